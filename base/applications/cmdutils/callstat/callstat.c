@@ -0,0 +1,285 @@
+/*
+ * PROJECT:     ReactOS System Call Statistics Utility
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Prints the most called system services every interval
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define WIN32_NO_STATUS
+#include <windef.h>
+#include <winbase.h>
+#define NTOS_MODE_USER
+#include <ndk/exfuncs.h>
+#include <ndk/rtlfuncs.h>
+
+#define DEFAULT_TOP_COUNT 20
+#define DEFAULT_INTERVAL 1
+
+static PCSTR NtServiceNames[] =
+{
+#define SVC_(name, argcount) "Nt" #name,
+#include <sysfuncs.h>
+#undef SVC_
+};
+
+static PCSTR Win32kServiceNames[] =
+{
+#define SVC_(name, argcount) "Nt" #name,
+#include <w32ksvc.h>
+#undef SVC_
+};
+
+typedef struct _CALL_SNAPSHOT
+{
+    PSYSTEM_CALL_COUNT_INFORMATION Counts;
+    PSYSTEM_CALL_TIME_INFORMATION Times;
+} CALL_SNAPSHOT, *PCALL_SNAPSHOT;
+
+typedef struct _SERVICE_DELTA
+{
+    ULONG Table;
+    ULONG Id;
+    ULONG Calls;
+    ULONG64 Cycles;
+} SERVICE_DELTA, *PSERVICE_DELTA;
+
+static
+PVOID
+QueryInformation(
+    _In_ SYSTEM_INFORMATION_CLASS InformationClass,
+    _Out_ PNTSTATUS Status)
+{
+    PVOID Buffer = NULL;
+    ULONG Length = 0;
+
+    /* The tables can only grow, so retry until the buffer is big enough */
+    for (;;)
+    {
+        *Status = NtQuerySystemInformation(InformationClass, Buffer, Length, &Length);
+        if (*Status != STATUS_INFO_LENGTH_MISMATCH)
+            break;
+
+        free(Buffer);
+        Buffer = malloc(Length);
+        if (!Buffer)
+        {
+            *Status = STATUS_NO_MEMORY;
+            break;
+        }
+    }
+
+    if (!NT_SUCCESS(*Status))
+    {
+        free(Buffer);
+        Buffer = NULL;
+    }
+
+    return Buffer;
+}
+
+static
+BOOL
+TakeSnapshot(
+    _Out_ PCALL_SNAPSHOT Snapshot)
+{
+    NTSTATUS Status;
+
+    Snapshot->Counts = QueryInformation(SystemCallCountInformation, &Status);
+    if (!Snapshot->Counts)
+    {
+        if (Status == STATUS_NOT_IMPLEMENTED)
+        {
+            fprintf(stderr, "System call statistics are off. Set the REG_DWORD value\n"
+                            "HKLM\\SYSTEM\\CurrentControlSet\\Control\\Session Manager\\Kernel\\SystemCallStatistics\n"
+                            "to 1 to count calls, or 3 to also time them, then reboot.\n");
+        }
+        else
+        {
+            fprintf(stderr, "Failed to query the call counts: 0x%08lx\n", Status);
+        }
+        return FALSE;
+    }
+
+    /* Timing is optional */
+    Snapshot->Times = QueryInformation(SystemCallTimeInformation, &Status);
+    return TRUE;
+}
+
+static
+VOID
+FreeSnapshot(
+    _Inout_ PCALL_SNAPSHOT Snapshot)
+{
+    free(Snapshot->Counts);
+    free(Snapshot->Times);
+    Snapshot->Counts = NULL;
+    Snapshot->Times = NULL;
+}
+
+static
+PCSTR
+GetServiceName(
+    _In_ ULONG Table,
+    _In_ ULONG Id,
+    _Out_writes_(NameLength) PSTR NameBuffer,
+    _In_ ULONG NameLength)
+{
+    if (Table == 0 && Id < _countof(NtServiceNames))
+        return NtServiceNames[Id];
+    if (Table == 1 && Id < _countof(Win32kServiceNames))
+        return Win32kServiceNames[Id];
+
+    _snprintf(NameBuffer, NameLength, "Table%lu!%lu", Table, Id);
+    NameBuffer[NameLength - 1] = ANSI_NULL;
+    return NameBuffer;
+}
+
+static
+int
+__cdecl
+CompareDeltas(
+    _In_ const void *First,
+    _In_ const void *Second)
+{
+    const SERVICE_DELTA *A = First, *B = Second;
+
+    if (A->Calls != B->Calls)
+        return (A->Calls < B->Calls) ? 1 : -1;
+    return (A->Cycles < B->Cycles) ? 1 : (A->Cycles > B->Cycles) ? -1 : 0;
+}
+
+static
+VOID
+PrintTopServices(
+    _In_ PCALL_SNAPSHOT Old,
+    _In_ PCALL_SNAPSHOT New,
+    _In_ ULONG TopCount,
+    _In_ ULONG Interval)
+{
+    PULONG OldEntries, NewEntries, OldCounts, NewCounts;
+    PSERVICE_DELTA Deltas;
+    ULONG Tables, Table, Id, Total = 0, Count = 0, i;
+    ULONG OldIndex = 0, NewIndex = 0;
+    BOOL Timed;
+    CHAR NameBuffer[32];
+
+    Tables = New->Counts->NumberOfTables;
+    NewEntries = (PULONG)(New->Counts + 1);
+    NewCounts = NewEntries + Tables;
+    OldEntries = (PULONG)(Old->Counts + 1);
+    OldCounts = OldEntries + Old->Counts->NumberOfTables;
+    Timed = (Old->Times && New->Times);
+
+    for (Table = 0; Table < Tables; Table++)
+        Total += NewEntries[Table];
+
+    Deltas = malloc(max(Total, 1) * sizeof(SERVICE_DELTA));
+    if (!Deltas)
+        return;
+
+    for (Table = 0; Table < Tables; Table++)
+    {
+        for (Id = 0; Id < NewEntries[Table]; Id++, NewIndex++)
+        {
+            Deltas[Count].Table = Table;
+            Deltas[Count].Id = Id;
+            Deltas[Count].Calls = NewCounts[NewIndex];
+            Deltas[Count].Cycles = Timed && NewIndex < New->Times->TotalCalls ?
+                                   New->Times->TimeOfCalls[NewIndex].QuadPart : 0;
+
+            /* A table that showed up since the last interval started from zero */
+            if (Table < Old->Counts->NumberOfTables && Id < OldEntries[Table])
+            {
+                Deltas[Count].Calls -= OldCounts[OldIndex + Id];
+                if (Timed && OldIndex + Id < Old->Times->TotalCalls)
+                    Deltas[Count].Cycles -= Old->Times->TimeOfCalls[OldIndex + Id].QuadPart;
+            }
+
+            if (Deltas[Count].Calls)
+                Count++;
+        }
+
+        if (Table < Old->Counts->NumberOfTables)
+            OldIndex += OldEntries[Table];
+    }
+
+    qsort(Deltas, Count, sizeof(SERVICE_DELTA), CompareDeltas);
+
+    printf("\n%12s %14s  %s\n", "Calls/s", Timed ? "Cycles/call" : "", "Service");
+    for (i = 0; i < min(Count, TopCount); i++)
+    {
+        printf("%12lu ", Deltas[i].Calls / Interval);
+        if (Timed)
+            printf("%14I64u  ", Deltas[i].Cycles / Deltas[i].Calls);
+        else
+            printf("%14s  ", "");
+        printf("%s\n", GetServiceName(Deltas[i].Table, Deltas[i].Id, NameBuffer, sizeof(NameBuffer)));
+    }
+
+    free(Deltas);
+}
+
+static
+VOID
+PrintUsage(VOID)
+{
+    printf("Prints the most called system services.\n\n"
+           "CALLSTAT [-n count] [-i seconds]\n\n"
+           "  -n count    Number of services to print, %u by default.\n"
+           "  -i seconds  Sampling interval, %u by default.\n\n"
+           "Press Ctrl+C to stop.\n",
+           DEFAULT_TOP_COUNT, DEFAULT_INTERVAL);
+}
+
+int main(int argc, char *argv[])
+{
+    CALL_SNAPSHOT Old, New;
+    ULONG TopCount = DEFAULT_TOP_COUNT, Interval = DEFAULT_INTERVAL;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if ((argv[i][0] == '-' || argv[i][0] == '/') && i + 1 < argc)
+        {
+            if (argv[i][1] == 'n')
+            {
+                TopCount = strtoul(argv[++i], NULL, 10);
+                continue;
+            }
+            if (argv[i][1] == 'i')
+            {
+                Interval = strtoul(argv[++i], NULL, 10);
+                continue;
+            }
+        }
+
+        PrintUsage();
+        return 1;
+    }
+
+    if (!TopCount || !Interval)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    if (!TakeSnapshot(&Old))
+        return 1;
+
+    for (;;)
+    {
+        Sleep(Interval * 1000);
+
+        if (!TakeSnapshot(&New))
+            break;
+
+        PrintTopServices(&Old, &New, TopCount, Interval);
+        FreeSnapshot(&Old);
+        Old = New;
+    }
+
+    FreeSnapshot(&Old);
+    return 1;
+}
@@ -106,6 +106,34 @@ StartUserShell(
 }
 
 
+static VOID
+ReportShellReady(VOID)
+{
+    PREFETCHER_INFORMATION Information;
+    ULONG Phase = PfUserShellReadyPhase;
+    BOOLEAN Old;
+    NTSTATUS Status;
+
+    /* The shell is up, so the kernel can stop tracing the boot */
+    RtlAdjustPrivilege(SE_PROF_SINGLE_PROCESS_PRIVILEGE, TRUE, FALSE, &Old);
+
+    Information.Version = PREFETCHER_INFORMATION_VERSION;
+    Information.Magic = PREFETCHER_INFORMATION_MAGIC;
+    Information.PrefetcherInformationClass = PrefetcherBootPhase;
+    Information.PrefetcherInformation = &Phase;
+    Information.PrefetcherInformationLength = sizeof(Phase);
+
+    /* Only the first logon ends the boot, the later ones fail harmlessly */
+    Status = NtSetSystemInformation(SystemPrefetcherInformation,
+                                    &Information,
+                                    sizeof(Information));
+    if (!NT_SUCCESS(Status))
+        TRACE("WL: Boot phase not set (Status 0x%08lx)\n", Status);
+
+    RtlAdjustPrivilege(SE_PROF_SINGLE_PROCESS_PRIVILEGE, Old, FALSE, &Old);
+}
+
+
 BOOL
 SetDefaultLanguage(
     IN PWLSESSION Session)
@@ -647,6 +675,7 @@ HandleLogon(
     }
 
     CallNotificationDlls(Session, StartShellHandler);
+    ReportShellReady();
 
     if (!InitializeScreenSaver(Session))
         WARN("WL: Failed to initialize screen saver\n");
@@ -6,12 +6,458 @@
 
 #include <wmistr.h>
 #include <evntrace.h>
+#include <winioctl.h>
+#include <wmiioctl.h>
 
 #define NDEBUG
 #include <debug.h>
 
 #define FIXME DPRINT1
 
+/* Room for the names the kernel returns with the logger information */
+#define ETWP_NAMES_LENGTH (2 * 1024 * sizeof(WCHAR))
+
+C_ASSERT(sizeof(EVENT_TRACE_PROPERTIES) == sizeof(WMI_LOGGER_INFORMATION));
+
+typedef struct _ETWP_REGISTRATION
+{
+    HANDLE DeviceHandle;
+    HANDLE EventHandle;
+    HANDLE WaitHandle;
+    GUID ControlGuid;
+    WMIDPREQUEST RequestAddress;
+    PVOID RequestContext;
+    RTL_CRITICAL_SECTION NotifyLock;
+    TRACEHANDLE EnableContext;
+} ETWP_REGISTRATION, *PETWP_REGISTRATION;
+
+static HANDLE EtwpControlHandle;
+
+static
+NTSTATUS
+EtwpOpenDevice(
+    _Out_ PHANDLE DeviceHandle)
+{
+    UNICODE_STRING DeviceName = RTL_CONSTANT_STRING(L"\\Device\\WMIDataDevice");
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatusBlock;
+
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &DeviceName,
+                               OBJ_CASE_INSENSITIVE,
+                               NULL,
+                               NULL);
+
+    return NtOpenFile(DeviceHandle,
+                      SYNCHRONIZE,
+                      &ObjectAttributes,
+                      &IoStatusBlock,
+                      FILE_SHARE_READ | FILE_SHARE_WRITE,
+                      FILE_SYNCHRONOUS_IO_NONALERT);
+}
+
+static
+NTSTATUS
+EtwpDeviceControl(
+    _In_opt_ HANDLE DeviceHandle,
+    _In_ ULONG IoControlCode,
+    _In_opt_ PVOID InputBuffer,
+    _In_ ULONG InputLength,
+    _Out_opt_ PVOID OutputBuffer,
+    _In_ ULONG OutputLength)
+{
+    IO_STATUS_BLOCK IoStatusBlock;
+    HANDLE Handle;
+    NTSTATUS Status;
+
+    /* Control requests share one handle, opened on first use */
+    if (DeviceHandle == NULL)
+    {
+        if (EtwpControlHandle == NULL)
+        {
+            Status = EtwpOpenDevice(&Handle);
+            if (!NT_SUCCESS(Status))
+                return Status;
+
+            if (InterlockedCompareExchangePointer(&EtwpControlHandle, Handle, NULL) != NULL)
+                NtClose(Handle);
+        }
+
+        DeviceHandle = EtwpControlHandle;
+    }
+
+    return NtDeviceIoControlFile(DeviceHandle,
+                                 NULL,
+                                 NULL,
+                                 NULL,
+                                 &IoStatusBlock,
+                                 IoControlCode,
+                                 InputBuffer,
+                                 InputLength,
+                                 OutputBuffer,
+                                 OutputLength);
+}
+
+static
+BOOLEAN
+EtwpGetPropertiesString(
+    _In_ PEVENT_TRACE_PROPERTIES Properties,
+    _In_ ULONG Offset,
+    _In_ BOOLEAN Ansi,
+    _Out_ PUNICODE_STRING String)
+{
+    ANSI_STRING AnsiString;
+
+    RtlInitEmptyUnicodeString(String, NULL, 0);
+    if ((Offset == 0) || (Offset >= Properties->Wnode.BufferSize))
+        return TRUE;
+
+    if (!Ansi)
+    {
+        RtlInitUnicodeString(String, (PCWSTR)((PUCHAR)Properties + Offset));
+        return TRUE;
+    }
+
+    RtlInitAnsiString(&AnsiString, (PCSZ)((PUCHAR)Properties + Offset));
+    return NT_SUCCESS(RtlAnsiStringToUnicodeString(String, &AnsiString, TRUE));
+}
+
+static
+VOID
+EtwpCopyOutString(
+    _Inout_ PEVENT_TRACE_PROPERTIES Properties,
+    _In_ ULONG Offset,
+    _In_ PWMI_LOGGER_INFORMATION LoggerInfo,
+    _In_ ULONG InfoOffset,
+    _In_ BOOLEAN Ansi)
+{
+    UNICODE_STRING String;
+    ULONG MaximumLength, Length;
+    PUCHAR Buffer;
+
+    if ((Offset < sizeof(EVENT_TRACE_PROPERTIES)) ||
+        (Offset >= Properties->Wnode.BufferSize) ||
+        (InfoOffset == 0))
+    {
+        return;
+    }
+
+    /* Log files come back as NT paths */
+    RtlInitUnicodeString(&String, (PCWSTR)((PUCHAR)LoggerInfo + InfoOffset));
+    if ((String.Length >= 4 * sizeof(WCHAR)) && !wcsncmp(String.Buffer, L"\\??\\", 4))
+    {
+        String.Buffer += 4;
+        String.Length -= 4 * sizeof(WCHAR);
+    }
+
+    Buffer = (PUCHAR)Properties + Offset;
+    MaximumLength = Properties->Wnode.BufferSize - Offset;
+
+    if (Ansi)
+    {
+        RtlUnicodeToMultiByteN((PCHAR)Buffer, MaximumLength - 1, &Length, String.Buffer, String.Length);
+        Buffer[Length] = ANSI_NULL;
+    }
+    else
+    {
+        Length = min(String.Length, MaximumLength - sizeof(WCHAR)) & ~1;
+        RtlCopyMemory(Buffer, String.Buffer, Length);
+        *(PWCHAR)(Buffer + Length) = UNICODE_NULL;
+    }
+}
+
+static
+VOID
+EtwpCopyOutProperties(
+    _Inout_ PEVENT_TRACE_PROPERTIES Properties,
+    _In_ PWMI_LOGGER_INFORMATION LoggerInfo,
+    _In_ BOOLEAN CopyNames,
+    _In_ BOOLEAN Ansi)
+{
+    ULONG BufferSize = Properties->Wnode.BufferSize;
+    ULONG LogFileNameOffset = Properties->LogFileNameOffset;
+    ULONG LoggerNameOffset = Properties->LoggerNameOffset;
+
+    /* Take the settings and statistics, but keep the caller's layout */
+    RtlCopyMemory(Properties, LoggerInfo, sizeof(EVENT_TRACE_PROPERTIES));
+    Properties->Wnode.BufferSize = BufferSize;
+    Properties->LogFileNameOffset = LogFileNameOffset;
+    Properties->LoggerNameOffset = LoggerNameOffset;
+
+    if (CopyNames)
+    {
+        EtwpCopyOutString(Properties, LoggerNameOffset, LoggerInfo, LoggerInfo->LoggerNameOffset, Ansi);
+        EtwpCopyOutString(Properties, LogFileNameOffset, LoggerInfo, LoggerInfo->LogFileNameOffset, Ansi);
+    }
+}
+
+static
+ULONG
+EtwpLoggerControl(
+    _In_ ULONG IoControlCode,
+    _In_ TRACEHANDLE TraceHandle,
+    _In_opt_ PCUNICODE_STRING LoggerName,
+    _In_opt_ PCUNICODE_STRING LogFileName,
+    _Inout_ PEVENT_TRACE_PROPERTIES Properties,
+    _In_ BOOLEAN Ansi)
+{
+    PWMI_LOGGER_INFORMATION LoggerInfo;
+    ULONG InputLength, Length, Offset;
+    NTSTATUS Status;
+
+    /* The names are passed inline after the structure */
+    InputLength = sizeof(WMI_LOGGER_INFORMATION);
+    if (LoggerName != NULL)
+        InputLength += LoggerName->Length + sizeof(WCHAR);
+    if (LogFileName != NULL)
+        InputLength += LogFileName->Length + sizeof(WCHAR);
+    Length = max(InputLength, sizeof(WMI_LOGGER_INFORMATION) + ETWP_NAMES_LENGTH);
+
+    LoggerInfo = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, Length);
+    if (LoggerInfo == NULL)
+        return ERROR_NOT_ENOUGH_MEMORY;
+
+    RtlCopyMemory(LoggerInfo, Properties, sizeof(EVENT_TRACE_PROPERTIES));
+    LoggerInfo->Wnode.BufferSize = InputLength;
+    LoggerInfo->Wnode.HistoricalContext = TraceHandle;
+    LoggerInfo->LoggerNameOffset = 0;
+    LoggerInfo->LogFileNameOffset = 0;
+
+    Offset = sizeof(WMI_LOGGER_INFORMATION);
+    if (LoggerName != NULL)
+    {
+        LoggerInfo->LoggerNameOffset = Offset;
+        RtlCopyMemory((PUCHAR)LoggerInfo + Offset, LoggerName->Buffer, LoggerName->Length);
+        Offset += LoggerName->Length + sizeof(WCHAR);
+    }
+    if (LogFileName != NULL)
+    {
+        LoggerInfo->LogFileNameOffset = Offset;
+        RtlCopyMemory((PUCHAR)LoggerInfo + Offset, LogFileName->Buffer, LogFileName->Length);
+    }
+
+    Status = EtwpDeviceControl(NULL,
+                               IoControlCode,
+                               LoggerInfo,
+                               InputLength,
+                               LoggerInfo,
+                               Length);
+    if (NT_SUCCESS(Status))
+    {
+        EtwpCopyOutProperties(Properties,
+                              LoggerInfo,
+                              IoControlCode != IOCTL_WMI_START_LOGGER,
+                              Ansi);
+    }
+
+    RtlFreeHeap(RtlGetProcessHeap(), 0, LoggerInfo);
+    return RtlNtStatusToDosError(Status);
+}
+
+static
+ULONG
+EtwpStartTrace(
+    _Out_ PTRACEHANDLE SessionHandle,
+    _In_ PCUNICODE_STRING SessionName,
+    _Inout_ PEVENT_TRACE_PROPERTIES Properties,
+    _In_ BOOLEAN Ansi)
+{
+    UNICODE_STRING LogFileName, NtFileName;
+    PUNICODE_STRING NtFileNamePtr = NULL;
+    ULONG Error;
+
+    if ((Properties->Wnode.BufferSize < sizeof(EVENT_TRACE_PROPERTIES)) ||
+        !(Properties->Wnode.Flags & WNODE_FLAG_TRACED_GUID))
+    {
+        return ERROR_BAD_LENGTH;
+    }
+
+    if (!EtwpGetPropertiesString(Properties, Properties->LogFileNameOffset, Ansi, &LogFileName))
+        return ERROR_NOT_ENOUGH_MEMORY;
+
+    /* The kernel opens the log file, so it needs its NT path */
+    if (LogFileName.Length != 0)
+    {
+        if (!RtlDosPathNameToNtPathName_U(LogFileName.Buffer, &NtFileName, NULL, NULL))
+        {
+            if (Ansi)
+                RtlFreeUnicodeString(&LogFileName);
+            return ERROR_BAD_PATHNAME;
+        }
+
+        NtFileNamePtr = &NtFileName;
+    }
+
+    Error = EtwpLoggerControl(IOCTL_WMI_START_LOGGER,
+                              0,
+                              SessionName,
+                              NtFileNamePtr,
+                              Properties,
+                              Ansi);
+    if (Error == ERROR_SUCCESS)
+    {
+        *SessionHandle = Properties->Wnode.HistoricalContext;
+    }
+
+    if (NtFileNamePtr != NULL)
+        RtlFreeUnicodeString(&NtFileName);
+    if (Ansi)
+        RtlFreeUnicodeString(&LogFileName);
+
+    return Error;
+}
+
+static
+ULONG
+EtwpControlTrace(
+    _In_ TRACEHANDLE SessionHandle,
+    _In_opt_ PCUNICODE_STRING SessionName,
+    _Inout_ PEVENT_TRACE_PROPERTIES Properties,
+    _In_ ULONG Control,
+    _In_ BOOLEAN Ansi)
+{
+    ULONG IoControlCode;
+
+    if (!Properties || (Properties->Wnode.BufferSize < sizeof(EVENT_TRACE_PROPERTIES)))
+        return ERROR_BAD_LENGTH;
+
+    if (!SessionHandle && (!SessionName || !SessionName->Length))
+        return ERROR_INVALID_PARAMETER;
+
+    switch (Control)
+    {
+        case EVENT_TRACE_CONTROL_QUERY:
+            IoControlCode = IOCTL_WMI_QUERY_LOGGER;
+            break;
+
+        case EVENT_TRACE_CONTROL_STOP:
+            IoControlCode = IOCTL_WMI_STOP_LOGGER;
+            break;
+
+        case EVENT_TRACE_CONTROL_UPDATE:
+            IoControlCode = IOCTL_WMI_UPDATE_LOGGER;
+            break;
+
+        case EVENT_TRACE_CONTROL_FLUSH:
+            IoControlCode = IOCTL_WMI_FLUSH_LOGGER;
+            break;
+
+        default:
+            return ERROR_INVALID_PARAMETER;
+    }
+
+    return EtwpLoggerControl(IoControlCode,
+                             SessionHandle,
+                             SessionHandle ? NULL : SessionName,
+                             NULL,
+                             Properties,
+                             Ansi);
+}
+
+static
+ULONG
+EtwpQueryAllTraces(
+    _Inout_ PEVENT_TRACE_PROPERTIES *PropertiesArray,
+    _In_ ULONG PropertiesArrayCount,
+    _Out_ PULONG SessionCount,
+    _In_ BOOLEAN Ansi)
+{
+    EVENT_TRACE_PROPERTIES Properties;
+    ULONG LoggerId, Count = 0;
+
+    if (!PropertiesArray || !SessionCount)
+        return ERROR_INVALID_PARAMETER;
+
+    /* Logger ids are the handles, just ask for each of them */
+    for (LoggerId = 1; LoggerId < WMI_MAXIMUM_LOGGERS; LoggerId++)
+    {
+        RtlZeroMemory(&Properties, sizeof(Properties));
+        Properties.Wnode.BufferSize = sizeof(Properties);
+        Properties.Wnode.Flags = WNODE_FLAG_TRACED_GUID;
+
+        if (EtwpLoggerControl(IOCTL_WMI_QUERY_LOGGER,
+                              LoggerId,
+                              NULL,
+                              NULL,
+                              (Count < PropertiesArrayCount) ?
+                                  PropertiesArray[Count] : &Properties,
+                              Ansi) == ERROR_SUCCESS)
+        {
+            Count++;
+        }
+    }
+
+    *SessionCount = Count;
+    return (Count > PropertiesArrayCount) ? ERROR_MORE_DATA : ERROR_SUCCESS;
+}
+
+/*
+ * Runs inline from the registration and from the thread pool whenever the
+ * enable state changes. The lock keeps the provider from seeing two
+ * notifications at once, or the older one last.
+ */
+static
+VOID
+EtwpNotifyProvider(
+    _In_ PETWP_REGISTRATION Registration)
+{
+    WMI_QUERY_TRACE_ENABLE QueryTraceEnable;
+    PWMI_TRACE_ENABLE_CONTEXT NewContext, OldContext;
+    WNODE_HEADER Wnode;
+    ULONG BufferSize;
+    NTSTATUS Status;
+
+    RtlEnterCriticalSection(&Registration->NotifyLock);
+
+    Status = EtwpDeviceControl(Registration->DeviceHandle,
+                               IOCTL_WMI_QUERY_TRACE_ENABLE,
+                               NULL,
+                               0,
+                               &QueryTraceEnable,
+                               sizeof(QueryTraceEnable));
+    if (!NT_SUCCESS(Status))
+        goto Quit;
+
+    /* A new session, level or set of flags all need a new enable notification */
+    NewContext = (PWMI_TRACE_ENABLE_CONTEXT)&QueryTraceEnable.EnableContext;
+    OldContext = (PWMI_TRACE_ENABLE_CONTEXT)&Registration->EnableContext;
+    if ((NewContext->LoggerId == OldContext->LoggerId) &&
+        (NewContext->Level == OldContext->Level) &&
+        (NewContext->EnableFlags == OldContext->EnableFlags))
+    {
+        goto Quit;
+    }
+
+    /* The provider keeps the context as its logger handle */
+    Registration->EnableContext = QueryTraceEnable.EnableContext;
+
+    RtlZeroMemory(&Wnode, sizeof(Wnode));
+    Wnode.BufferSize = sizeof(Wnode);
+    Wnode.HistoricalContext = QueryTraceEnable.EnableContext;
+    Wnode.Guid = Registration->ControlGuid;
+    Wnode.Flags = WNODE_FLAG_TRACED_GUID;
+    BufferSize = sizeof(Wnode);
+
+    Registration->RequestAddress(QueryTraceEnable.EnableContext ?
+                                     WMI_ENABLE_EVENTS : WMI_DISABLE_EVENTS,
+                                 Registration->RequestContext,
+                                 &BufferSize,
+                                 &Wnode);
+
+Quit:
+    RtlLeaveCriticalSection(&Registration->NotifyLock);
+}
+
+static
+VOID
+NTAPI
+EtwpEnableCallback(
+    _In_ PVOID Context,
+    _In_ BOOLEAN TimerOrWaitFired)
+{
+    EtwpNotifyProvider(Context);
+}
+
 /*
  * @unimplemented
  */
@@ -27,17 +473,27 @@ EtwTraceMessage(
     return ERROR_SUCCESS;
 }
 
+/*
+ * @implemented
+ */
 TRACEHANDLE
 NTAPI
 EtwGetTraceLoggerHandle(
     PVOID Buffer
 )
 {
-    FIXME("EtwGetTraceLoggerHandle stub()\n");
-    return (TRACEHANDLE)-1;
-}
+    if (!Buffer)
+    {
+        RtlSetLastWin32Error(ERROR_INVALID_PARAMETER);
+        return (TRACEHANDLE)(LONG_PTR)INVALID_HANDLE_VALUE;
+    }
 
+    return ((PWNODE_HEADER)Buffer)->HistoricalContext;
+}
 
+/*
+ * @implemented
+ */
 ULONG
 NTAPI
 EtwTraceEvent(
@@ -45,7 +501,7 @@ EtwTraceEvent(
     PEVENT_TRACE_HEADER EventTrace
 )
 {
-    FIXME("EtwTraceEvent stub()\n");
+    NTSTATUS Status;
 
     if (!SessionHandle || !EventTrace)
     {
@@ -53,91 +509,216 @@ EtwTraceEvent(
         return ERROR_INVALID_PARAMETER;
     }
 
-    if (EventTrace->Size != sizeof(EVENT_TRACE_HEADER))
+    if (EventTrace->Size < sizeof(EVENT_TRACE_HEADER))
     {
         /* invalid parameter */
         return ERROR_INVALID_PARAMETER;
     }
 
-    return ERROR_SUCCESS;
+    /* Provider handles carry the logger id in the low word, like session handles */
+    Status = NtTraceEvent((ULONG)SessionHandle,
+                          0,
+                          sizeof(EVENT_TRACE_HEADER),
+                          EventTrace);
+
+    return RtlNtStatusToDosError(Status);
 }
 
+/*
+ * @implemented
+ */
 ULONG
 NTAPI
 EtwGetTraceEnableFlags(
     TRACEHANDLE TraceHandle
 )
 {
-    FIXME("EtwGetTraceEnableFlags stub()\n");
-    return 0xFF;
+    return ((PWMI_TRACE_ENABLE_CONTEXT)&TraceHandle)->EnableFlags;
 }
 
+/*
+ * @implemented
+ */
 UCHAR
 NTAPI
 EtwGetTraceEnableLevel(
     TRACEHANDLE TraceHandle
 )
 {
-    FIXME("EtwGetTraceEnableLevel stub()\n");
-    return 0xFF;
+    return ((PWMI_TRACE_ENABLE_CONTEXT)&TraceHandle)->Level;
 }
 
+/*
+ * @implemented
+ */
 ULONG
 NTAPI
 EtwUnregisterTraceGuids(
     TRACEHANDLE RegistrationHandle
 )
 {
-    FIXME("EtwUnregisterTraceGuids stub()\n");
+    PETWP_REGISTRATION Registration = (PETWP_REGISTRATION)(ULONG_PTR)RegistrationHandle;
+
+    if (!Registration)
+        return ERROR_INVALID_PARAMETER;
+
+    /* Make sure no callback is running, then drop the registration */
+    RtlDeregisterWaitEx(Registration->WaitHandle, INVALID_HANDLE_VALUE);
+    NtClose(Registration->DeviceHandle);
+    NtClose(Registration->EventHandle);
+    RtlDeleteCriticalSection(&Registration->NotifyLock);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Registration);
+
     return ERROR_SUCCESS;
 }
 
+/*
+ * @implemented
+ */
 ULONG
 NTAPI
-EtwRegisterTraceGuidsA(
+EtwRegisterTraceGuidsW(
     WMIDPREQUEST RequestAddress,
     PVOID RequestContext,
     LPCGUID ControlGuid,
     ULONG GuidCount,
     PTRACE_GUID_REGISTRATION TraceGuidReg,
-    LPCSTR MofImagePath,
-    LPCSTR MofResourceName,
+    LPCWSTR MofImagePath,
+    LPCWSTR MofResourceName,
     PTRACEHANDLE RegistrationHandle
 )
 {
-    FIXME("EtwRegisterTraceGuidsA stub()\n");
+    PETWP_REGISTRATION Registration;
+    WMI_REGISTER_TRACE_GUID RegisterTraceGuid;
+    NTSTATUS Status;
+    ULONG i;
+
+    if (!RequestAddress || !ControlGuid || !RegistrationHandle ||
+        (GuidCount && !TraceGuidReg))
+    {
+        return ERROR_INVALID_PARAMETER;
+    }
+
+    Registration = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*Registration));
+    if (!Registration)
+        return ERROR_NOT_ENOUGH_MEMORY;
+
+    Registration->ControlGuid = *ControlGuid;
+    Registration->RequestAddress = RequestAddress;
+    Registration->RequestContext = RequestContext;
+
+    Status = RtlInitializeCriticalSection(&Registration->NotifyLock);
+    if (!NT_SUCCESS(Status))
+    {
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Registration);
+        return RtlNtStatusToDosError(Status);
+    }
+
+    /* The registration lives as long as its own device handle */
+    Status = EtwpOpenDevice(&Registration->DeviceHandle);
+    if (!NT_SUCCESS(Status))
+        goto Cleanup;
+
+    Status = NtCreateEvent(&Registration->EventHandle,
+                           EVENT_ALL_ACCESS,
+                           NULL,
+                           SynchronizationEvent,
+                           FALSE);
+    if (!NT_SUCCESS(Status))
+        goto Cleanup;
+
+    RegisterTraceGuid.ControlGuid = *ControlGuid;
+    RegisterTraceGuid.EventHandle = Registration->EventHandle;
+    Status = EtwpDeviceControl(Registration->DeviceHandle,
+                               IOCTL_WMI_REGISTER_TRACE_GUID,
+                               &RegisterTraceGuid,
+                               sizeof(RegisterTraceGuid),
+                               NULL,
+                               0);
+    if (!NT_SUCCESS(Status))
+        goto Cleanup;
+
+    for (i = 0; i < GuidCount; i++)
+    {
+        TraceGuidReg[i].RegHandle = Registration;
+    }
+
+    /* Catch up if a session already enabled us, then follow the changes */
+    EtwpNotifyProvider(Registration);
+    Status = RtlRegisterWait(&Registration->WaitHandle,
+                             Registration->EventHandle,
+                             EtwpEnableCallback,
+                             Registration,
+                             INFINITE,
+                             WT_EXECUTELONGFUNCTION);
+    if (!NT_SUCCESS(Status))
+        goto Cleanup;
+
+    *RegistrationHandle = (TRACEHANDLE)(ULONG_PTR)Registration;
     return ERROR_SUCCESS;
+
+Cleanup:
+    if (Registration->EventHandle)
+        NtClose(Registration->EventHandle);
+    if (Registration->DeviceHandle)
+        NtClose(Registration->DeviceHandle);
+    RtlDeleteCriticalSection(&Registration->NotifyLock);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Registration);
+    return RtlNtStatusToDosError(Status);
 }
 
+/*
+ * @implemented
+ */
 ULONG
 NTAPI
-EtwRegisterTraceGuidsW(
+EtwRegisterTraceGuidsA(
     WMIDPREQUEST RequestAddress,
     PVOID RequestContext,
     LPCGUID ControlGuid,
     ULONG GuidCount,
     PTRACE_GUID_REGISTRATION TraceGuidReg,
-    LPCWSTR MofImagePath,
-    LPCWSTR MofResourceName,
+    LPCSTR MofImagePath,
+    LPCSTR MofResourceName,
     PTRACEHANDLE RegistrationHandle
 )
 {
-    FIXME("EtwRegisterTraceGuidsW stub()\n");
-    return ERROR_SUCCESS;
+    /* The MOF names are ignored anyway */
+    return EtwRegisterTraceGuidsW(RequestAddress,
+                                  RequestContext,
+                                  ControlGuid,
+                                  GuidCount,
+                                  TraceGuidReg,
+                                  NULL,
+                                  NULL,
+                                  RegistrationHandle);
 }
 
 ULONG WINAPI EtwStartTraceW( PTRACEHANDLE pSessionHandle, LPCWSTR SessionName, PEVENT_TRACE_PROPERTIES Properties )
 {
-    FIXME("(%p, %s, %p) stub\n", pSessionHandle, SessionName, Properties);
-    if (pSessionHandle) *pSessionHandle = 0xcafe4242;
-    return ERROR_SUCCESS;
+    UNICODE_STRING Name;
+
+    if (!pSessionHandle || !SessionName || !Properties)
+        return ERROR_INVALID_PARAMETER;
+
+    RtlInitUnicodeString(&Name, SessionName);
+    return EtwpStartTrace(pSessionHandle, &Name, Properties, FALSE);
 }
 
 ULONG WINAPI EtwStartTraceA( PTRACEHANDLE pSessionHandle, LPCSTR SessionName, PEVENT_TRACE_PROPERTIES Properties )
 {
-    FIXME("(%p, %s, %p) stub\n", pSessionHandle, SessionName, Properties);
-    if (pSessionHandle) *pSessionHandle = 0xcafe4242;
-    return ERROR_SUCCESS;
+    UNICODE_STRING Name;
+    ULONG Error;
+
+    if (!pSessionHandle || !SessionName || !Properties)
+        return ERROR_INVALID_PARAMETER;
+
+    if (!RtlCreateUnicodeStringFromAsciiz(&Name, SessionName))
+        return ERROR_NOT_ENOUGH_MEMORY;
+
+    Error = EtwpStartTrace(pSessionHandle, &Name, Properties, TRUE);
+    RtlFreeUnicodeString(&Name);
+    return Error;
 }
 
 /******************************************************************************
@@ -148,8 +729,10 @@ ULONG WINAPI EtwStartTraceA( PTRACEHANDLE pSessionHandle, LPCSTR SessionName, PE
  */
 ULONG WINAPI EtwControlTraceW( TRACEHANDLE hSession, LPCWSTR SessionName, PEVENT_TRACE_PROPERTIES Properties, ULONG control )
 {
-    FIXME("(%I64x, %s, %p, %d) stub\n", hSession, SessionName, Properties, control);
-    return ERROR_SUCCESS;
+    UNICODE_STRING Name;
+
+    RtlInitUnicodeString(&Name, SessionName);
+    return EtwpControlTrace(hSession, &Name, Properties, control, FALSE);
 }
 
 /******************************************************************************
@@ -160,8 +743,16 @@ ULONG WINAPI EtwControlTraceW( TRACEHANDLE hSession, LPCWSTR SessionName, PEVENT
  */
 ULONG WINAPI EtwControlTraceA( TRACEHANDLE hSession, LPCSTR SessionName, PEVENT_TRACE_PROPERTIES Properties, ULONG control )
 {
-    FIXME("(%I64x, %s, %p, %d) stub\n", hSession, SessionName, Properties, control);
-    return ERROR_SUCCESS;
+    UNICODE_STRING Name;
+    ULONG Error;
+
+    RtlInitEmptyUnicodeString(&Name, NULL, 0);
+    if (SessionName && !RtlCreateUnicodeStringFromAsciiz(&Name, SessionName))
+        return ERROR_NOT_ENOUGH_MEMORY;
+
+    Error = EtwpControlTrace(hSession, &Name, Properties, control, TRUE);
+    RtlFreeUnicodeString(&Name);
+    return Error;
 }
 
 /******************************************************************************
@@ -169,10 +760,26 @@ ULONG WINAPI EtwControlTraceA( TRACEHANDLE hSession, LPCSTR SessionName, PEVENT_
  */
 ULONG WINAPI EtwEnableTrace( ULONG enable, ULONG flag, ULONG level, LPCGUID guid, TRACEHANDLE hSession )
 {
-    FIXME("(%d, 0x%x, %d, %p, %I64x): stub\n", enable, flag, level,
-            guid, hSession);
+    WMI_ENABLE_TRACE EnableTrace;
+    NTSTATUS Status;
 
-    return ERROR_SUCCESS;
+    if (!guid || !hSession)
+        return ERROR_INVALID_PARAMETER;
+
+    EnableTrace.ControlGuid = *guid;
+    EnableTrace.LoggerHandle = hSession;
+    EnableTrace.EnableFlags = flag;
+    EnableTrace.EnableLevel = (UCHAR)level;
+    EnableTrace.Enable = (enable != 0);
+
+    Status = EtwpDeviceControl(NULL,
+                               IOCTL_WMI_ENABLE_TRACE,
+                               &EnableTrace,
+                               sizeof(EnableTrace),
+                               NULL,
+                               0);
+
+    return RtlNtStatusToDosError(Status);
 }
 
 /******************************************************************************
@@ -183,10 +790,7 @@ ULONG WINAPI EtwEnableTrace( ULONG enable, ULONG flag, ULONG level, LPCGUID guid
  */
 ULONG WINAPI EtwQueryAllTracesW( PEVENT_TRACE_PROPERTIES * parray, ULONG arraycount, PULONG psessioncount )
 {
-    FIXME("(%p, %d, %p) stub\n", parray, arraycount, psessioncount);
-
-    if (psessioncount) *psessioncount = 0;
-    return ERROR_SUCCESS;
+    return EtwpQueryAllTraces(parray, arraycount, psessioncount, FALSE);
 }
 
 /******************************************************************************
@@ -196,10 +800,7 @@ ULONG WINAPI EtwQueryAllTracesW( PEVENT_TRACE_PROPERTIES * parray, ULONG arrayco
  */
 ULONG WINAPI EtwQueryAllTracesA( PEVENT_TRACE_PROPERTIES * parray, ULONG arraycount, PULONG psessioncount )
 {
-    FIXME("(%p, %d, %p) stub\n", parray, arraycount, psessioncount);
-
-    if (psessioncount) *psessioncount = 0;
-    return ERROR_SUCCESS;
+    return EtwpQueryAllTraces(parray, arraycount, psessioncount, TRUE);
 }
 
 /******************************************************************************
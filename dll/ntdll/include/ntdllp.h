@@ -8,8 +8,11 @@
 
 #pragma once
 
-#define LDR_HASH_TABLE_ENTRIES 32
-#define LDR_GET_HASH_ENTRY(x) (RtlUpcaseUnicodeChar((x)) & (LDR_HASH_TABLE_ENTRIES - 1))
+#define LDR_HASH_TABLE_ENTRIES 256
+
+/* Export name hash: only built for modules exporting at least this many names */
+#define LDRP_EXPORT_HASH_MIN_NAMES 32
+#define LDRP_EXPORT_HASH_BASE_BUCKETS 32
 
 /* LdrpUpdateLoadCount2 flags */
 #define LDRP_UPDATE_REFCOUNT   0x01
@@ -29,6 +32,18 @@ typedef struct _LDRP_TLS_DATA
     IMAGE_TLS_DIRECTORY TlsDirectory;
 } LDRP_TLS_DATA, *PLDRP_TLS_DATA;
 
+typedef struct _LDRP_EXPORT_HASH
+{
+    LIST_ENTRY Links;
+    PVOID ExportBase;
+    PIMAGE_EXPORT_DIRECTORY ExportDirectory;
+    ULONG NumberOfNames;
+    ULONG AddressOfNames;
+    ULONG TimeDateStamp;
+    ULONG BucketMask;
+    PULONG Buckets;
+} LDRP_EXPORT_HASH, *PLDRP_EXPORT_HASH;
+
 typedef
 NTSTATUS
 (NTAPI* PLDR_APP_COMPAT_DLL_REDIRECTION_CALLBACK_FUNCTION)(
@@ -92,6 +107,17 @@ LdrpSnapThunk(IN PVOID ExportBase,
               IN BOOLEAN Static,
               IN LPSTR DllName);
 
+USHORT NTAPI
+LdrpLookupExportName(IN LPSTR ImportName,
+                     IN PVOID ExportBase,
+                     IN PIMAGE_EXPORT_DIRECTORY ExportEntry);
+
+VOID NTAPI
+LdrpFreeExportHash(IN PVOID ExportBase);
+
+VOID NTAPI
+LdrpInitializeExportHash(VOID);
+
 NTSTATUS NTAPI
 LdrpWalkImportDescriptor(IN LPWSTR DllPath OPTIONAL,
                          IN PLDR_DATA_TABLE_ENTRY LdrEntry);
@@ -108,6 +134,9 @@ LdrpGetProcedureAddress(IN PVOID BaseAddress,
 PLDR_DATA_TABLE_ENTRY NTAPI
 LdrpAllocateDataTableEntry(IN PVOID BaseAddress);
 
+ULONG NTAPI
+LdrpGetHashEntry(IN PCUNICODE_STRING DllName);
+
 VOID NTAPI
 LdrpInsertMemoryTableEntry(IN PLDR_DATA_TABLE_ENTRY LdrEntry);
 
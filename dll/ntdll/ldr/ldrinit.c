@@ -1940,6 +1940,9 @@ LdrpInitializeProcess(IN PCONTEXT Context,
         InitializeListHead(&LdrpHashTable[i]);
     }
 
+    /* Initialize the export name hash lookup */
+    LdrpInitializeExportHash();
+
     /* Initialize the Loader Lock */
     // FIXME: What's the point of initing it manually, if two lines lower
     //        a call to RtlInitializeCriticalSection() is being made anyway?
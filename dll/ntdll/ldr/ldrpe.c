@@ -17,6 +17,7 @@
 
 PLDR_MANIFEST_PROBER_ROUTINE LdrpManifestProberRoutine;
 ULONG LdrpNormalSnap;
+LIST_ENTRY LdrpExportHashTable[LDRP_EXPORT_HASH_BASE_BUCKETS];
 
 /* FUNCTIONS *****************************************************************/
 
@@ -665,6 +666,204 @@ LdrpNameToOrdinal(IN LPSTR ImportName,
     return OrdinalTable[Next];
 }
 
+static
+ULONG
+LdrpHashExportName(IN LPSTR Name)
+{
+    ULONG Hash = 2166136261UL;
+
+    /* FNV-1a over the (case-sensitive) export name */
+    while (*Name)
+    {
+        Hash ^= (UCHAR)*Name++;
+        Hash *= 16777619UL;
+    }
+
+    return Hash;
+}
+
+VOID
+NTAPI
+LdrpInitializeExportHash(VOID)
+{
+    ULONG i;
+
+    /* Initialize the per-base buckets */
+    for (i = 0; i < LDRP_EXPORT_HASH_BASE_BUCKETS; i++)
+    {
+        InitializeListHead(&LdrpExportHashTable[i]);
+    }
+}
+
+static
+PLIST_ENTRY
+LdrpGetExportHashBucket(IN PVOID ExportBase)
+{
+    /* Images are 64K aligned, so skip the low bits */
+    return &LdrpExportHashTable[((ULONG_PTR)ExportBase >> 16) &
+                                (LDRP_EXPORT_HASH_BASE_BUCKETS - 1)];
+}
+
+static
+PLDRP_EXPORT_HASH
+LdrpFindExportHash(IN PVOID ExportBase)
+{
+    PLIST_ENTRY ListHead, ListEntry;
+    PLDRP_EXPORT_HASH ExportHash;
+
+    /* Nothing was ever built if the table wasn't set up yet */
+    ListHead = LdrpGetExportHashBucket(ExportBase);
+    if (!ListHead->Flink) return NULL;
+
+    /* Loop the bucket */
+    for (ListEntry = ListHead->Flink;
+         ListEntry != ListHead;
+         ListEntry = ListEntry->Flink)
+    {
+        ExportHash = CONTAINING_RECORD(ListEntry, LDRP_EXPORT_HASH, Links);
+        if (ExportHash->ExportBase == ExportBase) return ExportHash;
+    }
+
+    /* Not found */
+    return NULL;
+}
+
+VOID
+NTAPI
+LdrpFreeExportHash(IN PVOID ExportBase)
+{
+    PLDRP_EXPORT_HASH ExportHash;
+
+    /* Find the hash for this image and free it */
+    ExportHash = LdrpFindExportHash(ExportBase);
+    if (ExportHash)
+    {
+        RemoveEntryList(&ExportHash->Links);
+        RtlFreeHeap(LdrpHeap, 0, ExportHash);
+    }
+}
+
+static
+PLDRP_EXPORT_HASH
+LdrpGetExportHash(IN PVOID ExportBase,
+                  IN PIMAGE_EXPORT_DIRECTORY ExportEntry,
+                  IN PULONG NameTable)
+{
+    PLDRP_EXPORT_HASH ExportHash;
+    ULONG BucketCount, i, Index;
+
+    /* Check if we already have one, and that it still describes this image */
+    ExportHash = LdrpFindExportHash(ExportBase);
+    if (ExportHash)
+    {
+        if ((ExportHash->ExportDirectory == ExportEntry) &&
+            (ExportHash->NumberOfNames == ExportEntry->NumberOfNames) &&
+            (ExportHash->AddressOfNames == ExportEntry->AddressOfNames) &&
+            (ExportHash->TimeDateStamp == ExportEntry->TimeDateStamp))
+        {
+            return ExportHash;
+        }
+
+        /* Stale, a different image got mapped here. Rebuild it */
+        RemoveEntryList(&ExportHash->Links);
+        RtlFreeHeap(LdrpHeap, 0, ExportHash);
+    }
+
+    /* Make sure we can use the table at all */
+    if (!LdrpHeap || !LdrpExportHashTable[0].Flink) return NULL;
+
+    /* Use a power of two, keeping the load factor at or below 50% */
+    BucketCount = LDRP_EXPORT_HASH_MIN_NAMES;
+    while (BucketCount < (ExportEntry->NumberOfNames * 2))
+    {
+        BucketCount <<= 1;
+        if (!BucketCount) return NULL;
+    }
+
+    /* Allocate the header and the buckets in one go */
+    ExportHash = RtlAllocateHeap(LdrpHeap,
+                                 HEAP_ZERO_MEMORY,
+                                 sizeof(LDRP_EXPORT_HASH) +
+                                 BucketCount * sizeof(ULONG));
+    if (!ExportHash) return NULL;
+
+    /* Set it up */
+    ExportHash->ExportBase = ExportBase;
+    ExportHash->ExportDirectory = ExportEntry;
+    ExportHash->NumberOfNames = ExportEntry->NumberOfNames;
+    ExportHash->AddressOfNames = ExportEntry->AddressOfNames;
+    ExportHash->TimeDateStamp = ExportEntry->TimeDateStamp;
+    ExportHash->BucketMask = BucketCount - 1;
+    ExportHash->Buckets = (PULONG)(ExportHash + 1);
+
+    /* Insert every name, with linear probing. Slots hold the name index + 1 */
+    for (i = 0; i < ExportEntry->NumberOfNames; i++)
+    {
+        Index = LdrpHashExportName((LPSTR)((ULONG_PTR)ExportBase + NameTable[i])) &
+                ExportHash->BucketMask;
+        while (ExportHash->Buckets[Index])
+        {
+            Index = (Index + 1) & ExportHash->BucketMask;
+        }
+        ExportHash->Buckets[Index] = i + 1;
+    }
+
+    /* Remember it */
+    InsertHeadList(LdrpGetExportHashBucket(ExportBase), &ExportHash->Links);
+    return ExportHash;
+}
+
+USHORT
+NTAPI
+LdrpLookupExportName(IN LPSTR ImportName,
+                     IN PVOID ExportBase,
+                     IN PIMAGE_EXPORT_DIRECTORY ExportEntry)
+{
+    PULONG NameTable;
+    PUSHORT OrdinalTable;
+    PLDRP_EXPORT_HASH ExportHash = NULL;
+    ULONG Index, Slot;
+
+    /* Get the VA of the Name and Ordinal Tables */
+    NameTable = (PULONG)((ULONG_PTR)ExportBase +
+                         (ULONG_PTR)ExportEntry->AddressOfNames);
+    OrdinalTable = (PUSHORT)((ULONG_PTR)ExportBase +
+                             (ULONG_PTR)ExportEntry->AddressOfNameOrdinals);
+
+    /* Small export tables aren't worth hashing */
+    if (ExportEntry->NumberOfNames >= LDRP_EXPORT_HASH_MIN_NAMES)
+    {
+        ExportHash = LdrpGetExportHash(ExportBase, ExportEntry, NameTable);
+    }
+
+    /* Fall back to the binary search if we have no hash */
+    if (!ExportHash)
+    {
+        return LdrpNameToOrdinal(ImportName,
+                                 ExportEntry->NumberOfNames,
+                                 ExportBase,
+                                 NameTable,
+                                 OrdinalTable);
+    }
+
+    /* Probe until we hit an empty slot */
+    Index = LdrpHashExportName(ImportName) & ExportHash->BucketMask;
+    while ((Slot = ExportHash->Buckets[Index]))
+    {
+        /* Compare this name with the one we need to find */
+        if (!strcmp(ImportName, (PCHAR)((ULONG_PTR)ExportBase + NameTable[Slot - 1])))
+        {
+            /* Return found name */
+            return OrdinalTable[Slot - 1];
+        }
+
+        Index = (Index + 1) & ExportHash->BucketMask;
+    }
+
+    /* Not exported */
+    return -1;
+}
+
 NTSTATUS
 NTAPI
 LdrpWalkImportDescriptor(IN LPWSTR DllPath OPTIONAL,
@@ -1003,7 +1202,7 @@ LdrpSnapThunk(IN PVOID ExportBase,
         /* Get the hint */
         Hint = AddressOfData->Hint;
 
-        /* Try to get a match by using the hint */
+        /* Try to get a match by using the hint, if it's within the table */
         if (((ULONG)Hint < ExportEntry->NumberOfNames) &&
              (!strcmp(ImportName, ((LPSTR)((ULONG_PTR)ExportBase + NameTable[Hint])))))
         {
@@ -1013,11 +1212,9 @@ LdrpSnapThunk(IN PVOID ExportBase,
         else
         {
             /* Well bummer, hint didn't work, do it the long way */
-            Ordinal = LdrpNameToOrdinal(ImportName,
-                                        ExportEntry->NumberOfNames,
-                                        ExportBase,
-                                        NameTable,
-                                        OrdinalTable);
+            Ordinal = LdrpLookupExportName(ImportName,
+                                           ExportBase,
+                                           ExportEntry);
         }
     }
 
@@ -1574,6 +1574,28 @@ LdrpAllocateDataTableEntry(IN PVOID BaseAddress)
     return LdrEntry;
 }
 
+ULONG
+NTAPI
+LdrpGetHashEntry(IN PCUNICODE_STRING DllName)
+{
+    ULONG Hash;
+
+    /* Hash the whole base name, case-insensitively */
+    if (!NT_SUCCESS(RtlHashUnicodeString(DllName,
+                                         TRUE,
+                                         HASH_STRING_ALGORITHM_X65599,
+                                         &Hash)))
+    {
+        /* Can't fail for a valid string, but fall back to the first letter */
+        Hash = RtlUpcaseUnicodeChar(DllName->Buffer[0]);
+    }
+
+    /* Fold the upper bits in, the multiplier leaves the low ones weak */
+    Hash ^= (Hash >> 16);
+    Hash ^= (Hash >> 8);
+    return Hash & (LDR_HASH_TABLE_ENTRIES - 1);
+}
+
 VOID
 NTAPI
 LdrpInsertMemoryTableEntry(IN PLDR_DATA_TABLE_ENTRY LdrEntry)
@@ -1582,7 +1604,7 @@ LdrpInsertMemoryTableEntry(IN PLDR_DATA_TABLE_ENTRY LdrEntry)
     ULONG i;
 
     /* Insert into hash table */
-    i = LDR_GET_HASH_ENTRY(LdrEntry->BaseDllName.Buffer[0]);
+    i = LdrpGetHashEntry(&LdrEntry->BaseDllName);
     InsertTailList(&LdrpHashTable[i], &LdrEntry->HashLinks);
 
     /* Insert into other lists */
@@ -1606,6 +1628,9 @@ LdrpFinalizeAndDeallocateDataTableEntry(IN PLDR_DATA_TABLE_ENTRY Entry)
         Entry->EntryPointActivationContext = INVALID_HANDLE_VALUE;
     }
 
+    /* Drop the cached export name hash, if one was built */
+    if (Entry->DllBase) LdrpFreeExportHash(Entry->DllBase);
+
     /* Release the full dll name string */
     if (Entry->FullDllName.Buffer) LdrpFreeUnicodeString(&Entry->FullDllName);
 
@@ -2009,7 +2034,7 @@ lookinhash:
         /* FIXME: if we get redirected dll it means that we also get a full path so we need to find its filename for the hash lookup */
 
         /* Get hash index */
-        HashIndex = LDR_GET_HASH_ENTRY(DllName->Buffer[0]);
+        HashIndex = LdrpGetHashEntry(DllName);
 
         /* Traverse that list */
         ListHead = &LdrpHashTable[HashIndex];
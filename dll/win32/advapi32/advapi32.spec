@@ -452,7 +452,7 @@
 452 stdcall QueryServiceStatus(long ptr)
 453 stdcall QueryServiceStatusEx(long long ptr long ptr)
 454 stdcall QueryTraceA(double str ptr) ntdll.EtwQueryTraceA
-455 stdcall QueryTraceW(double str ptr) ntdll.EtwQueryTraceA
+455 stdcall QueryTraceW(double wstr ptr) ntdll.EtwQueryTraceW
 456 stdcall QueryUsersOnEncryptedFile(wstr ptr)
 457 stdcall ReadEncryptedFileRaw(ptr ptr ptr)
 458 stdcall ReadEventLogA(long long long ptr long ptr ptr)
@@ -590,7 +590,7 @@
 590 stdcall StartTraceA(ptr str ptr) ntdll.EtwStartTraceA
 591 stdcall StartTraceW(ptr wstr ptr) ntdll.EtwStartTraceW
 592 stdcall StopTraceA(double str ptr) ntdll.EtwStopTraceA
-593 stdcall StopTraceW(double wstr ptr) ntdll.EtwStopTraceA
+593 stdcall StopTraceW(double wstr ptr) ntdll.EtwStopTraceW
 594 stdcall SystemFunction001(ptr ptr ptr)
 595 stdcall SystemFunction002(ptr ptr ptr)
 596 stdcall SystemFunction003(ptr ptr)
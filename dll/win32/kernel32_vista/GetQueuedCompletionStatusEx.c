@@ -0,0 +1,93 @@
+
+#include "k32_vista.h"
+
+#include <ndk/iofuncs.h>
+
+/*
+ * The native API writes FILE_IO_COMPLETION_INFORMATION records straight
+ * into the caller's array, which are then converted in place.
+ */
+C_ASSERT(sizeof(OVERLAPPED_ENTRY) == sizeof(FILE_IO_COMPLETION_INFORMATION));
+C_ASSERT(FIELD_OFFSET(OVERLAPPED_ENTRY, Internal) ==
+         FIELD_OFFSET(FILE_IO_COMPLETION_INFORMATION, IoStatusBlock.Status));
+C_ASSERT(FIELD_OFFSET(OVERLAPPED_ENTRY, dwNumberOfBytesTransferred) ==
+         FIELD_OFFSET(FILE_IO_COMPLETION_INFORMATION, IoStatusBlock.Information));
+
+/*
+ * @implemented
+ */
+BOOL
+WINAPI
+GetQueuedCompletionStatusEx(IN HANDLE CompletionPort,
+                            OUT LPOVERLAPPED_ENTRY lpCompletionPortEntries,
+                            IN ULONG ulCount,
+                            OUT PULONG ulNumEntriesRemoved,
+                            IN DWORD dwMilliseconds,
+                            IN BOOL fAlertable)
+{
+    NTSTATUS Status;
+    PFILE_IO_COMPLETION_INFORMATION Information;
+    IO_STATUS_BLOCK IoStatus;
+    LARGE_INTEGER Time;
+    PLARGE_INTEGER TimePtr;
+    ULONG i;
+
+    if (!lpCompletionPortEntries || !ulCount)
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    /* Convert the timeout */
+    TimePtr = NULL;
+    if (dwMilliseconds != INFINITE)
+    {
+        Time.QuadPart = dwMilliseconds * -10000LL;
+        TimePtr = &Time;
+    }
+
+    /* Dequeue as many packets as are ready, in a single call */
+    Information = (PFILE_IO_COMPLETION_INFORMATION)lpCompletionPortEntries;
+    Status = NtRemoveIoCompletionEx(CompletionPort,
+                                    Information,
+                                    ulCount,
+                                    ulNumEntriesRemoved,
+                                    TimePtr,
+                                    (BOOLEAN)fAlertable);
+    if (!(NT_SUCCESS(Status)) || (Status == STATUS_TIMEOUT) || (Status == STATUS_USER_APC))
+    {
+        /* Nothing was removed */
+        *ulNumEntriesRemoved = 0;
+
+        /* Check what kind of error we got */
+        if (Status == STATUS_TIMEOUT)
+        {
+            /* Timeout error is set directly since there's no conversion */
+            SetLastError(WAIT_TIMEOUT);
+        }
+        else if (Status == STATUS_USER_APC)
+        {
+            /* An APC was delivered while we waited */
+            SetLastError(WAIT_IO_COMPLETION);
+        }
+        else
+        {
+            /* Any other error gets converted */
+            SetLastError(RtlNtStatusToDosError(Status));
+        }
+
+        /* This is a failure case */
+        return FALSE;
+    }
+
+    /* Convert the entries in place, the key and overlapped are already there */
+    for (i = 0; i < *ulNumEntriesRemoved; i++)
+    {
+        IoStatus = Information[i].IoStatusBlock;
+        lpCompletionPortEntries[i].Internal = (ULONG_PTR)IoStatus.Status;
+        lpCompletionPortEntries[i].dwNumberOfBytesTransferred = (DWORD)IoStatus.Information;
+    }
+
+    /* Return success */
+    return TRUE;
+}
@@ -66,7 +66,7 @@ DEFINE_GUID(BtrfsBusInterface, 0x4d414874, 0x6865, 0x6761, 0x6d, 0x65, 0x83, 0x6
 PDRIVER_OBJECT drvobj;
 PDEVICE_OBJECT master_devobj, busobj;
 #ifndef __REACTOS__
-bool have_sse42 = false, have_sse2 = false;
+bool have_sse42 = false, have_sse2 = false, have_pclmul = false;
 #endif
 uint64_t num_reads = 0;
 LIST_ENTRY uid_map_list, gid_map_list;
@@ -5607,10 +5607,12 @@ static void check_cpu() {
     __get_cpuid(1, &cpuInfo[0], &cpuInfo[1], &cpuInfo[2], &cpuInfo[3]);
     have_sse42 = cpuInfo[2] & bit_SSE4_2;
     have_sse2 = cpuInfo[3] & bit_SSE2;
+    have_pclmul = cpuInfo[2] & bit_PCLMUL;
 #else
    __cpuid(cpuInfo, 1);
    have_sse42 = cpuInfo[2] & (1 << 20);
    have_sse2 = cpuInfo[3] & (1 << 26);
+   have_pclmul = cpuInfo[2] & (1 << 1);
 #endif
 
     if (have_sse42)
@@ -5618,6 +5620,11 @@ static void check_cpu() {
     else
         TRACE("SSE4.2 not supported\n");
 
+    if (have_pclmul)
+        TRACE("PCLMULQDQ is supported\n");
+    else
+        TRACE("PCLMULQDQ is not supported\n");
+
     if (have_sse2)
         TRACE("SSE2 is supported\n");
     else
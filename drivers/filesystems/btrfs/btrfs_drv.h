@@ -617,7 +617,14 @@ typedef struct {
     LIST_ENTRY list_entry;
 } sys_chunk;
 
+enum calc_thread_type {
+    calc_thread_crc32c,
+    calc_thread_compress,
+    calc_thread_decompress
+};
+
 typedef struct {
+    enum calc_thread_type type;
     uint8_t* data;
     uint32_t* csum;
     uint32_t sectors;
@@ -625,6 +632,15 @@ typedef struct {
     KEVENT event;
     LONG refcount;
     LIST_ENTRY list_entry;
+
+    // compression and decompression jobs
+    uint8_t compression;
+    uint8_t* out;
+    uint32_t inlen;
+    uint32_t outlen;
+    uint32_t inpageoff;
+    uint32_t out_size;
+    NTSTATUS Status;
 } calc_job;
 
 typedef struct {
@@ -1505,7 +1521,13 @@ void watch_registry(HANDLE regh);
 NTSTATUS zlib_decompress(uint8_t* inbuf, uint32_t inlen, uint8_t* outbuf, uint32_t outlen);
 NTSTATUS lzo_decompress(uint8_t* inbuf, uint32_t inlen, uint8_t* outbuf, uint32_t outlen, uint32_t inpageoff);
 NTSTATUS zstd_decompress(uint8_t* inbuf, uint32_t inlen, uint8_t* outbuf, uint32_t outlen);
-NTSTATUS write_compressed_bit(fcb* fcb, uint64_t start_data, uint64_t end_data, void* data, bool* compressed, PIRP Irp, LIST_ENTRY* rollback);
+NTSTATUS zlib_compress(uint8_t* inbuf, uint32_t inlen, uint8_t* outbuf, uint32_t outlen, unsigned int level, uint32_t* out_size);
+NTSTATUS lzo_compress(uint8_t* inbuf, uint32_t inlen, uint8_t* outbuf, uint32_t outlen, uint32_t* out_size);
+NTSTATUS zstd_compress(uint8_t* inbuf, uint32_t inlen, uint8_t* outbuf, uint32_t outlen, uint32_t level, uint32_t* out_size);
+NTSTATUS compress_data(device_extension* Vcb, uint8_t compression, uint8_t* inbuf, uint32_t inlen, uint8_t* outbuf, uint32_t outlen, uint32_t* out_size);
+NTSTATUS decompress_data(uint8_t compression, uint8_t* inbuf, uint32_t inlen, uint8_t* outbuf, uint32_t outlen, uint32_t inpageoff);
+uint32_t compressed_buffer_size(uint8_t compression, uint32_t inlen);
+uint8_t get_compression_type(fcb* fcb);
 
 // in galois.c
 void galois_double(uint8_t* data, uint32_t len);
@@ -1526,6 +1548,9 @@ _Function_class_(KSTART_ROUTINE)
 void __stdcall calc_thread(void* context);
 
 NTSTATUS add_calc_job(device_extension* Vcb, uint8_t* data, uint32_t sectors, uint32_t* csum, calc_job** pcj);
+NTSTATUS add_calc_job_comp(device_extension* Vcb, uint8_t compression, uint8_t* in, uint32_t inlen, uint8_t* out, uint32_t outlen, calc_job** pcj);
+NTSTATUS add_calc_job_decomp(device_extension* Vcb, uint8_t compression, uint8_t* in, uint32_t inlen, uint8_t* out, uint32_t outlen,
+                             uint32_t inpageoff, calc_job** pcj);
 void free_calc_job(calc_job* cj);
 
 // in balance.c
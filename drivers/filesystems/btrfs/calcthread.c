@@ -19,23 +19,35 @@
 
 #define SECTOR_BLOCK 16
 
-NTSTATUS add_calc_job(device_extension* Vcb, uint8_t* data, uint32_t sectors, uint32_t* csum, calc_job** pcj) {
+// Checksum jobs are split into blocks of SECTOR_BLOCK sectors, which can be worked
+// on by several threads at once; compression and decompression jobs are one block.
+static LONG calc_job_blocks(calc_job* cj) {
+    if (cj->type == calc_thread_crc32c)
+        return (LONG)((cj->sectors + SECTOR_BLOCK - 1) / SECTOR_BLOCK);
+    else
+        return 1;
+}
+
+static calc_job* alloc_calc_job(enum calc_thread_type type) {
     calc_job* cj;
 
     cj = ExAllocatePoolWithTag(NonPagedPool, sizeof(calc_job), ALLOC_TAG);
     if (!cj) {
         ERR("out of memory\n");
-        return STATUS_INSUFFICIENT_RESOURCES;
+        return NULL;
     }
 
-    cj->data = data;
-    cj->sectors = sectors;
-    cj->csum = csum;
-    cj->pos = 0;
-    cj->done = 0;
+    RtlZeroMemory(cj, sizeof(calc_job));
+
+    cj->type = type;
     cj->refcount = 1;
+    cj->Status = STATUS_SUCCESS;
     KeInitializeEvent(&cj->event, NotificationEvent, false);
 
+    return cj;
+}
+
+static void queue_calc_job(device_extension* Vcb, calc_job* cj) {
     ExAcquireResourceExclusiveLite(&Vcb->calcthreads.lock, true);
 
     InsertTailList(&Vcb->calcthreads.job_list, &cj->list_entry);
@@ -44,6 +56,64 @@ NTSTATUS add_calc_job(device_extension* Vcb, uint8_t* data, uint32_t sectors, ui
     KeClearEvent(&Vcb->calcthreads.event);
 
     ExReleaseResourceLite(&Vcb->calcthreads.lock);
+}
+
+NTSTATUS add_calc_job(device_extension* Vcb, uint8_t* data, uint32_t sectors, uint32_t* csum, calc_job** pcj) {
+    calc_job* cj;
+
+    cj = alloc_calc_job(calc_thread_crc32c);
+    if (!cj)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    cj->data = data;
+    cj->sectors = sectors;
+    cj->csum = csum;
+
+    queue_calc_job(Vcb, cj);
+
+    *pcj = cj;
+
+    return STATUS_SUCCESS;
+}
+
+// Compresses inlen bytes at in into out, which must be compressed_buffer_size() bytes long.
+// Once the job's event is set, out_size holds the length of the compressed data.
+NTSTATUS add_calc_job_comp(device_extension* Vcb, uint8_t compression, uint8_t* in, uint32_t inlen, uint8_t* out, uint32_t outlen, calc_job** pcj) {
+    calc_job* cj;
+
+    cj = alloc_calc_job(calc_thread_compress);
+    if (!cj)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    cj->compression = compression;
+    cj->data = in;
+    cj->inlen = inlen;
+    cj->out = out;
+    cj->outlen = outlen;
+
+    queue_calc_job(Vcb, cj);
+
+    *pcj = cj;
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS add_calc_job_decomp(device_extension* Vcb, uint8_t compression, uint8_t* in, uint32_t inlen, uint8_t* out, uint32_t outlen,
+                             uint32_t inpageoff, calc_job** pcj) {
+    calc_job* cj;
+
+    cj = alloc_calc_job(calc_thread_decompress);
+    if (!cj)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    cj->compression = compression;
+    cj->data = in;
+    cj->inlen = inlen;
+    cj->out = out;
+    cj->outlen = outlen;
+    cj->inpageoff = inpageoff;
+
+    queue_calc_job(Vcb, cj);
 
     *pcj = cj;
 
@@ -57,38 +127,41 @@ void free_calc_job(calc_job* cj) {
         ExFreePool(cj);
 }
 
-static bool do_calc(device_extension* Vcb, calc_job* cj) {
-    LONG pos, done;
-    uint32_t* csum;
-    uint8_t* data;
-    ULONG blocksize, i;
+static void do_calc(device_extension* Vcb, calc_job* cj, LONG pos) {
+    LONG done;
 
-    pos = InterlockedIncrement(&cj->pos) - 1;
+    switch (cj->type) {
+        case calc_thread_crc32c: {
+            uint32_t* csum;
+            uint8_t* data;
+            ULONG blocksize, i;
 
-    if ((uint32_t)pos * SECTOR_BLOCK >= cj->sectors)
-        return false;
+            csum = &cj->csum[pos * SECTOR_BLOCK];
+            data = cj->data + (pos * SECTOR_BLOCK * Vcb->superblock.sector_size);
 
-    csum = &cj->csum[pos * SECTOR_BLOCK];
-    data = cj->data + (pos * SECTOR_BLOCK * Vcb->superblock.sector_size);
+            blocksize = min(SECTOR_BLOCK, cj->sectors - (pos * SECTOR_BLOCK));
+            for (i = 0; i < blocksize; i++) {
+                *csum = ~calc_crc32c(0xffffffff, data, Vcb->superblock.sector_size);
+                csum++;
+                data += Vcb->superblock.sector_size;
+            }
 
-    blocksize = min(SECTOR_BLOCK, cj->sectors - (pos * SECTOR_BLOCK));
-    for (i = 0; i < blocksize; i++) {
-        *csum = ~calc_crc32c(0xffffffff, data, Vcb->superblock.sector_size);
-        csum++;
-        data += Vcb->superblock.sector_size;
+            break;
+        }
+
+        case calc_thread_compress:
+            cj->Status = compress_data(Vcb, cj->compression, cj->data, cj->inlen, cj->out, cj->outlen, &cj->out_size);
+            break;
+
+        case calc_thread_decompress:
+            cj->Status = decompress_data(cj->compression, cj->data, cj->inlen, cj->out, cj->outlen, cj->inpageoff);
+            break;
     }
 
     done = InterlockedIncrement(&cj->done);
 
-    if ((uint32_t)done * SECTOR_BLOCK >= cj->sectors) {
-        ExAcquireResourceExclusiveLite(&Vcb->calcthreads.lock, true);
-        RemoveEntryList(&cj->list_entry);
-        ExReleaseResourceLite(&Vcb->calcthreads.lock);
-
+    if (done == calc_job_blocks(cj))
         KeSetEvent(&cj->event, 0, false);
-    }
-
-    return true;
 }
 
 _Function_class_(KSTART_ROUTINE)
@@ -103,7 +176,7 @@ void __stdcall calc_thread(void* context) {
 
         while (true) {
             calc_job* cj;
-            bool b;
+            LONG pos;
 
             ExAcquireResourceExclusiveLite(&Vcb->calcthreads.lock, true);
 
@@ -113,16 +186,21 @@ void __stdcall calc_thread(void* context) {
             }
 
             cj = CONTAINING_RECORD(Vcb->calcthreads.job_list.Flink, calc_job, list_entry);
-            cj->refcount++;
+
+            // Take the job off the list as soon as its last block has been handed out,
+            // so that the other threads move on to the next job rather than going idle.
+            pos = cj->pos++;
+
+            if (cj->pos >= calc_job_blocks(cj))
+                RemoveEntryList(&cj->list_entry);
+
+            InterlockedIncrement(&cj->refcount);
 
             ExReleaseResourceLite(&Vcb->calcthreads.lock);
 
-            b = do_calc(Vcb, cj);
+            do_calc(Vcb, cj, pos);
 
             free_calc_job(cj);
-
-            if (!b)
-                break;
         }
 
         if (thread->quit)
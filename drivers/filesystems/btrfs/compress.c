@@ -379,151 +379,47 @@ NTSTATUS zlib_decompress(uint8_t* inbuf, uint32_t inlen, uint8_t* outbuf, uint32
     return STATUS_SUCCESS;
 }
 
-static NTSTATUS zlib_write_compressed_bit(fcb* fcb, uint64_t start_data, uint64_t end_data, void* data, bool* compressed, PIRP Irp, LIST_ENTRY* rollback) {
-    NTSTATUS Status;
-    uint8_t compression;
-    uint32_t comp_length;
-    uint8_t* comp_data;
-    uint32_t out_left;
-    LIST_ENTRY* le;
-    chunk* c;
+NTSTATUS zlib_compress(uint8_t* inbuf, uint32_t inlen, uint8_t* outbuf, uint32_t outlen, unsigned int level, uint32_t* out_size) {
     z_stream c_stream;
     int ret;
 
-    comp_data = ExAllocatePoolWithTag(PagedPool, (uint32_t)(end_data - start_data), ALLOC_TAG);
-    if (!comp_data) {
-        ERR("out of memory\n");
-        return STATUS_INSUFFICIENT_RESOURCES;
-    }
-
-    Status = excise_extents(fcb->Vcb, fcb, start_data, end_data, Irp, rollback);
-    if (!NT_SUCCESS(Status)) {
-        ERR("excise_extents returned %08x\n", Status);
-        ExFreePool(comp_data);
-        return Status;
-    }
-
     c_stream.zalloc = zlib_alloc;
     c_stream.zfree = zlib_free;
     c_stream.opaque = (voidpf)0;
 
-    ret = deflateInit(&c_stream, fcb->Vcb->options.zlib_level);
+    ret = deflateInit(&c_stream, level);
 
     if (ret != Z_OK) {
         ERR("deflateInit returned %08x\n", ret);
-        ExFreePool(comp_data);
         return STATUS_INTERNAL_ERROR;
     }
 
-    c_stream.avail_in = (uint32_t)(end_data - start_data);
-    c_stream.next_in = data;
-    c_stream.avail_out = (uint32_t)(end_data - start_data);
-    c_stream.next_out = comp_data;
+    c_stream.avail_in = inlen;
+    c_stream.next_in = inbuf;
+    c_stream.avail_out = outlen;
+    c_stream.next_out = outbuf;
 
     do {
         ret = deflate(&c_stream, Z_FINISH);
 
         if (ret == Z_STREAM_ERROR) {
             ERR("deflate returned %x\n", ret);
-            ExFreePool(comp_data);
+            deflateEnd(&c_stream);
             return STATUS_INTERNAL_ERROR;
         }
     } while (c_stream.avail_in > 0 && c_stream.avail_out > 0);
 
-    out_left = c_stream.avail_out;
+    // if we ran out of space, this is outlen, i.e. the data is incompressible
+    *out_size = outlen - c_stream.avail_out;
 
     ret = deflateEnd(&c_stream);
 
-    if (ret != Z_OK) {
+    if (ret != Z_OK && ret != Z_DATA_ERROR) {
         ERR("deflateEnd returned %08x\n", ret);
-        ExFreePool(comp_data);
         return STATUS_INTERNAL_ERROR;
     }
 
-    if (out_left < fcb->Vcb->superblock.sector_size) { // compressed extent would be larger than or same size as uncompressed extent
-        ExFreePool(comp_data);
-
-        comp_length = (uint32_t)(end_data - start_data);
-        comp_data = data;
-        compression = BTRFS_COMPRESSION_NONE;
-
-        *compressed = false;
-    } else {
-        uint32_t cl;
-
-        compression = BTRFS_COMPRESSION_ZLIB;
-        cl = (uint32_t)(end_data - start_data - out_left);
-        comp_length = (uint32_t)sector_align(cl, fcb->Vcb->superblock.sector_size);
-
-        RtlZeroMemory(comp_data + cl, comp_length - cl);
-
-        *compressed = true;
-    }
-
-    ExAcquireResourceSharedLite(&fcb->Vcb->chunk_lock, true);
-
-    le = fcb->Vcb->chunks.Flink;
-    while (le != &fcb->Vcb->chunks) {
-        c = CONTAINING_RECORD(le, chunk, list_entry);
-
-        if (!c->readonly && !c->reloc) {
-            acquire_chunk_lock(c, fcb->Vcb);
-
-            if (c->chunk_item->type == fcb->Vcb->data_flags && (c->chunk_item->size - c->used) >= comp_length) {
-                if (insert_extent_chunk(fcb->Vcb, fcb, c, start_data, comp_length, false, comp_data, Irp, rollback, compression, end_data - start_data, false, 0)) {
-                    ExReleaseResourceLite(&fcb->Vcb->chunk_lock);
-
-                    if (compression != BTRFS_COMPRESSION_NONE)
-                        ExFreePool(comp_data);
-
-                    return STATUS_SUCCESS;
-                }
-            }
-
-            release_chunk_lock(c, fcb->Vcb);
-        }
-
-        le = le->Flink;
-    }
-
-    ExReleaseResourceLite(&fcb->Vcb->chunk_lock);
-
-    ExAcquireResourceExclusiveLite(&fcb->Vcb->chunk_lock, true);
-
-    Status = alloc_chunk(fcb->Vcb, fcb->Vcb->data_flags, &c, false);
-
-    ExReleaseResourceLite(&fcb->Vcb->chunk_lock);
-
-    if (!NT_SUCCESS(Status)) {
-        ERR("alloc_chunk returned %08x\n", Status);
-
-        if (compression != BTRFS_COMPRESSION_NONE)
-            ExFreePool(comp_data);
-
-        return Status;
-    }
-
-    if (c) {
-        acquire_chunk_lock(c, fcb->Vcb);
-
-        if (c->chunk_item->type == fcb->Vcb->data_flags && (c->chunk_item->size - c->used) >= comp_length) {
-            if (insert_extent_chunk(fcb->Vcb, fcb, c, start_data, comp_length, false, comp_data, Irp, rollback, compression, end_data - start_data, false, 0)) {
-                if (compression != BTRFS_COMPRESSION_NONE)
-                    ExFreePool(comp_data);
-
-                return STATUS_SUCCESS;
-            }
-        }
-
-        release_chunk_lock(c, fcb->Vcb);
-    }
-
-    WARN("couldn't find any data chunks with %I64x bytes free\n", comp_length);
-
-    if (compression != BTRFS_COMPRESSION_NONE)
-        ExFreePool(comp_data);
-
-    return STATUS_DISK_FULL;
+    return STATUS_SUCCESS;
 }
 
 static NTSTATUS lzo_do_compress(const uint8_t* in, uint32_t in_len, uint8_t* out, uint32_t* out_len, void* wrkmem) {
@@ -767,218 +663,98 @@ static __inline uint32_t lzo_max_outlen(uint32_t inlen) {
     return inlen + (inlen / 16) + 64 + 3; // formula comes from LZO.FAQ
 }
 
-static NTSTATUS lzo_write_compressed_bit(fcb* fcb, uint64_t start_data, uint64_t end_data, void* data, bool* compressed, PIRP Irp, LIST_ENTRY* rollback) {
+NTSTATUS lzo_compress(uint8_t* inbuf, uint32_t inlen, uint8_t* outbuf, uint32_t outlen, uint32_t* out_size) {
     NTSTATUS Status;
-    uint8_t compression;
-    uint64_t comp_length;
-    ULONG comp_data_len, num_pages, i;
-    uint8_t* comp_data;
-    bool skip_compression = false;
+    ULONG num_pages, i;
     lzo_stream stream;
-    uint32_t* out_size;
-    LIST_ENTRY* le;
-    chunk* c;
+    uint32_t* size;
 
-    num_pages = (ULONG)((sector_align(end_data - start_data, LZO_PAGE_SIZE)) / LZO_PAGE_SIZE);
+    num_pages = (ULONG)((sector_align(inlen, LZO_PAGE_SIZE)) / LZO_PAGE_SIZE);
 
-    // Four-byte overall header
-    // Another four-byte header page
-    // Each page has a maximum size of lzo_max_outlen(LZO_PAGE_SIZE)
-    // Plus another four bytes for possible padding
-    comp_data_len = sizeof(uint32_t) + ((lzo_max_outlen(LZO_PAGE_SIZE) + (2 * sizeof(uint32_t))) * num_pages);
-
-    comp_data = ExAllocatePoolWithTag(PagedPool, comp_data_len, ALLOC_TAG);
-    if (!comp_data) {
-        ERR("out of memory\n");
-        return STATUS_INSUFFICIENT_RESOURCES;
+    if (outlen < compressed_buffer_size(BTRFS_COMPRESSION_LZO, inlen)) {
+        ERR("output buffer too small (%x < %x)\n", outlen, compressed_buffer_size(BTRFS_COMPRESSION_LZO, inlen));
+        return STATUS_BUFFER_TOO_SMALL;
     }
 
     stream.wrkmem = ExAllocatePoolWithTag(PagedPool, LZO1X_MEM_COMPRESS, ALLOC_TAG);
     if (!stream.wrkmem) {
         ERR("out of memory\n");
-        ExFreePool(comp_data);
         return STATUS_INSUFFICIENT_RESOURCES;
     }
 
-    Status = excise_extents(fcb->Vcb, fcb, start_data, end_data, Irp, rollback);
-    if (!NT_SUCCESS(Status)) {
-        ERR("excise_extents returned %08x\n", Status);
-        ExFreePool(comp_data);
-        ExFreePool(stream.wrkmem);
-        return Status;
-    }
-
-    out_size = (uint32_t*)comp_data;
-    *out_size = sizeof(uint32_t);
+    size = (uint32_t*)outbuf;
+    *size = sizeof(uint32_t);
 
-    stream.in = data;
-    stream.out = comp_data + (2 * sizeof(uint32_t));
+    stream.in = inbuf;
+    stream.out = outbuf + (2 * sizeof(uint32_t));
 
     for (i = 0; i < num_pages; i++) {
         uint32_t* pagelen = (uint32_t*)(stream.out - sizeof(uint32_t));
 
-        stream.inlen = (uint32_t)min(LZO_PAGE_SIZE, end_data - start_data - (i * LZO_PAGE_SIZE));
+        stream.inlen = (uint32_t)min(LZO_PAGE_SIZE, inlen - (i * LZO_PAGE_SIZE));
 
         Status = lzo1x_1_compress(&stream);
         if (!NT_SUCCESS(Status)) {
             ERR("lzo1x_1_compress returned %08x\n", Status);
-            skip_compression = true;
+
+            // write the data uncompressed
+            *size = inlen;
             break;
         }
 
         *pagelen = stream.outlen;
-        *out_size += stream.outlen + sizeof(uint32_t);
+        *size += stream.outlen + sizeof(uint32_t);
 
         stream.in += LZO_PAGE_SIZE;
         stream.out += stream.outlen + sizeof(uint32_t);
 
-        if (LZO_PAGE_SIZE - (*out_size % LZO_PAGE_SIZE) < sizeof(uint32_t)) {
-            RtlZeroMemory(stream.out, LZO_PAGE_SIZE - (*out_size % LZO_PAGE_SIZE));
-            stream.out += LZO_PAGE_SIZE - (*out_size % LZO_PAGE_SIZE);
-            *out_size += LZO_PAGE_SIZE - (*out_size % LZO_PAGE_SIZE);
+        if (LZO_PAGE_SIZE - (*size % LZO_PAGE_SIZE) < sizeof(uint32_t)) {
+            RtlZeroMemory(stream.out, LZO_PAGE_SIZE - (*size % LZO_PAGE_SIZE));
+            stream.out += LZO_PAGE_SIZE - (*size % LZO_PAGE_SIZE);
+            *size += LZO_PAGE_SIZE - (*size % LZO_PAGE_SIZE);
         }
     }
 
     ExFreePool(stream.wrkmem);
 
-    if (skip_compression || *out_size >= end_data - start_data - fcb->Vcb->superblock.sector_size) { // compressed extent would be larger than or same size as uncompressed extent
-        ExFreePool(comp_data);
-
-        comp_length = end_data - start_data;
-        comp_data = data;
-        compression = BTRFS_COMPRESSION_NONE;
-
-        *compressed = false;
-    } else {
-        compression = BTRFS_COMPRESSION_LZO;
-        comp_length = sector_align(*out_size, fcb->Vcb->superblock.sector_size);
-
-        RtlZeroMemory(comp_data + *out_size, (ULONG)(comp_length - *out_size));
-
-        *compressed = true;
-    }
-
-    ExAcquireResourceSharedLite(&fcb->Vcb->chunk_lock, true);
-
-    le = fcb->Vcb->chunks.Flink;
-    while (le != &fcb->Vcb->chunks) {
-        c = CONTAINING_RECORD(le, chunk, list_entry);
-
-        if (!c->readonly && !c->reloc) {
-            acquire_chunk_lock(c, fcb->Vcb);
-
-            if (c->chunk_item->type == fcb->Vcb->data_flags && (c->chunk_item->size - c->used) >= comp_length) {
-                if (insert_extent_chunk(fcb->Vcb, fcb, c, start_data, comp_length, false, comp_data, Irp, rollback, compression, end_data - start_data, false, 0)) {
-                    ExReleaseResourceLite(&fcb->Vcb->chunk_lock);
-
-                    if (compression != BTRFS_COMPRESSION_NONE)
-                        ExFreePool(comp_data);
-
-                    return STATUS_SUCCESS;
-                }
-            }
-
-            release_chunk_lock(c, fcb->Vcb);
-        }
-
-        le = le->Flink;
-    }
-
-    ExReleaseResourceLite(&fcb->Vcb->chunk_lock);
-
-    ExAcquireResourceExclusiveLite(&fcb->Vcb->chunk_lock, true);
-
-    Status = alloc_chunk(fcb->Vcb, fcb->Vcb->data_flags, &c, false);
-
-    ExReleaseResourceLite(&fcb->Vcb->chunk_lock);
-
-    if (!NT_SUCCESS(Status)) {
-        ERR("alloc_chunk returned %08x\n", Status);
-
-        if (compression != BTRFS_COMPRESSION_NONE)
-            ExFreePool(comp_data);
-
-        return Status;
-    }
-
-    if (c) {
-        acquire_chunk_lock(c, fcb->Vcb);
-
-        if (c->chunk_item->type == fcb->Vcb->data_flags && (c->chunk_item->size - c->used) >= comp_length) {
-            if (insert_extent_chunk(fcb->Vcb, fcb, c, start_data, comp_length, false, comp_data, Irp, rollback, compression, end_data - start_data, false, 0)) {
-                if (compression != BTRFS_COMPRESSION_NONE)
-                    ExFreePool(comp_data);
-
-                return STATUS_SUCCESS;
-            }
-        }
-
-        release_chunk_lock(c, fcb->Vcb);
-    }
-
-    WARN("couldn't find any data chunks with %I64x bytes free\n", comp_length);
+    *out_size = *size;
 
-    if (compression != BTRFS_COMPRESSION_NONE)
-        ExFreePool(comp_data);
-
-    return STATUS_DISK_FULL;
+    return STATUS_SUCCESS;
 }
 
-static NTSTATUS zstd_write_compressed_bit(fcb* fcb, uint64_t start_data, uint64_t end_data, void* data, bool* compressed, PIRP Irp, LIST_ENTRY* rollback) {
-    NTSTATUS Status;
-    uint8_t compression;
-    uint32_t comp_length;
-    uint8_t* comp_data;
-    uint32_t out_left;
-    LIST_ENTRY* le;
-    chunk* c;
+NTSTATUS zstd_compress(uint8_t* inbuf, uint32_t inlen, uint8_t* outbuf, uint32_t outlen, uint32_t level, uint32_t* out_size) {
     ZSTD_CStream* stream;
     size_t init_res, written;
     ZSTD_inBuffer input;
     ZSTD_outBuffer output;
     ZSTD_parameters params;
 
-    comp_data = ExAllocatePoolWithTag(PagedPool, (uint32_t)(end_data - start_data), ALLOC_TAG);
-    if (!comp_data) {
-        ERR("out of memory\n");
-        return STATUS_INSUFFICIENT_RESOURCES;
-    }
-
-    Status = excise_extents(fcb->Vcb, fcb, start_data, end_data, Irp, rollback);
-    if (!NT_SUCCESS(Status)) {
-        ERR("excise_extents returned %08x\n", Status);
-        ExFreePool(comp_data);
-        return Status;
-    }
-
     stream = ZSTD_createCStream_advanced(zstd_mem);
 
     if (!stream) {
         ERR("ZSTD_createCStream failed.\n");
-        ExFreePool(comp_data);
         return STATUS_INTERNAL_ERROR;
     }
 
-    params = ZSTD_getParams(fcb->Vcb->options.zstd_level, (uint32_t)(end_data - start_data), 0);
+    params = ZSTD_getParams(level, inlen, 0);
 
     if (params.cParams.windowLog > ZSTD_BTRFS_MAX_WINDOWLOG)
         params.cParams.windowLog = ZSTD_BTRFS_MAX_WINDOWLOG;
 
-    init_res = ZSTD_initCStream_advanced(stream, NULL, 0, params, (uint32_t)(end_data - start_data));
+    init_res = ZSTD_initCStream_advanced(stream, NULL, 0, params, inlen);
 
     if (ZSTD_isError(init_res)) {
         ERR("ZSTD_initCStream_advanced failed: %s\n", ZSTD_getErrorName(init_res));
         ZSTD_freeCStream(stream);
-        ExFreePool(comp_data);
         return STATUS_INTERNAL_ERROR;
     }
 
-    input.src = data;
-    input.size = (uint32_t)(end_data - start_data);
+    input.src = inbuf;
+    input.size = inlen;
     input.pos = 0;
 
-    output.dst = comp_data;
-    output.size = (uint32_t)(end_data - start_data);
+    output.dst = outbuf;
+    output.size = outlen;
     output.pos = 0;
 
     while (input.pos < input.size && output.pos < output.size) {
@@ -987,7 +763,6 @@ static NTSTATUS zstd_write_compressed_bit(fcb* fcb, uint64_t start_data, uint64_
         if (ZSTD_isError(written)) {
             ERR("ZSTD_compressStream failed: %s\n", ZSTD_getErrorName(written));
             ZSTD_freeCStream(stream);
-            ExFreePool(comp_data);
             return STATUS_INTERNAL_ERROR;
         }
     }
@@ -996,126 +771,102 @@ static NTSTATUS zstd_write_compressed_bit(fcb* fcb, uint64_t start_data, uint64_
     if (ZSTD_isError(written)) {
         ERR("ZSTD_endStream failed: %s\n", ZSTD_getErrorName(written));
         ZSTD_freeCStream(stream);
-        ExFreePool(comp_data);
         return STATUS_INTERNAL_ERROR;
     }
 
     ZSTD_freeCStream(stream);
 
-    out_left = output.size - output.pos;
-
-    if (out_left < fcb->Vcb->superblock.sector_size) { // compressed extent would be larger than or same size as uncompressed extent
-        ExFreePool(comp_data);
-
-        comp_length = (uint32_t)(end_data - start_data);
-        comp_data = data;
-        compression = BTRFS_COMPRESSION_NONE;
+    *out_size = (uint32_t)output.pos;
 
-        *compressed = false;
-    } else {
-        uint32_t cl;
-
-        compression = BTRFS_COMPRESSION_ZSTD;
-        cl = (uint32_t)(end_data - start_data - out_left);
-        comp_length = (uint32_t)sector_align(cl, fcb->Vcb->superblock.sector_size);
+    return STATUS_SUCCESS;
+}
 
-        RtlZeroMemory(comp_data + cl, comp_length - cl);
+uint8_t get_compression_type(fcb* fcb) {
+    uint8_t type;
 
-        *compressed = true;
+    if (fcb->Vcb->options.compress_type != 0 && fcb->prop_compression == PropCompression_None)
+        type = fcb->Vcb->options.compress_type;
+    else {
+        if (!(fcb->Vcb->superblock.incompat_flags & BTRFS_INCOMPAT_FLAGS_COMPRESS_ZSTD) && fcb->prop_compression == PropCompression_ZSTD)
+            type = BTRFS_COMPRESSION_ZSTD;
+        else if (fcb->Vcb->superblock.incompat_flags & BTRFS_INCOMPAT_FLAGS_COMPRESS_ZSTD && fcb->prop_compression != PropCompression_Zlib && fcb->prop_compression != PropCompression_LZO)
+            type = BTRFS_COMPRESSION_ZSTD;
+        else if (!(fcb->Vcb->superblock.incompat_flags & BTRFS_INCOMPAT_FLAGS_COMPRESS_LZO) && fcb->prop_compression == PropCompression_LZO)
+            type = BTRFS_COMPRESSION_LZO;
+        else if (fcb->Vcb->superblock.incompat_flags & BTRFS_INCOMPAT_FLAGS_COMPRESS_LZO && fcb->prop_compression != PropCompression_Zlib)
+            type = BTRFS_COMPRESSION_LZO;
+        else
+            type = BTRFS_COMPRESSION_ZLIB;
     }
 
-    ExAcquireResourceSharedLite(&fcb->Vcb->chunk_lock, true);
-
-    le = fcb->Vcb->chunks.Flink;
-    while (le != &fcb->Vcb->chunks) {
-        c = CONTAINING_RECORD(le, chunk, list_entry);
-
-        if (!c->readonly && !c->reloc) {
-            acquire_chunk_lock(c, fcb->Vcb);
-
-            if (c->chunk_item->type == fcb->Vcb->data_flags && (c->chunk_item->size - c->used) >= comp_length) {
-                if (insert_extent_chunk(fcb->Vcb, fcb, c, start_data, comp_length, false, comp_data, Irp, rollback, compression, end_data - start_data, false, 0)) {
-                    ExReleaseResourceLite(&fcb->Vcb->chunk_lock);
-
-                    if (compression != BTRFS_COMPRESSION_NONE)
-                        ExFreePool(comp_data);
-
-                    return STATUS_SUCCESS;
-                }
-            }
+    return type;
+}
 
-            release_chunk_lock(c, fcb->Vcb);
-        }
+// Size of the buffer needed to compress inlen bytes. LZO's output may be bigger than its
+// input; the other algorithms stop once they've used up as much space as the input.
+uint32_t compressed_buffer_size(uint8_t compression, uint32_t inlen) {
+    if (compression == BTRFS_COMPRESSION_LZO) {
+        ULONG num_pages = (ULONG)((sector_align(inlen, LZO_PAGE_SIZE)) / LZO_PAGE_SIZE);
 
-        le = le->Flink;
+        // Four-byte overall header
+        // Another four-byte header page
+        // Each page has a maximum size of lzo_max_outlen(LZO_PAGE_SIZE)
+        // Plus another four bytes for possible padding
+        return sizeof(uint32_t) + ((lzo_max_outlen(LZO_PAGE_SIZE) + (2 * sizeof(uint32_t))) * num_pages);
     }
 
-    ExReleaseResourceLite(&fcb->Vcb->chunk_lock);
+    return inlen;
+}
 
-    ExAcquireResourceExclusiveLite(&fcb->Vcb->chunk_lock, true);
+NTSTATUS compress_data(device_extension* Vcb, uint8_t compression, uint8_t* inbuf, uint32_t inlen, uint8_t* outbuf, uint32_t outlen, uint32_t* out_size) {
+    switch (compression) {
+        case BTRFS_COMPRESSION_ZLIB:
+            return zlib_compress(inbuf, inlen, outbuf, outlen, Vcb->options.zlib_level, out_size);
 
-    Status = alloc_chunk(fcb->Vcb, fcb->Vcb->data_flags, &c, false);
+        case BTRFS_COMPRESSION_LZO:
+            return lzo_compress(inbuf, inlen, outbuf, outlen, out_size);
 
-    ExReleaseResourceLite(&fcb->Vcb->chunk_lock);
+        case BTRFS_COMPRESSION_ZSTD:
+            return zstd_compress(inbuf, inlen, outbuf, outlen, Vcb->options.zstd_level, out_size);
 
-    if (!NT_SUCCESS(Status)) {
-        ERR("alloc_chunk returned %08x\n", Status);
+        default:
+            ERR("unsupported compression type %x\n", compression);
+            return STATUS_NOT_SUPPORTED;
+    }
+}
 
-        if (compression != BTRFS_COMPRESSION_NONE)
-            ExFreePool(comp_data);
+NTSTATUS decompress_data(uint8_t compression, uint8_t* inbuf, uint32_t inlen, uint8_t* outbuf, uint32_t outlen, uint32_t inpageoff) {
+    NTSTATUS Status;
 
-        return Status;
-    }
+    switch (compression) {
+        case BTRFS_COMPRESSION_ZLIB:
+            Status = zlib_decompress(inbuf, inlen, outbuf, outlen);
 
-    if (c) {
-        acquire_chunk_lock(c, fcb->Vcb);
+            if (!NT_SUCCESS(Status))
+                ERR("zlib_decompress returned %08x\n", Status);
 
-        if (c->chunk_item->type == fcb->Vcb->data_flags && (c->chunk_item->size - c->used) >= comp_length) {
-            if (insert_extent_chunk(fcb->Vcb, fcb, c, start_data, comp_length, false, comp_data, Irp, rollback, compression, end_data - start_data, false, 0)) {
-                if (compression != BTRFS_COMPRESSION_NONE)
-                    ExFreePool(comp_data);
+            return Status;
 
-                return STATUS_SUCCESS;
-            }
-        }
+        case BTRFS_COMPRESSION_LZO:
+            Status = lzo_decompress(inbuf, inlen, outbuf, outlen, inpageoff);
 
-        release_chunk_lock(c, fcb->Vcb);
-    }
+            if (!NT_SUCCESS(Status))
+                ERR("lzo_decompress returned %08x\n", Status);
 
-    WARN("couldn't find any data chunks with %I64x bytes free\n", comp_length);
+            return Status;
 
-    if (compression != BTRFS_COMPRESSION_NONE)
-        ExFreePool(comp_data);
+        case BTRFS_COMPRESSION_ZSTD:
+            Status = zstd_decompress(inbuf, inlen, outbuf, outlen);
 
-    return STATUS_DISK_FULL;
-}
+            if (!NT_SUCCESS(Status))
+                ERR("zstd_decompress returned %08x\n", Status);
 
-NTSTATUS write_compressed_bit(fcb* fcb, uint64_t start_data, uint64_t end_data, void* data, bool* compressed, PIRP Irp, LIST_ENTRY* rollback) {
-    uint8_t type;
+            return Status;
 
-    if (fcb->Vcb->options.compress_type != 0 && fcb->prop_compression == PropCompression_None)
-        type = fcb->Vcb->options.compress_type;
-    else {
-        if (!(fcb->Vcb->superblock.incompat_flags & BTRFS_INCOMPAT_FLAGS_COMPRESS_ZSTD) && fcb->prop_compression == PropCompression_ZSTD)
-            type = BTRFS_COMPRESSION_ZSTD;
-        else if (fcb->Vcb->superblock.incompat_flags & BTRFS_INCOMPAT_FLAGS_COMPRESS_ZSTD && fcb->prop_compression != PropCompression_Zlib && fcb->prop_compression != PropCompression_LZO)
-            type = BTRFS_COMPRESSION_ZSTD;
-        else if (!(fcb->Vcb->superblock.incompat_flags & BTRFS_INCOMPAT_FLAGS_COMPRESS_LZO) && fcb->prop_compression == PropCompression_LZO)
-            type = BTRFS_COMPRESSION_LZO;
-        else if (fcb->Vcb->superblock.incompat_flags & BTRFS_INCOMPAT_FLAGS_COMPRESS_LZO && fcb->prop_compression != PropCompression_Zlib)
-            type = BTRFS_COMPRESSION_LZO;
-        else
-            type = BTRFS_COMPRESSION_ZLIB;
+        default:
+            ERR("unsupported compression type %x\n", compression);
+            return STATUS_NOT_SUPPORTED;
     }
-
-    if (type == BTRFS_COMPRESSION_ZSTD) {
-        fcb->Vcb->superblock.incompat_flags |= BTRFS_INCOMPAT_FLAGS_COMPRESS_ZSTD;
-        return zstd_write_compressed_bit(fcb, start_data, end_data, data, compressed, Irp, rollback);
-    } else if (type == BTRFS_COMPRESSION_LZO) {
-        fcb->Vcb->superblock.incompat_flags |= BTRFS_INCOMPAT_FLAGS_COMPRESS_LZO;
-        return lzo_write_compressed_bit(fcb, start_data, end_data, data, compressed, Irp, rollback);
-    } else
-        return zlib_write_compressed_bit(fcb, start_data, end_data, data, compressed, Irp, rollback);
 }
 
 static void* zstd_malloc(void* opaque, size_t size) {
@@ -2712,6 +2712,16 @@ NTSTATUS read_stream(fcb* fcb, uint8_t* data, uint64_t start, ULONG length, ULON
     return STATUS_SUCCESS;
 }
 
+typedef struct {
+    calc_job* cj;
+    uint8_t* buf;
+    uint8_t* decomp;
+    uint8_t* dest;
+    ULONG off;
+    ULONG length;
+    LIST_ENTRY list_entry;
+} read_decomp_job;
+
 NTSTATUS read_file(fcb* fcb, uint8_t* data, uint64_t start, uint64_t length, ULONG* pbr, PIRP Irp) {
     NTSTATUS Status;
     EXTENT_DATA* ed;
@@ -2719,9 +2729,12 @@ NTSTATUS read_file(fcb* fcb, uint8_t* data, uint64_t start, uint64_t length, ULO
     uint64_t last_end;
     LIST_ENTRY* le;
     POOL_TYPE pool_type;
+    LIST_ENTRY decomp_jobs;
 
     TRACE("(%p, %p, %I64x, %I64x, %p)\n", fcb, data, start, length, pbr);
 
+    InitializeListHead(&decomp_jobs);
+
     if (pbr)
         *pbr = 0;
 
@@ -2990,23 +3003,28 @@ NTSTATUS read_file(fcb* fcb, uint8_t* data, uint64_t start, uint64_t length, ULO
                         } else
                             outlen = min(read, (uint32_t)(ed2->num_bytes - off));
 
-                        if (ed->compression == BTRFS_COMPRESSION_ZLIB) {
-                            Status = zlib_decompress(buf2, inlen, decomp ? decomp : (data + bytes_read), outlen);
+                        if (get_num_of_processors() > 1) {
+                            read_decomp_job* rdj;
 
-                            if (!NT_SUCCESS(Status)) {
-                                ERR("zlib_decompress returned %08x\n", Status);
+                            // Let the calc threads decompress the extent while we read the next one;
+                            // the buffers are freed once all the jobs have finished.
+                            rdj = ExAllocatePoolWithTag(pool_type, sizeof(read_decomp_job), ALLOC_TAG);
+                            if (!rdj) {
+                                ERR("out of memory\n");
                                 ExFreePool(buf);
 
                                 if (decomp)
                                     ExFreePool(decomp);
 
+                                Status = STATUS_INSUFFICIENT_RESOURCES;
                                 goto exit;
                             }
-                        } else if (ed->compression == BTRFS_COMPRESSION_LZO) {
-                            Status = lzo_decompress(buf2, inlen, decomp ? decomp : (data + bytes_read), outlen, inpageoff);
 
+                            Status = add_calc_job_decomp(fcb->Vcb, ed->compression, buf2, inlen, decomp ? decomp : (data + bytes_read), outlen,
+                                                         inpageoff, &rdj->cj);
                             if (!NT_SUCCESS(Status)) {
-                                ERR("lzo_decompress returned %08x\n", Status);
+                                ERR("add_calc_job_decomp returned %08x\n", Status);
+                                ExFreePool(rdj);
                                 ExFreePool(buf);
 
                                 if (decomp)
@@ -3014,11 +3032,19 @@ NTSTATUS read_file(fcb* fcb, uint8_t* data, uint64_t start, uint64_t length, ULO
 
                                 goto exit;
                             }
-                        } else if (ed->compression == BTRFS_COMPRESSION_ZSTD) {
-                            Status = zstd_decompress(buf2, inlen, decomp ? decomp : (data + bytes_read), outlen);
+
+                            rdj->buf = buf;
+                            rdj->decomp = decomp;
+                            rdj->dest = data + bytes_read;
+                            rdj->off = off2;
+                            rdj->length = (ULONG)min(read, ed2->num_bytes - off);
+                            InsertTailList(&decomp_jobs, &rdj->list_entry);
+
+                            buf_free = false;
+                        } else {
+                            Status = decompress_data(ed->compression, buf2, inlen, decomp ? decomp : (data + bytes_read), outlen, inpageoff);
 
                             if (!NT_SUCCESS(Status)) {
-                                ERR("zstd_decompress returned %08x\n", Status);
                                 ExFreePool(buf);
 
                                 if (decomp)
@@ -3026,21 +3052,11 @@ NTSTATUS read_file(fcb* fcb, uint8_t* data, uint64_t start, uint64_t length, ULO
 
                                 goto exit;
                             }
-                        } else {
-                            ERR("unsupported compression type %x\n", ed->compression);
-                            Status = STATUS_NOT_SUPPORTED;
 
-                            ExFreePool(buf);
-
-                            if (decomp)
+                            if (decomp) {
+                                RtlCopyMemory(data + bytes_read, decomp + off2, (size_t)min(read, ed2->num_bytes - off));
                                 ExFreePool(decomp);
-
-                            goto exit;
-                        }
-
-                        if (decomp) {
-                            RtlCopyMemory(data + bytes_read, decomp + off2, (size_t)min(read, ed2->num_bytes - off));
-                            ExFreePool(decomp);
+                            }
                         }
                     }
 
@@ -3098,6 +3114,30 @@ nextitem:
         *pbr = bytes_read;
 
 exit:
+    while (!IsListEmpty(&decomp_jobs)) {
+        read_decomp_job* rdj = CONTAINING_RECORD(RemoveHeadList(&decomp_jobs), read_decomp_job, list_entry);
+
+        KeWaitForSingleObject(&rdj->cj->event, Executive, KernelMode, false, NULL);
+
+        if (NT_SUCCESS(Status)) {
+            if (!NT_SUCCESS(rdj->cj->Status)) {
+                Status = rdj->cj->Status;
+
+                if (pbr)
+                    *pbr = 0;
+            } else if (rdj->decomp)
+                RtlCopyMemory(rdj->dest, rdj->decomp + rdj->off, rdj->length);
+        }
+
+        free_calc_job(rdj->cj);
+        ExFreePool(rdj->buf);
+
+        if (rdj->decomp)
+            ExFreePool(rdj->decomp);
+
+        ExFreePool(rdj);
+    }
+
     return Status;
 }
 
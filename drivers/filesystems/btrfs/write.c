@@ -4100,27 +4100,172 @@ nextitem:
     return STATUS_SUCCESS;
 }
 
+static NTSTATUS insert_compressed_extent(fcb* fcb, uint64_t start_data, uint64_t end_data, uint8_t* comp_data, uint64_t comp_length,
+                                         uint8_t compression, PIRP Irp, LIST_ENTRY* rollback) {
+    NTSTATUS Status;
+    LIST_ENTRY* le;
+    chunk* c;
+
+    ExAcquireResourceSharedLite(&fcb->Vcb->chunk_lock, true);
+
+    le = fcb->Vcb->chunks.Flink;
+    while (le != &fcb->Vcb->chunks) {
+        c = CONTAINING_RECORD(le, chunk, list_entry);
+
+        if (!c->readonly && !c->reloc) {
+            acquire_chunk_lock(c, fcb->Vcb);
+
+            if (c->chunk_item->type == fcb->Vcb->data_flags && (c->chunk_item->size - c->used) >= comp_length) {
+                if (insert_extent_chunk(fcb->Vcb, fcb, c, start_data, comp_length, false, comp_data, Irp, rollback, compression, end_data - start_data, false, 0)) {
+                    ExReleaseResourceLite(&fcb->Vcb->chunk_lock);
+                    return STATUS_SUCCESS;
+                }
+            }
+
+            release_chunk_lock(c, fcb->Vcb);
+        }
+
+        le = le->Flink;
+    }
+
+    ExReleaseResourceLite(&fcb->Vcb->chunk_lock);
+
+    ExAcquireResourceExclusiveLite(&fcb->Vcb->chunk_lock, true);
+
+    Status = alloc_chunk(fcb->Vcb, fcb->Vcb->data_flags, &c, false);
+
+    ExReleaseResourceLite(&fcb->Vcb->chunk_lock);
+
+    if (!NT_SUCCESS(Status)) {
+        ERR("alloc_chunk returned %08x\n", Status);
+        return Status;
+    }
+
+    if (c) {
+        acquire_chunk_lock(c, fcb->Vcb);
+
+        if (c->chunk_item->type == fcb->Vcb->data_flags && (c->chunk_item->size - c->used) >= comp_length) {
+            if (insert_extent_chunk(fcb->Vcb, fcb, c, start_data, comp_length, false, comp_data, Irp, rollback, compression, end_data - start_data, false, 0))
+                return STATUS_SUCCESS;
+        }
+
+        release_chunk_lock(c, fcb->Vcb);
+    }
+
+    WARN("couldn't find any data chunks with %I64x bytes free\n", comp_length);
+
+    return STATUS_DISK_FULL;
+}
+
+typedef struct {
+    calc_job* cj;
+    uint8_t* comp_data;
+} comp_part;
+
+static NTSTATUS queue_compressed_part(fcb* fcb, uint8_t compression, uint64_t start_data, uint64_t end_data, void* data, uint64_t i, comp_part* part) {
+    uint64_t s2, e2;
+
+    s2 = start_data + (i * COMPRESSED_EXTENT_SIZE);
+    e2 = min(s2 + COMPRESSED_EXTENT_SIZE, end_data);
+
+    return add_calc_job_comp(fcb->Vcb, compression, (uint8_t*)data + (i * COMPRESSED_EXTENT_SIZE), (uint32_t)(e2 - s2), part->comp_data,
+                             compressed_buffer_size(compression, COMPRESSED_EXTENT_SIZE), &part->cj);
+}
+
+// The data is compressed in COMPRESSED_EXTENT_SIZE parts by the calc threads, a few parts
+// per thread ahead of the one we're writing; the extents are allocated in file order.
 NTSTATUS write_compressed(fcb* fcb, uint64_t start_data, uint64_t end_data, void* data, PIRP Irp, LIST_ENTRY* rollback) {
     NTSTATUS Status;
-    uint64_t i;
+    uint64_t num_parts, i, next;
+    ULONG max_parts, j;
+    uint8_t compression;
+    comp_part* parts;
 
-    for (i = 0; i < sector_align(end_data - start_data, COMPRESSED_EXTENT_SIZE) / COMPRESSED_EXTENT_SIZE; i++) {
-        uint64_t s2, e2;
-        bool compressed;
+    compression = get_compression_type(fcb);
+
+    if (compression == BTRFS_COMPRESSION_ZSTD)
+        fcb->Vcb->superblock.incompat_flags |= BTRFS_INCOMPAT_FLAGS_COMPRESS_ZSTD;
+    else if (compression == BTRFS_COMPRESSION_LZO)
+        fcb->Vcb->superblock.incompat_flags |= BTRFS_INCOMPAT_FLAGS_COMPRESS_LZO;
+
+    num_parts = sector_align(end_data - start_data, COMPRESSED_EXTENT_SIZE) / COMPRESSED_EXTENT_SIZE;
+    max_parts = (ULONG)min(num_parts, 2 * fcb->Vcb->calcthreads.num_threads);
+
+    parts = ExAllocatePoolWithTag(PagedPool, sizeof(comp_part) * max_parts, ALLOC_TAG);
+    if (!parts) {
+        ERR("out of memory\n");
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(parts, sizeof(comp_part) * max_parts);
+
+    for (j = 0; j < max_parts; j++) {
+        parts[j].comp_data = ExAllocatePoolWithTag(PagedPool, compressed_buffer_size(compression, COMPRESSED_EXTENT_SIZE), ALLOC_TAG);
+        if (!parts[j].comp_data) {
+            ERR("out of memory\n");
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto end;
+        }
+    }
+
+    Status = excise_extents(fcb->Vcb, fcb, start_data, end_data, Irp, rollback);
+    if (!NT_SUCCESS(Status)) {
+        ERR("excise_extents returned %08x\n", Status);
+        goto end;
+    }
+
+    for (next = 0; next < max_parts; next++) {
+        Status = queue_compressed_part(fcb, compression, start_data, end_data, data, next, &parts[next]);
+        if (!NT_SUCCESS(Status)) {
+            ERR("add_calc_job_comp returned %08x\n", Status);
+            goto end;
+        }
+    }
+
+    for (i = 0; i < num_parts; i++) {
+        comp_part* part = &parts[i % max_parts];
+        uint64_t s2, e2, comp_length;
+        uint32_t out_size;
+        uint8_t* comp_data;
+        uint8_t part_compression;
+
+        KeWaitForSingleObject(&part->cj->event, Executive, KernelMode, false, NULL);
+
+        Status = part->cj->Status;
+        out_size = part->cj->out_size;
+
+        free_calc_job(part->cj);
+        part->cj = NULL;
+
+        if (!NT_SUCCESS(Status)) {
+            ERR("compression returned %08x\n", Status);
+            goto end;
+        }
 
         s2 = start_data + (i * COMPRESSED_EXTENT_SIZE);
         e2 = min(s2 + COMPRESSED_EXTENT_SIZE, end_data);
 
-        Status = write_compressed_bit(fcb, s2, e2, (uint8_t*)data + (i * COMPRESSED_EXTENT_SIZE), &compressed, Irp, rollback);
+        if (out_size + fcb->Vcb->superblock.sector_size > e2 - s2) { // compressed extent would be larger than or same size as uncompressed extent
+            comp_length = e2 - s2;
+            comp_data = (uint8_t*)data + (i * COMPRESSED_EXTENT_SIZE);
+            part_compression = BTRFS_COMPRESSION_NONE;
+        } else {
+            comp_length = sector_align(out_size, fcb->Vcb->superblock.sector_size);
+            comp_data = part->comp_data;
+            part_compression = compression;
+
+            RtlZeroMemory(comp_data + out_size, (ULONG)(comp_length - out_size));
+        }
 
+        Status = insert_compressed_extent(fcb, s2, e2, comp_data, comp_length, part_compression, Irp, rollback);
         if (!NT_SUCCESS(Status)) {
-            ERR("write_compressed_bit returned %08x\n", Status);
-            return Status;
+            ERR("insert_compressed_extent returned %08x\n", Status);
+            goto end;
         }
 
         // If the first 128 KB of a file is incompressible, we set the nocompress flag so we don't
         // bother with the rest of it.
-        if (s2 == 0 && e2 == COMPRESSED_EXTENT_SIZE && !compressed && !fcb->Vcb->options.compress_force) {
+        if (s2 == 0 && e2 == COMPRESSED_EXTENT_SIZE && part_compression == BTRFS_COMPRESSION_NONE && !fcb->Vcb->options.compress_force) {
             fcb->inode_item.flags |= BTRFS_INODE_NOCOMPRESS;
             fcb->inode_item_changed = true;
             mark_fcb_dirty(fcb);
@@ -4129,17 +4274,42 @@ NTSTATUS write_compressed(fcb* fcb, uint64_t start_data, uint64_t end_data, void
             if (e2 < end_data) {
                 Status = do_write_file(fcb, e2, end_data, (uint8_t*)data + e2, Irp, false, 0, rollback);
 
-                if (!NT_SUCCESS(Status)) {
+                if (!NT_SUCCESS(Status))
                     ERR("do_write_file returned %08x\n", Status);
-                    return Status;
-                }
             }
 
-            return STATUS_SUCCESS;
+            goto end;
+        }
+
+        // reuse the part's buffer for the next one to compress
+        if (next < num_parts) {
+            Status = queue_compressed_part(fcb, compression, start_data, end_data, data, next, part);
+            if (!NT_SUCCESS(Status)) {
+                ERR("add_calc_job_comp returned %08x\n", Status);
+                goto end;
+            }
+
+            next++;
         }
     }
 
-    return STATUS_SUCCESS;
+    Status = STATUS_SUCCESS;
+
+end:
+    // the calc threads may still be working on the parts we haven't written
+    for (j = 0; j < max_parts; j++) {
+        if (parts[j].cj) {
+            KeWaitForSingleObject(&parts[j].cj->event, Executive, KernelMode, false, NULL);
+            free_calc_job(parts[j].cj);
+        }
+
+        if (parts[j].comp_data)
+            ExFreePool(parts[j].comp_data);
+    }
+
+    ExFreePool(parts);
+
+    return Status;
 }
 
 NTSTATUS write_file2(device_extension* Vcb, PIRP Irp, LARGE_INTEGER offset, void* buf, ULONG* length, bool paging_io, bool no_cache,
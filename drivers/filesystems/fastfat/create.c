@@ -815,6 +815,7 @@ VfatCreateFile(
 
                 if (PagingFileCreate)
                 {
+                    vfatInitPagingFileMcb(pFcb);
                     pFcb->Flags |= FCB_IS_PAGE_FILE;
                     SetFlag(DeviceExt->Flags, VCB_IS_SYS_OR_HAS_PAGE);
                 }
@@ -935,6 +936,7 @@ VfatCreateFile(
             }
             else
             {
+                vfatInitPagingFileMcb(pFcb);
                 pFcb->Flags |= FCB_IS_PAGE_FILE;
                 SetFlag(DeviceExt->Flags, VCB_IS_SYS_OR_HAS_PAGE);
             }
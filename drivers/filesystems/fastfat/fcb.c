@@ -151,7 +151,7 @@ vfatNewFCB(
     ExInitializeResourceLite(&rcFCB->PagingIoResource);
     ExInitializeResourceLite(&rcFCB->MainResource);
     FsRtlInitializeFileLock(&rcFCB->FileLock, NULL, NULL);
-    ExInitializeFastMutex(&rcFCB->LastMutex);
+    FsRtlInitializeLargeMcb(&rcFCB->Mcb, PagedPool);
     rcFCB->RFCB.PagingIoResource = &rcFCB->PagingIoResource;
     rcFCB->RFCB.Resource = &rcFCB->MainResource;
     rcFCB->RFCB.IsFastIoPossible = FastIoIsNotPossible;
@@ -254,6 +254,18 @@ vfatMakeFullName(
     return STATUS_SUCCESS;
 }
 
+/*
+ * The runs of a paging file are looked up while paging in, so they can't
+ * live in paged pool. They are read from the FAT again as needed.
+ */
+VOID
+vfatInitPagingFileMcb(
+    PVFATFCB Fcb)
+{
+    FsRtlUninitializeLargeMcb(&Fcb->Mcb);
+    FsRtlInitializeLargeMcb(&Fcb->Mcb, NonPagedPool);
+}
+
 VOID
 vfatDestroyCCB(
     PVFATCCB pCcb)
@@ -277,6 +289,7 @@ vfatDestroyFCB(
 #endif
 
     FsRtlUninitializeFileLock(&pFCB->FileLock);
+    FsRtlUninitializeLargeMcb(&pFCB->Mcb);
 
     if (!vfatFCBIsRoot(pFCB) &&
         !BooleanFlagOn(pFCB->Flags, FCB_IS_FAT) && !BooleanFlagOn(pFCB->Flags, FCB_IS_VOLUME))
@@ -514,13 +514,12 @@ typedef struct _VFATFCB
     FILE_LOCK FileLock;
 
     /*
-     * Optimization: caching of last read/write cluster+offset pair. Can't
-     * be in VFATCCB because it must be reset everytime the allocated clusters
-     * change.
+     * Optimization: runs of the cluster chain which were already walked,
+     * mapping cluster indexes in the file to clusters on the volume. It
+     * is filled lazily and must be truncated everytime the allocated
+     * clusters shrink.
      */
-    FAST_MUTEX LastMutex;
-    ULONG LastCluster;
-    ULONG LastOffset;
+    LARGE_MCB Mcb;
 
     struct _VFAT_CLOSE_CONTEXT * CloseContext;
 } VFATFCB, *PVFATFCB;
@@ -984,6 +983,10 @@ VOID
 vfatDestroyFCB(
     PVFATFCB pFCB);
 
+VOID
+vfatInitPagingFileMcb(
+    PVFATFCB Fcb);
+
 VOID
 vfatDestroyCCB(
     PVFATCCB pCcb);
@@ -1198,6 +1201,14 @@ NextCluster(
     PULONG CurrentCluster,
     BOOLEAN Extend);
 
+NTSTATUS
+OffsetToClusterRun(
+    PDEVICE_EXTENSION DeviceExt,
+    PVFATFCB Fcb,
+    ULONG FileOffset,
+    PULONG Cluster,
+    PULONG ClusterCount);
+
 /* shutdown.c */
 
 DRIVER_DISPATCH
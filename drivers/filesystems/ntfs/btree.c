@@ -1438,6 +1438,9 @@ UpdateIndexNode(PDEVICE_EXTENSION DeviceExt,
 
         // Write the buffer to the index allocation
         Status = WriteAttribute(DeviceExt, IndexAllocationContext, NodeOffset, (const PUCHAR)IndexBuffer, IndexBufferSize, &LengthWritten, FileRecord);
+
+        // Drop stale copies of the directory's index buffers, even if the write failed half way
+        NtfsInvalidateIndexBuffers(DeviceExt, IndexAllocationContext->FileMFTIndex);
         if (!NT_SUCCESS(Status) || LengthWritten != IndexBufferSize)
         {
             DPRINT1("ERROR: Failed to update index allocation!\n");
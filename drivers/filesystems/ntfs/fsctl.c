@@ -276,6 +276,8 @@ NtfsGetVolumeData(PDEVICE_OBJECT DeviceObject,
 
     ExInitializeNPagedLookasideList(&DeviceExt->FileRecLookasideList,
                                     NULL, NULL, 0, NtfsInfo->BytesPerFileRecord, TAG_FILE_REC, 0);
+    NtfsInitializeFileRecordCache(DeviceExt);
+    NtfsInitializeIndexBufferCache(DeviceExt);
 
     DeviceExt->MasterFileTable = ExAllocateFromNPagedLookasideList(&DeviceExt->FileRecLookasideList);
     if (DeviceExt->MasterFileTable == NULL)
@@ -373,6 +375,8 @@ NtfsGetVolumeData(PDEVICE_OBJECT DeviceObject,
         DPRINT1("Failed allocating volume FCB\n");
         ExFreeToNPagedLookasideList(&DeviceExt->FileRecLookasideList, VolumeRecord);
         ExFreeToNPagedLookasideList(&DeviceExt->FileRecLookasideList, DeviceExt->MasterFileTable);
+        NtfsUninitializeIndexBufferCache(DeviceExt);
+        NtfsUninitializeFileRecordCache(DeviceExt);
         ExDeleteNPagedLookasideList(&DeviceExt->FileRecLookasideList);
         return STATUS_INSUFFICIENT_RESOURCES;
     }
@@ -565,7 +569,11 @@ ByeBye:
             ExFreePool(Ccb);
 
         if (Lookaside)
+        {
+            NtfsUninitializeIndexBufferCache(Vcb);
+            NtfsUninitializeFileRecordCache(Vcb);
             ExDeleteNPagedLookasideList(&Vcb->FileRecLookasideList);
+        }
 
         if (NewDeviceObject)
             IoDeleteDevice(NewDeviceObject);
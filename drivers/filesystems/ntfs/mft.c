@@ -1068,18 +1068,13 @@ ReadAttribute(PDEVICE_EXTENSION Vcb,
               PCHAR Buffer,
               ULONG Length)
 {
-    ULONGLONG LastLCN;
-    PUCHAR DataRun;
-    LONGLONG DataRunOffset;
-    ULONGLONG DataRunLength;
-    LONGLONG DataRunStartLCN;
-    ULONGLONG CurrentOffset;
+    ULONGLONG BytesPerCluster;
+    ULONGLONG RunOffset;
+    LONGLONG Lbn;
+    LONGLONG RunLength;
     ULONG ReadLength;
     ULONG AlreadyRead;
     NTSTATUS Status;
-    
-    //TEMPTEMP
-    PUCHAR TempBuffer;
 
     if (!Context->pRecord->IsNonResident)
     {
@@ -1098,173 +1093,56 @@ ReadAttribute(PDEVICE_EXTENSION Vcb,
     }
 
     /*
-     * Non-resident attribute
-     */
-
-    /*
-     * I. Find the corresponding start data run.
+     * Non-resident attribute: look up each run in the MCB built from the
+     * data runs, and read it with a single request.
      */
 
     AlreadyRead = 0;
+    BytesPerCluster = Vcb->NtfsInfo.BytesPerCluster;
 
-    // FIXME: Cache seems to be non-working. Disable it for now
-    //if(Context->CacheRunOffset <= Offset && Offset < Context->CacheRunOffset + Context->CacheRunLength * Volume->ClusterSize)
-    if (0)
-    {
-        DataRun = Context->CacheRun;
-        LastLCN = Context->CacheRunLastLCN;
-        DataRunStartLCN = Context->CacheRunStartLCN;
-        DataRunLength = Context->CacheRunLength;
-        CurrentOffset = Context->CacheRunCurrentOffset;
-    }
-    else
+    while (Length > 0)
     {
-        //TEMPTEMP
-        ULONG UsedBufferSize;
-        TempBuffer = ExAllocatePoolWithTag(NonPagedPool, Vcb->NtfsInfo.BytesPerFileRecord, TAG_NTFS);
-        if (TempBuffer == NULL)
-        {
-            return STATUS_INSUFFICIENT_RESOURCES;
-        }
-
-        LastLCN = 0;
-        CurrentOffset = 0;
-
-        // This will be rewritten in the next iteration to just use the DataRuns MCB directly
-        ConvertLargeMCBToDataRuns(&Context->DataRunsMCB,
-                                  TempBuffer,
-                                  Vcb->NtfsInfo.BytesPerFileRecord,
-                                  &UsedBufferSize);
+        RunOffset = Offset % BytesPerCluster;
 
-        DataRun = TempBuffer;
-
-        while (1)
+        if (!FsRtlLookupLargeMcbEntry(&Context->DataRunsMCB,
+                                      Offset / BytesPerCluster,
+                                      &Lbn,
+                                      &RunLength,
+                                      NULL,
+                                      NULL,
+                                      NULL))
         {
-            DataRun = DecodeRun(DataRun, &DataRunOffset, &DataRunLength);
-            if (DataRunOffset != -1)
-            {
-                /* Normal data run. */
-                DataRunStartLCN = LastLCN + DataRunOffset;
-                LastLCN = DataRunStartLCN;
-            }
-            else
-            {
-                /* Sparse data run. */
-                DataRunStartLCN = -1;
-            }
-
-            if (Offset >= CurrentOffset &&
-                Offset < CurrentOffset + (DataRunLength * Vcb->NtfsInfo.BytesPerCluster))
-            {
+            /* Sparse runs at the end aren't in the MCB */
+            if (Offset / BytesPerCluster > Context->pRecord->NonResident.HighestVCN)
                 break;
-            }
 
-            if (*DataRun == 0)
-            {
-                ExFreePoolWithTag(TempBuffer, TAG_NTFS);
-                return AlreadyRead;
-            }
-
-            CurrentOffset += DataRunLength * Vcb->NtfsInfo.BytesPerCluster;
+            Lbn = -1;
+            RunLength = Context->pRecord->NonResident.HighestVCN + 1 - Offset / BytesPerCluster;
         }
-    }
 
-    /*
-     * II. Go through the run list and read the data
-     */
-
-    ReadLength = (ULONG)min(DataRunLength * Vcb->NtfsInfo.BytesPerCluster - (Offset - CurrentOffset), Length);
-    if (DataRunStartLCN == -1)
-    {
-        RtlZeroMemory(Buffer, ReadLength);
-        Status = STATUS_SUCCESS;
-    }
-    else
-    {
-        Status = NtfsReadDisk(Vcb->StorageDevice,
-                              DataRunStartLCN * Vcb->NtfsInfo.BytesPerCluster + Offset - CurrentOffset,
-                              ReadLength,
-                              Vcb->NtfsInfo.BytesPerSector,
-                              (PVOID)Buffer,
-                              FALSE);
-    }
-    if (NT_SUCCESS(Status))
-    {
-        Length -= ReadLength;
-        Buffer += ReadLength;
-        AlreadyRead += ReadLength;
-
-        if (ReadLength == DataRunLength * Vcb->NtfsInfo.BytesPerCluster - (Offset - CurrentOffset))
+        ReadLength = (ULONG)min(RunLength * BytesPerCluster - RunOffset, Length);
+        if (Lbn == -1)
         {
-            CurrentOffset += DataRunLength * Vcb->NtfsInfo.BytesPerCluster;
-            DataRun = DecodeRun(DataRun, &DataRunOffset, &DataRunLength);
-            if (DataRunOffset != (ULONGLONG)-1)
-            {
-                DataRunStartLCN = LastLCN + DataRunOffset;
-                LastLCN = DataRunStartLCN;
-            }
-            else
-                DataRunStartLCN = -1;
+            /* Sparse data run. */
+            RtlZeroMemory(Buffer, ReadLength);
         }
-
-        while (Length > 0)
+        else
         {
-            ReadLength = (ULONG)min(DataRunLength * Vcb->NtfsInfo.BytesPerCluster, Length);
-            if (DataRunStartLCN == -1)
-                RtlZeroMemory(Buffer, ReadLength);
-            else
-            {
-                Status = NtfsReadDisk(Vcb->StorageDevice,
-                                      DataRunStartLCN * Vcb->NtfsInfo.BytesPerCluster,
-                                      ReadLength,
-                                      Vcb->NtfsInfo.BytesPerSector,
-                                      (PVOID)Buffer,
-                                      FALSE);
-                if (!NT_SUCCESS(Status))
-                    break;
-            }
-
-            Length -= ReadLength;
-            Buffer += ReadLength;
-            AlreadyRead += ReadLength;
-
-            /* We finished this request, but there still data in this data run. */
-            if (Length == 0 && ReadLength != DataRunLength * Vcb->NtfsInfo.BytesPerCluster)
-                break;
-
-            /*
-             * Go to next run in the list.
-             */
-
-            if (*DataRun == 0)
+            Status = NtfsReadDisk(Vcb->StorageDevice,
+                                  Lbn * BytesPerCluster + RunOffset,
+                                  ReadLength,
+                                  Vcb->NtfsInfo.BytesPerSector,
+                                  (PVOID)Buffer,
+                                  FALSE);
+            if (!NT_SUCCESS(Status))
                 break;
-            CurrentOffset += DataRunLength * Vcb->NtfsInfo.BytesPerCluster;
-            DataRun = DecodeRun(DataRun, &DataRunOffset, &DataRunLength);
-            if (DataRunOffset != -1)
-            {
-                /* Normal data run. */
-                DataRunStartLCN = LastLCN + DataRunOffset;
-                LastLCN = DataRunStartLCN;
-            }
-            else
-            {
-                /* Sparse data run. */
-                DataRunStartLCN = -1;
-            }
-        } /* while */
-
-    } /* if Disk */
-
-    // TEMPTEMP
-    if (Context->pRecord->IsNonResident)
-        ExFreePoolWithTag(TempBuffer, TAG_NTFS);
+        }
 
-    Context->CacheRun = DataRun;
-    Context->CacheRunOffset = Offset + AlreadyRead;
-    Context->CacheRunStartLCN = DataRunStartLCN;
-    Context->CacheRunLength = DataRunLength;
-    Context->CacheRunLastLCN = LastLCN;
-    Context->CacheRunCurrentOffset = CurrentOffset;
+        Length -= ReadLength;
+        Buffer += ReadLength;
+        Offset += ReadLength;
+        AlreadyRead += ReadLength;
+    }
 
     return AlreadyRead;
 }
@@ -1627,15 +1505,288 @@ Cleanup:
     return Status;
 }
 
+VOID
+NtfsInitializeFileRecordCache(PDEVICE_EXTENSION Vcb)
+{
+    ExInitializeFastMutex(&Vcb->FileRecordCacheLock);
+    Vcb->FileRecordCacheClock = 0;
+    Vcb->FileRecordCacheGeneration = 0;
+    RtlZeroMemory(Vcb->FileRecordCache, sizeof(Vcb->FileRecordCache));
+}
+
+VOID
+NtfsUninitializeFileRecordCache(PDEVICE_EXTENSION Vcb)
+{
+    ULONG i;
+
+    for (i = 0; i < NTFS_FILE_RECORD_CACHE_SIZE; i++)
+    {
+        if (Vcb->FileRecordCache[i].FileRecord != NULL)
+        {
+            ExFreeToNPagedLookasideList(&Vcb->FileRecLookasideList, Vcb->FileRecordCache[i].FileRecord);
+            Vcb->FileRecordCache[i].FileRecord = NULL;
+        }
+    }
+}
+
+/**
+* Copies a fixed up file record out of the volume's file record cache.
+* Returns FALSE if the record isn't cached, along with the cache generation
+* to pass to CacheFileRecord() once the record has been read from disk.
+*/
+static
+BOOLEAN
+LookupCachedFileRecord(PDEVICE_EXTENSION Vcb,
+                       ULONGLONG MftIndex,
+                       PFILE_RECORD_HEADER FileRecord,
+                       PULONG Generation)
+{
+    PNTFS_FILE_RECORD_CACHE_ENTRY Entry;
+    BOOLEAN Found = FALSE;
+    ULONG i;
+
+    ExAcquireFastMutex(&Vcb->FileRecordCacheLock);
+    for (i = 0; i < NTFS_FILE_RECORD_CACHE_SIZE; i++)
+    {
+        Entry = &Vcb->FileRecordCache[i];
+        if (Entry->FileRecord != NULL && Entry->MftIndex == MftIndex)
+        {
+            RtlCopyMemory(FileRecord, Entry->FileRecord, Vcb->NtfsInfo.BytesPerFileRecord);
+            Entry->LastUse = ++Vcb->FileRecordCacheClock;
+            Found = TRUE;
+            break;
+        }
+    }
+    *Generation = Vcb->FileRecordCacheGeneration;
+    ExReleaseFastMutex(&Vcb->FileRecordCacheLock);
+
+    return Found;
+}
+
+/**
+* Stores a fixed up copy of a file record in the volume's file record cache,
+* replacing the previous copy of the record or the least recently used one.
+* Passing a NULL FileRecord drops the record from the cache.
+*
+* Readers pass the Generation they got from LookupCachedFileRecord(). If a
+* record was written since, what they read may already be stale and isn't
+* stored. Writers pass NULL, which makes every read in flight stale.
+*/
+static
+VOID
+CacheFileRecord(PDEVICE_EXTENSION Vcb,
+                ULONGLONG MftIndex,
+                PFILE_RECORD_HEADER FileRecord,
+                PULONG Generation)
+{
+    PNTFS_FILE_RECORD_CACHE_ENTRY Entry, Victim = NULL;
+    ULONG i;
+
+    ExAcquireFastMutex(&Vcb->FileRecordCacheLock);
+    if (Generation == NULL)
+    {
+        Vcb->FileRecordCacheGeneration++;
+    }
+    else if (*Generation != Vcb->FileRecordCacheGeneration)
+    {
+        ExReleaseFastMutex(&Vcb->FileRecordCacheLock);
+        return;
+    }
+
+    for (i = 0; i < NTFS_FILE_RECORD_CACHE_SIZE; i++)
+    {
+        Entry = &Vcb->FileRecordCache[i];
+        if (Entry->FileRecord != NULL && Entry->MftIndex == MftIndex)
+        {
+            Victim = Entry;
+            break;
+        }
+
+        if (Victim == NULL ||
+            (Victim->FileRecord != NULL &&
+             (Entry->FileRecord == NULL || Entry->LastUse < Victim->LastUse)))
+        {
+            Victim = Entry;
+        }
+    }
+
+    if (FileRecord == NULL)
+    {
+        if (Victim->FileRecord != NULL && Victim->MftIndex == MftIndex)
+        {
+            ExFreeToNPagedLookasideList(&Vcb->FileRecLookasideList, Victim->FileRecord);
+            Victim->FileRecord = NULL;
+        }
+    }
+    else
+    {
+        if (Victim->FileRecord == NULL)
+            Victim->FileRecord = ExAllocateFromNPagedLookasideList(&Vcb->FileRecLookasideList);
+
+        if (Victim->FileRecord != NULL)
+        {
+            RtlCopyMemory(Victim->FileRecord, FileRecord, Vcb->NtfsInfo.BytesPerFileRecord);
+            Victim->MftIndex = MftIndex;
+            Victim->LastUse = ++Vcb->FileRecordCacheClock;
+        }
+    }
+    ExReleaseFastMutex(&Vcb->FileRecordCacheLock);
+}
+
+VOID
+NtfsInitializeIndexBufferCache(PDEVICE_EXTENSION Vcb)
+{
+    ExInitializeFastMutex(&Vcb->IndexBufferCacheLock);
+    Vcb->IndexBufferCacheClock = 0;
+    Vcb->IndexBufferCacheGeneration = 0;
+    RtlZeroMemory(Vcb->IndexBufferCache, sizeof(Vcb->IndexBufferCache));
+}
+
+VOID
+NtfsUninitializeIndexBufferCache(PDEVICE_EXTENSION Vcb)
+{
+    ULONG i;
+
+    for (i = 0; i < NTFS_INDEX_BUFFER_CACHE_SIZE; i++)
+    {
+        if (Vcb->IndexBufferCache[i].IndexBuffer != NULL)
+        {
+            ExFreePoolWithTag(Vcb->IndexBufferCache[i].IndexBuffer, TAG_NTFS);
+            Vcb->IndexBufferCache[i].IndexBuffer = NULL;
+        }
+    }
+}
+
+/**
+* Drops every cached index buffer of the directory at MftIndex. Must be called
+* after any of the directory's $I30 index buffers is rewritten.
+*
+* This also makes every index buffer read in flight stale: it may have read
+* the buffer from disk before the write, and CacheIndexBuffer() won't store it.
+*/
+VOID
+NtfsInvalidateIndexBuffers(PDEVICE_EXTENSION Vcb,
+                           ULONGLONG MftIndex)
+{
+    PNTFS_INDEX_BUFFER_CACHE_ENTRY Entry;
+    ULONG i;
+
+    ExAcquireFastMutex(&Vcb->IndexBufferCacheLock);
+    Vcb->IndexBufferCacheGeneration++;
+    for (i = 0; i < NTFS_INDEX_BUFFER_CACHE_SIZE; i++)
+    {
+        Entry = &Vcb->IndexBufferCache[i];
+        if (Entry->IndexBuffer != NULL && Entry->MftIndex == MftIndex)
+        {
+            ExFreePoolWithTag(Entry->IndexBuffer, TAG_NTFS);
+            Entry->IndexBuffer = NULL;
+        }
+    }
+    ExReleaseFastMutex(&Vcb->IndexBufferCacheLock);
+}
+
+/**
+* Copies a fixed up index buffer of the directory at MftIndex out of the
+* volume's index buffer cache. Returns FALSE if the buffer isn't cached, along
+* with the cache Generation to pass to CacheIndexBuffer() once it is read.
+*/
+static
+BOOLEAN
+LookupCachedIndexBuffer(PDEVICE_EXTENSION Vcb,
+                        ULONGLONG MftIndex,
+                        ULONGLONG Vcn,
+                        PINDEX_BUFFER IndexBuffer,
+                        PULONG Generation)
+{
+    PNTFS_INDEX_BUFFER_CACHE_ENTRY Entry;
+    BOOLEAN Found = FALSE;
+    ULONG i;
+
+    ExAcquireFastMutex(&Vcb->IndexBufferCacheLock);
+    for (i = 0; i < NTFS_INDEX_BUFFER_CACHE_SIZE; i++)
+    {
+        Entry = &Vcb->IndexBufferCache[i];
+        if (Entry->IndexBuffer != NULL && Entry->MftIndex == MftIndex && Entry->Vcn == Vcn)
+        {
+            RtlCopyMemory(IndexBuffer, Entry->IndexBuffer, Vcb->NtfsInfo.BytesPerIndexRecord);
+            Entry->LastUse = ++Vcb->IndexBufferCacheClock;
+            Found = TRUE;
+            break;
+        }
+    }
+    *Generation = Vcb->IndexBufferCacheGeneration;
+    ExReleaseFastMutex(&Vcb->IndexBufferCacheLock);
+
+    return Found;
+}
+
+/**
+* Stores a fixed up copy of an index buffer in the volume's index buffer cache,
+* replacing the least recently used one. Nothing is stored if an index buffer
+* was written since LookupCachedIndexBuffer() returned Generation.
+*/
+static
+VOID
+CacheIndexBuffer(PDEVICE_EXTENSION Vcb,
+                 ULONGLONG MftIndex,
+                 ULONGLONG Vcn,
+                 PINDEX_BUFFER IndexBuffer,
+                 ULONG Generation)
+{
+    PNTFS_INDEX_BUFFER_CACHE_ENTRY Entry, Victim = NULL;
+    ULONG i;
+
+    ExAcquireFastMutex(&Vcb->IndexBufferCacheLock);
+    if (Generation != Vcb->IndexBufferCacheGeneration)
+    {
+        ExReleaseFastMutex(&Vcb->IndexBufferCacheLock);
+        return;
+    }
+
+    for (i = 0; i < NTFS_INDEX_BUFFER_CACHE_SIZE; i++)
+    {
+        Entry = &Vcb->IndexBufferCache[i];
+        if (Entry->IndexBuffer != NULL && Entry->MftIndex == MftIndex && Entry->Vcn == Vcn)
+        {
+            Victim = Entry;
+            break;
+        }
+
+        if (Victim == NULL ||
+            (Victim->IndexBuffer != NULL &&
+             (Entry->IndexBuffer == NULL || Entry->LastUse < Victim->LastUse)))
+        {
+            Victim = Entry;
+        }
+    }
+
+    if (Victim->IndexBuffer == NULL)
+        Victim->IndexBuffer = ExAllocatePoolWithTag(NonPagedPool, Vcb->NtfsInfo.BytesPerIndexRecord, TAG_NTFS);
+
+    if (Victim->IndexBuffer != NULL)
+    {
+        RtlCopyMemory(Victim->IndexBuffer, IndexBuffer, Vcb->NtfsInfo.BytesPerIndexRecord);
+        Victim->MftIndex = MftIndex;
+        Victim->Vcn = Vcn;
+        Victim->LastUse = ++Vcb->IndexBufferCacheClock;
+    }
+    ExReleaseFastMutex(&Vcb->IndexBufferCacheLock);
+}
+
 NTSTATUS
 ReadFileRecord(PDEVICE_EXTENSION Vcb,
                ULONGLONG index,
                PFILE_RECORD_HEADER file)
 {
     ULONGLONG BytesRead;
+    ULONG Generation;
+    NTSTATUS Status;
 
     DPRINT("ReadFileRecord(%p, %I64x, %p)\n", Vcb, index, file);
 
+    if (LookupCachedFileRecord(Vcb, index, file, &Generation))
+        return STATUS_SUCCESS;
+
     BytesRead = ReadAttribute(Vcb, Vcb->MFTContext, index * Vcb->NtfsInfo.BytesPerFileRecord, (PCHAR)file, Vcb->NtfsInfo.BytesPerFileRecord);
     if (BytesRead != Vcb->NtfsInfo.BytesPerFileRecord)
     {
@@ -1645,7 +1796,11 @@ ReadFileRecord(PDEVICE_EXTENSION Vcb,
 
     /* Apply update sequence array fixups. */
     DPRINT("Sequence number: %u\n", file->SequenceNumber);
-    return FixupUpdateSequenceArray(Vcb, &file->Ntfs);
+    Status = FixupUpdateSequenceArray(Vcb, &file->Ntfs);
+    if (NT_SUCCESS(Status))
+        CacheFileRecord(Vcb, index, file, &Generation);
+
+    return Status;
 }
 
 
@@ -1889,6 +2044,7 @@ UpdateIndexEntryFileNameSize(PDEVICE_EXTENSION Vcb,
             }
 
             Status = WriteAttribute(Vcb, IndexAllocationCtx, RecordOffset, (const PUCHAR)IndexRecord, IndexBlockSize, &Written, MftRecord);
+            NtfsInvalidateIndexBuffers(Vcb, IndexAllocationCtx->FileMFTIndex);
             if (!NT_SUCCESS(Status))
             {
                 DPRINT1("ERROR Performing write!\n");
@@ -1957,6 +2113,9 @@ UpdateFileRecord(PDEVICE_EXTENSION Vcb,
     // remove the fixup array (so the file record pointer can still be used)
     FixupUpdateSequenceArray(Vcb, &FileRecord->Ntfs);
 
+    // keep the cached copy in sync, we don't know what's on disk after a failure
+    CacheFileRecord(Vcb, MftIndex, NT_SUCCESS(Status) ? FileRecord : NULL, NULL);
+
     return Status;
 }
 
@@ -3142,6 +3301,284 @@ BrowseIndexEntries(PDEVICE_EXTENSION Vcb,
     return STATUS_OBJECT_PATH_NOT_FOUND;
 }
 
+/**
+* Reads the index buffer at Vcn of the $I30 index allocation of the directory
+* at MftIndex into IndexBuffer and applies its fixup array. Recently read
+* buffers are served from the volume's index buffer cache.
+*/
+static
+NTSTATUS
+ReadIndexBuffer(PDEVICE_EXTENSION Vcb,
+                ULONGLONG MftIndex,
+                PNTFS_ATTR_CONTEXT IndexAllocationContext,
+                ULONG IndexBlockSize,
+                ULONGLONG Vcn,
+                PINDEX_BUFFER IndexBuffer)
+{
+    ULONGLONG Offset;
+    ULONG BytesRead;
+    ULONG Generation = 0;
+    NTSTATUS Status;
+
+    if (IndexBlockSize == Vcb->NtfsInfo.BytesPerIndexRecord &&
+        LookupCachedIndexBuffer(Vcb, MftIndex, Vcn, IndexBuffer, &Generation))
+    {
+        return STATUS_SUCCESS;
+    }
+
+    Offset = GetAllocationOffsetFromVCN(Vcb, IndexBlockSize, Vcn);
+
+    BytesRead = ReadAttribute(Vcb, IndexAllocationContext, Offset, (PCHAR)IndexBuffer, IndexBlockSize);
+    if (BytesRead != IndexBlockSize)
+    {
+        DPRINT1("Unable to read index record!\n");
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    if (IndexBuffer->Ntfs.Type != NRH_INDX_TYPE)
+    {
+        DPRINT1("File system corruption detected, no index record at VCN %I64u.\n", Vcn);
+        return STATUS_DATA_ERROR;
+    }
+
+    Status = FixupUpdateSequenceArray(Vcb, &IndexBuffer->Ntfs);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Failed to apply fixup array!\n");
+        return Status;
+    }
+
+    if (IndexBlockSize == Vcb->NtfsInfo.BytesPerIndexRecord)
+        CacheIndexBuffer(Vcb, MftIndex, Vcn, IndexBuffer, Generation);
+
+    return STATUS_SUCCESS;
+}
+
+/**
+* Binary searches the entries of an index node for FileName. The entries of an
+* $I30 node are sorted the way CompareTreeKeys() orders them: by their upcased
+* names, and the final (dummy) entry after all others.
+*
+* Returns STATUS_SUCCESS and the entry whose name collates equal to FileName in
+* *Match, or STATUS_OBJECT_NAME_NOT_FOUND and the first entry that sorts after
+* FileName in *NextEntry; its sub-node is the only one that may hold FileName.
+* Entries must have room for MaxEntries pointers.
+*/
+static
+NTSTATUS
+SearchIndexNode(PINDEX_HEADER_ATTRIBUTE Header,
+                ULONG NodeSize,
+                PUNICODE_STRING FileName,
+                PINDEX_ENTRY_ATTRIBUTE *Entries,
+                ULONG MaxEntries,
+                PINDEX_ENTRY_ATTRIBUTE *Match,
+                PINDEX_ENTRY_ATTRIBUTE *NextEntry)
+{
+    PINDEX_ENTRY_ATTRIBUTE IndexEntry;
+    UNICODE_STRING EntryName;
+    ULONG_PTR NodeEnd;
+    ULONG Count, Low, High, Middle;
+    LONG Comparison;
+
+    if (Header->TotalSizeOfEntries > NodeSize)
+        return STATUS_DATA_ERROR;
+
+    // Gather the entries, they're variable-sized
+    NodeEnd = (ULONG_PTR)Header + Header->TotalSizeOfEntries;
+    IndexEntry = (PINDEX_ENTRY_ATTRIBUTE)((ULONG_PTR)Header + Header->FirstEntryOffset);
+    Count = 0;
+    for (;;)
+    {
+        if ((ULONG_PTR)IndexEntry + FIELD_OFFSET(INDEX_ENTRY_ATTRIBUTE, FileName) > NodeEnd ||
+            Count == MaxEntries)
+        {
+            return STATUS_DATA_ERROR;
+        }
+
+        Entries[Count++] = IndexEntry;
+
+        if (IndexEntry->Flags & NTFS_INDEX_ENTRY_END)
+            break;
+
+        if (IndexEntry->Length < sizeof(INDEX_ENTRY_ATTRIBUTE) ||
+            (ULONG_PTR)IndexEntry + IndexEntry->Length > NodeEnd)
+        {
+            return STATUS_DATA_ERROR;
+        }
+
+        IndexEntry = (PINDEX_ENTRY_ATTRIBUTE)((PCHAR)IndexEntry + IndexEntry->Length);
+    }
+
+    // The final entry sorts after any name, so it's never compared
+    Low = 0;
+    High = Count - 1;
+    while (Low < High)
+    {
+        Middle = Low + (High - Low) / 2;
+
+        EntryName.Buffer = Entries[Middle]->FileName.Name;
+        EntryName.Length =
+        EntryName.MaximumLength = Entries[Middle]->FileName.NameLength * sizeof(WCHAR);
+
+        Comparison = RtlCompareUnicodeString(FileName, &EntryName, TRUE);
+        if (Comparison == 0)
+        {
+            *Match = Entries[Middle];
+            return STATUS_SUCCESS;
+        }
+
+        if (Comparison < 0)
+            High = Middle;
+        else
+            Low = Middle + 1;
+    }
+
+    *NextEntry = Entries[Low];
+    return STATUS_OBJECT_NAME_NOT_FOUND;
+}
+
+/**
+* Looks up FileName in the $I30 index of the directory at MftIndex by descending
+* from the index root, reading one index buffer per level of the tree.
+*
+* Returns STATUS_MORE_PROCESSING_REQUIRED when the result isn't conclusive and
+* the caller has to walk the index instead: for case-sensitive lookups that hit
+* a name differing only in case, and for misses on names whose upcasing may
+* differ from the volume's $UpCase table (any non-ASCII name).
+*/
+static
+NTSTATUS
+SearchIndexTree(PDEVICE_EXTENSION Vcb,
+                ULONGLONG MftIndex,
+                PFILE_RECORD_HEADER MftRecord,
+                PINDEX_ROOT_ATTRIBUTE IndexRoot,
+                ULONG IndexRootLength,
+                PUNICODE_STRING FileName,
+                BOOLEAN CaseSensitive,
+                ULONGLONG *OutMFTIndex)
+{
+    PNTFS_ATTR_CONTEXT IndexAllocationContext = NULL;
+    PINDEX_BUFFER IndexBuffer = NULL;
+    PINDEX_ENTRY_ATTRIBUTE *Entries;
+    PINDEX_ENTRY_ATTRIBUTE Match = NULL, NextEntry = NULL;
+    PINDEX_HEADER_ATTRIBUTE Header;
+    UNICODE_STRING EntryName;
+    ULONG IndexBlockSize = IndexRoot->SizeOfEntry;
+    ULONG MaxEntries, NodeSize, Depth, i;
+    NTSTATUS Status;
+
+    if (IndexRootLength < sizeof(INDEX_ROOT_ATTRIBUTE) || IndexBlockSize < sizeof(INDEX_BUFFER))
+        return STATUS_DATA_ERROR;
+
+    // Every entry but the last one of a node holds at least a header and a $FILE_NAME
+    MaxEntries = max(IndexRootLength, IndexBlockSize) / sizeof(INDEX_ENTRY_ATTRIBUTE) + 1;
+    Entries = ExAllocatePoolWithTag(NonPagedPool, MaxEntries * sizeof(PINDEX_ENTRY_ATTRIBUTE), TAG_NTFS);
+    if (Entries == NULL)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    Header = &IndexRoot->Header;
+    NodeSize = IndexRootLength - FIELD_OFFSET(INDEX_ROOT_ATTRIBUTE, Header);
+
+    for (Depth = 0; ; Depth++)
+    {
+        Status = SearchIndexNode(Header, NodeSize, FileName, Entries, MaxEntries, &Match, &NextEntry);
+        if (Status != STATUS_OBJECT_NAME_NOT_FOUND)
+            break;
+
+        if (!(NextEntry->Flags & NTFS_INDEX_ENTRY_NODE))
+            break;
+
+        // No sane directory is anywhere near this deep, don't loop on a corrupted index
+        if (Depth == 32)
+        {
+            DPRINT1("File system corruption detected, $I30 index of %I64u is too deep!\n", MftIndex);
+            Status = STATUS_DATA_ERROR;
+            break;
+        }
+
+        if (IndexAllocationContext == NULL)
+        {
+            Status = FindAttribute(Vcb, MftRecord, AttributeIndexAllocation, L"$I30", 4, &IndexAllocationContext, NULL);
+            if (!NT_SUCCESS(Status))
+            {
+                DPRINT1("File system corruption detected, sub-node without an index allocation!\n");
+                IndexAllocationContext = NULL;
+                Status = STATUS_DATA_ERROR;
+                break;
+            }
+
+            IndexBuffer = ExAllocatePoolWithTag(NonPagedPool, IndexBlockSize, TAG_NTFS);
+            if (IndexBuffer == NULL)
+            {
+                Status = STATUS_INSUFFICIENT_RESOURCES;
+                break;
+            }
+        }
+
+        Status = ReadIndexBuffer(Vcb,
+                                 MftIndex,
+                                 IndexAllocationContext,
+                                 IndexBlockSize,
+                                 GetIndexEntryVCN(NextEntry),
+                                 IndexBuffer);
+        if (!NT_SUCCESS(Status))
+            break;
+
+        Header = &IndexBuffer->Header;
+        NodeSize = IndexBlockSize - FIELD_OFFSET(INDEX_BUFFER, Header);
+    }
+
+    if (Status == STATUS_SUCCESS)
+    {
+        EntryName.Buffer = Match->FileName.Name;
+        EntryName.Length =
+        EntryName.MaximumLength = Match->FileName.NameLength * sizeof(WCHAR);
+
+        if (CaseSensitive && !RtlEqualUnicodeString(FileName, &EntryName, FALSE))
+        {
+            // Names differing only in case are neighbors, possibly in other nodes
+            Status = STATUS_MORE_PROCESSING_REQUIRED;
+        }
+        else if ((Match->Data.Directory.IndexedFile & NTFS_MFT_MASK) < NTFS_FILE_FIRST_USER_FILE ||
+                 Match->FileName.NameType == NTFS_FILE_NAME_DOS)
+        {
+            Status = STATUS_OBJECT_PATH_NOT_FOUND;
+        }
+        else
+        {
+            *OutMFTIndex = (Match->Data.Directory.IndexedFile & NTFS_MFT_MASK);
+        }
+    }
+    else if (Status == STATUS_OBJECT_NAME_NOT_FOUND)
+    {
+        Status = STATUS_OBJECT_PATH_NOT_FOUND;
+
+        for (i = 0; i < FileName->Length / sizeof(WCHAR); i++)
+        {
+            if (FileName->Buffer[i] >= 0x80)
+            {
+                Status = STATUS_MORE_PROCESSING_REQUIRED;
+                break;
+            }
+        }
+    }
+
+    if (IndexBuffer != NULL)
+        ExFreePoolWithTag(IndexBuffer, TAG_NTFS);
+    if (IndexAllocationContext != NULL)
+        ReleaseAttributeContext(IndexAllocationContext);
+    ExFreePoolWithTag(Entries, TAG_NTFS);
+
+    return Status;
+}
+
+/**
+* Finds FileName in the directory at MFTIndex. Exact names are looked up by
+* descending the directory's index B+-tree, in which case FirstEntry is left
+* untouched. Wildcard searches (DirSearch) walk the index in order, starting
+* with the entry numbered *FirstEntry, and return the number of the entry found
+* in *FirstEntry.
+*/
 NTSTATUS
 NtfsFindMftRecord(PDEVICE_EXTENSION Vcb,
                   ULONGLONG MFTIndex,
@@ -3158,6 +3595,7 @@ NtfsFindMftRecord(PDEVICE_EXTENSION Vcb,
     PINDEX_ENTRY_ATTRIBUTE IndexEntry, IndexEntryEnd;
     NTSTATUS Status;
     ULONG CurrentEntry = 0;
+    ULONG IndexRootLength;
 
     DPRINT("NtfsFindMftRecord(%p, %I64d, %wZ, %lu, %s, %s, %p)\n",
            Vcb,
@@ -3197,7 +3635,7 @@ NtfsFindMftRecord(PDEVICE_EXTENSION Vcb,
         return STATUS_INSUFFICIENT_RESOURCES;
     }
 
-    ReadAttribute(Vcb, IndexRootCtx, 0, IndexRecord, Vcb->NtfsInfo.BytesPerIndexRecord);
+    IndexRootLength = ReadAttribute(Vcb, IndexRootCtx, 0, IndexRecord, Vcb->NtfsInfo.BytesPerIndexRecord);
     IndexRoot = (PINDEX_ROOT_ATTRIBUTE)IndexRecord;
     IndexEntry = (PINDEX_ENTRY_ATTRIBUTE)((PCHAR)&IndexRoot->Header + IndexRoot->Header.FirstEntryOffset);
     /* Index root is always resident. */
@@ -3206,6 +3644,26 @@ NtfsFindMftRecord(PDEVICE_EXTENSION Vcb,
 
     DPRINT("IndexRecordSize: %x IndexBlockSize: %x\n", Vcb->NtfsInfo.BytesPerIndexRecord, IndexRoot->SizeOfEntry);
 
+    if (!DirSearch)
+    {
+        Status = SearchIndexTree(Vcb,
+                                 MFTIndex,
+                                 MftRecord,
+                                 IndexRoot,
+                                 IndexRootLength,
+                                 FileName,
+                                 CaseSensitive,
+                                 OutMFTIndex);
+        if (Status != STATUS_MORE_PROCESSING_REQUIRED && Status != STATUS_DATA_ERROR)
+        {
+            ExFreePoolWithTag(IndexRecord, TAG_NTFS);
+            ExFreeToNPagedLookasideList(&Vcb->FileRecLookasideList, MftRecord);
+            return Status;
+        }
+
+        DPRINT("Falling back to walking the index of %I64u for %wZ\n", MFTIndex, FileName);
+    }
+
     Status = BrowseIndexEntries(Vcb,
                                 MftRecord,
                                 (PINDEX_ROOT_ATTRIBUTE)IndexRecord,
@@ -96,6 +96,27 @@ typedef struct
     ULONG Size;
 } NTFSIDENTIFIER, *PNTFSIDENTIFIER;
 
+/* Number of fixed up file records kept per volume by ReadFileRecord() */
+#define NTFS_FILE_RECORD_CACHE_SIZE 16
+
+typedef struct
+{
+    ULONGLONG MftIndex;
+    ULONG LastUse;
+    struct _FILE_RECORD_HEADER* FileRecord;
+} NTFS_FILE_RECORD_CACHE_ENTRY, *PNTFS_FILE_RECORD_CACHE_ENTRY;
+
+/* Number of fixed up $I30 index buffers kept per volume for directory lookups */
+#define NTFS_INDEX_BUFFER_CACHE_SIZE 16
+
+typedef struct
+{
+    ULONGLONG MftIndex;
+    ULONGLONG Vcn;
+    ULONG LastUse;
+    struct _INDEX_BUFFER* IndexBuffer;
+} NTFS_INDEX_BUFFER_CACHE_ENTRY, *PNTFS_INDEX_BUFFER_CACHE_ENTRY;
+
 typedef struct
 {
     NTFSIDENTIFIER Identifier;
@@ -118,6 +139,16 @@ typedef struct
 
     NPAGED_LOOKASIDE_LIST FileRecLookasideList;
 
+    FAST_MUTEX FileRecordCacheLock;
+    ULONG FileRecordCacheClock;
+    ULONG FileRecordCacheGeneration;
+    NTFS_FILE_RECORD_CACHE_ENTRY FileRecordCache[NTFS_FILE_RECORD_CACHE_SIZE];
+
+    FAST_MUTEX IndexBufferCacheLock;
+    ULONG IndexBufferCacheClock;
+    ULONG IndexBufferCacheGeneration;
+    NTFS_INDEX_BUFFER_CACHE_ENTRY IndexBufferCache[NTFS_INDEX_BUFFER_CACHE_SIZE];
+
     ULONG MftDataOffset;
     ULONG Flags;
     ULONG OpenHandleCount;
@@ -394,7 +425,7 @@ typedef struct
     INDEX_HEADER_ATTRIBUTE Header;
 } INDEX_ROOT_ATTRIBUTE, *PINDEX_ROOT_ATTRIBUTE;
 
-typedef struct
+typedef struct _INDEX_BUFFER
 {
     NTFS_RECORD_HEADER Ntfs;
     ULONGLONG VCN;
@@ -1111,6 +1142,22 @@ ReadFileRecord(PDEVICE_EXTENSION Vcb,
                ULONGLONG index,
                PFILE_RECORD_HEADER file);
 
+VOID
+NtfsInitializeFileRecordCache(PDEVICE_EXTENSION Vcb);
+
+VOID
+NtfsUninitializeFileRecordCache(PDEVICE_EXTENSION Vcb);
+
+VOID
+NtfsInitializeIndexBufferCache(PDEVICE_EXTENSION Vcb);
+
+VOID
+NtfsUninitializeIndexBufferCache(PDEVICE_EXTENSION Vcb);
+
+VOID
+NtfsInvalidateIndexBuffers(PDEVICE_EXTENSION Vcb,
+                           ULONGLONG MftIndex);
+
 NTSTATUS
 UpdateIndexEntryFileNameSize(PDEVICE_EXTENSION Vcb,
                              PFILE_RECORD_HEADER MftRecord,
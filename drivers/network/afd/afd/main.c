@@ -367,6 +367,11 @@ AfdCreateSocket(PDEVICE_OBJECT DeviceObject, PIRP Irp,
 
     InitializeListHead( &FCB->DatagramList );
     InitializeListHead( &FCB->PendingConnections );
+    InitializeListHead( &FCB->PollLinks );
+    InitializeListHead( &FCB->PollRegistrations );
+    InitializeListHead( &FCB->PollSetEntries );
+    InitializeListHead( &FCB->PollSetReady );
+    InitializeListHead( &FCB->PollSetWaiters );
 
     AFD_DbgPrint(MID_TRACE,("%p: Checking command channel\n", FCB));
 
@@ -452,6 +457,7 @@ AfdCleanupSocket(PDEVICE_OBJECT DeviceObject, PIRP Irp,
     }
 
     KillSelectsForFCB( FCB->DeviceExt, FileObject, FALSE );
+    DestroyPollSet( FCB->DeviceExt, FCB );
 
     return UnlockAndMaybeComplete(FCB, STATUS_SUCCESS, Irp, 0);
 }
@@ -497,6 +503,9 @@ AfdCloseSocket(PDEVICE_OBJECT DeviceObject, PIRP Irp,
     ASSERT(IsListEmpty(&FCB->PendingIrpList[FUNCTION_RECV]));
     ASSERT(IsListEmpty(&FCB->PendingIrpList[FUNCTION_PREACCEPT]));
     ASSERT(IsListEmpty(&FCB->PendingIrpList[FUNCTION_DISCONNECT]));
+    ASSERT(IsListEmpty(&FCB->PollLinks));
+    ASSERT(IsListEmpty(&FCB->PollRegistrations));
+    ASSERT(IsListEmpty(&FCB->PollSetEntries));
 
     while (!IsListEmpty(&FCB->PendingConnections))
     {
@@ -968,6 +977,12 @@ AfdDispatch(PDEVICE_OBJECT DeviceObject, PIRP Irp)
         case IOCTL_AFD_EVENT_SELECT:
             return AfdEventSelect( DeviceObject, Irp, IrpSp );
 
+        case IOCTL_AFD_REGISTER_POLL:
+            return AfdRegisterPoll( DeviceObject, Irp, IrpSp );
+
+        case IOCTL_AFD_WAIT_POLL:
+            return AfdWaitPoll( DeviceObject, Irp, IrpSp );
+
         case IOCTL_AFD_ENUM_NETWORK_EVENTS:
             return AfdEnumEvents( DeviceObject, Irp, IrpSp );
 
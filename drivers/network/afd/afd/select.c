@@ -51,6 +51,43 @@ VOID ZeroEvents( PAFD_HANDLE HandleArray,
     }
 }
 
+/* * * NOTE ALWAYS CALLED WITH DeviceExt->Lock HELD * * */
+static VOID LinkPoll( PAFD_ACTIVE_POLL Poll, PAFD_POLL_INFO PollReq ) {
+    UINT i;
+    PAFD_FCB FCB;
+    PAFD_POLL_LINK Link;
+
+    Poll->LinkCount = PollReq->HandleCount;
+
+    for( i = 0; i < PollReq->HandleCount; i++ ) {
+        Link = &Poll->Links[i];
+        Link->Poll = Poll;
+        Link->FCB = NULL;
+
+        if( !AFD_HANDLES(PollReq)[i].Handle ) continue;
+
+        FCB = ((PFILE_OBJECT)AFD_HANDLES(PollReq)[i].Handle)->FsContext;
+
+        /* A socket listed twice is already linked, as the tail entry */
+        if( !IsListEmpty( &FCB->PollLinks ) &&
+            CONTAINING_RECORD( FCB->PollLinks.Blink,
+                               AFD_POLL_LINK, ListEntry )->Poll == Poll )
+            continue;
+
+        Link->FCB = FCB;
+        InsertTailList( &FCB->PollLinks, &Link->ListEntry );
+    }
+}
+
+static VOID UnlinkPoll( PAFD_ACTIVE_POLL Poll ) {
+    UINT i;
+
+    for( i = 0; i < Poll->LinkCount; i++ ) {
+        if( Poll->Links[i].FCB )
+            RemoveEntryList( &Poll->Links[i].ListEntry );
+    }
+}
+
 
 /* you must pass either Poll OR Irp */
 VOID SignalSocket(
@@ -68,6 +105,7 @@ VOID SignalSocket(
     {
         KeCancelTimer( &Poll->Timer );
         RemoveEntryList( &Poll->ListEntry );
+        UnlinkPoll( Poll );
         ExFreePoolWithTag(Poll, TAG_AFD_ACTIVE_POLL);
     }
 
@@ -122,37 +160,53 @@ static VOID NTAPI SelectTimeout( PKDPC Dpc,
     AFD_DbgPrint(MID_TRACE,("Timeout\n"));
 }
 
+/* * * NOTE ALWAYS CALLED WITH DeviceExt->Lock HELD * * */
+static VOID FreePollRegistration( PAFD_POLL_REGISTRATION Registration ) {
+    RemoveEntryList( &Registration->SetEntry );
+    RemoveEntryList( &Registration->SocketEntry );
+    if( Registration->Signalled )
+        RemoveEntryList( &Registration->ReadyEntry );
+
+    ObDereferenceObject( Registration->FileObject );
+    ExFreePoolWithTag( Registration, TAG_AFD_POLL_REGISTRATION );
+}
+
 VOID KillSelectsForFCB( PAFD_DEVICE_EXTENSION DeviceExt,
                         PFILE_OBJECT FileObject,
                         BOOLEAN OnlyExclusive ) {
     KIRQL OldIrql;
     PLIST_ENTRY ListEntry;
+    PAFD_POLL_LINK Link;
     PAFD_ACTIVE_POLL Poll;
-    PIRP Irp;
     PAFD_POLL_INFO PollReq;
-    PAFD_HANDLE HandleArray;
-    UINT i;
+    PAFD_POLL_REGISTRATION Registration;
+    PAFD_FCB FCB = FileObject->FsContext;
 
     AFD_DbgPrint(MID_TRACE,("Killing selects that refer to %p\n", FileObject));
 
     KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
 
-    ListEntry = DeviceExt->Polls.Flink;
-    while ( ListEntry != &DeviceExt->Polls ) {
-        Poll = CONTAINING_RECORD(ListEntry, AFD_ACTIVE_POLL, ListEntry);
+    /* Only the polls waiting on this socket are linked to it */
+    ListEntry = FCB->PollLinks.Flink;
+    while ( ListEntry != &FCB->PollLinks ) {
+        Link = CONTAINING_RECORD(ListEntry, AFD_POLL_LINK, ListEntry);
         ListEntry = ListEntry->Flink;
-        Irp = Poll->Irp;
-        PollReq = Irp->AssociatedIrp.SystemBuffer;
-        HandleArray = AFD_HANDLES(PollReq);
+        Poll = Link->Poll;
 
-        for( i = 0; i < PollReq->HandleCount; i++ ) {
-            AFD_DbgPrint(MAX_TRACE,("Req: %u, This %p\n",
-                                    HandleArray[i].Handle, FileObject));
-            if( (PVOID)HandleArray[i].Handle == FileObject &&
-                (!OnlyExclusive || (OnlyExclusive && Poll->Exclusive)) ) {
-                ZeroEvents( PollReq->Handles, PollReq->HandleCount );
-                SignalSocket( Poll, NULL, PollReq, STATUS_CANCELLED );
-            }
+        if( !OnlyExclusive || Poll->Exclusive ) {
+            PollReq = Poll->Irp->AssociatedIrp.SystemBuffer;
+            ZeroEvents( PollReq->Handles, PollReq->HandleCount );
+            SignalSocket( Poll, NULL, PollReq, STATUS_CANCELLED );
+        }
+    }
+
+    /* The socket is going away, drop it from the poll sets watching it */
+    if( !OnlyExclusive ) {
+        while( !IsListEmpty( &FCB->PollRegistrations ) ) {
+            Registration = CONTAINING_RECORD(FCB->PollRegistrations.Flink,
+                                             AFD_POLL_REGISTRATION,
+                                             SocketEntry);
+            FreePollRegistration( Registration );
         }
     }
 
@@ -229,7 +283,8 @@ AfdSelect( PDEVICE_OBJECT DeviceObject, PIRP Irp,
        PAFD_ACTIVE_POLL Poll = NULL;
 
        Poll = ExAllocatePoolWithTag(NonPagedPool,
-                                    sizeof(AFD_ACTIVE_POLL),
+                                    FIELD_OFFSET(AFD_ACTIVE_POLL, Links) +
+                                    sizeof(AFD_POLL_LINK) * PollReq->HandleCount,
                                     TAG_AFD_ACTIVE_POLL);
 
        if (Poll){
@@ -242,6 +297,7 @@ AfdSelect( PDEVICE_OBJECT DeviceObject, PIRP Irp,
           KeInitializeDpc( (PRKDPC)&Poll->TimeoutDpc, SelectTimeout, Poll );
 
           InsertTailList( &DeviceExt->Polls, &Poll->ListEntry );
+          LinkPoll( Poll, PollReq );
 
           KeSetTimer( &Poll->Timer, PollReq->Timeout, &Poll->TimeoutDpc );
 
@@ -404,9 +460,287 @@ static BOOLEAN UpdatePollWithFCB( PAFD_ACTIVE_POLL Poll, PFILE_OBJECT FileObject
     return Signalled ? 1 : 0;
 }
 
+/* * * NOTE ALWAYS CALLED WITH DeviceExt->Lock HELD * * */
+static VOID CompletePollWait( PAFD_FCB SetFCB, PIRP Irp ) {
+    PIO_STACK_LOCATION IrpSp = IoGetCurrentIrpStackLocation( Irp );
+    PAFD_POLL_EVENT PollEvents = Irp->AssociatedIrp.SystemBuffer;
+    UINT Count = IrpSp->Parameters.DeviceIoControl.OutputBufferLength /
+                 sizeof(AFD_POLL_EVENT);
+    PAFD_POLL_REGISTRATION Registration;
+    UINT i = 0;
+
+    while( i < Count && !IsListEmpty( &SetFCB->PollSetReady ) ) {
+        Registration = CONTAINING_RECORD(RemoveHeadList( &SetFCB->PollSetReady ),
+                                         AFD_POLL_REGISTRATION,
+                                         ReadyEntry);
+
+        /* Report what happened since the last wait, and forget it */
+        PollEvents[i].Context = Registration->Context;
+        PollEvents[i].Events = Registration->Signalled;
+        Registration->Signalled = 0;
+        i++;
+    }
+
+    AFD_DbgPrint(MID_TRACE,("Completing poll wait %p with %u events\n", Irp, i));
+
+    Irp->IoStatus.Status = STATUS_SUCCESS;
+    Irp->IoStatus.Information = i * sizeof(AFD_POLL_EVENT);
+    IoCompleteRequest( Irp, IO_NETWORK_INCREMENT );
+}
+
+/* * * NOTE ALWAYS CALLED WITH DeviceExt->Lock HELD * * */
+static VOID ServicePollSetWaiters( PAFD_FCB SetFCB ) {
+    PIRP Irp;
+
+    while( !IsListEmpty( &SetFCB->PollSetReady ) &&
+           !IsListEmpty( &SetFCB->PollSetWaiters ) ) {
+        Irp = CONTAINING_RECORD(RemoveHeadList( &SetFCB->PollSetWaiters ),
+                                IRP,
+                                Tail.Overlay.ListEntry);
+
+        if( !IoSetCancelRoutine( Irp, NULL ) ) {
+            /* The cancel routine owns it now and will complete it */
+            InitializeListHead( &Irp->Tail.Overlay.ListEntry );
+            continue;
+        }
+
+        CompletePollWait( SetFCB, Irp );
+    }
+}
+
+/* * * NOTE ALWAYS CALLED WITH DeviceExt->Lock HELD * * */
+static VOID SignalPollRegistration( PAFD_POLL_REGISTRATION Registration ) {
+    ULONG Events = Registration->FCB->PollState & Registration->Events;
+
+    if( !Events ) return;
+
+    if( !Registration->Signalled )
+        InsertTailList( &Registration->SetFCB->PollSetReady,
+                        &Registration->ReadyEntry );
+    Registration->Signalled |= Events;
+
+    ServicePollSetWaiters( Registration->SetFCB );
+}
+
+static DRIVER_CANCEL AfdCancelPollWait;
+static VOID NTAPI AfdCancelPollWait( PDEVICE_OBJECT DeviceObject, PIRP Irp ) {
+    PAFD_DEVICE_EXTENSION DeviceExt = DeviceObject->DeviceExtension;
+    KIRQL OldIrql;
+
+    IoReleaseCancelSpinLock( Irp->CancelIrql );
+
+    KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
+    RemoveEntryList( &Irp->Tail.Overlay.ListEntry );
+    KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
+
+    Irp->IoStatus.Status = STATUS_CANCELLED;
+    Irp->IoStatus.Information = 0;
+    IoCompleteRequest( Irp, IO_NO_INCREMENT );
+}
+
+NTSTATUS NTAPI
+AfdRegisterPoll( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+                 PIO_STACK_LOCATION IrpSp ) {
+    PAFD_FCB SetFCB = IrpSp->FileObject->FsContext;
+    PAFD_POLL_REGISTER_INFO RegisterReq = Irp->AssociatedIrp.SystemBuffer;
+    PAFD_DEVICE_EXTENSION DeviceExt = DeviceObject->DeviceExtension;
+    PAFD_POLL_REGISTRATION Registration, NewRegistration;
+    PLIST_ENTRY ListEntry;
+    PFILE_OBJECT FileObject;
+    PAFD_FCB FCB;
+    KIRQL OldIrql;
+    NTSTATUS Status;
+
+    if( IrpSp->Parameters.DeviceIoControl.InputBufferLength <
+        sizeof(AFD_POLL_REGISTER_INFO) ) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto done;
+    }
+
+    AFD_DbgPrint(MID_TRACE,("Called (Handle %p Events %x Context %p)\n",
+                            (PVOID)RegisterReq->Handle,
+                            RegisterReq->Events,
+                            RegisterReq->Context));
+
+    Status = ObReferenceObjectByHandle( (PVOID)RegisterReq->Handle,
+                                        FILE_ALL_ACCESS,
+                                        *IoFileObjectType,
+                                        Irp->RequestorMode,
+                                        (PVOID*)&FileObject,
+                                        NULL );
+    if( !NT_SUCCESS(Status) ) goto done;
+
+    /* Only our own sockets can be polled */
+    FCB = FileObject->FsContext;
+    if( FileObject->DeviceObject != DeviceObject || !FCB ) {
+        ObDereferenceObject( FileObject );
+        Status = STATUS_INVALID_HANDLE;
+        goto done;
+    }
+
+    /* Allocate up front, we can't fail while holding the lock */
+    NewRegistration = NULL;
+    if( RegisterReq->Events ) {
+        NewRegistration = ExAllocatePoolWithTag(NonPagedPool,
+                                                sizeof(AFD_POLL_REGISTRATION),
+                                                TAG_AFD_POLL_REGISTRATION);
+        if( !NewRegistration ) {
+            ObDereferenceObject( FileObject );
+            Status = STATUS_NO_MEMORY;
+            goto done;
+        }
+    }
+
+    KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
+
+    /* Look for an existing registration, few sets watch the same socket */
+    Registration = NULL;
+    for( ListEntry = FCB->PollRegistrations.Flink;
+         ListEntry != &FCB->PollRegistrations;
+         ListEntry = ListEntry->Flink ) {
+        Registration = CONTAINING_RECORD(ListEntry,
+                                         AFD_POLL_REGISTRATION,
+                                         SocketEntry);
+        if( Registration->SetFCB == SetFCB ) break;
+        Registration = NULL;
+    }
+
+    if( !RegisterReq->Events ) {
+        if( Registration )
+            FreePollRegistration( Registration );
+        else
+            Status = STATUS_NOT_FOUND;
+    } else if( Registration ) {
+        Registration->Events = RegisterReq->Events;
+        Registration->Context = RegisterReq->Context;
+    } else {
+        Registration = NewRegistration;
+        NewRegistration = NULL;
+
+        RtlZeroMemory( Registration, sizeof(*Registration) );
+        Registration->SetFCB = SetFCB;
+        Registration->FCB = FCB;
+        Registration->FileObject = FileObject;
+        Registration->Events = RegisterReq->Events;
+        Registration->Context = RegisterReq->Context;
+        InsertTailList( &SetFCB->PollSetEntries, &Registration->SetEntry );
+        InsertTailList( &FCB->PollRegistrations, &Registration->SocketEntry );
+
+        /* The registration keeps the reference */
+        FileObject = NULL;
+    }
+
+    /* Don't miss anything that happened before the registration */
+    if( RegisterReq->Events )
+        SignalPollRegistration( Registration );
+
+    KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
+
+    if( NewRegistration )
+        ExFreePoolWithTag( NewRegistration, TAG_AFD_POLL_REGISTRATION );
+    if( FileObject )
+        ObDereferenceObject( FileObject );
+
+done:
+    AFD_DbgPrint(MID_TRACE,("Returning %x\n", Status));
+
+    Irp->IoStatus.Status = Status;
+    Irp->IoStatus.Information = 0;
+    IoCompleteRequest( Irp, IO_NETWORK_INCREMENT );
+
+    return Status;
+}
+
+NTSTATUS NTAPI
+AfdWaitPoll( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+             PIO_STACK_LOCATION IrpSp ) {
+    PAFD_FCB SetFCB = IrpSp->FileObject->FsContext;
+    PAFD_POLL_WAIT_INFO WaitReq = Irp->AssociatedIrp.SystemBuffer;
+    PAFD_DEVICE_EXTENSION DeviceExt = DeviceObject->DeviceExtension;
+    KIRQL OldIrql;
+    NTSTATUS Status;
+
+    if( IrpSp->Parameters.DeviceIoControl.InputBufferLength <
+        sizeof(AFD_POLL_WAIT_INFO) ||
+        IrpSp->Parameters.DeviceIoControl.OutputBufferLength <
+        sizeof(AFD_POLL_EVENT) ) {
+        Irp->IoStatus.Status = STATUS_INVALID_PARAMETER;
+        Irp->IoStatus.Information = 0;
+        IoCompleteRequest( Irp, IO_NETWORK_INCREMENT );
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
+
+    if( !IsListEmpty( &SetFCB->PollSetReady ) ) {
+        /* Something is ready, return it right away */
+        CompletePollWait( SetFCB, Irp );
+        Status = STATUS_SUCCESS;
+    } else if( WaitReq->Flags & AFD_IMMEDIATE ) {
+        Irp->IoStatus.Status = STATUS_TIMEOUT;
+        Irp->IoStatus.Information = 0;
+        IoCompleteRequest( Irp, IO_NETWORK_INCREMENT );
+        Status = STATUS_TIMEOUT;
+    } else {
+        /* Wait until one of the registrations is signalled */
+        IoMarkIrpPending( Irp );
+        InsertTailList( &SetFCB->PollSetWaiters, &Irp->Tail.Overlay.ListEntry );
+        (void)IoSetCancelRoutine( Irp, AfdCancelPollWait );
+
+        /* We lost the race against IoCancelIrp */
+        if( Irp->Cancel && IoSetCancelRoutine( Irp, NULL ) ) {
+            RemoveEntryList( &Irp->Tail.Overlay.ListEntry );
+            Irp->IoStatus.Status = STATUS_CANCELLED;
+            Irp->IoStatus.Information = 0;
+            IoCompleteRequest( Irp, IO_NO_INCREMENT );
+        }
+        Status = STATUS_PENDING;
+    }
+
+    KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
+
+    AFD_DbgPrint(MID_TRACE,("Returning %x\n", Status));
+
+    return Status;
+}
+
+VOID DestroyPollSet( PAFD_DEVICE_EXTENSION DeviceExt, PAFD_FCB FCB ) {
+    PAFD_POLL_REGISTRATION Registration;
+    PIRP Irp;
+    KIRQL OldIrql;
+
+    KeAcquireSpinLock( &DeviceExt->Lock, &OldIrql );
+
+    while( !IsListEmpty( &FCB->PollSetEntries ) ) {
+        Registration = CONTAINING_RECORD(FCB->PollSetEntries.Flink,
+                                         AFD_POLL_REGISTRATION,
+                                         SetEntry);
+        FreePollRegistration( Registration );
+    }
+
+    while( !IsListEmpty( &FCB->PollSetWaiters ) ) {
+        Irp = CONTAINING_RECORD(RemoveHeadList( &FCB->PollSetWaiters ),
+                                IRP,
+                                Tail.Overlay.ListEntry);
+
+        if( !IoSetCancelRoutine( Irp, NULL ) ) {
+            InitializeListHead( &Irp->Tail.Overlay.ListEntry );
+            continue;
+        }
+
+        Irp->IoStatus.Status = STATUS_CANCELLED;
+        Irp->IoStatus.Information = 0;
+        IoCompleteRequest( Irp, IO_NO_INCREMENT );
+    }
+
+    KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
+}
+
 VOID PollReeval( PAFD_DEVICE_EXTENSION DeviceExt, PFILE_OBJECT FileObject ) {
     PAFD_ACTIVE_POLL Poll = NULL;
     PLIST_ENTRY ThePollEnt = NULL;
+    PAFD_POLL_LINK Link;
+    PAFD_POLL_REGISTRATION Registration;
     PAFD_FCB FCB;
     KIRQL OldIrql;
     PAFD_POLL_INFO PollReq;
@@ -424,20 +758,32 @@ VOID PollReeval( PAFD_DEVICE_EXTENSION DeviceExt, PFILE_OBJECT FileObject ) {
         return;
     }
 
-    /* Now signal normal select irps */
-    ThePollEnt = DeviceExt->Polls.Flink;
+    /* Now signal normal select irps, only those waiting on this socket */
+    ThePollEnt = FCB->PollLinks.Flink;
 
-    while( ThePollEnt != &DeviceExt->Polls ) {
-        Poll = CONTAINING_RECORD( ThePollEnt, AFD_ACTIVE_POLL, ListEntry );
+    while( ThePollEnt != &FCB->PollLinks ) {
+        Link = CONTAINING_RECORD( ThePollEnt, AFD_POLL_LINK, ListEntry );
+        Poll = Link->Poll;
         PollReq = Poll->Irp->AssociatedIrp.SystemBuffer;
         AFD_DbgPrint(MID_TRACE,("Checking poll %p\n", Poll));
 
+        /* Signalling unlinks the poll, step over it first */
+        ThePollEnt = ThePollEnt->Flink;
+
         if( UpdatePollWithFCB( Poll, FileObject ) ) {
-            ThePollEnt = ThePollEnt->Flink;
             AFD_DbgPrint(MID_TRACE,("Signalling socket\n"));
             SignalSocket( Poll, NULL, PollReq, STATUS_SUCCESS );
-        } else
-            ThePollEnt = ThePollEnt->Flink;
+        }
+    }
+
+    /* And the poll sets this socket is registered with */
+    for( ThePollEnt = FCB->PollRegistrations.Flink;
+         ThePollEnt != &FCB->PollRegistrations;
+         ThePollEnt = ThePollEnt->Flink ) {
+        Registration = CONTAINING_RECORD( ThePollEnt,
+                                          AFD_POLL_REGISTRATION,
+                                          SocketEntry );
+        SignalPollRegistration( Registration );
     }
 
     KeReleaseSpinLock( &DeviceExt->Lock, OldIrql );
@@ -47,6 +47,7 @@
 #define TAG_AFD_POLL_HANDLE                'hpfA'
 #define TAG_AFD_FCB                        'cffA'
 #define TAG_AFD_ACTIVE_POLL                'pafA'
+#define TAG_AFD_POLL_REGISTRATION          'rpfA'
 #define TAG_AFD_EA_INFO                    'aefA'
 #define TAG_AFD_STORED_DATAGRAM            'gsfA'
 #define TAG_AFD_SNMP_ADDRESS_INFO          'asfA'
@@ -113,6 +114,13 @@ typedef struct _AFD_DEVICE_EXTENSION {
     KSPIN_LOCK Lock;
 } AFD_DEVICE_EXTENSION, *PAFD_DEVICE_EXTENSION;
 
+/* Links an active poll to one of the sockets it waits on */
+typedef struct _AFD_POLL_LINK {
+    LIST_ENTRY ListEntry; /* In the socket's PollLinks */
+    struct _AFD_ACTIVE_POLL *Poll;
+    struct _AFD_FCB *FCB; /* NULL if the socket is linked elsewhere */
+} AFD_POLL_LINK, *PAFD_POLL_LINK;
+
 typedef struct _AFD_ACTIVE_POLL {
     LIST_ENTRY ListEntry;
     PIRP Irp;
@@ -121,8 +129,23 @@ typedef struct _AFD_ACTIVE_POLL {
     KTIMER Timer;
     PKEVENT EventObject;
     BOOLEAN Exclusive;
+    UINT LinkCount;
+    AFD_POLL_LINK Links[1]; /* One per handle */
 } AFD_ACTIVE_POLL, *PAFD_ACTIVE_POLL;
 
+/* A socket registered with a poll set through IOCTL_AFD_REGISTER_POLL */
+typedef struct _AFD_POLL_REGISTRATION {
+    LIST_ENTRY SetEntry; /* In the poll set's PollSetEntries */
+    LIST_ENTRY SocketEntry; /* In the socket's PollRegistrations */
+    LIST_ENTRY ReadyEntry; /* In the poll set's PollSetReady, if Signalled */
+    struct _AFD_FCB *SetFCB;
+    struct _AFD_FCB *FCB;
+    PFILE_OBJECT FileObject;
+    ULONG Events;
+    ULONG Signalled;
+    PVOID Context;
+} AFD_POLL_REGISTRATION, *PAFD_POLL_REGISTRATION;
+
 typedef struct _IRP_LIST {
     LIST_ENTRY ListEntry;
     PIRP Irp;
@@ -201,6 +224,12 @@ typedef struct _AFD_FCB {
     LIST_ENTRY PendingIrpList[MAX_FUNCTIONS];
     LIST_ENTRY DatagramList;
     LIST_ENTRY PendingConnections;
+    /* Protected by DeviceExt->Lock */
+    LIST_ENTRY PollLinks;
+    LIST_ENTRY PollRegistrations;
+    LIST_ENTRY PollSetEntries;
+    LIST_ENTRY PollSetReady;
+    LIST_ENTRY PollSetWaiters;
 } AFD_FCB, *PAFD_FCB;
 
 /* bind.c */
@@ -328,6 +357,13 @@ AfdEventSelect( PDEVICE_OBJECT DeviceObject, PIRP Irp,
 NTSTATUS NTAPI
 AfdEnumEvents( PDEVICE_OBJECT DeviceObject, PIRP Irp,
 	       PIO_STACK_LOCATION IrpSp );
+NTSTATUS NTAPI
+AfdRegisterPoll( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+		 PIO_STACK_LOCATION IrpSp );
+NTSTATUS NTAPI
+AfdWaitPoll( PDEVICE_OBJECT DeviceObject, PIRP Irp,
+	     PIO_STACK_LOCATION IrpSp );
+VOID DestroyPollSet( PAFD_DEVICE_EXTENSION DeviceExt, PAFD_FCB FCB );
 VOID PollReeval( PAFD_DEVICE_EXTENSION DeviceObject, PFILE_OBJECT FileObject );
 VOID KillSelectsForFCB( PAFD_DEVICE_EXTENSION DeviceExt,
                         PFILE_OBJECT FileObject, BOOLEAN ExclusiveOnly );
@@ -30,6 +30,12 @@
 
 #define DO_XIP   0x00020000
 
+/*
+ * Largest boot disk kept mapped for its whole lifetime. The mapping uses
+ * system PTEs, which are scarce on x86, so bigger disks use on demand views
+ */
+#define RAMDISK_MAX_PERMANENT_VIEW 0x2000000u
+
 /* GLOBALS ********************************************************************/
 
 #define RAMDISK_SESSION_SIZE \
@@ -104,6 +110,9 @@ typedef struct _RAMDISK_DRIVE_EXTENSION
     WCHAR DriveLetter;
     ULONG BasePage;
 
+    /* Permanent mapping of the whole disk, if it fits in a view */
+    PVOID MappedBase;
+
     /* Data we get from the disk */
     ULONG BytesPerSector;
     ULONG SectorsPerTrack;
@@ -278,6 +287,13 @@ RamdiskMapPages(IN PRAMDISK_DRIVE_EXTENSION DeviceExtension,
     LARGE_INTEGER ActualOffset;
     LARGE_INTEGER ActualPages;
 
+    /* Nothing to map if the whole disk is mapped already */
+    if (DeviceExtension->MappedBase)
+    {
+        *OutputLength = Length;
+        return (PVOID)((ULONG_PTR)DeviceExtension->MappedBase + (ULONG_PTR)Offset.QuadPart);
+    }
+
     /* We only support boot disks for now */
     ASSERT(DeviceExtension->DiskType == RAMDISK_BOOT_DISK);
 
@@ -322,6 +338,9 @@ RamdiskUnmapPages(IN PRAMDISK_DRIVE_EXTENSION DeviceExtension,
     SIZE_T ActualLength;
     ULONG PageOffset;
 
+    /* The permanent mapping stays */
+    if (DeviceExtension->MappedBase) return;
+
     /* We only support boot disks for now */
     ASSERT(DeviceExtension->DiskType == RAMDISK_BOOT_DISK);
 
@@ -344,6 +363,26 @@ RamdiskUnmapPages(IN PRAMDISK_DRIVE_EXTENSION DeviceExtension,
     MmUnmapIoSpace(BaseAddress, ActualLength);
 }
 
+VOID
+NTAPI
+RamdiskUnmapDisk(IN PRAMDISK_DRIVE_EXTENSION DeviceExtension)
+{
+    PVOID BaseAddress;
+    LARGE_INTEGER Offset;
+
+    /* Nothing to do if the disk isn't permanently mapped */
+    BaseAddress = DeviceExtension->MappedBase;
+    if (!BaseAddress) return;
+
+    /* Clear it first, so that the views get unmapped for real */
+    DeviceExtension->MappedBase = NULL;
+    Offset.QuadPart = 0;
+    RamdiskUnmapPages(DeviceExtension,
+                      BaseAddress,
+                      Offset,
+                      DeviceExtension->DiskLength.LowPart);
+}
+
 NTSTATUS
 NTAPI
 RamdiskCreateDiskDevice(IN PRAMDISK_BUS_EXTENSION DeviceExtension,
@@ -535,6 +574,23 @@ RamdiskCreateDiskDevice(IN PRAMDISK_BUS_EXTENSION DeviceExtension,
         SymbolicLinkName.Buffer = NULL;
         GuidString.Buffer = NULL;
 
+        /* Map small boot disks once, instead of on every I/O */
+        if ((Input->DiskType == RAMDISK_BOOT_DISK) &&
+            (DiskLength.QuadPart + DriveExtension->DiskOffset <=
+             min(MaximumPerDiskViewLength, RAMDISK_MAX_PERMANENT_VIEW)))
+        {
+            CurrentOffset.QuadPart = 0;
+            DriveExtension->MappedBase = RamdiskMapPages(DriveExtension,
+                                                         CurrentOffset,
+                                                         DiskLength.LowPart,
+                                                         &BytesRead);
+            if (!DriveExtension->MappedBase)
+            {
+                /* Not fatal, map on demand */
+                DPRINT1("Failed to map the RAM disk, using on demand views\n");
+            }
+        }
+
         /* Check if this is a boot disk, or a registry ram drive */
         if (!(Input->Options.ExportAsCd) &&
             (Input->DiskType == RAMDISK_BOOT_DISK))
@@ -569,7 +625,8 @@ RamdiskCreateDiskDevice(IN PRAMDISK_BUS_EXTENSION DeviceExtension,
             }
             else
             {
-                /* Fail */
+                /* Fail, and drop the permanent view if we got one */
+                RamdiskUnmapDisk(DriveExtension);
                 Status = STATUS_INSUFFICIENT_RESOURCES;
                 goto FailCreate;
             }
@@ -940,34 +997,11 @@ RamdiskReadWriteReal(IN PIRP Irp,
                      IN PRAMDISK_DRIVE_EXTENSION DeviceExtension)
 {
     PMDL Mdl;
-    PVOID CurrentBase, SystemVa, BaseAddress;
+    PVOID SystemVa, BaseAddress;
     PIO_STACK_LOCATION IoStackLocation;
     LARGE_INTEGER CurrentOffset;
-    ULONG BytesRead, BytesLeft, CopyLength;
-    PVOID Source, Destination;
-    NTSTATUS Status;
-
-    /* Get the MDL and check if it's mapped */
-    Mdl = Irp->MdlAddress;
-    if (Mdl->MdlFlags & (MDL_MAPPED_TO_SYSTEM_VA | MDL_SOURCE_IS_NONPAGED_POOL))
-    {
-        /* Use the mapped address */
-        SystemVa = Mdl->MappedSystemVa;
-    }
-    else
-    {
-        /* Map it ourselves */
-        SystemVa = MmMapLockedPagesSpecifyCache(Mdl,
-                                                0,
-                                                MmCached,
-                                                NULL,
-                                                0,
-                                                NormalPagePriority);
-    }
-
-    /* Make sure we were able to map it */
-    CurrentBase = SystemVa;
-    if (!SystemVa) return STATUS_INSUFFICIENT_RESOURCES;
+    ULONG BytesRead, BytesLeft, MdlLength, CopyLength;
+    BOOLEAN IsRead;
 
     /* Initialize default */
     Irp->IoStatus.Information = 0;
@@ -978,56 +1012,68 @@ RamdiskReadWriteReal(IN PIRP Irp,
     BytesLeft = IoStackLocation->Parameters.Read.Length;
     if (!BytesLeft) return STATUS_INVALID_PARAMETER;
 
-    /* Do the copy loop */
-    while (TRUE)
+    /* Check if this is a read or write */
+    if (IoStackLocation->MajorFunction == IRP_MJ_READ)
+    {
+        IsRead = TRUE;
+    }
+    else if (IoStackLocation->MajorFunction == IRP_MJ_WRITE)
+    {
+        IsRead = FALSE;
+    }
+    else
     {
-        /* Map the pages */
-        BaseAddress = RamdiskMapPages(DeviceExtension,
-                                      CurrentOffset,
-                                      BytesLeft,
-                                      &BytesRead);
-        if (!BaseAddress) return STATUS_INSUFFICIENT_RESOURCES;
+        return STATUS_INVALID_PARAMETER;
+    }
 
-        /* Update our lengths */
-        Irp->IoStatus.Information += BytesRead;
-        CopyLength = BytesRead;
+    /* The buffer can be described by a chain of MDLs */
+    for (Mdl = Irp->MdlAddress; (Mdl) && (BytesLeft); Mdl = Mdl->Next)
+    {
+        /* Get a system address for this part of the buffer */
+        SystemVa = MmGetSystemAddressForMdlSafe(Mdl, NormalPagePriority);
+        if (!SystemVa) return STATUS_INSUFFICIENT_RESOURCES;
 
-        /* Check if this was a read or write */
-        Status = STATUS_SUCCESS;
-        if (IoStackLocation->MajorFunction == IRP_MJ_READ)
+        MdlLength = min(MmGetMdlByteCount(Mdl), BytesLeft);
+        while (MdlLength)
         {
-            /* Set our copy parameters */
-            Destination = CurrentBase;
-            Source = BaseAddress;
-            goto DoCopy;
-        }
-        else if (IoStackLocation->MajorFunction == IRP_MJ_WRITE)
-        {
-            /* Set our copy parameters */
-            Destination = BaseAddress;
-            Source = CurrentBase;
-DoCopy:
-            /* Copy the data */
-            RtlCopyMemory(Destination, Source, CopyLength);
-        }
-        else
-        {
-            /* Prepare us for failure */
-            BytesLeft = CopyLength;
-            Status = STATUS_INVALID_PARAMETER;
-        }
+            /* Without a permanent mapping, map one view at a time */
+            CopyLength = MdlLength;
+            if (!(DeviceExtension->MappedBase) && (CopyLength > DefaultViewLength))
+            {
+                CopyLength = DefaultViewLength;
+            }
 
-        /* Unmap the pages */
-        RamdiskUnmapPages(DeviceExtension, BaseAddress, CurrentOffset, BytesRead);
+            /* Map the pages */
+            BaseAddress = RamdiskMapPages(DeviceExtension,
+                                          CurrentOffset,
+                                          CopyLength,
+                                          &BytesRead);
+            if (!BaseAddress) return STATUS_INSUFFICIENT_RESOURCES;
+
+            /* Copy the data */
+            if (IsRead)
+            {
+                RtlCopyMemory(SystemVa, BaseAddress, BytesRead);
+            }
+            else
+            {
+                RtlCopyMemory(BaseAddress, SystemVa, BytesRead);
+            }
 
-        /* Update offset and bytes left */
-        BytesLeft -= BytesRead;
-        CurrentOffset.QuadPart += BytesRead;
-        CurrentBase = (PVOID)((ULONG_PTR)CurrentBase + BytesRead);
+            /* Unmap the pages */
+            RamdiskUnmapPages(DeviceExtension, BaseAddress, CurrentOffset, BytesRead);
 
-        /* Check if we are done */
-        if (!BytesLeft) return Status;
+            /* Update offsets and lengths */
+            Irp->IoStatus.Information += BytesRead;
+            CurrentOffset.QuadPart += BytesRead;
+            SystemVa = (PVOID)((ULONG_PTR)SystemVa + BytesRead);
+            MdlLength -= BytesRead;
+            BytesLeft -= BytesRead;
+        }
     }
+
+    /* Make sure the MDLs described the whole transfer */
+    return BytesLeft ? STATUS_INVALID_PARAMETER : STATUS_SUCCESS;
 }
 
 NTSTATUS
@@ -1048,8 +1094,8 @@ RamdiskReadWrite(IN PDEVICE_OBJECT DeviceObject,
                  IN PIRP Irp)
 {
     PRAMDISK_DRIVE_EXTENSION DeviceExtension;
-    // ULONG Length;
-    // LARGE_INTEGER ByteOffset;
+    ULONG Length;
+    LARGE_INTEGER ByteOffset;
     PIO_STACK_LOCATION IoStackLocation;
     NTSTATUS Status, ReturnStatus;
 
@@ -1064,10 +1110,17 @@ RamdiskReadWrite(IN PDEVICE_OBJECT DeviceObject,
 
     /* Capture parameters */
     IoStackLocation = IoGetCurrentIrpStackLocation(Irp);
-    // Length = IoStackLocation->Parameters.Read.Length;
-    // ByteOffset = IoStackLocation->Parameters.Read.ByteOffset;
+    Length = IoStackLocation->Parameters.Read.Length;
+    ByteOffset = IoStackLocation->Parameters.Read.ByteOffset;
 
-    /* FIXME: Validate offset */
+    /* Validate offset */
+    if ((ByteOffset.QuadPart < 0) ||
+        (ByteOffset.QuadPart + Length > DeviceExtension->DiskLength.QuadPart))
+    {
+        /* Fail, this is beyond the disk */
+        Status = STATUS_INVALID_PARAMETER;
+        goto Complete;
+    }
 
     /* FIXME: Validate sector */
 
@@ -1080,7 +1133,7 @@ RamdiskReadWrite(IN PDEVICE_OBJECT DeviceObject,
         goto Complete;
     }
 
-    /* See if we want to do this sync or async */
+    /* Memory resident disks are done inline, file backed ones in a worker */
     if (DeviceExtension->DiskType > RAMDISK_MEMORY_MAPPED_DISK)
     {
         /* Do it sync */
@@ -1544,6 +1597,14 @@ NTAPI
 RamdiskDeleteDiskDevice(IN PDEVICE_OBJECT DeviceObject,
                         IN PIRP Irp)
 {
+    PRAMDISK_DRIVE_EXTENSION DriveExtension;
+
+    DriveExtension = DeviceObject->DeviceExtension;
+
+    /* Wait for the pending I/O, then drop the permanent view of the disk */
+    IoReleaseRemoveLockAndWait(&DriveExtension->RemoveLock, Irp);
+    RamdiskUnmapDisk(DriveExtension);
+
     UNIMPLEMENTED_DBGBREAK();
     return STATUS_SUCCESS;
 }
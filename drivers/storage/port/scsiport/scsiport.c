@@ -1390,7 +1390,7 @@ CreatePortConfig:
           DeviceExtension->MultipleReqsPerLun = PortConfig->MultipleRequestPerLu = FALSE;
 
       if (ConfigInfo.DisableTaggedQueueing)
-          DeviceExtension->SupportsTaggedQueuing = PortConfig->MultipleRequestPerLu = FALSE;
+          DeviceExtension->SupportsTaggedQueuing = PortConfig->TaggedQueuing = FALSE;
 
       /* Check if we need to alloc SRB data */
       if (DeviceExtension->SupportsTaggedQueuing ||
@@ -1443,6 +1443,10 @@ CreatePortConfig:
           else
               Count = DeviceExtension->RequestsNumber * 2;
 
+          /* Each SRB data structure is a queue tag, don't run out of them */
+          if (Count > MAX_QUEUE_TAGS)
+              Count = MAX_QUEUE_TAGS;
+
           /* Allocate the data */
           SrbData = ExAllocatePoolWithTag(NonPagedPool, Count * sizeof(SCSI_REQUEST_BLOCK_INFO), TAG_SCSIPORT);
           if (SrbData == NULL)
@@ -3352,8 +3356,11 @@ SpiAllocateLunExtension(IN PSCSI_PORT_DEVICE_EXTENSION DeviceExtension)
     /* Initialize timeout counter */
     LunExtension->RequestTimeout = -1;
 
-    /* Set maximum queue size */
-    LunExtension->MaxQueueCount = 256;
+    /* Set maximum queue size. Tagged requests are limited by the number of tags */
+    if (DeviceExtension->NeedSrbDataAlloc && DeviceExtension->SrbDataCount != 0)
+        LunExtension->MaxQueueCount = DeviceExtension->SrbDataCount;
+    else
+        LunExtension->MaxQueueCount = 256;
 
     /* Initialize request queue */
     KeInitializeDeviceQueue(&LunExtension->DeviceQueue);
@@ -23,6 +23,9 @@
 
 #define MAX_SG_LIST 17
 
+/* Queue tags are 1 based and SP_UNTAGGED is 0xFF */
+#define MAX_QUEUE_TAGS 254
+
 /* Flags */
 #define SCSI_PORT_DEVICE_BUSY         0x0001
 #define SCSI_PORT_LU_ACTIVE           0x0002
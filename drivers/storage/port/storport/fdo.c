@@ -24,8 +24,8 @@ PortFdoInterruptRoutine(
 {
     PFDO_DEVICE_EXTENSION DeviceExtension;
 
-    DPRINT1("PortFdoInterruptRoutine(%p %p)\n",
-            Interrupt, ServiceContext);
+    DPRINT("PortFdoInterruptRoutine(%p %p)\n",
+           Interrupt, ServiceContext);
 
     DeviceExtension = (PFDO_DEVICE_EXTENSION)ServiceContext;
 
@@ -139,6 +139,14 @@ PortFdoStartMiniport(
         return Status;
     }
 
+    /* Allocate the request resources now that the miniport limits are known */
+    Status = PortInitializeAdapterQueue(DeviceExtension);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("PortInitializeAdapterQueue() failed (Status 0x%08lx)\n", Status);
+        return Status;
+    }
+
     /* Connect the configured interrupt */
     Status = PortFdoConnectInterrupt(DeviceExtension);
     if (!NT_SUCCESS(Status))
@@ -237,8 +245,12 @@ PortFdoStartDevice(
     {
         DPRINT1("FdoStartMiniport() failed (Status 0x%08lx)\n", Status);
         DeviceExtension->PnpState = dsStopped;
+        return Status;
     }
 
+    /* Start the request timeout and pause timer */
+    IoStartTimer(DeviceExtension->Device);
+
     return Status;
 }
 
@@ -251,7 +263,6 @@ PortSendInquiry(
     IO_STATUS_BLOCK IoStatusBlock;
     PIO_STACK_LOCATION IrpStack;
     KEVENT Event;
-//    KIRQL Irql;
     PIRP Irp;
     NTSTATUS Status;
     PSENSE_DATA SenseBuffer;
@@ -259,8 +270,6 @@ PortSendInquiry(
     ULONG RetryCount = 0;
     SCSI_REQUEST_BLOCK Srb;
     PCDB Cdb;
-//    PSCSI_PORT_LUN_EXTENSION LunExtension;
-//    PFDO_DEVICE_EXTENSION DeviceExtension;
 
     DPRINT("PortSendInquiry(%p)\n", PdoExtension);
 
@@ -313,7 +322,7 @@ PortSendInquiry(
         Srb.TargetId = PdoExtension->Target;
         Srb.Lun = PdoExtension->Lun;
         Srb.Function = SRB_FUNCTION_EXECUTE_SCSI;
-        Srb.SrbFlags = SRB_FLAGS_DATA_IN | SRB_FLAGS_DISABLE_SYNCH_TRANSFER;
+        Srb.SrbFlags = SRB_FLAGS_DATA_IN | SRB_FLAGS_DISABLE_SYNCH_TRANSFER | SRB_FLAGS_NO_QUEUE_FREEZE;
         Srb.TimeOutValue = 4;
         Srb.CdbLength = 6;
 
@@ -368,25 +377,10 @@ PortSendInquiry(
             /* Something weird happened, deal with it (unfreeze the queue) */
             KeepTrying = FALSE;
 
-            DPRINT("SpiSendInquiry(): the queue is frozen at TargetId %d\n", Srb.TargetId);
-
-//            LunExtension = SpiGetLunExtension(DeviceExtension,
-//                                              LunInfo->PathId,
-//                                              LunInfo->TargetId,
-//                                              LunInfo->Lun);
-
-            /* Clear frozen flag */
-//            LunExtension->Flags &= ~LUNEX_FROZEN_QUEUE;
+            DPRINT("PortSendInquiry(): the queue is frozen at TargetId %d\n", Srb.TargetId);
 
-            /* Acquire the spinlock */
-//            KeAcquireSpinLock(&DeviceExtension->SpinLock, &Irql);
-
-            /* Process the request */
-//            SpiGetNextRequestFromLun(DeviceObject->DeviceExtension, LunExtension);
-
-            /* SpiGetNextRequestFromLun() releases the spinlock,
-                so we just lower irql back to what it was before */
-//            KeLowerIrql(Irql);
+            /* Clear frozen flag and process the waiting requests */
+            PortReleaseLunQueue(PdoExtension);
         }
 
         /* Check if data overrun happened */
@@ -472,6 +466,10 @@ PortFdoScanBus(
         {
             DPRINT("  Scanning target %ld:%ld\n", Bus, Target);
 
+            /* Units found by an earlier scan keep their PDO */
+            if (PortGetPdoExtension(DeviceExtension, Bus, Target, 0) != NULL)
+                continue;
+
             DPRINT("    Scanning logical unit %ld:%ld:%ld\n", Bus, Target, 0);
             Status = PortCreatePdo(DeviceExtension, Bus, Target, 0, &PdoExtension);
             if (NT_SUCCESS(Status))
@@ -516,9 +514,14 @@ static
 NTSTATUS
 PortFdoQueryBusRelations(
     _In_ PFDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ PIRP Irp,
     _Out_ PULONG_PTR Information)
 {
-    NTSTATUS Status = STATUS_SUCCESS;;
+    PDEVICE_RELATIONS OldRelations, DeviceRelations;
+    PPDO_DEVICE_EXTENSION PdoExtension;
+    PLIST_ENTRY Entry;
+    ULONG Count = 0;
+    NTSTATUS Status = STATUS_SUCCESS;
 
     DPRINT1("PortFdoQueryBusRelations(%p %p)\n",
             DeviceExtension, Information);
@@ -527,7 +530,42 @@ PortFdoQueryBusRelations(
 
     DPRINT1("Units found: %lu\n", DeviceExtension->PdoCount);
 
-    *Information = 0;
+    /* Keep the relations reported by the drivers above us */
+    OldRelations = (PDEVICE_RELATIONS)Irp->IoStatus.Information;
+    if (OldRelations != NULL)
+        Count = OldRelations->Count;
+
+    DeviceRelations = ExAllocatePoolWithTag(PagedPool,
+                                            FIELD_OFFSET(DEVICE_RELATIONS, Objects) +
+                                            (Count + DeviceExtension->PdoCount) * sizeof(PDEVICE_OBJECT),
+                                            TAG_DEVICE_ID);
+    if (DeviceRelations == NULL)
+    {
+        *Information = (ULONG_PTR)OldRelations;
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    if (OldRelations != NULL)
+    {
+        RtlCopyMemory(DeviceRelations->Objects,
+                      OldRelations->Objects,
+                      Count * sizeof(PDEVICE_OBJECT));
+        ExFreePool(OldRelations);
+    }
+
+    /* The PDO list only changes on the PnP path, which this IRP serializes */
+    for (Entry = DeviceExtension->PdoListHead.Flink;
+         Entry != &DeviceExtension->PdoListHead;
+         Entry = Entry->Flink)
+    {
+        PdoExtension = CONTAINING_RECORD(Entry, PDO_DEVICE_EXTENSION, PdoListEntry);
+
+        ObReferenceObject(PdoExtension->Device);
+        DeviceRelations->Objects[Count++] = PdoExtension->Device;
+    }
+
+    DeviceRelations->Count = Count;
+    *Information = (ULONG_PTR)DeviceRelations;
 
     return Status;
 }
@@ -555,6 +593,58 @@ PortFdoFilterRequirements(
 }
 
 
+/*
+ * Runs once per second. Resumes paused adapters and units whose pause
+ * expired and lets the units with outstanding requests check for timeouts.
+ */
+VOID
+NTAPI
+PortFdoTimer(
+    _In_ PDEVICE_OBJECT DeviceObject,
+    _In_opt_ PVOID Context)
+{
+    PFDO_DEVICE_EXTENSION DeviceExtension = (PFDO_DEVICE_EXTENSION)Context;
+    PPDO_DEVICE_EXTENSION PdoExtension;
+    PLIST_ENTRY Entry;
+    ULONG Ticks;
+    KIRQL OldIrql;
+
+    Ticks = ++DeviceExtension->TimerTicks;
+
+    if (DeviceExtension->Paused &&
+        (LONG)(Ticks - DeviceExtension->PauseDeadline) >= 0)
+    {
+        DPRINT("Adapter pause expired\n");
+        InterlockedExchange(&DeviceExtension->Paused, FALSE);
+        KeInsertQueueDpc(&DeviceExtension->CompletionDpc, NULL, NULL);
+    }
+
+    OldIrql = PortAcquirePdoListLock(DeviceExtension);
+
+    for (Entry = DeviceExtension->PdoListHead.Flink;
+         Entry != &DeviceExtension->PdoListHead;
+         Entry = Entry->Flink)
+    {
+        PdoExtension = CONTAINING_RECORD(Entry, PDO_DEVICE_EXTENSION, PdoListEntry);
+
+        if (PdoExtension->Paused &&
+            (LONG)(Ticks - PdoExtension->PauseDeadline) >= 0)
+        {
+            DPRINT("Unit %lu:%lu:%lu pause expired\n",
+                   PdoExtension->Bus, PdoExtension->Target, PdoExtension->Lun);
+            InterlockedExchange(&PdoExtension->Paused, FALSE);
+            KeInsertQueueDpc(&PdoExtension->UnitDpc, NULL, NULL);
+        }
+        else if (PdoExtension->OutstandingRequests != 0)
+        {
+            KeInsertQueueDpc(&PdoExtension->UnitDpc, NULL, NULL);
+        }
+    }
+
+    PortReleasePdoListLock(DeviceExtension, OldIrql);
+}
+
+
 NTSTATUS
 NTAPI
 PortFdoScsi(
@@ -616,6 +706,7 @@ PortFdoPnp(
 
         case IRP_MN_REMOVE_DEVICE: /* 0x02 */
             DPRINT1("IRP_MJ_PNP / IRP_MN_REMOVE_DEVICE\n");
+            IoStopTimer(DeviceObject);
             break;
 
         case IRP_MN_CANCEL_REMOVE_DEVICE: /* 0x03 */
@@ -624,6 +715,7 @@ PortFdoPnp(
 
         case IRP_MN_STOP_DEVICE: /* 0x04 */
             DPRINT1("IRP_MJ_PNP / IRP_MN_STOP_DEVICE\n");
+            IoStopTimer(DeviceObject);
             break;
 
         case IRP_MN_QUERY_STOP_DEVICE: /* 0x05 */
@@ -640,7 +732,7 @@ PortFdoPnp(
             {
                 case BusRelations:
                     DPRINT1("    IRP_MJ_PNP / IRP_MN_QUERY_DEVICE_RELATIONS / BusRelations\n");
-                    Status = PortFdoQueryBusRelations(DeviceExtension, &Information);
+                    Status = PortFdoQueryBusRelations(DeviceExtension, Irp, &Information);
                     break;
 
                 case RemovalRelations:
@@ -15,6 +15,38 @@
 
 /* FUNCTIONS ******************************************************************/
 
+/*
+ * Miniports look units up from HwInterrupt, so the PDO list lock is
+ * always taken at the interrupt IRQL.
+ */
+KIRQL
+PortAcquirePdoListLock(
+    _In_ PFDO_DEVICE_EXTENSION FdoExtension)
+{
+    KIRQL OldIrql, LockIrql;
+
+    LockIrql = (KIRQL)max(FdoExtension->InterruptIrql, DISPATCH_LEVEL);
+
+    OldIrql = KeGetCurrentIrql();
+    if (OldIrql < LockIrql)
+        KeRaiseIrql(LockIrql, &OldIrql);
+
+    KeAcquireSpinLockAtDpcLevel(&FdoExtension->PdoListLock);
+
+    return OldIrql;
+}
+
+
+VOID
+PortReleasePdoListLock(
+    _In_ PFDO_DEVICE_EXTENSION FdoExtension,
+    _In_ KIRQL OldIrql)
+{
+    KeReleaseSpinLockFromDpcLevel(&FdoExtension->PdoListLock);
+    KeLowerIrql(OldIrql);
+}
+
+
 NTSTATUS
 PortCreatePdo(
     _In_ PFDO_DEVICE_EXTENSION FdoDeviceExtension,
@@ -25,7 +57,7 @@ PortCreatePdo(
 {
     PPDO_DEVICE_EXTENSION DeviceExtension = NULL;
     PDEVICE_OBJECT Pdo = NULL;
-    KLOCK_QUEUE_HANDLE LockHandle;
+    KIRQL OldIrql;
     NTSTATUS Status;
 
     DPRINT("PortCreatePdo(%p %p)\n",
@@ -58,17 +90,35 @@ PortCreatePdo(
     DeviceExtension->FdoExtension = FdoDeviceExtension;
     DeviceExtension->PnpState = dsStopped;
 
+    DeviceExtension->Bus = Bus;
+    DeviceExtension->Target = Target;
+    DeviceExtension->Lun = Lun;
+
     /* Add the PDO to the PDO list*/
-    KeAcquireInStackQueuedSpinLock(&FdoDeviceExtension->PdoListLock,
-                                   &LockHandle);
+    OldIrql = PortAcquirePdoListLock(FdoDeviceExtension);
     InsertHeadList(&FdoDeviceExtension->PdoListHead,
                    &DeviceExtension->PdoListEntry);
     FdoDeviceExtension->PdoCount++;
-    KeReleaseInStackQueuedSpinLock(&LockHandle);
+    PortReleasePdoListLock(FdoDeviceExtension, OldIrql);
 
-    DeviceExtension->Bus = Bus;
-    DeviceExtension->Target = Target;
-    DeviceExtension->Lun = Lun;
+    /* Initialize the request queue */
+    PortInitializeLunQueue(DeviceExtension);
+
+    /* Allocate the miniport logical unit extension */
+    if (FdoDeviceExtension->Miniport.PortConfig.SpecificLuExtensionSize != 0)
+    {
+        DeviceExtension->LuExtension = ExAllocatePoolWithTag(NonPagedPool,
+                                                             FdoDeviceExtension->Miniport.PortConfig.SpecificLuExtensionSize,
+                                                             TAG_LUN_EXTENSION);
+        if (DeviceExtension->LuExtension == NULL)
+        {
+            PortDeletePdo(DeviceExtension);
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        RtlZeroMemory(DeviceExtension->LuExtension,
+                      FdoDeviceExtension->Miniport.PortConfig.SpecificLuExtensionSize);
+    }
 
 
     // FIXME: More initialization
@@ -88,22 +138,37 @@ PortDeletePdo(
     _In_ PPDO_DEVICE_EXTENSION PdoExtension)
 {
     KLOCK_QUEUE_HANDLE LockHandle;
+    KIRQL OldIrql;
 
     DPRINT("PortDeletePdo(%p)\n", PdoExtension);
 
     /* Remove the PDO from the PDO list*/
-    KeAcquireInStackQueuedSpinLock(&PdoExtension->FdoExtension->PdoListLock,
-                                   &LockHandle);
+    OldIrql = PortAcquirePdoListLock(PdoExtension->FdoExtension);
     RemoveEntryList(&PdoExtension->PdoListEntry);
     PdoExtension->FdoExtension->PdoCount--;
+    PortReleasePdoListLock(PdoExtension->FdoExtension, OldIrql);
+
+    /* Remove the PDO from the ready list */
+    KeAcquireInStackQueuedSpinLock(&PdoExtension->FdoExtension->ReadyLunLock,
+                                   &LockHandle);
+    if (!IsListEmpty(&PdoExtension->ReadyListEntry))
+        RemoveEntryList(&PdoExtension->ReadyListEntry);
     KeReleaseInStackQueuedSpinLock(&LockHandle);
 
+    KeRemoveQueueDpc(&PdoExtension->UnitDpc);
+
     if (PdoExtension->InquiryBuffer)
     {
         ExFreePoolWithTag(PdoExtension->InquiryBuffer, TAG_INQUIRY_DATA);
         PdoExtension->InquiryBuffer = NULL;
     }
 
+    if (PdoExtension->LuExtension)
+    {
+        ExFreePoolWithTag(PdoExtension->LuExtension, TAG_LUN_EXTENSION);
+        PdoExtension->LuExtension = NULL;
+    }
+
 
     // FIXME: More uninitialization
 
@@ -115,17 +180,402 @@ PortDeletePdo(
 }
 
 
+/*
+ * Returns the unit with the given address. Callable up to the interrupt IRQL.
+ */
+PPDO_DEVICE_EXTENSION
+PortGetPdoExtension(
+    _In_ PFDO_DEVICE_EXTENSION FdoExtension,
+    _In_ ULONG Bus,
+    _In_ ULONG Target,
+    _In_ ULONG Lun)
+{
+    PPDO_DEVICE_EXTENSION PdoExtension, Result = NULL;
+    PLIST_ENTRY Entry;
+    KIRQL OldIrql;
+
+    OldIrql = PortAcquirePdoListLock(FdoExtension);
+
+    for (Entry = FdoExtension->PdoListHead.Flink;
+         Entry != &FdoExtension->PdoListHead;
+         Entry = Entry->Flink)
+    {
+        PdoExtension = CONTAINING_RECORD(Entry, PDO_DEVICE_EXTENSION, PdoListEntry);
+        if (PdoExtension->Bus == Bus &&
+            PdoExtension->Target == Target &&
+            PdoExtension->Lun == Lun)
+        {
+            Result = PdoExtension;
+            break;
+        }
+    }
+
+    PortReleasePdoListLock(FdoExtension, OldIrql);
+
+    return Result;
+}
+
+
+static
+NTSTATUS
+PortPdoClaimDevice(
+    _In_ PPDO_DEVICE_EXTENSION PdoExtension,
+    _In_ PSCSI_REQUEST_BLOCK Srb)
+{
+    KLOCK_QUEUE_HANDLE LockHandle;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    KeAcquireInStackQueuedSpinLock(&PdoExtension->QueueLock, &LockHandle);
+
+    if (Srb->Function == SRB_FUNCTION_RELEASE_DEVICE)
+    {
+        PdoExtension->DeviceClaimed = FALSE;
+    }
+    else if (PdoExtension->DeviceClaimed)
+    {
+        Status = STATUS_DEVICE_BUSY;
+    }
+    else
+    {
+        if (Srb->Function == SRB_FUNCTION_CLAIM_DEVICE)
+            PdoExtension->DeviceClaimed = TRUE;
+
+        Srb->DataBuffer = PdoExtension->Device;
+    }
+
+    KeReleaseInStackQueuedSpinLock(&LockHandle);
+
+    Srb->SrbStatus = NT_SUCCESS(Status) ? SRB_STATUS_SUCCESS : SRB_STATUS_BUSY;
+
+    return Status;
+}
+
+
 NTSTATUS
 NTAPI
 PortPdoScsi(
     _In_ PDEVICE_OBJECT DeviceObject,
     _In_ PIRP Irp)
 {
-    DPRINT1("PortPdoScsi(%p %p)\n", DeviceObject, Irp);
+    PPDO_DEVICE_EXTENSION DeviceExtension;
+    PIO_STACK_LOCATION Stack;
+    PSCSI_REQUEST_BLOCK Srb;
+    NTSTATUS Status;
+
+    DPRINT("PortPdoScsi(%p %p)\n", DeviceObject, Irp);
+
+    DeviceExtension = (PPDO_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
+    ASSERT(DeviceExtension);
+    ASSERT(DeviceExtension->ExtensionType == PdoExtension);
+
+    Stack = IoGetCurrentIrpStackLocation(Irp);
+    Srb = Stack->Parameters.Scsi.Srb;
+    if (Srb == NULL)
+    {
+        Irp->IoStatus.Information = 0;
+        Irp->IoStatus.Status = STATUS_INVALID_PARAMETER;
+        IoCompleteRequest(Irp, IO_NO_INCREMENT);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    switch (Srb->Function)
+    {
+        case SRB_FUNCTION_CLAIM_DEVICE:
+        case SRB_FUNCTION_ATTACH_DEVICE:
+        case SRB_FUNCTION_RELEASE_DEVICE:
+            Status = PortPdoClaimDevice(DeviceExtension, Srb);
+            break;
+
+        case SRB_FUNCTION_RELEASE_QUEUE:
+            PortReleaseLunQueue(DeviceExtension);
+            Srb->SrbStatus = SRB_STATUS_SUCCESS;
+            Status = STATUS_SUCCESS;
+            break;
+
+        case SRB_FUNCTION_FLUSH_QUEUE:
+            PortFlushLunQueue(DeviceExtension);
+            Srb->SrbStatus = SRB_STATUS_SUCCESS;
+            Status = STATUS_SUCCESS;
+            break;
+
+        case SRB_FUNCTION_LOCK_QUEUE:
+        case SRB_FUNCTION_UNLOCK_QUEUE:
+            PortSetLunQueueLock(DeviceExtension,
+                                Srb->Function == SRB_FUNCTION_LOCK_QUEUE);
+            Srb->SrbStatus = SRB_STATUS_SUCCESS;
+            Status = STATUS_SUCCESS;
+            break;
+
+        default:
+            /* Everything else goes to the miniport */
+            return PortQueueRequest(DeviceExtension, Irp, Srb);
+    }
 
     Irp->IoStatus.Information = 0;
-    Irp->IoStatus.Status = STATUS_SUCCESS;
+    Irp->IoStatus.Status = Status;
     IoCompleteRequest(Irp, IO_NO_INCREMENT);
+    return Status;
+}
+
+
+static
+PCSTR
+PortGetDeviceTypeName(
+    _In_ PINQUIRYDATA InquiryData,
+    _In_ BOOLEAN Generic)
+{
+    static const PCSTR TypeNames[][2] =
+    {
+        {"Disk", "GenDisk"},
+        {"Sequential", "GenSequential"},
+        {"Printer", "GenPrinter"},
+        {"Processor", "GenProcessor"},
+        {"Worm", "GenWorm"},
+        {"CdRom", "GenCdRom"},
+        {"Scanner", "GenScanner"},
+        {"Optical", "GenOptical"},
+        {"Changer", "GenChanger"},
+        {"Net", "GenNet"}
+    };
+
+    if (InquiryData->DeviceType >= RTL_NUMBER_OF(TypeNames))
+        return Generic ? "ScsiOther" : "Other";
+
+    return TypeNames[InquiryData->DeviceType][Generic ? 1 : 0];
+}
+
+
+/* Copies an inquiry string field, replacing the characters IDs must not contain */
+static
+ULONG
+PortCopyIdField(
+    _Out_writes_(Length) PCHAR Buffer,
+    _In_reads_(Length) const UCHAR *Field,
+    _In_ ULONG Length)
+{
+    ULONG i;
+
+    for (i = 0; i < Length; i++)
+    {
+        if (Field[i] <= ' ' || Field[i] >= 0x7F || Field[i] == ',')
+            Buffer[i] = '_';
+        else
+            Buffer[i] = Field[i];
+    }
+
+    return Length;
+}
+
+
+/*
+ * Converts a list of ANSI IDs into the Unicode MULTI_SZ the PnP manager
+ * expects. A single ID yields a string with an extra terminating NUL.
+ */
+static
+NTSTATUS
+PortBuildIdList(
+    _In_reads_(Count) PCSTR *Ids,
+    _In_ ULONG Count,
+    _Out_ PULONG_PTR Information)
+{
+    PWCHAR Buffer, Ptr;
+    ULONG Length = 1, i;
+    PCSTR Id;
+
+    for (i = 0; i < Count; i++)
+        Length += (ULONG)strlen(Ids[i]) + 1;
+
+    Buffer = ExAllocatePoolWithTag(PagedPool, Length * sizeof(WCHAR), TAG_DEVICE_ID);
+    if (Buffer == NULL)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    Ptr = Buffer;
+    for (i = 0; i < Count; i++)
+    {
+        for (Id = Ids[i]; *Id != ANSI_NULL; Id++)
+            *Ptr++ = (WCHAR)(UCHAR)*Id;
+        *Ptr++ = UNICODE_NULL;
+    }
+    *Ptr = UNICODE_NULL;
+
+    *Information = (ULONG_PTR)Buffer;
+
+    return STATUS_SUCCESS;
+}
+
+
+static
+NTSTATUS
+PortPdoQueryId(
+    _In_ PPDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ BUS_QUERY_ID_TYPE IdType,
+    _Out_ PULONG_PTR Information)
+{
+    PINQUIRYDATA InquiryData = DeviceExtension->InquiryBuffer;
+    CHAR Id[6][64];
+    PCSTR Ids[6];
+    PCSTR TypeName;
+    ULONG Offset;
+
+    TypeName = PortGetDeviceTypeName(InquiryData, FALSE);
+
+    switch (IdType)
+    {
+        case BusQueryDeviceID:
+            /* SCSI\<Type>&Ven_<Vendor>&Prod_<Product>&Rev_<Revision> */
+            Offset = sprintf(Id[0], "SCSI\\%s&Ven_", TypeName);
+            Offset += PortCopyIdField(&Id[0][Offset], InquiryData->VendorId, 8);
+            Offset += sprintf(&Id[0][Offset], "&Prod_");
+            Offset += PortCopyIdField(&Id[0][Offset], InquiryData->ProductId, 16);
+            Offset += sprintf(&Id[0][Offset], "&Rev_");
+            Offset += PortCopyIdField(&Id[0][Offset], InquiryData->ProductRevisionLevel, 4);
+            Id[0][Offset] = ANSI_NULL;
+
+            Ids[0] = Id[0];
+            return PortBuildIdList(Ids, 1, Information);
+
+        case BusQueryHardwareIDs:
+            /* SCSI\<Type><Vendor><Product><Revision> */
+            Offset = sprintf(Id[0], "SCSI\\%s", TypeName);
+            Offset += PortCopyIdField(&Id[0][Offset], InquiryData->VendorId, 8);
+            Offset += PortCopyIdField(&Id[0][Offset], InquiryData->ProductId, 16);
+            Offset += PortCopyIdField(&Id[0][Offset], InquiryData->ProductRevisionLevel, 4);
+            Id[0][Offset] = ANSI_NULL;
+
+            /* SCSI\<Type><Vendor><Product> */
+            Offset = sprintf(Id[1], "SCSI\\%s", TypeName);
+            Offset += PortCopyIdField(&Id[1][Offset], InquiryData->VendorId, 8);
+            Offset += PortCopyIdField(&Id[1][Offset], InquiryData->ProductId, 16);
+            Id[1][Offset] = ANSI_NULL;
+
+            /* SCSI\<Type><Vendor> */
+            Offset = sprintf(Id[2], "SCSI\\%s", TypeName);
+            Offset += PortCopyIdField(&Id[2][Offset], InquiryData->VendorId, 8);
+            Id[2][Offset] = ANSI_NULL;
+
+            /* SCSI\<Vendor><Product><Revision[0]> */
+            Offset = sprintf(Id[3], "SCSI\\");
+            Offset += PortCopyIdField(&Id[3][Offset], InquiryData->VendorId, 8);
+            Offset += PortCopyIdField(&Id[3][Offset], InquiryData->ProductId, 16);
+            Offset += PortCopyIdField(&Id[3][Offset], InquiryData->ProductRevisionLevel, 1);
+            Id[3][Offset] = ANSI_NULL;
+
+            /* <Vendor><Product><Revision[0]> */
+            Offset = PortCopyIdField(Id[4], InquiryData->VendorId, 8);
+            Offset += PortCopyIdField(&Id[4][Offset], InquiryData->ProductId, 16);
+            Offset += PortCopyIdField(&Id[4][Offset], InquiryData->ProductRevisionLevel, 1);
+            Id[4][Offset] = ANSI_NULL;
+
+            Ids[0] = Id[0];
+            Ids[1] = Id[1];
+            Ids[2] = Id[2];
+            Ids[3] = Id[3];
+            Ids[4] = Id[4];
+            Ids[5] = PortGetDeviceTypeName(InquiryData, TRUE);
+            return PortBuildIdList(Ids, 6, Information);
+
+        case BusQueryCompatibleIDs:
+            sprintf(Id[0], "SCSI\\%s", TypeName);
+
+            Ids[0] = Id[0];
+            Ids[1] = "SCSI\\RAW";
+            return PortBuildIdList(Ids, 2, Information);
+
+        case BusQueryInstanceID:
+            sprintf(Id[0], "%lx%lx%lx",
+                    DeviceExtension->Bus, DeviceExtension->Target, DeviceExtension->Lun);
+
+            Ids[0] = Id[0];
+            return PortBuildIdList(Ids, 1, Information);
+
+        default:
+            return STATUS_NOT_SUPPORTED;
+    }
+}
+
+
+static
+NTSTATUS
+PortPdoQueryDeviceText(
+    _In_ PPDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ DEVICE_TEXT_TYPE TextType,
+    _Out_ PULONG_PTR Information)
+{
+    PINQUIRYDATA InquiryData = DeviceExtension->InquiryBuffer;
+    CHAR Text[64];
+    PCSTR Texts[1];
+    ULONG Offset;
+
+    switch (TextType)
+    {
+        case DeviceTextDescription:
+            /* <Vendor> <Product> */
+            Offset = PortCopyIdField(Text, InquiryData->VendorId, 8);
+            while (Offset > 0 && Text[Offset - 1] == '_')
+                Offset--;
+            Text[Offset++] = ' ';
+            Offset += PortCopyIdField(&Text[Offset], InquiryData->ProductId, 16);
+            while (Offset > 0 && Text[Offset - 1] == '_')
+                Offset--;
+            Text[Offset] = ANSI_NULL;
+            break;
+
+        case DeviceTextLocationInformation:
+            sprintf(Text, "Bus Number %lu, Target Id %lu, LUN %lu",
+                    DeviceExtension->Bus, DeviceExtension->Target, DeviceExtension->Lun);
+            break;
+
+        default:
+            return STATUS_NOT_SUPPORTED;
+    }
+
+    Texts[0] = Text;
+    return PortBuildIdList(Texts, 1, Information);
+}
+
+
+static
+NTSTATUS
+PortPdoQueryCapabilities(
+    _In_ PPDO_DEVICE_EXTENSION DeviceExtension,
+    _In_ PDEVICE_CAPABILITIES Capabilities)
+{
+    if (Capabilities->Version != 1 ||
+        Capabilities->Size < sizeof(DEVICE_CAPABILITIES))
+        return STATUS_UNSUCCESSFUL;
+
+    Capabilities->UniqueID = FALSE;
+    Capabilities->SilentInstall = TRUE;
+    Capabilities->RawDeviceOK = FALSE;
+    Capabilities->Removable = FALSE;
+    Capabilities->SurpriseRemovalOK = FALSE;
+    Capabilities->Address = (DeviceExtension->Target << 8) | DeviceExtension->Lun;
+    Capabilities->UINumber = DeviceExtension->Target;
+
+    return STATUS_SUCCESS;
+}
+
+
+static
+NTSTATUS
+PortPdoQueryTargetRelation(
+    _In_ PPDO_DEVICE_EXTENSION DeviceExtension,
+    _Out_ PULONG_PTR Information)
+{
+    PDEVICE_RELATIONS DeviceRelations;
+
+    DeviceRelations = ExAllocatePoolWithTag(PagedPool,
+                                            sizeof(DEVICE_RELATIONS),
+                                            TAG_DEVICE_ID);
+    if (DeviceRelations == NULL)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    DeviceRelations->Count = 1;
+    DeviceRelations->Objects[0] = DeviceExtension->Device;
+    ObReferenceObject(DeviceExtension->Device);
+
+    *Information = (ULONG_PTR)DeviceRelations;
+
     return STATUS_SUCCESS;
 }
 
@@ -136,12 +586,98 @@ PortPdoPnp(
     _In_ PDEVICE_OBJECT DeviceObject,
     _In_ PIRP Irp)
 {
-    DPRINT1("PortPdoPnp(%p %p)\n", DeviceObject, Irp);
+    PPDO_DEVICE_EXTENSION DeviceExtension;
+    PIO_STACK_LOCATION Stack;
+    ULONG_PTR Information;
+    NTSTATUS Status;
 
-    Irp->IoStatus.Information = 0;
-    Irp->IoStatus.Status = STATUS_SUCCESS;
+    DPRINT("PortPdoPnp(%p %p)\n", DeviceObject, Irp);
+
+    DeviceExtension = (PPDO_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
+    ASSERT(DeviceExtension);
+    ASSERT(DeviceExtension->ExtensionType == PdoExtension);
+
+    Stack = IoGetCurrentIrpStackLocation(Irp);
+
+    /* Requests we do not handle keep their status and information */
+    Status = Irp->IoStatus.Status;
+    Information = Irp->IoStatus.Information;
+
+    switch (Stack->MinorFunction)
+    {
+        case IRP_MN_START_DEVICE: /* 0x00 */
+            DPRINT("IRP_MJ_PNP / IRP_MN_START_DEVICE\n");
+            DeviceExtension->PnpState = dsStarted;
+            Status = STATUS_SUCCESS;
+            break;
+
+        case IRP_MN_QUERY_REMOVE_DEVICE: /* 0x01 */
+        case IRP_MN_CANCEL_REMOVE_DEVICE: /* 0x03 */
+        case IRP_MN_QUERY_STOP_DEVICE: /* 0x05 */
+        case IRP_MN_CANCEL_STOP_DEVICE: /* 0x06 */
+            Status = STATUS_SUCCESS;
+            break;
+
+        case IRP_MN_REMOVE_DEVICE: /* 0x02 */
+        case IRP_MN_SURPRISE_REMOVAL: /* 0x17 */
+            DPRINT("IRP_MJ_PNP / IRP_MN_REMOVE_DEVICE (0x%lx)\n", Stack->MinorFunction);
+            /*
+             * The unit stays on the bus, so keep the PDO and only fail the
+             * requests still waiting in its queue.
+             */
+            PortFlushLunQueue(DeviceExtension);
+            DeviceExtension->PnpState = (Stack->MinorFunction == IRP_MN_REMOVE_DEVICE) ?
+                                        dsRemoved : dsSurpriseRemoved;
+            Status = STATUS_SUCCESS;
+            break;
+
+        case IRP_MN_STOP_DEVICE: /* 0x04 */
+            DeviceExtension->PnpState = dsStopped;
+            Status = STATUS_SUCCESS;
+            break;
+
+        case IRP_MN_QUERY_DEVICE_RELATIONS: /* 0x07 */
+            if (Stack->Parameters.QueryDeviceRelations.Type == TargetDeviceRelation)
+                Status = PortPdoQueryTargetRelation(DeviceExtension, &Information);
+            break;
+
+        case IRP_MN_QUERY_CAPABILITIES: /* 0x09 */
+            Status = PortPdoQueryCapabilities(DeviceExtension,
+                                              Stack->Parameters.DeviceCapabilities.Capabilities);
+            break;
+
+        case IRP_MN_QUERY_DEVICE_TEXT: /* 0x0c */
+            Status = PortPdoQueryDeviceText(DeviceExtension,
+                                            Stack->Parameters.QueryDeviceText.DeviceTextType,
+                                            &Information);
+            if (Status == STATUS_NOT_SUPPORTED)
+            {
+                Status = Irp->IoStatus.Status;
+                Information = Irp->IoStatus.Information;
+            }
+            break;
+
+        case IRP_MN_QUERY_ID: /* 0x13 */
+            DPRINT("IRP_MJ_PNP / IRP_MN_QUERY_ID %lu\n", Stack->Parameters.QueryId.IdType);
+            Status = PortPdoQueryId(DeviceExtension,
+                                    Stack->Parameters.QueryId.IdType,
+                                    &Information);
+            if (Status == STATUS_NOT_SUPPORTED)
+            {
+                Status = Irp->IoStatus.Status;
+                Information = Irp->IoStatus.Information;
+            }
+            break;
+
+        default:
+            DPRINT("IRP_MJ_PNP / Unhandled minor function 0x%lx\n", Stack->MinorFunction);
+            break;
+    }
+
+    Irp->IoStatus.Information = Information;
+    Irp->IoStatus.Status = Status;
     IoCompleteRequest(Irp, IO_NO_INCREMENT);
-    return STATUS_SUCCESS;
+    return Status;
 }
 
 /* EOF */
@@ -31,6 +31,27 @@
 #define TAG_ADDRESS_MAPPING 'MAtS'
 #define TAG_INQUIRY_DATA    'QItS'
 #define TAG_SENSE_DATA      'NStS'
+#define TAG_LUN_EXTENSION   'ULtS'
+#define TAG_REQUEST         'QRtS'
+#define TAG_DEVICE_ID       'IDtS'
+
+/* Request queue limits */
+#define STORPORT_DEFAULT_QUEUE_DEPTH        20
+#define STORPORT_MAX_QUEUE_DEPTH            254
+#define STORPORT_MAX_ADAPTER_REQUESTS       256
+#define STORPORT_DEFAULT_TRANSFER_LENGTH    0x10000
+#define STORPORT_SRB_EXTENSION_ALIGNMENT    128
+#define STORPORT_START_BATCH                8
+#define STORPORT_DEFAULT_REQUEST_TIMEOUT    10
+
+/* Matches any path, target or LUN in StorPortCompleteRequest */
+#ifndef SP_UNTAGGED
+#define SP_UNTAGGED ((UCHAR)~0)
+#endif
+
+/* Logical unit queue flags */
+#define LUNEX_FROZEN_QUEUE  0x0001
+#define LUNEX_LOCKED_QUEUE  0x0002
 
 typedef enum
 {
@@ -81,6 +102,19 @@ typedef struct _MINIPORT
     PMINIPORT_DEVICE_EXTENSION MiniportExtension;
 } MINIPORT, *PMINIPORT;
 
+typedef struct _PORT_REQUEST
+{
+    SLIST_ENTRY CompletionEntry;
+    PIRP Irp;
+    PSCSI_REQUEST_BLOCK Srb;
+    struct _PDO_DEVICE_EXTENSION *PdoExtension;
+    ULONG QueueTag;
+    ULONG Timeout;
+    LONG Completed;
+    BOOLEAN FromLookaside;
+    PSTOR_SCATTER_GATHER_LIST ScatterGatherList;
+} PORT_REQUEST, *PPORT_REQUEST;
+
 typedef struct _UNIT_DATA
 {
     LIST_ENTRY ListEntry;
@@ -111,10 +145,31 @@ typedef struct _FDO_DEVICE_EXTENSION
     PHW_PASSIVE_INITIALIZE_ROUTINE HwPassiveInitRoutine;
     PKINTERRUPT Interrupt;
     ULONG InterruptIrql;
+    ULONG TimerTicks;
 
     KSPIN_LOCK PdoListLock;
     LIST_ENTRY PdoListHead;
     ULONG PdoCount;
+
+    /* Request processing */
+    BOOLEAN QueueInitialized;
+    KSPIN_LOCK StartIoLock;
+    KDPC CompletionDpc;
+    SLIST_HEADER CompletionList;
+    KSPIN_LOCK ReadyLunLock;
+    LIST_ENTRY ReadyLunListHead;
+    NPAGED_LOOKASIDE_LIST RequestLookaside;
+    ULONG MaxScatterGatherElements;
+    LONG OutstandingRequests;
+    LONG MaxOutstandingRequests;
+    LONG BusyCount;
+    LONG Paused;
+    ULONG PauseDeadline;
+    SLIST_HEADER SrbExtensionList;
+    PVOID SrbExtensionBase;
+    PHYSICAL_ADDRESS SrbExtensionPhysicalBase;
+    ULONG SrbExtensionSlotSize;
+    ULONG SrbExtensionPoolSize;
 } FDO_DEVICE_EXTENSION, *PFDO_DEVICE_EXTENSION;
 
 
@@ -131,8 +186,25 @@ typedef struct _PDO_DEVICE_EXTENSION
     ULONG Target;
     ULONG Lun;
     PINQUIRYDATA InquiryBuffer;
-
-
+    PVOID LuExtension;
+    BOOLEAN DeviceClaimed;
+
+    /* Request queue */
+    KSPIN_LOCK QueueLock;
+    LIST_ENTRY QueueListHead;
+    ULONG QueueFlags;
+    LONG QueueDepth;
+    LONG OutstandingRequests;
+    LONG BusyCount;
+    LONG Paused;
+    ULONG PauseDeadline;
+    LONG CompletePending;
+    UCHAR CompleteSrbStatus;
+    KDPC UnitDpc;
+    LIST_ENTRY ReadyListEntry;
+    RTL_BITMAP TagBitmap;
+    ULONG TagBitmapBuffer[(STORPORT_MAX_QUEUE_DEPTH + 31) / 32];
+    PPORT_REQUEST ActiveRequests[STORPORT_MAX_QUEUE_DEPTH];
 } PDO_DEVICE_EXTENSION, *PPDO_DEVICE_EXTENSION;
 
 
@@ -150,6 +222,8 @@ PortFdoPnp(
     _In_ PDEVICE_OBJECT DeviceObject,
     _In_ PIRP Irp);
 
+IO_TIMER_ROUTINE PortFdoTimer;
+
 
 /* miniport.c */
 
@@ -236,6 +310,15 @@ AllocateAddressMapping(
 
 /* pdo.c */
 
+KIRQL
+PortAcquirePdoListLock(
+    _In_ PFDO_DEVICE_EXTENSION FdoExtension);
+
+VOID
+PortReleasePdoListLock(
+    _In_ PFDO_DEVICE_EXTENSION FdoExtension,
+    _In_ KIRQL OldIrql);
+
 NTSTATUS
 PortCreatePdo(
     _In_ PFDO_DEVICE_EXTENSION FdoExtension,
@@ -248,6 +331,13 @@ NTSTATUS
 PortDeletePdo(
     _In_ PPDO_DEVICE_EXTENSION PdoExtension);
 
+PPDO_DEVICE_EXTENSION
+PortGetPdoExtension(
+    _In_ PFDO_DEVICE_EXTENSION FdoExtension,
+    _In_ ULONG Bus,
+    _In_ ULONG Target,
+    _In_ ULONG Lun);
+
 NTSTATUS
 NTAPI
 PortPdoScsi(
@@ -261,6 +351,55 @@ PortPdoPnp(
     _In_ PIRP Irp);
 
 
+/* queue.c */
+
+NTSTATUS
+PortInitializeAdapterQueue(
+    _In_ PFDO_DEVICE_EXTENSION FdoExtension);
+
+VOID
+PortInitializeLunQueue(
+    _In_ PPDO_DEVICE_EXTENSION PdoExtension);
+
+NTSTATUS
+PortQueueRequest(
+    _In_ PPDO_DEVICE_EXTENSION PdoExtension,
+    _In_ PIRP Irp,
+    _In_ PSCSI_REQUEST_BLOCK Srb);
+
+VOID
+PortStartLunQueue(
+    _In_ PPDO_DEVICE_EXTENSION PdoExtension);
+
+VOID
+PortReleaseLunQueue(
+    _In_ PPDO_DEVICE_EXTENSION PdoExtension);
+
+VOID
+PortFlushLunQueue(
+    _In_ PPDO_DEVICE_EXTENSION PdoExtension);
+
+VOID
+PortSetLunQueueLock(
+    _In_ PPDO_DEVICE_EXTENSION PdoExtension,
+    _In_ BOOLEAN Locked);
+
+VOID
+PortRequeueLun(
+    _In_ PPDO_DEVICE_EXTENSION PdoExtension);
+
+VOID
+PortRequestComplete(
+    _In_ PFDO_DEVICE_EXTENSION FdoExtension,
+    _In_ PSCSI_REQUEST_BLOCK Srb);
+
+PPORT_REQUEST
+PortGetRequest(
+    _In_ PSCSI_REQUEST_BLOCK Srb);
+
+KDEFERRED_ROUTINE PortCompletionDpc;
+KDEFERRED_ROUTINE PortUnitDpc;
+
 /* storport.c */
 
 PHW_INITIALIZATION_DATA
@@ -0,0 +1,1006 @@
+/*
+ * PROJECT:     ReactOS Storport Driver
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Storport request queue code
+ */
+
+/* INCLUDES *******************************************************************/
+
+#include "precomp.h"
+
+#define NDEBUG
+#include <debug.h>
+
+
+/* FUNCTIONS ******************************************************************/
+
+static
+NTSTATUS
+PortStatusSrbToNt(
+    _In_ UCHAR SrbStatus)
+{
+    switch (SRB_STATUS(SrbStatus))
+    {
+        case SRB_STATUS_SUCCESS:
+            return STATUS_SUCCESS;
+
+        case SRB_STATUS_TIMEOUT:
+        case SRB_STATUS_COMMAND_TIMEOUT:
+            return STATUS_IO_TIMEOUT;
+
+        case SRB_STATUS_BAD_SRB_BLOCK_LENGTH:
+        case SRB_STATUS_BAD_FUNCTION:
+            return STATUS_INVALID_DEVICE_REQUEST;
+
+        case SRB_STATUS_NO_DEVICE:
+        case SRB_STATUS_INVALID_LUN:
+        case SRB_STATUS_INVALID_TARGET_ID:
+        case SRB_STATUS_NO_HBA:
+            return STATUS_DEVICE_DOES_NOT_EXIST;
+
+        case SRB_STATUS_DATA_OVERRUN:
+            return STATUS_BUFFER_OVERFLOW;
+
+        case SRB_STATUS_SELECTION_TIMEOUT:
+            return STATUS_DEVICE_NOT_CONNECTED;
+
+        case SRB_STATUS_BUSY:
+            return STATUS_DEVICE_BUSY;
+
+        case SRB_STATUS_REQUEST_FLUSHED:
+        case SRB_STATUS_ABORTED:
+            return STATUS_CANCELLED;
+
+        default:
+            return STATUS_IO_DEVICE_ERROR;
+    }
+}
+
+
+static
+VOID
+PortDecrementBusyCount(
+    _Inout_ PLONG BusyCount)
+{
+    LONG Count, OldCount;
+
+    /* Count down to zero, but never below */
+    Count = *BusyCount;
+    while (Count > 0)
+    {
+        OldCount = InterlockedCompareExchange(BusyCount, Count - 1, Count);
+        if (OldCount == Count)
+            break;
+
+        Count = OldCount;
+    }
+}
+
+
+NTSTATUS
+PortInitializeAdapterQueue(
+    _In_ PFDO_DEVICE_EXTENSION FdoExtension)
+{
+    PPORT_CONFIGURATION_INFORMATION PortConfig;
+    PHYSICAL_ADDRESS LowestAddress, HighestAddress, Alignment;
+    PUCHAR Slot;
+    ULONG TransferLength, RequestSize, i;
+
+    DPRINT("PortInitializeAdapterQueue(%p)\n", FdoExtension);
+
+    if (FdoExtension->QueueInitialized)
+        return STATUS_SUCCESS;
+
+    PortConfig = &FdoExtension->Miniport.PortConfig;
+
+    /*
+     * Size the request lookaside list for the largest transfer the miniport
+     * accepts. Larger requests get their scatter/gather list from the pool.
+     */
+    TransferLength = PortConfig->MaximumTransferLength;
+    if (TransferLength == 0 || TransferLength == (ULONG)-1)
+        TransferLength = STORPORT_DEFAULT_TRANSFER_LENGTH;
+
+    FdoExtension->MaxScatterGatherElements = BYTES_TO_PAGES(TransferLength) + 1;
+
+    RequestSize = sizeof(PORT_REQUEST) +
+                  sizeof(STOR_SCATTER_GATHER_LIST) +
+                  FdoExtension->MaxScatterGatherElements * sizeof(STOR_SCATTER_GATHER_ELEMENT);
+
+    FdoExtension->MaxOutstandingRequests = STORPORT_MAX_ADAPTER_REQUESTS;
+
+    /*
+     * SRB extensions are handed to the hardware (AHCI command tables live
+     * in them), so they come from physically contiguous memory.
+     */
+    if (PortConfig->SrbExtensionSize != 0)
+    {
+        FdoExtension->SrbExtensionSlotSize = ALIGN_UP_BY(PortConfig->SrbExtensionSize,
+                                                         STORPORT_SRB_EXTENSION_ALIGNMENT);
+
+        Alignment.QuadPart = 0;
+        LowestAddress.QuadPart = 0;
+        HighestAddress.QuadPart = 0x00000000FFFFFFFF;
+
+        while (FdoExtension->SrbExtensionBase == NULL)
+        {
+            FdoExtension->SrbExtensionPoolSize = FdoExtension->SrbExtensionSlotSize *
+                                                 FdoExtension->MaxOutstandingRequests;
+            FdoExtension->SrbExtensionBase = MmAllocateContiguousMemorySpecifyCache(FdoExtension->SrbExtensionPoolSize,
+                                                                                    LowestAddress,
+                                                                                    HighestAddress,
+                                                                                    Alignment,
+                                                                                    MmCached);
+            if (FdoExtension->SrbExtensionBase != NULL)
+                break;
+
+            /* Retry with fewer outstanding requests */
+            if (FdoExtension->MaxOutstandingRequests <= STORPORT_DEFAULT_QUEUE_DEPTH)
+            {
+                DPRINT1("Failed to allocate the SRB extensions\n");
+                return STATUS_INSUFFICIENT_RESOURCES;
+            }
+
+            FdoExtension->MaxOutstandingRequests /= 2;
+        }
+
+        FdoExtension->SrbExtensionPhysicalBase = MmGetPhysicalAddress(FdoExtension->SrbExtensionBase);
+
+        Slot = FdoExtension->SrbExtensionBase;
+        for (i = 0; i < (ULONG)FdoExtension->MaxOutstandingRequests; i++)
+        {
+            InterlockedPushEntrySList(&FdoExtension->SrbExtensionList,
+                                      (PSLIST_ENTRY)Slot);
+            Slot += FdoExtension->SrbExtensionSlotSize;
+        }
+    }
+
+    ExInitializeNPagedLookasideList(&FdoExtension->RequestLookaside,
+                                    NULL,
+                                    NULL,
+                                    0,
+                                    RequestSize,
+                                    TAG_REQUEST,
+                                    0);
+
+    DPRINT("MaxOutstandingRequests: %ld  MaxScatterGatherElements: %lu\n",
+            FdoExtension->MaxOutstandingRequests, FdoExtension->MaxScatterGatherElements);
+
+    FdoExtension->QueueInitialized = TRUE;
+
+    return STATUS_SUCCESS;
+}
+
+
+VOID
+PortInitializeLunQueue(
+    _In_ PPDO_DEVICE_EXTENSION PdoExtension)
+{
+    KeInitializeSpinLock(&PdoExtension->QueueLock);
+    InitializeListHead(&PdoExtension->QueueListHead);
+    InitializeListHead(&PdoExtension->ReadyListEntry);
+
+    PdoExtension->QueueDepth = STORPORT_DEFAULT_QUEUE_DEPTH;
+
+    RtlInitializeBitMap(&PdoExtension->TagBitmap,
+                        PdoExtension->TagBitmapBuffer,
+                        STORPORT_MAX_QUEUE_DEPTH);
+    RtlClearAllBits(&PdoExtension->TagBitmap);
+
+    KeInitializeDpc(&PdoExtension->UnitDpc,
+                    PortUnitDpc,
+                    PdoExtension);
+}
+
+
+static
+BOOLEAN
+PortBuildScatterGatherList(
+    _In_ PFDO_DEVICE_EXTENSION FdoExtension,
+    _In_ PPORT_REQUEST Request)
+{
+    PSCSI_REQUEST_BLOCK Srb = Request->Srb;
+    PSTOR_SCATTER_GATHER_LIST SgList = Request->ScatterGatherList;
+    PSTOR_SCATTER_GATHER_ELEMENT Element = NULL;
+    PMDL Mdl = Request->Irp->MdlAddress;
+    PPFN_NUMBER PfnArray = NULL;
+    ULONG_PTR VirtualAddress, MdlAddress;
+    ULONG PageIndex = 0, PageOffset, Length, Remaining;
+    PHYSICAL_ADDRESS PhysicalAddress;
+
+    SgList->NumberOfElements = 0;
+
+    if (Srb->DataBuffer == NULL || Srb->DataTransferLength == 0)
+        return TRUE;
+
+    VirtualAddress = (ULONG_PTR)Srb->DataBuffer;
+    Remaining = Srb->DataTransferLength;
+
+    /* Use the MDL pages if the data buffer lies within the MDL */
+    if (Mdl != NULL)
+    {
+        MdlAddress = (ULONG_PTR)MmGetMdlVirtualAddress(Mdl);
+        if (VirtualAddress >= MdlAddress &&
+            VirtualAddress + Remaining <= MdlAddress + MmGetMdlByteCount(Mdl))
+        {
+            PfnArray = MmGetMdlPfnArray(Mdl);
+            PageIndex = (MmGetMdlByteOffset(Mdl) + (ULONG)(VirtualAddress - MdlAddress)) >> PAGE_SHIFT;
+        }
+    }
+
+    while (Remaining != 0)
+    {
+        PageOffset = BYTE_OFFSET(VirtualAddress);
+        Length = min(PAGE_SIZE - PageOffset, Remaining);
+
+        if (PfnArray != NULL)
+        {
+            PhysicalAddress.QuadPart = ((ULONGLONG)PfnArray[PageIndex] << PAGE_SHIFT) + PageOffset;
+            PageIndex++;
+        }
+        else
+        {
+            /* Non-paged system buffer */
+            PhysicalAddress = MmGetPhysicalAddress((PVOID)VirtualAddress);
+        }
+
+        /* Merge physically contiguous pages into one element */
+        if (Element != NULL &&
+            Element->PhysicalAddress.QuadPart + Element->Length == PhysicalAddress.QuadPart)
+        {
+            Element->Length += Length;
+        }
+        else
+        {
+            if (SgList->NumberOfElements == (ULONG)SgList->Reserved)
+                return FALSE;
+
+            Element = &SgList->List[SgList->NumberOfElements++];
+            Element->PhysicalAddress = PhysicalAddress;
+            Element->Length = Length;
+            Element->Reserved = 0;
+        }
+
+        VirtualAddress += Length;
+        Remaining -= Length;
+    }
+
+    return TRUE;
+}
+
+
+static
+PPORT_REQUEST
+PortAllocateRequest(
+    _In_ PFDO_DEVICE_EXTENSION FdoExtension,
+    _In_ PSCSI_REQUEST_BLOCK Srb)
+{
+    PPORT_REQUEST Request;
+    ULONG Elements;
+
+    /* Worst case: one scatter/gather element per page */
+    Elements = 0;
+    if (Srb->DataBuffer != NULL && Srb->DataTransferLength != 0)
+        Elements = ADDRESS_AND_SIZE_TO_SPAN_PAGES(Srb->DataBuffer, Srb->DataTransferLength);
+
+    if (Elements <= FdoExtension->MaxScatterGatherElements)
+    {
+        Request = ExAllocateFromNPagedLookasideList(&FdoExtension->RequestLookaside);
+        if (Request == NULL)
+            return NULL;
+
+        Request->FromLookaside = TRUE;
+        Elements = FdoExtension->MaxScatterGatherElements;
+    }
+    else
+    {
+        Request = ExAllocatePoolWithTag(NonPagedPool,
+                                        sizeof(PORT_REQUEST) +
+                                        sizeof(STOR_SCATTER_GATHER_LIST) +
+                                        Elements * sizeof(STOR_SCATTER_GATHER_ELEMENT),
+                                        TAG_REQUEST);
+        if (Request == NULL)
+            return NULL;
+
+        Request->FromLookaside = FALSE;
+    }
+
+    Request->Completed = FALSE;
+    Request->ScatterGatherList = (PSTOR_SCATTER_GATHER_LIST)(Request + 1);
+    Request->ScatterGatherList->NumberOfElements = 0;
+
+    /* The port keeps the list capacity in the reserved field */
+    Request->ScatterGatherList->Reserved = Elements;
+
+    return Request;
+}
+
+
+static
+VOID
+PortFreeRequest(
+    _In_ PFDO_DEVICE_EXTENSION FdoExtension,
+    _In_ PPORT_REQUEST Request)
+{
+    if (Request->FromLookaside)
+        ExFreeToNPagedLookasideList(&FdoExtension->RequestLookaside, Request);
+    else
+        ExFreePoolWithTag(Request, TAG_REQUEST);
+}
+
+
+PPORT_REQUEST
+PortGetRequest(
+    _In_ PSCSI_REQUEST_BLOCK Srb)
+{
+    PIRP Irp;
+
+    Irp = (PIRP)Srb->OriginalRequest;
+    if (Irp == NULL)
+        return NULL;
+
+    return (PPORT_REQUEST)Irp->Tail.Overlay.DriverContext[0];
+}
+
+
+NTSTATUS
+PortQueueRequest(
+    _In_ PPDO_DEVICE_EXTENSION PdoExtension,
+    _In_ PIRP Irp,
+    _In_ PSCSI_REQUEST_BLOCK Srb)
+{
+    PFDO_DEVICE_EXTENSION FdoExtension = PdoExtension->FdoExtension;
+    KLOCK_QUEUE_HANDLE LockHandle;
+    PPORT_REQUEST Request;
+
+    DPRINT("PortQueueRequest(%p %p %p)\n", PdoExtension, Irp, Srb);
+
+    if (!FdoExtension->QueueInitialized)
+    {
+        Srb->SrbStatus = SRB_STATUS_NO_HBA;
+        Irp->IoStatus.Status = STATUS_DEVICE_NOT_READY;
+        Irp->IoStatus.Information = 0;
+        IoCompleteRequest(Irp, IO_NO_INCREMENT);
+        return STATUS_DEVICE_NOT_READY;
+    }
+
+    Request = PortAllocateRequest(FdoExtension, Srb);
+    if (Request == NULL)
+    {
+        Srb->SrbStatus = SRB_STATUS_INTERNAL_ERROR;
+        Irp->IoStatus.Status = STATUS_INSUFFICIENT_RESOURCES;
+        Irp->IoStatus.Information = 0;
+        IoCompleteRequest(Irp, IO_NO_INCREMENT);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    /* Address the request to this unit */
+    Srb->PathId = (UCHAR)PdoExtension->Bus;
+    Srb->TargetId = (UCHAR)PdoExtension->Target;
+    Srb->Lun = (UCHAR)PdoExtension->Lun;
+    Srb->OriginalRequest = Irp;
+    Srb->SrbExtension = NULL;
+    Srb->SrbStatus = SRB_STATUS_PENDING;
+
+    Request->Irp = Irp;
+    Request->Srb = Srb;
+    Request->PdoExtension = PdoExtension;
+
+    /* Build the scatter/gather list now, outside of any lock */
+    if (!PortBuildScatterGatherList(FdoExtension, Request))
+    {
+        PortFreeRequest(FdoExtension, Request);
+        Srb->SrbStatus = SRB_STATUS_INVALID_REQUEST;
+        Irp->IoStatus.Status = STATUS_INVALID_PARAMETER;
+        Irp->IoStatus.Information = 0;
+        IoCompleteRequest(Irp, IO_NO_INCREMENT);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    Irp->Tail.Overlay.DriverContext[0] = Request;
+    IoMarkIrpPending(Irp);
+
+    /* Requests that bypass a frozen queue go to the front */
+    KeAcquireInStackQueuedSpinLock(&PdoExtension->QueueLock, &LockHandle);
+    if (Srb->SrbFlags & SRB_FLAGS_BYPASS_FROZEN_QUEUE)
+        InsertHeadList(&PdoExtension->QueueListHead, &Irp->Tail.Overlay.ListEntry);
+    else
+        InsertTailList(&PdoExtension->QueueListHead, &Irp->Tail.Overlay.ListEntry);
+    KeReleaseInStackQueuedSpinLock(&LockHandle);
+
+    PortStartLunQueue(PdoExtension);
+
+    return STATUS_PENDING;
+}
+
+
+static
+VOID
+PortInsertReadyLun(
+    _In_ PPDO_DEVICE_EXTENSION PdoExtension)
+{
+    PFDO_DEVICE_EXTENSION FdoExtension = PdoExtension->FdoExtension;
+    KLOCK_QUEUE_HANDLE LockHandle;
+
+    KeAcquireInStackQueuedSpinLock(&FdoExtension->ReadyLunLock, &LockHandle);
+    if (IsListEmpty(&PdoExtension->ReadyListEntry))
+    {
+        InsertTailList(&FdoExtension->ReadyLunListHead,
+                       &PdoExtension->ReadyListEntry);
+    }
+    KeReleaseInStackQueuedSpinLock(&LockHandle);
+}
+
+
+static
+BOOLEAN
+NTAPI
+PortStartIoSynchronized(
+    _In_ PVOID SynchronizeContext)
+{
+    PSCSI_REQUEST_BLOCK Srb = (PSCSI_REQUEST_BLOCK)SynchronizeContext;
+    PPORT_REQUEST Request = PortGetRequest(Srb);
+
+    return MiniportStartIo(&Request->PdoExtension->FdoExtension->Miniport, Srb);
+}
+
+
+/*
+ * Removes up to STORPORT_START_BATCH requests from the unit queue that may
+ * be started now. Must be called at DISPATCH_LEVEL.
+ */
+static
+ULONG
+PortDequeueRequests(
+    _In_ PPDO_DEVICE_EXTENSION PdoExtension,
+    _Out_writes_(STORPORT_START_BATCH) PPORT_REQUEST *Requests)
+{
+    PFDO_DEVICE_EXTENSION FdoExtension = PdoExtension->FdoExtension;
+    KLOCK_QUEUE_HANDLE LockHandle;
+    PSCSI_REQUEST_BLOCK Srb;
+    PPORT_REQUEST Request;
+    PLIST_ENTRY Entry;
+    BOOLEAN Starved = FALSE;
+    ULONG Count = 0, Tag;
+    PIRP Irp;
+
+    KeAcquireInStackQueuedSpinLockAtDpcLevel(&PdoExtension->QueueLock, &LockHandle);
+
+    while (Count < STORPORT_START_BATCH &&
+           !IsListEmpty(&PdoExtension->QueueListHead))
+    {
+        Entry = PdoExtension->QueueListHead.Flink;
+        Irp = CONTAINING_RECORD(Entry, IRP, Tail.Overlay.ListEntry);
+        Request = (PPORT_REQUEST)Irp->Tail.Overlay.DriverContext[0];
+        Srb = Request->Srb;
+
+        /* Frozen and locked queues only pass the requests that bypass them */
+        if ((PdoExtension->QueueFlags & LUNEX_FROZEN_QUEUE) &&
+            !(Srb->SrbFlags & SRB_FLAGS_BYPASS_FROZEN_QUEUE))
+            break;
+
+        if ((PdoExtension->QueueFlags & LUNEX_LOCKED_QUEUE) &&
+            !(Srb->SrbFlags & SRB_FLAGS_BYPASS_LOCKED_QUEUE))
+            break;
+
+        /* The unit limits are lifted by its own completions or a resume */
+        if (PdoExtension->OutstandingRequests >= PdoExtension->QueueDepth ||
+            PdoExtension->BusyCount > 0 ||
+            PdoExtension->Paused)
+            break;
+
+        /* The adapter limits are lifted by completions on any unit */
+        if (FdoExtension->BusyCount > 0 ||
+            FdoExtension->Paused)
+        {
+            Starved = TRUE;
+            break;
+        }
+
+        if (InterlockedIncrement(&FdoExtension->OutstandingRequests) > FdoExtension->MaxOutstandingRequests)
+        {
+            InterlockedDecrement(&FdoExtension->OutstandingRequests);
+            Starved = TRUE;
+            break;
+        }
+
+        Tag = RtlFindClearBitsAndSet(&PdoExtension->TagBitmap, 1, 0);
+        ASSERT(Tag != MAXULONG);
+
+        RemoveEntryList(Entry);
+        PdoExtension->OutstandingRequests++;
+        PdoExtension->ActiveRequests[Tag] = Request;
+        Request->QueueTag = Tag;
+
+        /* The timer counts whole seconds, so wait at least one full tick */
+        Request->Timeout = FdoExtension->TimerTicks + 1 +
+                           (Srb->TimeOutValue != 0 ? Srb->TimeOutValue : STORPORT_DEFAULT_REQUEST_TIMEOUT);
+
+        Requests[Count++] = Request;
+    }
+
+    KeReleaseInStackQueuedSpinLockFromDpcLevel(&LockHandle);
+
+    /*
+     * Remember the unit so that the completion DPC restarts it. The DPC
+     * only needs a kick if the adapter freed up in the meantime.
+     */
+    if (Starved)
+    {
+        PortInsertReadyLun(PdoExtension);
+
+        if (FdoExtension->BusyCount == 0 &&
+            !FdoExtension->Paused &&
+            FdoExtension->OutstandingRequests < FdoExtension->MaxOutstandingRequests)
+        {
+            KeInsertQueueDpc(&FdoExtension->CompletionDpc, NULL, NULL);
+        }
+    }
+
+    return Count;
+}
+
+
+VOID
+PortStartLunQueue(
+    _In_ PPDO_DEVICE_EXTENSION PdoExtension)
+{
+    PFDO_DEVICE_EXTENSION FdoExtension = PdoExtension->FdoExtension;
+    PMINIPORT Miniport = &FdoExtension->Miniport;
+    PPORT_REQUEST Requests[STORPORT_START_BATCH];
+    BOOLEAN Started[STORPORT_START_BATCH];
+    KLOCK_QUEUE_HANDLE LockHandle;
+    PSCSI_REQUEST_BLOCK Srb;
+    ULONG Count, i;
+    KIRQL OldIrql;
+
+    DPRINT("PortStartLunQueue(%p)\n", PdoExtension);
+
+    KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+
+    for (;;)
+    {
+        Count = PortDequeueRequests(PdoExtension, Requests);
+        if (Count == 0)
+            break;
+
+        for (i = 0; i < Count; i++)
+        {
+            Srb = Requests[i]->Srb;
+
+            /* Hand out a tag and an SRB extension */
+            Srb->QueueTag = (UCHAR)Requests[i]->QueueTag;
+            if (FdoExtension->SrbExtensionBase != NULL)
+            {
+                Srb->SrbExtension = InterlockedPopEntrySList(&FdoExtension->SrbExtensionList);
+                ASSERT(Srb->SrbExtension != NULL);
+                RtlZeroMemory(Srb->SrbExtension, Miniport->PortConfig.SrbExtensionSize);
+            }
+
+            /* Let the miniport prepare the request without holding a lock */
+            Started[i] = TRUE;
+            if (Miniport->InitData->HwBuildIo != NULL)
+                Started[i] = Miniport->InitData->HwBuildIo(&Miniport->MiniportExtension->HwDeviceExtension, Srb);
+        }
+
+        /* Submit the whole batch under a single StartIoLock acquisition */
+        KeAcquireInStackQueuedSpinLockAtDpcLevel(&FdoExtension->StartIoLock, &LockHandle);
+        for (i = 0; i < Count; i++)
+        {
+            if (!Started[i])
+                continue;
+
+            if (Miniport->PortConfig.SynchronizationModel == StorSynchronizeHalfDuplex &&
+                FdoExtension->Interrupt != NULL)
+            {
+                KeSynchronizeExecution(FdoExtension->Interrupt,
+                                       PortStartIoSynchronized,
+                                       Requests[i]->Srb);
+            }
+            else
+            {
+                MiniportStartIo(Miniport, Requests[i]->Srb);
+            }
+        }
+        KeReleaseInStackQueuedSpinLockFromDpcLevel(&LockHandle);
+    }
+
+    KeLowerIrql(OldIrql);
+}
+
+
+VOID
+PortReleaseLunQueue(
+    _In_ PPDO_DEVICE_EXTENSION PdoExtension)
+{
+    KLOCK_QUEUE_HANDLE LockHandle;
+
+    DPRINT("PortReleaseLunQueue(%p)\n", PdoExtension);
+
+    KeAcquireInStackQueuedSpinLock(&PdoExtension->QueueLock, &LockHandle);
+    PdoExtension->QueueFlags &= ~LUNEX_FROZEN_QUEUE;
+    KeReleaseInStackQueuedSpinLock(&LockHandle);
+
+    PortStartLunQueue(PdoExtension);
+}
+
+
+VOID
+PortFlushLunQueue(
+    _In_ PPDO_DEVICE_EXTENSION PdoExtension)
+{
+    PFDO_DEVICE_EXTENSION FdoExtension = PdoExtension->FdoExtension;
+    KLOCK_QUEUE_HANDLE LockHandle;
+    LIST_ENTRY FlushList;
+    PPORT_REQUEST Request;
+    PLIST_ENTRY Entry;
+    PIRP Irp;
+
+    DPRINT("PortFlushLunQueue(%p)\n", PdoExtension);
+
+    /* Take all waiting requests off the queue and unfreeze it */
+    KeAcquireInStackQueuedSpinLock(&PdoExtension->QueueLock, &LockHandle);
+    PdoExtension->QueueFlags &= ~LUNEX_FROZEN_QUEUE;
+
+    InitializeListHead(&FlushList);
+    while (!IsListEmpty(&PdoExtension->QueueListHead))
+    {
+        Entry = RemoveHeadList(&PdoExtension->QueueListHead);
+        InsertTailList(&FlushList, Entry);
+    }
+    KeReleaseInStackQueuedSpinLock(&LockHandle);
+
+    /* Complete them as flushed */
+    while (!IsListEmpty(&FlushList))
+    {
+        Entry = RemoveHeadList(&FlushList);
+        Irp = CONTAINING_RECORD(Entry, IRP, Tail.Overlay.ListEntry);
+        Request = (PPORT_REQUEST)Irp->Tail.Overlay.DriverContext[0];
+
+        Request->Srb->SrbStatus = SRB_STATUS_REQUEST_FLUSHED;
+        Irp->IoStatus.Status = STATUS_CANCELLED;
+        Irp->IoStatus.Information = 0;
+
+        PortFreeRequest(FdoExtension, Request);
+        IoCompleteRequest(Irp, IO_NO_INCREMENT);
+    }
+}
+
+
+VOID
+PortSetLunQueueLock(
+    _In_ PPDO_DEVICE_EXTENSION PdoExtension,
+    _In_ BOOLEAN Locked)
+{
+    KLOCK_QUEUE_HANDLE LockHandle;
+
+    DPRINT("PortSetLunQueueLock(%p %u)\n", PdoExtension, Locked);
+
+    KeAcquireInStackQueuedSpinLock(&PdoExtension->QueueLock, &LockHandle);
+    if (Locked)
+        PdoExtension->QueueFlags |= LUNEX_LOCKED_QUEUE;
+    else
+        PdoExtension->QueueFlags &= ~LUNEX_LOCKED_QUEUE;
+    KeReleaseInStackQueuedSpinLock(&LockHandle);
+
+    if (!Locked)
+        PortStartLunQueue(PdoExtension);
+}
+
+
+/*
+ * Puts a unit on the adapter ready list and lets the completion DPC restart
+ * its queue. Can be called at any IRQL up to DISPATCH_LEVEL, including from
+ * within the miniport HwStartIo routine.
+ */
+VOID
+PortRequeueLun(
+    _In_ PPDO_DEVICE_EXTENSION PdoExtension)
+{
+    PortInsertReadyLun(PdoExtension);
+
+    KeInsertQueueDpc(&PdoExtension->FdoExtension->CompletionDpc, NULL, NULL);
+}
+
+
+/*
+ * Called by the miniport through StorPortNotification(RequestComplete),
+ * possibly at DIRQL. Only queues the request; the completion DPC finishes it.
+ */
+VOID
+PortRequestComplete(
+    _In_ PFDO_DEVICE_EXTENSION FdoExtension,
+    _In_ PSCSI_REQUEST_BLOCK Srb)
+{
+    PPORT_REQUEST Request;
+
+    Request = PortGetRequest(Srb);
+    if (Request == NULL)
+    {
+        DPRINT1("Completed SRB %p has no request!\n", Srb);
+        return;
+    }
+
+    /* The port may have completed it already after a timeout */
+    if (InterlockedExchange(&Request->Completed, TRUE))
+    {
+        DPRINT("SRB %p was already completed\n", Srb);
+        return;
+    }
+
+    InterlockedPushEntrySList(&FdoExtension->CompletionList,
+                              &Request->CompletionEntry);
+    KeInsertQueueDpc(&FdoExtension->CompletionDpc, NULL, NULL);
+}
+
+
+static
+VOID
+PortCompleteRequest(
+    _In_ PFDO_DEVICE_EXTENSION FdoExtension,
+    _In_ PPORT_REQUEST Request)
+{
+    PPDO_DEVICE_EXTENSION PdoExtension = Request->PdoExtension;
+    PSCSI_REQUEST_BLOCK Srb = Request->Srb;
+    KLOCK_QUEUE_HANDLE LockHandle;
+    PIRP Irp = Request->Irp;
+
+    /* Release the tag and freeze the queue on errors */
+    KeAcquireInStackQueuedSpinLockAtDpcLevel(&PdoExtension->QueueLock, &LockHandle);
+
+    PdoExtension->ActiveRequests[Request->QueueTag] = NULL;
+    RtlClearBit(&PdoExtension->TagBitmap, Request->QueueTag);
+    PdoExtension->OutstandingRequests--;
+
+    if (SRB_STATUS(Srb->SrbStatus) != SRB_STATUS_SUCCESS &&
+        !(Srb->SrbFlags & SRB_FLAGS_NO_QUEUE_FREEZE))
+    {
+        PdoExtension->QueueFlags |= LUNEX_FROZEN_QUEUE;
+        Srb->SrbStatus |= SRB_STATUS_QUEUE_FROZEN;
+    }
+
+    KeReleaseInStackQueuedSpinLockFromDpcLevel(&LockHandle);
+
+    PortDecrementBusyCount(&PdoExtension->BusyCount);
+    PortDecrementBusyCount(&FdoExtension->BusyCount);
+
+    /* Return the SRB extension */
+    if (Srb->SrbExtension != NULL)
+    {
+        InterlockedPushEntrySList(&FdoExtension->SrbExtensionList,
+                                  (PSLIST_ENTRY)Srb->SrbExtension);
+        Srb->SrbExtension = NULL;
+    }
+
+    InterlockedDecrement(&FdoExtension->OutstandingRequests);
+
+    /* Complete the IRP */
+    Irp->IoStatus.Status = PortStatusSrbToNt(Srb->SrbStatus);
+    if (NT_SUCCESS(Irp->IoStatus.Status) ||
+        SRB_STATUS(Srb->SrbStatus) == SRB_STATUS_DATA_OVERRUN)
+        Irp->IoStatus.Information = Srb->DataTransferLength;
+    else
+        Irp->IoStatus.Information = 0;
+
+    PortFreeRequest(FdoExtension, Request);
+    IoCompleteRequest(Irp, IO_DISK_INCREMENT);
+}
+
+
+VOID
+NTAPI
+PortCompletionDpc(
+    _In_ PKDPC Dpc,
+    _In_opt_ PVOID DeferredContext,
+    _In_opt_ PVOID SystemArgument1,
+    _In_opt_ PVOID SystemArgument2)
+{
+    PFDO_DEVICE_EXTENSION FdoExtension = (PFDO_DEVICE_EXTENSION)DeferredContext;
+    PPDO_DEVICE_EXTENSION Units[STORPORT_START_BATCH];
+    PPDO_DEVICE_EXTENSION PdoExtension;
+    KLOCK_QUEUE_HANDLE LockHandle;
+    PSLIST_ENTRY Entry, Next, Completed = NULL;
+    PPORT_REQUEST Request;
+    ULONG UnitCount = 0, i;
+
+    DPRINT("PortCompletionDpc(%p)\n", FdoExtension);
+
+    /* Take all completed requests at once and restore their order */
+    Entry = InterlockedFlushSList(&FdoExtension->CompletionList);
+    while (Entry != NULL)
+    {
+        Next = Entry->Next;
+        Entry->Next = Completed;
+        Completed = Entry;
+        Entry = Next;
+    }
+
+    while (Completed != NULL)
+    {
+        Request = CONTAINING_RECORD(Completed, PORT_REQUEST, CompletionEntry);
+        Completed = Completed->Next;
+
+        /* Collect the units to restart once the batch is done */
+        PdoExtension = Request->PdoExtension;
+        for (i = 0; i < UnitCount; i++)
+        {
+            if (Units[i] == PdoExtension)
+                break;
+        }
+
+        if (i == UnitCount)
+        {
+            if (UnitCount < STORPORT_START_BATCH)
+                Units[UnitCount++] = PdoExtension;
+            else
+                PortRequeueLun(PdoExtension);
+        }
+
+        PortCompleteRequest(FdoExtension, Request);
+    }
+
+    for (i = 0; i < UnitCount; i++)
+        PortStartLunQueue(Units[i]);
+
+    /* Restart the units that were waiting for the adapter */
+    for (;;)
+    {
+        KeAcquireInStackQueuedSpinLockAtDpcLevel(&FdoExtension->ReadyLunLock, &LockHandle);
+        if (IsListEmpty(&FdoExtension->ReadyLunListHead))
+        {
+            KeReleaseInStackQueuedSpinLockFromDpcLevel(&LockHandle);
+            break;
+        }
+
+        PdoExtension = CONTAINING_RECORD(RemoveHeadList(&FdoExtension->ReadyLunListHead),
+                                         PDO_DEVICE_EXTENSION,
+                                         ReadyListEntry);
+        InitializeListHead(&PdoExtension->ReadyListEntry);
+        KeReleaseInStackQueuedSpinLockFromDpcLevel(&LockHandle);
+
+        PortStartLunQueue(PdoExtension);
+
+        /* Stop if the adapter ran out of resources again */
+        if (FdoExtension->BusyCount > 0 ||
+            FdoExtension->Paused ||
+            FdoExtension->OutstandingRequests >= FdoExtension->MaxOutstandingRequests)
+            break;
+    }
+}
+
+
+static
+BOOLEAN
+NTAPI
+PortResetBusSynchronized(
+    _In_ PVOID SynchronizeContext)
+{
+    PPDO_DEVICE_EXTENSION PdoExtension = (PPDO_DEVICE_EXTENSION)SynchronizeContext;
+    PMINIPORT Miniport = &PdoExtension->FdoExtension->Miniport;
+
+    return Miniport->InitData->HwResetBus(&Miniport->MiniportExtension->HwDeviceExtension,
+                                          PdoExtension->Bus);
+}
+
+
+/*
+ * Asks the miniport to reset the bus of a unit. The miniport reports the
+ * requests it aborted through StorPortCompleteRequest.
+ */
+static
+VOID
+PortResetBus(
+    _In_ PPDO_DEVICE_EXTENSION PdoExtension)
+{
+    PFDO_DEVICE_EXTENSION FdoExtension = PdoExtension->FdoExtension;
+    PMINIPORT Miniport = &FdoExtension->Miniport;
+    KLOCK_QUEUE_HANDLE LockHandle;
+
+    DPRINT1("Resetting bus %lu\n", PdoExtension->Bus);
+
+    if (Miniport->InitData->HwResetBus == NULL)
+        return;
+
+    KeAcquireInStackQueuedSpinLockAtDpcLevel(&FdoExtension->StartIoLock, &LockHandle);
+    if (Miniport->PortConfig.SynchronizationModel == StorSynchronizeHalfDuplex &&
+        FdoExtension->Interrupt != NULL)
+    {
+        KeSynchronizeExecution(FdoExtension->Interrupt,
+                               PortResetBusSynchronized,
+                               PdoExtension);
+    }
+    else
+    {
+        PortResetBusSynchronized(PdoExtension);
+    }
+    KeReleaseInStackQueuedSpinLockFromDpcLevel(&LockHandle);
+}
+
+
+/*
+ * Per-unit housekeeping, queued by the adapter timer, StorPortResumeDevice
+ * and StorPortCompleteRequest. Completes the requests the miniport gave up
+ * on, times out the requests it never completed and restarts the queue.
+ */
+VOID
+NTAPI
+PortUnitDpc(
+    _In_ PKDPC Dpc,
+    _In_opt_ PVOID DeferredContext,
+    _In_opt_ PVOID SystemArgument1,
+    _In_opt_ PVOID SystemArgument2)
+{
+    PPDO_DEVICE_EXTENSION PdoExtension = (PPDO_DEVICE_EXTENSION)DeferredContext;
+    PFDO_DEVICE_EXTENSION FdoExtension = PdoExtension->FdoExtension;
+    UCHAR SrbStatus = SRB_STATUS_PENDING;
+    KLOCK_QUEUE_HANDLE LockHandle;
+    PSLIST_ENTRY TimedOut = NULL;
+    PPORT_REQUEST Request;
+    BOOLEAN Completed = FALSE;
+    ULONG Tag;
+
+    DPRINT("PortUnitDpc(%p)\n", PdoExtension);
+
+    if (InterlockedExchange(&PdoExtension->CompletePending, FALSE))
+        SrbStatus = PdoExtension->CompleteSrbStatus;
+
+    KeAcquireInStackQueuedSpinLockAtDpcLevel(&PdoExtension->QueueLock, &LockHandle);
+
+    for (Tag = 0;
+         Tag < STORPORT_MAX_QUEUE_DEPTH && PdoExtension->OutstandingRequests != 0;
+         Tag++)
+    {
+        Request = PdoExtension->ActiveRequests[Tag];
+        if (Request == NULL)
+            continue;
+
+        if (SrbStatus != SRB_STATUS_PENDING)
+        {
+            /* StorPortCompleteRequest: the miniport dropped all requests */
+            if (!InterlockedExchange(&Request->Completed, TRUE))
+            {
+                Request->Srb->SrbStatus = SrbStatus;
+                InterlockedPushEntrySList(&FdoExtension->CompletionList,
+                                          &Request->CompletionEntry);
+                Completed = TRUE;
+            }
+        }
+        else if ((LONG)(FdoExtension->TimerTicks - Request->Timeout) >= 0)
+        {
+            /* Keep the request away from the miniport until the bus is reset */
+            if (!InterlockedExchange(&Request->Completed, TRUE))
+            {
+                DPRINT1("SRB %p timed out\n", Request->Srb);
+                Request->CompletionEntry.Next = TimedOut;
+                TimedOut = &Request->CompletionEntry;
+            }
+        }
+    }
+
+    KeReleaseInStackQueuedSpinLockFromDpcLevel(&LockHandle);
+
+    if (TimedOut != NULL)
+    {
+        /* The hardware must be done with the requests before they go away */
+        PortResetBus(PdoExtension);
+
+        while (TimedOut != NULL)
+        {
+            Request = CONTAINING_RECORD(TimedOut, PORT_REQUEST, CompletionEntry);
+            TimedOut = TimedOut->Next;
+
+            Request->Srb->SrbStatus = SRB_STATUS_TIMEOUT;
+            InterlockedPushEntrySList(&FdoExtension->CompletionList,
+                                      &Request->CompletionEntry);
+        }
+
+        Completed = TRUE;
+    }
+
+    if (Completed)
+        KeInsertQueueDpc(&FdoExtension->CompletionDpc, NULL, NULL);
+    else
+        PortStartLunQueue(PdoExtension);
+}
+
+/* EOF */
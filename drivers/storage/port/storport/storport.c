@@ -108,23 +108,27 @@ PortAcquireSpinLock(
     PVOID LockContext,
     PSTOR_LOCK_HANDLE LockHandle)
 {
-    DPRINT1("PortAcquireSpinLock(%p %lu %p %p)\n",
-            DeviceExtension, SpinLock, LockContext, LockHandle);
+    DPRINT("PortAcquireSpinLock(%p %lu %p %p)\n",
+           DeviceExtension, SpinLock, LockContext, LockHandle);
 
     LockHandle->Lock = SpinLock;
 
     switch (SpinLock)
     {
         case DpcLock: /* 1, */
-            DPRINT1("DpcLock\n");
+            DPRINT("DpcLock\n");
+            KeAcquireInStackQueuedSpinLock((PKSPIN_LOCK)&((PSTOR_DPC)LockContext)->Lock,
+                                           (PKLOCK_QUEUE_HANDLE)&LockHandle->Context);
             break;
 
         case StartIoLock: /* 2 */
-            DPRINT1("StartIoLock\n");
+            DPRINT("StartIoLock\n");
+            KeAcquireInStackQueuedSpinLock(&DeviceExtension->StartIoLock,
+                                           (PKLOCK_QUEUE_HANDLE)&LockHandle->Context);
             break;
 
         case InterruptLock: /* 3 */
-            DPRINT1("InterruptLock\n");
+            DPRINT("InterruptLock\n");
             if (DeviceExtension->Interrupt == NULL)
                 LockHandle->Context.OldIrql = 0;
             else
@@ -140,21 +144,19 @@ PortReleaseSpinLock(
     PFDO_DEVICE_EXTENSION DeviceExtension,
     PSTOR_LOCK_HANDLE LockHandle)
 {
-    DPRINT1("PortReleaseSpinLock(%p %p)\n",
-            DeviceExtension, LockHandle);
+    DPRINT("PortReleaseSpinLock(%p %p)\n",
+           DeviceExtension, LockHandle);
 
     switch (LockHandle->Lock)
     {
         case DpcLock: /* 1, */
-            DPRINT1("DpcLock\n");
-            break;
-
         case StartIoLock: /* 2 */
-            DPRINT1("StartIoLock\n");
+            DPRINT("DpcLock/StartIoLock\n");
+            KeReleaseInStackQueuedSpinLock((PKLOCK_QUEUE_HANDLE)&LockHandle->Context);
             break;
 
         case InterruptLock: /* 3 */
-            DPRINT1("InterruptLock\n");
+            DPRINT("InterruptLock\n");
             if (DeviceExtension->Interrupt != NULL)
                 KeReleaseInterruptSpinLock(DeviceExtension->Interrupt,
                                            LockHandle->Context.OldIrql);
@@ -226,6 +228,26 @@ PortAddDevice(
     KeInitializeSpinLock(&DeviceExtension->PdoListLock);
     InitializeListHead(&DeviceExtension->PdoListHead);
 
+    /* Initialize the request processing */
+    KeInitializeSpinLock(&DeviceExtension->StartIoLock);
+    KeInitializeDpc(&DeviceExtension->CompletionDpc,
+                    PortCompletionDpc,
+                    DeviceExtension);
+    InitializeSListHead(&DeviceExtension->CompletionList);
+    InitializeSListHead(&DeviceExtension->SrbExtensionList);
+    KeInitializeSpinLock(&DeviceExtension->ReadyLunLock);
+    InitializeListHead(&DeviceExtension->ReadyLunListHead);
+
+    Status = IoInitializeTimer(Fdo,
+                               PortFdoTimer,
+                               DeviceExtension);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("IoInitializeTimer() failed (Status 0x%08lx)\n", Status);
+        IoDeleteDevice(Fdo);
+        return Status;
+    }
+
     /* Attach the FDO to the device stack */
     Status = IoAttachDeviceToDeviceStackSafe(Fdo,
                                              PhysicalDeviceObject,
@@ -348,11 +370,11 @@ PortDispatchScsi(
 {
     PFDO_DEVICE_EXTENSION DeviceExtension;
 
-    DPRINT1("PortDispatchScsi(%p %p)\n",
-            DeviceObject, Irp);
+    DPRINT("PortDispatchScsi(%p %p)\n",
+           DeviceObject, Irp);
 
     DeviceExtension = (PFDO_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
-    DPRINT1("ExtensionType: %u\n", DeviceExtension->ExtensionType);
+    DPRINT("ExtensionType: %u\n", DeviceExtension->ExtensionType);
 
     switch (DeviceExtension->ExtensionType)
     {
@@ -480,7 +502,7 @@ StorPortAllocateRegistryBuffer(
 
 
 /*
- * @unimplemented
+ * @implemented
  */
 STORPORT_API
 BOOLEAN
@@ -489,14 +511,31 @@ StorPortBusy(
     _In_ PVOID HwDeviceExtension,
     _In_ ULONG RequestsToComplete)
 {
-    DPRINT1("StorPortBuzy()\n");
-    UNIMPLEMENTED;
-    return FALSE;
+    PMINIPORT_DEVICE_EXTENSION MiniportExtension;
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+    LONG Outstanding;
+
+    DPRINT("StorPortBusy(%p %lu)\n",
+            HwDeviceExtension, RequestsToComplete);
+
+    /* Get the miniport extension */
+    MiniportExtension = CONTAINING_RECORD(HwDeviceExtension,
+                                          MINIPORT_DEVICE_EXTENSION,
+                                          HwDeviceExtension);
+
+    DeviceExtension = MiniportExtension->Miniport->DeviceExtension;
+
+    /* Only outstanding requests can lift the busy state */
+    Outstanding = DeviceExtension->OutstandingRequests;
+    InterlockedExchange(&DeviceExtension->BusyCount,
+                        min((LONG)RequestsToComplete, Outstanding));
+
+    return TRUE;
 }
 
 
 /*
- * @unimplemented
+ * @implemented
  */
 STORPORT_API
 VOID
@@ -508,8 +547,45 @@ StorPortCompleteRequest(
     _In_ UCHAR Lun,
     _In_ UCHAR SrbStatus)
 {
-    DPRINT1("StorPortCompleteRequest()\n");
-    UNIMPLEMENTED;
+    PMINIPORT_DEVICE_EXTENSION MiniportExtension;
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+    PPDO_DEVICE_EXTENSION PdoExtension;
+    PLIST_ENTRY Entry;
+    KIRQL OldIrql;
+
+    DPRINT("StorPortCompleteRequest(%p %u %u %u %x)\n",
+           HwDeviceExtension, PathId, TargetId, Lun, SrbStatus);
+
+    /* Get the miniport extension */
+    MiniportExtension = CONTAINING_RECORD(HwDeviceExtension,
+                                          MINIPORT_DEVICE_EXTENSION,
+                                          HwDeviceExtension);
+
+    DeviceExtension = MiniportExtension->Miniport->DeviceExtension;
+
+    /*
+     * This is usually called from HwResetBus or HwInterrupt, so the unit
+     * DPC completes the outstanding requests of each matching unit.
+     */
+    OldIrql = PortAcquirePdoListLock(DeviceExtension);
+
+    for (Entry = DeviceExtension->PdoListHead.Flink;
+         Entry != &DeviceExtension->PdoListHead;
+         Entry = Entry->Flink)
+    {
+        PdoExtension = CONTAINING_RECORD(Entry, PDO_DEVICE_EXTENSION, PdoListEntry);
+
+        if ((PathId != SP_UNTAGGED && PdoExtension->Bus != PathId) ||
+            (TargetId != SP_UNTAGGED && PdoExtension->Target != TargetId) ||
+            (Lun != SP_UNTAGGED && PdoExtension->Lun != Lun))
+            continue;
+
+        PdoExtension->CompleteSrbStatus = SrbStatus;
+        InterlockedExchange(&PdoExtension->CompletePending, TRUE);
+        KeInsertQueueDpc(&PdoExtension->UnitDpc, NULL, NULL);
+    }
+
+    PortReleasePdoListLock(DeviceExtension, OldIrql);
 }
 
 
@@ -565,7 +641,7 @@ StorPortDebugPrint(
 
 
 /*
- * @unimplemented
+ * @implemented
  */
 STORPORT_API
 BOOLEAN
@@ -577,14 +653,36 @@ StorPortDeviceBusy(
     _In_ UCHAR Lun,
     _In_ ULONG RequestsToComplete)
 {
-    DPRINT1("StorPortDeviceBusy()\n");
-    UNIMPLEMENTED;
-    return FALSE;
+    PMINIPORT_DEVICE_EXTENSION MiniportExtension;
+    PPDO_DEVICE_EXTENSION PdoExtension;
+    LONG Outstanding;
+
+    DPRINT("StorPortDeviceBusy(%p %u %u %u %lu)\n",
+            HwDeviceExtension, PathId, TargetId, Lun, RequestsToComplete);
+
+    /* Get the miniport extension */
+    MiniportExtension = CONTAINING_RECORD(HwDeviceExtension,
+                                          MINIPORT_DEVICE_EXTENSION,
+                                          HwDeviceExtension);
+
+    PdoExtension = PortGetPdoExtension(MiniportExtension->Miniport->DeviceExtension,
+                                       PathId,
+                                       TargetId,
+                                       Lun);
+    if (PdoExtension == NULL)
+        return FALSE;
+
+    /* Only outstanding requests can lift the busy state */
+    Outstanding = PdoExtension->OutstandingRequests;
+    InterlockedExchange(&PdoExtension->BusyCount,
+                        min((LONG)RequestsToComplete, Outstanding));
+
+    return TRUE;
 }
 
 
 /*
- * @unimplemented
+ * @implemented
  */
 STORPORT_API
 BOOLEAN
@@ -595,9 +693,30 @@ StorPortDeviceReady(
     _In_ UCHAR TargetId,
     _In_ UCHAR Lun)
 {
-    DPRINT1("StorPortDeviceReady()\n");
-    UNIMPLEMENTED;
-    return FALSE;
+    PMINIPORT_DEVICE_EXTENSION MiniportExtension;
+    PPDO_DEVICE_EXTENSION PdoExtension;
+
+    DPRINT("StorPortDeviceReady(%p %u %u %u)\n",
+            HwDeviceExtension, PathId, TargetId, Lun);
+
+    /* Get the miniport extension */
+    MiniportExtension = CONTAINING_RECORD(HwDeviceExtension,
+                                          MINIPORT_DEVICE_EXTENSION,
+                                          HwDeviceExtension);
+
+    PdoExtension = PortGetPdoExtension(MiniportExtension->Miniport->DeviceExtension,
+                                       PathId,
+                                       TargetId,
+                                       Lun);
+    if (PdoExtension == NULL)
+        return FALSE;
+
+    InterlockedExchange(&PdoExtension->BusyCount, 0);
+
+    /* Let the completion DPC restart the queue */
+    PortRequeueLun(PdoExtension);
+
+    return TRUE;
 }
 
 
@@ -765,7 +884,7 @@ StorPortGetDeviceBase(
 
 
 /*
- * @unimplemented
+ * @implemented
  */
 STORPORT_API
 PVOID
@@ -776,9 +895,25 @@ StorPortGetLogicalUnit(
     _In_ UCHAR TargetId,
     _In_ UCHAR Lun)
 {
-    DPRINT1("StorPortGetLogicalUnit()\n");
-    UNIMPLEMENTED;
-    return NULL;
+    PMINIPORT_DEVICE_EXTENSION MiniportExtension;
+    PPDO_DEVICE_EXTENSION PdoExtension;
+
+    DPRINT("StorPortGetLogicalUnit(%p %u %u %u)\n",
+           HwDeviceExtension, PathId, TargetId, Lun);
+
+    /* Get the miniport extension */
+    MiniportExtension = CONTAINING_RECORD(HwDeviceExtension,
+                                          MINIPORT_DEVICE_EXTENSION,
+                                          HwDeviceExtension);
+
+    PdoExtension = PortGetPdoExtension(MiniportExtension->Miniport->DeviceExtension,
+                                       PathId,
+                                       TargetId,
+                                       Lun);
+    if (PdoExtension == NULL)
+        return NULL;
+
+    return PdoExtension->LuExtension;
 }
 
 
@@ -799,15 +934,15 @@ StorPortGetPhysicalAddress(
     STOR_PHYSICAL_ADDRESS PhysicalAddress;
     ULONG_PTR Offset;
 
-    DPRINT1("StorPortGetPhysicalAddress(%p %p %p %p)\n",
-            HwDeviceExtension, Srb, VirtualAddress, Length);
+    DPRINT("StorPortGetPhysicalAddress(%p %p %p %p)\n",
+           HwDeviceExtension, Srb, VirtualAddress, Length);
 
     /* Get the miniport extension */
     MiniportExtension = CONTAINING_RECORD(HwDeviceExtension,
                                           MINIPORT_DEVICE_EXTENSION,
                                           HwDeviceExtension);
-    DPRINT1("HwDeviceExtension %p  MiniportExtension %p\n",
-            HwDeviceExtension, MiniportExtension);
+    DPRINT("HwDeviceExtension %p  MiniportExtension %p\n",
+           HwDeviceExtension, MiniportExtension);
 
     DeviceExtension = MiniportExtension->Miniport->DeviceExtension;
 
@@ -823,22 +958,28 @@ StorPortGetPhysicalAddress(
         return PhysicalAddress;
     }
 
-    // FIXME
+    /* Inside of the SRB extension pool? */
+    if (((ULONG_PTR)VirtualAddress >= (ULONG_PTR)DeviceExtension->SrbExtensionBase) &&
+        ((ULONG_PTR)VirtualAddress < (ULONG_PTR)DeviceExtension->SrbExtensionBase + DeviceExtension->SrbExtensionPoolSize))
+    {
+        Offset = (ULONG_PTR)VirtualAddress - (ULONG_PTR)DeviceExtension->SrbExtensionBase;
 
+        PhysicalAddress.QuadPart = DeviceExtension->SrbExtensionPhysicalBase.QuadPart + Offset;
+        *Length = DeviceExtension->SrbExtensionSlotSize - (ULONG)(Offset % DeviceExtension->SrbExtensionSlotSize);
 
-    PhysicalAddress = MmGetPhysicalAddress(VirtualAddress);
-    *Length = 1;
-//    UNIMPLEMENTED;
+        return PhysicalAddress;
+    }
 
-//    *Length = 0;
-//    PhysicalAddress.QuadPart = (LONGLONG)0;
+    /* Anything else is non-paged memory, contiguous up to the end of the page */
+    PhysicalAddress = MmGetPhysicalAddress(VirtualAddress);
+    *Length = PAGE_SIZE - BYTE_OFFSET(VirtualAddress);
 
     return PhysicalAddress;
 }
 
 
 /*
- * @unimplemented
+ * @implemented
  */
 STORPORT_API
 PSTOR_SCATTER_GATHER_LIST
@@ -847,9 +988,17 @@ StorPortGetScatterGatherList(
     _In_ PVOID DeviceExtension,
     _In_ PSCSI_REQUEST_BLOCK Srb)
 {
-    DPRINT1("StorPortGetScatterGatherList()\n");
-    UNIMPLEMENTED;
-    return NULL;
+    PPORT_REQUEST Request;
+
+    DPRINT("StorPortGetScatterGatherList(%p %p)\n",
+           DeviceExtension, Srb);
+
+    /* The list was built when the request was queued */
+    Request = PortGetRequest(Srb);
+    if (Request == NULL || Request->ScatterGatherList->NumberOfElements == 0)
+        return NULL;
+
+    return Request->ScatterGatherList;
 }
 
 
@@ -866,8 +1015,33 @@ StorPortGetSrb(
     _In_ UCHAR Lun,
     _In_ LONG QueueTag)
 {
-    DPRINT("StorPortGetSrb()\n");
-    return NULL;
+    PMINIPORT_DEVICE_EXTENSION MiniportExtension;
+    PPDO_DEVICE_EXTENSION PdoExtension;
+    PPORT_REQUEST Request;
+
+    DPRINT("StorPortGetSrb(%p %u %u %u %ld)\n",
+           DeviceExtension, PathId, TargetId, Lun, QueueTag);
+
+    if (QueueTag < 0 || QueueTag >= STORPORT_MAX_QUEUE_DEPTH)
+        return NULL;
+
+    /* Get the miniport extension */
+    MiniportExtension = CONTAINING_RECORD(DeviceExtension,
+                                          MINIPORT_DEVICE_EXTENSION,
+                                          HwDeviceExtension);
+
+    PdoExtension = PortGetPdoExtension(MiniportExtension->Miniport->DeviceExtension,
+                                       PathId,
+                                       TargetId,
+                                       Lun);
+    if (PdoExtension == NULL)
+        return NULL;
+
+    Request = PdoExtension->ActiveRequests[QueueTag];
+    if (Request == NULL)
+        return NULL;
+
+    return Request->Srb;
 }
 
 
@@ -1102,6 +1276,8 @@ StorPortNotification(
     PBOOLEAN Result;
     PSTOR_DPC Dpc;
     PHW_DPC_ROUTINE HwDpcRoutine;
+    PVOID SystemArgument1, SystemArgument2;
+    PLONG Succ;
     va_list ap;
 
     STOR_SPINLOCK SpinLock;
@@ -1109,8 +1285,8 @@ StorPortNotification(
     PSTOR_LOCK_HANDLE LockHandle;
     PSCSI_REQUEST_BLOCK Srb;
 
-    DPRINT1("StorPortNotification(%x %p)\n",
-            NotificationType, HwDeviceExtension);
+    DPRINT("StorPortNotification(%x %p)\n",
+           NotificationType, HwDeviceExtension);
 
     /* Get the miniport extension */
     if (HwDeviceExtension != NULL)
@@ -1118,8 +1294,8 @@ StorPortNotification(
         MiniportExtension = CONTAINING_RECORD(HwDeviceExtension,
                                               MINIPORT_DEVICE_EXTENSION,
                                               HwDeviceExtension);
-        DPRINT1("HwDeviceExtension %p  MiniportExtension %p\n",
-                HwDeviceExtension, MiniportExtension);
+        DPRINT("HwDeviceExtension %p  MiniportExtension %p\n",
+               HwDeviceExtension, MiniportExtension);
 
         DeviceExtension = MiniportExtension->Miniport->DeviceExtension;
     }
@@ -1129,14 +1305,16 @@ StorPortNotification(
     switch (NotificationType)
     {
         case RequestComplete:
-            DPRINT1("RequestComplete\n");
+            DPRINT("RequestComplete\n");
             Srb = (PSCSI_REQUEST_BLOCK)va_arg(ap, PSCSI_REQUEST_BLOCK);
-            DPRINT1("Srb %p\n", Srb);
-            if (Srb->OriginalRequest != NULL)
-            {
-                DPRINT1("Need to complete the IRP!\n");
+            DPRINT("Srb %p\n", Srb);
+            if (DeviceExtension != NULL)
+                PortRequestComplete(DeviceExtension, Srb);
+            break;
 
-            }
+        case NextRequest:
+        case NextLuRequest:
+            /* Storport starts new requests on its own */
             break;
 
         case GetExtendedFunctionTable:
@@ -1169,20 +1347,34 @@ StorPortNotification(
             HwDpcRoutine = (PHW_DPC_ROUTINE)va_arg(ap, PHW_DPC_ROUTINE);
             DPRINT1("HwDpcRoutine %p\n", HwDpcRoutine);
 
+            /* The DPC routine gets the miniport device extension as its context */
             KeInitializeDpc((PRKDPC)&Dpc->Dpc,
                             (PKDEFERRED_ROUTINE)HwDpcRoutine,
-                            (PVOID)DeviceExtension);
-            KeInitializeSpinLock(&Dpc->Lock);
+                            HwDeviceExtension);
+            KeInitializeSpinLock((PKSPIN_LOCK)&Dpc->Lock);
+            break;
+
+        case IssueDpc:
+            DPRINT("IssueDpc\n");
+            Dpc = (PSTOR_DPC)va_arg(ap, PSTOR_DPC);
+            SystemArgument1 = (PVOID)va_arg(ap, PVOID);
+            SystemArgument2 = (PVOID)va_arg(ap, PVOID);
+            Succ = (PLONG)va_arg(ap, PLONG);
+            DPRINT("Dpc %p\n", Dpc);
+
+            *Succ = KeInsertQueueDpc((PRKDPC)&Dpc->Dpc,
+                                     SystemArgument1,
+                                     SystemArgument2);
             break;
 
         case AcquireSpinLock:
-            DPRINT1("AcquireSpinLock\n");
+            DPRINT("AcquireSpinLock\n");
             SpinLock = (STOR_SPINLOCK)va_arg(ap, STOR_SPINLOCK);
-            DPRINT1("SpinLock %lu\n", SpinLock);
+            DPRINT("SpinLock %lu\n", SpinLock);
             LockContext = (PVOID)va_arg(ap, PVOID);
-            DPRINT1("LockContext %p\n", LockContext);
+            DPRINT("LockContext %p\n", LockContext);
             LockHandle = (PSTOR_LOCK_HANDLE)va_arg(ap, PSTOR_LOCK_HANDLE);
-            DPRINT1("LockHandle %p\n", LockHandle);
+            DPRINT("LockHandle %p\n", LockHandle);
             PortAcquireSpinLock(DeviceExtension,
                                 SpinLock,
                                 LockContext,
@@ -1190,9 +1382,9 @@ StorPortNotification(
             break;
 
         case ReleaseSpinLock:
-            DPRINT1("ReleaseSpinLock\n");
+            DPRINT("ReleaseSpinLock\n");
             LockHandle = (PSTOR_LOCK_HANDLE)va_arg(ap, PSTOR_LOCK_HANDLE);
-            DPRINT1("LockHandle %p\n", LockHandle);
+            DPRINT("LockHandle %p\n", LockHandle);
             PortReleaseSpinLock(DeviceExtension,
                                 LockHandle);
             break;
@@ -1207,7 +1399,7 @@ StorPortNotification(
 
 
 /*
- * @unimplemented
+ * @implemented
  */
 STORPORT_API
 BOOLEAN
@@ -1216,14 +1408,28 @@ StorPortPause(
     _In_ PVOID HwDeviceExtension,
     _In_ ULONG TimeOut)
 {
-    DPRINT1("StorPortPause()\n");
-    UNIMPLEMENTED;
-    return FALSE;
+    PMINIPORT_DEVICE_EXTENSION MiniportExtension;
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+
+    DPRINT("StorPortPause(%p %lu)\n", HwDeviceExtension, TimeOut);
+
+    /* Get the miniport extension */
+    MiniportExtension = CONTAINING_RECORD(HwDeviceExtension,
+                                          MINIPORT_DEVICE_EXTENSION,
+                                          HwDeviceExtension);
+
+    DeviceExtension = MiniportExtension->Miniport->DeviceExtension;
+
+    /* The adapter timer resumes the adapter once the timeout (in seconds) expires */
+    DeviceExtension->PauseDeadline = DeviceExtension->TimerTicks + TimeOut;
+    InterlockedExchange(&DeviceExtension->Paused, TRUE);
+
+    return TRUE;
 }
 
 
 /*
- * @unimplemented
+ * @implemented
  */
 STORPORT_API
 BOOLEAN
@@ -1235,9 +1441,28 @@ StorPortPauseDevice(
     _In_ UCHAR Lun,
     _In_ ULONG TimeOut)
 {
-    DPRINT1("StorPortPauseDevice()\n");
-    UNIMPLEMENTED;
-    return FALSE;
+    PMINIPORT_DEVICE_EXTENSION MiniportExtension;
+    PPDO_DEVICE_EXTENSION PdoExtension;
+
+    DPRINT("StorPortPauseDevice(%p %u %u %u %lu)\n",
+           HwDeviceExtension, PathId, TargetId, Lun, TimeOut);
+
+    /* Get the miniport extension */
+    MiniportExtension = CONTAINING_RECORD(HwDeviceExtension,
+                                          MINIPORT_DEVICE_EXTENSION,
+                                          HwDeviceExtension);
+
+    PdoExtension = PortGetPdoExtension(MiniportExtension->Miniport->DeviceExtension,
+                                       PathId,
+                                       TargetId,
+                                       Lun);
+    if (PdoExtension == NULL)
+        return FALSE;
+
+    PdoExtension->PauseDeadline = PdoExtension->FdoExtension->TimerTicks + TimeOut;
+    InterlockedExchange(&PdoExtension->Paused, TRUE);
+
+    return TRUE;
 }
 
 
@@ -1261,7 +1486,7 @@ StorPortQuerySystemTime(
 
 
 /*
- * @unimplemented
+ * @implemented
  */
 STORPORT_API
 BOOLEAN
@@ -1269,9 +1494,24 @@ NTAPI
 StorPortReady(
     _In_ PVOID HwDeviceExtension)
 {
-    DPRINT1("StorPortReady()\n");
-    UNIMPLEMENTED;
-    return FALSE;
+    PMINIPORT_DEVICE_EXTENSION MiniportExtension;
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+
+    DPRINT("StorPortReady(%p)\n", HwDeviceExtension);
+
+    /* Get the miniport extension */
+    MiniportExtension = CONTAINING_RECORD(HwDeviceExtension,
+                                          MINIPORT_DEVICE_EXTENSION,
+                                          HwDeviceExtension);
+
+    DeviceExtension = MiniportExtension->Miniport->DeviceExtension;
+
+    InterlockedExchange(&DeviceExtension->BusyCount, 0);
+
+    /* The units waiting for the adapter are on the ready list */
+    KeInsertQueueDpc(&DeviceExtension->CompletionDpc, NULL, NULL);
+
+    return TRUE;
 }
 
 
@@ -1316,7 +1556,7 @@ StorPortRegistryWrite(
 
 
 /*
- * @unimplemented
+ * @implemented
  */
 STORPORT_API
 BOOLEAN
@@ -1324,14 +1564,29 @@ NTAPI
 StorPortResume(
     _In_ PVOID HwDeviceExtension)
 {
-    DPRINT1("StorPortResume()\n");
-    UNIMPLEMENTED;
-    return FALSE;
+    PMINIPORT_DEVICE_EXTENSION MiniportExtension;
+    PFDO_DEVICE_EXTENSION DeviceExtension;
+
+    DPRINT("StorPortResume(%p)\n", HwDeviceExtension);
+
+    /* Get the miniport extension */
+    MiniportExtension = CONTAINING_RECORD(HwDeviceExtension,
+                                          MINIPORT_DEVICE_EXTENSION,
+                                          HwDeviceExtension);
+
+    DeviceExtension = MiniportExtension->Miniport->DeviceExtension;
+
+    InterlockedExchange(&DeviceExtension->Paused, FALSE);
+
+    /* The units waiting for the adapter are on the ready list */
+    KeInsertQueueDpc(&DeviceExtension->CompletionDpc, NULL, NULL);
+
+    return TRUE;
 }
 
 
 /*
- * @unimplemented
+ * @implemented
  */
 STORPORT_API
 BOOLEAN
@@ -1342,9 +1597,30 @@ StorPortResumeDevice(
     _In_ UCHAR TargetId,
     _In_ UCHAR Lun)
 {
-    DPRINT1("StorPortResumeDevice()\n");
-    UNIMPLEMENTED;
-    return FALSE;
+    PMINIPORT_DEVICE_EXTENSION MiniportExtension;
+    PPDO_DEVICE_EXTENSION PdoExtension;
+
+    DPRINT("StorPortResumeDevice(%p %u %u %u)\n",
+           HwDeviceExtension, PathId, TargetId, Lun);
+
+    /* Get the miniport extension */
+    MiniportExtension = CONTAINING_RECORD(HwDeviceExtension,
+                                          MINIPORT_DEVICE_EXTENSION,
+                                          HwDeviceExtension);
+
+    PdoExtension = PortGetPdoExtension(MiniportExtension->Miniport->DeviceExtension,
+                                       PathId,
+                                       TargetId,
+                                       Lun);
+    if (PdoExtension == NULL)
+        return FALSE;
+
+    InterlockedExchange(&PdoExtension->Paused, FALSE);
+
+    /* The unit DPC restarts the queue */
+    KeInsertQueueDpc(&PdoExtension->UnitDpc, NULL, NULL);
+
+    return TRUE;
 }
 
 
@@ -1390,7 +1666,7 @@ StorPortSetBusDataByOffset(
 
 
 /*
- * @unimplemented
+ * @implemented
  */
 STORPORT_API
 BOOLEAN
@@ -1402,9 +1678,35 @@ StorPortSetDeviceQueueDepth(
     _In_ UCHAR Lun,
     _In_ ULONG Depth)
 {
-    DPRINT1("StorPortSetDeviceQueueDepth()\n");
-    UNIMPLEMENTED;
-    return FALSE;
+    PMINIPORT_DEVICE_EXTENSION MiniportExtension;
+    PPDO_DEVICE_EXTENSION PdoExtension;
+
+    DPRINT("StorPortSetDeviceQueueDepth(%p %u %u %u %lu)\n",
+            HwDeviceExtension, PathId, TargetId, Lun, Depth);
+
+    if (Depth == 0 || Depth > STORPORT_MAX_QUEUE_DEPTH)
+        return FALSE;
+
+    /* Get the miniport extension */
+    MiniportExtension = CONTAINING_RECORD(HwDeviceExtension,
+                                          MINIPORT_DEVICE_EXTENSION,
+                                          HwDeviceExtension);
+
+    PdoExtension = PortGetPdoExtension(MiniportExtension->Miniport->DeviceExtension,
+                                       PathId,
+                                       TargetId,
+                                       Lun);
+    if (PdoExtension == NULL)
+        return FALSE;
+
+    /*
+     * The miniport may call this from HwStartIo, so the queue is restarted
+     * by the completion DPC rather than from here.
+     */
+    InterlockedExchange(&PdoExtension->QueueDepth, (LONG)Depth);
+    PortRequeueLun(PdoExtension);
+
+    return TRUE;
 }
 
 
@@ -386,7 +386,8 @@ x86BiosCall(
                       x86BOP,
                       x86IntAck,
                       NULL,  // FpuCallback,
-                      NULL); // Tlb
+                      NULL,  // Tlb
+                      NULL); // InstCache
 
 //RegisterBop(BOP_UNSIMULATE, CpuUnsimulateBop);
 
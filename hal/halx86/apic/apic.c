@@ -287,6 +287,9 @@ ApicInitializeLocalApic(ULONG Cpu)
     /* Set the spurious ISR */
     KeRegisterInterruptHandler(APIC_SPURIOUS_VECTOR, ApicSpuriousService);
 
+    /* Every processor gets its own profile interrupt from its local timer */
+    KeRegisterInterruptHandler(APIC_PROFILE_VECTOR, HalpProfileInterrupt);
+
     /* Create a template LVT */
     LvtEntry.Long = 0;
     LvtEntry.Vector = 0xFF;
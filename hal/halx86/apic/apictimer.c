@@ -62,6 +62,76 @@ ApicInitializeTimer(ULONG Cpu)
 // KeSetTimeIncrement
 }
 
+static
+ULONG
+ApicCalibrateTimer(VOID)
+{
+    LVT_REGISTER LvtEntry;
+    ULONG Remaining;
+
+    /* Let the masked timer count down from the top for a millisecond */
+    LvtEntry.Long = 0;
+    LvtEntry.Vector = APIC_PROFILE_VECTOR;
+    LvtEntry.Mask = 1;
+    ApicWrite(APIC_TMRLVTR, LvtEntry.Long);
+    ApicWrite(APIC_TDCR, TIMER_DV_DivideBy1);
+    ApicWrite(APIC_TICR, MAXULONG);
+    KeStallExecutionProcessor(1000);
+    Remaining = ApicRead(APIC_TCCR);
+    ApicWrite(APIC_TICR, 0);
+
+    /* The bus clock drives the timer, so this is its frequency in kHz */
+    return MAXULONG - Remaining;
+}
+
+static
+ULONG
+ApicGetProfileCount(VOID)
+{
+    PKPCR Pcr = KeGetPcr();
+    ULONGLONG Count;
+
+    /* The stall counter is only calibrated late in phase 0, so do this lazily */
+    if (!Pcr->HalReserved[HAL_PROFILING_MULTIPLIER])
+    {
+        Pcr->HalReserved[HAL_PROFILING_MULTIPLIER] = max(ApicCalibrateTimer(), 1);
+    }
+
+    /* The interval is in 100ns units, the multiplier in timer ticks per ms */
+    Count = HalCurProfileInterval * Pcr->HalReserved[HAL_PROFILING_MULTIPLIER] / 10000;
+    Pcr->HalReserved[HAL_PROFILING_INTERVAL] = (ULONG)max(Count, 1);
+    return Pcr->HalReserved[HAL_PROFILING_INTERVAL];
+}
+
+VOID
+FASTCALL
+HalpProfileInterruptHandler(IN PKTRAP_FRAME TrapFrame)
+{
+    KIRQL Irql;
+
+    /* Enter trap */
+    KiEnterInterruptTrap(TrapFrame);
+
+    /* Start the interrupt */
+    if (!HalBeginSystemInterrupt(PROFILE_LEVEL, APIC_PROFILE_VECTOR, &Irql))
+    {
+        /* Spurious, just end the interrupt */
+        KiEoiHelper(TrapFrame);
+    }
+
+    /* If profiling is enabled, call the kernel function */
+    if (HalIsProfiling)
+    {
+        KeProfileInterrupt(TrapFrame);
+    }
+
+#ifndef _M_AMD64
+    /* Finish the interrupt */
+    _disable();
+    HalEndSystemInterrupt(Irql, TrapFrame);
+#endif
+    KiEoiHelper(TrapFrame);
+}
 
 /* PUBLIC FUNCTIONS ***********************************************************/
 
@@ -69,8 +139,9 @@ VOID
 NTAPI
 HalInitializeProfiling(VOID)
 {
-    KeGetPcr()->HalReserved[HAL_PROFILING_INTERVAL] = HalCurProfileInterval;
-    KeGetPcr()->HalReserved[HAL_PROFILING_MULTIPLIER] = 1; /* TODO: HACK */
+    /* The timer gets calibrated when profiling starts on this processor */
+    KeGetPcr()->HalReserved[HAL_PROFILING_INTERVAL] = 0;
+    KeGetPcr()->HalReserved[HAL_PROFILING_MULTIPLIER] = 0;
 }
 
 VOID
@@ -86,7 +157,8 @@ HalStartProfileInterrupt(IN KPROFILE_SOURCE ProfileSource)
         HalIsProfiling = TRUE;
 
         /* Set interrupt interval */
-        ApicWrite(APIC_TICR, KeGetPcr()->HalReserved[HAL_PROFILING_INTERVAL]);
+        ApicWrite(APIC_TDCR, TIMER_DV_DivideBy1);
+        ApicWrite(APIC_TICR, ApicGetProfileCount());
 
         /* Unmask it */
         LvtEntry.Long = 0;
@@ -122,7 +194,6 @@ ULONG_PTR
 NTAPI
 HalSetProfileInterval(IN ULONG_PTR Interval)
 {
-    ULONGLONG TimerInterval;
     ULONGLONG FixedInterval;
 
     FixedInterval = (ULONGLONG)Interval;
@@ -137,17 +208,14 @@ HalSetProfileInterval(IN ULONG_PTR Interval)
         FixedInterval = HalMaxProfileInterval;
     }
 
-    /* Remember interval */
+    /* Remember interval, processors that aren't profiling pick it up on start */
     HalCurProfileInterval = FixedInterval;
 
-    /* Recalculate interval for APIC */
-    TimerInterval = FixedInterval * KeGetPcr()->HalReserved[HAL_PROFILING_MULTIPLIER] / HalMaxProfileInterval;
-
-    /* Remember recalculated interval in PCR */
-    KeGetPcr()->HalReserved[HAL_PROFILING_INTERVAL] = (ULONG)TimerInterval;
-
-    /* And set it */
-    ApicWrite(APIC_TICR, (ULONG)TimerInterval);
+    /* Update this processor's timer if it's running */
+    if (HalIsProfiling)
+    {
+        ApicWrite(APIC_TICR, ApicGetProfileCount());
+    }
 
-    return Interval;
+    return (ULONG_PTR)FixedInterval;
 }
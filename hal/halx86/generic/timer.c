@@ -29,6 +29,10 @@ ULONG HalpCurrentTimeIncrement;
 ULONG HalpCurrentRollOver;
 ULONG HalpNextMSRate = 14;
 ULONG HalpLargestClockMS = 15;
+BOOLEAN HalpClockIdleStretched;
+ULONG HalpIdleCarryRollOver;
+ULONG HalpIdleSavedRollOver;
+ULONG HalpIdleSavedTimeIncrement;
 
 static struct _HALP_ROLLOVER
 {
@@ -111,6 +115,122 @@ HalpSetTimerRollOver(USHORT RollOver)
     __writeeflags(Flags);
 }
 
+#ifndef _MINIHAL_
+FORCEINLINE
+ULONG
+HalpRollOverToIncrement(ULONG RollOver)
+{
+    /* Convert PIT counts to 100ns units */
+    return (ULONG)(((ULONGLONG)RollOver * 10000000) / PIT_FREQUENCY);
+}
+
+static
+BOOLEAN
+HalpReadIdleClock(PULONG Elapsed)
+{
+    ULONG CounterValue;
+    I8259_OCW3 Ocw3;
+
+    /*
+     * Don't race a clock interrupt that is pending or about to be. It would
+     * credit the new rollover for a period that ran with the old one.
+     */
+    CounterValue = HalpRead8254Value();
+    if ((CounterValue < HalpRolloverTable[0].RollOver / 16) ||
+        (CounterValue > HalpCurrentRollOver))
+    {
+        return FALSE;
+    }
+
+    Ocw3.Bits = 0;
+    Ocw3.Sbo = 1;
+    Ocw3.ReadRequest = ReadIdr;
+    __outbyte(PIC1_CONTROL_PORT, Ocw3.Bits);
+    if (__inbyte(PIC1_CONTROL_PORT) & 1) return FALSE;
+
+    /* Return the PIT counts of the current period that went by */
+    *Elapsed = HalpCurrentRollOver - CounterValue;
+    return TRUE;
+}
+
+static
+BOOLEAN
+HalpReprogramIdleClock(ULONG RollOver)
+{
+    ULONG Elapsed;
+
+    if (!HalpReadIdleClock(&Elapsed)) return FALSE;
+
+    /* Remember the normal clock rate the first time we leave it */
+    if (!HalpClockIdleStretched)
+    {
+        HalpIdleSavedRollOver = HalpCurrentRollOver;
+        HalpIdleSavedTimeIncrement = HalpCurrentTimeIncrement;
+        HalpClockIdleStretched = TRUE;
+    }
+
+    /*
+     * Reprogramming restarts the count. Account for the part of the period
+     * that already went by now, the next interrupt reports it to the kernel.
+     */
+    HalpPerfCounter.QuadPart += Elapsed;
+    HalpIdleCarryRollOver += Elapsed;
+
+    /* Start the new period */
+    HalpSetTimerRollOver((USHORT)RollOver);
+    HalpCurrentRollOver = RollOver;
+    HalpCurrentTimeIncrement = HalpRollOverToIncrement(RollOver);
+    return TRUE;
+}
+
+ULONG
+NTAPI
+HalpSetIdleClockInterval(IN ULONG Interval)
+{
+    ULONGLONG RollOver;
+    ULONG Elapsed;
+
+    /* Check if the processor is leaving idle */
+    if (!Interval)
+    {
+        /*
+         * Nothing to do if the clock interrupt already ended the stretched
+         * period. If it is pending or due within a fraction of a tick, it
+         * reports the time itself.
+         */
+        if (!HalpClockIdleStretched || !HalpReadIdleClock(&Elapsed)) return 0;
+
+        /* Account for the stretched period so far */
+        HalpPerfCounter.QuadPart += Elapsed;
+        Elapsed += HalpIdleCarryRollOver;
+        HalpIdleCarryRollOver = 0;
+
+        /* Go back to the normal rate, starting a full period now */
+        HalpCurrentTimeIncrement = HalpIdleSavedTimeIncrement;
+        HalpCurrentRollOver = HalpIdleSavedRollOver;
+        HalpSetTimerRollOver((USHORT)HalpCurrentRollOver);
+        HalpClockIdleStretched = FALSE;
+
+        /* The kernel catches up the time that went by */
+        return HalpRollOverToIncrement(Elapsed);
+    }
+
+    /* Convert the interval to PIT counts, as far as the counter can go */
+    RollOver = ((ULONGLONG)Interval * PIT_FREQUENCY) / 10000000;
+    if (RollOver > MAXUSHORT) RollOver = MAXUSHORT;
+
+    /* Not worth it if the normal tick comes sooner */
+    if (RollOver <= (HalpClockIdleStretched ? HalpIdleSavedRollOver : HalpCurrentRollOver))
+    {
+        return 0;
+    }
+
+    /* Stretch the current period */
+    if (!HalpReprogramIdleClock((ULONG)RollOver)) return 0;
+    return HalpCurrentTimeIncrement;
+}
+#endif
+
 INIT_FUNCTION
 VOID
 NTAPI
@@ -134,6 +254,11 @@ HalpInitializeClock(VOID)
     /* Save rollover and increment */
     HalpCurrentRollOver = RollOver;
     HalpCurrentTimeIncrement = Increment;
+
+#ifndef _MINIHAL_
+    /* Let the kernel stretch the clock period while idle */
+    HalSetIdleClockInterval = HalpSetIdleClockInterval;
+#endif
 }
 
 #ifdef _M_IX86
@@ -158,6 +283,20 @@ HalpClockInterruptHandler(IN PKTRAP_FRAME TrapFrame)
         /* Save increment */
         LastIncrement = HalpCurrentTimeIncrement;
 
+        /* Check if this ends a stretched idle period */
+        if (HalpClockIdleStretched)
+        {
+            /* Report the part that went by before the clock was reprogrammed */
+            LastIncrement += HalpRollOverToIncrement(HalpIdleCarryRollOver);
+            HalpIdleCarryRollOver = 0;
+
+            /* Go back to the normal rate */
+            HalpCurrentTimeIncrement = HalpIdleSavedTimeIncrement;
+            HalpCurrentRollOver = HalpIdleSavedRollOver;
+            HalpSetTimerRollOver((USHORT)HalpCurrentRollOver);
+            HalpClockIdleStretched = FALSE;
+        }
+
         /* Check if someone changed the time rate */
         if (HalpClockSetMSRate)
         {
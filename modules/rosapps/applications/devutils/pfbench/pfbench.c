@@ -0,0 +1,243 @@
+/*
+ * PROJECT:     ReactOS Prefetcher Benchmark
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Times the cold start of an application, driven by pfbench.py
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define WIN32_NO_STATUS
+#include <windef.h>
+#include <winbase.h>
+#include <winuser.h>
+#define NTOS_MODE_USER
+#include <ndk/exfuncs.h>
+#include <ndk/rtlfuncs.h>
+#include <ndk/setypes.h>
+
+#define DEFAULT_TIMEOUT 60
+
+static
+VOID
+Report(
+    _In_ PCSTR Format,
+    ...)
+{
+    CHAR Buffer[256];
+    va_list Args;
+
+    va_start(Args, Format);
+    _vsnprintf(Buffer, sizeof(Buffer) - 1, Format, Args);
+    va_end(Args);
+    Buffer[sizeof(Buffer) - 1] = ANSI_NULL;
+
+    /* The host script picks the debug output up from the serial port */
+    fputs(Buffer, stdout);
+    OutputDebugStringA(Buffer);
+}
+
+static
+NTSTATUS
+QueryPrefetcher(
+    _Out_ PPF_SYSTEM_PREFETCH_PARAMETERS Parameters)
+{
+    PREFETCHER_INFORMATION Information;
+
+    Information.Version = PREFETCHER_INFORMATION_VERSION;
+    Information.Magic = PREFETCHER_INFORMATION_MAGIC;
+    Information.PrefetcherInformationClass = PrefetcherSystemParameters;
+    Information.PrefetcherInformation = Parameters;
+    Information.PrefetcherInformationLength = sizeof(*Parameters);
+
+    return NtQuerySystemInformation(SystemPrefetcherInformation,
+                                    &Information,
+                                    sizeof(Information),
+                                    NULL);
+}
+
+static
+NTSTATUS
+SetBootPhase(
+    _In_ PF_BOOT_PHASE_ID Phase)
+{
+    PREFETCHER_INFORMATION Information;
+    ULONG Value = Phase;
+    BOOLEAN Enabled;
+    NTSTATUS Status;
+
+    Status = RtlAdjustPrivilege(SE_PROF_SINGLE_PROCESS_PRIVILEGE, TRUE, FALSE, &Enabled);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    Information.Version = PREFETCHER_INFORMATION_VERSION;
+    Information.Magic = PREFETCHER_INFORMATION_MAGIC;
+    Information.PrefetcherInformationClass = PrefetcherBootPhase;
+    Information.PrefetcherInformation = &Value;
+    Information.PrefetcherInformationLength = sizeof(Value);
+
+    return NtSetSystemInformation(SystemPrefetcherInformation,
+                                  &Information,
+                                  sizeof(Information));
+}
+
+static
+VOID
+ReportPrefetcher(VOID)
+{
+    PF_SYSTEM_PREFETCH_PARAMETERS Parameters;
+    NTSTATUS Status;
+
+    Status = QueryPrefetcher(&Parameters);
+    if (!NT_SUCCESS(Status))
+    {
+        Report("pfbench: prefetcher unavailable 0x%08lx\n", Status);
+        return;
+    }
+
+    Report("pfbench: prefetcher status=%lu active=%lu completed=%lu saved=%lu "
+           "scenarios=%lu files=%lu bytes=%I64u\n",
+           Parameters.EnableStatus,
+           Parameters.ActiveTraces,
+           Parameters.TracesCompleted,
+           Parameters.TracesSaved,
+           Parameters.ScenariosPrefetched,
+           Parameters.FilesPrefetched,
+           Parameters.BytesPrefetched);
+}
+
+static
+BOOL
+Launch(
+    _In_ LPSTR CommandLine,
+    _In_ BOOL WaitForExit,
+    _In_ DWORD Timeout,
+    _Out_ PDWORD Elapsed)
+{
+    STARTUPINFOA StartupInfo;
+    PROCESS_INFORMATION ProcessInfo;
+    LARGE_INTEGER Frequency, Start, End;
+    DWORD Result;
+
+    ZeroMemory(&StartupInfo, sizeof(StartupInfo));
+    StartupInfo.cb = sizeof(StartupInfo);
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+
+    if (!CreateProcessA(NULL, CommandLine, NULL, NULL, FALSE, 0, NULL, NULL,
+                        &StartupInfo, &ProcessInfo))
+    {
+        Report("pfbench: failed to start '%s': %lu\n", CommandLine, GetLastError());
+        return FALSE;
+    }
+
+    /* A GUI application is up once it waits for input, anything else once it exits */
+    if (WaitForExit)
+        Result = WaitForSingleObject(ProcessInfo.hProcess, Timeout * 1000);
+    else
+        Result = WaitForInputIdle(ProcessInfo.hProcess, Timeout * 1000);
+
+    QueryPerformanceCounter(&End);
+    *Elapsed = (DWORD)((End.QuadPart - Start.QuadPart) * 1000 / Frequency.QuadPart);
+
+    CloseHandle(ProcessInfo.hThread);
+    CloseHandle(ProcessInfo.hProcess);
+
+    if (Result != WAIT_OBJECT_0)
+    {
+        Report("pfbench: '%s' did not start within %lu seconds\n", CommandLine, Timeout);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static
+VOID
+WaitForTraces(
+    _In_ DWORD Timeout)
+{
+    PF_SYSTEM_PREFETCH_PARAMETERS Parameters;
+    DWORD Waited;
+
+    /* The next boot only benefits from the traces that made it to disk */
+    for (Waited = 0; Waited < Timeout * 1000; Waited += 500)
+    {
+        if (!NT_SUCCESS(QueryPrefetcher(&Parameters)) || !Parameters.ActiveTraces)
+            break;
+
+        Sleep(500);
+    }
+}
+
+static
+VOID
+PrintUsage(VOID)
+{
+    printf("Times the cold start of an application for pfbench.py.\n\n"
+           "PFBENCH [/exit] [/timeout seconds] [/shutdown] command line\n\n"
+           "  /exit       Wait for the application to exit, instead of waiting\n"
+           "              for it to be idle. Use it for console applications.\n"
+           "  /timeout    How long to wait for the application and for the\n"
+           "              prefetcher traces, %u seconds by default.\n"
+           "  /shutdown   Power off once the traces are saved.\n",
+           DEFAULT_TIMEOUT);
+}
+
+int main(int argc, char *argv[])
+{
+    BOOL WaitForExit = FALSE, Shutdown = FALSE;
+    DWORD Timeout = DEFAULT_TIMEOUT, Elapsed;
+    LPSTR CommandLine;
+    BOOLEAN Enabled;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (argv[i][0] != '/' && argv[i][0] != '-')
+            break;
+
+        if (!_stricmp(argv[i] + 1, "exit"))
+            WaitForExit = TRUE;
+        else if (!_stricmp(argv[i] + 1, "shutdown"))
+            Shutdown = TRUE;
+        else if (!_stricmp(argv[i] + 1, "timeout") && i + 1 < argc)
+            Timeout = strtoul(argv[++i], NULL, 10);
+        else
+            break;
+    }
+
+    if (i >= argc || !Timeout)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    /* Hand the rest of our command line to the application as is */
+    CommandLine = strstr(GetCommandLineA(), argv[i]);
+    if (!CommandLine)
+        CommandLine = argv[i];
+
+    /* We run from the Run key, so the shell is up and the boot trace may end */
+    Report("pfbench: boot %lu\n", GetTickCount());
+    SetBootPhase(PfUserShellReadyPhase);
+    ReportPrefetcher();
+
+    if (Launch(CommandLine, WaitForExit, Timeout, &Elapsed))
+        Report("pfbench: launch %lu %s\n", Elapsed, CommandLine);
+
+    WaitForTraces(Timeout);
+    ReportPrefetcher();
+    Report("pfbench: done\n");
+
+    if (Shutdown)
+    {
+        RtlAdjustPrivilege(SE_SHUTDOWN_PRIVILEGE, TRUE, FALSE, &Enabled);
+        ExitWindowsEx(EWX_POWEROFF | EWX_FORCE, 0);
+    }
+
+    return 0;
+}
@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+#
+# PROJECT:     ReactOS Prefetcher Benchmark
+# LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+# PURPOSE:     Compares cold starts with and without prefetcher traces under QEMU
+#
+# Prepare the disk image once:
+#   1. Install ReactOS on it and boot it up to the desktop a first time.
+#   2. Make sure the boot entry passes /DEBUG /DEBUGPORT=COM1, the results
+#      travel over the debug output.
+#   3. Add a REG_SZ value to HKLM\Software\Microsoft\Windows\CurrentVersion\Run
+#      that starts the benchmark and powers off, for instance:
+#        pfbench.exe /shutdown C:\ReactOS\system32\wordpad.exe
+#   4. Delete C:\ReactOS\Prefetch and shut down cleanly.
+#
+# Every boot is a cold start: QEMU runs on a fresh overlay of the image, with
+# the host cache bypassed and the disk throttled so that seeks cost something.
+# The cold runs each get their own overlay, so nothing was ever traced. The
+# traced runs share one overlay that a training boot filled with traces first.
+#
+# Usage: pfbench.py [--runs N] [--iops N] [--memory MB] disk-image
+
+import argparse
+import os
+import re
+import statistics
+import subprocess
+import sys
+import tempfile
+
+RESULT = re.compile(r'pfbench: (boot|launch) (\d+)')
+STATUS = re.compile(r'pfbench: prefetcher (.*)')
+
+
+def make_overlay(image, path):
+    subprocess.run(['qemu-img', 'create', '-q', '-f', 'qcow2', '-F',
+                    detect_format(image), '-b', os.path.abspath(image), path],
+                   check=True)
+
+
+def detect_format(image):
+    return 'qcow2' if image.endswith('.qcow2') else 'raw'
+
+
+def boot(args, overlay, log):
+    drive = ('file={},format=qcow2,if=ide,cache=none,aio=threads,'
+             'throttling.iops-total={}'.format(overlay, args.iops))
+    command = [args.qemu, '-m', str(args.memory), '-drive', drive,
+               '-serial', 'file:' + log, '-display', 'none', '-no-reboot']
+    if args.kvm:
+        command.append('-enable-kvm')
+
+    try:
+        subprocess.run(command, timeout=args.timeout, check=False)
+    except subprocess.TimeoutExpired:
+        print('  boot timed out', file=sys.stderr)
+
+    results = {}
+    status = None
+    with open(log, errors='replace') as f:
+        for line in f:
+            match = RESULT.search(line)
+            if match:
+                results[match.group(1)] = int(match.group(2))
+            match = STATUS.search(line)
+            if match:
+                status = match.group(1)
+    return results, status
+
+
+def run(args, name, overlay, workdir, index):
+    log = os.path.join(workdir, '{}-{}.log'.format(name, index))
+    results, status = boot(args, overlay, log)
+    print('  {} #{}: boot {} ms, launch {} ms ({})'.format(
+        name, index, results.get('boot', '?'), results.get('launch', '?'),
+        status or 'no prefetcher status'))
+    return results
+
+
+def summarize(name, samples):
+    for key in ('boot', 'launch'):
+        values = [s[key] for s in samples if key in s]
+        if not values:
+            continue
+        print('{:>7} {:>6}: median {:6} ms, min {:6} ms, max {:6} ms over {} runs'.format(
+            name, key, int(statistics.median(values)), min(values), max(values), len(values)))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Compares cold starts with and without prefetcher traces under QEMU')
+    parser.add_argument('image', help='prepared ReactOS disk image')
+    parser.add_argument('--runs', type=int, default=5)
+    parser.add_argument('--iops', type=int, default=150,
+                        help='disk throttling, 150 is about a rotating disk')
+    parser.add_argument('--memory', type=int, default=512)
+    parser.add_argument('--timeout', type=int, default=600)
+    parser.add_argument('--qemu', default='qemu-system-i386')
+    parser.add_argument('--kvm', action='store_true')
+    parser.add_argument('--keep', action='store_true',
+                        help='keep the overlays and the serial logs')
+    args = parser.parse_args()
+
+    workdir = tempfile.mkdtemp(prefix='pfbench-')
+    print('Working in ' + workdir)
+
+    cold = []
+    for i in range(args.runs):
+        overlay = os.path.join(workdir, 'cold-{}.qcow2'.format(i))
+        make_overlay(args.image, overlay)
+        cold.append(run(args, 'cold', overlay, workdir, i))
+        if not args.keep:
+            os.remove(overlay)
+
+    traced = []
+    overlay = os.path.join(workdir, 'traced.qcow2')
+    make_overlay(args.image, overlay)
+    run(args, 'train', overlay, workdir, 0)
+    for i in range(args.runs):
+        traced.append(run(args, 'traced', overlay, workdir, i))
+
+    print()
+    summarize('cold', cold)
+    summarize('traced', traced)
+
+    if not args.keep:
+        for entry in os.listdir(workdir):
+            os.remove(os.path.join(workdir, entry))
+        os.rmdir(workdir)
+
+
+if __name__ == '__main__':
+    main()
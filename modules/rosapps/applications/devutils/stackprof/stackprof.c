@@ -0,0 +1,865 @@
+/*
+ * PROJECT:     ReactOS Sampling Profiler
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Samples call stacks through the NT Kernel Logger and prints
+ *              them folded, one line per stack, for flamegraph.pl
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WIN32_NO_STATUS
+#include <windef.h>
+#include <winbase.h>
+#include <wincon.h>
+#include <winver.h>
+#include <wmistr.h>
+#include <initguid.h>
+#include <evntrace.h>
+#include <dbghelp.h>
+#define NTOS_MODE_USER
+#include <ndk/exfuncs.h>
+#include <ndk/kefuncs.h>
+#include <ndk/psfuncs.h>
+#include <ndk/rtlfuncs.h>
+#include <ndk/setypes.h>
+#include <wmiguid.h>
+#include <wmiioctl.h>
+
+#define DEFAULT_FREQUENCY 1000
+#define DEFAULT_DURATION 10
+#define HASH_BUCKETS 4096
+#define MAX_FRAME_NAME 128
+
+/* EventTraceGuid, which identifies the logfile header event */
+static const GUID LogFileHeaderGuid = {0x68fdd900, 0x4a3e, 0x11d1, {0x84, 0xf4, 0x00, 0x00, 0xf8, 0x04, 0x64, 0xe3}};
+
+typedef struct _TRACE_PROPERTIES
+{
+    EVENT_TRACE_PROPERTIES Properties;
+    WCHAR LoggerName[64];
+    WCHAR LogFileName[MAX_PATH];
+} TRACE_PROPERTIES, *PTRACE_PROPERTIES;
+
+/* The kernel and every sampled process get one, with their own symbols */
+typedef struct _PROFILED_PROCESS
+{
+    struct _PROFILED_PROCESS *Next;
+    ULONG ProcessId;
+    CHAR ImageName[64];
+    PRTL_PROCESS_MODULES Modules;
+    BOOL SymbolsLoaded;
+} PROFILED_PROCESS, *PPROFILED_PROCESS;
+
+typedef struct _FRAME_NAME
+{
+    struct _FRAME_NAME *Next;
+    PPROFILED_PROCESS Process;
+    ULONG64 Address;
+    CHAR Name[ANYSIZE_ARRAY];
+} FRAME_NAME, *PFRAME_NAME;
+
+typedef struct _FOLDED_STACK
+{
+    struct _FOLDED_STACK *Next;
+    ULONG Count;
+    CHAR Stack[ANYSIZE_ARRAY];
+} FOLDED_STACK, *PFOLDED_STACK;
+
+/* The kernel walks user stacks after the sample, and logs them separately */
+typedef struct _USER_STACK
+{
+    struct _USER_STACK *Next;
+    ULONG SampleId;
+    ULONG FrameCount;
+    ULONG64 Frames[ANYSIZE_ARRAY];
+} USER_STACK, *PUSER_STACK;
+
+static PROFILED_PROCESS KernelProcess = { NULL, 0, "kernel" };
+static PPROFILED_PROCESS ProcessList;
+static PFRAME_NAME FrameNames[HASH_BUCKETS];
+static PFOLDED_STACK FoldedStacks[HASH_BUCKETS];
+static PUSER_STACK UserStacks[HASH_BUCKETS];
+static HANDLE StopEvent;
+
+static
+ULONG
+HashBytes(
+    _In_ const VOID *Data,
+    _In_ SIZE_T Length,
+    _In_ ULONG Hash)
+{
+    const UCHAR *Bytes = Data;
+
+    while (Length--)
+        Hash = Hash * 33 + *Bytes++;
+
+    return Hash;
+}
+
+static
+PVOID
+QueryInformation(
+    _In_ SYSTEM_INFORMATION_CLASS InformationClass,
+    _Out_ PNTSTATUS Status)
+{
+    PVOID Buffer = NULL;
+    ULONG Length = 0x4000;
+
+    /* The lists can grow between two calls, so retry until the buffer is big enough */
+    for (;;)
+    {
+        free(Buffer);
+        Buffer = malloc(Length);
+        if (!Buffer)
+        {
+            *Status = STATUS_NO_MEMORY;
+            return NULL;
+        }
+
+        *Status = NtQuerySystemInformation(InformationClass, Buffer, Length, &Length);
+        if (*Status != STATUS_INFO_LENGTH_MISMATCH)
+            break;
+
+        Length += 0x1000;
+    }
+
+    if (!NT_SUCCESS(*Status))
+    {
+        free(Buffer);
+        Buffer = NULL;
+    }
+
+    return Buffer;
+}
+
+static
+PRTL_PROCESS_MODULES
+CopyModules(
+    _In_ PRTL_PROCESS_MODULES Modules)
+{
+    PRTL_PROCESS_MODULES Copy;
+    SIZE_T Size;
+
+    Size = FIELD_OFFSET(RTL_PROCESS_MODULES, Modules[Modules->NumberOfModules]);
+    Copy = malloc(Size);
+    if (Copy)
+        memcpy(Copy, Modules, Size);
+
+    return Copy;
+}
+
+static
+VOID
+QueryProcessModules(
+    _Inout_ PPROFILED_PROCESS Process)
+{
+    PRTL_DEBUG_INFORMATION DebugBuffer;
+    PRTL_PROCESS_MODULES Modules;
+
+    DebugBuffer = RtlCreateQueryDebugBuffer(0, FALSE);
+    if (!DebugBuffer)
+        return;
+
+    /* Keep what we had if the process is gone by now */
+    if (NT_SUCCESS(RtlQueryProcessDebugInformation(Process->ProcessId,
+                                                   RTL_DEBUG_QUERY_MODULES,
+                                                   DebugBuffer)) &&
+        DebugBuffer->Modules)
+    {
+        Modules = CopyModules(DebugBuffer->Modules);
+        if (Modules)
+        {
+            free(Process->Modules);
+            Process->Modules = Modules;
+        }
+    }
+
+    RtlDestroyQueryDebugBuffer(DebugBuffer);
+}
+
+static
+PPROFILED_PROCESS
+FindProcess(
+    _In_ ULONG ProcessId)
+{
+    PPROFILED_PROCESS Process;
+
+    for (Process = ProcessList; Process; Process = Process->Next)
+    {
+        if (Process->ProcessId == ProcessId)
+            return Process;
+    }
+
+    return NULL;
+}
+
+/*
+ * Module lists have to be taken while the processes are alive, so this runs
+ * every second while sampling. Processes that come and go in between only
+ * get raw addresses.
+ */
+static
+VOID
+UpdateProcesses(
+    _In_ BOOL RefreshModules)
+{
+    PSYSTEM_PROCESS_INFORMATION Info;
+    PPROFILED_PROCESS Process;
+    PVOID Buffer;
+    NTSTATUS Status;
+    ULONG ProcessId;
+
+    Buffer = QueryInformation(SystemProcessInformation, &Status);
+    if (!Buffer)
+        return;
+
+    for (Info = Buffer; ; Info = (PSYSTEM_PROCESS_INFORMATION)((PUCHAR)Info + Info->NextEntryOffset))
+    {
+        ProcessId = HandleToUlong(Info->UniqueProcessId);
+        Process = FindProcess(ProcessId);
+        if (!Process)
+        {
+            Process = calloc(1, sizeof(*Process));
+            if (!Process)
+                break;
+
+            Process->ProcessId = ProcessId;
+            if (Info->ImageName.Buffer)
+            {
+                _snprintf(Process->ImageName, sizeof(Process->ImageName) - 1, "%wZ", &Info->ImageName);
+            }
+            else
+            {
+                strcpy(Process->ImageName, ProcessId ? "System" : "Idle");
+            }
+
+            Process->Next = ProcessList;
+            ProcessList = Process;
+            QueryProcessModules(Process);
+        }
+        else if (RefreshModules)
+        {
+            QueryProcessModules(Process);
+        }
+
+        if (!Info->NextEntryOffset)
+            break;
+    }
+
+    free(Buffer);
+}
+
+static
+VOID
+QueryKernelModules(VOID)
+{
+    PRTL_PROCESS_MODULES Modules;
+    NTSTATUS Status;
+
+    Modules = QueryInformation(SystemModuleInformation, &Status);
+    if (!Modules)
+    {
+        fprintf(stderr, "Failed to query the kernel modules: 0x%08lx\n", Status);
+        return;
+    }
+
+    KernelProcess.Modules = CopyModules(Modules);
+    free(Modules);
+}
+
+static
+VOID
+GetModulePath(
+    _In_ PRTL_PROCESS_MODULE_INFORMATION Module,
+    _Out_writes_(PathLength) PSTR Path,
+    _In_ ULONG PathLength)
+{
+    PCSTR FullPath = (PCSTR)Module->FullPathName;
+    CHAR WindowsDirectory[MAX_PATH];
+
+    /* Kernel modules come with NT paths */
+    if (!_strnicmp(FullPath, "\\SystemRoot\\", 12))
+    {
+        GetWindowsDirectoryA(WindowsDirectory, _countof(WindowsDirectory));
+        _snprintf(Path, PathLength, "%s\\%s", WindowsDirectory, FullPath + 12);
+    }
+    else if (!strncmp(FullPath, "\\??\\", 4))
+    {
+        _snprintf(Path, PathLength, "%s", FullPath + 4);
+    }
+    else
+    {
+        _snprintf(Path, PathLength, "%s", FullPath);
+    }
+    Path[PathLength - 1] = ANSI_NULL;
+}
+
+static
+VOID
+LoadSymbols(
+    _Inout_ PPROFILED_PROCESS Process)
+{
+    PRTL_PROCESS_MODULE_INFORMATION Module;
+    CHAR Path[MAX_PATH];
+    ULONG i;
+
+    /* The process doesn't need to be around, so any unique value does as a handle */
+    Process->SymbolsLoaded = SymInitialize((HANDLE)Process, NULL, FALSE);
+    if (!Process->SymbolsLoaded || !Process->Modules)
+        return;
+
+    for (i = 0; i < Process->Modules->NumberOfModules; i++)
+    {
+        Module = &Process->Modules->Modules[i];
+        GetModulePath(Module, Path, sizeof(Path));
+        SymLoadModuleEx((HANDLE)Process,
+                        NULL,
+                        Path,
+                        NULL,
+                        (ULONG_PTR)Module->ImageBase,
+                        Module->ImageSize,
+                        NULL,
+                        0);
+    }
+}
+
+static
+VOID
+ResolveAddress(
+    _Inout_ PPROFILED_PROCESS Process,
+    _In_ ULONG64 Address,
+    _Out_writes_(NameLength) PSTR Name,
+    _In_ ULONG NameLength)
+{
+    PRTL_PROCESS_MODULE_INFORMATION Module = NULL;
+    UCHAR SymbolBuffer[sizeof(SYMBOL_INFO) + MAX_FRAME_NAME];
+    PSYMBOL_INFO Symbol = (PSYMBOL_INFO)SymbolBuffer;
+    DWORD64 Displacement;
+    PCSTR ModuleName;
+    ULONG i;
+
+    if (Process->Modules)
+    {
+        for (i = 0; i < Process->Modules->NumberOfModules; i++)
+        {
+            Module = &Process->Modules->Modules[i];
+            if ((Address >= (ULONG_PTR)Module->ImageBase) &&
+                (Address < (ULONG_PTR)Module->ImageBase + Module->ImageSize))
+            {
+                break;
+            }
+            Module = NULL;
+        }
+    }
+
+    if (!Module)
+    {
+        _snprintf(Name, NameLength, "0x%I64x", Address);
+        Name[NameLength - 1] = ANSI_NULL;
+        return;
+    }
+
+    ModuleName = (PCSTR)Module->FullPathName + Module->OffsetToFileName;
+
+    if (!Process->SymbolsLoaded)
+        LoadSymbols(Process);
+
+    ZeroMemory(SymbolBuffer, sizeof(SymbolBuffer));
+    Symbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+    Symbol->MaxNameLen = MAX_FRAME_NAME;
+    if (Process->SymbolsLoaded &&
+        SymFromAddr((HANDLE)Process, Address, &Displacement, Symbol))
+    {
+        _snprintf(Name, NameLength, "%s!%s", ModuleName, Symbol->Name);
+    }
+    else
+    {
+        _snprintf(Name, NameLength, "%s+0x%I64x", ModuleName, Address - (ULONG_PTR)Module->ImageBase);
+    }
+    Name[NameLength - 1] = ANSI_NULL;
+}
+
+static
+PCSTR
+GetFrameName(
+    _Inout_ PPROFILED_PROCESS Process,
+    _In_ ULONG64 Address)
+{
+    CHAR Name[MAX_FRAME_NAME + 64];
+    PFRAME_NAME Entry;
+    ULONG Bucket;
+    SIZE_T Length;
+
+    /* Resolving is slow and every hot address comes back many times */
+    Bucket = HashBytes(&Address, sizeof(Address), HashBytes(&Process, sizeof(Process), 5381)) % HASH_BUCKETS;
+    for (Entry = FrameNames[Bucket]; Entry; Entry = Entry->Next)
+    {
+        if ((Entry->Process == Process) && (Entry->Address == Address))
+            return Entry->Name;
+    }
+
+    ResolveAddress(Process, Address, Name, sizeof(Name));
+
+    /* The folded format uses these as separators */
+    for (Length = 0; Name[Length]; Length++)
+    {
+        if ((Name[Length] == ';') || (Name[Length] == ' '))
+            Name[Length] = '_';
+    }
+
+    Entry = malloc(FIELD_OFFSET(FRAME_NAME, Name[Length + 1]));
+    if (!Entry)
+        return "?";
+
+    Entry->Process = Process;
+    Entry->Address = Address;
+    memcpy(Entry->Name, Name, Length + 1);
+    Entry->Next = FrameNames[Bucket];
+    FrameNames[Bucket] = Entry;
+    return Entry->Name;
+}
+
+static
+VOID
+AppendFrame(
+    _Inout_ PSTR Stack,
+    _Inout_ PSIZE_T Length,
+    _In_ SIZE_T MaxLength,
+    _In_ PCSTR Name)
+{
+    SIZE_T NameLength = strlen(Name);
+
+    if (*Length + NameLength + 2 > MaxLength)
+        return;
+
+    if (*Length)
+        Stack[(*Length)++] = ';';
+    memcpy(Stack + *Length, Name, NameLength + 1);
+    *Length += NameLength;
+}
+
+static
+VOID
+AddUserStack(
+    _In_ PEVENT_TRACE_HEADER Header,
+    _In_ PWMI_SAMPLED_USER_STACK_EVENT UserStack)
+{
+    PUSER_STACK Entry;
+    ULONG Bucket;
+
+    if (!UserStack->FrameCount ||
+        (UserStack->FrameCount > WMI_SAMPLED_PROFILE_MAX_FRAMES) ||
+        (Header->Size < sizeof(EVENT_TRACE_HEADER) +
+                        FIELD_OFFSET(WMI_SAMPLED_USER_STACK_EVENT, Frames[UserStack->FrameCount])))
+    {
+        return;
+    }
+
+    Entry = malloc(FIELD_OFFSET(USER_STACK, Frames[UserStack->FrameCount]));
+    if (!Entry)
+        return;
+
+    Entry->SampleId = UserStack->SampleId;
+    Entry->FrameCount = UserStack->FrameCount;
+    memcpy(Entry->Frames, UserStack->Frames, UserStack->FrameCount * sizeof(ULONG64));
+
+    Bucket = UserStack->SampleId % HASH_BUCKETS;
+    Entry->Next = UserStacks[Bucket];
+    UserStacks[Bucket] = Entry;
+}
+
+static
+PUSER_STACK
+FindUserStack(
+    _In_ ULONG SampleId)
+{
+    PUSER_STACK Entry;
+
+    for (Entry = UserStacks[SampleId % HASH_BUCKETS]; Entry; Entry = Entry->Next)
+    {
+        if (Entry->SampleId == SampleId)
+            return Entry;
+    }
+
+    return NULL;
+}
+
+static
+VOID
+AddSample(
+    _In_ PEVENT_TRACE_HEADER Header,
+    _In_ PWMI_SAMPLED_PROFILE_EVENT Sample)
+{
+    CHAR Stack[2 * WMI_SAMPLED_PROFILE_MAX_FRAMES * (MAX_FRAME_NAME + 64)];
+    PPROFILED_PROCESS Process;
+    PFOLDED_STACK Entry;
+    PUSER_STACK UserStack;
+    PULONG64 UserFrames;
+    SIZE_T Length = 0;
+    ULONG Frames, UserFrameCount, Bucket, i;
+
+    Frames = Sample->KernelFrames + Sample->UserFrames;
+    if (!Frames ||
+        (Frames > WMI_SAMPLED_PROFILE_MAX_FRAMES) ||
+        (Header->Size < sizeof(EVENT_TRACE_HEADER) + FIELD_OFFSET(WMI_SAMPLED_PROFILE_EVENT, Frames[Frames])))
+    {
+        return;
+    }
+
+    /* Without a walked user stack, the interrupted user address has to do */
+    UserFrames = Sample->Frames + Sample->KernelFrames;
+    UserFrameCount = Sample->UserFrames;
+    UserStack = UserFrameCount ? FindUserStack(Sample->SampleId) : NULL;
+    if (UserStack)
+    {
+        UserFrames = UserStack->Frames;
+        UserFrameCount = UserStack->FrameCount;
+    }
+
+    Process = FindProcess(Header->ProcessId);
+    AppendFrame(Stack, &Length, sizeof(Stack), Process ? Process->ImageName : "?");
+
+    /* Folded stacks go from the root to the leaf, the sample has it the other way */
+    for (i = UserFrameCount; i > 0; i--)
+    {
+        AppendFrame(Stack, &Length, sizeof(Stack),
+                    Process ? GetFrameName(Process, UserFrames[i - 1]) : "?");
+    }
+    for (i = Sample->KernelFrames; i > 0; i--)
+    {
+        AppendFrame(Stack, &Length, sizeof(Stack), GetFrameName(&KernelProcess, Sample->Frames[i - 1]));
+    }
+
+    Bucket = HashBytes(Stack, Length, 5381) % HASH_BUCKETS;
+    for (Entry = FoldedStacks[Bucket]; Entry; Entry = Entry->Next)
+    {
+        if (!strcmp(Entry->Stack, Stack))
+        {
+            Entry->Count++;
+            return;
+        }
+    }
+
+    Entry = malloc(FIELD_OFFSET(FOLDED_STACK, Stack[Length + 1]));
+    if (!Entry)
+        return;
+
+    Entry->Count = 1;
+    memcpy(Entry->Stack, Stack, Length + 1);
+    Entry->Next = FoldedStacks[Bucket];
+    FoldedStacks[Bucket] = Entry;
+}
+
+/* Walk the buffers of the log file and handle every event of the given type */
+static
+ULONG
+ReadLogFile(
+    _In_ PCWSTR LogFileName,
+    _In_ UCHAR Type)
+{
+    WMI_BUFFER_HEADER FirstHeader;
+    PWMI_BUFFER_HEADER BufferHeader;
+    PEVENT_TRACE_HEADER Header;
+    PUCHAR Buffer;
+    HANDLE File;
+    DWORD Read;
+    ULONG Offset, Events = 0;
+
+    File = CreateFileW(LogFileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+    if (File == INVALID_HANDLE_VALUE)
+    {
+        fprintf(stderr, "Failed to open the log file: %lu\n", GetLastError());
+        return 0;
+    }
+
+    /* All buffers have the size of the first one */
+    if (!ReadFile(File, &FirstHeader, sizeof(FirstHeader), &Read, NULL) ||
+        (Read != sizeof(FirstHeader)) ||
+        (FirstHeader.BufferSize < sizeof(WMI_BUFFER_HEADER)))
+    {
+        fprintf(stderr, "The log file is empty\n");
+        CloseHandle(File);
+        return 0;
+    }
+
+    SetFilePointer(File, 0, NULL, FILE_BEGIN);
+    Buffer = malloc(FirstHeader.BufferSize);
+    if (!Buffer)
+    {
+        CloseHandle(File);
+        return 0;
+    }
+
+    while (ReadFile(File, Buffer, FirstHeader.BufferSize, &Read, NULL) && (Read == FirstHeader.BufferSize))
+    {
+        BufferHeader = (PWMI_BUFFER_HEADER)Buffer;
+        if (BufferHeader->SavedOffset > FirstHeader.BufferSize)
+            continue;
+
+        for (Offset = sizeof(WMI_BUFFER_HEADER);
+             Offset + sizeof(EVENT_TRACE_HEADER) <= BufferHeader->SavedOffset;
+             Offset += (Header->Size + 7) & ~7)
+        {
+            Header = (PEVENT_TRACE_HEADER)(Buffer + Offset);
+            if ((Header->Size < sizeof(EVENT_TRACE_HEADER)) ||
+                (Offset + Header->Size > BufferHeader->SavedOffset))
+            {
+                break;
+            }
+
+            if (IsEqualGUID(&Header->Guid, &LogFileHeaderGuid))
+                continue;
+
+            if (!IsEqualGUID(&Header->Guid, &PerfInfoGuid) || (Header->Class.Type != Type))
+                continue;
+
+            if (Type == WMI_TRACE_TYPE_SAMPLED_USER_STACK)
+                AddUserStack(Header, (PWMI_SAMPLED_USER_STACK_EVENT)(Header + 1));
+            else
+                AddSample(Header, (PWMI_SAMPLED_PROFILE_EVENT)(Header + 1));
+            Events++;
+        }
+    }
+
+    free(Buffer);
+    CloseHandle(File);
+    return Events;
+}
+
+static
+VOID
+PrintFoldedStacks(
+    _In_ FILE *Output)
+{
+    PFOLDED_STACK Entry;
+    ULONG i;
+
+    for (i = 0; i < HASH_BUCKETS; i++)
+    {
+        for (Entry = FoldedStacks[i]; Entry; Entry = Entry->Next)
+            fprintf(Output, "%s %lu\n", Entry->Stack, Entry->Count);
+    }
+}
+
+static
+VOID
+InitProperties(
+    _Out_ PTRACE_PROPERTIES Properties,
+    _In_opt_ PCWSTR LogFileName)
+{
+    ZeroMemory(Properties, sizeof(*Properties));
+    Properties->Properties.Wnode.BufferSize = sizeof(*Properties);
+    Properties->Properties.Wnode.Flags = WNODE_FLAG_TRACED_GUID;
+    Properties->Properties.Wnode.ClientContext = 1;
+    Properties->Properties.Wnode.Guid = SystemTraceControlGuid;
+    Properties->Properties.LoggerNameOffset = FIELD_OFFSET(TRACE_PROPERTIES, LoggerName);
+    Properties->Properties.LogFileNameOffset = FIELD_OFFSET(TRACE_PROPERTIES, LogFileName);
+    Properties->Properties.LogFileMode = EVENT_TRACE_FILE_MODE_SEQUENTIAL;
+    Properties->Properties.EnableFlags = EVENT_TRACE_FLAG_PROFILE;
+    Properties->Properties.BufferSize = 64;
+    Properties->Properties.MaximumBuffers = 256;
+    Properties->Properties.FlushTimer = 1;
+    if (LogFileName)
+        wcsncpy(Properties->LogFileName, LogFileName, _countof(Properties->LogFileName) - 1);
+}
+
+static
+BOOL
+WINAPI
+CtrlHandler(
+    _In_ DWORD CtrlType)
+{
+    /* Stop sampling, the kernel logger must not be left running */
+    SetEvent(StopEvent);
+    return TRUE;
+}
+
+static
+VOID
+PrintUsage(VOID)
+{
+    printf("Samples kernel and user call stacks and prints them folded for flamegraph.pl.\n\n"
+           "STACKPROF [-f hertz] [-t seconds] [-o file] [-l file] [command line]\n\n"
+           "  -f hertz    Sampling frequency, %u by default. The HAL may round it.\n"
+           "  -t seconds  How long to sample when no command is given, %u by default.\n"
+           "  -o file     Write the folded stacks to a file instead of the console.\n"
+           "  -l file     Keep the kernel logger's log file.\n\n"
+           "With a command line, samples until the command exits. Press Ctrl+C to\n"
+           "stop early. Requires the SeSystemProfilePrivilege.\n",
+           DEFAULT_FREQUENCY, DEFAULT_DURATION);
+}
+
+int wmain(int argc, WCHAR *argv[])
+{
+    TRACE_PROPERTIES Properties;
+    TRACEHANDLE SessionHandle = 0;
+    STARTUPINFOW StartupInfo;
+    PROCESS_INFORMATION ProcessInfo = { NULL };
+    WCHAR TempPath[MAX_PATH], LogFileName[MAX_PATH] = L"";
+    PCWSTR OutputFileName = NULL;
+    PWSTR CommandLine = NULL;
+    ULONG Frequency = DEFAULT_FREQUENCY, Duration = DEFAULT_DURATION;
+    ULONG OldInterval = 0, Samples, Error;
+    HANDLE Waits[2];
+    DWORD Start, Result;
+    BOOL KeepLog = FALSE;
+    BOOLEAN Enabled;
+    FILE *Output = stdout;
+    NTSTATUS Status;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if ((argv[i][0] != '-' && argv[i][0] != '/') || !argv[i][1] || argv[i][2])
+            break;
+
+        if (i + 1 >= argc)
+        {
+            PrintUsage();
+            return 1;
+        }
+
+        switch (argv[i][1])
+        {
+            case 'f':
+                Frequency = wcstoul(argv[++i], NULL, 10);
+                break;
+            case 't':
+                Duration = wcstoul(argv[++i], NULL, 10);
+                break;
+            case 'o':
+                OutputFileName = argv[++i];
+                break;
+            case 'l':
+                wcsncpy(LogFileName, argv[++i], _countof(LogFileName) - 1);
+                KeepLog = TRUE;
+                break;
+            default:
+                PrintUsage();
+                return 1;
+        }
+    }
+
+    if (!Frequency || !Duration)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    /* Hand the rest of our command line to the command as is */
+    if (i < argc)
+    {
+        CommandLine = wcsstr(GetCommandLineW(), argv[i]);
+        if (!CommandLine)
+            CommandLine = argv[i];
+    }
+
+    Status = RtlAdjustPrivilege(SE_SYSTEM_PROFILE_PRIVILEGE, TRUE, FALSE, &Enabled);
+    if (!NT_SUCCESS(Status))
+    {
+        fprintf(stderr, "SeSystemProfilePrivilege is not held: 0x%08lx\n", Status);
+        return 1;
+    }
+
+    /* Reading the module lists of other users' processes needs this one */
+    RtlAdjustPrivilege(SE_DEBUG_PRIVILEGE, TRUE, FALSE, &Enabled);
+
+    if (!KeepLog)
+    {
+        GetTempPathW(_countof(TempPath), TempPath);
+        GetTempFileNameW(TempPath, L"spf", 0, LogFileName);
+    }
+
+    StopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    SetConsoleCtrlHandler(CtrlHandler, TRUE);
+    SymSetOptions(SYMOPT_UNDNAME | SYMOPT_DEFERRED_LOADS);
+
+    QueryKernelModules();
+    UpdateProcesses(FALSE);
+
+    /* The samples come from the profile interrupt, at the ProfileTime interval */
+    NtQueryIntervalProfile(ProfileTime, &OldInterval);
+    NtSetIntervalProfile(10000000 / Frequency, ProfileTime);
+
+    InitProperties(&Properties, LogFileName);
+    Error = StartTraceW(&SessionHandle, KERNEL_LOGGER_NAMEW, &Properties.Properties);
+    if (Error != ERROR_SUCCESS)
+    {
+        if (Error == ERROR_ALREADY_EXISTS)
+            fprintf(stderr, "The NT Kernel Logger is already running\n");
+        else
+            fprintf(stderr, "Failed to start the NT Kernel Logger: %lu\n", Error);
+        goto Cleanup;
+    }
+
+    if (CommandLine)
+    {
+        ZeroMemory(&StartupInfo, sizeof(StartupInfo));
+        StartupInfo.cb = sizeof(StartupInfo);
+        if (!CreateProcessW(NULL, CommandLine, NULL, NULL, FALSE, 0, NULL, NULL,
+                            &StartupInfo, &ProcessInfo))
+        {
+            fprintf(stderr, "Failed to start '%S': %lu\n", CommandLine, GetLastError());
+        }
+    }
+
+    /* Pick up new processes and modules while they are still around */
+    Waits[0] = StopEvent;
+    Waits[1] = ProcessInfo.hProcess;
+    Start = GetTickCount();
+    for (;;)
+    {
+        Result = WaitForMultipleObjects(ProcessInfo.hProcess ? 2 : 1, Waits, FALSE, 1000);
+        if (Result != WAIT_TIMEOUT)
+            break;
+
+        UpdateProcesses(FALSE);
+        if (!ProcessInfo.hProcess && (GetTickCount() - Start >= Duration * 1000))
+            break;
+    }
+
+    UpdateProcesses(TRUE);
+
+    InitProperties(&Properties, NULL);
+    Error = ControlTraceW(SessionHandle, NULL, &Properties.Properties, EVENT_TRACE_CONTROL_STOP);
+    if (Error != ERROR_SUCCESS)
+    {
+        fprintf(stderr, "Failed to stop the NT Kernel Logger: %lu\n", Error);
+        goto Cleanup;
+    }
+
+    if (OutputFileName)
+    {
+        Output = _wfopen(OutputFileName, L"w");
+        if (!Output)
+        {
+            fprintf(stderr, "Failed to create '%S'\n", OutputFileName);
+            goto Cleanup;
+        }
+    }
+
+    /* The buffers of different processors can come in any order */
+    ReadLogFile(LogFileName, WMI_TRACE_TYPE_SAMPLED_USER_STACK);
+    Samples = ReadLogFile(LogFileName, WMI_TRACE_TYPE_SAMPLED_PROFILE);
+    PrintFoldedStacks(Output);
+    fprintf(stderr, "%lu samples in %lu ms, %lu events lost\n",
+            Samples, GetTickCount() - Start, Properties.Properties.EventsLost);
+
+    if (Output != stdout)
+        fclose(Output);
+
+Cleanup:
+    if (OldInterval)
+        NtSetIntervalProfile(OldInterval, ProfileTime);
+    if (ProcessInfo.hProcess)
+    {
+        CloseHandle(ProcessInfo.hThread);
+        CloseHandle(ProcessInfo.hProcess);
+    }
+    if (!KeepLog)
+        DeleteFileW(LogFileName);
+    CloseHandle(StopEvent);
+    return 0;
+}
@@ -0,0 +1,273 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     LGPL-2.1+ (https://spdx.org/licenses/LGPL-2.1+)
+ * PURPOSE:     Test for StartTrace/TraceEvent/ControlTrace
+ */
+
+#include "precomp.h"
+
+#include <wmistr.h>
+#include <evntrace.h>
+#include <wmiioctl.h>
+#include <ndk/setypes.h>
+
+#define BENCH_ROUNDS 4096
+#define SESSION_NAME L"ReactOS TraceEvent Test"
+
+/* EventTraceGuid, which identifies the logfile header event */
+static const GUID LogFileHeaderGuid = {0x68fdd900, 0x4a3e, 0x11d1, {0x84, 0xf4, 0x00, 0x00, 0xf8, 0x04, 0x64, 0xe3}};
+static const GUID TestProviderGuid = {0x5c5b3c6e, 0x31d1, 0x4f3c, {0x8e, 0x2a, 0x64, 0x8b, 0x15, 0xe9, 0x70, 0x42}};
+
+typedef struct _TEST_EVENT
+{
+    EVENT_TRACE_HEADER Header;
+    ULONG Sequence;
+} TEST_EVENT, *PTEST_EVENT;
+
+typedef struct _TEST_PROPERTIES
+{
+    EVENT_TRACE_PROPERTIES Properties;
+    WCHAR LoggerName[64];
+    WCHAR LogFileName[MAX_PATH];
+} TEST_PROPERTIES, *PTEST_PROPERTIES;
+
+static TRACEHANDLE LoggerHandle;
+static BOOLEAN ProviderEnabled;
+static HANDLE ControlEvent;
+
+static
+ULONG
+WINAPI
+ControlCallback(
+    _In_ WMIDPREQUESTCODE RequestCode,
+    _In_ PVOID Context,
+    _Inout_ ULONG *BufferSize,
+    _Inout_ PVOID Buffer)
+{
+    if (RequestCode == WMI_ENABLE_EVENTS)
+    {
+        LoggerHandle = GetTraceLoggerHandle(Buffer);
+        ProviderEnabled = TRUE;
+    }
+    else if (RequestCode == WMI_DISABLE_EVENTS)
+    {
+        ProviderEnabled = FALSE;
+    }
+
+    SetEvent(ControlEvent);
+    return ERROR_SUCCESS;
+}
+
+static
+void
+InitProperties(
+    _Out_ PTEST_PROPERTIES Properties,
+    _In_opt_ PCWSTR LogFileName)
+{
+    ZeroMemory(Properties, sizeof(*Properties));
+    Properties->Properties.Wnode.BufferSize = sizeof(*Properties);
+    Properties->Properties.Wnode.Flags = WNODE_FLAG_TRACED_GUID;
+    Properties->Properties.Wnode.ClientContext = 1;
+    Properties->Properties.LoggerNameOffset = FIELD_OFFSET(TEST_PROPERTIES, LoggerName);
+    Properties->Properties.LogFileNameOffset = FIELD_OFFSET(TEST_PROPERTIES, LogFileName);
+    Properties->Properties.LogFileMode = EVENT_TRACE_FILE_MODE_SEQUENTIAL;
+    Properties->Properties.BufferSize = 16;
+    if (LogFileName)
+        StringCchCopyW(Properties->LogFileName, _countof(Properties->LogFileName), LogFileName);
+}
+
+/* Walk the buffers of a log file and count the events of the test provider */
+static
+void
+CheckLogFile(
+    _In_ PCWSTR LogFileName,
+    _In_ ULONG Expected)
+{
+    HANDLE File;
+    PUCHAR Buffer;
+    DWORD Read;
+    ULONG BufferSize = 16 * 1024, BufferCount = 0, Offset, Count = 0;
+    PWMI_BUFFER_HEADER BufferHeader;
+    PEVENT_TRACE_HEADER Header;
+    PWMI_LOGFILE_HEADER LogFileHeader;
+
+    File = CreateFileW(LogFileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+    ok(File != INVALID_HANDLE_VALUE, "CreateFileW failed with %lu\n", GetLastError());
+    if (File == INVALID_HANDLE_VALUE)
+        return;
+
+    Buffer = HeapAlloc(GetProcessHeap(), 0, BufferSize);
+    while (ReadFile(File, Buffer, BufferSize, &Read, NULL) && Read == BufferSize)
+    {
+        BufferHeader = (PWMI_BUFFER_HEADER)Buffer;
+        ok(BufferHeader->BufferSize == BufferSize, "Buffer %lu has size %lu\n", BufferCount, BufferHeader->BufferSize);
+        ok(BufferHeader->SavedOffset <= BufferSize, "Buffer %lu uses %lu bytes\n", BufferCount, BufferHeader->SavedOffset);
+        if (BufferHeader->SavedOffset > BufferSize)
+            break;
+
+        /* The first buffer describes the session */
+        if (BufferCount == 0)
+        {
+            Header = (PEVENT_TRACE_HEADER)(BufferHeader + 1);
+            LogFileHeader = (PWMI_LOGFILE_HEADER)(Header + 1);
+            ok(IsEqualGUID(&Header->Guid, &LogFileHeaderGuid), "Unexpected first event\n");
+            ok(LogFileHeader->Version == WMI_LOGFILE_VERSION, "Version is %lu\n", LogFileHeader->Version);
+            ok(LogFileHeader->BufferSize == BufferSize, "BufferSize is %lu\n", LogFileHeader->BufferSize);
+            ok(LogFileHeader->PointerSize == sizeof(PVOID), "PointerSize is %lu\n", LogFileHeader->PointerSize);
+            ok(LogFileHeader->EventsLost == 0, "EventsLost is %lu\n", LogFileHeader->EventsLost);
+        }
+
+        for (Offset = sizeof(WMI_BUFFER_HEADER);
+             Offset + sizeof(EVENT_TRACE_HEADER) <= BufferHeader->SavedOffset;
+             Offset += (Header->Size + 7) & ~7)
+        {
+            Header = (PEVENT_TRACE_HEADER)(Buffer + Offset);
+            if (Header->Size < sizeof(EVENT_TRACE_HEADER))
+            {
+                ok(0, "Buffer %lu has a %u byte event at %lu\n", BufferCount, Header->Size, Offset);
+                break;
+            }
+
+            if (IsEqualGUID(&Header->Guid, &TestProviderGuid) &&
+                Header->Size == sizeof(TEST_EVENT))
+            {
+                Count++;
+            }
+        }
+
+        BufferCount++;
+    }
+
+    ok(BufferCount > 1, "Got %lu buffers\n", BufferCount);
+    ok(Count == Expected, "Got %lu events, expected %lu\n", Count, Expected);
+
+    HeapFree(GetProcessHeap(), 0, Buffer);
+    CloseHandle(File);
+}
+
+static
+void
+TestTraceSession(void)
+{
+    TEST_PROPERTIES Properties;
+    TRACE_GUID_REGISTRATION GuidRegistration;
+    TRACEHANDLE SessionHandle = 0, OtherHandle, RegistrationHandle = 0;
+    TEST_EVENT Event;
+    WCHAR TempPath[MAX_PATH], LogFileName[MAX_PATH];
+    BOOLEAN WasEnabled;
+    LARGE_INTEGER Start, End, Frequency;
+    NTSTATUS Status;
+    ULONG Error, i;
+
+    Status = RtlAdjustPrivilege(SE_SYSTEM_PROFILE_PRIVILEGE, TRUE, FALSE, &WasEnabled);
+    if (!NT_SUCCESS(Status))
+    {
+        skip("SeSystemProfilePrivilege is not held\n");
+        return;
+    }
+
+    GetTempPathW(_countof(TempPath), TempPath);
+    GetTempFileNameW(TempPath, L"etl", 0, LogFileName);
+
+    /* Session control needs a properly sized WNODE */
+    InitProperties(&Properties, LogFileName);
+    Properties.Properties.Wnode.BufferSize = sizeof(WNODE_HEADER);
+    Error = StartTraceW(&SessionHandle, SESSION_NAME, &Properties.Properties);
+    ok(Error == ERROR_BAD_LENGTH, "StartTraceW returned %lu\n", Error);
+
+    InitProperties(&Properties, LogFileName);
+    Error = StartTraceW(&SessionHandle, SESSION_NAME, &Properties.Properties);
+    ok(Error == ERROR_SUCCESS, "StartTraceW failed with %lu\n", Error);
+    if (Error != ERROR_SUCCESS)
+        goto Cleanup;
+
+    /* Session names are unique */
+    InitProperties(&Properties, LogFileName);
+    Error = StartTraceW(&OtherHandle, SESSION_NAME, &Properties.Properties);
+    ok(Error == ERROR_ALREADY_EXISTS, "StartTraceW returned %lu\n", Error);
+
+    ControlEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+    GuidRegistration.Guid = &TestProviderGuid;
+    GuidRegistration.RegHandle = NULL;
+    Error = RegisterTraceGuidsW(ControlCallback,
+                                NULL,
+                                &TestProviderGuid,
+                                1,
+                                &GuidRegistration,
+                                NULL,
+                                NULL,
+                                &RegistrationHandle);
+    ok(Error == ERROR_SUCCESS, "RegisterTraceGuidsW failed with %lu\n", Error);
+
+    Error = EnableTrace(TRUE, 0, TRACE_LEVEL_INFORMATION, &TestProviderGuid, SessionHandle);
+    ok(Error == ERROR_SUCCESS, "EnableTrace failed with %lu\n", Error);
+    ok(WaitForSingleObject(ControlEvent, 5000) == WAIT_OBJECT_0, "Provider was not notified\n");
+    ok(ProviderEnabled, "Provider is not enabled\n");
+    ok(GetTraceEnableLevel(LoggerHandle) == TRACE_LEVEL_INFORMATION, "Unexpected enable level\n");
+
+    ZeroMemory(&Event, sizeof(Event));
+    Event.Header.Size = sizeof(Event);
+    Event.Header.Flags = WNODE_FLAG_TRACED_GUID;
+    Event.Header.Guid = TestProviderGuid;
+    Event.Header.Class.Type = EVENT_TRACE_TYPE_INFO;
+
+    /* Rough per event cost, the writer never leaves the calling thread */
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < BENCH_ROUNDS; i++)
+    {
+        Event.Sequence = i;
+        Error = TraceEvent(LoggerHandle, &Event.Header);
+        if (Error != ERROR_SUCCESS)
+            break;
+    }
+    QueryPerformanceCounter(&End);
+    ok(i == BENCH_ROUNDS, "Event %lu: TraceEvent failed with %lu\n", i, Error);
+    trace("%lu events: %I64u ns per event\n",
+          i, (End.QuadPart - Start.QuadPart) * 1000000000 / Frequency.QuadPart / max(i, 1));
+
+    /* Events too small to hold a header are refused */
+    Event.Header.Size = sizeof(EVENT_TRACE_HEADER) - 1;
+    Error = TraceEvent(LoggerHandle, &Event.Header);
+    ok(Error == ERROR_INVALID_PARAMETER, "TraceEvent returned %lu\n", Error);
+
+    InitProperties(&Properties, NULL);
+    Error = FlushTraceW(SessionHandle, NULL, &Properties.Properties);
+    ok(Error == ERROR_SUCCESS, "FlushTraceW failed with %lu\n", Error);
+
+    InitProperties(&Properties, NULL);
+    Error = QueryTraceW(SessionHandle, NULL, &Properties.Properties);
+    ok(Error == ERROR_SUCCESS, "QueryTraceW failed with %lu\n", Error);
+    ok(Properties.Properties.BuffersWritten > 0, "BuffersWritten is %lu\n", Properties.Properties.BuffersWritten);
+    ok(Properties.Properties.EventsLost == 0, "EventsLost is %lu\n", Properties.Properties.EventsLost);
+    ok(wcscmp(Properties.LoggerName, SESSION_NAME) == 0, "LoggerName is %S\n", Properties.LoggerName);
+
+    Error = EnableTrace(FALSE, 0, 0, &TestProviderGuid, SessionHandle);
+    ok(Error == ERROR_SUCCESS, "EnableTrace failed with %lu\n", Error);
+    ok(WaitForSingleObject(ControlEvent, 5000) == WAIT_OBJECT_0, "Provider was not notified\n");
+    ok(!ProviderEnabled, "Provider is still enabled\n");
+
+    InitProperties(&Properties, NULL);
+    Error = StopTraceW(SessionHandle, NULL, &Properties.Properties);
+    ok(Error == ERROR_SUCCESS, "StopTraceW failed with %lu\n", Error);
+
+    /* A stopped session is gone */
+    InitProperties(&Properties, NULL);
+    Error = QueryTraceW(SessionHandle, NULL, &Properties.Properties);
+    ok(Error == ERROR_WMI_INSTANCE_NOT_FOUND, "QueryTraceW returned %lu\n", Error);
+
+    UnregisterTraceGuids(RegistrationHandle);
+    CloseHandle(ControlEvent);
+
+    CheckLogFile(LogFileName, BENCH_ROUNDS);
+
+Cleanup:
+    DeleteFileW(LogFileName);
+    if (!WasEnabled)
+        RtlAdjustPrivilege(SE_SYSTEM_PROFILE_PRIVILEGE, FALSE, FALSE, &WasEnabled);
+}
+
+START_TEST(TraceEvent)
+{
+    TestTraceSession();
+}
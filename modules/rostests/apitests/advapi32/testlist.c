@@ -20,6 +20,7 @@ extern void func_SaferIdentifyLevel(void);
 extern void func_ServiceArgs(void);
 extern void func_ServiceEnv(void);
 extern void func_ServiceNetwork(void);
+extern void func_TraceEvent(void);
 
 const struct test winetest_testlist[] =
 {
@@ -40,6 +41,7 @@ const struct test winetest_testlist[] =
     { "ServiceArgs", func_ServiceArgs },
     { "ServiceEnv", func_ServiceEnv },
     { "ServiceNetwork", func_ServiceNetwork },
+    { "TraceEvent", func_TraceEvent },
     { 0, 0 }
 };
 
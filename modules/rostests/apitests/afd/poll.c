@@ -0,0 +1,246 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     LGPL-2.1+ (https://spdx.org/licenses/LGPL-2.1+)
+ * PURPOSE:     Test for IOCTL_AFD_REGISTER_POLL/IOCTL_AFD_WAIT_POLL
+ */
+
+#include "precomp.h"
+
+#define SOCKET_COUNT 64
+#define BENCH_ROUNDS 256
+#define BASE_PORT 28100
+
+static
+NTSTATUS
+RegisterPoll(
+    _In_ HANDLE SetHandle,
+    _In_ HANDLE SocketHandle,
+    _In_ ULONG Events,
+    _In_opt_ PVOID Context)
+{
+    IO_STATUS_BLOCK IoStatus;
+    AFD_POLL_REGISTER_INFO RegisterInfo;
+
+    RegisterInfo.Handle = (SOCKET)SocketHandle;
+    RegisterInfo.Events = Events;
+    RegisterInfo.Context = Context;
+
+    /* Registration never pends */
+    return NtDeviceIoControlFile(SetHandle,
+                                 NULL,
+                                 NULL,
+                                 NULL,
+                                 &IoStatus,
+                                 IOCTL_AFD_REGISTER_POLL,
+                                 &RegisterInfo,
+                                 sizeof(RegisterInfo),
+                                 NULL,
+                                 0);
+}
+
+static
+NTSTATUS
+WaitPoll(
+    _In_ HANDLE SetHandle,
+    _In_ BOOLEAN Wait,
+    _Out_ PAFD_POLL_EVENT Events,
+    _In_ ULONG Count,
+    _Out_ PULONG Returned)
+{
+    NTSTATUS Status;
+    IO_STATUS_BLOCK IoStatus;
+    AFD_POLL_WAIT_INFO WaitInfo;
+    LARGE_INTEGER Timeout;
+    HANDLE Event;
+    PVOID Buffer;
+    ULONG Length = max(Count * sizeof(AFD_POLL_EVENT), sizeof(WaitInfo));
+
+    *Returned = 0;
+
+    Status = NtCreateEvent(&Event,
+                           EVENT_ALL_ACCESS,
+                           NULL,
+                           NotificationEvent,
+                           FALSE);
+    if (!NT_SUCCESS(Status))
+    {
+        return Status;
+    }
+
+    /* Input and output share the buffer */
+    Buffer = RtlAllocateHeap(RtlGetProcessHeap(), 0, Length);
+    if (!Buffer)
+    {
+        NtClose(Event);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    WaitInfo.Flags = Wait ? 0 : AFD_IMMEDIATE;
+    RtlCopyMemory(Buffer, &WaitInfo, sizeof(WaitInfo));
+
+    Status = NtDeviceIoControlFile(SetHandle,
+                                   Event,
+                                   NULL,
+                                   NULL,
+                                   &IoStatus,
+                                   IOCTL_AFD_WAIT_POLL,
+                                   Buffer,
+                                   sizeof(WaitInfo),
+                                   Buffer,
+                                   Count * sizeof(AFD_POLL_EVENT));
+    if (Status == STATUS_PENDING)
+    {
+        /* Don't hang the test if the event never shows up */
+        Timeout.QuadPart = -5 * 10000000LL;
+        if (NtWaitForSingleObject(Event, FALSE, &Timeout) == STATUS_TIMEOUT)
+        {
+            NtCancelIoFile(SetHandle, &IoStatus);
+            NtWaitForSingleObject(Event, FALSE, NULL);
+        }
+        Status = IoStatus.Status;
+    }
+
+    if (Status == STATUS_SUCCESS)
+    {
+        *Returned = (ULONG)IoStatus.Information / sizeof(AFD_POLL_EVENT);
+        RtlCopyMemory(Events, Buffer, *Returned * sizeof(AFD_POLL_EVENT));
+    }
+
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Buffer);
+    NtClose(Event);
+
+    return Status;
+}
+
+static
+void
+TestPoll(void)
+{
+    NTSTATUS Status;
+    HANDLE SetHandle, SenderHandle, EventHandle;
+    HANDLE SocketHandles[SOCKET_COUNT];
+    AFD_POLL_EVENT Events[SOCKET_COUNT + 1];
+    BOOLEAN Seen[SOCKET_COUNT];
+    ULONG Returned, i, Index;
+    CHAR Buffer[16];
+    struct sockaddr_in addr;
+    LARGE_INTEGER Start, End, Frequency;
+
+    RtlZeroMemory(Buffer, sizeof(Buffer));
+
+    Status = AfdCreateSocket(&SetHandle, AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    ok(Status == STATUS_SUCCESS, "AfdCreateSocket failed with %lx\n", Status);
+    Status = AfdCreateSocket(&SenderHandle, AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    ok(Status == STATUS_SUCCESS, "AfdCreateSocket failed with %lx\n", Status);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    addr.sin_port = htons(0);
+    Status = AfdBind(SenderHandle, (const struct sockaddr *)&addr, sizeof(addr));
+    ok(Status == STATUS_SUCCESS, "AfdBind failed with %lx\n", Status);
+
+    for (i = 0; i < SOCKET_COUNT; i++)
+    {
+        Status = AfdCreateSocket(&SocketHandles[i], AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        ok(Status == STATUS_SUCCESS, "AfdCreateSocket failed with %lx\n", Status);
+
+        addr.sin_port = htons(BASE_PORT + i);
+        Status = AfdBind(SocketHandles[i], (const struct sockaddr *)&addr, sizeof(addr));
+        ok(Status == STATUS_SUCCESS, "AfdBind failed with %lx\n", Status);
+    }
+
+    /* Nothing registered, nothing to report */
+    Status = WaitPoll(SetHandle, FALSE, Events, SOCKET_COUNT, &Returned);
+    ok(Status == STATUS_TIMEOUT, "WaitPoll returned %lx\n", Status);
+
+    /* Only sockets can be registered */
+    Status = NtCreateEvent(&EventHandle, EVENT_ALL_ACCESS, NULL, NotificationEvent, FALSE);
+    ok(Status == STATUS_SUCCESS, "NtCreateEvent failed with %lx\n", Status);
+    Status = RegisterPoll(SetHandle, EventHandle, AFD_EVENT_RECEIVE, NULL);
+    ok(Status == STATUS_OBJECT_TYPE_MISMATCH, "RegisterPoll returned %lx\n", Status);
+    NtClose(EventHandle);
+
+    /* Datagram sockets are always writable, so registering reports them once */
+    for (i = 0; i < SOCKET_COUNT; i++)
+    {
+        Status = RegisterPoll(SetHandle, SocketHandles[i], AFD_EVENT_SEND, (PVOID)(ULONG_PTR)(i + 1));
+        ok(Status == STATUS_SUCCESS, "RegisterPoll failed with %lx\n", Status);
+    }
+
+    RtlZeroMemory(Seen, sizeof(Seen));
+    Status = WaitPoll(SetHandle, TRUE, Events, SOCKET_COUNT + 1, &Returned);
+    ok(Status == STATUS_SUCCESS, "WaitPoll failed with %lx\n", Status);
+    ok(Returned == SOCKET_COUNT, "Got %lu events\n", Returned);
+    for (i = 0; i < Returned; i++)
+    {
+        Index = (ULONG)(ULONG_PTR)Events[i].Context - 1;
+        ok(Index < SOCKET_COUNT, "Unexpected context %p\n", Events[i].Context);
+        ok(Events[i].Events == AFD_EVENT_SEND, "Unexpected events %lx\n", Events[i].Events);
+        if (Index < SOCKET_COUNT)
+        {
+            ok(!Seen[Index], "Socket %lu reported twice\n", Index);
+            Seen[Index] = TRUE;
+        }
+    }
+
+    /* Edge triggered, the state didn't change since */
+    Status = WaitPoll(SetHandle, FALSE, Events, SOCKET_COUNT, &Returned);
+    ok(Status == STATUS_TIMEOUT, "WaitPoll returned %lx\n", Status);
+
+    /* Watch for incoming data instead, the registration is updated in place */
+    for (i = 0; i < SOCKET_COUNT; i++)
+    {
+        Status = RegisterPoll(SetHandle, SocketHandles[i], AFD_EVENT_RECEIVE, (PVOID)(ULONG_PTR)(i + 1));
+        ok(Status == STATUS_SUCCESS, "RegisterPoll failed with %lx\n", Status);
+    }
+
+    addr.sin_port = htons(BASE_PORT + SOCKET_COUNT / 2);
+    Status = AfdSendTo(SenderHandle, Buffer, sizeof(Buffer), (const struct sockaddr *)&addr, sizeof(addr));
+    ok(Status == STATUS_SUCCESS, "AfdSendTo failed with %lx\n", Status);
+
+    Status = WaitPoll(SetHandle, TRUE, Events, SOCKET_COUNT, &Returned);
+    ok(Status == STATUS_SUCCESS, "WaitPoll failed with %lx\n", Status);
+    ok(Returned == 1, "Got %lu events\n", Returned);
+    ok(Events[0].Context == (PVOID)(ULONG_PTR)(SOCKET_COUNT / 2 + 1), "Unexpected context %p\n", Events[0].Context);
+    ok(Events[0].Events == AFD_EVENT_RECEIVE, "Unexpected events %lx\n", Events[0].Events);
+
+    /* Rough cost of a wakeup with many registered sockets */
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < BENCH_ROUNDS; i++)
+    {
+        addr.sin_port = htons(BASE_PORT + (i % SOCKET_COUNT));
+        AfdSendTo(SenderHandle, Buffer, sizeof(Buffer), (const struct sockaddr *)&addr, sizeof(addr));
+        Status = WaitPoll(SetHandle, TRUE, Events, SOCKET_COUNT, &Returned);
+        if (Status != STATUS_SUCCESS || Returned != 1)
+            break;
+    }
+    QueryPerformanceCounter(&End);
+    ok(i == BENCH_ROUNDS, "Round %lu: WaitPoll returned %lx with %lu events\n", i, Status, Returned);
+    trace("%lu send/wait rounds over %u registered sockets: %I64u us\n",
+          i, SOCKET_COUNT, (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart);
+
+    /* Unregistering twice fails */
+    Status = RegisterPoll(SetHandle, SocketHandles[0], 0, NULL);
+    ok(Status == STATUS_SUCCESS, "RegisterPoll failed with %lx\n", Status);
+    Status = RegisterPoll(SetHandle, SocketHandles[0], 0, NULL);
+    ok(Status == STATUS_NOT_FOUND, "RegisterPoll returned %lx\n", Status);
+
+    /* Closed sockets drop out of the set */
+    for (i = 0; i < SOCKET_COUNT; i++)
+    {
+        NtClose(SocketHandles[i]);
+    }
+
+    Status = WaitPoll(SetHandle, FALSE, Events, SOCKET_COUNT, &Returned);
+    ok(Status == STATUS_TIMEOUT, "WaitPoll returned %lx\n", Status);
+
+    NtClose(SenderHandle);
+    NtClose(SetHandle);
+}
+
+START_TEST(poll)
+{
+    TestPoll();
+}
@@ -0,0 +1,112 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPLv2+ - See COPYING in the top level directory
+ * PURPOSE:         Test for the btrfs driver's CRC32C implementation
+ */
+
+#include <apitest.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+uint32_t calc_crc32c(uint32_t seed, uint8_t* msg, ULONG msglen);
+
+#define MAX_LENGTH 4096
+#define MAX_ALIGNMENT 16
+
+static uint8_t Buffer[MAX_LENGTH + MAX_ALIGNMENT];
+
+/* Bitwise reference, independent of the driver's tables */
+static
+uint32_t
+ReferenceCrc32c(uint32_t Crc, const uint8_t *Data, ULONG Length)
+{
+    int Bit;
+
+    while (Length--)
+    {
+        Crc ^= *Data++;
+        for (Bit = 0; Bit < 8; Bit++)
+            Crc = (Crc >> 1) ^ (0x82F63B78 & (0 - (Crc & 1)));
+    }
+
+    return Crc;
+}
+
+static
+void
+FillBuffer(void)
+{
+    ULONG i;
+
+    for (i = 0; i < sizeof(Buffer); i++)
+        Buffer[i] = (uint8_t)rand();
+}
+
+static
+void
+TestAllLengths(void)
+{
+    ULONG Alignment, Length, Failures = 0;
+    uint32_t Seed, Expected, Result;
+
+    for (Alignment = 0; Alignment < MAX_ALIGNMENT; Alignment++)
+    {
+        for (Length = 0; Length <= MAX_LENGTH; Length++)
+        {
+            Seed = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+            Expected = ReferenceCrc32c(Seed, Buffer + Alignment, Length);
+            Result = calc_crc32c(Seed, Buffer + Alignment, Length);
+            if (Result != Expected && Failures++ < 10)
+            {
+                ok(0, "Alignment %lu, length %lu: got 0x%08x, expected 0x%08x\n",
+                   Alignment, Length, Result, Expected);
+            }
+        }
+    }
+
+    ok(Failures == 0, "%lu mismatches\n", Failures);
+}
+
+static
+void
+Benchmark(void)
+{
+    LARGE_INTEGER Frequency, Start, End;
+    ULONG Round, Rounds = 4096;
+    uint32_t Crc = 0;
+    double Seconds;
+
+    if (!QueryPerformanceFrequency(&Frequency))
+        return;
+
+    QueryPerformanceCounter(&Start);
+    for (Round = 0; Round < Rounds; Round++)
+        Crc = calc_crc32c(Crc, Buffer, MAX_LENGTH);
+    QueryPerformanceCounter(&End);
+
+    Seconds = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+    if (Seconds > 0)
+    {
+        trace("%lu x %u bytes in %.3f s, %.0f MB/s (0x%08x)\n",
+              Rounds, MAX_LENGTH, Seconds,
+              Rounds * (double)MAX_LENGTH / Seconds / 1e6, Crc);
+    }
+}
+
+START_TEST(calc_crc32c)
+{
+    int Pass;
+
+    /* Standard check value: CRC32C("123456789") */
+    ok_hex(~calc_crc32c(0xffffffff, (uint8_t *)"123456789", 9), 0xe3069283);
+    ok_hex(calc_crc32c(0x12345678, Buffer, 0), 0x12345678);
+
+    srand(0x5eed);
+    for (Pass = 0; Pass < 4; Pass++)
+    {
+        FillBuffer();
+        TestAllLengths();
+    }
+
+    Benchmark();
+}
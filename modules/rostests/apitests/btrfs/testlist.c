@@ -0,0 +1,10 @@
+#define STANDALONE
+#include <apitest.h>
+
+extern void func_calc_crc32c(void);
+
+const struct test winetest_testlist[] =
+{
+    { "calc_crc32c", func_calc_crc32c },
+    { 0, 0 }
+};
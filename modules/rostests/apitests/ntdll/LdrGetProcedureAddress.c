@@ -0,0 +1,101 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         LGPLv2.1+ - See COPYING.LIB in the top level directory
+ * PURPOSE:         Test for LdrGetProcedureAddress
+ */
+
+#include "precomp.h"
+
+static
+VOID
+TestExportsByName(
+    _In_ PCWSTR DllName)
+{
+    PVOID DllBase;
+    PIMAGE_EXPORT_DIRECTORY ExportDir;
+    ULONG ExportSize;
+    PULONG NameTable, FunctionTable;
+    PUSHORT OrdinalTable;
+    ULONG i, Failures = 0;
+    ANSI_STRING Name;
+    PVOID Address;
+    NTSTATUS Status;
+    LARGE_INTEGER Start, End, Frequency;
+
+    DllBase = GetModuleHandleW(DllName);
+    ok(DllBase != NULL, "%ls not loaded\n", DllName);
+    if (!DllBase)
+        return;
+
+    ExportDir = RtlImageDirectoryEntryToData(DllBase,
+                                             TRUE,
+                                             IMAGE_DIRECTORY_ENTRY_EXPORT,
+                                             &ExportSize);
+    ok(ExportDir != NULL, "No export directory in %ls\n", DllName);
+    if (!ExportDir)
+        return;
+
+    NameTable = (PULONG)((ULONG_PTR)DllBase + ExportDir->AddressOfNames);
+    OrdinalTable = (PUSHORT)((ULONG_PTR)DllBase + ExportDir->AddressOfNameOrdinals);
+    FunctionTable = (PULONG)((ULONG_PTR)DllBase + ExportDir->AddressOfFunctions);
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+
+    /* Every exported name must resolve to its own slot in the function table */
+    for (i = 0; i < ExportDir->NumberOfNames; i++)
+    {
+        ULONG_PTR Expected = (ULONG_PTR)DllBase + FunctionTable[OrdinalTable[i]];
+
+        RtlInitAnsiString(&Name, (PCSZ)((ULONG_PTR)DllBase + NameTable[i]));
+        Status = LdrGetProcedureAddress(DllBase, &Name, 0, &Address);
+
+        /* Forwarders point into the export directory and resolve elsewhere */
+        if (Expected > (ULONG_PTR)ExportDir &&
+            Expected < (ULONG_PTR)ExportDir + ExportSize)
+        {
+            continue;
+        }
+
+        if (!NT_SUCCESS(Status) || (ULONG_PTR)Address != Expected)
+        {
+            if (Failures++ < 10)
+            {
+                ok(0, "%ls!%s: Status 0x%lx, got %p, expected %p\n",
+                   DllName, Name.Buffer, Status, Address, (PVOID)Expected);
+            }
+        }
+    }
+
+    QueryPerformanceCounter(&End);
+    ok(Failures == 0, "%lu of %lu names failed to resolve in %ls\n",
+       Failures, ExportDir->NumberOfNames, DllName);
+    trace("%ls: %lu lookups by name in %I64u us\n",
+          DllName, ExportDir->NumberOfNames,
+          (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart);
+
+    /* Names that aren't exported must still fail, including near misses */
+    RtlInitAnsiString(&Name, "ThisFunctionDoesNotExist");
+    Status = LdrGetProcedureAddress(DllBase, &Name, 0, &Address);
+    ok_ntstatus(Status, STATUS_PROCEDURE_NOT_FOUND);
+
+    if (ExportDir->NumberOfNames)
+    {
+        CHAR Buffer[MAX_PATH];
+
+        StringCbCopyA(Buffer, sizeof(Buffer), (PCSTR)((ULONG_PTR)DllBase + NameTable[0]));
+        StringCbCatA(Buffer, sizeof(Buffer), "_");
+        RtlInitAnsiString(&Name, Buffer);
+        Status = LdrGetProcedureAddress(DllBase, &Name, 0, &Address);
+        ok_ntstatus(Status, STATUS_PROCEDURE_NOT_FOUND);
+    }
+}
+
+START_TEST(LdrGetProcedureAddress)
+{
+    /* Large tables go through the export name hash, small ones don't */
+    TestExportsByName(L"ntdll.dll");
+    TestExportsByName(L"kernel32.dll");
+    TestExportsByName(L"advapi32.dll");
+    TestExportsByName(L"msvcrt.dll");
+}
@@ -0,0 +1,342 @@
+/*
+ * PROJECT:         ReactOS API tests
+ * LICENSE:         LGPLv2.1+ - See COPYING.LIB in the top level directory
+ * PURPOSE:         Test for NtReadFileScatter/NtWriteFileGather
+ */
+
+#include "precomp.h"
+
+#define TEST_PAGES 8
+#define BENCH_ROUNDS 64
+
+static
+VOID
+SetSegment(
+    _Out_ PFILE_SEGMENT_ELEMENT Segment,
+    _In_opt_ PVOID Address)
+{
+    /* Avoid sign-extending the pointer on 32 bit systems */
+    Segment->Alignment = (ULONG_PTR)Address;
+}
+
+static
+BOOLEAN
+CheckPage(
+    _In_ PUCHAR Page,
+    _In_ UCHAR Value)
+{
+    ULONG i;
+
+    for (i = 0; i < PAGE_SIZE; i++)
+    {
+        if (Page[i] != Value)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+static
+HANDLE
+OpenTestFile(
+    _In_ POBJECT_ATTRIBUTES ObjectAttributes,
+    _In_ ULONG Disposition,
+    _In_ ULONG Options)
+{
+    NTSTATUS Status;
+    HANDLE FileHandle;
+    IO_STATUS_BLOCK IoStatus;
+
+    Status = NtCreateFile(&FileHandle,
+                          FILE_READ_DATA | FILE_WRITE_DATA | DELETE | SYNCHRONIZE,
+                          ObjectAttributes,
+                          &IoStatus,
+                          NULL,
+                          0,
+                          FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                          Disposition,
+                          FILE_NON_DIRECTORY_FILE | Options,
+                          NULL,
+                          0);
+    ok_hex(Status, STATUS_SUCCESS);
+    return NT_SUCCESS(Status) ? FileHandle : NULL;
+}
+
+static
+VOID
+BenchmarkReads(
+    _In_ HANDLE FileHandle,
+    _In_ PUCHAR Buffer,
+    _In_ PFILE_SEGMENT_ELEMENT Segments)
+{
+    NTSTATUS Status;
+    IO_STATUS_BLOCK IoStatus;
+    LARGE_INTEGER ByteOffset;
+    LARGE_INTEGER Start, PerPage, Scatter, Frequency;
+    ULONG Round, i;
+
+    NtQueryPerformanceCounter(&Start, &Frequency);
+    for (Round = 0; Round < BENCH_ROUNDS; Round++)
+    {
+        for (i = 0; i < TEST_PAGES; i++)
+        {
+            ByteOffset.QuadPart = i * PAGE_SIZE;
+            Status = NtReadFile(FileHandle,
+                                NULL,
+                                NULL,
+                                NULL,
+                                &IoStatus,
+                                Buffer + (TEST_PAGES - 1 - i) * PAGE_SIZE,
+                                PAGE_SIZE,
+                                &ByteOffset,
+                                NULL);
+            if (!NT_SUCCESS(Status))
+                break;
+        }
+    }
+    NtQueryPerformanceCounter(&PerPage, NULL);
+
+    for (Round = 0; Round < BENCH_ROUNDS; Round++)
+    {
+        ByteOffset.QuadPart = 0;
+        Status = NtReadFileScatter(FileHandle,
+                                   NULL,
+                                   NULL,
+                                   NULL,
+                                   &IoStatus,
+                                   Segments,
+                                   TEST_PAGES * PAGE_SIZE,
+                                   &ByteOffset,
+                                   NULL);
+        if (!NT_SUCCESS(Status))
+            break;
+    }
+    NtQueryPerformanceCounter(&Scatter, NULL);
+
+    if (Frequency.QuadPart == 0)
+        return;
+
+    trace("%u x %u pages: per-page NtReadFile %I64u us, NtReadFileScatter %I64u us\n",
+          BENCH_ROUNDS, TEST_PAGES,
+          (PerPage.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart,
+          (Scatter.QuadPart - PerPage.QuadPart) * 1000000 / Frequency.QuadPart);
+}
+
+START_TEST(NtReadFileScatter)
+{
+    NTSTATUS Status;
+    HANDLE FileHandle;
+    HANDLE EventHandle;
+    UNICODE_STRING FileName = RTL_CONSTANT_STRING(L"\\SystemRoot\\ntdll-apitest-NtReadFileScatter-test.bin");
+    PUCHAR Buffer;
+    SIZE_T BufferSize;
+    LARGE_INTEGER ByteOffset;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatus;
+    FILE_DISPOSITION_INFORMATION DispositionInfo;
+    FILE_SEGMENT_ELEMENT Segments[TEST_PAGES + 1];
+    ULONG i;
+
+    Buffer = NULL;
+    BufferSize = TEST_PAGES * PAGE_SIZE;
+    Status = NtAllocateVirtualMemory(NtCurrentProcess(),
+                                     (PVOID*)&Buffer,
+                                     0,
+                                     &BufferSize,
+                                     MEM_RESERVE | MEM_COMMIT,
+                                     PAGE_READWRITE);
+    if (!NT_SUCCESS(Status))
+    {
+        skip("Failed to allocate memory, status %lx\n", Status);
+        return;
+    }
+
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &FileName,
+                               OBJ_CASE_INSENSITIVE,
+                               NULL,
+                               NULL);
+
+    /* Cached handles can't do scatter/gather I/O */
+    FileHandle = OpenTestFile(&ObjectAttributes,
+                              FILE_SUPERSEDE,
+                              FILE_SYNCHRONOUS_IO_NONALERT);
+    if (!FileHandle)
+    {
+        skip("Failed to create test file\n");
+        goto Cleanup;
+    }
+
+    for (i = 0; i < TEST_PAGES; i++)
+        SetSegment(&Segments[i], Buffer + i * PAGE_SIZE);
+    SetSegment(&Segments[TEST_PAGES], NULL);
+
+    ByteOffset.QuadPart = 0;
+    Status = NtWriteFileGather(FileHandle,
+                               NULL,
+                               NULL,
+                               NULL,
+                               &IoStatus,
+                               Segments,
+                               TEST_PAGES * PAGE_SIZE,
+                               &ByteOffset,
+                               NULL);
+    ok_hex(Status, STATUS_INVALID_PARAMETER);
+    NtClose(FileHandle);
+
+    FileHandle = OpenTestFile(&ObjectAttributes,
+                              FILE_OPEN,
+                              FILE_SYNCHRONOUS_IO_NONALERT | FILE_NO_INTERMEDIATE_BUFFERING);
+    if (!FileHandle)
+    {
+        skip("Failed to open test file\n");
+        goto Cleanup;
+    }
+
+    /* Write the pages in reverse order, each filled with its file page number */
+    for (i = 0; i < TEST_PAGES; i++)
+    {
+        RtlFillMemory(Buffer + i * PAGE_SIZE, PAGE_SIZE, (UCHAR)(TEST_PAGES - i));
+        SetSegment(&Segments[i], Buffer + (TEST_PAGES - 1 - i) * PAGE_SIZE);
+    }
+
+    ByteOffset.QuadPart = 0;
+    RtlFillMemory(&IoStatus, sizeof(IoStatus), 0x55);
+    Status = NtWriteFileGather(FileHandle,
+                               NULL,
+                               NULL,
+                               NULL,
+                               &IoStatus,
+                               Segments,
+                               TEST_PAGES * PAGE_SIZE,
+                               &ByteOffset,
+                               NULL);
+    ok_hex(Status, STATUS_SUCCESS);
+    ok_hex(IoStatus.Status, STATUS_SUCCESS);
+    ok_size_t(IoStatus.Information, TEST_PAGES * PAGE_SIZE);
+
+    /* Read them back in file order */
+    RtlZeroMemory(Buffer, TEST_PAGES * PAGE_SIZE);
+    for (i = 0; i < TEST_PAGES; i++)
+        SetSegment(&Segments[i], Buffer + i * PAGE_SIZE);
+
+    ByteOffset.QuadPart = 0;
+    RtlFillMemory(&IoStatus, sizeof(IoStatus), 0x55);
+    Status = NtReadFileScatter(FileHandle,
+                               NULL,
+                               NULL,
+                               NULL,
+                               &IoStatus,
+                               Segments,
+                               TEST_PAGES * PAGE_SIZE,
+                               &ByteOffset,
+                               NULL);
+    ok_hex(Status, STATUS_SUCCESS);
+    ok_hex(IoStatus.Status, STATUS_SUCCESS);
+    ok_size_t(IoStatus.Information, TEST_PAGES * PAGE_SIZE);
+    for (i = 0; i < TEST_PAGES; i++)
+        ok(CheckPage(Buffer + i * PAGE_SIZE, (UCHAR)(i + 1)), "Wrong data in page %lu\n", i);
+
+    /* The length must be sector aligned */
+    ByteOffset.QuadPart = 0;
+    Status = NtReadFileScatter(FileHandle,
+                               NULL,
+                               NULL,
+                               NULL,
+                               &IoStatus,
+                               Segments,
+                               PAGE_SIZE + 1,
+                               &ByteOffset,
+                               NULL);
+    ok_hex(Status, STATUS_INVALID_PARAMETER);
+
+    /* And the segments must be page aligned */
+    SetSegment(&Segments[1], Buffer + PAGE_SIZE + 1);
+    ByteOffset.QuadPart = 0;
+    Status = NtReadFileScatter(FileHandle,
+                               NULL,
+                               NULL,
+                               NULL,
+                               &IoStatus,
+                               Segments,
+                               2 * PAGE_SIZE,
+                               &ByteOffset,
+                               NULL);
+    ok(!NT_SUCCESS(Status), "NtReadFileScatter returned %lx\n", Status);
+    SetSegment(&Segments[1], Buffer + PAGE_SIZE);
+
+    BenchmarkReads(FileHandle, Buffer, Segments);
+    NtClose(FileHandle);
+
+    /* Asynchronous completion through an event */
+    Status = NtCreateEvent(&EventHandle,
+                           EVENT_ALL_ACCESS,
+                           NULL,
+                           NotificationEvent,
+                           FALSE);
+    ok_hex(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status)) EventHandle = NULL;
+
+    FileHandle = OpenTestFile(&ObjectAttributes,
+                              FILE_OPEN,
+                              FILE_NO_INTERMEDIATE_BUFFERING);
+    if (FileHandle && EventHandle)
+    {
+        /* Without a byte offset, asynchronous I/O can't work */
+        Status = NtReadFileScatter(FileHandle,
+                                   EventHandle,
+                                   NULL,
+                                   NULL,
+                                   &IoStatus,
+                                   Segments,
+                                   PAGE_SIZE,
+                                   NULL,
+                                   NULL);
+        ok_hex(Status, STATUS_INVALID_PARAMETER);
+
+        RtlZeroMemory(Buffer, TEST_PAGES * PAGE_SIZE);
+        ByteOffset.QuadPart = PAGE_SIZE;
+        RtlFillMemory(&IoStatus, sizeof(IoStatus), 0x55);
+        Status = NtReadFileScatter(FileHandle,
+                                   EventHandle,
+                                   NULL,
+                                   NULL,
+                                   &IoStatus,
+                                   Segments,
+                                   2 * PAGE_SIZE,
+                                   &ByteOffset,
+                                   NULL);
+        ok(Status == STATUS_SUCCESS || Status == STATUS_PENDING,
+           "NtReadFileScatter returned %lx\n", Status);
+        if (Status == STATUS_PENDING)
+        {
+            Status = NtWaitForSingleObject(EventHandle, FALSE, NULL);
+            ok_hex(Status, STATUS_WAIT_0);
+        }
+        ok_hex(IoStatus.Status, STATUS_SUCCESS);
+        ok_size_t(IoStatus.Information, 2 * PAGE_SIZE);
+        ok(CheckPage(Buffer, 2), "Wrong data in page 0\n");
+        ok(CheckPage(Buffer + PAGE_SIZE, 3), "Wrong data in page 1\n");
+        ok(CheckPage(Buffer + 2 * PAGE_SIZE, 0), "Page 2 was written\n");
+    }
+    if (EventHandle) NtClose(EventHandle);
+
+    if (FileHandle)
+    {
+        DispositionInfo.DeleteFile = TRUE;
+        Status = NtSetInformationFile(FileHandle,
+                                      &IoStatus,
+                                      &DispositionInfo,
+                                      sizeof(DispositionInfo),
+                                      FileDispositionInformation);
+        ok_hex(Status, STATUS_SUCCESS);
+        Status = NtClose(FileHandle);
+        ok_hex(Status, STATUS_SUCCESS);
+    }
+
+Cleanup:
+    Status = NtFreeVirtualMemory(NtCurrentProcess(),
+                                 (PVOID*)&Buffer,
+                                 &BufferSize,
+                                 MEM_RELEASE);
+    ok_hex(Status, STATUS_SUCCESS);
+}
@@ -0,0 +1,86 @@
+/*
+ * PROJECT:         ReactOS API tests
+ * LICENSE:         LGPLv2.1+ - See COPYING.LIB in the top level directory
+ * PURPOSE:         Test for NtRemoveIoCompletionEx
+ */
+
+#include "precomp.h"
+
+#define TEST_PACKETS 5
+
+START_TEST(NtRemoveIoCompletionEx)
+{
+    NTSTATUS Status;
+    HANDLE Port;
+    FILE_IO_COMPLETION_INFORMATION Information[TEST_PACKETS + 1];
+    ULONG Removed, i;
+    LARGE_INTEGER Timeout;
+
+    Status = NtCreateIoCompletion(&Port, IO_COMPLETION_ALL_ACCESS, NULL, 0);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+    {
+        skip("Failed to create the completion port\n");
+        return;
+    }
+
+    /* An empty array is not accepted */
+    Timeout.QuadPart = 0;
+    Removed = 0xdeadbeef;
+    Status = NtRemoveIoCompletionEx(Port, Information, 0, &Removed, &Timeout, FALSE);
+    ok_ntstatus(Status, STATUS_INVALID_PARAMETER);
+
+    /* Nothing queued, we time out and report no entries */
+    Removed = 0xdeadbeef;
+    Status = NtRemoveIoCompletionEx(Port, Information, TEST_PACKETS, &Removed, &Timeout, FALSE);
+    ok_ntstatus(Status, STATUS_TIMEOUT);
+    ok_long(Removed, 0);
+
+    /* Queue a few packets */
+    for (i = 0; i < TEST_PACKETS; i++)
+    {
+        Status = NtSetIoCompletion(Port,
+                                   (PVOID)(ULONG_PTR)(i + 1),
+                                   (PVOID)(ULONG_PTR)(i + 0x100),
+                                   STATUS_SUCCESS,
+                                   i * 10);
+        ok_ntstatus(Status, STATUS_SUCCESS);
+    }
+
+    /* Only take as many as we ask for, in order */
+    RtlFillMemory(Information, sizeof(Information), 0x55);
+    Removed = 0;
+    Status = NtRemoveIoCompletionEx(Port, Information, 2, &Removed, &Timeout, FALSE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok_long(Removed, 2);
+    ok_ptr(Information[0].KeyContext, (PVOID)1);
+    ok_ptr(Information[0].ApcContext, (PVOID)0x100);
+    ok_ptr(Information[1].KeyContext, (PVOID)2);
+    ok_ptr(Information[1].ApcContext, (PVOID)0x101);
+    ok_long(Information[1].IoStatusBlock.Information, 10);
+    ok_ptr(Information[2].KeyContext, (PVOID)(ULONG_PTR)0x5555555555555555ULL);
+
+    /* Asking for more than is queued returns the rest at once */
+    Removed = 0;
+    Status = NtRemoveIoCompletionEx(Port, Information, TEST_PACKETS + 1, &Removed, &Timeout, FALSE);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    ok_long(Removed, TEST_PACKETS - 2);
+    for (i = 0; i < Removed; i++)
+    {
+        ok_ptr(Information[i].KeyContext, (PVOID)(ULONG_PTR)(i + 3));
+        ok_ntstatus(Information[i].IoStatusBlock.Status, STATUS_SUCCESS);
+        ok_long(Information[i].IoStatusBlock.Information, (i + 2) * 10);
+    }
+
+    /* The port is empty again */
+    Removed = 0xdeadbeef;
+    Status = NtRemoveIoCompletionEx(Port, Information, TEST_PACKETS, &Removed, &Timeout, FALSE);
+    ok_ntstatus(Status, STATUS_TIMEOUT);
+    ok_long(Removed, 0);
+
+    /* A bad output buffer is caught */
+    Status = NtRemoveIoCompletionEx(Port, (PVOID)1, TEST_PACKETS, &Removed, &Timeout, FALSE);
+    ok_ntstatus(Status, STATUS_DATATYPE_MISALIGNMENT);
+
+    NtClose(Port);
+}
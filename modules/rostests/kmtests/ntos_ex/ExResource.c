@@ -518,6 +518,99 @@ TestResourceWithOwner(
     FinishThread(&ThreadDataOwner);
 }
 
+#define BENCH_ROUNDS 100000
+
+static
+VOID
+TestResourceLockInformation(
+    IN PERESOURCE Res)
+{
+    NTSTATUS Status;
+    ULONG Length, i;
+    PRTL_PROCESS_LOCKS Locks;
+    PRTL_PROCESS_LOCK_INFORMATION Lock = NULL;
+    PULONGLONG WaitTimes;
+    LARGE_INTEGER Start, End, Frequency;
+
+    KeEnterCriticalRegion();
+    ok_bool_true(ExAcquireResourceExclusiveLite(Res, TRUE), "ExAcquireResourceExclusiveLite returned");
+    ok_bool_true(ExAcquireResourceExclusiveLite(Res, TRUE), "ExAcquireResourceExclusiveLite returned");
+
+    /* Too small, but we learn the size needed */
+    Length = 0;
+    Status = ZwQuerySystemInformation(SystemLocksInformation, NULL, 0, &Length);
+    ok_eq_hex(Status, STATUS_INFO_LENGTH_MISMATCH);
+    ok(Length >= sizeof(RTL_PROCESS_LOCKS), "Length = %lu\n", Length);
+
+    /* Leave room for resources created meanwhile */
+    Length += 16 * (sizeof(RTL_PROCESS_LOCK_INFORMATION) + sizeof(ULONGLONG));
+    Locks = ExAllocatePoolWithTag(NonPagedPool, Length, 'LRmK');
+    if (!skip(Locks != NULL, "Out of memory\n"))
+    {
+        Status = ZwQuerySystemInformation(SystemLocksInformation, Locks, Length, &Length);
+        ok_eq_hex(Status, STATUS_SUCCESS);
+        if (NT_SUCCESS(Status))
+        {
+            for (i = 0; i < Locks->NumberOfLocks; i++)
+            {
+                if (Locks->Locks[i].Address == Res)
+                {
+                    Lock = &Locks->Locks[i];
+                    break;
+                }
+            }
+            ok(Lock != NULL, "Resource %p not reported\n", Res);
+            if (Lock)
+            {
+                ok_eq_uint(Lock->Type, RTL_RESOURCE_TYPE);
+                ok_eq_ulong(Lock->OwnerThreadId, HandleToUlong(PsGetCurrentThreadId()));
+                ok_eq_ulong(Lock->RecursionCount, 2LU);
+                ok_eq_ulong(Lock->NumberOfSharedWaiters, 0LU);
+                ok_eq_ulong(Lock->NumberOfExclusiveWaiters, 0LU);
+
+                /* ReactOS follows the locks with their wait times */
+                if (Length >= RTL_PROCESS_LOCKS_WAIT_TIMES_OFFSET(Locks->NumberOfLocks) +
+                              Locks->NumberOfLocks * sizeof(ULONGLONG))
+                {
+                    WaitTimes = (PULONGLONG)((PUCHAR)Locks +
+                                             RTL_PROCESS_LOCKS_WAIT_TIMES_OFFSET(Locks->NumberOfLocks));
+                    if (!Lock->ContentionCount) ok_eq_ulonglong(WaitTimes[i], 0ULL);
+                    trace("%lu waits, %I64u us\n", Lock->ContentionCount, WaitTimes[i] / 10);
+                }
+            }
+        }
+        ExFreePoolWithTag(Locks, 'LRmK');
+    }
+
+    /* Rough cost of a nested acquire/release pair */
+    KeQueryPerformanceCounter(&Frequency);
+    Start = KeQueryPerformanceCounter(NULL);
+    for (i = 0; i < BENCH_ROUNDS; i++)
+    {
+        ExAcquireResourceExclusiveLite(Res, TRUE);
+        ExReleaseResourceLite(Res);
+    }
+    End = KeQueryPerformanceCounter(NULL);
+    trace("%u nested acquire/release pairs: %I64u us\n",
+          BENCH_ROUNDS, (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart);
+    CheckResourceStatus(Res, TRUE, 2LU, 0LU, 0LU);
+
+    ExReleaseResourceLite(Res);
+    ExReleaseResourceLite(Res);
+
+    /* And of an uncontended one */
+    Start = KeQueryPerformanceCounter(NULL);
+    for (i = 0; i < BENCH_ROUNDS; i++)
+    {
+        ExAcquireResourceExclusiveLite(Res, TRUE);
+        ExReleaseResourceLite(Res);
+    }
+    End = KeQueryPerformanceCounter(NULL);
+    trace("%u uncontended acquire/release pairs: %I64u us\n",
+          BENCH_ROUNDS, (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart);
+    KeLeaveCriticalRegion();
+}
+
 START_TEST(ExResource)
 {
     NTSTATUS Status;
@@ -580,6 +673,9 @@ START_TEST(ExResource)
     TestResourceWithOwner(&Res);
     CheckResourceStatus(&Res, FALSE, 0LU, 0LU, 0LU);
 
+    TestResourceLockInformation(&Res);
+    CheckResourceStatus(&Res, FALSE, 0LU, 0LU, 0LU);
+
     Status = ExDeleteResourceLite(&Res);
     ok_eq_hex(Status, STATUS_SUCCESS);
 
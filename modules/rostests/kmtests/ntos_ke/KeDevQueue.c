@@ -189,9 +189,58 @@ void Tests_Insert_And_Delete()
     ExFreePool(element);
 }
 
+void Tests_Remove_By_Key()
+{
+    ULONG i;
+    PKDEVICE_QUEUE testing_queue;
+    KDEVICE_QUEUE_ENTRY elements[INSERT_COUNT];
+    PKDEVICE_QUEUE_ENTRY return_value;
+    KIRQL OldIrql;
+
+    trace("******* Testing KeRemoveByKeyDeviceQueue *********** \n");
+
+    testing_queue = ExAllocatePool(NonPagedPool, sizeof(KDEVICE_QUEUE));
+    KeInitializeDeviceQueue(testing_queue);
+
+    KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+
+    /* The first insertion only makes the queue busy */
+    ok(!KeInsertByKeyDeviceQueue(testing_queue, &elements[0], 0), "Element was inserted into an idle queue\n");
+
+    /* Insert the keys 10, 20, ... in reverse order, they must get sorted */
+    for (i = INSERT_COUNT - 1; i > 0; i--) {
+        ok(KeInsertByKeyDeviceQueue(testing_queue, &elements[i], i * 10), "Element was not inserted\n");
+    }
+
+    /* An exact match is returned, even for the last key */
+    return_value = KeRemoveByKeyDeviceQueue(testing_queue, (INSERT_COUNT - 1) * 10);
+    ok(return_value == &elements[INSERT_COUNT - 1], "Expected the entry with the exact key\n");
+
+    /* Otherwise the next higher key */
+    return_value = KeRemoveByKeyDeviceQueue(testing_queue, 15);
+    ok(return_value == &elements[2], "Expected the entry with the next higher key\n");
+
+    /* Wrap around to the first entry past the last key */
+    return_value = KeRemoveByKeyDeviceQueue(testing_queue, 1000);
+    ok(return_value == &elements[1], "Expected the first entry\n");
+
+    return_value = KeRemoveByKeyDeviceQueue(testing_queue, 0);
+    ok(return_value == &elements[3], "Expected the remaining entry\n");
+    ok(return_value->Inserted == FALSE, "Returning element is still in queue\n");
+
+    ok(KeRemoveByKeyDeviceQueue(testing_queue, 0) == NULL, "Queue is not empty\n");
+    ok(testing_queue->Busy == FALSE, "Queue is busy\n");
+
+    KeLowerIrql(OldIrql);
+
+    trace("****************************************************\n\n");
+    ExFreePool(testing_queue);
+}
+
 START_TEST(KeDeviceQueue)
 {
     Test_Initialize();
     Tests_Insert_And_Delete();
+    Tests_Remove_By_Key();
 }
 
@@ -15,9 +15,12 @@
 #include <debug.h>
 
 BOOLEAN CcPfEnablePrefetcher;
+ULONG CcPfEnableStatus = PF_ENABLE_APPLICATION_LAUNCH | PF_ENABLE_BOOT;
 PFSN_PREFETCHER_GLOBALS CcPfGlobals;
 MM_SYSTEMSIZE CcCapturedSystemSize;
 
+extern ULONG InitSafeBootMode;
+
 static ULONG BugCheckFileId = 0x4 << 16;
 
 /* FUNCTIONS *****************************************************************/
@@ -34,10 +37,17 @@ CcPfInitializePrefetcher(VOID)
 
     /* Setup the Prefetcher Data */
     InitializeListHead(&CcPfGlobals.ActiveTraces);
+    KeInitializeSpinLock(&CcPfGlobals.ActiveTracesLock);
     InitializeListHead(&CcPfGlobals.CompletedTraces);
     ExInitializeFastMutex(&CcPfGlobals.CompletedTracesLock);
+    CcPfGlobals.BootPhase = PfKernelInitPhase;
+
+    /* Safe mode must not depend on what the last boot touched */
+    if (InitSafeBootMode) CcPfEnableStatus = 0;
 
-    /* FIXME: Setup the rest of the prefetecher */
+    /* Honor Memory Management\PrefetchParameters\EnablePrefetcher */
+    CcPfEnableStatus &= PF_ENABLE_APPLICATION_LAUNCH | PF_ENABLE_BOOT;
+    CcPfEnablePrefetcher = (CcPfEnableStatus != 0);
 }
 
 INIT_FUNCTION
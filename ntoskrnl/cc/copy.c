@@ -819,6 +819,8 @@ CcCopyRead (
            FileObject, FileOffset->QuadPart, Length, Wait,
            Buffer, IoStatus);
 
+    CcPfLogFileAccess(FileObject, FileOffset->QuadPart, Length, PF_ENTRY_TYPE_READ);
+
     return CcCopyData(FileObject,
                       FileOffset->QuadPart,
                       Buffer,
@@ -0,0 +1,1373 @@
+/*
+ * PROJECT:         ReactOS Kernel
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * FILE:            ntoskrnl/cc/prefetch.c
+ * PURPOSE:         Application Launch and Boot Prefetcher
+ */
+
+/* INCLUDES ******************************************************************/
+
+#include <ntoskrnl.h>
+#define NDEBUG
+#include <debug.h>
+
+/* GLOBALS *******************************************************************/
+
+/*
+ * Launches are traced for at most ten one second periods, and stop as soon
+ * as the application is done faulting. The boot is traced for up to a minute,
+ * or until the shell tells us it is ready.
+ */
+#define PF_LAUNCH_TRACE_PERIOD          1000
+#define PF_BOOT_TRACE_PERIOD            6000
+#define PF_MAX_TRACE_PERIODS            RTL_NUMBER_OF(((PPFSN_TRACE_HEADER)NULL)->FaultsPerPeriod)
+#define PF_MIN_LAUNCH_PERIODS           3
+#define PF_MIN_FAULTS_PER_PERIOD        16
+
+#define PF_MAX_LAUNCH_ENTRIES           16384
+#define PF_MAX_BOOT_ENTRIES             65536
+#define PF_MIN_SAVED_ENTRIES            32
+#define PF_MAX_SECTIONS                 1024
+#define PF_SECTION_HASH_SHIFT           11
+#define PF_SECTION_HASH_SIZE            (1 << PF_SECTION_HASH_SHIFT)
+#define PF_MAX_TRACE_FILE_SIZE          (4 * 1024 * 1024)
+#define PF_MAX_OUTSTANDING_READS        8
+#define PF_MAX_FILE_OFFSET_PAGE         ((1 << 30) - 1)
+#define PF_PAGES_PER_VIEW               (VACB_MAPPING_GRANULARITY / PAGE_SIZE)
+
+#define PF_BOOT_SCENARIO_NAME           L"NTOSBOOT"
+#define PF_BOOT_SCENARIO_HASH           0xB00DFAAD
+
+static UNICODE_STRING CcPfPrefetchDirectory = RTL_CONSTANT_STRING(L"\\SystemRoot\\Prefetch");
+
+/* PRIVATE FUNCTIONS *********************************************************/
+
+static
+ULONG
+CcPfHashSection(IN PSECTION_OBJECT_POINTERS SectionObjectPointer)
+{
+    /* Fibonacci hashing, the low bits of a pool address are always zero */
+    return ((ULONG)((ULONG_PTR)SectionObjectPointer >> 3) * 0x9E3779B1) >>
+           (32 - PF_SECTION_HASH_SHIFT);
+}
+
+/*
+ * Returns the key of the file in this trace, assigning the next one on first
+ * access. Must be called with the trace buffer lock held.
+ */
+static
+ULONG
+CcPfGetFileKey(IN PPFSN_TRACE_HEADER Trace,
+               IN PFILE_OBJECT FileObject)
+{
+    PSECTION_OBJECT_POINTERS SectionObjectPointer = FileObject->SectionObjectPointer;
+    ULONG Index, FileKey;
+
+    /* Every file object of a file shares the same section object pointers */
+    Index = CcPfHashSection(SectionObjectPointer);
+    while ((FileKey = Trace->SectionHash[Index]) != 0)
+    {
+        if (Trace->Sections[FileKey - 1].SectionObjectPointer == SectionObjectPointer)
+        {
+            return FileKey - 1;
+        }
+
+        Index = (Index + 1) & (PF_SECTION_HASH_SIZE - 1);
+    }
+
+    /* The table is twice as large as the number of files, so there was a free slot */
+    if (Trace->NumSections >= PF_MAX_SECTIONS) return MAXULONG;
+
+    /* Keep the file around so that its name can be queried once the trace ends */
+    FileKey = Trace->NumSections++;
+    ObReferenceObject(FileObject);
+    Trace->Sections[FileKey].SectionObjectPointer = SectionObjectPointer;
+    Trace->Sections[FileKey].FileObject = FileObject;
+    Trace->SectionHash[Index] = FileKey + 1;
+    return FileKey;
+}
+
+static
+VOID
+CcPfLogRange(IN PPFSN_TRACE_HEADER Trace,
+             IN PFILE_OBJECT FileObject,
+             IN LONGLONG FileOffset,
+             IN ULONG Length,
+             IN ULONG Type)
+{
+    PPFSN_LOG_ENTRIES Log = Trace->CurrentTraceBuffer;
+    PPF_LOG_ENTRY Entry;
+    ULONGLONG Page, LastPage;
+    ULONG FileKey, Step;
+    KIRQL OldIrql;
+
+    KeAcquireSpinLock(&Trace->TraceBufferSpinLock, &OldIrql);
+
+    FileKey = CcPfGetFileKey(Trace, FileObject);
+    if (FileKey == MAXULONG) goto Quit;
+
+    /* A cached read brings in the whole view, a fault only the page */
+    Step = (Type == PF_ENTRY_TYPE_READ) ? PF_PAGES_PER_VIEW : 1;
+    Page = ROUND_DOWN((ULONGLONG)FileOffset >> PAGE_SHIFT, Step);
+    LastPage = ((ULONGLONG)FileOffset + Length - 1) >> PAGE_SHIFT;
+    for (; Page <= LastPage && Page <= PF_MAX_FILE_OFFSET_PAGE; Page += Step)
+    {
+        /* Sequential reads keep hitting the same view, log it once */
+        if (Log->NumEntries != 0)
+        {
+            Entry = &Log->Entries[Log->NumEntries - 1];
+            if ((Entry->FileKey == FileKey) &&
+                (Entry->FileOffset == Page) &&
+                (Entry->Type == Type))
+            {
+                continue;
+            }
+        }
+
+        if (Log->NumEntries >= Log->MaxEntries) break;
+
+        Entry = &Log->Entries[Log->NumEntries++];
+        Entry->FileOffset = (ULONG)Page;
+        Entry->Type = Type;
+        Entry->FileKey = FileKey;
+        Trace->NumFaults++;
+    }
+
+Quit:
+    KeReleaseSpinLock(&Trace->TraceBufferSpinLock, OldIrql);
+}
+
+/*
+ * Returns the launch trace of the process and the boot trace, each protected
+ * from going away until the caller is done logging.
+ */
+static
+ULONG
+CcPfReferenceTraces(IN PEPROCESS Process,
+                    OUT PPFSN_TRACE_HEADER Traces[2])
+{
+    PPFSN_TRACE_HEADER Trace;
+    ULONG Count = 0;
+    KIRQL OldIrql;
+
+    KeAcquireSpinLock(&CcPfGlobals.ActiveTracesLock, &OldIrql);
+
+    Trace = (PPFSN_TRACE_HEADER)Process->PrefetchTrace.Value;
+    if (Trace && ExAcquireRundownProtection(&Trace->RefCount))
+    {
+        Traces[Count++] = Trace;
+    }
+
+    /* The system process is the prefetcher itself, the lazy writer and the file systems */
+    Trace = CcPfGlobals.SystemWideTrace;
+    if (Trace && (Process != PsInitialSystemProcess) &&
+        ExAcquireRundownProtection(&Trace->RefCount))
+    {
+        Traces[Count++] = Trace;
+    }
+
+    KeReleaseSpinLock(&CcPfGlobals.ActiveTracesLock, OldIrql);
+    return Count;
+}
+
+static
+VOID
+CcPfFreeTrace(IN PPFSN_TRACE_HEADER Trace)
+{
+    PPFSN_LOG_ENTRIES Log;
+    ULONG i;
+
+    /* Let the cache of the prefetched files go */
+    if (Trace->PrefetchedFiles)
+    {
+        for (i = 0; i < Trace->NumPrefetchedFiles; i++)
+        {
+            if (!Trace->PrefetchedFiles[i]) continue;
+
+            CcRosDereferenceCache(Trace->PrefetchedFiles[i]);
+            ObDereferenceObject(Trace->PrefetchedFiles[i]);
+        }
+
+        ExFreePoolWithTag(Trace->PrefetchedFiles, TAG_PREFETCH);
+    }
+
+    if (Trace->Sections)
+    {
+        for (i = 0; i < Trace->NumSections; i++)
+        {
+            ObDereferenceObject(Trace->Sections[i].FileObject);
+        }
+
+        ExFreePoolWithTag(Trace->Sections, TAG_PREFETCH);
+    }
+
+    while (!IsListEmpty(&Trace->TraceBuffersList))
+    {
+        Log = CONTAINING_RECORD(RemoveHeadList(&Trace->TraceBuffersList),
+                                PFSN_LOG_ENTRIES,
+                                TraceBuffersLink);
+        ExFreePoolWithTag(Log, TAG_PREFETCH);
+    }
+
+    if (Trace->Process) ObDereferenceObject(Trace->Process);
+    ExFreePoolWithTag(Trace, TAG_PREFETCH);
+}
+
+static
+VOID
+NTAPI
+CcPfEndTraceWorker(IN PVOID Parameter);
+
+static
+VOID
+NTAPI
+CcPfTraceTimerDpc(IN PKDPC Dpc,
+                  IN PVOID DeferredContext,
+                  IN PVOID SystemArgument1,
+                  IN PVOID SystemArgument2);
+
+static
+PPFSN_TRACE_HEADER
+CcPfAllocateTrace(IN PPF_SCENARIO_ID ScenarioId,
+                  IN PF_SCENARIO_TYPE ScenarioType,
+                  IN PEPROCESS Process,
+                  IN ULONG MaxEntries,
+                  IN ULONG Period)
+{
+    PPFSN_TRACE_HEADER Trace;
+    PPFSN_LOG_ENTRIES Log;
+
+    /* Everything is touched at fault time, so it all lives in nonpaged pool */
+    Trace = ExAllocatePoolWithTag(NonPagedPool, sizeof(*Trace), TAG_PREFETCH);
+    if (!Trace) return NULL;
+
+    RtlZeroMemory(Trace, sizeof(*Trace));
+    Trace->Magic = PFSN_TRACE_HEADER_MAGIC;
+    Trace->ScenarioId = *ScenarioId;
+    Trace->ScenarioType = ScenarioType;
+    InitializeListHead(&Trace->TraceBuffersList);
+    KeInitializeSpinLock(&Trace->TraceBufferSpinLock);
+    KeInitializeTimer(&Trace->TraceTimer);
+    KeInitializeDpc(&Trace->TraceTimerDpc, CcPfTraceTimerDpc, Trace);
+    KeInitializeSpinLock(&Trace->TraceTimerSpinLock);
+    Trace->TraceTimerPeriod.QuadPart = Int32x32To64(Period, -10000);
+    Trace->MaxFaults = MaxEntries;
+    ExInitializeRundownProtection(&Trace->RefCount);
+    ExInitializeWorkItem(&Trace->EndTraceWorkItem, CcPfEndTraceWorker, Trace);
+    KeQuerySystemTime(&Trace->LaunchTime);
+
+    if (Process)
+    {
+        ObReferenceObject(Process);
+        Trace->Process = Process;
+    }
+
+    Log = ExAllocatePoolWithTag(NonPagedPool,
+                                FIELD_OFFSET(PFSN_LOG_ENTRIES, Entries[MaxEntries]),
+                                TAG_PREFETCH);
+    if (!Log) goto Failure;
+
+    Log->NumEntries = 0;
+    Log->MaxEntries = MaxEntries;
+    InsertTailList(&Trace->TraceBuffersList, &Log->TraceBuffersLink);
+    Trace->CurrentTraceBuffer = Log;
+    Trace->NumTraceBuffers = 1;
+
+    /* The file table and its hash index */
+    Trace->Sections = ExAllocatePoolWithTag(NonPagedPool,
+                                            PF_MAX_SECTIONS * sizeof(PFSN_SECTION) +
+                                            PF_SECTION_HASH_SIZE * sizeof(ULONG),
+                                            TAG_PREFETCH);
+    if (!Trace->Sections) goto Failure;
+
+    Trace->SectionHash = (PULONG)&Trace->Sections[PF_MAX_SECTIONS];
+    RtlZeroMemory(Trace->SectionHash, PF_SECTION_HASH_SIZE * sizeof(ULONG));
+    return Trace;
+
+Failure:
+    CcPfFreeTrace(Trace);
+    return NULL;
+}
+
+static
+VOID
+CcPfStartTrace(IN PPFSN_TRACE_HEADER Trace)
+{
+    KIRQL OldIrql;
+
+    /* Publish it to the fault and read paths */
+    KeAcquireSpinLock(&CcPfGlobals.ActiveTracesLock, &OldIrql);
+    InsertTailList(&CcPfGlobals.ActiveTraces, &Trace->ActiveTracesLink);
+    if (Trace->Process)
+    {
+        Trace->Process->PrefetchTrace.Value = (ULONG_PTR)Trace;
+    }
+    else
+    {
+        CcPfGlobals.SystemWideTrace = Trace;
+    }
+    InterlockedIncrement(&CcPfGlobals.NumActiveTraces);
+    KeReleaseSpinLock(&CcPfGlobals.ActiveTracesLock, OldIrql);
+
+    /* And have it end on its own */
+    KeAcquireSpinLock(&Trace->TraceTimerSpinLock, &OldIrql);
+    KeSetTimer(&Trace->TraceTimer, Trace->TraceTimerPeriod, &Trace->TraceTimerDpc);
+    KeReleaseSpinLock(&Trace->TraceTimerSpinLock, OldIrql);
+}
+
+/*
+ * The timer DPC is the only one ending a trace, so that once it queued the
+ * end work item nothing else is left pointing at the trace.
+ */
+static
+VOID
+NTAPI
+CcPfTraceTimerDpc(IN PKDPC Dpc,
+                  IN PVOID DeferredContext,
+                  IN PVOID SystemArgument1,
+                  IN PVOID SystemArgument2)
+{
+    PPFSN_TRACE_HEADER Trace = DeferredContext;
+    LONG NumFaults;
+    BOOLEAN EndTrace;
+
+    KeAcquireSpinLockAtDpcLevel(&Trace->TraceTimerSpinLock);
+
+    /* Remember how busy this period was */
+    NumFaults = Trace->NumFaults;
+    Trace->FaultsPerPeriod[Trace->CurPeriod] = NumFaults - Trace->LastNumFaults;
+    Trace->LastNumFaults = NumFaults;
+    Trace->CurPeriod++;
+
+    EndTrace = Trace->EndTraceRequested ||
+               (Trace->CurPeriod >= PF_MAX_TRACE_PERIODS) ||
+               (NumFaults >= Trace->MaxFaults);
+
+    /* A launch is over once the application stopped faulting */
+    if ((Trace->ScenarioType == PfApplicationLaunchScenarioType) &&
+        (Trace->CurPeriod >= PF_MIN_LAUNCH_PERIODS) &&
+        (Trace->FaultsPerPeriod[Trace->CurPeriod - 1] < PF_MIN_FAULTS_PER_PERIOD))
+    {
+        EndTrace = TRUE;
+    }
+
+    if (EndTrace)
+    {
+        Trace->EndTraceCalled = TRUE;
+        ExQueueWorkItem(&Trace->EndTraceWorkItem, DelayedWorkQueue);
+    }
+    else
+    {
+        KeSetTimer(&Trace->TraceTimer, Trace->TraceTimerPeriod, &Trace->TraceTimerDpc);
+    }
+
+    KeReleaseSpinLockFromDpcLevel(&Trace->TraceTimerSpinLock);
+}
+
+static
+VOID
+CcPfRequestEndTrace(IN PPFSN_TRACE_HEADER Trace)
+{
+    LARGE_INTEGER DueTime;
+    KIRQL OldIrql;
+
+    KeAcquireSpinLock(&Trace->TraceTimerSpinLock, &OldIrql);
+    if (!Trace->EndTraceCalled)
+    {
+        Trace->EndTraceRequested = TRUE;
+
+        /* If the timer already fired, its DPC will see the request */
+        if (KeCancelTimer(&Trace->TraceTimer))
+        {
+            DueTime.QuadPart = -1;
+            KeSetTimer(&Trace->TraceTimer, DueTime, &Trace->TraceTimerDpc);
+        }
+    }
+    KeReleaseSpinLock(&Trace->TraceTimerSpinLock, OldIrql);
+}
+
+static
+VOID
+CcPfBuildTraceFileName(IN PPF_SCENARIO_ID ScenarioId,
+                       OUT PUNICODE_STRING FileName,
+                       IN PWCHAR Buffer,
+                       IN ULONG BufferSize)
+{
+    RtlStringCbPrintfW(Buffer,
+                       BufferSize,
+                       L"%wZ\\%s-%08lX.pf",
+                       &CcPfPrefetchDirectory,
+                       ScenarioId->ScenName,
+                       ScenarioId->HashId);
+    RtlInitUnicodeString(FileName, Buffer);
+}
+
+static
+NTSTATUS
+CcPfWriteTraceFile(IN PPF_TRACE_HEADER Header)
+{
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatusBlock;
+    UNICODE_STRING FileName;
+    WCHAR Buffer[MAX_PATH];
+    LARGE_INTEGER ByteOffset;
+    HANDLE Handle;
+    NTSTATUS Status;
+
+    /* Create the prefetch directory the first time around */
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &CcPfPrefetchDirectory,
+                               OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE,
+                               NULL,
+                               NULL);
+    Status = ZwCreateFile(&Handle,
+                          FILE_LIST_DIRECTORY | SYNCHRONIZE,
+                          &ObjectAttributes,
+                          &IoStatusBlock,
+                          NULL,
+                          FILE_ATTRIBUTE_NORMAL,
+                          FILE_SHARE_READ | FILE_SHARE_WRITE,
+                          FILE_OPEN_IF,
+                          FILE_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT,
+                          NULL,
+                          0);
+    if (!NT_SUCCESS(Status)) return Status;
+    ZwClose(Handle);
+
+    /* The new trace replaces the one of the previous launch */
+    CcPfBuildTraceFileName(&Header->ScenarioId, &FileName, Buffer, sizeof(Buffer));
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &FileName,
+                               OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE,
+                               NULL,
+                               NULL);
+    Status = ZwCreateFile(&Handle,
+                          FILE_WRITE_DATA | SYNCHRONIZE,
+                          &ObjectAttributes,
+                          &IoStatusBlock,
+                          NULL,
+                          FILE_ATTRIBUTE_NORMAL,
+                          0,
+                          FILE_OVERWRITE_IF,
+                          FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT |
+                          FILE_SEQUENTIAL_ONLY,
+                          NULL,
+                          0);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    ByteOffset.QuadPart = 0;
+    Status = ZwWriteFile(Handle,
+                         NULL,
+                         NULL,
+                         NULL,
+                         &IoStatusBlock,
+                         Header,
+                         Header->Size,
+                         &ByteOffset,
+                         NULL);
+    ZwClose(Handle);
+    return Status;
+}
+
+static
+NTSTATUS
+CcPfSaveTrace(IN PPFSN_TRACE_HEADER Trace)
+{
+    PPFSN_LOG_ENTRIES Log = Trace->CurrentTraceBuffer;
+    POBJECT_NAME_INFORMATION *Names;
+    FILE_INTERNAL_INFORMATION InternalInformation;
+    PPF_TRACE_HEADER Header;
+    PPF_SECTION_INFO SectionInfo;
+    ULONG i, Size, NameOffset, ReturnLength;
+    NTSTATUS Status;
+
+    PAGED_CODE();
+
+    /* Get the names of the files, they are what the next launch opens */
+    Names = ExAllocatePoolWithTag(PagedPool,
+                                  max(Trace->NumSections, 1) * sizeof(POBJECT_NAME_INFORMATION),
+                                  TAG_PREFETCH);
+    if (!Names) return STATUS_INSUFFICIENT_RESOURCES;
+
+    Size = sizeof(PF_TRACE_HEADER) +
+           Log->NumEntries * sizeof(PF_LOG_ENTRY) +
+           Trace->NumSections * sizeof(PF_SECTION_INFO);
+    for (i = 0; i < Trace->NumSections; i++)
+    {
+        Names[i] = ExAllocatePoolWithTag(PagedPool,
+                                         sizeof(OBJECT_NAME_INFORMATION) + MAX_PATH * sizeof(WCHAR),
+                                         TAG_PREFETCH);
+        if (!Names[i]) continue;
+
+        Status = ObQueryNameString(Trace->Sections[i].FileObject,
+                                   Names[i],
+                                   sizeof(OBJECT_NAME_INFORMATION) + MAX_PATH * sizeof(WCHAR),
+                                   &ReturnLength);
+        if (!NT_SUCCESS(Status) || !Names[i]->Name.Length)
+        {
+            /* Stream files and the like can't be opened again, skip them */
+            ExFreePoolWithTag(Names[i], TAG_PREFETCH);
+            Names[i] = NULL;
+            continue;
+        }
+
+        Size += Names[i]->Name.Length + sizeof(UNICODE_NULL);
+    }
+
+    Header = ExAllocatePoolWithTag(PagedPool, Size, TAG_PREFETCH);
+    if (!Header)
+    {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto Quit;
+    }
+
+    /* Fill out the header */
+    RtlZeroMemory(Header, sizeof(PF_TRACE_HEADER));
+    Header->Version = PF_TRACE_VERSION;
+    Header->MagicNumber = PF_TRACE_MAGIC_NUMBER;
+    Header->Size = Size;
+    Header->ScenarioId = Trace->ScenarioId;
+    Header->ScenarioType = Trace->ScenarioType;
+    Header->TraceBufferOffset = sizeof(PF_TRACE_HEADER);
+    Header->NumEntries = Log->NumEntries;
+    Header->SectionInfoOffset = Header->TraceBufferOffset +
+                                Header->NumEntries * sizeof(PF_LOG_ENTRY);
+    Header->NumSections = Trace->NumSections;
+    RtlCopyMemory(Header->FaultsPerPeriod,
+                  Trace->FaultsPerPeriod,
+                  sizeof(Header->FaultsPerPeriod));
+    Header->LaunchTime = Trace->LaunchTime;
+
+    /* Then the entries, in the order the pages were touched */
+    RtlCopyMemory((PUCHAR)Header + Header->TraceBufferOffset,
+                  Log->Entries,
+                  Header->NumEntries * sizeof(PF_LOG_ENTRY));
+
+    /* And the files they belong to, followed by their names */
+    SectionInfo = (PPF_SECTION_INFO)((PUCHAR)Header + Header->SectionInfoOffset);
+    NameOffset = Header->SectionInfoOffset + Header->NumSections * sizeof(PF_SECTION_INFO);
+    for (i = 0; i < Trace->NumSections; i++)
+    {
+        RtlZeroMemory(&SectionInfo[i], sizeof(PF_SECTION_INFO));
+        SectionInfo[i].FileKey = i;
+        if (!Names[i]) continue;
+
+        /* Lets the next launch tell a replaced file apart */
+        Status = IoQueryFileInformation(Trace->Sections[i].FileObject,
+                                        FileInternalInformation,
+                                        sizeof(InternalInformation),
+                                        &InternalInformation,
+                                        &ReturnLength);
+        if (NT_SUCCESS(Status))
+        {
+            SectionInfo[i].FileIdLow = InternalInformation.IndexNumber.LowPart;
+            SectionInfo[i].FileIdHigh = InternalInformation.IndexNumber.HighPart;
+        }
+
+        SectionInfo[i].FileNameOffset = NameOffset;
+        SectionInfo[i].FileNameLength = Names[i]->Name.Length / sizeof(WCHAR);
+        RtlCopyMemory((PUCHAR)Header + NameOffset,
+                      Names[i]->Name.Buffer,
+                      Names[i]->Name.Length);
+        NameOffset += Names[i]->Name.Length;
+        *(PWCHAR)((PUCHAR)Header + NameOffset) = UNICODE_NULL;
+        NameOffset += sizeof(UNICODE_NULL);
+    }
+
+    ASSERT(NameOffset == Size);
+    Status = CcPfWriteTraceFile(Header);
+    ExFreePoolWithTag(Header, TAG_PREFETCH);
+
+Quit:
+    for (i = 0; i < Trace->NumSections; i++)
+    {
+        if (Names[i]) ExFreePoolWithTag(Names[i], TAG_PREFETCH);
+    }
+    ExFreePoolWithTag(Names, TAG_PREFETCH);
+    return Status;
+}
+
+static
+VOID
+NTAPI
+CcPfEndTraceWorker(IN PVOID Parameter)
+{
+    PPFSN_TRACE_HEADER Trace = Parameter;
+    NTSTATUS Status;
+    KIRQL OldIrql;
+
+    /* The timer DPC queued us, make sure it let go of the trace */
+    KeAcquireSpinLock(&Trace->TraceTimerSpinLock, &OldIrql);
+    ASSERT(Trace->EndTraceCalled);
+    KeReleaseSpinLock(&Trace->TraceTimerSpinLock, OldIrql);
+
+    /* Stop logging into it */
+    KeAcquireSpinLock(&CcPfGlobals.ActiveTracesLock, &OldIrql);
+    RemoveEntryList(&Trace->ActiveTracesLink);
+    if (Trace->Process)
+    {
+        Trace->Process->PrefetchTrace.Value = 0;
+    }
+    else
+    {
+        CcPfGlobals.SystemWideTrace = NULL;
+    }
+    InterlockedDecrement(&CcPfGlobals.NumActiveTraces);
+    KeReleaseSpinLock(&CcPfGlobals.ActiveTracesLock, OldIrql);
+
+    /* Wait for the faults being logged and the boot prefetch to be done */
+    ExWaitForRundownProtectionRelease(&Trace->RefCount);
+
+    DPRINT("Trace of %S ended with %lu entries in %lu files\n",
+           Trace->ScenarioId.ScenName,
+           Trace->CurrentTraceBuffer->NumEntries,
+           Trace->NumSections);
+
+    /* A handful of faults is not worth prefetching, keep the last trace then */
+    if (Trace->CurrentTraceBuffer->NumEntries >= PF_MIN_SAVED_ENTRIES)
+    {
+        Status = CcPfSaveTrace(Trace);
+        Trace->TraceDumpStatus = Status;
+        if (NT_SUCCESS(Status))
+        {
+            InterlockedIncrement(&CcPfGlobals.NumSavedTraces);
+        }
+        else
+        {
+            DPRINT1("Failed to save the trace of %S: 0x%lx\n",
+                    Trace->ScenarioId.ScenName, Status);
+        }
+    }
+
+    InterlockedIncrement(&CcPfGlobals.NumCompletedTraces);
+    CcPfFreeTrace(Trace);
+}
+
+static
+BOOLEAN
+CcPfVerifyTrace(IN PPF_TRACE_HEADER Header,
+                IN ULONG Size,
+                IN PPF_SCENARIO_ID ScenarioId,
+                IN PF_SCENARIO_TYPE ScenarioType)
+{
+    PPF_SECTION_INFO SectionInfo;
+    ULONG i;
+
+    /* Make sure it is a trace of this scenario */
+    if ((Size < sizeof(PF_TRACE_HEADER)) ||
+        (Header->Version != PF_TRACE_VERSION) ||
+        (Header->MagicNumber != PF_TRACE_MAGIC_NUMBER) ||
+        (Header->Size != Size) ||
+        (Header->ScenarioType != ScenarioType) ||
+        (RtlCompareMemory(&Header->ScenarioId, ScenarioId, sizeof(PF_SCENARIO_ID)) !=
+         sizeof(PF_SCENARIO_ID)))
+    {
+        return FALSE;
+    }
+
+    /* Everything it points at must be within the file */
+    if ((Header->TraceBufferOffset > Size) ||
+        (Header->NumEntries > (Size - Header->TraceBufferOffset) / sizeof(PF_LOG_ENTRY)) ||
+        (Header->SectionInfoOffset > Size) ||
+        (Header->NumSections > (Size - Header->SectionInfoOffset) / sizeof(PF_SECTION_INFO)) ||
+        (Header->TraceBufferOffset % sizeof(ULONG)) ||
+        (Header->SectionInfoOffset % sizeof(ULONG)))
+    {
+        return FALSE;
+    }
+
+    SectionInfo = (PPF_SECTION_INFO)((PUCHAR)Header + Header->SectionInfoOffset);
+    for (i = 0; i < Header->NumSections; i++)
+    {
+        if ((SectionInfo[i].FileNameOffset > Size) ||
+            (SectionInfo[i].FileNameOffset % sizeof(WCHAR)) ||
+            (SectionInfo[i].FileNameLength > MAXUSHORT / sizeof(WCHAR)) ||
+            (SectionInfo[i].FileNameLength >
+             (Size - SectionInfo[i].FileNameOffset) / sizeof(WCHAR)))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static
+NTSTATUS
+CcPfReadTrace(IN PPF_SCENARIO_ID ScenarioId,
+              IN PF_SCENARIO_TYPE ScenarioType,
+              OUT PPF_TRACE_HEADER *Trace)
+{
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatusBlock;
+    FILE_STANDARD_INFORMATION StandardInformation;
+    UNICODE_STRING FileName;
+    WCHAR Buffer[MAX_PATH];
+    LARGE_INTEGER ByteOffset;
+    PPF_TRACE_HEADER Header = NULL;
+    HANDLE Handle;
+    NTSTATUS Status;
+
+    PAGED_CODE();
+
+    CcPfBuildTraceFileName(ScenarioId, &FileName, Buffer, sizeof(Buffer));
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &FileName,
+                               OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE,
+                               NULL,
+                               NULL);
+    Status = ZwOpenFile(&Handle,
+                        FILE_READ_DATA | SYNCHRONIZE,
+                        &ObjectAttributes,
+                        &IoStatusBlock,
+                        FILE_SHARE_READ,
+                        FILE_NON_DIRECTORY_FILE | FILE_SYNCHRONOUS_IO_NONALERT |
+                        FILE_SEQUENTIAL_ONLY);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    Status = ZwQueryInformationFile(Handle,
+                                    &IoStatusBlock,
+                                    &StandardInformation,
+                                    sizeof(StandardInformation),
+                                    FileStandardInformation);
+    if (!NT_SUCCESS(Status)) goto Quit;
+
+    if ((StandardInformation.EndOfFile.QuadPart < sizeof(PF_TRACE_HEADER)) ||
+        (StandardInformation.EndOfFile.QuadPart > PF_MAX_TRACE_FILE_SIZE))
+    {
+        Status = STATUS_FILE_CORRUPT_ERROR;
+        goto Quit;
+    }
+
+    Header = ExAllocatePoolWithTag(PagedPool,
+                                   StandardInformation.EndOfFile.LowPart,
+                                   TAG_PREFETCH);
+    if (!Header)
+    {
+        Status = STATUS_INSUFFICIENT_RESOURCES;
+        goto Quit;
+    }
+
+    ByteOffset.QuadPart = 0;
+    Status = ZwReadFile(Handle,
+                        NULL,
+                        NULL,
+                        NULL,
+                        &IoStatusBlock,
+                        Header,
+                        StandardInformation.EndOfFile.LowPart,
+                        &ByteOffset,
+                        NULL);
+    if (!NT_SUCCESS(Status)) goto Quit;
+
+    if (!CcPfVerifyTrace(Header,
+                         (ULONG)IoStatusBlock.Information,
+                         ScenarioId,
+                         ScenarioType))
+    {
+        DPRINT1("Ignoring the invalid trace %wZ\n", &FileName);
+        Status = STATUS_FILE_CORRUPT_ERROR;
+        goto Quit;
+    }
+
+    *Trace = Header;
+    Header = NULL;
+
+Quit:
+    if (Header) ExFreePoolWithTag(Header, TAG_PREFETCH);
+    ZwClose(Handle);
+    return Status;
+}
+
+static
+int
+__cdecl
+CcPfCompareViews(IN const void *First,
+                 IN const void *Second)
+{
+    ULONGLONG A = *(const ULONGLONG *)First, B = *(const ULONGLONG *)Second;
+
+    return (A < B) ? -1 : (A > B) ? 1 : 0;
+}
+
+static
+HANDLE
+CcPfOpenPrefetchFile(IN PPF_TRACE_HEADER Header,
+                     IN PPF_SECTION_INFO SectionInfo)
+{
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatusBlock;
+    FILE_INTERNAL_INFORMATION InternalInformation;
+    UNICODE_STRING FileName;
+    HANDLE Handle;
+    NTSTATUS Status;
+
+    FileName.Buffer = (PWCHAR)((PUCHAR)Header + SectionInfo->FileNameOffset);
+    FileName.Length = (USHORT)(SectionInfo->FileNameLength * sizeof(WCHAR));
+    FileName.MaximumLength = FileName.Length;
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &FileName,
+                               OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE,
+                               NULL,
+                               NULL);
+
+    /* The reads are asynchronous, and must not trigger the read ahead */
+    Status = ZwOpenFile(&Handle,
+                        FILE_READ_DATA | FILE_READ_ATTRIBUTES,
+                        &ObjectAttributes,
+                        &IoStatusBlock,
+                        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                        FILE_NON_DIRECTORY_FILE | FILE_RANDOM_ACCESS);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT("Failed to open %wZ: 0x%lx\n", &FileName, Status);
+        return NULL;
+    }
+
+    /* A file that was replaced since has nothing in common with the trace */
+    if (SectionInfo->FileIdLow || SectionInfo->FileIdHigh)
+    {
+        Status = ZwQueryInformationFile(Handle,
+                                        &IoStatusBlock,
+                                        &InternalInformation,
+                                        sizeof(InternalInformation),
+                                        FileInternalInformation);
+        if (NT_SUCCESS(Status) &&
+            ((InternalInformation.IndexNumber.LowPart != SectionInfo->FileIdLow) ||
+             (InternalInformation.IndexNumber.HighPart != (LONG)SectionInfo->FileIdHigh)))
+        {
+            DPRINT("%wZ changed since it was traced\n", &FileName);
+            ZwClose(Handle);
+            return NULL;
+        }
+    }
+
+    return Handle;
+}
+
+/*
+ * Keeps the views of the file cached after its handle is closed, the same way
+ * a section does, so that the faults of the launch find them.
+ */
+static
+PFILE_OBJECT
+CcPfPinPrefetchedFile(IN HANDLE Handle)
+{
+    PFILE_OBJECT FileObject;
+    NTSTATUS Status;
+
+    Status = ObReferenceObjectByHandle(Handle,
+                                       0,
+                                       IoFileObjectType,
+                                       KernelMode,
+                                       (PVOID*)&FileObject,
+                                       NULL);
+    if (!NT_SUCCESS(Status)) return NULL;
+
+    /* Nothing was cached if every read failed */
+    if (!FileObject->SectionObjectPointer ||
+        !FileObject->SectionObjectPointer->SharedCacheMap)
+    {
+        ObDereferenceObject(FileObject);
+        return NULL;
+    }
+
+    CcRosReferenceCache(FileObject);
+    return FileObject;
+}
+
+/*
+ * Reads every view the trace touched, file by file and in file order. Cc
+ * brings in a whole view on the first access to it, so reading its first page
+ * is enough; the reads go out asynchronously through the file systems.
+ */
+static
+VOID
+CcPfReadViews(IN PPFSN_TRACE_HEADER Trace,
+              IN PPF_TRACE_HEADER Header,
+              IN PULONGLONG Views,
+              IN ULONG NumViews)
+{
+    PPF_SECTION_INFO SectionInfo;
+    HANDLE Events[PF_MAX_OUTSTANDING_READS];
+    IO_STATUS_BLOCK IoStatusBlocks[PF_MAX_OUTSTANDING_READS];
+    BOOLEAN Pending[PF_MAX_OUTSTANDING_READS];
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    LARGE_INTEGER ByteOffset;
+    PHANDLE Handles;
+    PUCHAR Buffer;
+    ULONG i, Slot, FileKey, NumEvents = 0;
+    LONGLONG BytesPrefetched = 0;
+    HANDLE Handle = NULL;
+    NTSTATUS Status;
+
+    SectionInfo = (PPF_SECTION_INFO)((PUCHAR)Header + Header->SectionInfoOffset);
+
+    Handles = ExAllocatePoolWithTag(PagedPool,
+                                    Header->NumSections * sizeof(HANDLE),
+                                    TAG_PREFETCH);
+    Trace->PrefetchedFiles = ExAllocatePoolWithTag(PagedPool,
+                                                   Header->NumSections * sizeof(PFILE_OBJECT),
+                                                   TAG_PREFETCH);
+    Buffer = ExAllocatePoolWithTag(PagedPool,
+                                   PF_MAX_OUTSTANDING_READS * PAGE_SIZE,
+                                   TAG_PREFETCH);
+    if (!Handles || !Trace->PrefetchedFiles || !Buffer) goto Quit;
+
+    RtlZeroMemory(Handles, Header->NumSections * sizeof(HANDLE));
+    RtlZeroMemory(Trace->PrefetchedFiles, Header->NumSections * sizeof(PFILE_OBJECT));
+    Trace->NumPrefetchedFiles = Header->NumSections;
+
+    InitializeObjectAttributes(&ObjectAttributes, NULL, OBJ_KERNEL_HANDLE, NULL, NULL);
+    for (NumEvents = 0; NumEvents < PF_MAX_OUTSTANDING_READS; NumEvents++)
+    {
+        Status = ZwCreateEvent(&Events[NumEvents],
+                               EVENT_ALL_ACCESS,
+                               &ObjectAttributes,
+                               NotificationEvent,
+                               FALSE);
+        if (!NT_SUCCESS(Status)) goto Quit;
+        Pending[NumEvents] = FALSE;
+    }
+
+    FileKey = MAXULONG;
+    Slot = 0;
+    for (i = 0; i < NumViews; i++)
+    {
+        /* The views are sorted by file, open the next one */
+        if ((ULONG)(Views[i] >> 32) != FileKey)
+        {
+            FileKey = (ULONG)(Views[i] >> 32);
+            Handle = CcPfOpenPrefetchFile(Header, &SectionInfo[FileKey]);
+            Handles[FileKey] = Handle;
+            if (Handle) InterlockedIncrement(&CcPfGlobals.NumPrefetchedFiles);
+        }
+
+        if (!Handle) continue;
+
+        /* Reuse the oldest slot once its read is done */
+        if (Pending[Slot])
+        {
+            ZwWaitForSingleObject(Events[Slot], FALSE, NULL);
+            Pending[Slot] = FALSE;
+        }
+
+        ByteOffset.QuadPart = (LONGLONG)(ULONG)Views[i] * VACB_MAPPING_GRANULARITY;
+        Status = ZwReadFile(Handle,
+                            Events[Slot],
+                            NULL,
+                            NULL,
+                            &IoStatusBlocks[Slot],
+                            Buffer + Slot * PAGE_SIZE,
+                            PAGE_SIZE,
+                            &ByteOffset,
+                            NULL);
+        if (Status == STATUS_PENDING)
+        {
+            Pending[Slot] = TRUE;
+        }
+        else if (!NT_SUCCESS(Status))
+        {
+            /* Past the end of a file that shrunk, most likely */
+            continue;
+        }
+
+        BytesPrefetched += VACB_MAPPING_GRANULARITY;
+        Slot = (Slot + 1) % PF_MAX_OUTSTANDING_READS;
+    }
+
+    /* Wait for the stragglers */
+    for (Slot = 0; Slot < PF_MAX_OUTSTANDING_READS; Slot++)
+    {
+        if (Pending[Slot]) ZwWaitForSingleObject(Events[Slot], FALSE, NULL);
+    }
+
+    InterlockedExchangeAdd64(&CcPfGlobals.NumPrefetchedBytes, BytesPrefetched);
+
+    /* Now the handles can go without the cache going with them */
+    for (FileKey = 0; FileKey < Header->NumSections; FileKey++)
+    {
+        if (!Handles[FileKey]) continue;
+
+        Trace->PrefetchedFiles[FileKey] = CcPfPinPrefetchedFile(Handles[FileKey]);
+    }
+
+Quit:
+    while (NumEvents--) ZwClose(Events[NumEvents]);
+
+    if (Handles)
+    {
+        for (FileKey = 0; FileKey < Header->NumSections; FileKey++)
+        {
+            if (Handles[FileKey]) ZwClose(Handles[FileKey]);
+        }
+        ExFreePoolWithTag(Handles, TAG_PREFETCH);
+    }
+
+    if (Buffer) ExFreePoolWithTag(Buffer, TAG_PREFETCH);
+}
+
+static
+VOID
+CcPfPrefetchScenario(IN PPFSN_TRACE_HEADER Trace)
+{
+    PPF_TRACE_HEADER Header;
+    PPF_LOG_ENTRY Entries;
+    PPF_SECTION_INFO SectionInfo;
+    PULONGLONG Views;
+    ULONG i, NumViews = 0;
+    NTSTATUS Status;
+
+    PAGED_CODE();
+
+    /* Nothing to do on the first launch */
+    Status = CcPfReadTrace(&Trace->ScenarioId, Trace->ScenarioType, &Header);
+    if (!NT_SUCCESS(Status)) return;
+
+    InterlockedIncrement(&CcPfGlobals.ActivePrefetches);
+
+    Views = ExAllocatePoolWithTag(PagedPool,
+                                  max(Header->NumEntries, 1) * sizeof(ULONGLONG),
+                                  TAG_PREFETCH);
+    if (!Views) goto Quit;
+
+    /* Turn the pages into the views holding them, keyed by file then offset */
+    Entries = (PPF_LOG_ENTRY)((PUCHAR)Header + Header->TraceBufferOffset);
+    SectionInfo = (PPF_SECTION_INFO)((PUCHAR)Header + Header->SectionInfoOffset);
+    for (i = 0; i < Header->NumEntries; i++)
+    {
+        if ((Entries[i].FileKey >= Header->NumSections) ||
+            !SectionInfo[Entries[i].FileKey].FileNameLength)
+        {
+            continue;
+        }
+
+        Views[NumViews++] = ((ULONGLONG)Entries[i].FileKey << 32) |
+                            (Entries[i].FileOffset / PF_PAGES_PER_VIEW);
+    }
+
+    /* Sort them so that each file is read front to back, once */
+    qsort(Views, NumViews, sizeof(ULONGLONG), CcPfCompareViews);
+    if (NumViews)
+    {
+        ULONG Unique = 1;
+
+        for (i = 1; i < NumViews; i++)
+        {
+            if (Views[i] != Views[Unique - 1]) Views[Unique++] = Views[i];
+        }
+        NumViews = Unique;
+    }
+
+    DPRINT("Prefetching %lu views of %S\n", NumViews, Trace->ScenarioId.ScenName);
+    CcPfReadViews(Trace, Header, Views, NumViews);
+    InterlockedIncrement(&CcPfGlobals.NumPrefetchedScenarios);
+    ExFreePoolWithTag(Views, TAG_PREFETCH);
+
+Quit:
+    InterlockedDecrement(&CcPfGlobals.ActivePrefetches);
+    ExFreePoolWithTag(Header, TAG_PREFETCH);
+}
+
+static
+NTSTATUS
+CcPfGetLaunchScenarioId(IN PEPROCESS Process,
+                        OUT PPF_SCENARIO_ID ScenarioId)
+{
+    PUNICODE_STRING ImageName;
+    ULONG i, Start = 0, Length;
+    NTSTATUS Status;
+
+    Status = SeLocateProcessImageName(Process, &ImageName);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    /* The name is the one of the image, the hash tells apart images of the same name */
+    for (i = 0; i < ImageName->Length / sizeof(WCHAR); i++)
+    {
+        if (ImageName->Buffer[i] == OBJ_NAME_PATH_SEPARATOR) Start = i + 1;
+    }
+
+    RtlZeroMemory(ScenarioId, sizeof(PF_SCENARIO_ID));
+    Length = min(ImageName->Length / sizeof(WCHAR) - Start,
+                 RTL_NUMBER_OF(ScenarioId->ScenName) - 1);
+    for (i = 0; i < Length; i++)
+    {
+        ScenarioId->ScenName[i] = RtlUpcaseUnicodeChar(ImageName->Buffer[Start + i]);
+    }
+
+    Status = RtlHashUnicodeString(ImageName,
+                                  TRUE,
+                                  HASH_STRING_ALGORITHM_X65599,
+                                  &ScenarioId->HashId);
+    if (NT_SUCCESS(Status) && !Length) Status = STATUS_OBJECT_NAME_INVALID;
+
+    ExFreePoolWithTag(ImageName, TAG_SEPA);
+    return Status;
+}
+
+static
+VOID
+NTAPI
+CcPfBootPrefetchThread(IN PVOID StartContext)
+{
+    PPFSN_TRACE_HEADER Trace = StartContext;
+
+    CcPfPrefetchScenario(Trace);
+
+    /* The trace may end now */
+    ExReleaseRundownProtection(&Trace->RefCount);
+    PsTerminateSystemThread(STATUS_SUCCESS);
+}
+
+static
+NTSTATUS
+CcPfBeginBootTrace(VOID)
+{
+    PF_SCENARIO_ID ScenarioId;
+    PPFSN_TRACE_HEADER Trace;
+    HANDLE ThreadHandle;
+    NTSTATUS Status;
+
+    if (!(CcPfEnableStatus & PF_ENABLE_BOOT)) return STATUS_SUCCESS;
+
+    RtlZeroMemory(&ScenarioId, sizeof(ScenarioId));
+    RtlCopyMemory(ScenarioId.ScenName, PF_BOOT_SCENARIO_NAME, sizeof(PF_BOOT_SCENARIO_NAME));
+    ScenarioId.HashId = PF_BOOT_SCENARIO_HASH;
+
+    Trace = CcPfAllocateTrace(&ScenarioId,
+                              PfSystemBootScenarioType,
+                              NULL,
+                              PF_MAX_BOOT_ENTRIES,
+                              PF_BOOT_TRACE_PERIOD);
+    if (!Trace) return STATUS_INSUFFICIENT_RESOURCES;
+
+    /* The prefetch runs alongside the boot, keep the trace until it is done */
+    ExAcquireRundownProtection(&Trace->RefCount);
+    CcPfStartTrace(Trace);
+
+    Status = PsCreateSystemThread(&ThreadHandle,
+                                  THREAD_ALL_ACCESS,
+                                  NULL,
+                                  NULL,
+                                  NULL,
+                                  CcPfBootPrefetchThread,
+                                  Trace);
+    if (!NT_SUCCESS(Status))
+    {
+        ExReleaseRundownProtection(&Trace->RefCount);
+        return Status;
+    }
+
+    ZwClose(ThreadHandle);
+    return STATUS_SUCCESS;
+}
+
+/* PUBLIC FUNCTIONS **********************************************************/
+
+VOID
+NTAPI
+CcPfLogEntry(IN PFILE_OBJECT FileObject,
+             IN LONGLONG FileOffset,
+             IN ULONG Length,
+             IN ULONG Type)
+{
+    PPFSN_TRACE_HEADER Traces[2];
+    ULONG Count;
+
+    /* Only files with a cache can be prefetched */
+    if (!Length || !FileObject->SectionObjectPointer) return;
+
+    Count = CcPfReferenceTraces(PsGetCurrentProcess(), Traces);
+    while (Count--)
+    {
+        CcPfLogRange(Traces[Count], FileObject, FileOffset, Length, Type);
+        ExReleaseRundownProtection(&Traces[Count]->RefCount);
+    }
+}
+
+/*
+ * Called on the first thread of a new process, before it runs any user code.
+ * Reads in what the last launch of the same image faulted in, then traces
+ * this launch to refresh it.
+ */
+VOID
+NTAPI
+CcPfBeginAppLaunch(IN PEPROCESS Process)
+{
+    PF_SCENARIO_ID ScenarioId;
+    PPFSN_TRACE_HEADER Trace;
+    NTSTATUS Status;
+
+    PAGED_CODE();
+
+    if (!(CcPfEnableStatus & PF_ENABLE_APPLICATION_LAUNCH)) return;
+
+    /* Only launched once */
+    if (PspSetProcessFlag(Process, PSF_LAUNCH_PREFETCHED_BIT) & PSF_LAUNCH_PREFETCHED_BIT)
+    {
+        return;
+    }
+
+    Status = CcPfGetLaunchScenarioId(Process, &ScenarioId);
+    if (!NT_SUCCESS(Status)) return;
+
+    Trace = CcPfAllocateTrace(&ScenarioId,
+                              PfApplicationLaunchScenarioType,
+                              Process,
+                              PF_MAX_LAUNCH_ENTRIES,
+                              PF_LAUNCH_TRACE_PERIOD);
+    if (!Trace) return;
+
+    /* Prefetch before tracing, so that our own reads don't get logged */
+    CcPfPrefetchScenario(Trace);
+    CcPfStartTrace(Trace);
+}
+
+NTSTATUS
+NTAPI
+CcPfBeginBootPhase(IN PF_BOOT_PHASE_ID Phase)
+{
+    PPFSN_TRACE_HEADER Trace;
+    NTSTATUS Status = STATUS_SUCCESS;
+    KIRQL OldIrql;
+
+    PAGED_CODE();
+
+    /* Phases only move forward */
+    if (Phase <= CcPfGlobals.BootPhase) return STATUS_INVALID_PARAMETER;
+    CcPfGlobals.BootPhase = Phase;
+
+    if (!CcPfEnablePrefetcher) return STATUS_SUCCESS;
+
+    if (Phase == PfSessionManagerInitPhase)
+    {
+        /* Everything before SMSS comes from the boot loader already */
+        Status = CcPfBeginBootTrace();
+    }
+    else if (Phase >= PfUserShellReadyPhase)
+    {
+        /* The boot is over once the shell is up */
+        KeAcquireSpinLock(&CcPfGlobals.ActiveTracesLock, &OldIrql);
+        Trace = CcPfGlobals.SystemWideTrace;
+        if (Trace) CcPfRequestEndTrace(Trace);
+        KeReleaseSpinLock(&CcPfGlobals.ActiveTracesLock, OldIrql);
+    }
+
+    return Status;
+}
+
+NTSTATUS
+NTAPI
+CcPfQueryPrefetcherInformation(IN PVOID SystemInformation,
+                               IN ULONG SystemInformationLength,
+                               IN KPROCESSOR_MODE PreviousMode,
+                               OUT PULONG Length)
+{
+    PREFETCHER_INFORMATION PrefetcherInformation;
+    PPF_SYSTEM_PREFETCH_PARAMETERS Parameters;
+
+    /* The caller already probed the buffer and guards the accesses */
+    *Length = sizeof(PREFETCHER_INFORMATION);
+    if (SystemInformationLength != sizeof(PREFETCHER_INFORMATION))
+    {
+        return STATUS_INFO_LENGTH_MISMATCH;
+    }
+
+    PrefetcherInformation = *(PPREFETCHER_INFORMATION)SystemInformation;
+    if ((PrefetcherInformation.Version != PREFETCHER_INFORMATION_VERSION) ||
+        (PrefetcherInformation.Magic != PREFETCHER_INFORMATION_MAGIC))
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    switch (PrefetcherInformation.PrefetcherInformationClass)
+    {
+        case PrefetcherSystemParameters:
+            if (PrefetcherInformation.PrefetcherInformationLength !=
+                sizeof(PF_SYSTEM_PREFETCH_PARAMETERS))
+            {
+                return STATUS_INFO_LENGTH_MISMATCH;
+            }
+
+            Parameters = PrefetcherInformation.PrefetcherInformation;
+            if (PreviousMode != KernelMode)
+            {
+                ProbeForWrite(Parameters, sizeof(*Parameters), sizeof(ULONG));
+            }
+
+            Parameters->EnableStatus = CcPfEnableStatus;
+            Parameters->ActiveTraces = CcPfGlobals.NumActiveTraces;
+            Parameters->TracesCompleted = CcPfGlobals.NumCompletedTraces;
+            Parameters->TracesSaved = CcPfGlobals.NumSavedTraces;
+            Parameters->ScenariosPrefetched = CcPfGlobals.NumPrefetchedScenarios;
+            Parameters->FilesPrefetched = CcPfGlobals.NumPrefetchedFiles;
+            Parameters->BytesPrefetched = CcPfGlobals.NumPrefetchedBytes;
+            return STATUS_SUCCESS;
+
+        default:
+            return STATUS_INVALID_INFO_CLASS;
+    }
+}
+
+NTSTATUS
+NTAPI
+CcPfSetPrefetcherInformation(IN PVOID SystemInformation,
+                             IN ULONG SystemInformationLength,
+                             IN KPROCESSOR_MODE PreviousMode)
+{
+    PREFETCHER_INFORMATION PrefetcherInformation;
+    PVOID Information;
+    ULONG Value;
+
+    PAGED_CODE();
+
+    if (SystemInformationLength != sizeof(PREFETCHER_INFORMATION))
+    {
+        return STATUS_INFO_LENGTH_MISMATCH;
+    }
+
+    PrefetcherInformation = *(PPREFETCHER_INFORMATION)SystemInformation;
+    if ((PrefetcherInformation.Version != PREFETCHER_INFORMATION_VERSION) ||
+        (PrefetcherInformation.Magic != PREFETCHER_INFORMATION_MAGIC))
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* Both classes take a single ULONG */
+    Information = PrefetcherInformation.PrefetcherInformation;
+    switch (PrefetcherInformation.PrefetcherInformationClass)
+    {
+        case PrefetcherSystemParameters:
+            if (PrefetcherInformation.PrefetcherInformationLength !=
+                sizeof(PF_SYSTEM_PREFETCH_PARAMETERS))
+            {
+                return STATUS_INFO_LENGTH_MISMATCH;
+            }
+            break;
+
+        case PrefetcherBootPhase:
+            if (PrefetcherInformation.PrefetcherInformationLength != sizeof(ULONG))
+            {
+                return STATUS_INFO_LENGTH_MISMATCH;
+            }
+            break;
+
+        default:
+            return STATUS_INVALID_INFO_CLASS;
+    }
+
+    if (PreviousMode != KernelMode) ProbeForRead(Information, sizeof(ULONG), sizeof(ULONG));
+    Value = *(PULONG)Information;
+
+    if (PrefetcherInformation.PrefetcherInformationClass == PrefetcherBootPhase)
+    {
+        return CcPfBeginBootPhase((PF_BOOT_PHASE_ID)Value);
+    }
+
+    /* Traces already running finish, nothing new gets traced */
+    CcPfEnableStatus = Value & (PF_ENABLE_APPLICATION_LAUNCH | PF_ENABLE_BOOT);
+    CcPfEnablePrefetcher = (CcPfEnableStatus != 0);
+    return STATUS_SUCCESS;
+}
+
+/* EOF */
@@ -481,6 +481,13 @@ INIT_SECTION CM_SYSTEM_CONTROL_VECTOR CmControlVector[] =
         NULL,
         NULL
     },
+    {
+        L"Session Manager\\Memory Management\\PrefetchParameters",
+        L"EnablePrefetcher",
+        &CcPfEnableStatus,
+        NULL,
+        NULL
+    },
     {
         L"Session Manager\\Executive",
         L"AdditionalCriticalWorkerThreads",
@@ -530,6 +537,13 @@ INIT_SECTION CM_SYSTEM_CONTROL_VECTOR CmControlVector[] =
         NULL,
         NULL
     },
+    {
+        L"Session Manager\\Kernel",
+        L"SystemCallStatistics",
+        &KiSystemCallStatistics,
+        NULL,
+        NULL
+    },
     {
         L"Session Manager\\Kernel",
         L"ObUnsecureGlobalNames",
@@ -547,7 +547,7 @@ ExpLoadInitialProcess(IN PINIT_BUFFER InitBuffer,
     RtlAppendUnicodeStringToString(&Environment, &NullString);
 
     /* Prepare the prefetcher */
-    //CcPfBeginBootPhase(150);
+    CcPfBeginBootPhase(PfSessionManagerInitPhase);
 
     /* Create SMSS process */
     SmssName = ProcessParams->ImagePathName;
@@ -1280,25 +1280,6 @@ ExpInitializeExecutive(IN ULONG Cpu,
     /* Initialize the Handle Table */
     ExpInitializeHandleTables();
 
-#if DBG
-    /* On checked builds, allocate the system call count table */
-    KeServiceDescriptorTable[0].Count =
-        ExAllocatePoolWithTag(NonPagedPool,
-                              KiServiceLimit * sizeof(ULONG),
-                              'llaC');
-
-    /* Use it for the shadow table too */
-    KeServiceDescriptorTableShadow[0].Count = KeServiceDescriptorTable[0].Count;
-
-    /* Make sure allocation succeeded */
-    if (KeServiceDescriptorTable[0].Count)
-    {
-        /* Zero the call counts to 0 */
-        RtlZeroMemory(KeServiceDescriptorTable[0].Count,
-                      KiServiceLimit * sizeof(ULONG));
-    }
-#endif
-
     /* Create the Basic Object Manager Types to allow new Object Types */
     if (!ObInitSystem()) KeBugCheck(OBJECT_INITIALIZATION_FAILED);
 
@@ -1611,6 +1592,9 @@ Phase1InitializationDiscard(IN PVOID Context)
     /* Update the progress bar */
     InbvUpdateProgressBar(5);
 
+    /* All processors are known now, set up the system call statistics */
+    KiInitializeServiceStatistics(0, KiServiceLimit);
+
     /* Call OB initialization again */
     if (!ObInitSystem()) KeBugCheck(OBJECT1_INITIALIZATION_FAILED);
 
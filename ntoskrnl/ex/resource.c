@@ -18,6 +18,20 @@
 #define IsOwnedExclusive(r)     (r->Flag & ResourceOwnedExclusive)
 #define IsBoostAllowed(r)       (!(r->Flag & ResourceHasDisabledPriorityBoost))
 
+/*
+ * ActiveCount and Flag make up a single 32-bit state word, which the
+ * uncontended exclusive acquire claims with one compare-exchange, without
+ * the resource lock. Whenever the resource can be unowned, they may thus
+ * only be changed atomically, through that word.
+ */
+C_ASSERT(FIELD_OFFSET(ERESOURCE, Flag) == FIELD_OFFSET(ERESOURCE, ActiveCount) + sizeof(SHORT));
+#define ExpResourceState(r)         ((volatile LONG *)&(r)->ActiveCount)
+#define ExpResourceStateFlag(f)     ((LONG)(f) << 16)
+#define ExpSetResourceFlag(r, f)    InterlockedOr((PLONG)ExpResourceState(r), ExpResourceStateFlag(f))
+#define ExpClearResourceFlag(r, f)  InterlockedAnd((PLONG)ExpResourceState(r), ~ExpResourceStateFlag(f))
+#define ExpClearResourceActive(r)   InterlockedAnd((PLONG)ExpResourceState(r), \
+                                                   ~(ExpResourceStateFlag(ResourceOwnedExclusive) | 0xFFFF))
+
 #if (!(defined(CONFIG_SMP)) && !(DBG))
 
 FORCEINLINE
@@ -76,6 +90,26 @@ KSPIN_LOCK ExpResourceSpinLock;
 LIST_ENTRY ExpSystemResourcesList;
 BOOLEAN ExResourceStrict = TRUE;
 
+/*
+ * How long to spin on a contended resource before blocking on MP. This
+ * follows how long owners have recently been holding on to resources.
+ */
+#define EXP_RESOURCE_MIN_SPIN_COUNT 16
+#define EXP_RESOURCE_MAX_SPIN_COUNT 4096
+ULONG ExpResourceSpinCount = 512;
+
+/* Time spent waiting on the resources that ever had to be waited on */
+typedef struct _EXP_RESOURCE_WAIT_ENTRY
+{
+    LIST_ENTRY HashLinks;
+    PERESOURCE Resource;
+    ULONGLONG WaitTime;
+} EXP_RESOURCE_WAIT_ENTRY, *PEXP_RESOURCE_WAIT_ENTRY;
+
+LIST_ENTRY ExpResourceWaitTable[RESOURCE_HASH_TABLE_SIZE];
+#define ExpResourceWaitBucket(r) \
+    (&ExpResourceWaitTable[((ULONG_PTR)(r) / sizeof(ERESOURCE)) % RESOURCE_HASH_TABLE_SIZE])
+
 /* PRIVATE FUNCTIONS *********************************************************/
 
 #if DBG
@@ -151,6 +185,286 @@ ExpCheckForApcsDisabled(IN KIRQL Irql,
 #define ExpCheckForApcsDisabled(b,r,t)
 #endif
 
+/*++
+ * @name ExpAcquireResourceRecursive
+ *
+ *     The ExpAcquireResourceRecursive routine acquires a resource again for
+ *     the thread that already owns its first owner entry, without taking
+ *     the resource lock.
+ *
+ * @param Resource
+ *        Pointer to the resource to acquire.
+ *
+ * @param Thread
+ *        Identifies the calling thread.
+ *
+ * @param Exclusive
+ *        Specifies whether the caller wants exclusive access.
+ *
+ * @return TRUE if the resource was acquired, FALSE if the caller must go
+ *         through the locked path.
+ *
+ * @remarks The first owner entry only changes hands under the resource lock,
+ *          or through ExpAcquireResourceUnowned while nobody owns it, and
+ *          never while its owner is busy acquiring the resource again. The
+ *          owner is thus free to update its own count, as long as it does so
+ *          atomically.
+ *
+ *--*/
+FORCEINLINE
+BOOLEAN
+ExpAcquireResourceRecursive(IN PERESOURCE Resource,
+                            IN ERESOURCE_THREAD Thread,
+                            IN BOOLEAN Exclusive)
+{
+    OWNER_ENTRY OldEntry, NewEntry;
+    LONG Value;
+
+    /* Check if we own the first entry, exclusively if that's what we want */
+    if ((Resource->OwnerEntry.OwnerThread != Thread) ||
+        ((Exclusive) && !(IsOwnedExclusive(Resource))))
+    {
+        return FALSE;
+    }
+
+    /* Increase the owning count */
+    OldEntry.TableSize = *(volatile ULONG *)&Resource->OwnerEntry.TableSize;
+    for (;;)
+    {
+        NewEntry.TableSize = OldEntry.TableSize;
+        NewEntry.OwnerCount++;
+        ASSERT(NewEntry.OwnerCount != 0);
+
+        Value = InterlockedCompareExchange((PLONG)&Resource->OwnerEntry.TableSize,
+                                           NewEntry.TableSize,
+                                           OldEntry.TableSize);
+        if (Value == (LONG)OldEntry.TableSize) return TRUE;
+        OldEntry.TableSize = Value;
+    }
+}
+
+/*++
+ * @name ExpReleaseResourceRecursive
+ *
+ *     The ExpReleaseResourceRecursive routine undoes a nested acquire of the
+ *     first owner entry without taking the resource lock.
+ *
+ * @param Resource
+ *        Pointer to the resource to release.
+ *
+ * @param Thread
+ *        Identifies the thread that acquired the resource.
+ *
+ * @return TRUE if the resource was released, FALSE if this is the last
+ *         release and the caller must go through the locked path.
+ *
+ * @remarks See ExpAcquireResourceRecursive.
+ *
+ *--*/
+FORCEINLINE
+BOOLEAN
+ExpReleaseResourceRecursive(IN PERESOURCE Resource,
+                            IN ERESOURCE_THREAD Thread)
+{
+    OWNER_ENTRY OldEntry, NewEntry;
+    LONG Value;
+
+    /* Check if we own the first entry */
+    if (Resource->OwnerEntry.OwnerThread != Thread) return FALSE;
+
+    /* Decrease the owning count, as long as it doesn't drop to zero */
+    OldEntry.TableSize = *(volatile ULONG *)&Resource->OwnerEntry.TableSize;
+    while (OldEntry.OwnerCount > 1)
+    {
+        NewEntry.TableSize = OldEntry.TableSize;
+        NewEntry.OwnerCount--;
+
+        Value = InterlockedCompareExchange((PLONG)&Resource->OwnerEntry.TableSize,
+                                           NewEntry.TableSize,
+                                           OldEntry.TableSize);
+        if (Value == (LONG)OldEntry.TableSize) return TRUE;
+        OldEntry.TableSize = Value;
+    }
+
+    /* Ownership changes, take the lock */
+    return FALSE;
+}
+
+/*++
+ * @name ExpClaimResource
+ *
+ *     The ExpClaimResource routine makes the given resource active, if
+ *     nobody owns it.
+ *
+ * @param Resource
+ *        Pointer to the resource to claim.
+ *
+ * @param Exclusive
+ *        Specifies whether the resource is being claimed for exclusive access.
+ *
+ * @return TRUE if the resource was claimed, FALSE if it's owned already.
+ *
+ * @remarks The caller must fill the owner entry and the active entries.
+ *          Until then, the resource looks active, but owned by nobody.
+ *
+ *--*/
+FORCEINLINE
+BOOLEAN
+ExpClaimResource(IN PERESOURCE Resource,
+                 IN BOOLEAN Exclusive)
+{
+    LONG OldState, NewState, Value;
+
+    /* Loop as long as nobody owns it, the flags might change meanwhile */
+    OldState = *ExpResourceState(Resource);
+    while (!(SHORT)OldState)
+    {
+        NewState = OldState + 1;
+        if (Exclusive) NewState |= ExpResourceStateFlag(ResourceOwnedExclusive);
+
+        Value = InterlockedCompareExchange((PLONG)ExpResourceState(Resource),
+                                           NewState,
+                                           OldState);
+        if (Value == OldState) return TRUE;
+        OldState = Value;
+    }
+
+    /* Someone got there first */
+    return FALSE;
+}
+
+/*++
+ * @name ExpAcquireResourceUnowned
+ *
+ *     The ExpAcquireResourceUnowned routine acquires an unowned resource for
+ *     exclusive access, without taking the resource lock.
+ *
+ * @param Resource
+ *        Pointer to the resource to acquire.
+ *
+ * @param Thread
+ *        Identifies the calling thread.
+ *
+ * @return TRUE if the resource was acquired, FALSE if the caller must go
+ *         through the locked path.
+ *
+ * @remarks Shared acquires can't do the same: a shared acquire under the
+ *          lock could pick the first owner entry before it is filled.
+ *          Exclusive acquires under the lock go wait instead, since the
+ *          claim marks the resource as owned exclusive.
+ *
+ *--*/
+FORCEINLINE
+BOOLEAN
+ExpAcquireResourceUnowned(IN PERESOURCE Resource,
+                          IN ERESOURCE_THREAD Thread)
+{
+    /* Claim the resource if nobody owns it */
+    if (!ExpClaimResource(Resource, TRUE)) return FALSE;
+
+    /* We own it now, fill in the owner */
+    ASSERT(Resource->ActiveEntries == 0);
+    Resource->OwnerEntry.OwnerThread = Thread;
+    Resource->OwnerEntry.OwnerCount = 1;
+    Resource->ActiveEntries = 1;
+    return TRUE;
+}
+
+/*++
+ * @name ExpFindResourceWaitEntry
+ *
+ *     The ExpFindResourceWaitEntry routine looks up the wait time record of
+ *     the given resource.
+ *
+ * @param Resource
+ *        Pointer to the resource.
+ *
+ * @return Pointer to the record, or NULL if nobody ever waited on the
+ *         resource.
+ *
+ * @remarks The caller must hold ExpResourceSpinLock.
+ *
+ *--*/
+PEXP_RESOURCE_WAIT_ENTRY
+FASTCALL
+ExpFindResourceWaitEntry(IN PERESOURCE Resource)
+{
+    PLIST_ENTRY ListHead, NextEntry;
+    PEXP_RESOURCE_WAIT_ENTRY WaitEntry;
+
+    /* Loop the bucket */
+    ListHead = ExpResourceWaitBucket(Resource);
+    for (NextEntry = ListHead->Flink; NextEntry != ListHead; NextEntry = NextEntry->Flink)
+    {
+        /* Check if it's our resource */
+        WaitEntry = CONTAINING_RECORD(NextEntry, EXP_RESOURCE_WAIT_ENTRY, HashLinks);
+        if (WaitEntry->Resource == Resource) return WaitEntry;
+    }
+
+    /* Not found */
+    return NULL;
+}
+
+/*++
+ * @name ExpAccountResourceWait
+ *
+ *     The ExpAccountResourceWait routine adds the time spent by a thread
+ *     waiting on the given resource to its total.
+ *
+ * @param Resource
+ *        Pointer to the resource that was waited on.
+ *
+ * @param WaitTime
+ *        Time spent waiting, in 100ns units.
+ *
+ * @return None.
+ *
+ * @remarks The record is created on the first wait, and dropped if there is
+ *          no memory for it.
+ *
+ *--*/
+VOID
+FASTCALL
+ExpAccountResourceWait(IN PERESOURCE Resource,
+                       IN ULONGLONG WaitTime)
+{
+    KLOCK_QUEUE_HANDLE LockHandle;
+    PEXP_RESOURCE_WAIT_ENTRY WaitEntry, NewEntry = NULL;
+
+    /* Look for the record */
+    KeAcquireInStackQueuedSpinLock(&ExpResourceSpinLock, &LockHandle);
+    WaitEntry = ExpFindResourceWaitEntry(Resource);
+    if (!WaitEntry)
+    {
+        /* This is the first wait, allocate the record without the lock */
+        KeReleaseInStackQueuedSpinLock(&LockHandle);
+        NewEntry = ExAllocatePoolWithTag(NonPagedPool,
+                                         sizeof(EXP_RESOURCE_WAIT_ENTRY),
+                                         TAG_RESOURCE_WAIT);
+        if (!NewEntry) return;
+
+        /* Someone else might have created it meanwhile */
+        KeAcquireInStackQueuedSpinLock(&ExpResourceSpinLock, &LockHandle);
+        WaitEntry = ExpFindResourceWaitEntry(Resource);
+        if (!WaitEntry)
+        {
+            /* Nope, insert ours */
+            WaitEntry = NewEntry;
+            NewEntry = NULL;
+            WaitEntry->Resource = Resource;
+            WaitEntry->WaitTime = 0;
+            InsertTailList(ExpResourceWaitBucket(Resource), &WaitEntry->HashLinks);
+        }
+    }
+
+    /* Add our time */
+    WaitEntry->WaitTime += WaitTime;
+    KeReleaseInStackQueuedSpinLock(&LockHandle);
+
+    /* Free our record if we lost the race */
+    if (NewEntry) ExFreePoolWithTag(NewEntry, TAG_RESOURCE_WAIT);
+}
+
 /*++
  * @name ExpResourceInitialization
  *
@@ -168,10 +482,18 @@ VOID
 NTAPI
 ExpResourceInitialization(VOID)
 {
+    ULONG i;
+
     /* Setup the timeout */
     ExpTimeout.QuadPart = Int32x32To64(4, -10000000);
     InitializeListHead(&ExpSystemResourcesList);
     KeInitializeSpinLock(&ExpResourceSpinLock);
+
+    /* Setup the wait time records */
+    for (i = 0; i < RESOURCE_HASH_TABLE_SIZE; i++)
+    {
+        InitializeListHead(&ExpResourceWaitTable[i]);
+    }
 }
 
 /*++
@@ -420,7 +742,7 @@ ExpFindFreeEntry(IN PERESOURCE Resource,
 
     /* Sanity check */
     ASSERT(LockHandle != 0);
-    ASSERT(Resource->OwnerEntry.OwnerThread != 0);
+    ASSERT(Resource->ActiveCount != 0);
 
     /* Get the current table pointer */
     Owner = Resource->OwnerTable;
@@ -550,6 +872,88 @@ Expand:
     }
 }
 
+/*++
+ * @name ExpSpinForResource
+ *
+ *     The ExpSpinForResource routine busy-waits for a little while on a
+ *     contended resource, before the caller decides to block on it.
+ *
+ * @param Resource
+ *        Pointer to the resource to spin on.
+ *
+ * @param LockHandle
+ *        Pointer to in-stack queued spinlock.
+ *
+ * @param Exclusive
+ *        Specifies whether the caller wants exclusive access.
+ *
+ * @return TRUE if the lock was dropped and the caller must check the
+ *         resource again, FALSE if spinning is pointless on this system.
+ *
+ * @remarks Owners usually hold a resource for a short time, so this saves
+ *          the two context switches of a wait. Only done on MP systems,
+ *          where the owner can make progress meanwhile.
+ *
+ *          How long it took for the resource to become available tells how
+ *          long owners hold on to resources, and the spin count follows it,
+ *          with some headroom. Giving up means they hold on for longer than
+ *          spinning is worth, so the spin count shrinks.
+ *
+ *--*/
+BOOLEAN
+FASTCALL
+ExpSpinForResource(IN PERESOURCE Resource,
+                   IN PKLOCK_QUEUE_HANDLE LockHandle,
+                   IN BOOLEAN Exclusive)
+{
+    volatile ERESOURCE *VolatileResource = Resource;
+    ULONG SpinCount, SpinLimit;
+    LONG Target;
+
+    /* Nobody can release the resource while we spin on UP */
+    if (KeNumberProcessors == 1) return FALSE;
+
+    /* Release the lock */
+    ExReleaseResourceLock(Resource, LockHandle);
+
+    /* Spin until the resource looks available, or we give up */
+    SpinLimit = ExpResourceSpinCount;
+    for (SpinCount = 0; SpinCount < SpinLimit; SpinCount++)
+    {
+        YieldProcessor();
+
+        if (Exclusive)
+        {
+            /* We need it unowned */
+            if (!VolatileResource->ActiveCount) break;
+        }
+        else
+        {
+            /* Shared owners are fine, unless an exclusive owner is queued */
+            if (!(VolatileResource->Flag & ResourceOwnedExclusive) &&
+                !(VolatileResource->NumberOfExclusiveWaiters))
+            {
+                break;
+            }
+        }
+    }
+
+    /* Move the spin count an eighth of the way towards what we saw */
+    Target = (SpinCount < SpinLimit) ? (LONG)(SpinCount * 2) : (LONG)(SpinLimit / 2);
+    SpinLimit += (Target - (LONG)SpinLimit) / 8;
+
+    /*
+     * Other spinners might be updating it too, we don't mind losing their
+     * update since this is only an estimate
+     */
+    ExpResourceSpinCount = min(max(SpinLimit, EXP_RESOURCE_MIN_SPIN_COUNT),
+                               EXP_RESOURCE_MAX_SPIN_COUNT);
+
+    /* Lock the resource again */
+    ExAcquireResourceLock(Resource, LockHandle);
+    return TRUE;
+}
+
 /*++
  * @name ExpBoostOwnerThread
  *
@@ -624,6 +1028,7 @@ ExpWaitForResource(IN PERESOURCE Resource,
     ULONG WaitCount = 0;
     NTSTATUS Status;
     LARGE_INTEGER Timeout;
+    ULONGLONG WaitStart;
     PKTHREAD Thread, OwnerThread;
 #if DBG
     KLOCK_QUEUE_HANDLE LockHandle;
@@ -631,6 +1036,7 @@ ExpWaitForResource(IN PERESOURCE Resource,
 
     /* Increase contention count and use a 5 second timeout */
     Resource->ContentionCount++;
+    WaitStart = KeQueryInterruptTime();
     Timeout.QuadPart = 500 * -10000;
     for (;;)
     {
@@ -727,6 +1133,133 @@ ExpWaitForResource(IN PERESOURCE Resource,
             }
         }
     }
+
+    /* Account for the time we spent waiting */
+    ExpAccountResourceWait(Resource, KeQueryInterruptTime() - WaitStart);
+}
+
+/*++
+ * @name ExQuerySystemLockInformation
+ *
+ *     The ExQuerySystemLockInformation routine returns a snapshot of every
+ *     resource in the system, along with its contention statistics.
+ *     ContentionCount is the number of times a thread had to wait for the
+ *     resource. The lock array is followed by the total time spent waiting
+ *     on each resource, see RTL_PROCESS_LOCKS_WAIT_TIMES_OFFSET.
+ *
+ * @param LockInformation
+ *        Pointer to the RTL_PROCESS_LOCKS buffer to fill.
+ *
+ * @param LockInformationLength
+ *        Size of the buffer, in bytes.
+ *
+ * @param ReturnLength
+ *        Receives the size needed for all the resources.
+ *
+ * @return STATUS_SUCCESS, or STATUS_INFO_LENGTH_MISMATCH if the buffer is
+ *         too small.
+ *
+ * @remarks The buffer can be a user-mode one, it is only written to once the
+ *          resource list lock has been released.
+ *
+ *--*/
+NTSTATUS
+NTAPI
+ExQuerySystemLockInformation(OUT PRTL_PROCESS_LOCKS LockInformation,
+                             IN ULONG LockInformationLength,
+                             OUT PULONG ReturnLength)
+{
+    KLOCK_QUEUE_HANDLE LockHandle;
+    PLIST_ENTRY NextEntry;
+    PERESOURCE Resource;
+    PRTL_PROCESS_LOCK_INFORMATION Locks;
+    PEXP_RESOURCE_WAIT_ENTRY WaitEntry;
+    PULONGLONG WaitTimes;
+    ERESOURCE_THREAD OwnerThread;
+    ULONG Count, i;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    /* Count the resources */
+    Count = 0;
+    KeAcquireInStackQueuedSpinLock(&ExpResourceSpinLock, &LockHandle);
+    for (NextEntry = ExpSystemResourcesList.Flink;
+         NextEntry != &ExpSystemResourcesList;
+         NextEntry = NextEntry->Flink)
+    {
+        Count++;
+    }
+    KeReleaseInStackQueuedSpinLock(&LockHandle);
+
+    /* Make sure the caller can take them all, along with their wait times */
+    *ReturnLength = RTL_PROCESS_LOCKS_WAIT_TIMES_OFFSET(Count) +
+                    Count * sizeof(ULONGLONG);
+    if (LockInformationLength < *ReturnLength) return STATUS_INFO_LENGTH_MISMATCH;
+
+    /* Take the snapshot in a nonpaged buffer */
+    WaitTimes = ExAllocatePoolWithTag(NonPagedPool,
+                                      max(Count, 1) * (sizeof(ULONGLONG) +
+                                                       sizeof(RTL_PROCESS_LOCK_INFORMATION)),
+                                      TAG_RESOURCE_LOCKS);
+    if (!WaitTimes) return STATUS_INSUFFICIENT_RESOURCES;
+    Locks = (PRTL_PROCESS_LOCK_INFORMATION)(WaitTimes + max(Count, 1));
+
+    /* Resources might have come and gone meanwhile, take what fits */
+    i = 0;
+    KeAcquireInStackQueuedSpinLock(&ExpResourceSpinLock, &LockHandle);
+    for (NextEntry = ExpSystemResourcesList.Flink;
+         (NextEntry != &ExpSystemResourcesList) && (i < Count);
+         NextEntry = NextEntry->Flink)
+    {
+        Resource = CONTAINING_RECORD(NextEntry, ERESOURCE, SystemResourcesList);
+
+        /* Owners set with ExSetResourceOwnerPointer aren't threads */
+        OwnerThread = Resource->OwnerEntry.OwnerThread;
+        if ((OwnerThread) && !(OwnerThread & 3))
+        {
+            OwnerThread = (ERESOURCE_THREAD)PsGetThreadId((PETHREAD)OwnerThread);
+        }
+        else
+        {
+            OwnerThread = 0;
+        }
+
+        Locks[i].Address = Resource;
+        Locks[i].Type = RTL_RESOURCE_TYPE;
+        Locks[i].CreatorBackTraceIndex = 0;
+        Locks[i].OwnerThreadId = (ULONG)OwnerThread;
+        Locks[i].ActiveCount = Resource->ActiveEntries;
+        Locks[i].ContentionCount = Resource->ContentionCount;
+        Locks[i].EntryCount = 0;
+        Locks[i].RecursionCount = Resource->OwnerEntry.OwnerCount;
+        Locks[i].NumberOfSharedWaiters = Resource->NumberOfSharedWaiters;
+        Locks[i].NumberOfExclusiveWaiters = Resource->NumberOfExclusiveWaiters;
+
+        /* Resources nobody waited on have no record */
+        WaitEntry = ExpFindResourceWaitEntry(Resource);
+        WaitTimes[i] = WaitEntry ? WaitEntry->WaitTime : 0;
+        i++;
+    }
+    KeReleaseInStackQueuedSpinLock(&LockHandle);
+
+    /* Copy it out, the caller might have handed us a bad buffer */
+    _SEH2_TRY
+    {
+        LockInformation->NumberOfLocks = i;
+        RtlCopyMemory(LockInformation->Locks,
+                      Locks,
+                      i * sizeof(RTL_PROCESS_LOCK_INFORMATION));
+        RtlCopyMemory((PUCHAR)LockInformation + RTL_PROCESS_LOCKS_WAIT_TIMES_OFFSET(i),
+                      WaitTimes,
+                      i * sizeof(ULONGLONG));
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+        Status = _SEH2_GetExceptionCode();
+    }
+    _SEH2_END;
+
+    ExFreePoolWithTag(WaitTimes, TAG_RESOURCE_LOCKS);
+    return Status;
 }
 
 /* FUNCTIONS *****************************************************************/
@@ -772,7 +1305,7 @@ ExAcquireResourceExclusiveLite(IN PERESOURCE Resource,
 {
     KLOCK_QUEUE_HANDLE LockHandle;
     ERESOURCE_THREAD Thread;
-    BOOLEAN Success;
+    BOOLEAN Success, Spun = FALSE;
 
     /* Sanity check */
     ASSERT((Resource->Flag & ResourceNeverExclusive) == 0);
@@ -783,14 +1316,18 @@ ExAcquireResourceExclusiveLite(IN PERESOURCE Resource,
     /* Sanity check and validation */
     ASSERT(KeIsExecutingDpc() == FALSE);
     ExpVerifyResource(Resource);
+    ExpCheckForApcsDisabled(KeGetCurrentIrql(), Resource, (PKTHREAD)Thread);
+
+    /* Recursive and uncontended acquires don't need the lock */
+    if (ExpAcquireResourceRecursive(Resource, Thread, TRUE)) return TRUE;
+    if (ExpAcquireResourceUnowned(Resource, Thread)) return TRUE;
 
     /* Acquire the lock */
     ExAcquireResourceLock(Resource, &LockHandle);
-    ExpCheckForApcsDisabled(LockHandle.OldIrql, Resource, (PKTHREAD)Thread);
 
     /* Check if there is a shared owner or exclusive owner */
 TryAcquire:
-    if (Resource->ActiveEntries)
+    if (Resource->ActiveCount)
     {
         /* Check if it's exclusively owned, and we own it */   
         if ((IsOwnedExclusive(Resource)) &&
@@ -813,6 +1350,13 @@ TryAcquire:
             }
             else
             {
+                /* Give the owner a chance to release it before we block */
+                if (!Spun)
+                {
+                    Spun = TRUE;
+                    if (ExpSpinForResource(Resource, &LockHandle, TRUE)) goto TryAcquire;
+                }
+
                 /* Check if it has exclusive waiters */
                 if (!Resource->ExclusiveWaiters)
                 {
@@ -835,11 +1379,9 @@ TryAcquire:
     else
     {
         /* Nobody owns it, so let's! */
+        if (!ExpClaimResource(Resource, TRUE)) goto TryAcquire;
         ASSERT(Resource->ActiveEntries == 0);
-        ASSERT(Resource->ActiveCount == 0);
-        Resource->Flag |= ResourceOwnedExclusive;
         Resource->ActiveEntries = 1;
-        Resource->ActiveCount = 1;
         Resource->OwnerEntry.OwnerThread = Thread;
         Resource->OwnerEntry.OwnerCount = 1;
         Success = TRUE;
@@ -888,7 +1430,7 @@ ExAcquireResourceSharedLite(IN PERESOURCE Resource,
     KLOCK_QUEUE_HANDLE LockHandle;
     ERESOURCE_THREAD Thread;
     POWNER_ENTRY Owner = NULL;
-    BOOLEAN FirstEntryBusy;
+    BOOLEAN FirstEntryBusy, Spun = FALSE;
 
     /* Get the thread */
     Thread = ExGetCurrentResourceThread();
@@ -896,13 +1438,17 @@ ExAcquireResourceSharedLite(IN PERESOURCE Resource,
     /* Sanity check and validation */
     ASSERT(KeIsExecutingDpc() == FALSE);
     ExpVerifyResource(Resource);
+    ExpCheckForApcsDisabled(KeGetCurrentIrql(), Resource, (PKTHREAD)Thread);
+
+    /* Recursive acquires don't need the lock */
+    if (ExpAcquireResourceRecursive(Resource, Thread, FALSE)) return TRUE;
 
     /* Acquire the lock */
     ExAcquireResourceLock(Resource, &LockHandle);
-    ExpCheckForApcsDisabled(LockHandle.OldIrql, Resource, (PKTHREAD)Thread);
 
-    /* Check how many active entries we've got */
-    while (Resource->ActiveEntries != 0)
+    /* Check if anyone owns it */
+TryAcquire:
+    while (Resource->ActiveCount != 0)
     {
         /* Check if it's exclusively owned */
         if (IsOwnedExclusive(Resource))
@@ -951,20 +1497,9 @@ ExAcquireResourceSharedLite(IN PERESOURCE Resource,
                 Owner->OwnerThread = Thread;
                 Owner->OwnerCount = 1;
                 
-                /* Check how many active entries we had */
-                if (Resource->ActiveEntries == 0)
-                {
-                    /* Set initial counts */
-                    ASSERT(Resource->ActiveCount == 0);
-                    Resource->ActiveEntries = 1;
-                    Resource->ActiveCount = 1;
-                }
-                else
-                {
-                    /* Increase active entries */
-                    ASSERT(Resource->ActiveCount == 1);
-                    Resource->ActiveEntries++;   
-                }
+                /* Someone else owns it shared, so it's active already */
+                ASSERT(Resource->ActiveCount == 1);
+                Resource->ActiveEntries++;
                 
                 /* Release the lock and return */
                 ExReleaseResourceLock(Resource, &LockHandle);
@@ -979,6 +1514,13 @@ ExAcquireResourceSharedLite(IN PERESOURCE Resource,
             ExReleaseResourceLock(Resource, &LockHandle);
             return FALSE;
         }
+
+        /* Give the owner a chance to release it before we block */
+        if (!Spun)
+        {
+            Spun = TRUE;
+            if (ExpSpinForResource(Resource, &LockHandle, FALSE)) continue;
+        }
         
         /* Check if we have a shared waiters semaphore */
         if (!Resource->SharedWaiters)
@@ -994,13 +1536,12 @@ ExAcquireResourceSharedLite(IN PERESOURCE Resource,
     }
     
     /* Did we get here because we don't have active entries? */
-    if (Resource->ActiveEntries == 0)
+    if (Resource->ActiveCount == 0)
     {
         /* Acquire it */
+        if (!ExpClaimResource(Resource, FALSE)) goto TryAcquire;
         ASSERT(Resource->ActiveEntries == 0);
-        ASSERT(Resource->ActiveCount == 0);
         Resource->ActiveEntries = 1;
-        Resource->ActiveCount = 1;
         Resource->OwnerEntry.OwnerThread = Thread;
         Resource->OwnerEntry.OwnerCount = 1;
         
@@ -1079,12 +1620,11 @@ ExAcquireSharedStarveExclusive(IN PERESOURCE Resource,
 
     /* See if anyone owns it */
 TryAcquire:
-    if (Resource->ActiveEntries == 0)
+    if (Resource->ActiveCount == 0)
     {
         /* Nobody owns it, so let's take control */
+        if (!ExpClaimResource(Resource, FALSE)) goto TryAcquire;
         ASSERT(Resource->ActiveEntries == 0);
-        ASSERT(Resource->ActiveCount == 0);
-        Resource->ActiveCount = 1;
         Resource->ActiveEntries = 1;
         Resource->OwnerEntry.OwnerThread = Thread;
         Resource->OwnerEntry.OwnerCount = 1;
@@ -1134,20 +1674,9 @@ TryAcquire:
         Owner->OwnerThread = Thread;
         Owner->OwnerCount = 1;
 
-        /* Check how many active entries we had */
-        if (Resource->ActiveEntries == 0)
-        {
-            /* Set initial counts */
-            ASSERT(Resource->ActiveCount == 0);
-            Resource->ActiveEntries = 1;
-            Resource->ActiveCount = 1;
-        }
-        else
-        {
-            /* Increase active entries */
-            ASSERT(Resource->ActiveCount == 1);
-            Resource->ActiveEntries++;   
-        }
+        /* Someone else owns it shared, so it's active already */
+        ASSERT(Resource->ActiveCount == 1);
+        Resource->ActiveEntries++;
 
         /* Release the lock and return */
         ExReleaseResourceLock(Resource, &LockHandle);
@@ -1233,12 +1762,11 @@ ExAcquireSharedWaitForExclusive(IN PERESOURCE Resource,
 
     /* See if nobody owns us */
 TryAcquire:
-    if (!Resource->ActiveEntries)
+    if (!Resource->ActiveCount)
     {
         /* Nobody owns it, so let's take control */
+        if (!ExpClaimResource(Resource, FALSE)) goto TryAcquire;
         ASSERT(Resource->ActiveEntries == 0);
-        ASSERT(Resource->ActiveCount == 0);
-        Resource->ActiveCount = 1;
         Resource->ActiveEntries = 1;
         Resource->OwnerEntry.OwnerThread = Thread;
         Resource->OwnerEntry.OwnerCount = 1;
@@ -1333,20 +1861,9 @@ TryAcquire:
             Owner->OwnerThread = Thread;
             Owner->OwnerCount = 1;
 
-            /* Check how many active entries we had */
-            if (Resource->ActiveEntries == 0)
-            {
-                /* Set initial counts */
-                ASSERT(Resource->ActiveCount == 0);
-                Resource->ActiveEntries = 1;
-                Resource->ActiveCount = 1;
-            }
-            else
-            {
-                /* Increase active entries */
-                ASSERT(Resource->ActiveCount == 1);
-                Resource->ActiveEntries++;   
-            }
+            /* Someone else owns it shared, so it's active already */
+            ASSERT(Resource->ActiveCount == 1);
+            Resource->ActiveEntries++;
             
             /* Release the lock and return */
             ExReleaseResourceLock(Resource, &LockHandle);
@@ -1414,7 +1931,7 @@ ExConvertExclusiveToSharedLite(IN PERESOURCE Resource)
     ExAcquireResourceLock(Resource, &LockHandle);
 
     /* Erase the exclusive flag */
-    Resource->Flag &= ~ResourceOwnedExclusive;
+    ExpClearResourceFlag(Resource, ResourceOwnedExclusive);
 
     /* Check if we have shared waiters */
     if (IsSharedWaiting(Resource))
@@ -1456,6 +1973,7 @@ NTAPI
 ExDeleteResourceLite(IN PERESOURCE Resource)
 {
     KLOCK_QUEUE_HANDLE LockHandle;
+    PEXP_RESOURCE_WAIT_ENTRY WaitEntry;
 
     /* Sanity checks */
     ASSERT(IsSharedWaiting(Resource) == FALSE);
@@ -1466,11 +1984,14 @@ ExDeleteResourceLite(IN PERESOURCE Resource)
     /* Lock the resource */
     KeAcquireInStackQueuedSpinLock(&ExpResourceSpinLock, &LockHandle);
 
-    /* Remove the resource */
+    /* Remove the resource, along with its wait time record */
     RemoveEntryList(&Resource->SystemResourcesList);
+    WaitEntry = ExpFindResourceWaitEntry(Resource);
+    if (WaitEntry) RemoveEntryList(&WaitEntry->HashLinks);
 
     /* Release the lock */
     KeReleaseInStackQueuedSpinLock(&LockHandle);
+    if (WaitEntry) ExFreePoolWithTag(WaitEntry, TAG_RESOURCE_WAIT);
 
     /* Free every  structure */
     if (Resource->OwnerTable) ExFreePoolWithTag(Resource->OwnerTable, TAG_RESOURCE_TABLE);
@@ -1509,7 +2030,7 @@ ExDisableResourceBoostLite(IN PERESOURCE Resource)
     ExAcquireResourceLock(Resource, &LockHandle);
 
     /* Remove the flag */
-    Resource->Flag |= ResourceHasDisabledPriorityBoost;
+    ExpSetResourceFlag(Resource, ResourceHasDisabledPriorityBoost);
 
     /* Release the lock */
     ExReleaseResourceLock(Resource, &LockHandle);
@@ -1759,6 +2280,8 @@ ExReinitializeResourceLite(IN PERESOURCE Resource)
     PKSEMAPHORE Semaphore;
     ULONG i, Size;
     POWNER_ENTRY Owner;
+    KLOCK_QUEUE_HANDLE LockHandle;
+    PEXP_RESOURCE_WAIT_ENTRY WaitEntry;
 
     /* Get the owner table */
     Owner = Resource->OwnerTable;
@@ -1793,6 +2316,12 @@ ExReinitializeResourceLite(IN PERESOURCE Resource)
     Resource->ContentionCount = 0;
     Resource->NumberOfSharedWaiters = 0;
     Resource->NumberOfExclusiveWaiters = 0;
+
+    /* Reset the wait time too */
+    KeAcquireInStackQueuedSpinLock(&ExpResourceSpinLock, &LockHandle);
+    WaitEntry = ExpFindResourceWaitEntry(Resource);
+    if (WaitEntry) WaitEntry->WaitTime = 0;
+    KeReleaseInStackQueuedSpinLock(&LockHandle);
     return STATUS_SUCCESS;
 }
 
@@ -1850,6 +2379,9 @@ ExReleaseResourceForThreadLite(IN PERESOURCE Resource,
     POWNER_ENTRY Owner, Limit;
     ASSERT(Thread != 0);
 
+    /* Nested releases don't need the lock */
+    if (ExpReleaseResourceRecursive(Resource, Thread)) return;
+
     /* Get the thread and lock the resource */
     ExAcquireResourceLock(Resource, &LockHandle);
 
@@ -1880,7 +2412,7 @@ ExReleaseResourceForThreadLite(IN PERESOURCE Resource,
         if (IsSharedWaiting(Resource))
         {
             /* Remove the exclusive flag */
-            Resource->Flag &= ~ResourceOwnedExclusive;
+            ExpClearResourceFlag(Resource, ResourceOwnedExclusive);
             
             /* Give ownage to another thread */
             Count = Resource->NumberOfSharedWaiters;
@@ -1909,9 +2441,8 @@ ExReleaseResourceForThreadLite(IN PERESOURCE Resource,
             return;
         }
         
-        /* Remove the exclusive flag */
-        Resource->Flag &= ~ResourceOwnedExclusive;
-        Resource->ActiveCount = 0;
+        /* Remove the exclusive flag and let the next one claim it */
+        ExpClearResourceActive(Resource);
     }
     else
     {
@@ -1988,7 +2519,7 @@ ExReleaseResourceForThreadLite(IN PERESOURCE Resource,
             if (IsExclusiveWaiting(Resource))
             {
                 /* Give exclusive access */
-                Resource->Flag |= ResourceOwnedExclusive;
+                ExpSetResourceFlag(Resource, ResourceOwnedExclusive);
                 Resource->OwnerEntry.OwnerThread = 1;
                 Resource->OwnerEntry.OwnerCount = 1;
                 Resource->ActiveEntries = 1;
@@ -2002,8 +2533,8 @@ ExReleaseResourceForThreadLite(IN PERESOURCE Resource,
                 return;
             }
             
-            /* Clear the active count */
-            Resource->ActiveCount = 0;
+            /* Clear the active count, letting the next one claim it */
+            ExpClearResourceActive(Resource);
         }
     }
 
@@ -2142,22 +2673,15 @@ ExTryToAcquireResourceExclusiveLite(IN PERESOURCE Resource)
     ASSERT(KeIsExecutingDpc() == FALSE);
     ExpVerifyResource(Resource);
 
+    /* Uncontended acquires don't need the lock */
+    if (ExpAcquireResourceUnowned(Resource, Thread)) return TRUE;
+
     /* Acquire the lock */
     ExAcquireResourceLock(Resource, &LockHandle);
 
-    /* Check if there is an owner */
-    if (!Resource->ActiveCount)
-    {
-        /* No owner, give exclusive access */
-        Resource->Flag |= ResourceOwnedExclusive;
-        Resource->OwnerEntry.OwnerThread = Thread;
-        Resource->OwnerEntry.OwnerCount = 1;
-        Resource->ActiveCount = 1;
-        Resource->ActiveEntries = 1;
-        Acquired = TRUE;
-    }
-    else if ((IsOwnedExclusive(Resource)) &&
-             (Resource->OwnerEntry.OwnerThread == Thread))
+    /* Check if we already own it */
+    if ((IsOwnedExclusive(Resource)) &&
+        (Resource->OwnerEntry.OwnerThread == Thread))
     {
         /* Do a recursive acquire */
         Resource->OwnerEntry.OwnerCount++;
@@ -1110,12 +1110,78 @@ Skip:
     return Status;
 }
 
+/*
+ * Snapshots the sizes of the service tables that keep statistics. Tables
+ * without statistics in between report no services. Returns the number of
+ * tables and the total number of services.
+ */
+static
+ULONG
+ExpGetServiceStatisticsLimits(OUT PULONG Limits,
+                              OUT PULONG TotalServices)
+{
+    ULONG i, Tables = 0;
+
+    *TotalServices = 0;
+    for (i = 0; i < SSDT_MAX_ENTRIES; i++)
+    {
+        Limits[i] = KiServiceStatistics[i].Counts ? KiServiceStatistics[i].Limit : 0;
+        if (Limits[i])
+        {
+            Tables = i + 1;
+            *TotalServices += Limits[i];
+        }
+    }
+
+    return Tables;
+}
+
 /* Class 6 - Call Count Information */
 QSI_DEF(SystemCallCountInformation)
 {
-    /* FIXME */
-    DPRINT1("NtQuerySystemInformation - SystemCallCountInformation not implemented\n");
-    return STATUS_NOT_IMPLEMENTED;
+    PSYSTEM_CALL_COUNT_INFORMATION Scci = (PSYSTEM_CALL_COUNT_INFORMATION)Buffer;
+    PKSERVICE_TABLE_STATISTICS Statistics;
+    ULONG Limits[SSDT_MAX_ENTRIES];
+    ULONG Tables, TotalServices, i, Id, Cpu, Count;
+    PULONG NumberOfEntries, CallCounts;
+
+    /* Calls are only counted if the system was asked to */
+    Tables = ExpGetServiceStatisticsLimits(Limits, &TotalServices);
+    if (!Tables)
+    {
+        return STATUS_NOT_IMPLEMENTED;
+    }
+
+    /* The header is followed by the table sizes, then the counts of each table */
+    *ReqSize = sizeof(SYSTEM_CALL_COUNT_INFORMATION) + (Tables + TotalServices) * sizeof(ULONG);
+    if (Size < *ReqSize)
+    {
+        return STATUS_INFO_LENGTH_MISMATCH;
+    }
+
+    Scci->Length = *ReqSize;
+    Scci->NumberOfTables = Tables;
+    NumberOfEntries = (PULONG)(Scci + 1);
+    CallCounts = NumberOfEntries + Tables;
+
+    for (i = 0; i < Tables; i++)
+    {
+        Statistics = &KiServiceStatistics[i];
+        NumberOfEntries[i] = Limits[i];
+
+        /* Sum up what each processor counted */
+        for (Id = 0; Id < Limits[i]; Id++)
+        {
+            Count = 0;
+            for (Cpu = 0; Cpu < Statistics->Processors; Cpu++)
+            {
+                Count += Statistics->Counts[Cpu * Statistics->CountStride + Id];
+            }
+            *CallCounts++ = Count;
+        }
+    }
+
+    return STATUS_SUCCESS;
 }
 
 /* Class 7 - Device Information */
@@ -1221,9 +1287,60 @@ SSI_DEF(SystemFlagsInformation)
 /* Class 10 - Call Time Information */
 QSI_DEF(SystemCallTimeInformation)
 {
-    /* FIXME */
-    DPRINT1("NtQuerySystemInformation - SystemCallTimeInformation not implemented\n");
-    return STATUS_NOT_IMPLEMENTED;
+    PSYSTEM_CALL_TIME_INFORMATION Scti = (PSYSTEM_CALL_TIME_INFORMATION)Buffer;
+    PKSERVICE_TABLE_STATISTICS Statistics;
+    ULONG Limits[SSDT_MAX_ENTRIES];
+    ULONG Tables, TotalServices, i, Id, Cpu;
+    ULONG64 Cycles;
+    PLARGE_INTEGER TimeOfCalls;
+    BOOLEAN Timed = FALSE;
+
+    Tables = ExpGetServiceStatisticsLimits(Limits, &TotalServices);
+    for (i = 0; i < Tables; i++)
+    {
+        if (Limits[i] && KiServiceStatistics[i].Cycles) Timed = TRUE;
+    }
+
+    /* Calls are only timed if the system was asked to */
+    if (!Timed)
+    {
+        return STATUS_NOT_IMPLEMENTED;
+    }
+
+    /*
+     * One cycle count per service, in the same order as the call counts
+     * of SystemCallCountInformation. TotalCalls is the number of entries.
+     */
+    *ReqSize = FIELD_OFFSET(SYSTEM_CALL_TIME_INFORMATION, TimeOfCalls) +
+               TotalServices * sizeof(LARGE_INTEGER);
+    if (Size < *ReqSize)
+    {
+        return STATUS_INFO_LENGTH_MISMATCH;
+    }
+
+    Scti->Length = *ReqSize;
+    Scti->TotalCalls = TotalServices;
+    TimeOfCalls = Scti->TimeOfCalls;
+
+    for (i = 0; i < Tables; i++)
+    {
+        Statistics = &KiServiceStatistics[i];
+
+        for (Id = 0; Id < Limits[i]; Id++)
+        {
+            Cycles = 0;
+            if (Statistics->Cycles)
+            {
+                for (Cpu = 0; Cpu < Statistics->Processors; Cpu++)
+                {
+                    Cycles += Statistics->Cycles[Cpu * Statistics->CycleStride + Id];
+                }
+            }
+            (TimeOfCalls++)->QuadPart = Cycles;
+        }
+    }
+
+    return STATUS_SUCCESS;
 }
 
 /* Class 11 - Module Information */
@@ -1251,9 +1368,10 @@ QSI_DEF(SystemModuleInformation)
 /* Class 12 - Locks Information */
 QSI_DEF(SystemLocksInformation)
 {
-    /* FIXME */
-    DPRINT1("NtQuerySystemInformation - SystemLocksInformation not implemented\n");
-    return STATUS_NOT_IMPLEMENTED;
+    /* Snapshot the executive resources */
+    return ExQuerySystemLockInformation((PRTL_PROCESS_LOCKS)Buffer,
+                                        Size,
+                                        ReqSize);
 }
 
 /* Class 13 - Stack Trace Information */
@@ -2406,9 +2524,20 @@ QSI_DEF(SystemNumaProcessorMap)
 /* Class 56 - Prefetcher information  */
 QSI_DEF(SystemPrefetcherInformation)
 {
-    /* FIXME */
-    DPRINT1("NtQuerySystemInformation - SystemPrefetcherInformation not implemented\n");
-    return STATUS_NOT_IMPLEMENTED;
+    return CcPfQueryPrefetcherInformation(Buffer, Size, ExGetPreviousMode(), ReqSize);
+}
+
+SSI_DEF(SystemPrefetcherInformation)
+{
+    KPROCESSOR_MODE PreviousMode = ExGetPreviousMode();
+
+    /* Turning the prefetcher off or moving the boot along is for administrators */
+    if (!SeSinglePrivilegeCheck(SeProfileSingleProcessPrivilege, PreviousMode))
+    {
+        return STATUS_PRIVILEGE_NOT_HELD;
+    }
+
+    return CcPfSetPrefetcherInformation(Buffer, Size, PreviousMode);
 }
 
 
@@ -2893,7 +3022,7 @@ CallQS [] =
     SI_QX(SystemSessionProcessesInformation),
     SI_XS(SystemLoadGdiDriverInSystemSpaceInformation),
     SI_QX(SystemNumaProcessorMap),
-    SI_QX(SystemPrefetcherInformation),
+    SI_QS(SystemPrefetcherInformation),
     SI_QX(SystemExtendedProcessInformation),
     SI_QX(SystemRecommendedSharedDataAlignment),
     SI_XX(SystemComPlusPackage),
@@ -510,36 +510,65 @@ FsRtlLookupBaseMcbEntry(IN PBASE_MCB OpaqueMcb,
     OUT PULONG Index OPTIONAL)
 {
     BOOLEAN Result = FALSE;
-    ULONG i;
+    PBASE_MCB_INTERNAL Mcb = (PBASE_MCB_INTERNAL)OpaqueMcb;
+    PLARGE_MCB_MAPPING_ENTRY Run;
+    ULONG i = 0;
     LONGLONG LastVbn = 0, LastLbn = 0, Count = 0;   // the last values we've found during traversal
+    LONGLONG RunEndVbn = 0;
 
     DPRINT("FsRtlLookupBaseMcbEntry(%p, %I64d, %p, %p, %p, %p, %p)\n", OpaqueMcb, Vbn, Lbn, SectorCountFromLbn, StartingLbn, SectorCountFromStartingLbn, Index);
 
-    for (i = 0; FsRtlGetNextBaseMcbEntry(OpaqueMcb, i, &LastVbn, &LastLbn, &Count); i++)
+    // Walk the tree once, emulating the 'hole' runs the way FsRtlGetNextBaseMcbEntry() does
+    for (Run = (PLARGE_MCB_MAPPING_ENTRY)RtlEnumerateGenericTable(&Mcb->Mapping->Table, TRUE);
+         Run;
+         Run = (PLARGE_MCB_MAPPING_ENTRY)RtlEnumerateGenericTable(&Mcb->Mapping->Table, FALSE))
     {
-        // have we reached the target mapping?
-        if (Vbn < LastVbn + Count)
+        // is there a hole before the current run?
+        if (Run->RunStartVbn.QuadPart > RunEndVbn)
         {
-            if (Lbn)
-            {
-                if (LastLbn == -1)
-                    *Lbn = -1;
-                else
-                    *Lbn = LastLbn + (Vbn - LastVbn);
-            }
+            LastVbn = RunEndVbn;
+            LastLbn = -1;
+            Count = Run->RunStartVbn.QuadPart - RunEndVbn;
 
-            if (SectorCountFromLbn)
-                *SectorCountFromLbn = LastVbn + Count - Vbn;
-            if (StartingLbn)
-                *StartingLbn = LastLbn;
-            if (SectorCountFromStartingLbn)
-                *SectorCountFromStartingLbn = LastVbn + Count - LastVbn;
-            if (Index)
-                *Index = i;
+            if (Vbn < LastVbn + Count)
+                break;
 
-            Result = TRUE;
-            goto quit;
+            i++;
         }
+
+        LastVbn = Run->RunStartVbn.QuadPart;
+        LastLbn = Run->StartingLbn.QuadPart;
+        Count = Run->RunEndVbn.QuadPart - Run->RunStartVbn.QuadPart;
+
+        if (Vbn < LastVbn + Count)
+            break;
+
+        i++;
+        RunEndVbn = Run->RunEndVbn.QuadPart;
+    }
+
+    // have we reached the target mapping?
+    if (Run)
+    {
+        if (Lbn)
+        {
+            if (LastLbn == -1)
+                *Lbn = -1;
+            else
+                *Lbn = LastLbn + (Vbn - LastVbn);
+        }
+
+        if (SectorCountFromLbn)
+            *SectorCountFromLbn = LastVbn + Count - Vbn;
+        if (StartingLbn)
+            *StartingLbn = LastLbn;
+        if (SectorCountFromStartingLbn)
+            *SectorCountFromStartingLbn = LastVbn + Count - LastVbn;
+        if (Index)
+            *Index = i;
+
+        Result = TRUE;
+        goto quit;
     }
 
     if (Lbn)
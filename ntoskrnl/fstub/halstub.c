@@ -62,7 +62,14 @@ HAL_PRIVATE_DISPATCH HalPrivateDispatchTable =
     (pKdCheckPowerButton)xHalReferenceHandler,
     xHalVectorToIDTEntry,
     (pKdMapPhysicalMemory64)MatchAll,
-    (pKdUnmapVirtualAddress)xKdUnmapVirtualAddress
+    (pKdUnmapVirtualAddress)xKdUnmapVirtualAddress,
+#if (NTDDI_VERSION >= NTDDI_LONGHORN)
+    (pKdGetPciDataByOffset)NULL,
+    (pKdSetPciDataByOffset)NULL,
+    NULL,
+    NULL,
+#endif
+    xHalSetIdleClockInterval
 };
 
 /* FUNCTIONS *****************************************************************/
@@ -83,6 +90,14 @@ xHalHaltSystem(VOID)
     while (TRUE);
 }
 
+ULONG
+NTAPI
+xHalSetIdleClockInterval(IN ULONG Interval)
+{
+    /* Keep the periodic clock */
+    return 0;
+}
+
 VOID
 NTAPI
 xHalEndOfBoot(VOID)
@@ -66,6 +66,27 @@ extern ULONG CcPinMappedDataCount;
 extern ULONG CcDataPages;
 extern ULONG CcDataFlushes;
 
+//
+// Prefetcher Trace Files
+//
+#define PF_TRACE_VERSION                17
+#define PF_TRACE_MAGIC_NUMBER           'ACCS'
+#define PFSN_TRACE_HEADER_MAGIC         'hTfP'
+
+typedef enum _PF_SCENARIO_TYPE
+{
+    PfApplicationLaunchScenarioType,
+    PfSystemBootScenarioType,
+    PfMaxScenarioType
+} PF_SCENARIO_TYPE;
+
+//
+// What made a page get logged. The FileOffset of a log entry is in pages.
+//
+#define PF_ENTRY_TYPE_DATA_FAULT        0
+#define PF_ENTRY_TYPE_IMAGE_FAULT       1
+#define PF_ENTRY_TYPE_READ              2
+
 typedef struct _PF_SCENARIO_ID
 {
     WCHAR ScenName[30];
@@ -97,6 +118,8 @@ typedef struct _PF_SECTION_INFO
     ULONG FileSequenceNumber;
     ULONG FileIdLow;
     ULONG FileIdHigh;
+    ULONG FileNameOffset;
+    ULONG FileNameLength;
 } PF_SECTION_INFO, *PPF_SECTION_INFO;
 
 typedef struct _PF_TRACE_HEADER
@@ -123,6 +146,12 @@ typedef struct _PFSN_TRACE_DUMP
     PF_TRACE_HEADER Trace;
 } PFSN_TRACE_DUMP, *PPFSN_TRACE_DUMP;
 
+typedef struct _PFSN_SECTION
+{
+    PSECTION_OBJECT_POINTERS SectionObjectPointer;
+    PFILE_OBJECT FileObject;
+} PFSN_SECTION, *PPFSN_SECTION;
+
 typedef struct _PFSN_TRACE_HEADER
 {
     ULONG Magic;
@@ -153,6 +182,12 @@ typedef struct _PFSN_TRACE_HEADER
     LARGE_INTEGER LaunchTime;
     PPF_SECTION_INFO SectionInfo;
     ULONG SectionInfoCount;
+    BOOLEAN EndTraceRequested;
+    PPFSN_SECTION Sections;
+    PULONG SectionHash;
+    ULONG NumSections;
+    PFILE_OBJECT *PrefetchedFiles;
+    ULONG NumPrefetchedFiles;
 } PFSN_TRACE_HEADER, *PPFSN_TRACE_HEADER;
 
 typedef struct _PFSN_PREFETCHER_GLOBALS
@@ -165,8 +200,18 @@ typedef struct _PFSN_PREFETCHER_GLOBALS
     LONG NumCompletedTraces;
     PKEVENT CompletedTracesEvent;
     LONG ActivePrefetches;
+    LONG NumActiveTraces;
+    LONG NumSavedTraces;
+    LONG NumPrefetchedScenarios;
+    LONG NumPrefetchedFiles;
+    LONGLONG NumPrefetchedBytes;
+    PF_BOOT_PHASE_ID BootPhase;
 } PFSN_PREFETCHER_GLOBALS, *PPFSN_PREFETCHER_GLOBALS;
 
+extern BOOLEAN CcPfEnablePrefetcher;
+extern ULONG CcPfEnableStatus;
+extern PFSN_PREFETCHER_GLOBALS CcPfGlobals;
+
 typedef struct _ROS_SHARED_CACHE_MAP
 {
     CSHORT NodeTypeCode;
@@ -293,6 +338,44 @@ CcPfInitializePrefetcher(
     VOID
 );
 
+VOID
+NTAPI
+CcPfBeginAppLaunch(
+    IN PEPROCESS Process
+);
+
+NTSTATUS
+NTAPI
+CcPfBeginBootPhase(
+    IN PF_BOOT_PHASE_ID Phase
+);
+
+VOID
+NTAPI
+CcPfLogEntry(
+    IN PFILE_OBJECT FileObject,
+    IN LONGLONG FileOffset,
+    IN ULONG Length,
+    IN ULONG Type
+);
+
+NTSTATUS
+NTAPI
+CcPfQueryPrefetcherInformation(
+    IN PVOID SystemInformation,
+    IN ULONG SystemInformationLength,
+    IN KPROCESSOR_MODE PreviousMode,
+    OUT PULONG Length
+);
+
+NTSTATUS
+NTAPI
+CcPfSetPrefetcherInformation(
+    IN PVOID SystemInformation,
+    IN ULONG SystemInformationLength,
+    IN KPROCESSOR_MODE PreviousMode
+);
+
 VOID
 NTAPI
 CcMdlReadComplete2(
@@ -542,3 +625,18 @@ CcRosVacbDecRefCount(
 }
 #define CcRosVacbGetRefCount(vacb) InterlockedCompareExchange((PLONG)&(vacb)->ReferenceCount, 0, 0)
 #endif
+
+FORCEINLINE
+VOID
+CcPfLogFileAccess(
+    IN PFILE_OBJECT FileObject,
+    IN LONGLONG FileOffset,
+    IN ULONG Length,
+    IN ULONG Type)
+{
+    /* Faults and reads are only logged while a launch or the boot is traced */
+    if (CcPfGlobals.NumActiveTraces != 0)
+    {
+        CcPfLogEntry(FileObject, FileOffset, Length, Type);
+    }
+}
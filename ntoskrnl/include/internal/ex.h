@@ -297,6 +297,14 @@ VOID
 NTAPI
 ExpResourceInitialization(VOID);
 
+NTSTATUS
+NTAPI
+ExQuerySystemLockInformation(
+    OUT PRTL_PROCESS_LOCKS LockInformation,
+    IN ULONG LockInformationLength,
+    OUT PULONG ReturnLength
+);
+
 INIT_FUNCTION
 VOID
 NTAPI
@@ -66,6 +66,12 @@ xHalSetWakeEnable(
     IN BOOLEAN Enable
 );
 
+ULONG
+NTAPI
+xHalSetIdleClockInterval(
+    IN ULONG Interval
+);
+
 UCHAR
 NTAPI
 xHalVectorToIDTEntry(
@@ -86,6 +86,11 @@
 //
 #define IOP_MAX_REPARSE_TRAVERSAL 0x20
 
+//
+// Max completion packets removed by a single NtRemoveIoCompletionEx call
+//
+#define IOP_MAX_COMPLETION_BATCH 0x40
+
 //
 // Private flags for IoCreateFile / IoParseDevice
 //
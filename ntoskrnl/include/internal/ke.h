@@ -78,6 +78,23 @@ typedef struct _KNMI_HANDLER_CALLBACK
     PVOID Handle;
 } KNMI_HANDLER_CALLBACK, *PKNMI_HANDLER_CALLBACK;
 
+//
+// Per-processor call counts and cycle times of one system service table.
+// Processor N owns Counts[N * CountStride] and Cycles[N * CycleStride].
+//
+typedef struct _KSERVICE_TABLE_STATISTICS
+{
+    PULONG Counts;
+    PULONG64 Cycles;
+    ULONG Limit;
+    ULONG Processors;
+    ULONG CountStride;
+    ULONG CycleStride;
+} KSERVICE_TABLE_STATISTICS, *PKSERVICE_TABLE_STATISTICS;
+
+#define KI_SYSCALL_STATISTICS_COUNTS        0x1
+#define KI_SYSCALL_STATISTICS_CYCLES        0x2
+
 typedef PCHAR
 (NTAPI *PKE_BUGCHECK_UNICODE_TO_ANSI)(
     IN PUNICODE_STRING Unicode,
@@ -120,6 +137,8 @@ extern LARGE_INTEGER KiTimeIncrementReciprocal;
 extern UCHAR KiTimeIncrementShiftCount;
 extern ULONG KiTimeLimitIsrMicroseconds;
 extern ULONG KiServiceLimit;
+extern ULONG KiSystemCallStatistics;
+extern KSERVICE_TABLE_STATISTICS KiServiceStatistics[SSDT_MAX_ENTRIES];
 extern LIST_ENTRY KeBugcheckCallbackListHead, KeBugcheckReasonCallbackListHead;
 extern KSPIN_LOCK BugCheckCallbackLock;
 extern KDPC KiTimerExpireDpc;
@@ -171,6 +190,13 @@ KiSwapThread(
     IN PKPRCB Prcb
 );
 
+VOID
+NTAPI
+KiInitializeServiceStatistics(
+    IN ULONG Index,
+    IN ULONG Limit
+);
+
 VOID
 NTAPI
 KeReadyThread(
@@ -411,6 +437,14 @@ KeSetIntervalProfile(
     KPROFILE_SOURCE ProfileSource
 );
 
+VOID
+NTAPI
+KeStartSampledProfile(VOID);
+
+VOID
+NTAPI
+KeStopSampledProfile(VOID);
+
 VOID
 NTAPI
 KeUpdateRunTime(
@@ -418,6 +452,18 @@ KeUpdateRunTime(
     KIRQL Irql
 );
 
+BOOLEAN
+NTAPI
+KiEnterDynamicTickIdle(
+    VOID
+);
+
+VOID
+NTAPI
+KiExitDynamicTickIdle(
+    VOID
+);
+
 VOID
 NTAPI
 KiExpireTimers(
@@ -645,6 +691,17 @@ KiInsertQueue(
     BOOLEAN Head
 );
 
+ULONG
+NTAPI
+KeRemoveQueueEx(
+    IN PKQUEUE Queue,
+    IN KPROCESSOR_MODE WaitMode,
+    IN BOOLEAN Alertable,
+    IN PLARGE_INTEGER Timeout OPTIONAL,
+    OUT PLIST_ENTRY *EntryArray,
+    IN ULONG Count
+);
+
 VOID
 NTAPI
 KiTimerExpiration(
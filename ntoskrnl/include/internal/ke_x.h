@@ -1235,7 +1235,7 @@ KxSetTimerForThreadWait(IN PKTIMER Timer,
     }                                                                       \
                                                                             \
     /* Set wait settings */                                                 \
-    Thread->Alertable = FALSE;                                              \
+    Thread->Alertable = Alertable;                                          \
     Thread->WaitMode = WaitMode;                                            \
     Thread->WaitReason = WrQueue;                                           \
                                                                             \
@@ -1681,6 +1681,54 @@ KiReleaseNmiListLock(IN KIRQL OldIrql)
     KeReleaseSpinLock(&KiNmiCallbackListLock, OldIrql);
 }
 
+//
+// Charges a call to a system service on the current processor. The counters
+// are per processor and approximate: a thread preempted between reading its
+// processor number and the increment may race with the next thread there.
+//
+FORCEINLINE
+VOID
+KiIncreaseSystemCallCount(IN ULONG TableIndex,
+                          IN ULONG ServiceNumber)
+{
+    PKSERVICE_TABLE_STATISTICS Statistics;
+    PULONG Counts;
+    ULONG Number;
+
+    if (TableIndex >= SSDT_MAX_ENTRIES) return;
+    Statistics = &KiServiceStatistics[TableIndex];
+    Counts = Statistics->Counts;
+    if (!Counts || (ServiceNumber >= Statistics->Limit)) return;
+
+    Number = KeGetCurrentProcessorNumber();
+    if (Number < Statistics->Processors)
+    {
+        Counts[Number * Statistics->CountStride + ServiceNumber]++;
+    }
+}
+
+FORCEINLINE
+VOID
+KiAddSystemCallCycles(IN ULONG TableIndex,
+                      IN ULONG ServiceNumber,
+                      IN ULONG64 Cycles)
+{
+    PKSERVICE_TABLE_STATISTICS Statistics;
+    PULONG64 CycleCounts;
+    ULONG Number;
+
+    if (TableIndex >= SSDT_MAX_ENTRIES) return;
+    Statistics = &KiServiceStatistics[TableIndex];
+    CycleCounts = Statistics->Cycles;
+    if (!CycleCounts || (ServiceNumber >= Statistics->Limit)) return;
+
+    Number = KeGetCurrentProcessorNumber();
+    if (Number < Statistics->Processors)
+    {
+        CycleCounts[Number * Statistics->CycleStride + ServiceNumber] += Cycles;
+    }
+}
+
 #if defined(_M_IX86) || defined(_M_AMD64)
 FORCEINLINE
 VOID
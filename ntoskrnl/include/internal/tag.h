@@ -6,6 +6,7 @@
 #define TAG_SHARED_CACHE_MAP    'cScC'
 #define TAG_PRIVATE_CACHE_MAP   'cPcC'
 #define TAG_BCB                 'cBcC'
+#define TAG_PREFETCH            'fPcC'
 
 /* Executive Callbacks */
 #define TAG_CALLBACK_ROUTINE_BLOCK 'brbC'
@@ -18,6 +19,8 @@
 #define TAG_RESOURCE_TABLE      'aTeR'
 #define TAG_RESOURCE_EVENT      'aTeR'
 #define TAG_RESOURCE_SEMAPHORE  'aTeR'
+#define TAG_RESOURCE_LOCKS      'aTeR'
+#define TAG_RESOURCE_WAIT       'aTeR'
 
 /* formerly located in ex/handle.c */
 #define TAG_OBJECT_TABLE 'btbO'
@@ -104,6 +107,9 @@
 #define TAG_VPB    ' BPV'
 #define TAG_SYSB   'BSYS'
 
+/* Kernel system call statistics */
+#define TAG_KE_SYSCALL 'llaC'
+
 /* formerly located in ldr/loader.c */
 #define TAG_DRIVER_MEM  'MVRD' /* drvm */
 #define TAG_MODULE_OBJECT 'omlk' /* klmo - kernel ldr module object */
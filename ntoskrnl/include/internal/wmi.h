@@ -0,0 +1,54 @@
+/*
+* PROJECT:         ReactOS Kernel
+* LICENSE:         GPL - See COPYING in the top level directory
+* FILE:            ntoskrnl/include/internal/wmi.h
+* PURPOSE:         Internal header for WMI event tracing
+*/
+
+#pragma once
+
+#include <evntrace.h>
+
+//
+// Enable flags of the running NT Kernel Logger, zero when it isn't running
+//
+extern volatile ULONG WmipKernelLoggerEnableFlags;
+
+FORCEINLINE
+BOOLEAN
+WmiIsKernelEventEnabled(IN ULONG Flag)
+{
+    return (WmipKernelLoggerEnableFlags & Flag) != 0;
+}
+
+//
+// Kernel logger callouts
+//
+VOID
+FASTCALL
+WmiTraceContextSwitch(
+    IN PKTHREAD OldThread,
+    IN PKTHREAD NewThread
+);
+
+VOID
+FASTCALL
+WmiTraceDiskIo(
+    IN PIRP Irp,
+    IN PIO_STACK_LOCATION StackPtr,
+    IN BOOLEAN Completion
+);
+
+VOID
+FASTCALL
+WmiTracePageFault(
+    IN NTSTATUS Status,
+    IN PVOID Address,
+    IN PVOID TrapInformation
+);
+
+VOID
+FASTCALL
+WmiTraceProfileSample(
+    IN PKTRAP_FRAME TrapFrame
+);
@@ -645,6 +645,302 @@ IopDeviceFsIoControl(IN HANDLE DeviceHandle,
                                         IopOtherTransfer);
 }
 
+static
+NTSTATUS
+NTAPI
+IopReadWriteFileSegments(IN HANDLE FileHandle,
+                         IN HANDLE Event OPTIONAL,
+                         IN PIO_APC_ROUTINE UserApcRoutine OPTIONAL,
+                         IN PVOID UserApcContext OPTIONAL,
+                         OUT PIO_STATUS_BLOCK UserIoStatusBlock,
+                         IN FILE_SEGMENT_ELEMENT BufferDescription[],
+                         IN ULONG BufferLength,
+                         IN PLARGE_INTEGER ByteOffset OPTIONAL,
+                         IN PULONG Key OPTIONAL,
+                         IN BOOLEAN Write)
+{
+    NTSTATUS Status;
+    PFILE_OBJECT FileObject;
+    PIRP Irp;
+    PDEVICE_OBJECT DeviceObject;
+    PIO_STACK_LOCATION StackPtr;
+    KPROCESSOR_MODE PreviousMode = KeGetPreviousMode();
+    PKEVENT EventObject = NULL;
+    LARGE_INTEGER CapturedByteOffset;
+    ULONG CapturedKey = 0;
+    BOOLEAN Synchronous = FALSE;
+    PMDL Mdl = NULL;
+    PFILE_SEGMENT_ELEMENT CapturedSegments = NULL;
+    ULONG SegmentsSize;
+    OBJECT_HANDLE_INFORMATION ObjectHandleInfo;
+
+    PAGED_CODE();
+    CapturedByteOffset.QuadPart = 0;
+    IOTRACE(IO_API_DEBUG, "FileHandle: %p. Length: %lx. Write: %d\n",
+            FileHandle, BufferLength, Write);
+
+    /* Get the File Object with the right access */
+    if (Write)
+    {
+        Status = ObReferenceFileObjectForWrite(FileHandle,
+                                               PreviousMode,
+                                               &FileObject,
+                                               &ObjectHandleInfo);
+    }
+    else
+    {
+        Status = ObReferenceObjectByHandle(FileHandle,
+                                           FILE_READ_DATA,
+                                           IoFileObjectType,
+                                           PreviousMode,
+                                           (PVOID*)&FileObject,
+                                           &ObjectHandleInfo);
+    }
+    if (!NT_SUCCESS(Status)) return Status;
+
+    /* Get the device object */
+    DeviceObject = IoGetRelatedDeviceObject(FileObject);
+
+    /*
+     * The segments are whole pages going straight to the device, so this
+     * only works for handles that bypass the cache, and the length must
+     * be a multiple of the sector size
+     */
+    if (!(FileObject->Flags & FO_NO_INTERMEDIATE_BUFFERING) ||
+        ((DeviceObject->SectorSize != 0) &&
+         (BufferLength % DeviceObject->SectorSize != 0)))
+    {
+        /* Release the file object and fail */
+        ObDereferenceObject(FileObject);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* Validate User-Mode Buffers */
+    if (PreviousMode != KernelMode)
+    {
+        _SEH2_TRY
+        {
+            /* Probe the status block */
+            ProbeForWriteIoStatusBlock(UserIoStatusBlock);
+
+            /* Probe the segment array, one element per page */
+            ProbeForRead(BufferDescription,
+                         BYTES_TO_PAGES(BufferLength) * sizeof(FILE_SEGMENT_ELEMENT),
+                         sizeof(ULONGLONG));
+
+            /* Check if we got a byte offset */
+            if (ByteOffset)
+            {
+                /* Capture and probe it */
+                CapturedByteOffset = ProbeForReadLargeInteger(ByteOffset);
+            }
+
+            /* Capture and probe the key */
+            if (Key) CapturedKey = ProbeForReadUlong(Key);
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            /* Release the file object and return the exception code */
+            ObDereferenceObject(FileObject);
+            _SEH2_YIELD(return _SEH2_GetExceptionCode());
+        }
+        _SEH2_END;
+    }
+    else
+    {
+        /* Kernel mode: capture directly */
+        if (ByteOffset) CapturedByteOffset = *ByteOffset;
+        if (Key) CapturedKey = *Key;
+    }
+
+    /* Fail if ByteOffset is not sector size aligned */
+    if ((ByteOffset) &&
+        (DeviceObject->SectorSize != 0) &&
+        (CapturedByteOffset.QuadPart % DeviceObject->SectorSize != 0))
+    {
+        /* Only if that's not specific values for synchronous IO */
+        if ((CapturedByteOffset.QuadPart != FILE_USE_FILE_POINTER_POSITION ||
+             !BooleanFlagOn(FileObject->Flags, FO_SYNCHRONOUS_IO)) &&
+            (!(Write) || (CapturedByteOffset.QuadPart != FILE_WRITE_TO_END_OF_FILE)))
+        {
+            /* Release the file object and fail */
+            ObDereferenceObject(FileObject);
+            return STATUS_INVALID_PARAMETER;
+        }
+    }
+
+    /* Check if this is an append operation */
+    if ((Write) &&
+        ((ObjectHandleInfo.GrantedAccess &
+          (FILE_APPEND_DATA | FILE_WRITE_DATA)) == FILE_APPEND_DATA))
+    {
+        /* Give the drivers something to understand */
+        CapturedByteOffset.u.LowPart = FILE_WRITE_TO_END_OF_FILE;
+        CapturedByteOffset.u.HighPart = -1;
+    }
+
+    /* Check for event */
+    if (Event)
+    {
+        /* Reference it */
+        Status = ObReferenceObjectByHandle(Event,
+                                           EVENT_MODIFY_STATE,
+                                           ExEventObjectType,
+                                           PreviousMode,
+                                           (PVOID*)&EventObject,
+                                           NULL);
+        if (!NT_SUCCESS(Status))
+        {
+            /* Fail */
+            ObDereferenceObject(FileObject);
+            return Status;
+        }
+
+        /* Otherwise reset the event */
+        KeClearEvent(EventObject);
+    }
+
+    /* Check if we should use Sync IO or not */
+    if (FileObject->Flags & FO_SYNCHRONOUS_IO)
+    {
+        /* Lock the file object */
+        Status = IopLockFileObject(FileObject, PreviousMode);
+        if (Status != STATUS_SUCCESS)
+        {
+            if (EventObject) ObDereferenceObject(EventObject);
+            ObDereferenceObject(FileObject);
+            return Status;
+        }
+
+        /* Check if we don't have a byte offset available */
+        if (!(ByteOffset) ||
+            ((CapturedByteOffset.u.LowPart == FILE_USE_FILE_POINTER_POSITION) &&
+             (CapturedByteOffset.u.HighPart == -1)))
+        {
+            /* Use the Current Byte Offset instead */
+            CapturedByteOffset = FileObject->CurrentByteOffset;
+        }
+
+        /* Remember we are sync */
+        Synchronous = TRUE;
+    }
+    else if (!(ByteOffset) &&
+             !(FileObject->Flags & (FO_NAMED_PIPE | FO_MAILSLOT)))
+    {
+        /* Otherwise, this was async I/O without a byte offset, so fail */
+        if (EventObject) ObDereferenceObject(EventObject);
+        ObDereferenceObject(FileObject);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* Clear the File Object's event */
+    KeClearEvent(&FileObject->Event);
+
+    /* Allocate the IRP */
+    Irp = IoAllocateIrp(DeviceObject->StackSize, FALSE);
+    if (!Irp) return IopCleanupFailedIrp(FileObject, EventObject, NULL);
+
+    /* Set the IRP */
+    Irp->Tail.Overlay.OriginalFileObject = FileObject;
+    Irp->Tail.Overlay.Thread = PsGetCurrentThread();
+    Irp->RequestorMode = PreviousMode;
+    Irp->Overlay.AsynchronousParameters.UserApcRoutine = UserApcRoutine;
+    Irp->Overlay.AsynchronousParameters.UserApcContext = UserApcContext;
+    Irp->UserIosb = UserIoStatusBlock;
+    Irp->UserEvent = EventObject;
+    Irp->PendingReturned = FALSE;
+    Irp->Cancel = FALSE;
+    Irp->CancelRoutine = NULL;
+    Irp->AssociatedIrp.SystemBuffer = NULL;
+    Irp->MdlAddress = NULL;
+    Irp->UserBuffer = NULL;
+
+    /* Set the Stack Data */
+    StackPtr = IoGetNextIrpStackLocation(Irp);
+    StackPtr->FileObject = FileObject;
+    if (Write)
+    {
+        StackPtr->MajorFunction = IRP_MJ_WRITE;
+        StackPtr->Parameters.Write.Key = CapturedKey;
+        StackPtr->Parameters.Write.Length = BufferLength;
+        StackPtr->Parameters.Write.ByteOffset = CapturedByteOffset;
+
+        /* Set write-through flag if the file object requires it */
+        if (FileObject->Flags & FO_WRITE_THROUGH)
+        {
+            StackPtr->Flags = SL_WRITE_THROUGH;
+        }
+    }
+    else
+    {
+        StackPtr->MajorFunction = IRP_MJ_READ;
+        StackPtr->Parameters.Read.Key = CapturedKey;
+        StackPtr->Parameters.Read.Length = BufferLength;
+        StackPtr->Parameters.Read.ByteOffset = CapturedByteOffset;
+    }
+
+    /*
+     * Whatever the device's buffering method, the request is described by
+     * a single MDL whose pages come from the segment array. The drivers
+     * see a virtually contiguous buffer starting at the first segment.
+     */
+    if (BufferLength)
+    {
+        _SEH2_TRY
+        {
+            /* The caller can change or unmap the array at any time, so capture it */
+            SegmentsSize = BYTES_TO_PAGES(BufferLength) * sizeof(FILE_SEGMENT_ELEMENT);
+            CapturedSegments = ExAllocatePoolWithTag(NonPagedPool, SegmentsSize, TAG_IO);
+            if (!CapturedSegments)
+                ExRaiseStatus(STATUS_INSUFFICIENT_RESOURCES);
+
+            RtlCopyMemory(CapturedSegments, BufferDescription, SegmentsSize);
+
+            /* Allocate an MDL for the first segment's address */
+            Mdl = IoAllocateMdl((PVOID)(ULONG_PTR)CapturedSegments[0].Buffer,
+                                BufferLength,
+                                FALSE,
+                                TRUE,
+                                Irp);
+            if (!Mdl)
+                ExRaiseStatus(STATUS_INSUFFICIENT_RESOURCES);
+
+            /* Fill it from the segment array, checking each page */
+            MmProbeAndLockSelectedPages(Mdl,
+                                        CapturedSegments,
+                                        PreviousMode,
+                                        Write ? IoReadAccess : IoWriteAccess);
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            /* A failed probe unlocks what it got, but don't free a locked MDL anyway */
+            if ((Mdl) && (Mdl->MdlFlags & MDL_PAGES_LOCKED)) MmUnlockPages(Mdl);
+            if (CapturedSegments) ExFreePoolWithTag(CapturedSegments, TAG_IO);
+
+            /* Clean up and return the exception code */
+            IopCleanupAfterException(FileObject, Irp, EventObject, NULL);
+            _SEH2_YIELD(return _SEH2_GetExceptionCode());
+        }
+        _SEH2_END;
+
+        /* The MDL has the pages now */
+        ExFreePoolWithTag(CapturedSegments, TAG_IO);
+    }
+
+    /* The length and offset are aligned, so the drivers can skip the cache */
+    Irp->Flags = IRP_NOCACHE | IRP_DEFER_IO_COMPLETION |
+                 (Write ? IRP_WRITE_OPERATION : IRP_READ_OPERATION);
+
+    /* Perform the call */
+    return IopPerformSynchronousRequest(DeviceObject,
+                                        Irp,
+                                        FileObject,
+                                        TRUE,
+                                        PreviousMode,
+                                        Synchronous,
+                                        Write ? IopWriteTransfer : IopReadTransfer);
+}
+
 NTSTATUS
 NTAPI
 IopQueryDeviceInformation(IN PFILE_OBJECT FileObject,
@@ -2328,6 +2624,37 @@ NtQueryInformationFile(IN HANDLE FileHandle,
                                        &HandleInformation);
     if (!NT_SUCCESS(Status)) return Status;
 
+    /* The completion notification modes are only kept in the file object */
+    if (FileInformationClass == FileIoCompletionNotificationInformation)
+    {
+        /* Protect write in SEH */
+        _SEH2_TRY
+        {
+            /* Convert the file object flags back */
+            ((PFILE_IO_COMPLETION_NOTIFICATION_INFORMATION)FileInformation)->
+                Flags = ((FileObject->Flags & FO_SKIP_COMPLETION_PORT) ?
+                         FILE_SKIP_COMPLETION_PORT_ON_SUCCESS : 0) |
+                        ((FileObject->Flags & FO_SKIP_SET_EVENT) ?
+                         FILE_SKIP_SET_EVENT_ON_HANDLE : 0) |
+                        ((FileObject->Flags & FO_SKIP_SET_FAST_IO) ?
+                         FILE_SKIP_SET_USER_EVENT_ON_FAST_IO : 0);
+
+            /* Fill out the I/O Status Block */
+            IoStatusBlock->Information = sizeof(FILE_IO_COMPLETION_NOTIFICATION_INFORMATION);
+            Status = IoStatusBlock->Status = STATUS_SUCCESS;
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            /* Get the exception code */
+            Status = _SEH2_GetExceptionCode();
+        }
+        _SEH2_END;
+
+        /* Dereference the file and return */
+        ObDereferenceObject(FileObject);
+        return Status;
+    }
+
     /* Check if this is a direct open or not */
     if (FileObject->Flags & FO_DIRECT_DEVICE_OPEN)
     {
@@ -2861,10 +3188,11 @@ NtReadFile(IN HANDLE FileHandle,
                 }
                 _SEH2_END;
 
-                /* Signal the completion event */
+                /* Signal the completion event, unless the caller opted out */
                 if (EventObject)
                 {
-                    KeSetEvent(EventObject, 0, FALSE);
+                    if (!(FileObject->Flags & FO_SKIP_SET_FAST_IO))
+                        KeSetEvent(EventObject, 0, FALSE);
                     ObDereferenceObject(EventObject);
                 }
 
@@ -3002,7 +3330,7 @@ NtReadFile(IN HANDLE FileHandle,
 }
 
 /*
- * @unimplemented
+ * @implemented
  */
 NTSTATUS
 NTAPI
@@ -3016,8 +3344,17 @@ NtReadFileScatter(IN HANDLE FileHandle,
                   IN PLARGE_INTEGER  ByteOffset,
                   IN PULONG Key OPTIONAL)
 {
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
+    /* Build the I/O request from the segment array */
+    return IopReadWriteFileSegments(FileHandle,
+                                    Event,
+                                    UserApcRoutine,
+                                    UserApcContext,
+                                    UserIoStatusBlock,
+                                    BufferDescription,
+                                    BufferLength,
+                                    ByteOffset,
+                                    Key,
+                                    FALSE);
 }
 
 /*
@@ -3062,6 +3399,7 @@ NtSetInformationFile(IN HANDLE FileHandle,
     PIO_COMPLETION_CONTEXT Context;
     PFILE_RENAME_INFORMATION RenameInfo;
     HANDLE TargetHandle = NULL;
+    ULONG NotificationModes;
     PAGED_CODE();
     IOTRACE(IO_API_DEBUG, "FileHandle: %p\n", FileHandle);
 
@@ -3147,6 +3485,73 @@ NtSetInformationFile(IN HANDLE FileHandle,
     DPRINT("Will call: %p\n", DeviceObject);
     DPRINT("Associated driver: %p (%wZ)\n", DeviceObject->DriverObject, &DeviceObject->DriverObject->DriverName);
 
+    /* The completion notification modes are only kept in the file object */
+    if (FileInformationClass == FileIoCompletionNotificationInformation)
+    {
+        /* Protect read in SEH */
+        _SEH2_TRY
+        {
+            /* Capture the new modes */
+            NotificationModes =
+                ((PFILE_IO_COMPLETION_NOTIFICATION_INFORMATION)FileInformation)->Flags;
+            Status = STATUS_SUCCESS;
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            /* Get the exception code */
+            Status = _SEH2_GetExceptionCode();
+        }
+        _SEH2_END;
+
+        if (NT_SUCCESS(Status))
+        {
+            /*
+             * Fail unknown modes, and skipping the port on a synchronous
+             * file object, which never reports pending I/O to begin with
+             */
+            if ((NotificationModes & ~(FILE_SKIP_COMPLETION_PORT_ON_SUCCESS |
+                                       FILE_SKIP_SET_EVENT_ON_HANDLE |
+                                       FILE_SKIP_SET_USER_EVENT_ON_FAST_IO)) ||
+                ((NotificationModes & FILE_SKIP_COMPLETION_PORT_ON_SUCCESS) &&
+                 (FileObject->Flags & FO_SYNCHRONOUS_IO)))
+            {
+                Status = STATUS_INVALID_PARAMETER;
+            }
+            else
+            {
+                /* The modes can't be cleared once set */
+                InterlockedOr((PLONG)&FileObject->Flags,
+                              ((NotificationModes & FILE_SKIP_COMPLETION_PORT_ON_SUCCESS) ?
+                               FO_SKIP_COMPLETION_PORT : 0) |
+                              ((NotificationModes & FILE_SKIP_SET_EVENT_ON_HANDLE) ?
+                               FO_SKIP_SET_EVENT : 0) |
+                              ((NotificationModes & FILE_SKIP_SET_USER_EVENT_ON_FAST_IO) ?
+                               FO_SKIP_SET_FAST_IO : 0));
+            }
+        }
+
+        if (NT_SUCCESS(Status))
+        {
+            /* Protect write in SEH */
+            _SEH2_TRY
+            {
+                /* Fill out the I/O Status Block */
+                IoStatusBlock->Information = 0;
+                IoStatusBlock->Status = Status;
+            }
+            _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+            {
+                /* Get the exception code */
+                Status = _SEH2_GetExceptionCode();
+            }
+            _SEH2_END;
+        }
+
+        /* Dereference the file and return */
+        ObDereferenceObject(FileObject);
+        return Status;
+    }
+
     /* Check if this is a file that was opened for Synch I/O */
     if (FileObject->Flags & FO_SYNCHRONOUS_IO)
     {
@@ -3919,10 +4324,11 @@ NtWriteFile(IN HANDLE FileHandle,
                 }
                 _SEH2_END;
 
-                /* Signal the completion event */
+                /* Signal the completion event, unless the caller opted out */
                 if (EventObject)
                 {
-                    KeSetEvent(EventObject, 0, FALSE);
+                    if (!(FileObject->Flags & FO_SKIP_SET_FAST_IO))
+                        KeSetEvent(EventObject, 0, FALSE);
                     ObDereferenceObject(EventObject);
                 }
 
@@ -4072,8 +4478,17 @@ NtWriteFileGather(IN HANDLE FileHandle,
                   IN PLARGE_INTEGER ByteOffset,
                   IN PULONG Key OPTIONAL)
 {
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
+    /* Build the I/O request from the segment array */
+    return IopReadWriteFileSegments(FileHandle,
+                                    Event,
+                                    UserApcRoutine,
+                                    UserApcContext,
+                                    UserIoStatusBlock,
+                                    BufferDescription,
+                                    BufferLength,
+                                    ByteOffset,
+                                    Key,
+                                    TRUE);
 }
 
 /*
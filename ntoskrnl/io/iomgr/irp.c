@@ -332,8 +332,14 @@ IopCompleteRequest(IN PKAPC Apc,
         (Irp->PendingReturned &&
          !IsIrpSynchronous(Irp, FileObject)))
     {
-        /* Get any information we need from the FO before we kill it */
-        if ((FileObject) && (FileObject->CompletionContext))
+        /*
+         * Get any information we need from the FO before we kill it. If the
+         * caller asked for it, don't queue a packet for a request that
+         * completed inline, the service returns its status directly.
+         */
+        if ((FileObject) && (FileObject->CompletionContext) &&
+            (!(FileObject->Flags & FO_SKIP_COMPLETION_PORT) ||
+             (Irp->PendingReturned)))
         {
             /* Save Completion Data */
             Port = FileObject->CompletionContext->Port;
@@ -399,8 +405,15 @@ IopCompleteRequest(IN PKAPC Apc,
         }
         else if (FileObject)
         {
-            /* Signal the file object and set the status */
-            KeSetEvent(&FileObject->Event, 0, FALSE);
+            /*
+             * Signal the file object and set the status. Asynchronous file
+             * objects can opt out of the signal, nobody waits on it for them.
+             */
+            if (!(FileObject->Flags & FO_SKIP_SET_EVENT) ||
+                (FileObject->Flags & FO_SYNCHRONOUS_IO))
+            {
+                KeSetEvent(&FileObject->Event, 0, FALSE);
+            }
             FileObject->FinalStatus = Irp->IoStatus.Status;
 
             /*
@@ -1282,6 +1295,13 @@ IofCallDriver(IN PDEVICE_OBJECT DeviceObject,
     /* Get the Device Object */
     StackPtr->DeviceObject = DeviceObject;
 
+    /* Log disk requests as they enter the top of the stack */
+    if ((Irp->CurrentLocation == Irp->StackCount) &&
+        WmiIsKernelEventEnabled(EVENT_TRACE_FLAG_DISK_IO_INIT))
+    {
+        WmiTraceDiskIo(Irp, StackPtr, FALSE);
+    }
+
     /* Call it */
     return DriverObject->MajorFunction[StackPtr->MajorFunction](DeviceObject,
                                                                 Irp);
@@ -1364,6 +1384,13 @@ IofCompleteRequest(IN PIRP Irp,
         /* Set Pending Returned */
         Irp->PendingReturned = StackPtr->Control & SL_PENDING_RETURNED;
 
+        /* Log disk requests as they complete at the top of the stack */
+        if ((Irp->CurrentLocation == (Irp->StackCount + 1)) &&
+            WmiIsKernelEventEnabled(EVENT_TRACE_FLAG_DISK_IO))
+        {
+            WmiTraceDiskIo(Irp, StackPtr, TRUE);
+        }
+
         /* Check if we failed */
         if (!NT_SUCCESS(Irp->IoStatus.Status))
         {
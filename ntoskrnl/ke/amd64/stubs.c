@@ -352,6 +352,9 @@ KiSystemCallHandler(
     /* Get descriptor table */
     DescriptorTable = (PVOID)((ULONG_PTR)Thread->ServiceTable + Offset);
 
+    /* Increase individual counts if system call statistics are on */
+    KiIncreaseSystemCallCount(Offset >> BITS_PER_ENTRY, ServiceNumber);
+
     /* Get stack bytes and calculate argument count */
     Count = DescriptorTable->Number[ServiceNumber] / 8;
 
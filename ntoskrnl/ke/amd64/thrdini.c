@@ -172,6 +172,12 @@ KiSwapContextResume(
     Pcr->ContextSwitches++;
     NewThread->ContextSwitches++;
 
+    /* Log the switch if the kernel logger wants it */
+    if (WmiIsKernelEventEnabled(EVENT_TRACE_FLAG_CSWITCH))
+    {
+        WmiTraceContextSwitch(OldThread, NewThread);
+    }
+
     /* DPCs shouldn't be active */
     if (Pcr->Prcb.DpcRoutineActive)
     {
@@ -224,7 +224,7 @@ KeRemoveByKeyDeviceQueue(IN PKDEVICE_QUEUE DeviceQueue,
                                         DeviceListEntry);
 
         /* Check if we can just get the first entry */
-        if (ReturnEntry->SortKey <= SortKey)
+        if (ReturnEntry->SortKey < SortKey)
         {
             /* Get the first entry */
             ReturnEntry = CONTAINING_RECORD(NextEntry->Flink,
@@ -299,7 +299,7 @@ KeRemoveByKeyDeviceQueueIfBusy(IN PKDEVICE_QUEUE DeviceQueue,
                                         DeviceListEntry);
 
         /* Check if we can just get the first entry */
-        if (ReturnEntry->SortKey <= SortKey)
+        if (ReturnEntry->SortKey < SortKey)
         {
             /* Get the first entry */
             ReturnEntry = CONTAINING_RECORD(NextEntry->Flink,
@@ -380,6 +380,12 @@ KiSwapContextExit(IN PKTHREAD OldThread,
     /* Load data from switch frame */
     Pcr->NtTib.ExceptionList = SwitchFrame->ExceptionList;
 
+    /* Log the switch if the kernel logger wants it */
+    if (WmiIsKernelEventEnabled(EVENT_TRACE_FLAG_CSWITCH))
+    {
+        WmiTraceContextSwitch(OldThread, NewThread);
+    }
+
     /* DPCs shouldn't be active */
     if (Pcr->PrcbData.DpcRoutineActive)
     {
@@ -1720,6 +1720,7 @@ KiSystemServiceHandler(IN PKTRAP_FRAME TrapFrame,
     ULONG Id, Offset, StackBytes;
     NTSTATUS Status;
     PVOID Handler;
+    ULONG64 StartCycles;
     ULONG SystemCallNumber = TrapFrame->Eax;
 
     /* Get the current thread */
@@ -1812,8 +1813,8 @@ KiSystemServiceHandler(IN PKTRAP_FRAME TrapFrame,
     /* Increase system call count */
     KeGetCurrentPrcb()->KeSystemCalls++;
 
-    /* FIXME: Increase individual counts on debug systems */
-    //KiIncreaseSystemCallCount(DescriptorTable, Id);
+    /* Increase individual counts if system call statistics are on */
+    KiIncreaseSystemCallCount(Offset >> BITS_PER_ENTRY, Id);
 
     /* Get stack bytes */
     StackBytes = DescriptorTable->Number[Id];
@@ -1830,7 +1831,17 @@ KiSystemServiceHandler(IN PKTRAP_FRAME TrapFrame,
 
     /* Get the handler and make the system call */
     Handler = (PVOID)DescriptorTable->Base[Id];
-    Status = KiSystemCallTrampoline(Handler, Arguments, StackBytes);
+    if (__builtin_expect(KiSystemCallStatistics & KI_SYSCALL_STATISTICS_CYCLES, 0))
+    {
+        /* Time the service too, including any user mode callbacks it makes */
+        StartCycles = __rdtsc();
+        Status = KiSystemCallTrampoline(Handler, Arguments, StackBytes);
+        KiAddSystemCallCycles(Offset >> BITS_PER_ENTRY, Id, __rdtsc() - StartCycles);
+    }
+    else
+    {
+        Status = KiSystemCallTrampoline(Handler, Arguments, StackBytes);
+    }
 
     /* Call post-service debug hook */
     Status = KiDbgPostServiceHook(SystemCallNumber, Status);
@@ -924,6 +924,9 @@ KeAddSystemServiceTable(IN PULONG_PTR Base,
     KeServiceDescriptorTableShadow[Index].Limit = Limit;
     KeServiceDescriptorTableShadow[Index].Number = Number;
     KeServiceDescriptorTableShadow[Index].Count = Count;
+
+    /* Count calls into the new table as well */
+    KiInitializeServiceStatistics(Index, Limit);
     return TRUE;
 }
 
@@ -20,6 +20,7 @@ LIST_ENTRY KiProfileSourceListHead;
 KSPIN_LOCK KiProfileLock;
 ULONG KiProfileTimeInterval = 78125; /* Default resolution 7.8ms (sysinternals) */
 ULONG KiProfileAlignmentFixupInterval;
+BOOLEAN KiSampledProfileActive;
 
 /* FUNCTIONS *****************************************************************/
 
@@ -201,8 +202,11 @@ KeStopProfile(IN PKPROFILE Profile)
     /* Release the profile lock */
     KeReleaseSpinLockFromDpcLevel(&KiProfileLock);
 
-    /* Stop the profile interrupt */
-    HalStopProfileInterrupt(Profile->Source);
+    /* Stop the profile interrupt, unless the kernel logger still samples */
+    if (!(KiSampledProfileActive) || (Profile->Source != ProfileTime))
+    {
+        HalStopProfileInterrupt(Profile->Source);
+    }
 
     /* Lower back to original IRQL */
     KeLowerIrql(OldIrql);
@@ -288,6 +292,84 @@ KeSetIntervalProfile(IN ULONG Interval,
     }
 }
 
+ULONG_PTR
+NTAPI
+KiStartProfileInterruptTarget(IN ULONG_PTR Interval)
+{
+    /* MP HALs have a profile timer per processor, each one is set up locally */
+    HalSetProfileInterval(Interval);
+    HalStartProfileInterrupt(ProfileTime);
+    return 0;
+}
+
+ULONG_PTR
+NTAPI
+KiStopProfileInterruptTarget(IN ULONG_PTR Argument)
+{
+    /* Stop this processor's profile timer */
+    HalStopProfileInterrupt(ProfileTime);
+    return 0;
+}
+
+VOID
+NTAPI
+KeStartSampledProfile(VOID)
+{
+    KIRQL OldIrql;
+
+    /* Raise to profile IRQL and acquire the profile lock */
+    KeRaiseIrql(KiProfileIrql, &OldIrql);
+    KeAcquireSpinLockAtDpcLevel(&KiProfileLock);
+
+    /* Keep profile objects from stopping the interrupt under us */
+    KiSampledProfileActive = TRUE;
+
+    /* Release the profile lock and lower IRQL */
+    KeReleaseSpinLockFromDpcLevel(&KiProfileLock);
+    KeLowerIrql(OldIrql);
+
+    /* Sample on all processors, at the interval set for ProfileTime */
+    KeIpiGenericCall(KiStartProfileInterruptTarget, KiProfileTimeInterval);
+}
+
+VOID
+NTAPI
+KeStopSampledProfile(VOID)
+{
+    KIRQL OldIrql;
+    PKPROFILE_SOURCE_OBJECT CurrentSource;
+    PLIST_ENTRY NextEntry;
+    BOOLEAN StopInterrupt = TRUE;
+
+    /* Raise to profile IRQL and acquire the profile lock */
+    KeRaiseIrql(KiProfileIrql, &OldIrql);
+    KeAcquireSpinLockAtDpcLevel(&KiProfileLock);
+
+    KiSampledProfileActive = FALSE;
+
+    /* Leave the interrupt on if profile objects still use it */
+    for (NextEntry = KiProfileSourceListHead.Flink;
+         NextEntry != &KiProfileSourceListHead;
+         NextEntry = NextEntry->Flink)
+    {
+        CurrentSource = CONTAINING_RECORD(NextEntry,
+                                          KPROFILE_SOURCE_OBJECT,
+                                          ListEntry);
+        if (CurrentSource->Source == ProfileTime)
+        {
+            StopInterrupt = FALSE;
+            break;
+        }
+    }
+
+    /* Release the profile lock and lower IRQL */
+    KeReleaseSpinLockFromDpcLevel(&KiProfileLock);
+    KeLowerIrql(OldIrql);
+
+    /* Stop sampling on all processors */
+    if (StopInterrupt) KeIpiGenericCall(KiStopProfileInterruptTarget, 0);
+}
+
 /*
  * @implemented
  */
@@ -356,6 +438,12 @@ KeProfileInterruptWithSource(IN PKTRAP_FRAME TrapFrame,
 {
     PKPROCESS Process = KeGetCurrentThread()->ApcState.Process;
 
+    /* Let the NT Kernel Logger take a call stack sample */
+    if ((Source == ProfileTime) && WmiIsKernelEventEnabled(EVENT_TRACE_FLAG_PROFILE))
+    {
+        WmiTraceProfileSample(TrapFrame);
+    }
+
     /* We have to parse 2 lists. Per-Process and System-Wide */
     KiParseProfileList(TrapFrame, Source, &Process->ProfileListHead);
     KiParseProfileList(TrapFrame, Source, &KiProfileListHead);
@@ -231,16 +231,55 @@ KeReadStateQueue(IN PKQUEUE Queue)
 }
 
 /*
- * @implemented
+ * Takes whatever else is queued without waiting, with the dispatcher lock
+ * held. These entries are processed by the thread which already owns the
+ * first one, so they don't count against concurrency.
  */
-PLIST_ENTRY
-NTAPI
-KeRemoveQueue(IN PKQUEUE Queue,
+static
+ULONG
+KiDrainQueue(IN PKQUEUE Queue,
+             OUT PLIST_ENTRY *EntryArray,
+             IN ULONG Count)
+{
+    PLIST_ENTRY QueueEntry;
+    ULONG Entries = 1;
+
+    while (Entries < Count)
+    {
+        QueueEntry = Queue->EntryListHead.Flink;
+        if (QueueEntry == &Queue->EntryListHead) break;
+
+        /* Decrease the number of entries */
+        Queue->Header.SignalState--;
+
+        /* Remove the Entry */
+        RemoveEntryList(QueueEntry);
+        QueueEntry->Flink = NULL;
+        EntryArray[Entries++] = QueueEntry;
+    }
+
+    return Entries;
+}
+
+/*
+ * Waits for an entry and stores it in EntryArray[0], or the wait status if
+ * the wait failed. Up to Count - 1 more entries are taken while the
+ * dispatcher lock is still held from the wait.
+ */
+static
+ULONG
+KiRemoveQueue(IN PKQUEUE Queue,
               IN KPROCESSOR_MODE WaitMode,
-              IN PLARGE_INTEGER Timeout OPTIONAL)
+              IN BOOLEAN Alertable,
+              IN PLARGE_INTEGER Timeout OPTIONAL,
+              OUT PLIST_ENTRY *EntryArray,
+              IN ULONG Count)
 {
     PLIST_ENTRY QueueEntry;
+    ULONG Entries = 1;
+    KIRQL OldIrql;
     LONG_PTR Status;
+    NTSTATUS WaitStatus;
     PKTHREAD Thread = KeGetCurrentThread();
     PKQUEUE PreviousQueue;
     PKWAIT_BLOCK WaitBlock = &Thread->WaitBlock[0];
@@ -344,12 +383,12 @@ KeRemoveQueue(IN PKQUEUE Queue,
             }
             else
             {
-                /* Fail if there's a User APC Pending */
-                if ((WaitMode != KernelMode) &&
-                    (Thread->ApcState.UserApcPending))
+                /* Fail if we were alerted or there's a User APC Pending */
+                WaitStatus = KiCheckAlertability(Thread, Alertable, WaitMode);
+                if (WaitStatus != STATUS_WAIT_0)
                 {
                     /* Return the status and increase the pending threads */
-                    QueueEntry = (PLIST_ENTRY)STATUS_USER_APC;
+                    QueueEntry = (PLIST_ENTRY)(LONG_PTR)WaitStatus;
                     Queue->CurrentCount++;
                     break;
                 }
@@ -404,7 +443,28 @@ KeRemoveQueue(IN PKQUEUE Queue,
                 Thread->WaitReason = 0;
 
                 /* Check if we were executing an APC */
-                if (Status != STATUS_KERNEL_APC) return (PLIST_ENTRY)Status;
+                if (Status != STATUS_KERNEL_APC)
+                {
+                    /* We were either handed an entry or the wait failed */
+                    EntryArray[0] = (PLIST_ENTRY)Status;
+                    if ((Count == 1) ||
+                        (Status == STATUS_TIMEOUT) ||
+                        (Status == STATUS_USER_APC) ||
+                        (Status == STATUS_ALERTED))
+                    {
+                        return Entries;
+                    }
+
+                    /*
+                     * The entry was handed over by the thread which queued
+                     * it and which has released the lock since, so take
+                     * it once more for the rest.
+                     */
+                    OldIrql = KiAcquireDispatcherLock();
+                    Entries = KiDrainQueue(Queue, EntryArray, Count);
+                    KiReleaseDispatcherLock(OldIrql);
+                    return Entries;
+                }
 
                 /* Check if we had a timeout */
                 if (Timeout)
@@ -424,12 +484,59 @@ KeRemoveQueue(IN PKQUEUE Queue,
         }
     }
 
+    /* If we got an entry, take the rest under the same lock */
+    EntryArray[0] = QueueEntry;
+    if ((QueueEntry != (PLIST_ENTRY)(LONG_PTR)STATUS_TIMEOUT) &&
+        (QueueEntry != (PLIST_ENTRY)(LONG_PTR)STATUS_USER_APC) &&
+        (QueueEntry != (PLIST_ENTRY)(LONG_PTR)STATUS_ALERTED))
+    {
+        Entries = KiDrainQueue(Queue, EntryArray, Count);
+    }
+
     /* Unlock Database and return */
     KiReleaseDispatcherLockFromSynchLevel();
     KiExitDispatcher(Thread->WaitIrql);
+    return Entries;
+}
+
+/*
+ * @implemented
+ */
+PLIST_ENTRY
+NTAPI
+KeRemoveQueue(IN PKQUEUE Queue,
+              IN KPROCESSOR_MODE WaitMode,
+              IN PLARGE_INTEGER Timeout OPTIONAL)
+{
+    PLIST_ENTRY QueueEntry;
+
+    /* Wait for a single entry */
+    KiRemoveQueue(Queue, WaitMode, FALSE, Timeout, &QueueEntry, 1);
     return QueueEntry;
 }
 
+/*
+ * @implemented
+ *
+ * Returns the number of entries written to EntryArray. If the wait failed,
+ * this is one and the first entry is the wait status instead.
+ */
+ULONG
+NTAPI
+KeRemoveQueueEx(IN PKQUEUE Queue,
+                IN KPROCESSOR_MODE WaitMode,
+                IN BOOLEAN Alertable,
+                IN PLARGE_INTEGER Timeout OPTIONAL,
+                OUT PLIST_ENTRY *EntryArray,
+                IN ULONG Count)
+{
+    ASSERT_QUEUE(Queue);
+    ASSERT(Count != 0);
+
+    /* Wait for the first entry, this makes us an active thread of the queue */
+    return KiRemoveQueue(Queue, WaitMode, Alertable, Timeout, EntryArray, Count);
+}
+
 /*
  * @implemented
  */
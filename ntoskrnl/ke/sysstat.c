@@ -0,0 +1,94 @@
+/*
+* PROJECT:         ReactOS Kernel
+* LICENSE:         GPL - See COPYING in the top level directory
+* FILE:            ntoskrnl/ke/sysstat.c
+* PURPOSE:         Per-Service System Call Statistics
+*/
+
+/* INCLUDES ******************************************************************/
+
+#include <ntoskrnl.h>
+#define NDEBUG
+#include <debug.h>
+
+/* GLOBALS *******************************************************************/
+
+/*
+ * Set from Session Manager\Kernel\SystemCallStatistics. Checked builds count
+ * calls by default, like they always meant to.
+ */
+#if DBG
+ULONG KiSystemCallStatistics = KI_SYSCALL_STATISTICS_COUNTS;
+#else
+ULONG KiSystemCallStatistics;
+#endif
+
+KSERVICE_TABLE_STATISTICS KiServiceStatistics[SSDT_MAX_ENTRIES];
+
+/* PRIVATE FUNCTIONS *********************************************************/
+
+static
+PVOID
+KiAllocateServiceCounters(IN ULONG Stride)
+{
+    SIZE_T Size;
+    PVOID Counters;
+
+    /*
+     * Whole pages come back page aligned, so with a cache aligned stride
+     * no two processors ever write to the same line.
+     */
+    Size = ROUND_TO_PAGES((SIZE_T)Stride * KeNumberProcessors);
+    Counters = ExAllocatePoolWithTag(NonPagedPool, Size, TAG_KE_SYSCALL);
+    if (Counters) RtlZeroMemory(Counters, Size);
+    return Counters;
+}
+
+VOID
+NTAPI
+KiInitializeServiceStatistics(IN ULONG Index,
+                              IN ULONG Limit)
+{
+    PKSERVICE_TABLE_STATISTICS Statistics;
+    PULONG Counts;
+    PULONG64 Cycles = NULL;
+    ULONG CountStride, CycleStride;
+    PAGED_CODE();
+
+    /* Nothing to do if statistics are off or were already set up */
+    if (!(KiSystemCallStatistics & KI_SYSCALL_STATISTICS_COUNTS)) return;
+    if (Index >= SSDT_MAX_ENTRIES) return;
+    Statistics = &KiServiceStatistics[Index];
+    if (Statistics->Counts) return;
+
+    /* Every processor gets its own cache aligned slice of counters */
+    CountStride = ALIGN_UP_BY(Limit * sizeof(ULONG), SYSTEM_CACHE_ALIGNMENT_SIZE);
+    CycleStride = ALIGN_UP_BY(Limit * sizeof(ULONG64), SYSTEM_CACHE_ALIGNMENT_SIZE);
+
+    Counts = KiAllocateServiceCounters(CountStride);
+    if (!Counts)
+    {
+        DPRINT1("Failed to allocate call counters for service table %lu\n", Index);
+        return;
+    }
+
+    if (KiSystemCallStatistics & KI_SYSCALL_STATISTICS_CYCLES)
+    {
+        /* Timing is optional, keep counting if it can't be had */
+        Cycles = KiAllocateServiceCounters(CycleStride);
+        if (!Cycles)
+        {
+            DPRINT1("Failed to allocate call timers for service table %lu\n", Index);
+        }
+    }
+
+    /* Fill out the table before publishing it to the system call path */
+    Statistics->Limit = Limit;
+    Statistics->Processors = KeNumberProcessors;
+    Statistics->CountStride = CountStride / sizeof(ULONG);
+    Statistics->CycleStride = CycleStride / sizeof(ULONG64);
+    Statistics->Cycles = Cycles;
+    InterlockedExchangePointer((PVOID*)&Statistics->Counts, Counts);
+}
+
+/* EOF */
@@ -18,6 +18,9 @@ LONG KiTickOffset;
 ULONG KeTimeAdjustment;
 BOOLEAN KiTimeAdjustmentEnabled = FALSE;
 
+/* Longest idle period we ask the HAL for, in 100ns units */
+#define KI_MAXIMUM_IDLE_INTERVAL (1000 * 10000)
+
 /* FUNCTIONS ******************************************************************/
 
 FORCEINLINE
@@ -59,6 +62,62 @@ KiCheckForTimerExpiration(
     }
 }
 
+/*
+ * Advances the interrupt time by Increment and the system time and tick
+ * count by the full ticks this completes. Returns the number of ticks.
+ */
+static
+ULONG
+KiAdvanceSystemTime(
+    PKPRCB Prcb,
+    PKTRAP_FRAME TrapFrame,
+    ULONG Increment)
+{
+    ULARGE_INTEGER CurrentTime, InterruptTime;
+    LONG OldTickOffset;
+    ULONG Ticks, i;
+
+    /* Add the increment time to the shared data */
+    InterruptTime.QuadPart = *(ULONGLONG*)&SharedUserData->InterruptTime;
+    InterruptTime.QuadPart += Increment;
+    KiWriteSystemTime(&SharedUserData->InterruptTime, InterruptTime);
+
+    /* Check for timer expiration */
+    KiCheckForTimerExpiration(Prcb, TrapFrame, InterruptTime);
+
+    /* Update the tick offset */
+    OldTickOffset = InterlockedExchangeAdd(&KiTickOffset, -(LONG)Increment);
+
+    /* Check for full tick */
+    if (OldTickOffset > (LONG)Increment) return 0;
+
+    /* A stretched idle period can cover more than one tick */
+    Ticks = ((ULONG)((LONG)Increment - OldTickOffset) / KeMaximumIncrement) + 1;
+
+    /* Update the system time */
+    CurrentTime.QuadPart = *(ULONGLONG*)&SharedUserData->SystemTime;
+    CurrentTime.QuadPart += (ULONGLONG)KeTimeAdjustment * Ticks;
+    KiWriteSystemTime(&SharedUserData->SystemTime, CurrentTime);
+
+    /* Update the tick count, one tick at a time so no timer hand is skipped */
+    for (i = 0; i < Ticks; i++)
+    {
+        CurrentTime.QuadPart = (*(ULONGLONG*)&KeTickCount) + 1;
+        KiWriteSystemTime(&KeTickCount, CurrentTime);
+
+        /* Check for expiration with the new tick count as well */
+        KiCheckForTimerExpiration(Prcb, TrapFrame, InterruptTime);
+    }
+
+    /* Update it in the shared user data */
+    KiWriteSystemTime(&SharedUserData->TickCount, CurrentTime);
+
+    /* Reset the tick offset */
+    KiTickOffset += KeMaximumIncrement * Ticks;
+
+    return Ticks;
+}
+
 VOID
 FASTCALL
 KeUpdateSystemTime(IN PKTRAP_FRAME TrapFrame,
@@ -66,8 +125,7 @@ KeUpdateSystemTime(IN PKTRAP_FRAME TrapFrame,
                    IN KIRQL Irql)
 {
     PKPRCB Prcb = KeGetCurrentPrcb();
-    ULARGE_INTEGER CurrentTime, InterruptTime;
-    LONG OldTickOffset;
+    ULONG Ticks;
 
     /* Check if this tick is being skipped */
     if (Prcb->SkipTick)
@@ -83,16 +141,8 @@ KeUpdateSystemTime(IN PKTRAP_FRAME TrapFrame,
         return;
     }
 
-    /* Add the increment time to the shared data */
-    InterruptTime.QuadPart = *(ULONGLONG*)&SharedUserData->InterruptTime;
-    InterruptTime.QuadPart += Increment;
-    KiWriteSystemTime(&SharedUserData->InterruptTime, InterruptTime);
-
-    /* Check for timer expiration */
-    KiCheckForTimerExpiration(Prcb, TrapFrame, InterruptTime);
-
-    /* Update the tick offset */
-    OldTickOffset = InterlockedExchangeAdd(&KiTickOffset, -(LONG)Increment);
+    /* Update the interrupt time, system time and tick count */
+    Ticks = KiAdvanceSystemTime(Prcb, TrapFrame, Increment);
 
     /* If the debugger is enabled, check for break-in request */
     if (KdDebuggerEnabled && KdPollBreakIn())
@@ -102,28 +152,17 @@ KeUpdateSystemTime(IN PKTRAP_FRAME TrapFrame,
     }
 
     /* Check for full tick */
-    if (OldTickOffset <= (LONG)Increment)
+    if (Ticks)
     {
-        /* Update the system time */
-        CurrentTime.QuadPart = *(ULONGLONG*)&SharedUserData->SystemTime;
-        CurrentTime.QuadPart += KeTimeAdjustment;
-        KiWriteSystemTime(&SharedUserData->SystemTime, CurrentTime);
-
-        /* Update the tick count */
-        CurrentTime.QuadPart = (*(ULONGLONG*)&KeTickCount) + 1;
-        KiWriteSystemTime(&KeTickCount, CurrentTime);
-
-        /* Update it in the shared user data */
-        KiWriteSystemTime(&SharedUserData->TickCount, CurrentTime);
-
-        /* Check for expiration with the new tick count as well */
-        KiCheckForTimerExpiration(Prcb, TrapFrame, InterruptTime);
-
-        /* Reset the tick offset */
-        KiTickOffset += KeMaximumIncrement;
-
         /* Update processor/thread runtime */
         KeUpdateRunTime(TrapFrame, Irql);
+
+        /* The ticks that were skipped have all been spent idle */
+        if (Ticks > 1)
+        {
+            Prcb->KernelTime += Ticks - 1;
+            Prcb->IdleThread->KernelTime += Ticks - 1;
+        }
     }
     else
     {
@@ -250,3 +289,57 @@ KeUpdateRunTime(IN PKTRAP_FRAME TrapFrame,
         HalRequestSoftwareInterrupt(DISPATCH_LEVEL);
     }
 }
+
+BOOLEAN
+NTAPI
+KiEnterDynamicTickIdle(VOID)
+{
+    ULONGLONG InterruptTime, DueTime;
+    ULONG Hand, i;
+
+    /* The debugger polls for break-in on every tick, keep them coming */
+    if (KdDebuggerEnabled) return FALSE;
+
+    /* Find the earliest due time among the hands we could skip over */
+    InterruptTime = *(ULONGLONG*)&SharedUserData->InterruptTime;
+    Hand = KiComputeTimerTableIndex(InterruptTime);
+    DueTime = InterruptTime + KI_MAXIMUM_IDLE_INTERVAL;
+    for (i = 0; i <= (KI_MAXIMUM_IDLE_INTERVAL / KeMaximumIncrement) + 1; i++)
+    {
+        /* The list time is the earliest due time of all its timers */
+        if (KiTimerTableListHead[Hand].Time.QuadPart < DueTime)
+        {
+            DueTime = KiTimerTableListHead[Hand].Time.QuadPart;
+        }
+
+        Hand = (Hand + 1) & (TIMER_TABLE_SIZE - 1);
+    }
+
+    /* Nothing to gain if a timer expires within the next tick anyway */
+    if (DueTime <= InterruptTime + KeMaximumIncrement) return FALSE;
+
+    /* Ask the HAL to hold off the clock until then */
+    return HalSetIdleClockInterval((ULONG)(DueTime - InterruptTime)) != 0;
+}
+
+VOID
+NTAPI
+KiExitDynamicTickIdle(VOID)
+{
+    PKPRCB Prcb = KeGetCurrentPrcb();
+    ULONG Increment, Ticks;
+
+    /* Go back to the periodic clock and get the time we slept */
+    Increment = HalSetIdleClockInterval(0);
+    if (!Increment) return;
+
+    /*
+     * Catch up before the woken thread looks at the time. There is no trap
+     * frame here, the PRCB only flags a timer request for the idle loop.
+     */
+    Ticks = KiAdvanceSystemTime(Prcb, (PKTRAP_FRAME)Prcb, Increment);
+
+    /* All of these ticks have been spent idle */
+    Prcb->KernelTime += Ticks;
+    Prcb->IdleThread->KernelTime += Ticks;
+}
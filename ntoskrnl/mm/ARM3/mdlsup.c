@@ -1690,16 +1690,115 @@ MmProbeAndLockProcessPages(IN OUT PMDL MemoryDescriptorList,
 
 
 /*
- * @unimplemented
+ * @implemented
  */
 VOID
 NTAPI
 MmProbeAndLockSelectedPages(IN OUT PMDL MemoryDescriptorList,
-                            IN LARGE_INTEGER PageList[],
+                            IN FILE_SEGMENT_ELEMENT SegmentArray[],
                             IN KPROCESSOR_MODE AccessMode,
                             IN LOCK_OPERATION Operation)
 {
-    UNIMPLEMENTED;
+    PPFN_NUMBER MdlPages;
+    ULONG PageCount, ByteCount, i;
+    ULONG_PTR Address;
+    NTSTATUS Status = STATUS_SUCCESS;
+    struct
+    {
+        MDL Mdl;
+        PFN_NUMBER Page;
+    } PageMdl;
+    DPRINT("Probing selected pages for MDL: %p\n", MemoryDescriptorList);
+
+    //
+    // Sanity checks
+    //
+    ASSERT(MemoryDescriptorList->ByteCount != 0);
+    ASSERT(MemoryDescriptorList->ByteOffset == 0);
+    ASSERT((MemoryDescriptorList->MdlFlags & (MDL_PAGES_LOCKED |
+                                              MDL_MAPPED_TO_SYSTEM_VA |
+                                              MDL_SOURCE_IS_NONPAGED_POOL |
+                                              MDL_PARTIAL |
+                                              MDL_IO_SPACE)) == 0);
+
+    //
+    // Every element of the segment array describes exactly one page
+    //
+    MdlPages = (PPFN_NUMBER)(MemoryDescriptorList + 1);
+    PageCount = ADDRESS_AND_SIZE_TO_SPAN_PAGES(0, MemoryDescriptorList->ByteCount);
+
+    MemoryDescriptorList->Process = NULL;
+
+    for (i = 0; i < PageCount; i++)
+    {
+        _SEH2_TRY
+        {
+            //
+            // The pages must be page aligned and addressable from here. Callers
+            // should pass a captured array, but a bad one must not leak the
+            // pages locked so far either
+            //
+            Address = (ULONG_PTR)SegmentArray[i].Buffer;
+            if ((Address & (PAGE_SIZE - 1)) ||
+                ((ULONGLONG)Address != SegmentArray[i].Alignment))
+            {
+                ExRaiseStatus(STATUS_DATATYPE_MISALIGNMENT);
+            }
+
+            //
+            // Probe and lock this page through a single page MDL
+            //
+            MmInitializeMdl(&PageMdl.Mdl, (PVOID)Address, PAGE_SIZE);
+            MmProbeAndLockPages(&PageMdl.Mdl, AccessMode, Operation);
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            Status = _SEH2_GetExceptionCode();
+        }
+        _SEH2_END;
+        if (!NT_SUCCESS(Status)) break;
+
+        //
+        // All the pages must come from the same address space
+        //
+        if ((i != 0) && (PageMdl.Mdl.Process != MemoryDescriptorList->Process))
+        {
+            MmUnlockPages(&PageMdl.Mdl);
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        //
+        // Move the locked page into the caller's MDL
+        //
+        MemoryDescriptorList->Process = PageMdl.Mdl.Process;
+        MemoryDescriptorList->MdlFlags |= PageMdl.Mdl.MdlFlags &
+                                          (MDL_PAGES_LOCKED |
+                                           MDL_IO_SPACE |
+                                           MDL_WRITE_OPERATION);
+        MdlPages[i] = PageMdl.Page;
+    }
+
+    //
+    // So how did that go?
+    //
+    if (!NT_SUCCESS(Status))
+    {
+        //
+        // Unlock the pages we got so far, shrinking the MDL so that the
+        // locked page accounting matches, and raise the error
+        //
+        DPRINT("SELECTED PAGES PROBE FAILED!\n");
+        if (i != 0)
+        {
+            ByteCount = MemoryDescriptorList->ByteCount;
+            MemoryDescriptorList->ByteCount = i * PAGE_SIZE;
+            MmUnlockPages(MemoryDescriptorList);
+            MemoryDescriptorList->ByteCount = ByteCount;
+        }
+        MemoryDescriptorList->Process = NULL;
+        ExRaiseStatus(Status);
+    }
 }
 
 /*
@@ -199,12 +199,12 @@ MmNotPresentFault(KPROCESSOR_MODE Mode,
 
 extern BOOLEAN Mmi386MakeKernelPageTableGlobal(PVOID Address);
 
+static
 NTSTATUS
-NTAPI
-MmAccessFault(IN ULONG FaultCode,
-              IN PVOID Address,
-              IN KPROCESSOR_MODE Mode,
-              IN PVOID TrapInformation)
+MmpDispatchAccessFault(IN ULONG FaultCode,
+                       IN PVOID Address,
+                       IN KPROCESSOR_MODE Mode,
+                       IN PVOID TrapInformation)
 {
     PMEMORY_AREA MemoryArea = NULL;
 
@@ -264,3 +264,23 @@ MmAccessFault(IN ULONG FaultCode,
     }
 }
 
+NTSTATUS
+NTAPI
+MmAccessFault(IN ULONG FaultCode,
+              IN PVOID Address,
+              IN KPROCESSOR_MODE Mode,
+              IN PVOID TrapInformation)
+{
+    NTSTATUS Status;
+
+    Status = MmpDispatchAccessFault(FaultCode, Address, Mode, TrapInformation);
+
+    /* Let the kernel logger know how the fault was resolved */
+    if (WmiIsKernelEventEnabled(EVENT_TRACE_FLAG_MEMORY_PAGE_FAULTS))
+    {
+        WmiTracePageFault(Status, Address, TrapInformation);
+    }
+
+    return Status;
+}
+
@@ -1098,6 +1098,12 @@ MiReadPage(PMEMORY_AREA MemoryArea,
 
     DPRINT("%S %I64x\n", FileObject->FileName.Buffer, FileOffset);
 
+    /* Let the prefetcher know what this launch needs */
+    CcPfLogFileAccess(FileObject,
+                      FileOffset,
+                      PAGE_SIZE,
+                      IsImageSection ? PF_ENTRY_TYPE_IMAGE_FAULT : PF_ENTRY_TYPE_DATA_FAULT);
+
     /*
      * If the file system is letting us go directly to the cache and the
      * memory area was mapped at an offset in the file which is page aligned
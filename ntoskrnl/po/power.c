@@ -386,8 +386,21 @@ VOID
 FASTCALL
 PopIdle0(IN PPROCESSOR_POWER_STATE PowerState)
 {
+    BOOLEAN DynamicTick;
+
+    /* Skip the clock ticks until the next timer is due */
+    DynamicTick = KiEnterDynamicTickIdle();
+
     /* FIXME: Extremly naive implementation */
     HalProcessorIdle();
+
+    /* Whatever woke us up might ready a thread, bring the clock back */
+    if (DynamicTick)
+    {
+        _disable();
+        KiExitDynamicTickIdle();
+        _enable();
+    }
 }
 
 INIT_FUNCTION
@@ -65,7 +65,8 @@ PspUserThreadStartup(IN PKSTART_ROUTINE StartRoutine,
         /* Check if the Prefetcher is enabled */
         if (CcPfEnablePrefetcher)
         {
-            /* FIXME: Prepare to prefetch this process */
+            /* Prefetch and trace the launch of this process */
+            CcPfBeginAppLaunch(Thread->ThreadsProcess);
         }
 
         /* Raise to APC */
@@ -0,0 +1,511 @@
+/*
+ * PROJECT:         ReactOS Kernel
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * FILE:            ntoskrnl/wmi/callouts.c
+ * PURPOSE:         NT Kernel Logger Event Callouts
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include <ntoskrnl.h>
+#include <wmiguid.h>
+#include "wmip.h"
+
+#define NDEBUG
+#include <debug.h>
+
+/* GLOBALS *******************************************************************/
+
+static volatile LONG WmipProfileSampleId;
+
+#ifdef _M_IX86
+/* Most samples one processor keeps for its DPC, those beyond go without user stack */
+#define WMIP_MAX_PENDING_SAMPLES 16
+
+/* Bounds the pool used by threads that don't get to deliver their APCs */
+#define WMIP_MAX_PENDING_WALKS 1024
+
+typedef struct _WMIP_PROFILE_PROCESSOR
+{
+    KDPC Dpc;
+    PKTHREAD Thread;
+    ULONG SampleCount;
+    ULONG SampleIds[WMIP_MAX_PENDING_SAMPLES];
+} WMIP_PROFILE_PROCESSOR, *PWMIP_PROFILE_PROCESSOR;
+
+typedef struct _WMIP_USER_STACK_WALK
+{
+    KAPC Apc;
+    ULONG SampleCount;
+    ULONG SampleIds[ANYSIZE_ARRAY];
+} WMIP_USER_STACK_WALK, *PWMIP_USER_STACK_WALK;
+
+static WMIP_PROFILE_PROCESSOR WmipProfileProcessors[MAXIMUM_PROCESSORS];
+static volatile LONG WmipPendingWalks;
+#endif
+
+/* PRIVATE FUNCTIONS *********************************************************/
+
+#ifdef _M_IX86
+/*
+ * Follows an EBP chain. The profile interrupt uses it for kernel stacks,
+ * which it can read without faulting as long as every frame is inside the
+ * stack. User stacks are only walked at PASSIVE_LEVEL, with every frame
+ * probed under SEH, so Walked is kept up to date in case a read faults.
+ */
+static
+VOID
+WmipWalkFrameChain(
+    _In_ ULONG_PTR Frame,
+    _In_ ULONG_PTR StackBegin,
+    _In_ ULONG_PTR StackEnd,
+    _In_ BOOLEAN UserStack,
+    _Out_writes_to_(Count, *Walked) PULONG64 Frames,
+    _In_ ULONG Count,
+    _Out_ PULONG Walked)
+{
+    ULONG_PTR NextFrame, ReturnAddress;
+    ULONG i;
+
+    *Walked = 0;
+    for (i = 0; i < Count; i++)
+    {
+        /* The frame holds the caller's frame and the return address */
+        if ((Frame < StackBegin) ||
+            (Frame > StackEnd - 2 * sizeof(ULONG_PTR)) ||
+            (Frame & (sizeof(ULONG_PTR) - 1)))
+        {
+            break;
+        }
+
+        if (UserStack)
+            ProbeForRead((PVOID)Frame, 2 * sizeof(ULONG_PTR), sizeof(ULONG_PTR));
+
+        NextFrame = ((PULONG_PTR)Frame)[0];
+        ReturnAddress = ((PULONG_PTR)Frame)[1];
+        if (ReturnAddress == 0)
+            break;
+
+        Frames[i] = ReturnAddress;
+        *Walked = i + 1;
+
+        /* Callers always live further up the stack */
+        if (NextFrame <= Frame)
+            break;
+        Frame = NextFrame;
+    }
+}
+
+static
+ULONG
+WmipWalkKernelStack(
+    _In_ PKTHREAD Thread,
+    _In_ PKTRAP_FRAME TrapFrame,
+    _Out_writes_to_(Count, return) PULONG64 Frames,
+    _In_ ULONG Count)
+{
+    ULONG_PTR StackBegin, StackEnd;
+    ULONG Walked;
+
+    StackBegin = (ULONG_PTR)Thread->StackLimit;
+    StackEnd = (ULONG_PTR)Thread->StackBase;
+    if ((TrapFrame->Ebp < StackBegin) || (TrapFrame->Ebp >= StackEnd))
+    {
+        /* DPCs run on the processor's own stack */
+        StackEnd = (ULONG_PTR)KeGetCurrentPrcb()->DpcStack;
+        StackBegin = StackEnd - KERNEL_STACK_SIZE;
+        if (!(StackEnd) || (TrapFrame->Ebp < StackBegin) || (TrapFrame->Ebp >= StackEnd))
+            return 0;
+    }
+
+    WmipWalkFrameChain(TrapFrame->Ebp, StackBegin, StackEnd, FALSE, Frames, Count, &Walked);
+    return Walked;
+}
+
+/* Runs at PASSIVE_LEVEL in the sampled thread, the stack is the caller's to unmap */
+static
+ULONG
+WmipWalkUserStack(
+    _In_ PKTHREAD Thread,
+    _In_ PKTRAP_FRAME TrapFrame,
+    _Out_writes_to_(Count, return) PULONG64 Frames,
+    _In_ ULONG Count)
+{
+    PNT_TIB Tib = &((PTEB)Thread->Teb)->NtTib;
+    ULONG_PTR StackBegin, StackEnd;
+    ULONG Walked = 0;
+
+    PAGED_CODE();
+
+    Frames[0] = TrapFrame->Eip;
+
+    _SEH2_TRY
+    {
+        ProbeForRead(Tib, sizeof(NT_TIB), sizeof(ULONG_PTR));
+        StackBegin = (ULONG_PTR)Tib->StackLimit;
+        StackEnd = (ULONG_PTR)Tib->StackBase;
+        if ((StackEnd > StackBegin) && (StackEnd <= MmUserProbeAddress))
+        {
+            WmipWalkFrameChain(TrapFrame->Ebp, StackBegin, StackEnd, TRUE,
+                               Frames + 1, Count - 1, &Walked);
+        }
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+        /* Keep the frames that could be read */
+    }
+    _SEH2_END;
+
+    return 1 + Walked;
+}
+
+static
+VOID
+NTAPI
+WmipUserStackKernelRoutine(
+    _In_ PKAPC Apc,
+    _Inout_ PKNORMAL_ROUTINE *NormalRoutine,
+    _Inout_ PVOID *NormalContext,
+    _Inout_ PVOID *SystemArgument1,
+    _Inout_ PVOID *SystemArgument2)
+{
+    /* The walk happens in the normal routine, at PASSIVE_LEVEL */
+}
+
+static
+VOID
+NTAPI
+WmipUserStackRundownRoutine(
+    _In_ PKAPC Apc)
+{
+    ExFreePoolWithTag(CONTAINING_RECORD(Apc, WMIP_USER_STACK_WALK, Apc), TAG_WMI_STACK_WALK);
+    InterlockedDecrement(&WmipPendingWalks);
+}
+
+/*
+ * The thread can't have run user code since it was sampled, kernel APCs are
+ * delivered before it returns to user mode. So its user trap frame still
+ * describes the sampled user stack.
+ */
+static
+VOID
+NTAPI
+WmipUserStackNormalRoutine(
+    _In_ PVOID NormalContext,
+    _In_ PVOID SystemArgument1,
+    _In_ PVOID SystemArgument2)
+{
+    PWMIP_USER_STACK_WALK Walk = NormalContext;
+    struct
+    {
+        WMI_SAMPLED_USER_STACK_EVENT Event;
+        ULONG64 MoreFrames[WMI_SAMPLED_PROFILE_MAX_FRAMES - ANYSIZE_ARRAY];
+    } Stack;
+    PKTHREAD Thread = KeGetCurrentThread();
+    PKTRAP_FRAME TrapFrame = KeGetTrapFrame(Thread);
+    ULONG i;
+
+    if (KiUserTrap(TrapFrame) && !(TrapFrame->EFlags & EFLAGS_V86_MASK))
+    {
+        Stack.Event.FrameCount = WmipWalkUserStack(Thread,
+                                                   TrapFrame,
+                                                   Stack.Event.Frames,
+                                                   WMI_SAMPLED_PROFILE_MAX_FRAMES);
+
+        /* Every sample taken before the walk shares the stack */
+        for (i = 0; i < Walk->SampleCount; i++)
+        {
+            Stack.Event.SampleId = Walk->SampleIds[i];
+            WmipTraceKernelEvent(&PerfInfoGuid,
+                                 WMI_TRACE_TYPE_SAMPLED_USER_STACK,
+                                 &Stack.Event,
+                                 FIELD_OFFSET(WMI_SAMPLED_USER_STACK_EVENT,
+                                              Frames[Stack.Event.FrameCount]));
+        }
+    }
+
+    ExFreePoolWithTag(Walk, TAG_WMI_STACK_WALK);
+    InterlockedDecrement(&WmipPendingWalks);
+}
+
+/* Queues the user stack walk for the samples the profile interrupt left here */
+static
+VOID
+NTAPI
+WmipProfileDpcRoutine(
+    _In_ PKDPC Dpc,
+    _In_opt_ PVOID DeferredContext,
+    _In_opt_ PVOID SystemArgument1,
+    _In_opt_ PVOID SystemArgument2)
+{
+    PWMIP_PROFILE_PROCESSOR Processor = DeferredContext;
+    ULONG SampleIds[WMIP_MAX_PENDING_SAMPLES];
+    PWMIP_USER_STACK_WALK Walk;
+    ULONG SampleCount;
+    PKTHREAD Thread;
+    BOOLEAN Enable;
+
+    /* The profile interrupt fills this in on the same processor */
+    Enable = KeDisableInterrupts();
+    Thread = Processor->Thread;
+    SampleCount = Processor->SampleCount;
+    RtlCopyMemory(SampleIds, Processor->SampleIds, SampleCount * sizeof(ULONG));
+    Processor->SampleCount = 0;
+    KeRestoreInterrupts(Enable);
+
+    /*
+     * Nothing can be scheduled before this DPC runs, so the sampled thread is
+     * normally still current, and therefore still alive. If not, the samples
+     * keep just the interrupted user address.
+     */
+    if (!(SampleCount) || (Thread != KeGetCurrentThread()))
+        return;
+
+    if (InterlockedIncrement(&WmipPendingWalks) > WMIP_MAX_PENDING_WALKS)
+    {
+        InterlockedDecrement(&WmipPendingWalks);
+        return;
+    }
+
+    Walk = ExAllocatePoolWithTag(NonPagedPool,
+                                 FIELD_OFFSET(WMIP_USER_STACK_WALK, SampleIds[SampleCount]),
+                                 TAG_WMI_STACK_WALK);
+    if (!Walk)
+    {
+        InterlockedDecrement(&WmipPendingWalks);
+        return;
+    }
+
+    Walk->SampleCount = SampleCount;
+    RtlCopyMemory(Walk->SampleIds, SampleIds, SampleCount * sizeof(ULONG));
+
+    KeInitializeApc(&Walk->Apc,
+                    Thread,
+                    OriginalApcEnvironment,
+                    WmipUserStackKernelRoutine,
+                    WmipUserStackRundownRoutine,
+                    WmipUserStackNormalRoutine,
+                    KernelMode,
+                    Walk);
+    if (!KeInsertQueueApc(&Walk->Apc, NULL, NULL, IO_NO_INCREMENT))
+    {
+        ExFreePoolWithTag(Walk, TAG_WMI_STACK_WALK);
+        InterlockedDecrement(&WmipPendingWalks);
+    }
+}
+#endif
+
+VOID
+NTAPI
+WmipInitializeProfileSampling(
+    VOID)
+{
+#ifdef _M_IX86
+    ULONG i;
+
+    for (i = 0; i < MAXIMUM_PROCESSORS; i++)
+    {
+        KeInitializeDpc(&WmipProfileProcessors[i].Dpc,
+                        WmipProfileDpcRoutine,
+                        &WmipProfileProcessors[i]);
+    }
+#endif
+}
+
+/* FUNCTIONS *****************************************************************/
+
+/*
+ * Called from the dispatcher on the new thread's stack, with the dispatcher
+ * lock still held.
+ */
+VOID
+FASTCALL
+WmiTraceContextSwitch(IN PKTHREAD OldThread,
+                      IN PKTHREAD NewThread)
+{
+    WMI_CSWITCH_EVENT Event;
+
+    Event.NewThreadId = HandleToUlong(CONTAINING_RECORD(NewThread, ETHREAD, Tcb)->Cid.UniqueThread);
+    Event.OldThreadId = HandleToUlong(CONTAINING_RECORD(OldThread, ETHREAD, Tcb)->Cid.UniqueThread);
+    Event.NewThreadPriority = NewThread->Priority;
+    Event.OldThreadPriority = OldThread->Priority;
+    Event.PreviousCState = 0;
+    Event.SpareByte = 0;
+    Event.OldThreadWaitReason = OldThread->WaitReason;
+    Event.OldThreadWaitMode = OldThread->WaitMode;
+    Event.OldThreadState = OldThread->State;
+    Event.OldThreadWaitIdealProcessor = OldThread->IdealProcessor;
+    Event.NewThreadWaitTime = KeTickCount.LowPart - NewThread->WaitTime;
+    Event.Reserved = 0;
+
+    WmipTraceKernelEvent(&ThreadGuid, WMI_TRACE_TYPE_CSWITCH, &Event, sizeof(Event));
+}
+
+VOID
+FASTCALL
+WmiTraceDiskIo(IN PIRP Irp,
+               IN PIO_STACK_LOCATION StackPtr,
+               IN BOOLEAN Completion)
+{
+    WMI_DISKIO_EVENT Event;
+    UCHAR Type;
+
+    /* Only reads and writes sent to disks are interesting */
+    if ((StackPtr->DeviceObject == NULL) ||
+        (StackPtr->DeviceObject->DeviceType != FILE_DEVICE_DISK))
+    {
+        return;
+    }
+
+    if (StackPtr->MajorFunction == IRP_MJ_READ)
+    {
+        Type = Completion ? EVENT_TRACE_TYPE_IO_READ : EVENT_TRACE_TYPE_IO_READ_INIT;
+    }
+    else if (StackPtr->MajorFunction == IRP_MJ_WRITE)
+    {
+        Type = Completion ? EVENT_TRACE_TYPE_IO_WRITE : EVENT_TRACE_TYPE_IO_WRITE_INIT;
+    }
+    else
+    {
+        return;
+    }
+
+    /* Read and write parameters share the same layout */
+    Event.IrpFlags = Irp->Flags;
+    Event.TransferSize = Completion ? (ULONG)Irp->IoStatus.Information :
+                                      StackPtr->Parameters.Read.Length;
+    Event.Status = Completion ? Irp->IoStatus.Status : STATUS_PENDING;
+    Event.Reserved = 0;
+    Event.ByteOffset = StackPtr->Parameters.Read.ByteOffset;
+    Event.Irp = (ULONG_PTR)Irp;
+    Event.FileObject = (ULONG_PTR)StackPtr->FileObject;
+    Event.DeviceObject = (ULONG_PTR)StackPtr->DeviceObject;
+
+    WmipTraceKernelEvent(&DiskIoGuid, Type, &Event, sizeof(Event));
+}
+
+VOID
+FASTCALL
+WmiTracePageFault(IN NTSTATUS Status,
+                  IN PVOID Address,
+                  IN PVOID TrapInformation)
+{
+    WMI_PAGE_FAULT_EVENT Event;
+    UCHAR Type;
+
+    /* The type says how the fault was resolved */
+    switch (Status)
+    {
+        case STATUS_PAGE_FAULT_TRANSITION:
+            Type = EVENT_TRACE_TYPE_MM_TF;
+            break;
+
+        case STATUS_PAGE_FAULT_DEMAND_ZERO:
+            Type = EVENT_TRACE_TYPE_MM_DZF;
+            break;
+
+        case STATUS_PAGE_FAULT_COPY_ON_WRITE:
+            Type = EVENT_TRACE_TYPE_MM_COW;
+            break;
+
+        case STATUS_PAGE_FAULT_GUARD_PAGE:
+        case STATUS_GUARD_PAGE_VIOLATION:
+            Type = EVENT_TRACE_TYPE_MM_GPF;
+            break;
+
+        case STATUS_PAGE_FAULT_PAGING_FILE:
+            Type = EVENT_TRACE_TYPE_MM_HPF;
+            break;
+
+        default:
+            Type = NT_SUCCESS(Status) ? EVENT_TRACE_TYPE_INFO : EVENT_TRACE_TYPE_MM_AV;
+            break;
+    }
+
+    Event.VirtualAddress = (ULONG_PTR)Address;
+    Event.ProgramCounter = (TrapInformation != NULL) ?
+                           KeGetTrapFramePc((PKTRAP_FRAME)TrapInformation) : 0;
+    Event.Status = Status;
+    Event.Reserved = 0;
+
+    WmipTraceKernelEvent(&PageFaultGuid, Type, &Event, sizeof(Event));
+}
+
+/*
+ * Called from the profile interrupt, with the trap frame of whatever it
+ * interrupted. Only the kernel stack can be walked here. The user stack
+ * lives in memory the process can unmap at any time, and a fault at
+ * PROFILE_LEVEL is fatal, so only the interrupted user address is recorded,
+ * and the full user stack follows in a separate event from a kernel APC.
+ */
+VOID
+FASTCALL
+WmiTraceProfileSample(IN PKTRAP_FRAME TrapFrame)
+{
+    struct
+    {
+        WMI_SAMPLED_PROFILE_EVENT Event;
+        ULONG64 MoreFrames[WMI_SAMPLED_PROFILE_MAX_FRAMES - ANYSIZE_ARRAY];
+    } Sample;
+    PULONG64 Frames = Sample.Event.Frames;
+    ULONG KernelFrames = 0, UserFrames = 0;
+    ULONG SampleId = InterlockedIncrement(&WmipProfileSampleId);
+#ifdef _M_IX86
+    PKTHREAD Thread = KeGetCurrentThread();
+    PWMIP_PROFILE_PROCESSOR Processor;
+    PKTRAP_FRAME UserTrapFrame;
+
+    if (KiUserTrap(TrapFrame) || (TrapFrame->EFlags & EFLAGS_V86_MASK))
+    {
+        UserTrapFrame = TrapFrame;
+    }
+    else
+    {
+        /* Leave a frame for the interrupted user address */
+        Frames[0] = TrapFrame->Eip;
+        KernelFrames = 1 + WmipWalkKernelStack(Thread,
+                                               TrapFrame,
+                                               Frames + 1,
+                                               WMI_SAMPLED_PROFILE_MAX_FRAMES - 2);
+
+        /* Threads that came from user mode have that trap frame on top of their stack */
+        UserTrapFrame = KeGetTrapFrame(Thread);
+        if (!KiUserTrap(UserTrapFrame)) UserTrapFrame = NULL;
+    }
+
+    if (UserTrapFrame)
+    {
+        Frames[KernelFrames] = UserTrapFrame->Eip;
+        UserFrames = 1;
+
+        /* Leave the rest of the user stack to the sampled thread itself */
+        Processor = &WmipProfileProcessors[KeGetCurrentProcessorNumber()];
+        if ((Thread->Teb) &&
+            !(UserTrapFrame->EFlags & EFLAGS_V86_MASK) &&
+            (Processor->SampleCount < WMIP_MAX_PENDING_SAMPLES) &&
+            (!(Processor->SampleCount) || (Processor->Thread == Thread)))
+        {
+            Processor->Thread = Thread;
+            Processor->SampleIds[Processor->SampleCount++] = SampleId;
+            KeInsertQueueDpc(&Processor->Dpc, NULL, NULL);
+        }
+    }
+#else
+    /* Without frame pointers to follow, only the interrupted address is known */
+    Frames[0] = KeGetTrapFramePc(TrapFrame);
+    if (KiUserTrap(TrapFrame))
+        UserFrames = 1;
+    else
+        KernelFrames = 1;
+#endif
+
+    Sample.Event.KernelFrames = (USHORT)KernelFrames;
+    Sample.Event.UserFrames = (USHORT)UserFrames;
+    Sample.Event.SampleId = SampleId;
+
+    WmipTraceKernelEvent(&PerfInfoGuid,
+                         WMI_TRACE_TYPE_SAMPLED_PROFILE,
+                         &Sample.Event,
+                         FIELD_OFFSET(WMI_SAMPLED_PROFILE_EVENT,
+                                      Frames[max(KernelFrames + UserFrames, 1)]));
+}
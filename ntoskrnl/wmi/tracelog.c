@@ -0,0 +1,1667 @@
+/*
+ * PROJECT:         ReactOS Kernel
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * FILE:            ntoskrnl/wmi/tracelog.c
+ * PURPOSE:         Event Tracing Sessions and Trace Providers
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include <ntoskrnl.h>
+#include <wmiguid.h>
+#include "wmip.h"
+
+#define NDEBUG
+#include <debug.h>
+
+typedef struct _WMIP_TRACE_PROVIDER
+{
+    LIST_ENTRY ListEntry;
+    GUID ControlGuid;
+    PKEVENT Event;
+} WMIP_TRACE_PROVIDER, *PWMIP_TRACE_PROVIDER;
+
+typedef struct _WMIP_TRACE_ENABLE
+{
+    LIST_ENTRY ListEntry;
+    GUID ControlGuid;
+    WMI_TRACE_ENABLE_CONTEXT Context;
+} WMIP_TRACE_ENABLE, *PWMIP_TRACE_ENABLE;
+
+C_ASSERT(sizeof(WMI_TRACE_ENABLE_CONTEXT) == sizeof(TRACEHANDLE));
+
+#define WMIP_MAX_MOF_FIELDS 16
+
+/* GLOBALS *******************************************************************/
+
+/* Serializes logger control and the provider lists, never taken by writers */
+KGUARDED_MUTEX WmipTraceMutex;
+LIST_ENTRY WmipTraceProviderList;
+LIST_ENTRY WmipTraceEnableList;
+
+/* Indexed by logger id, which is also the handle. Id 0 is never used */
+PWMIP_LOGGER_CONTEXT volatile WmipLoggerContext[WMI_MAXIMUM_LOGGERS];
+PWMIP_LOGGER_CONTEXT volatile WmipKernelLogger;
+volatile ULONG WmipKernelLoggerEnableFlags;
+
+/* PRIVATE FUNCTIONS *********************************************************/
+
+VOID
+NTAPI
+WmipInitializeTraceLog(
+    VOID)
+{
+    KeInitializeGuardedMutex(&WmipTraceMutex);
+    InitializeListHead(&WmipTraceProviderList);
+    InitializeListHead(&WmipTraceEnableList);
+    WmipInitializeProfileSampling();
+}
+
+FORCEINLINE
+LONG64
+WmipGetTimeStamp(
+    _In_ PWMIP_LOGGER_CONTEXT Logger)
+{
+    return WmiGetClock(Logger->ClockType, NULL);
+}
+
+static
+VOID
+NTAPI
+WmipFlushDpcRoutine(
+    _In_ PKDPC Dpc,
+    _In_opt_ PVOID DeferredContext,
+    _In_opt_ PVOID SystemArgument1,
+    _In_opt_ PVOID SystemArgument2)
+{
+    PWMIP_LOGGER_CONTEXT Logger = DeferredContext;
+
+    /* Writers can't signal from where they run, so wake the flush thread from here */
+    KeSetEvent(&Logger->FlushEvent, IO_NO_INCREMENT, FALSE);
+}
+
+static
+PWMIP_BUFFER
+WmipAllocateBuffer(
+    _In_ PWMIP_LOGGER_CONTEXT Logger)
+{
+    PWMIP_BUFFER Buffer;
+
+    Buffer = ExAllocatePoolWithTag(NonPagedPool,
+                                   FIELD_OFFSET(WMIP_BUFFER, Header) + Logger->BufferSize,
+                                   TAG_WMI_BUFFER);
+    if (Buffer != NULL)
+    {
+        /*
+         * Only ever set here. Writers still holding a stale pointer may
+         * reference the buffer after it was recycled, and undo it later.
+         */
+        Buffer->ReferenceCount = 0;
+        InterlockedIncrement(&Logger->NumberOfBuffers);
+    }
+
+    return Buffer;
+}
+
+static
+VOID
+WmipGrowFreeList(
+    _In_ PWMIP_LOGGER_CONTEXT Logger)
+{
+    PWMIP_BUFFER Buffer;
+
+    /* Keep a spare buffer per processor so bursts don't lose events */
+    while ((ExQueryDepthSList(&Logger->FreeList) < (USHORT)KeNumberProcessors + 1) &&
+           ((ULONG)Logger->NumberOfBuffers < Logger->MaximumBuffers))
+    {
+        Buffer = WmipAllocateBuffer(Logger);
+        if (Buffer == NULL)
+            break;
+
+        InterlockedPushEntrySList(&Logger->FreeList, &Buffer->ListEntry);
+    }
+}
+
+static
+VOID
+WmipFreeBuffers(
+    _In_ PWMIP_LOGGER_CONTEXT Logger)
+{
+    PSLIST_ENTRY ListEntry;
+
+    while ((ListEntry = InterlockedPopEntrySList(&Logger->FreeList)) != NULL)
+    {
+        ExFreePoolWithTag(CONTAINING_RECORD(ListEntry, WMIP_BUFFER, ListEntry),
+                          TAG_WMI_BUFFER);
+    }
+}
+
+static
+BOOLEAN
+FASTCALL
+WmipSwitchBuffer(
+    _In_ PWMIP_LOGGER_CONTEXT Logger,
+    _In_ ULONG Processor,
+    _In_opt_ PWMIP_BUFFER OldBuffer)
+{
+    PWMIP_BUFFER NewBuffer;
+
+    /* Get a fresh buffer, allocation is left to the flush thread */
+    NewBuffer = (PWMIP_BUFFER)InterlockedPopEntrySList(&Logger->FreeList);
+    if (NewBuffer == NULL)
+    {
+        KeInsertQueueDpc(&Logger->FlushDpc, NULL, NULL);
+        return FALSE;
+    }
+
+    NewBuffer->CurrentOffset = sizeof(WMI_BUFFER_HEADER);
+    NewBuffer->Header.SavedOffset = 0;
+    NewBuffer->Header.ProcessorNumber = (USHORT)Processor;
+    NewBuffer->Header.LoggerId = (USHORT)Logger->LoggerId;
+
+    /* Install it, unless somebody else replaced the full one first */
+    if (InterlockedCompareExchangePointer((PVOID*)&Logger->ProcessorBuffers[Processor],
+                                          NewBuffer,
+                                          OldBuffer) != OldBuffer)
+    {
+        InterlockedPushEntrySList(&Logger->FreeList, &NewBuffer->ListEntry);
+        return TRUE;
+    }
+
+    /* Hand the old one over to the flush thread */
+    if (OldBuffer != NULL)
+    {
+        InterlockedPushEntrySList(&Logger->FlushList, &OldBuffer->ListEntry);
+        KeInsertQueueDpc(&Logger->FlushDpc, NULL, NULL);
+    }
+
+    return TRUE;
+}
+
+/*
+ * Reserves Size bytes in the current processor's buffer and returns it
+ * referenced. Must be called at DISPATCH_LEVEL or above, possibly from
+ * inside the dispatcher, so it neither allocates nor signals anything.
+ */
+static
+PEVENT_TRACE_HEADER
+FASTCALL
+WmipReserveEvent(
+    _In_ PWMIP_LOGGER_CONTEXT Logger,
+    _In_ ULONG Size,
+    _Out_ PWMIP_BUFFER *ReservedBuffer)
+{
+    PWMIP_BUFFER Buffer;
+    ULONG Processor, Offset;
+
+    ASSERT(KeGetCurrentIrql() >= DISPATCH_LEVEL);
+
+    Size = ALIGN_UP_BY(Size, 8);
+    if (Size > Logger->BufferSize - sizeof(WMI_BUFFER_HEADER))
+    {
+        InterlockedIncrement(&Logger->EventsLost);
+        return NULL;
+    }
+
+    Processor = KeGetCurrentProcessorNumber();
+    for (;;)
+    {
+        Buffer = Logger->ProcessorBuffers[Processor];
+        if (Buffer == NULL)
+        {
+            if (!WmipSwitchBuffer(Logger, Processor, NULL))
+                break;
+
+            continue;
+        }
+
+        /* Reference the buffer and make sure it wasn't switched meanwhile */
+        InterlockedIncrement(&Buffer->ReferenceCount);
+        if (Buffer == Logger->ProcessorBuffers[Processor])
+        {
+            Offset = (ULONG)Buffer->CurrentOffset;
+            if (Offset + Size <= Logger->BufferSize)
+            {
+                Offset = (ULONG)InterlockedExchangeAdd(&Buffer->CurrentOffset, Size);
+                if (Offset + Size <= Logger->BufferSize)
+                {
+                    *ReservedBuffer = Buffer;
+                    return (PEVENT_TRACE_HEADER)((PUCHAR)&Buffer->Header + Offset);
+                }
+
+                /* We went past the end first, remember where the data stops */
+                if (Offset <= Logger->BufferSize)
+                {
+                    Buffer->Header.SavedOffset = Offset;
+                }
+            }
+        }
+        InterlockedDecrement(&Buffer->ReferenceCount);
+
+        /* The buffer is full, move on to a new one */
+        if ((Buffer == Logger->ProcessorBuffers[Processor]) &&
+            !WmipSwitchBuffer(Logger, Processor, Buffer))
+        {
+            break;
+        }
+    }
+
+    InterlockedIncrement(&Logger->EventsLost);
+    return NULL;
+}
+
+static
+VOID
+WmipFillEventHeader(
+    _Out_ PEVENT_TRACE_HEADER TraceHeader,
+    _In_ ULONG Size,
+    _In_ LONG64 TimeStamp)
+{
+    PETHREAD Thread = PsGetCurrentThread();
+
+    TraceHeader->Size = (USHORT)Size;
+    TraceHeader->ThreadId = HandleToUlong(Thread->Cid.UniqueThread);
+    TraceHeader->ProcessId = HandleToUlong(Thread->Cid.UniqueProcess);
+    TraceHeader->TimeStamp.QuadPart = TimeStamp;
+    TraceHeader->KernelTime = Thread->Tcb.KernelTime;
+    TraceHeader->UserTime = Thread->Tcb.UserTime;
+}
+
+static
+VOID
+WmipWaitForBuffer(
+    _In_ PWMIP_BUFFER Buffer)
+{
+    LARGE_INTEGER Interval;
+
+    /* Writers copying user data still reference it */
+    Interval.QuadPart = -10 * 1000;
+    while (Buffer->ReferenceCount != 0)
+    {
+        KeDelayExecutionThread(KernelMode, FALSE, &Interval);
+    }
+}
+
+static
+NTSTATUS
+WmipWriteLogFile(
+    _In_ PWMIP_LOGGER_CONTEXT Logger,
+    _In_ PVOID Data,
+    _In_ PLARGE_INTEGER ByteOffset)
+{
+    IO_STATUS_BLOCK IoStatusBlock;
+
+    return ZwWriteFile(Logger->FileHandle,
+                       NULL,
+                       NULL,
+                       NULL,
+                       &IoStatusBlock,
+                       Data,
+                       Logger->BufferSize,
+                       ByteOffset,
+                       NULL);
+}
+
+static
+VOID
+WmipWriteBuffer(
+    _In_ PWMIP_LOGGER_CONTEXT Logger,
+    _In_ PWMIP_BUFFER Buffer)
+{
+    ULONG Used;
+    ULONG64 Limit;
+    NTSTATUS Status;
+
+    WmipWaitForBuffer(Buffer);
+
+    /* Writers that overflowed the buffer left the real end behind */
+    Used = (ULONG)Buffer->CurrentOffset;
+    if (Used > Logger->BufferSize)
+    {
+        Used = Buffer->Header.SavedOffset;
+    }
+
+    if (Used <= sizeof(WMI_BUFFER_HEADER))
+        return;
+
+    Buffer->Header.BufferSize = Logger->BufferSize;
+    Buffer->Header.SavedOffset = Used;
+    Buffer->Header.TimeStamp.QuadPart = WmipGetTimeStamp(Logger);
+    Buffer->Header.SequenceNumber = Logger->SequenceNumber++;
+    RtlZeroMemory(Buffer->Header.Reserved, sizeof(Buffer->Header.Reserved));
+    RtlZeroMemory((PUCHAR)&Buffer->Header + Used, Logger->BufferSize - Used);
+
+    /* Honour the file size limit */
+    Limit = (ULONG64)Logger->MaximumFileSize * 1024 * 1024;
+    if ((Limit != 0) && ((ULONG64)Logger->FileOffset.QuadPart + Logger->BufferSize > Limit))
+    {
+        if (!(Logger->LogFileMode & EVENT_TRACE_FILE_MODE_CIRCULAR))
+        {
+            Logger->LogBuffersLost++;
+            return;
+        }
+
+        /* Wrap around, the logfile header buffer stays */
+        Logger->FileOffset.QuadPart = Logger->BufferSize;
+    }
+
+    Status = WmipWriteLogFile(Logger, &Buffer->Header, &Logger->FileOffset);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Failed to write trace buffer: 0x%lx\n", Status);
+        Logger->LogBuffersLost++;
+        return;
+    }
+
+    Logger->FileOffset.QuadPart += Logger->BufferSize;
+    Logger->BuffersWritten++;
+}
+
+static
+VOID
+WmipFlushBuffers(
+    _In_ PWMIP_LOGGER_CONTEXT Logger)
+{
+    PSLIST_ENTRY ListEntry, NextEntry, OldestEntry;
+    PWMIP_BUFFER Buffer;
+
+    /* Take the whole list and reverse it, so buffers are written in order */
+    ListEntry = InterlockedFlushSList(&Logger->FlushList);
+    OldestEntry = NULL;
+    while (ListEntry != NULL)
+    {
+        NextEntry = ListEntry->Next;
+        ListEntry->Next = OldestEntry;
+        OldestEntry = ListEntry;
+        ListEntry = NextEntry;
+    }
+
+    for (ListEntry = OldestEntry; ListEntry != NULL; ListEntry = NextEntry)
+    {
+        NextEntry = ListEntry->Next;
+        Buffer = CONTAINING_RECORD(ListEntry, WMIP_BUFFER, ListEntry);
+
+        WmipWriteBuffer(Logger, Buffer);
+        InterlockedPushEntrySList(&Logger->FreeList, &Buffer->ListEntry);
+    }
+}
+
+static
+VOID
+WmipWriteLogFileHeader(
+    _In_ PWMIP_LOGGER_CONTEXT Logger,
+    _In_ BOOLEAN Final)
+{
+    PWMI_BUFFER_HEADER BufferHeader;
+    PEVENT_TRACE_HEADER TraceHeader;
+    PWMI_LOGFILE_HEADER LogFileHeader;
+    LARGE_INTEGER ByteOffset;
+    ULONG Size;
+    NTSTATUS Status;
+
+    BufferHeader = ExAllocatePoolWithTag(PagedPool, Logger->BufferSize, TAG_WMI_BUFFER);
+    if (BufferHeader == NULL)
+    {
+        DPRINT1("Failed to allocate the logfile header buffer\n");
+        return;
+    }
+
+    RtlZeroMemory(BufferHeader, Logger->BufferSize);
+    TraceHeader = (PEVENT_TRACE_HEADER)(BufferHeader + 1);
+    LogFileHeader = (PWMI_LOGFILE_HEADER)(TraceHeader + 1);
+    Size = sizeof(EVENT_TRACE_HEADER) + sizeof(WMI_LOGFILE_HEADER);
+
+    BufferHeader->BufferSize = Logger->BufferSize;
+    BufferHeader->SavedOffset = sizeof(WMI_BUFFER_HEADER) + ALIGN_UP_BY(Size, 8);
+    BufferHeader->TimeStamp = Logger->StartTimeStamp;
+    BufferHeader->LoggerId = (USHORT)Logger->LoggerId;
+
+    TraceHeader->Size = (USHORT)Size;
+    TraceHeader->Class.Type = EVENT_TRACE_TYPE_INFO;
+    TraceHeader->Guid = EventTraceGuid;
+    TraceHeader->TimeStamp = Logger->StartTimeStamp;
+
+    LogFileHeader->Version = WMI_LOGFILE_VERSION;
+    LogFileHeader->NumberOfProcessors = KeNumberProcessors;
+    LogFileHeader->BufferSize = Logger->BufferSize;
+    LogFileHeader->LogFileMode = Logger->LogFileMode;
+    LogFileHeader->MaximumFileSize = Logger->MaximumFileSize;
+    LogFileHeader->EnableFlags = Logger->EnableFlags;
+    LogFileHeader->ClockType = Logger->ClientContext;
+    LogFileHeader->PointerSize = sizeof(PVOID);
+    LogFileHeader->ClockFrequency = Logger->ClockFrequency;
+    LogFileHeader->StartTime = Logger->StartTime;
+    LogFileHeader->StartTimeStamp = Logger->StartTimeStamp;
+
+    /* The statistics are only known once the logger stops */
+    if (Final)
+    {
+        KeQuerySystemTime(&LogFileHeader->EndTime);
+        LogFileHeader->BuffersWritten = Logger->BuffersWritten;
+        LogFileHeader->EventsLost = Logger->EventsLost;
+        LogFileHeader->BuffersLost = Logger->LogBuffersLost;
+    }
+
+    ByteOffset.QuadPart = 0;
+    Status = WmipWriteLogFile(Logger, BufferHeader, &ByteOffset);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Failed to write the logfile header: 0x%lx\n", Status);
+    }
+
+    ExFreePoolWithTag(BufferHeader, TAG_WMI_BUFFER);
+}
+
+static
+VOID
+WmipSwitchAllBuffers(
+    _In_ PWMIP_LOGGER_CONTEXT Logger)
+{
+    PWMIP_BUFFER Buffer;
+    ULONG i;
+
+    for (i = 0; i < (ULONG)KeNumberProcessors; i++)
+    {
+        Buffer = Logger->ProcessorBuffers[i];
+        if ((Buffer != NULL) && (Buffer->CurrentOffset > sizeof(WMI_BUFFER_HEADER)))
+        {
+            WmipSwitchBuffer(Logger, i, Buffer);
+        }
+    }
+}
+
+static
+VOID
+NTAPI
+WmipLoggerThread(
+    _In_ PVOID Context)
+{
+    PWMIP_LOGGER_CONTEXT Logger = Context;
+    PWMIP_BUFFER Buffer;
+    LARGE_INTEGER Timeout;
+    LONG FlushRequested;
+    NTSTATUS Status;
+    ULONG i;
+
+    WmipWriteLogFileHeader(Logger, FALSE);
+
+    for (;;)
+    {
+        /* The flush timer can be updated while we run */
+        Timeout.QuadPart = Int32x32To64(Logger->FlushTimer, -10000000);
+        Status = KeWaitForSingleObject(&Logger->FlushEvent,
+                                       Executive,
+                                       KernelMode,
+                                       FALSE,
+                                       (Logger->FlushTimer != 0) ? &Timeout : NULL);
+        if (Logger->Stopping)
+            break;
+
+        /* On timeout or request, also write out the partially filled buffers */
+        FlushRequested = InterlockedExchange(&Logger->FlushRequested, 0);
+        if ((Status == STATUS_TIMEOUT) || FlushRequested)
+        {
+            WmipSwitchAllBuffers(Logger);
+        }
+
+        WmipFlushBuffers(Logger);
+        WmipGrowFreeList(Logger);
+
+        if (FlushRequested)
+        {
+            KeSetEvent(&Logger->FlushCompleteEvent, IO_NO_INCREMENT, FALSE);
+        }
+    }
+
+    /* Writers are gone, take back the processor buffers and write everything */
+    for (i = 0; i < (ULONG)KeNumberProcessors; i++)
+    {
+        Buffer = InterlockedExchangePointer((PVOID*)&Logger->ProcessorBuffers[i], NULL);
+        if (Buffer != NULL)
+        {
+            InterlockedPushEntrySList(&Logger->FlushList, &Buffer->ListEntry);
+        }
+    }
+
+    WmipFlushBuffers(Logger);
+    WmipWriteLogFileHeader(Logger, TRUE);
+
+    ZwClose(Logger->FileHandle);
+    Logger->FileHandle = NULL;
+
+    PsTerminateSystemThread(STATUS_SUCCESS);
+}
+
+static
+NTSTATUS
+WmipGetLoggerString(
+    _In_ PWMI_LOGGER_INFORMATION LoggerInfo,
+    _In_ ULONG Offset,
+    _Out_ PUNICODE_STRING String)
+{
+    PWCHAR Buffer;
+    ULONG Length, MaximumLength;
+
+    RtlInitEmptyUnicodeString(String, NULL, 0);
+
+    if (Offset == 0)
+        return STATUS_SUCCESS;
+
+    if ((Offset < sizeof(WMI_LOGGER_INFORMATION)) ||
+        (Offset >= LoggerInfo->Wnode.BufferSize) ||
+        (Offset & (sizeof(WCHAR) - 1)))
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* The string is stored inline and must be terminated inside the buffer */
+    Buffer = (PWCHAR)((PUCHAR)LoggerInfo + Offset);
+    MaximumLength = min((LoggerInfo->Wnode.BufferSize - Offset) / sizeof(WCHAR),
+                        UNICODE_STRING_MAX_CHARS);
+    for (Length = 0; Length < MaximumLength; Length++)
+    {
+        if (Buffer[Length] == UNICODE_NULL)
+        {
+            String->Buffer = Buffer;
+            String->Length = (USHORT)(Length * sizeof(WCHAR));
+            String->MaximumLength = String->Length;
+            return STATUS_SUCCESS;
+        }
+    }
+
+    return STATUS_INVALID_PARAMETER;
+}
+
+static
+ULONG
+WmipFillLoggerInformation(
+    _In_ PWMIP_LOGGER_CONTEXT Logger,
+    _Out_ PWMI_LOGGER_INFORMATION LoggerInfo,
+    _In_ ULONG Length)
+{
+    ULONG Offset;
+
+    LoggerInfo->Wnode.HistoricalContext = Logger->LoggerId;
+    LoggerInfo->Wnode.ClientContext = Logger->ClientContext;
+    LoggerInfo->Wnode.Guid = Logger->InstanceGuid;
+    LoggerInfo->BufferSize = Logger->BufferSize / 1024;
+    LoggerInfo->MinimumBuffers = Logger->MinimumBuffers;
+    LoggerInfo->MaximumBuffers = Logger->MaximumBuffers;
+    LoggerInfo->MaximumFileSize = Logger->MaximumFileSize;
+    LoggerInfo->LogFileMode = Logger->LogFileMode;
+    LoggerInfo->FlushTimer = Logger->FlushTimer;
+    LoggerInfo->EnableFlags = Logger->EnableFlags;
+    LoggerInfo->AgeLimit = 0;
+    LoggerInfo->NumberOfBuffers = Logger->NumberOfBuffers;
+    LoggerInfo->FreeBuffers = ExQueryDepthSList(&Logger->FreeList);
+    LoggerInfo->EventsLost = Logger->EventsLost;
+    LoggerInfo->BuffersWritten = Logger->BuffersWritten;
+    LoggerInfo->LogBuffersLost = Logger->LogBuffersLost;
+    LoggerInfo->RealTimeBuffersLost = 0;
+    LoggerInfo->LoggerThreadId = (Logger->FlushThread != NULL) ?
+                                 Logger->FlushThread->Cid.UniqueThread : NULL;
+    LoggerInfo->LoggerNameOffset = 0;
+    LoggerInfo->LogFileNameOffset = 0;
+
+    /* Return the names as well if they fit */
+    Offset = sizeof(WMI_LOGGER_INFORMATION);
+    if (Offset + Logger->LoggerName.Length + sizeof(WCHAR) +
+        Logger->LogFileName.Length + sizeof(WCHAR) <= Length)
+    {
+        LoggerInfo->LoggerNameOffset = Offset;
+        RtlCopyMemory((PUCHAR)LoggerInfo + Offset,
+                      Logger->LoggerName.Buffer,
+                      Logger->LoggerName.Length);
+        Offset += Logger->LoggerName.Length;
+        *(PWCHAR)((PUCHAR)LoggerInfo + Offset) = UNICODE_NULL;
+        Offset += sizeof(WCHAR);
+
+        LoggerInfo->LogFileNameOffset = Offset;
+        RtlCopyMemory((PUCHAR)LoggerInfo + Offset,
+                      Logger->LogFileName.Buffer,
+                      Logger->LogFileName.Length);
+        Offset += Logger->LogFileName.Length;
+        *(PWCHAR)((PUCHAR)LoggerInfo + Offset) = UNICODE_NULL;
+        Offset += sizeof(WCHAR);
+    }
+
+    LoggerInfo->Wnode.BufferSize = Offset;
+    return Offset;
+}
+
+static
+BOOLEAN
+WmipIsKernelLogger(
+    _In_ PWMI_LOGGER_INFORMATION LoggerInfo,
+    _In_ PCUNICODE_STRING LoggerName)
+{
+    UNICODE_STRING KernelLoggerName = RTL_CONSTANT_STRING(KERNEL_LOGGER_NAMEW);
+
+    return IsEqualGUID(&LoggerInfo->Wnode.Guid, &SystemTraceControlGuid) ||
+           RtlEqualUnicodeString(LoggerName, &KernelLoggerName, TRUE);
+}
+
+static
+PWMIP_LOGGER_CONTEXT
+WmipFindLogger(
+    _In_ PWMI_LOGGER_INFORMATION LoggerInfo)
+{
+    UNICODE_STRING LoggerName;
+    ULONG LoggerId, i;
+
+    ASSERT(KeAreAllApcsDisabled());
+
+    /* Prefer the handle, fall back to the name */
+    LoggerId = (ULONG)LoggerInfo->Wnode.HistoricalContext;
+    if ((LoggerId != 0) && (LoggerId < WMI_MAXIMUM_LOGGERS))
+    {
+        return WmipLoggerContext[LoggerId];
+    }
+
+    if (!NT_SUCCESS(WmipGetLoggerString(LoggerInfo, LoggerInfo->LoggerNameOffset, &LoggerName)))
+        return NULL;
+
+    if (WmipIsKernelLogger(LoggerInfo, &LoggerName))
+        return WmipKernelLogger;
+
+    if (LoggerName.Length == 0)
+        return NULL;
+
+    for (i = 1; i < WMI_MAXIMUM_LOGGERS; i++)
+    {
+        if ((WmipLoggerContext[i] != NULL) &&
+            RtlEqualUnicodeString(&WmipLoggerContext[i]->LoggerName, &LoggerName, TRUE))
+        {
+            return WmipLoggerContext[i];
+        }
+    }
+
+    return NULL;
+}
+
+static
+VOID
+WmipNotifyProviders(
+    _In_ LPCGUID ControlGuid)
+{
+    PLIST_ENTRY ListEntry;
+    PWMIP_TRACE_PROVIDER Provider;
+
+    for (ListEntry = WmipTraceProviderList.Flink;
+         ListEntry != &WmipTraceProviderList;
+         ListEntry = ListEntry->Flink)
+    {
+        Provider = CONTAINING_RECORD(ListEntry, WMIP_TRACE_PROVIDER, ListEntry);
+        if (IsEqualGUID(&Provider->ControlGuid, ControlGuid))
+        {
+            KeSetEvent(Provider->Event, IO_NO_INCREMENT, FALSE);
+        }
+    }
+}
+
+static
+PWMIP_TRACE_ENABLE
+WmipFindTraceEnable(
+    _In_ LPCGUID ControlGuid)
+{
+    PLIST_ENTRY ListEntry;
+    PWMIP_TRACE_ENABLE TraceEnable;
+
+    for (ListEntry = WmipTraceEnableList.Flink;
+         ListEntry != &WmipTraceEnableList;
+         ListEntry = ListEntry->Flink)
+    {
+        TraceEnable = CONTAINING_RECORD(ListEntry, WMIP_TRACE_ENABLE, ListEntry);
+        if (IsEqualGUID(&TraceEnable->ControlGuid, ControlGuid))
+        {
+            return TraceEnable;
+        }
+    }
+
+    return NULL;
+}
+
+static
+VOID
+WmipDisableLoggerProviders(
+    _In_ ULONG LoggerId)
+{
+    PLIST_ENTRY ListEntry;
+    PWMIP_TRACE_ENABLE TraceEnable;
+
+    ListEntry = WmipTraceEnableList.Flink;
+    while (ListEntry != &WmipTraceEnableList)
+    {
+        TraceEnable = CONTAINING_RECORD(ListEntry, WMIP_TRACE_ENABLE, ListEntry);
+        ListEntry = ListEntry->Flink;
+
+        if (TraceEnable->Context.LoggerId == LoggerId)
+        {
+            RemoveEntryList(&TraceEnable->ListEntry);
+            WmipNotifyProviders(&TraceEnable->ControlGuid);
+            ExFreePoolWithTag(TraceEnable, TAG_WMI_PROVIDER);
+        }
+    }
+}
+
+/* Sampled profiling runs the profile interrupt on every processor */
+static
+VOID
+WmipUpdateKernelProfile(
+    _In_ ULONG OldFlags,
+    _In_ ULONG NewFlags)
+{
+    if ((NewFlags & EVENT_TRACE_FLAG_PROFILE) && !(OldFlags & EVENT_TRACE_FLAG_PROFILE))
+    {
+        KeStartSampledProfile();
+    }
+    else if (!(NewFlags & EVENT_TRACE_FLAG_PROFILE) && (OldFlags & EVENT_TRACE_FLAG_PROFILE))
+    {
+        KeStopSampledProfile();
+    }
+}
+
+static
+VOID
+WmipWaitForWriters(
+    VOID)
+{
+    ULONG i;
+
+    /*
+     * Writers only look at the logger at DISPATCH_LEVEL, so once we ran on
+     * every processor nobody can still be using the logger we unpublished.
+     */
+    for (i = 0; i < (ULONG)KeNumberProcessors; i++)
+    {
+        KeSetSystemAffinityThread(AFFINITY_MASK(i));
+    }
+    KeRevertToUserAffinityThread();
+}
+
+static
+VOID
+WmipDeleteLogger(
+    _In_ PWMIP_LOGGER_CONTEXT Logger)
+{
+    WmipFreeBuffers(Logger);
+
+    if (Logger->FileHandle != NULL)
+        ZwClose(Logger->FileHandle);
+
+    if (Logger->LoggerName.Buffer != NULL)
+        ExFreePoolWithTag(Logger->LoggerName.Buffer, TAG_WMI_LOGGER);
+
+    if (Logger->LogFileName.Buffer != NULL)
+        ExFreePoolWithTag(Logger->LogFileName.Buffer, TAG_WMI_LOGGER);
+
+    ExFreePoolWithTag(Logger, TAG_WMI_LOGGER);
+}
+
+static
+NTSTATUS
+WmipDuplicateString(
+    _In_ PCUNICODE_STRING Source,
+    _Out_ PUNICODE_STRING Destination)
+{
+    RtlInitEmptyUnicodeString(Destination, NULL, 0);
+    if (Source->Length == 0)
+        return STATUS_SUCCESS;
+
+    Destination->Buffer = ExAllocatePoolWithTag(PagedPool, Source->Length, TAG_WMI_LOGGER);
+    if (Destination->Buffer == NULL)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    Destination->MaximumLength = Source->Length;
+    RtlCopyUnicodeString(Destination, Source);
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+WmipCreateLogFile(
+    _In_ PWMIP_LOGGER_CONTEXT Logger,
+    _In_ KPROCESSOR_MODE PreviousMode)
+{
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatusBlock;
+
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &Logger->LogFileName,
+                               OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE,
+                               NULL,
+                               NULL);
+
+    /* The file is written from the logger thread, but opened on the caller's behalf */
+    return IoCreateFile(&Logger->FileHandle,
+                        FILE_GENERIC_WRITE,
+                        &ObjectAttributes,
+                        &IoStatusBlock,
+                        NULL,
+                        FILE_ATTRIBUTE_NORMAL,
+                        FILE_SHARE_READ,
+                        FILE_OVERWRITE_IF,
+                        FILE_SYNCHRONOUS_IO_NONALERT | FILE_NON_DIRECTORY_FILE,
+                        NULL,
+                        0,
+                        CreateFileTypeNone,
+                        NULL,
+                        (PreviousMode != KernelMode) ? IO_FORCE_ACCESS_CHECK : 0);
+}
+
+static
+NTSTATUS
+WmipStartLogger(
+    _Inout_ PWMI_LOGGER_INFORMATION LoggerInfo,
+    _In_ KPROCESSOR_MODE PreviousMode)
+{
+    UNICODE_STRING LoggerName, LogFileName;
+    PWMIP_LOGGER_CONTEXT Logger;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    HANDLE ThreadHandle;
+    BOOLEAN KernelLogger;
+    ULONG LoggerId, i;
+    NTSTATUS Status;
+    PAGED_CODE();
+
+    /* Capture the names */
+    Status = WmipGetLoggerString(LoggerInfo, LoggerInfo->LoggerNameOffset, &LoggerName);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    Status = WmipGetLoggerString(LoggerInfo, LoggerInfo->LogFileNameOffset, &LogFileName);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    KernelLogger = WmipIsKernelLogger(LoggerInfo, &LoggerName);
+    if ((LoggerName.Length == 0) && !KernelLogger)
+        return STATUS_INVALID_PARAMETER;
+
+    /* Only file sessions are supported */
+    if ((LogFileName.Length == 0) ||
+        (LoggerInfo->LogFileMode & ~(EVENT_TRACE_FILE_MODE_SEQUENTIAL |
+                                     EVENT_TRACE_FILE_MODE_CIRCULAR)))
+    {
+        DPRINT1("Unsupported log file mode 0x%lx\n", LoggerInfo->LogFileMode);
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    if (((LoggerInfo->LogFileMode & EVENT_TRACE_FILE_MODE_SEQUENTIAL) &&
+         (LoggerInfo->LogFileMode & EVENT_TRACE_FILE_MODE_CIRCULAR)) ||
+        ((LoggerInfo->LogFileMode & EVENT_TRACE_FILE_MODE_CIRCULAR) &&
+         (LoggerInfo->MaximumFileSize == 0)))
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* Allocate the logger with room for a buffer pointer per processor */
+    Logger = ExAllocatePoolWithTag(NonPagedPool,
+                                   FIELD_OFFSET(WMIP_LOGGER_CONTEXT,
+                                                ProcessorBuffers[KeNumberProcessors]),
+                                   TAG_WMI_LOGGER);
+    if (Logger == NULL)
+        return STATUS_INSUFFICIENT_RESOURCES;
+
+    RtlZeroMemory(Logger, FIELD_OFFSET(WMIP_LOGGER_CONTEXT, ProcessorBuffers[KeNumberProcessors]));
+    Logger->KernelLogger = KernelLogger;
+    InitializeSListHead(&Logger->FreeList);
+    InitializeSListHead(&Logger->FlushList);
+    KeInitializeDpc(&Logger->FlushDpc, WmipFlushDpcRoutine, Logger);
+    KeInitializeEvent(&Logger->FlushEvent, SynchronizationEvent, FALSE);
+    KeInitializeEvent(&Logger->FlushCompleteEvent, SynchronizationEvent, FALSE);
+
+    if (KernelLogger)
+    {
+        RtlInitUnicodeString(&LoggerName, KERNEL_LOGGER_NAMEW);
+        Logger->InstanceGuid = SystemTraceControlGuid;
+    }
+    else
+    {
+        Logger->InstanceGuid = LoggerInfo->Wnode.Guid;
+    }
+
+    Status = WmipDuplicateString(&LoggerName, &Logger->LoggerName);
+    if (NT_SUCCESS(Status))
+        Status = WmipDuplicateString(&LogFileName, &Logger->LogFileName);
+    if (!NT_SUCCESS(Status))
+    {
+        WmipDeleteLogger(Logger);
+        return Status;
+    }
+
+    /* Apply the settings, with sane defaults and limits */
+    Logger->BufferSize = (LoggerInfo->BufferSize != 0) ? LoggerInfo->BufferSize : 64;
+    Logger->BufferSize = min(max(Logger->BufferSize, 4), 1024) * 1024;
+    Logger->MinimumBuffers = max(LoggerInfo->MinimumBuffers, (ULONG)KeNumberProcessors * 2);
+    Logger->MaximumBuffers = (LoggerInfo->MaximumBuffers != 0) ?
+                             LoggerInfo->MaximumBuffers : Logger->MinimumBuffers + 20;
+    Logger->MaximumBuffers = max(Logger->MaximumBuffers, Logger->MinimumBuffers);
+    Logger->MaximumFileSize = LoggerInfo->MaximumFileSize;
+    Logger->LogFileMode = LoggerInfo->LogFileMode;
+    Logger->FlushTimer = LoggerInfo->FlushTimer;
+    Logger->EnableFlags = KernelLogger ? LoggerInfo->EnableFlags : 0;
+    Logger->SequenceNumber = 1;
+
+    if ((Logger->LogFileMode & EVENT_TRACE_FILE_MODE_CIRCULAR) &&
+        ((ULONG64)Logger->MaximumFileSize * 1024 * 1024 < 2 * Logger->BufferSize))
+    {
+        WmipDeleteLogger(Logger);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* Pick the clock, Wnode.ClientContext uses the EVENT_TRACE_PROPERTIES values */
+    switch (LoggerInfo->Wnode.ClientContext)
+    {
+        case 2:
+            Logger->ClientContext = 2;
+            Logger->ClockType = WMICT_SYSTEMTIME;
+            Logger->ClockFrequency.QuadPart = 10000000;
+            break;
+
+#if defined(_M_IX86) || defined(_M_AMD64)
+        case 3:
+            Logger->ClientContext = 3;
+            Logger->ClockType = WMICT_CPUCYCLE;
+            Logger->ClockFrequency.QuadPart = (LONGLONG)KeGetCurrentPrcb()->MHz * 1000000;
+            break;
+#endif
+
+        default:
+            Logger->ClientContext = 1;
+            Logger->ClockType = WMICT_PERFCOUNTER;
+            KeQueryPerformanceCounter(&Logger->ClockFrequency);
+            break;
+    }
+
+    for (i = 0; i < Logger->MinimumBuffers; i++)
+    {
+        PWMIP_BUFFER Buffer = WmipAllocateBuffer(Logger);
+        if (Buffer == NULL)
+        {
+            WmipDeleteLogger(Logger);
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        InterlockedPushEntrySList(&Logger->FreeList, &Buffer->ListEntry);
+    }
+
+    Status = WmipCreateLogFile(Logger, PreviousMode);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Failed to create log file %wZ: 0x%lx\n", &Logger->LogFileName, Status);
+        WmipDeleteLogger(Logger);
+        return Status;
+    }
+
+    KeAcquireGuardedMutex(&WmipTraceMutex);
+
+    /* Names are unique, and there is only one kernel logger */
+    LoggerInfo->Wnode.HistoricalContext = 0;
+    if ((KernelLogger && (WmipKernelLogger != NULL)) ||
+        (!KernelLogger && (WmipFindLogger(LoggerInfo) != NULL)))
+    {
+        KeReleaseGuardedMutex(&WmipTraceMutex);
+        WmipDeleteLogger(Logger);
+        return STATUS_OBJECT_NAME_COLLISION;
+    }
+
+    for (LoggerId = 1; LoggerId < WMI_MAXIMUM_LOGGERS; LoggerId++)
+    {
+        if (WmipLoggerContext[LoggerId] == NULL)
+            break;
+    }
+
+    if (LoggerId == WMI_MAXIMUM_LOGGERS)
+    {
+        KeReleaseGuardedMutex(&WmipTraceMutex);
+        WmipDeleteLogger(Logger);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    Logger->LoggerId = LoggerId;
+    KeQuerySystemTime(&Logger->StartTime);
+    Logger->StartTimeStamp.QuadPart = WmipGetTimeStamp(Logger);
+    Logger->FileOffset.QuadPart = Logger->BufferSize;
+
+    /* Start the flush thread */
+    InitializeObjectAttributes(&ObjectAttributes, NULL, OBJ_KERNEL_HANDLE, NULL, NULL);
+    Status = PsCreateSystemThread(&ThreadHandle,
+                                  THREAD_ALL_ACCESS,
+                                  &ObjectAttributes,
+                                  NULL,
+                                  NULL,
+                                  WmipLoggerThread,
+                                  Logger);
+    if (!NT_SUCCESS(Status))
+    {
+        KeReleaseGuardedMutex(&WmipTraceMutex);
+        WmipDeleteLogger(Logger);
+        return Status;
+    }
+
+    ObReferenceObjectByHandle(ThreadHandle,
+                              SYNCHRONIZE,
+                              PsThreadType,
+                              KernelMode,
+                              (PVOID*)&Logger->FlushThread,
+                              NULL);
+    ZwClose(ThreadHandle);
+
+    /* Publish it, writers can use it from now on */
+    WmipLoggerContext[LoggerId] = Logger;
+    if (KernelLogger)
+    {
+        WmipKernelLogger = Logger;
+        WmipKernelLoggerEnableFlags = Logger->EnableFlags;
+        WmipUpdateKernelProfile(0, Logger->EnableFlags);
+    }
+
+    WmipFillLoggerInformation(Logger, LoggerInfo, LoggerInfo->Wnode.BufferSize);
+    KeReleaseGuardedMutex(&WmipTraceMutex);
+
+    DPRINT("Started logger %lu %wZ\n", LoggerId, &Logger->LoggerName);
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+WmipStopLogger(
+    _Inout_ PWMI_LOGGER_INFORMATION LoggerInfo)
+{
+    PWMIP_LOGGER_CONTEXT Logger;
+    PAGED_CODE();
+
+    KeAcquireGuardedMutex(&WmipTraceMutex);
+
+    Logger = WmipFindLogger(LoggerInfo);
+    if (Logger == NULL)
+    {
+        KeReleaseGuardedMutex(&WmipTraceMutex);
+        return STATUS_WMI_INSTANCE_NOT_FOUND;
+    }
+
+    /* Unpublish the logger and tell its providers */
+    WmipLoggerContext[Logger->LoggerId] = NULL;
+    if (Logger->KernelLogger)
+    {
+        WmipUpdateKernelProfile(Logger->EnableFlags, 0);
+        WmipKernelLoggerEnableFlags = 0;
+        WmipKernelLogger = NULL;
+    }
+    WmipDisableLoggerProviders(Logger->LoggerId);
+
+    /* Let the flush thread write out everything and exit */
+    WmipWaitForWriters();
+    Logger->Stopping = TRUE;
+    KeSetEvent(&Logger->FlushEvent, IO_NO_INCREMENT, FALSE);
+    KeWaitForSingleObject(Logger->FlushThread, Executive, KernelMode, FALSE, NULL);
+
+    /* Nothing can queue the DPC anymore */
+    KeRemoveQueueDpc(&Logger->FlushDpc);
+    KeFlushQueuedDpcs();
+
+    WmipFillLoggerInformation(Logger, LoggerInfo, LoggerInfo->Wnode.BufferSize);
+    KeReleaseGuardedMutex(&WmipTraceMutex);
+
+    DPRINT("Stopped logger %lu, %lu buffers written, %lu events lost\n",
+           Logger->LoggerId, Logger->BuffersWritten, Logger->EventsLost);
+
+    ObDereferenceObject(Logger->FlushThread);
+    WmipDeleteLogger(Logger);
+    return STATUS_SUCCESS;
+}
+
+static
+BOOLEAN
+WmipCheckTraceAccess(VOID)
+{
+    /* Sessions see every process, so controlling them takes the profiling privilege */
+    return SeSinglePrivilegeCheck(SeSystemProfilePrivilege, ExGetPreviousMode());
+}
+
+/* PUBLIC FUNCTIONS **********************************************************/
+
+LONG64
+FASTCALL
+WmiGetClock(IN WMI_CLOCK_TYPE ClockType,
+            IN PVOID Context)
+{
+    LARGE_INTEGER Time;
+    PKTHREAD Thread;
+
+    switch (ClockType)
+    {
+        case WMICT_SYSTEMTIME:
+            KeQuerySystemTime(&Time);
+            return Time.QuadPart;
+
+#if defined(_M_IX86) || defined(_M_AMD64)
+        case WMICT_CPUCYCLE:
+            return __rdtsc();
+#endif
+
+        case WMICT_PROCESS:
+        case WMICT_THREAD:
+            /* Run time of the given thread, in 100ns units */
+            Thread = (Context != NULL) ? Context : KeGetCurrentThread();
+            return (LONG64)(Thread->KernelTime + Thread->UserTime) * KeMaximumIncrement;
+
+        default:
+            return KeQueryPerformanceCounter(NULL).QuadPart;
+    }
+}
+
+NTSTATUS
+NTAPI
+WmiStartTrace(IN OUT PWMI_LOGGER_INFORMATION LoggerInfo)
+{
+    PAGED_CODE();
+
+    if (LoggerInfo->Wnode.BufferSize < sizeof(WMI_LOGGER_INFORMATION))
+        return STATUS_INVALID_BUFFER_SIZE;
+
+    if (!WmipCheckTraceAccess())
+        return STATUS_ACCESS_DENIED;
+
+    return WmipStartLogger(LoggerInfo, ExGetPreviousMode());
+}
+
+NTSTATUS
+NTAPI
+WmiStopTrace(IN PWMI_LOGGER_INFORMATION LoggerInfo)
+{
+    PAGED_CODE();
+
+    if (LoggerInfo->Wnode.BufferSize < sizeof(WMI_LOGGER_INFORMATION))
+        return STATUS_INVALID_BUFFER_SIZE;
+
+    if (!WmipCheckTraceAccess())
+        return STATUS_ACCESS_DENIED;
+
+    return WmipStopLogger(LoggerInfo);
+}
+
+NTSTATUS
+NTAPI
+WmiQueryTrace(IN OUT PWMI_LOGGER_INFORMATION LoggerInfo)
+{
+    PWMIP_LOGGER_CONTEXT Logger;
+    NTSTATUS Status = STATUS_WMI_INSTANCE_NOT_FOUND;
+    PAGED_CODE();
+
+    if (LoggerInfo->Wnode.BufferSize < sizeof(WMI_LOGGER_INFORMATION))
+        return STATUS_INVALID_BUFFER_SIZE;
+
+    KeAcquireGuardedMutex(&WmipTraceMutex);
+    Logger = WmipFindLogger(LoggerInfo);
+    if (Logger != NULL)
+    {
+        WmipFillLoggerInformation(Logger, LoggerInfo, LoggerInfo->Wnode.BufferSize);
+        Status = STATUS_SUCCESS;
+    }
+    KeReleaseGuardedMutex(&WmipTraceMutex);
+
+    return Status;
+}
+
+NTSTATUS
+NTAPI
+WmiUpdateTrace(IN OUT PWMI_LOGGER_INFORMATION LoggerInfo)
+{
+    PWMIP_LOGGER_CONTEXT Logger;
+    NTSTATUS Status = STATUS_WMI_INSTANCE_NOT_FOUND;
+    PAGED_CODE();
+
+    if (LoggerInfo->Wnode.BufferSize < sizeof(WMI_LOGGER_INFORMATION))
+        return STATUS_INVALID_BUFFER_SIZE;
+
+    if (!WmipCheckTraceAccess())
+        return STATUS_ACCESS_DENIED;
+
+    KeAcquireGuardedMutex(&WmipTraceMutex);
+    Logger = WmipFindLogger(LoggerInfo);
+    if (Logger != NULL)
+    {
+        /* Only the settings that don't need the buffers reallocated can change */
+        if (LoggerInfo->MaximumBuffers > Logger->MaximumBuffers)
+            Logger->MaximumBuffers = LoggerInfo->MaximumBuffers;
+
+        Logger->FlushTimer = LoggerInfo->FlushTimer;
+        KeSetEvent(&Logger->FlushEvent, IO_NO_INCREMENT, FALSE);
+
+        if (Logger->KernelLogger)
+        {
+            WmipUpdateKernelProfile(Logger->EnableFlags, LoggerInfo->EnableFlags);
+            Logger->EnableFlags = LoggerInfo->EnableFlags;
+            WmipKernelLoggerEnableFlags = Logger->EnableFlags;
+        }
+
+        WmipFillLoggerInformation(Logger, LoggerInfo, LoggerInfo->Wnode.BufferSize);
+        Status = STATUS_SUCCESS;
+    }
+    KeReleaseGuardedMutex(&WmipTraceMutex);
+
+    return Status;
+}
+
+NTSTATUS
+NTAPI
+WmiFlushTrace(IN OUT PWMI_LOGGER_INFORMATION LoggerInfo)
+{
+    PWMIP_LOGGER_CONTEXT Logger;
+    NTSTATUS Status = STATUS_WMI_INSTANCE_NOT_FOUND;
+    PAGED_CODE();
+
+    if (LoggerInfo->Wnode.BufferSize < sizeof(WMI_LOGGER_INFORMATION))
+        return STATUS_INVALID_BUFFER_SIZE;
+
+    if (!WmipCheckTraceAccess())
+        return STATUS_ACCESS_DENIED;
+
+    KeAcquireGuardedMutex(&WmipTraceMutex);
+    Logger = WmipFindLogger(LoggerInfo);
+    if (Logger != NULL)
+    {
+        /* The logger can't go away while we hold the mutex */
+        KeClearEvent(&Logger->FlushCompleteEvent);
+        InterlockedExchange(&Logger->FlushRequested, 1);
+        KeSetEvent(&Logger->FlushEvent, IO_NO_INCREMENT, FALSE);
+        KeWaitForSingleObject(&Logger->FlushCompleteEvent, Executive, KernelMode, FALSE, NULL);
+
+        WmipFillLoggerInformation(Logger, LoggerInfo, LoggerInfo->Wnode.BufferSize);
+        Status = STATUS_SUCCESS;
+    }
+    KeReleaseGuardedMutex(&WmipTraceMutex);
+
+    return Status;
+}
+
+VOID
+FASTCALL
+WmipTraceKernelEvent(
+    _In_ LPCGUID Guid,
+    _In_ UCHAR Type,
+    _In_reads_bytes_(Length) PVOID Data,
+    _In_ ULONG Length)
+{
+    PWMIP_LOGGER_CONTEXT Logger;
+    PEVENT_TRACE_HEADER TraceHeader;
+    PWMIP_BUFFER Buffer;
+    KIRQL OldIrql;
+
+    /* Callouts can come from any IRQL up to the dispatcher's */
+    OldIrql = KeGetCurrentIrql();
+    if (OldIrql < DISPATCH_LEVEL)
+        KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+
+    Logger = WmipKernelLogger;
+    if (Logger != NULL)
+    {
+        TraceHeader = WmipReserveEvent(Logger, sizeof(EVENT_TRACE_HEADER) + Length, &Buffer);
+        if (TraceHeader != NULL)
+        {
+            TraceHeader->Version = 0;
+            TraceHeader->Class.Type = Type;
+            TraceHeader->Class.Level = TRACE_LEVEL_NONE;
+            TraceHeader->Class.Version = 0;
+            TraceHeader->Guid = *Guid;
+            WmipFillEventHeader(TraceHeader,
+                                sizeof(EVENT_TRACE_HEADER) + Length,
+                                WmipGetTimeStamp(Logger));
+            RtlCopyMemory(TraceHeader + 1, Data, Length);
+            InterlockedDecrement(&Buffer->ReferenceCount);
+        }
+    }
+
+    if (OldIrql < DISPATCH_LEVEL)
+        KeLowerIrql(OldIrql);
+}
+
+NTSTATUS
+NTAPI
+WmipTraceEvent(
+    _In_ ULONG LoggerId,
+    _In_ PEVENT_TRACE_HEADER TraceHeader,
+    _In_ KPROCESSOR_MODE PreviousMode)
+{
+    EVENT_TRACE_HEADER LocalHeader;
+    MOF_FIELD MofFields[WMIP_MAX_MOF_FIELDS];
+    PWMIP_LOGGER_CONTEXT Logger;
+    PEVENT_TRACE_HEADER Record;
+    PWMIP_BUFFER Buffer;
+    ULONG MofCount, DataLength, i;
+    LONG64 TimeStamp;
+    PUCHAR Data;
+    KIRQL OldIrql;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    /* Capture the header, the MOF descriptors and the GUID */
+    _SEH2_TRY
+    {
+        if (PreviousMode != KernelMode)
+        {
+            ProbeForRead(TraceHeader, sizeof(EVENT_TRACE_HEADER), sizeof(ULONG));
+        }
+
+        LocalHeader = *TraceHeader;
+        if (LocalHeader.Size < sizeof(EVENT_TRACE_HEADER))
+        {
+            _SEH2_YIELD(return STATUS_INVALID_BUFFER_SIZE);
+        }
+
+        if (LocalHeader.Flags & WNODE_FLAG_USE_GUID_PTR)
+        {
+            if (PreviousMode != KernelMode)
+            {
+                ProbeForRead((PVOID)(ULONG_PTR)LocalHeader.GuidPtr, sizeof(GUID), sizeof(ULONG));
+            }
+
+            LocalHeader.Guid = *(LPGUID)(ULONG_PTR)LocalHeader.GuidPtr;
+        }
+
+        MofCount = 0;
+        DataLength = LocalHeader.Size - sizeof(EVENT_TRACE_HEADER);
+        if (LocalHeader.Flags & WNODE_FLAG_USE_MOF_PTR)
+        {
+            /* The data is described by MOF_FIELDs following the header */
+            MofCount = DataLength / sizeof(MOF_FIELD);
+            if (MofCount > WMIP_MAX_MOF_FIELDS)
+            {
+                _SEH2_YIELD(return STATUS_ARRAY_BOUNDS_EXCEEDED);
+            }
+
+            if (PreviousMode != KernelMode)
+            {
+                ProbeForRead(TraceHeader + 1, MofCount * sizeof(MOF_FIELD), sizeof(ULONG));
+            }
+
+            RtlCopyMemory(MofFields, TraceHeader + 1, MofCount * sizeof(MOF_FIELD));
+
+            DataLength = 0;
+            for (i = 0; i < MofCount; i++)
+            {
+                DataLength += MofFields[i].Length;
+                if (DataLength > MAXUSHORT)
+                {
+                    _SEH2_YIELD(return STATUS_INVALID_BUFFER_SIZE);
+                }
+            }
+        }
+        else if (PreviousMode != KernelMode)
+        {
+            ProbeForRead(TraceHeader + 1, DataLength, sizeof(UCHAR));
+        }
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+        _SEH2_YIELD(return _SEH2_GetExceptionCode());
+    }
+    _SEH2_END;
+
+    if (sizeof(EVENT_TRACE_HEADER) + DataLength > MAXUSHORT)
+        return STATUS_INVALID_BUFFER_SIZE;
+
+    /* Reserve the space, the logger can only be looked at from DISPATCH_LEVEL */
+    KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+    Logger = (LoggerId < WMI_MAXIMUM_LOGGERS) ? WmipLoggerContext[LoggerId] : NULL;
+    if (Logger == NULL)
+    {
+        KeLowerIrql(OldIrql);
+        return STATUS_INVALID_HANDLE;
+    }
+
+    Record = WmipReserveEvent(Logger, sizeof(EVENT_TRACE_HEADER) + DataLength, &Buffer);
+    if (Record != NULL)
+    {
+        TimeStamp = (LocalHeader.Flags & WNODE_FLAG_USE_TIMESTAMP) ?
+                    LocalHeader.TimeStamp.QuadPart : WmipGetTimeStamp(Logger);
+    }
+    KeLowerIrql(OldIrql);
+
+    if (Record == NULL)
+        return STATUS_NO_MEMORY;
+
+    /* The buffer stays referenced while the data, which can fault, is copied */
+    *Record = LocalHeader;
+    WmipFillEventHeader(Record, sizeof(EVENT_TRACE_HEADER) + DataLength, TimeStamp);
+    Data = (PUCHAR)(Record + 1);
+
+    _SEH2_TRY
+    {
+        if (LocalHeader.Flags & WNODE_FLAG_USE_MOF_PTR)
+        {
+            for (i = 0; i < MofCount; i++)
+            {
+                if (PreviousMode != KernelMode)
+                {
+                    ProbeForRead((PVOID)(ULONG_PTR)MofFields[i].DataPtr,
+                                 MofFields[i].Length,
+                                 sizeof(UCHAR));
+                }
+
+                RtlCopyMemory(Data, (PVOID)(ULONG_PTR)MofFields[i].DataPtr, MofFields[i].Length);
+                Data += MofFields[i].Length;
+            }
+        }
+        else
+        {
+            RtlCopyMemory(Data, TraceHeader + 1, DataLength);
+        }
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+        /* Turn the record into padding */
+        RtlZeroMemory(Record, sizeof(EVENT_TRACE_HEADER));
+        Record->Size = (USHORT)(sizeof(EVENT_TRACE_HEADER) + DataLength);
+        Status = _SEH2_GetExceptionCode();
+    }
+    _SEH2_END;
+
+    InterlockedDecrement(&Buffer->ReferenceCount);
+    return Status;
+}
+
+NTSTATUS
+FASTCALL
+WmiTraceFastEvent(IN PWNODE_HEADER Wnode)
+{
+    return WmipTraceEvent((ULONG)(USHORT)Wnode->HistoricalContext,
+                          (PEVENT_TRACE_HEADER)Wnode,
+                          KernelMode);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+NtTraceEvent(IN ULONG TraceHandle,
+             IN ULONG Flags,
+             IN ULONG TraceHeaderLength,
+             IN struct _EVENT_TRACE_HEADER* TraceHeader)
+{
+    PAGED_CODE();
+
+    if (TraceHeaderLength < sizeof(EVENT_TRACE_HEADER))
+        return STATUS_INVALID_BUFFER_SIZE;
+
+    return WmipTraceEvent((USHORT)TraceHandle, TraceHeader, ExGetPreviousMode());
+}
+
+/* TRACE PROVIDERS ***********************************************************/
+
+NTSTATUS
+NTAPI
+WmipEnableTrace(
+    _In_ PWMI_ENABLE_TRACE EnableTrace)
+{
+    PWMIP_TRACE_ENABLE TraceEnable;
+    ULONG LoggerId;
+    NTSTATUS Status = STATUS_SUCCESS;
+    PAGED_CODE();
+
+    LoggerId = (USHORT)EnableTrace->LoggerHandle;
+
+    KeAcquireGuardedMutex(&WmipTraceMutex);
+
+    TraceEnable = WmipFindTraceEnable(&EnableTrace->ControlGuid);
+    if (EnableTrace->Enable)
+    {
+        if ((LoggerId == 0) || (LoggerId >= WMI_MAXIMUM_LOGGERS) ||
+            (WmipLoggerContext[LoggerId] == NULL))
+        {
+            Status = STATUS_INVALID_HANDLE;
+            goto Quit;
+        }
+
+        if (TraceEnable == NULL)
+        {
+            TraceEnable = ExAllocatePoolWithTag(PagedPool, sizeof(*TraceEnable), TAG_WMI_PROVIDER);
+            if (TraceEnable == NULL)
+            {
+                Status = STATUS_INSUFFICIENT_RESOURCES;
+                goto Quit;
+            }
+
+            TraceEnable->ControlGuid = EnableTrace->ControlGuid;
+            InsertTailList(&WmipTraceEnableList, &TraceEnable->ListEntry);
+        }
+
+        /* A provider traces to a single session, the last one wins */
+        TraceEnable->Context.LoggerId = (USHORT)LoggerId;
+        TraceEnable->Context.Level = EnableTrace->EnableLevel;
+        TraceEnable->Context.InternalFlag = 0;
+        TraceEnable->Context.EnableFlags = EnableTrace->EnableFlags;
+    }
+    else
+    {
+        if ((TraceEnable == NULL) || (TraceEnable->Context.LoggerId != LoggerId))
+        {
+            Status = STATUS_WMI_GUID_NOT_FOUND;
+            goto Quit;
+        }
+
+        RemoveEntryList(&TraceEnable->ListEntry);
+        ExFreePoolWithTag(TraceEnable, TAG_WMI_PROVIDER);
+    }
+
+    WmipNotifyProviders(&EnableTrace->ControlGuid);
+
+Quit:
+    KeReleaseGuardedMutex(&WmipTraceMutex);
+    return Status;
+}
+
+NTSTATUS
+NTAPI
+WmipRegisterTraceGuid(
+    _In_ PFILE_OBJECT FileObject,
+    _In_ PWMI_REGISTER_TRACE_GUID RegisterTraceGuid,
+    _In_ KPROCESSOR_MODE PreviousMode)
+{
+    PWMIP_TRACE_PROVIDER Provider;
+    PKEVENT Event;
+    NTSTATUS Status;
+    PAGED_CODE();
+
+    /* The event is set whenever the provider's enable state changes */
+    Status = ObReferenceObjectByHandle(RegisterTraceGuid->EventHandle,
+                                       EVENT_MODIFY_STATE,
+                                       ExEventObjectType,
+                                       PreviousMode,
+                                       (PVOID*)&Event,
+                                       NULL);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    Provider = ExAllocatePoolWithTag(PagedPool, sizeof(*Provider), TAG_WMI_PROVIDER);
+    if (Provider == NULL)
+    {
+        ObDereferenceObject(Event);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    Provider->ControlGuid = RegisterTraceGuid->ControlGuid;
+    Provider->Event = Event;
+
+    KeAcquireGuardedMutex(&WmipTraceMutex);
+
+    /* One registration per handle */
+    if (FileObject->FsContext != NULL)
+    {
+        KeReleaseGuardedMutex(&WmipTraceMutex);
+        ObDereferenceObject(Event);
+        ExFreePoolWithTag(Provider, TAG_WMI_PROVIDER);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    FileObject->FsContext = Provider;
+    InsertTailList(&WmipTraceProviderList, &Provider->ListEntry);
+
+    /* Already enabled, let it pick the settings up */
+    if (WmipFindTraceEnable(&Provider->ControlGuid) != NULL)
+    {
+        KeSetEvent(Event, IO_NO_INCREMENT, FALSE);
+    }
+
+    KeReleaseGuardedMutex(&WmipTraceMutex);
+    return STATUS_SUCCESS;
+}
+
+VOID
+NTAPI
+WmipUnregisterTraceGuid(
+    _In_ PFILE_OBJECT FileObject)
+{
+    PWMIP_TRACE_PROVIDER Provider;
+    PAGED_CODE();
+
+    KeAcquireGuardedMutex(&WmipTraceMutex);
+    Provider = FileObject->FsContext;
+    if (Provider != NULL)
+    {
+        RemoveEntryList(&Provider->ListEntry);
+        FileObject->FsContext = NULL;
+    }
+    KeReleaseGuardedMutex(&WmipTraceMutex);
+
+    if (Provider != NULL)
+    {
+        ObDereferenceObject(Provider->Event);
+        ExFreePoolWithTag(Provider, TAG_WMI_PROVIDER);
+    }
+}
+
+NTSTATUS
+NTAPI
+WmipQueryTraceEnable(
+    _In_ PFILE_OBJECT FileObject,
+    _Out_ PWMI_QUERY_TRACE_ENABLE QueryTraceEnable)
+{
+    PWMIP_TRACE_PROVIDER Provider;
+    PWMIP_TRACE_ENABLE TraceEnable;
+    NTSTATUS Status = STATUS_SUCCESS;
+    PAGED_CODE();
+
+    QueryTraceEnable->EnableContext = 0;
+
+    KeAcquireGuardedMutex(&WmipTraceMutex);
+    Provider = FileObject->FsContext;
+    if (Provider == NULL)
+    {
+        Status = STATUS_INVALID_PARAMETER;
+    }
+    else
+    {
+        TraceEnable = WmipFindTraceEnable(&Provider->ControlGuid);
+        if (TraceEnable != NULL)
+        {
+            RtlCopyMemory(&QueryTraceEnable->EnableContext,
+                          &TraceEnable->Context,
+                          sizeof(TraceEnable->Context));
+        }
+    }
+    KeReleaseGuardedMutex(&WmipTraceMutex);
+
+    return Status;
+}
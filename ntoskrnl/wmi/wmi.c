@@ -16,21 +16,13 @@
 
 #include "wmip.h"
 
+/* evntrace.h already came in through the PCH, so instantiate its GUIDs here */
+DEFINE_GUID(EventTraceGuid, 0x68fdd900, 0x4a3e, 0x11d1, 0x84, 0xf4, 0x00, 0x00, 0xf8, 0x04, 0x64, 0xe3);
+DEFINE_GUID(SystemTraceControlGuid, 0x9e814aad, 0x3204, 0x11d2, 0x9a, 0x82, 0x00, 0x60, 0x08, 0xa8, 0x69, 0x39);
+
 #define NDEBUG
 #include <debug.h>
 
-typedef PVOID PWMI_LOGGER_INFORMATION; // FIXME
-
-typedef enum _WMI_CLOCK_TYPE
-{
-    WMICT_DEFAULT,
-    WMICT_SYSTEMTIME,
-    WMICT_PERFCOUNTER,
-    WMICT_PROCESS,
-    WMICT_THREAD,
-    WMICT_CPUCYCLE
-} WMI_CLOCK_TYPE;
-
 /* FUNCTIONS *****************************************************************/
 
 BOOLEAN
@@ -41,6 +33,9 @@ WmiInitialize(
     UNICODE_STRING DriverName = RTL_CONSTANT_STRING(L"\\Driver\\WMIxWDM");
     NTSTATUS Status;
 
+    /* Initialize event tracing */
+    WmipInitializeTraceLog();
+
     /* Initialize the GUID object type */
     Status = WmipInitializeGuidObjectType();
     if (!NT_SUCCESS(Status))
@@ -361,75 +356,4 @@ WmiTraceMessageVa(IN TRACEHANDLE LoggerHandle,
     return STATUS_NOT_IMPLEMENTED;
 }
 
-NTSTATUS
-NTAPI
-WmiFlushTrace(IN OUT PWMI_LOGGER_INFORMATION LoggerInfo)
-{
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
-}
-
-LONG64
-FASTCALL
-WmiGetClock(IN WMI_CLOCK_TYPE ClockType,
-            IN PVOID Context)
-{
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
-}
-
-NTSTATUS
-NTAPI
-WmiQueryTrace(IN OUT PWMI_LOGGER_INFORMATION LoggerInfo)
-{
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
-}
-
-NTSTATUS
-NTAPI
-WmiStartTrace(IN OUT PWMI_LOGGER_INFORMATION LoggerInfo)
-{
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
-}
-    
-NTSTATUS
-NTAPI
-WmiStopTrace(IN PWMI_LOGGER_INFORMATION LoggerInfo)
-{
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
-}
-
-NTSTATUS
-FASTCALL
-WmiTraceFastEvent(IN PWNODE_HEADER Wnode)
-{
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
-}
-
-NTSTATUS
-NTAPI
-WmiUpdateTrace(IN OUT PWMI_LOGGER_INFORMATION LoggerInfo)
-{
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
-}
-
-/*
- * @unimplemented
- */
-NTSTATUS
-NTAPI
-NtTraceEvent(IN ULONG TraceHandle,
-             IN ULONG Flags,
-             IN ULONG TraceHeaderLength,
-             IN struct _EVENT_TRACE_HEADER* TraceHeader)
-{
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
-}
-
 /*Eof*/
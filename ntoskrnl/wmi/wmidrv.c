@@ -87,9 +87,18 @@ WmipOpenCloseCleanup(
     _In_ PDEVICE_OBJECT DeviceObject,
     _Inout_ PIRP Irp)
 {
+    PIO_STACK_LOCATION IoStackLocation;
     PAGED_CODE();
 
-    /* No work to do, just return success */
+    /* Drop the trace provider registered on this handle */
+    IoStackLocation = IoGetCurrentIrpStackLocation(Irp);
+    if ((IoStackLocation->MajorFunction == IRP_MJ_CLEANUP) &&
+        (IoStackLocation->FileObject->FsContext != NULL))
+    {
+        WmipUnregisterTraceGuid(IoStackLocation->FileObject);
+    }
+
+    /* No other work to do, just return success */
     Irp->IoStatus.Status = STATUS_SUCCESS;
     Irp->IoStatus.Information = 0;
     IoCompleteRequest(Irp, IO_NO_INCREMENT);
@@ -102,8 +111,25 @@ WmiTraceEvent(
     PVOID InputBuffer,
     KPROCESSOR_MODE PreviousMode)
 {
-    UNIMPLEMENTED_DBGBREAK();
-    return STATUS_SUCCESS;
+    ULONG LoggerId;
+
+    /* The logger handle is passed in the WNODE part of the header */
+    _SEH2_TRY
+    {
+        if (PreviousMode != KernelMode)
+        {
+            ProbeForRead(InputBuffer, sizeof(WNODE_HEADER), sizeof(ULONG));
+        }
+
+        LoggerId = (USHORT)((PWNODE_HEADER)InputBuffer)->HistoricalContext;
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+        _SEH2_YIELD(return _SEH2_GetExceptionCode());
+    }
+    _SEH2_END;
+
+    return WmipTraceEvent(LoggerId, InputBuffer, PreviousMode);
 }
 
 static
@@ -443,6 +469,60 @@ WmiSetMark(
     return STATUS_SUCCESS;
 }
 
+static
+NTSTATUS
+WmipLoggerControl(
+    _In_ ULONG IoControlCode,
+    _Inout_ PWMI_LOGGER_INFORMATION LoggerInfo,
+    _In_ ULONG InputLength,
+    _Inout_ PULONG OutputLength)
+{
+    NTSTATUS Status;
+
+    if ((InputLength < sizeof(WMI_LOGGER_INFORMATION)) ||
+        (*OutputLength < sizeof(WMI_LOGGER_INFORMATION)))
+    {
+        return STATUS_INVALID_BUFFER_SIZE;
+    }
+
+    /* Input and output share the system buffer */
+    LoggerInfo->Wnode.BufferSize = max(InputLength, *OutputLength);
+
+    switch (IoControlCode)
+    {
+        case IOCTL_WMI_START_LOGGER:
+            Status = WmiStartTrace(LoggerInfo);
+            break;
+
+        case IOCTL_WMI_STOP_LOGGER:
+            Status = WmiStopTrace(LoggerInfo);
+            break;
+
+        case IOCTL_WMI_QUERY_LOGGER:
+            Status = WmiQueryTrace(LoggerInfo);
+            break;
+
+        case IOCTL_WMI_UPDATE_LOGGER:
+            Status = WmiUpdateTrace(LoggerInfo);
+            break;
+
+        case IOCTL_WMI_FLUSH_LOGGER:
+            Status = WmiFlushTrace(LoggerInfo);
+            break;
+
+        default:
+            Status = STATUS_INVALID_DEVICE_REQUEST;
+            break;
+    }
+
+    if (NT_SUCCESS(Status))
+    {
+        *OutputLength = min(LoggerInfo->Wnode.BufferSize, *OutputLength);
+    }
+
+    return Status;
+}
+
 NTSTATUS
 NTAPI
 WmipIoControl(
@@ -519,6 +599,66 @@ WmipIoControl(
             break;
         }
 
+        case IOCTL_WMI_START_LOGGER:
+        case IOCTL_WMI_STOP_LOGGER:
+        case IOCTL_WMI_QUERY_LOGGER:
+        case IOCTL_WMI_UPDATE_LOGGER:
+        case IOCTL_WMI_FLUSH_LOGGER:
+        {
+            Status = WmipLoggerControl(IoControlCode,
+                                       Buffer,
+                                       InputLength,
+                                       &OutputLength);
+            break;
+        }
+
+        case IOCTL_WMI_ENABLE_TRACE:
+        {
+            if (InputLength < sizeof(WMI_ENABLE_TRACE))
+            {
+                Status = STATUS_INVALID_BUFFER_SIZE;
+                break;
+            }
+
+            if (!SeSinglePrivilegeCheck(SeSystemProfilePrivilege, Irp->RequestorMode))
+            {
+                Status = STATUS_PRIVILEGE_NOT_HELD;
+                break;
+            }
+
+            Status = WmipEnableTrace(Buffer);
+            OutputLength = 0;
+            break;
+        }
+
+        case IOCTL_WMI_REGISTER_TRACE_GUID:
+        {
+            if (InputLength < sizeof(WMI_REGISTER_TRACE_GUID))
+            {
+                Status = STATUS_INVALID_BUFFER_SIZE;
+                break;
+            }
+
+            Status = WmipRegisterTraceGuid(IoStackLocation->FileObject,
+                                           Buffer,
+                                           Irp->RequestorMode);
+            OutputLength = 0;
+            break;
+        }
+
+        case IOCTL_WMI_QUERY_TRACE_ENABLE:
+        {
+            if (OutputLength < sizeof(WMI_QUERY_TRACE_ENABLE))
+            {
+                Status = STATUS_BUFFER_TOO_SMALL;
+                break;
+            }
+
+            Status = WmipQueryTraceEnable(IoStackLocation->FileObject, Buffer);
+            OutputLength = sizeof(WMI_QUERY_TRACE_ENABLE);
+            break;
+        }
+
         default:
             DPRINT1("Unsupported yet IOCTL: 0x%lx\n", IoControlCode);
             Status = STATUS_INVALID_DEVICE_REQUEST;
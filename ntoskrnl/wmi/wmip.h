@@ -1,10 +1,74 @@
 
 #pragma once
 
+#include <wmistr.h>
+#include <wmiioctl.h>
+
 extern POBJECT_TYPE WmipGuidObjectType;
 
 #define GUID_STRING_LENGTH 36
 
+#define TAG_WMI_LOGGER 'gLmW'
+#define TAG_WMI_BUFFER 'bLmW'
+#define TAG_WMI_PROVIDER 'pTmW'
+#define TAG_WMI_STACK_WALK 'sPmW'
+
+typedef enum _WMI_CLOCK_TYPE
+{
+    WMICT_DEFAULT,
+    WMICT_SYSTEMTIME,
+    WMICT_PERFCOUNTER,
+    WMICT_PROCESS,
+    WMICT_THREAD,
+    WMICT_CPUCYCLE
+} WMI_CLOCK_TYPE;
+
+/* The on-disk part starts at Header, offsets are relative to it */
+typedef struct _WMIP_BUFFER
+{
+    SLIST_ENTRY ListEntry;
+    volatile LONG CurrentOffset;
+    volatile LONG ReferenceCount;
+    WMI_BUFFER_HEADER Header;
+} WMIP_BUFFER, *PWMIP_BUFFER;
+
+typedef struct _WMIP_LOGGER_CONTEXT
+{
+    ULONG LoggerId;
+    BOOLEAN KernelLogger;
+    volatile BOOLEAN Stopping;
+    UNICODE_STRING LoggerName;
+    UNICODE_STRING LogFileName;
+    GUID InstanceGuid;
+    ULONG ClientContext;
+    WMI_CLOCK_TYPE ClockType;
+    LARGE_INTEGER ClockFrequency;
+    LARGE_INTEGER StartTime;
+    LARGE_INTEGER StartTimeStamp;
+    ULONG BufferSize;
+    ULONG MinimumBuffers;
+    ULONG MaximumBuffers;
+    ULONG MaximumFileSize;
+    ULONG LogFileMode;
+    ULONG FlushTimer;
+    ULONG EnableFlags;
+    volatile LONG NumberOfBuffers;
+    volatile LONG EventsLost;
+    ULONG BuffersWritten;
+    ULONG LogBuffersLost;
+    ULONG SequenceNumber;
+    SLIST_HEADER FreeList;
+    SLIST_HEADER FlushList;
+    KDPC FlushDpc;
+    KEVENT FlushEvent;
+    KEVENT FlushCompleteEvent;
+    volatile LONG FlushRequested;
+    PETHREAD FlushThread;
+    HANDLE FileHandle;
+    LARGE_INTEGER FileOffset;
+    PWMIP_BUFFER volatile ProcessorBuffers[ANYSIZE_ARRAY];
+} WMIP_LOGGER_CONTEXT, *PWMIP_LOGGER_CONTEXT;
+
 typedef struct _WMIP_IRP_CONTEXT
 {
     LIST_ENTRY GuidObjectListHead;
@@ -55,3 +119,81 @@ WmipQueryRawSMBiosTables(
     _Inout_ ULONG *InOutBufferSize,
     _Out_opt_ PVOID OutBuffer);
 
+LONG64
+FASTCALL
+WmiGetClock(
+    _In_ WMI_CLOCK_TYPE ClockType,
+    _In_opt_ PVOID Context);
+
+NTSTATUS
+NTAPI
+WmiStartTrace(
+    _Inout_ PWMI_LOGGER_INFORMATION LoggerInfo);
+
+NTSTATUS
+NTAPI
+WmiStopTrace(
+    _In_ PWMI_LOGGER_INFORMATION LoggerInfo);
+
+NTSTATUS
+NTAPI
+WmiQueryTrace(
+    _Inout_ PWMI_LOGGER_INFORMATION LoggerInfo);
+
+NTSTATUS
+NTAPI
+WmiUpdateTrace(
+    _Inout_ PWMI_LOGGER_INFORMATION LoggerInfo);
+
+NTSTATUS
+NTAPI
+WmiFlushTrace(
+    _Inout_ PWMI_LOGGER_INFORMATION LoggerInfo);
+
+VOID
+NTAPI
+WmipInitializeTraceLog(
+    VOID);
+
+VOID
+NTAPI
+WmipInitializeProfileSampling(
+    VOID);
+
+NTSTATUS
+NTAPI
+WmipTraceEvent(
+    _In_ ULONG LoggerId,
+    _In_ PEVENT_TRACE_HEADER TraceHeader,
+    _In_ KPROCESSOR_MODE PreviousMode);
+
+VOID
+FASTCALL
+WmipTraceKernelEvent(
+    _In_ LPCGUID Guid,
+    _In_ UCHAR Type,
+    _In_reads_bytes_(Length) PVOID Data,
+    _In_ ULONG Length);
+
+NTSTATUS
+NTAPI
+WmipEnableTrace(
+    _In_ PWMI_ENABLE_TRACE EnableTrace);
+
+NTSTATUS
+NTAPI
+WmipRegisterTraceGuid(
+    _In_ PFILE_OBJECT FileObject,
+    _In_ PWMI_REGISTER_TRACE_GUID RegisterTraceGuid,
+    _In_ KPROCESSOR_MODE PreviousMode);
+
+VOID
+NTAPI
+WmipUnregisterTraceGuid(
+    _In_ PFILE_OBJECT FileObject);
+
+NTSTATUS
+NTAPI
+WmipQueryTraceEnable(
+    _In_ PFILE_OBJECT FileObject,
+    _Out_ PWMI_QUERY_TRACE_ENABLE QueryTraceEnable);
@@ -91,6 +91,10 @@ DEFINE_GUID(UdpIpGuid,
 DEFINE_GUID(ImageLoadGuid,
     0x2cb15d1d, 0x5fc1, 0x11d2, 0xab, 0xe1, 0x00, 0xa0, 0xc9, 0x11, 0xf5, 0x18);
 
+/* ce1dbfb4-137e-4da6-87b0-3f59aa102cbc */
+DEFINE_GUID(PerfInfoGuid,
+    0xce1dbfb4, 0x137e, 0x4da6, 0x87, 0xb0, 0x3f, 0x59, 0xaa, 0x10, 0x2c, 0xbc);
+
 /* AE53722E-C863-11d2-8659-00C04FA321A1 */
 DEFINE_GUID(RegistryGuid,
     0xae53722e, 0xc863, 0x11d2, 0x86, 0x59, 0x0, 0xc0, 0x4f, 0xa3, 0x21, 0xa1);
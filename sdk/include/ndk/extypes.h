@@ -1398,7 +1398,64 @@ typedef struct _SYSTEM_NUMA_INFORMATION
     };
 } SYSTEM_NUMA_INFORMATION, *PSYSTEM_NUMA_INFORMATION;
 
-// FIXME: Class 56-63
+// Class 56
+#define PREFETCHER_INFORMATION_VERSION          23
+#define PREFETCHER_INFORMATION_MAGIC            'kuhC'
+
+typedef enum _PREFETCHER_INFORMATION_CLASS
+{
+    PrefetcherRetrieveTrace = 1,
+    PrefetcherSystemParameters,
+    PrefetcherBootPhase,
+    PrefetcherRetrieveBootLoaderTrace,
+    PrefetcherBootControl
+} PREFETCHER_INFORMATION_CLASS;
+
+typedef struct _PREFETCHER_INFORMATION
+{
+    ULONG Version;
+    ULONG Magic;
+    PREFETCHER_INFORMATION_CLASS PrefetcherInformationClass;
+    PVOID PrefetcherInformation;
+    ULONG PrefetcherInformationLength;
+} PREFETCHER_INFORMATION, *PPREFETCHER_INFORMATION;
+
+typedef enum _PF_BOOT_PHASE_ID
+{
+    PfKernelInitPhase = 0,
+    PfBootDriverInitPhase = 90,
+    PfSystemDriverInitPhase = 120,
+    PfSessionManagerInitPhase = 150,
+    PfSMRegistryInitPhase = 180,
+    PfVideoInitPhase = 210,
+    PfPostVideoInitPhase = 240,
+    PfBootAcceptedRegistryInitPhase = 270,
+    PfUserShellReadyPhase = 300,
+    PfMaxBootPhaseId = 900
+} PF_BOOT_PHASE_ID;
+
+//
+// Prefetcher Enable Flags
+//
+#define PF_ENABLE_APPLICATION_LAUNCH            0x1
+#define PF_ENABLE_BOOT                          0x2
+
+//
+// ReactOS-specific: the enable flags followed by the prefetcher counters.
+// Only EnableStatus is taken into account when setting.
+//
+typedef struct _PF_SYSTEM_PREFETCH_PARAMETERS
+{
+    ULONG EnableStatus;
+    ULONG ActiveTraces;
+    ULONG TracesCompleted;
+    ULONG TracesSaved;
+    ULONG ScenariosPrefetched;
+    ULONG FilesPrefetched;
+    ULONGLONG BytesPrefetched;
+} PF_SYSTEM_PREFETCH_PARAMETERS, *PPF_SYSTEM_PREFETCH_PARAMETERS;
+
+// FIXME: Class 57-63
 
 // Class 64
 typedef struct _SYSTEM_HANDLE_TABLE_ENTRY_INFO_EX
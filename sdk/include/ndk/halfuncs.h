@@ -51,6 +51,9 @@ Author:
 #define HalVectorToIDTEntry             HALPRIVATEDISPATCH->HalVectorToIDTEntry
 #define KdMapPhysicalMemory64           HALPRIVATEDISPATCH->KdMapPhysicalMemory64
 #define KdUnmapVirtualAddress           HALPRIVATEDISPATCH->KdUnmapVirtualAddress
+#ifdef __REACTOS__
+#define HalSetIdleClockInterval         HALPRIVATEDISPATCH->HalSetIdleClockInterval
+#endif
 
 //
 // Display Functions
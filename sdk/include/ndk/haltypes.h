@@ -152,6 +152,16 @@ BOOLEAN
     _Out_ PPHYSICAL_ADDRESS TranslatedAddress
 );
 
+//
+// Stretches the clock period of an idle processor, or with an interval of
+// zero, ends it and returns the time that went by (ReactOS extension)
+//
+typedef
+ULONG
+(NTAPI *pHalSetIdleClockInterval)(
+    _In_ ULONG Interval
+);
+
 //
 // Hal Private dispatch Table
 //
@@ -184,6 +194,9 @@ typedef struct _HAL_PRIVATE_DISPATCH
     PVOID HalGetInterruptVectorOverride;
     PVOID HalGetVectorInputOverride;
 #endif
+#ifdef __REACTOS__
+    pHalSetIdleClockInterval HalSetIdleClockInterval;
+#endif
 } HAL_PRIVATE_DISPATCH, *PHAL_PRIVATE_DISPATCH;
 
 //
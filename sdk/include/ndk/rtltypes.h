@@ -1151,6 +1151,16 @@ typedef struct _RTL_PROCESS_LOCKS
     RTL_PROCESS_LOCK_INFORMATION Locks[1];
 } RTL_PROCESS_LOCKS, *PRTL_PROCESS_LOCKS;
 
+//
+// ReactOS extension: SystemLocksInformation follows the lock array with the
+// time spent waiting on each lock, as ULONGLONGs in 100ns units, starting at
+// this offset from the beginning of the buffer
+//
+#define RTL_PROCESS_LOCKS_WAIT_TIMES_OFFSET(NumberOfLocks)                  \
+    ((ULONG)((FIELD_OFFSET(RTL_PROCESS_LOCKS, Locks) +                      \
+              (NumberOfLocks) * sizeof(RTL_PROCESS_LOCK_INFORMATION) +      \
+              sizeof(ULONGLONG) - 1) & ~(sizeof(ULONGLONG) - 1)))
+
 typedef struct _RTL_PROCESS_BACKTRACE_INFORMATION
 {
     PVOID SymbolicBackTrace;
@@ -149,6 +149,22 @@ typedef struct _AFD_TDI_HANDLE_DATA
     HANDLE TdiConnectionHandle;
 } AFD_TDI_HANDLE_DATA, *PAFD_TDI_HANDLE_DATA;
 
+/* ReactOS extension: persistent, edge-triggered poll registrations */
+typedef struct _AFD_POLL_REGISTER_INFO {
+    SOCKET				Handle;
+    ULONG				Events; /* 0 removes the registration */
+    PVOID				Context;
+} AFD_POLL_REGISTER_INFO, *PAFD_POLL_REGISTER_INFO;
+
+typedef struct _AFD_POLL_WAIT_INFO {
+    ULONG				Flags; /* AFD_IMMEDIATE does not wait */
+} AFD_POLL_WAIT_INFO, *PAFD_POLL_WAIT_INFO;
+
+typedef struct _AFD_POLL_EVENT {
+    PVOID				Context;
+    ULONG				Events;
+} AFD_POLL_EVENT, *PAFD_POLL_EVENT;
+
 /* AFD Packet Endpoint Flags */
 #define AFD_ENDPOINT_CONNECTIONLESS	0x1
 #define AFD_ENDPOINT_MESSAGE_ORIENTED	0x10
@@ -261,6 +277,8 @@ typedef struct _AFD_TDI_HANDLE_DATA
 #define AFD_DEFER_ACCEPT		35
 #define AFD_GET_PENDING_CONNECT_DATA	41
 #define AFD_VALIDATE_GROUP		42
+#define AFD_REGISTER_POLL		70 /* ReactOS specific */
+#define AFD_WAIT_POLL			71 /* ReactOS specific */
 
 /* AFD IOCTLs */
 
@@ -336,6 +354,10 @@ typedef struct _AFD_TDI_HANDLE_DATA
   _AFD_CONTROL_CODE(AFD_ENUM_NETWORK_EVENTS, METHOD_NEITHER)
 #define IOCTL_AFD_VALIDATE_GROUP \
   _AFD_CONTROL_CODE(AFD_VALIDATE_GROUP, METHOD_NEITHER)
+#define IOCTL_AFD_REGISTER_POLL \
+  _AFD_CONTROL_CODE(AFD_REGISTER_POLL, METHOD_BUFFERED)
+#define IOCTL_AFD_WAIT_POLL \
+  _AFD_CONTROL_CODE(AFD_WAIT_POLL, METHOD_BUFFERED)
 
 typedef struct _AFD_SOCKET_INFORMATION {
     BOOL CommandChannel;
@@ -116,6 +116,19 @@
 C_ASSERT((FAST486_CACHE_SIZE >= sizeof(ULONG))
          && (FAST486_CACHE_SIZE <= FAST486_PAGE_SIZE));
 
+/*
+ * The decoded instruction cache only covers the first 2 MB of the address
+ * space, which is all that real mode and V86 code can reach. It is keyed
+ * by the address seen after the A20 gate, so that code reached through
+ * an alias at 1 MB shares the entries. Writes to that range are tracked
+ * with a bitmap of 64-byte lines.
+ */
+#define FAST486_ICACHE_ENTRIES      4096
+#define FAST486_ICACHE_LIMIT        0x200000
+#define FAST486_ICACHE_LINE_SHIFT   6
+#define FAST486_ICACHE_LINES        (FAST486_ICACHE_LIMIT >> FAST486_ICACHE_LINE_SHIFT)
+#define FAST486_ICACHE_MAX_LENGTH   15
+
 struct _FAST486_STATE;
 typedef struct _FAST486_STATE FAST486_STATE, *PFAST486_STATE;
 
@@ -244,6 +257,14 @@ VOID
     PFAST486_STATE State
 );
 
+typedef
+VOID
+(FASTCALL *FAST486_ICACHE_HANDLER)
+(
+    PFAST486_STATE State,
+    UCHAR Opcode
+);
+
 typedef union _FAST486_REG
 {
     union
@@ -511,6 +532,24 @@ typedef union _FAST486_FPU_CONTROL_REG
     };
 } FAST486_FPU_CONTROL_REG, *PFAST486_FPU_CONTROL_REG;
 
+typedef struct _FAST486_ICACHE_ENTRY
+{
+    ULONG Address;
+    ULONG Generation;
+    FAST486_ICACHE_HANDLER Handler;
+    ULONG PrefixFlags;
+    FAST486_SEG_REGS SegmentOverride;
+    UCHAR Opcode;
+    UCHAR Length;
+} FAST486_ICACHE_ENTRY, *PFAST486_ICACHE_ENTRY;
+
+typedef struct _FAST486_ICACHE
+{
+    ULONG Generation;
+    ULONG CodeLines[FAST486_ICACHE_LINES / 32];
+    FAST486_ICACHE_ENTRY Entries[FAST486_ICACHE_ENTRIES];
+} FAST486_ICACHE, *PFAST486_ICACHE;
+
 struct _FAST486_STATE
 {
     FAST486_MEM_READ_PROC MemReadCallback;
@@ -539,6 +578,10 @@ struct _FAST486_STATE
     BOOLEAN DoNotInterrupt;
     PULONG Tlb;
     BOOLEAN TlbEmpty;
+    PFAST486_ICACHE InstCache;
+    ULONG A20Mask;
+    PVOID *MemoryMap;
+    ULONG MemoryMapPages;
 #ifndef FAST486_NO_PREFETCH
     BOOLEAN PrefetchValid;
     ULONG PrefetchAddress;
@@ -568,7 +611,8 @@ Fast486Initialize(PFAST486_STATE         State,
                   FAST486_BOP_PROC       BopCallback,
                   FAST486_INT_ACK_PROC   IntAckCallback,
                   FAST486_FPU_PROC       FpuCallback,
-                  PULONG                 Tlb);
+                  PULONG                 Tlb,
+                  PFAST486_ICACHE        InstCache);
 
 VOID
 NTAPI
@@ -619,6 +663,22 @@ VOID
 NTAPI
 Fast486Rewind(PFAST486_STATE State);
 
+VOID
+NTAPI
+Fast486FlushInstructionCache(PFAST486_STATE State);
+
+VOID
+NTAPI
+Fast486InvalidateInstructionCache(PFAST486_STATE State, ULONG Address, ULONG Size);
+
+VOID
+NTAPI
+Fast486SetMemoryMap(PFAST486_STATE State, PVOID *MemoryMap, ULONG NumPages);
+
+VOID
+NTAPI
+Fast486SetA20(PFAST486_STATE State, BOOLEAN Enabled);
+
 #endif // _FAST486_H_
 
 /* EOF */
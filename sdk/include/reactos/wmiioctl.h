@@ -6,12 +6,12 @@
 #define IOCTL_WMI_SET_SINGLE_INSTANCE CTL_CODE(FILE_DEVICE_UNKNOWN, 0x02, METHOD_BUFFERED, FILE_WRITE_ACCESS) // 0x228008
 #define IOCTL_WMI_SET_SINGLE_ITEM CTL_CODE(FILE_DEVICE_UNKNOWN, 0x03, METHOD_BUFFERED, FILE_WRITE_ACCESS) // 0x22800C
 #define IOCTL_WMI_09 CTL_CODE(FILE_DEVICE_UNKNOWN, 0x09, METHOD_BUFFERED, FILE_WRITE_ACCESS) // 0x228024
-#define IOCTL_WMI_20 CTL_CODE(FILE_DEVICE_UNKNOWN, 0x20, METHOD_BUFFERED, FILE_ANY_ACCESS) // 0x220080
-#define IOCTL_WMI_21 CTL_CODE(FILE_DEVICE_UNKNOWN, 0x21, METHOD_BUFFERED, FILE_ANY_ACCESS) // 0x220084
-#define IOCTL_WMI_22 CTL_CODE(FILE_DEVICE_UNKNOWN, 0x22, METHOD_BUFFERED, FILE_ANY_ACCESS) // 0x220088
+#define IOCTL_WMI_START_LOGGER CTL_CODE(FILE_DEVICE_UNKNOWN, 0x20, METHOD_BUFFERED, FILE_ANY_ACCESS) // 0x220080
+#define IOCTL_WMI_STOP_LOGGER CTL_CODE(FILE_DEVICE_UNKNOWN, 0x21, METHOD_BUFFERED, FILE_ANY_ACCESS) // 0x220084
+#define IOCTL_WMI_QUERY_LOGGER CTL_CODE(FILE_DEVICE_UNKNOWN, 0x22, METHOD_BUFFERED, FILE_ANY_ACCESS) // 0x220088
 #define IOCTL_WMI_TRACE_EVENT CTL_CODE(FILE_DEVICE_UNKNOWN, 0x23, METHOD_NEITHER, FILE_WRITE_ACCESS) // 0x22808F
-#define IOCTL_WMI_24 CTL_CODE(FILE_DEVICE_UNKNOWN, 0x24, METHOD_BUFFERED, FILE_ANY_ACCESS) // 0x220090
-#define IOCTL_WMI_25 CTL_CODE(FILE_DEVICE_UNKNOWN, 0x25, METHOD_BUFFERED, FILE_ANY_ACCESS) // 0x220094
+#define IOCTL_WMI_UPDATE_LOGGER CTL_CODE(FILE_DEVICE_UNKNOWN, 0x24, METHOD_BUFFERED, FILE_ANY_ACCESS) // 0x220090
+#define IOCTL_WMI_FLUSH_LOGGER CTL_CODE(FILE_DEVICE_UNKNOWN, 0x25, METHOD_BUFFERED, FILE_ANY_ACCESS) // 0x220094
 #define IOCTL_WMI_TRACE_USER_MESSAGE CTL_CODE(FILE_DEVICE_UNKNOWN, 0x28, METHOD_NEITHER, FILE_WRITE_ACCESS) // 0x2280A3
 #define IOCTL_WMI_SET_MARK CTL_CODE(FILE_DEVICE_UNKNOWN, 0x29, METHOD_BUFFERED, FILE_ANY_ACCESS) // 0x2200A4
 #define IOCTL_WMI_2a CTL_CODE(FILE_DEVICE_UNKNOWN, 0x2a, METHOD_BUFFERED, FILE_ANY_ACCESS) // 0x2200A8
@@ -35,3 +35,178 @@
 #define IOCTL_WMI_58 CTL_CODE(FILE_DEVICE_UNKNOWN, 0x58, METHOD_BUFFERED, FILE_READ_ACCESS) // 0x224160
 #define IOCTL_WMI_59 CTL_CODE(FILE_DEVICE_UNKNOWN, 0x59, METHOD_BUFFERED, FILE_READ_ACCESS) // 0x224164
 #define IOCTL_WMI_5a CTL_CODE(FILE_DEVICE_UNKNOWN, 0x5a, METHOD_BUFFERED, FILE_WRITE_ACCESS) // 0x228168
+
+/* ReactOS specific, used by ntdll to drive trace providers */
+#define IOCTL_WMI_ENABLE_TRACE CTL_CODE(FILE_DEVICE_UNKNOWN, 0x60, METHOD_BUFFERED, FILE_ANY_ACCESS) // 0x220180
+#define IOCTL_WMI_REGISTER_TRACE_GUID CTL_CODE(FILE_DEVICE_UNKNOWN, 0x61, METHOD_BUFFERED, FILE_ANY_ACCESS) // 0x220184
+#define IOCTL_WMI_QUERY_TRACE_ENABLE CTL_CODE(FILE_DEVICE_UNKNOWN, 0x62, METHOD_BUFFERED, FILE_ANY_ACCESS) // 0x220188
+
+#define WMI_MAXIMUM_LOGGERS 32
+
+/*
+ * Logger control block for the IOCTL_WMI_*_LOGGER requests. It has the layout
+ * of EVENT_TRACE_PROPERTIES, the names are stored inline after the structure
+ * and the offsets are relative to its start. Wnode.HistoricalContext holds the
+ * logger handle and Wnode.ClientContext the clock type.
+ */
+typedef struct _WMI_LOGGER_INFORMATION
+{
+    WNODE_HEADER Wnode;
+    ULONG BufferSize;
+    ULONG MinimumBuffers;
+    ULONG MaximumBuffers;
+    ULONG MaximumFileSize;
+    ULONG LogFileMode;
+    ULONG FlushTimer;
+    ULONG EnableFlags;
+    LONG AgeLimit;
+    ULONG NumberOfBuffers;
+    ULONG FreeBuffers;
+    ULONG EventsLost;
+    ULONG BuffersWritten;
+    ULONG LogBuffersLost;
+    ULONG RealTimeBuffersLost;
+    HANDLE LoggerThreadId;
+    ULONG LogFileNameOffset;
+    ULONG LoggerNameOffset;
+} WMI_LOGGER_INFORMATION, *PWMI_LOGGER_INFORMATION;
+
+/* Trace handles handed to providers pack the logger and its settings */
+typedef struct _WMI_TRACE_ENABLE_CONTEXT
+{
+    USHORT LoggerId;
+    UCHAR Level;
+    UCHAR InternalFlag;
+    ULONG EnableFlags;
+} WMI_TRACE_ENABLE_CONTEXT, *PWMI_TRACE_ENABLE_CONTEXT;
+
+typedef struct _WMI_ENABLE_TRACE
+{
+    GUID ControlGuid;
+    TRACEHANDLE LoggerHandle;
+    ULONG EnableFlags;
+    UCHAR EnableLevel;
+    BOOLEAN Enable;
+} WMI_ENABLE_TRACE, *PWMI_ENABLE_TRACE;
+
+/* The registration lives as long as the file object it was made on */
+typedef struct _WMI_REGISTER_TRACE_GUID
+{
+    GUID ControlGuid;
+    HANDLE EventHandle;
+} WMI_REGISTER_TRACE_GUID, *PWMI_REGISTER_TRACE_GUID;
+
+typedef struct _WMI_QUERY_TRACE_ENABLE
+{
+    TRACEHANDLE EnableContext;
+} WMI_QUERY_TRACE_ENABLE, *PWMI_QUERY_TRACE_ENABLE;
+
+/*
+ * Log file format. The file is a sequence of BufferSize sized buffers, each
+ * starting with a WMI_BUFFER_HEADER. SavedOffset is the number of bytes in use,
+ * header included. Events follow the header, each one starts with an
+ * EVENT_TRACE_HEADER whose Size covers the event data, and the next one starts
+ * at the next 8 byte boundary. Events with a null GUID are padding.
+ * The first buffer holds a single EventTraceGuid event with a WMI_LOGFILE_HEADER.
+ */
+#define WMI_LOGFILE_VERSION 1
+
+typedef struct _WMI_BUFFER_HEADER
+{
+    ULONG BufferSize;
+    ULONG SavedOffset;
+    LARGE_INTEGER TimeStamp;
+    ULONG SequenceNumber;
+    USHORT ProcessorNumber;
+    USHORT LoggerId;
+    ULONG Reserved[2];
+} WMI_BUFFER_HEADER, *PWMI_BUFFER_HEADER;
+
+typedef struct _WMI_LOGFILE_HEADER
+{
+    ULONG Version;
+    ULONG NumberOfProcessors;
+    ULONG BufferSize;
+    ULONG LogFileMode;
+    ULONG MaximumFileSize;
+    ULONG EnableFlags;
+    ULONG ClockType;
+    ULONG PointerSize;
+    LARGE_INTEGER ClockFrequency;
+    LARGE_INTEGER StartTime;
+    LARGE_INTEGER StartTimeStamp;
+    LARGE_INTEGER EndTime;
+    ULONG BuffersWritten;
+    ULONG EventsLost;
+    ULONG BuffersLost;
+    ULONG Reserved;
+} WMI_LOGFILE_HEADER, *PWMI_LOGFILE_HEADER;
+
+/* Kernel logger events */
+#define WMI_TRACE_TYPE_CSWITCH 36
+
+typedef struct _WMI_CSWITCH_EVENT
+{
+    ULONG NewThreadId;
+    ULONG OldThreadId;
+    CHAR NewThreadPriority;
+    CHAR OldThreadPriority;
+    UCHAR PreviousCState;
+    CHAR SpareByte;
+    CHAR OldThreadWaitReason;
+    CHAR OldThreadWaitMode;
+    CHAR OldThreadState;
+    CHAR OldThreadWaitIdealProcessor;
+    ULONG NewThreadWaitTime;
+    ULONG Reserved;
+} WMI_CSWITCH_EVENT, *PWMI_CSWITCH_EVENT;
+
+/* Logged as the request is sent to the disk and when it completes, match them with Irp */
+typedef struct _WMI_DISKIO_EVENT
+{
+    ULONG IrpFlags;
+    ULONG TransferSize;
+    NTSTATUS Status;
+    ULONG Reserved;
+    LARGE_INTEGER ByteOffset;
+    ULONG64 Irp;
+    ULONG64 FileObject;
+    ULONG64 DeviceObject;
+} WMI_DISKIO_EVENT, *PWMI_DISKIO_EVENT;
+
+typedef struct _WMI_PAGE_FAULT_EVENT
+{
+    ULONG64 VirtualAddress;
+    ULONG64 ProgramCounter;
+    NTSTATUS Status;
+    ULONG Reserved;
+} WMI_PAGE_FAULT_EVENT, *PWMI_PAGE_FAULT_EVENT;
+
+/*
+ * Logged with PerfInfoGuid on every profile interrupt. Frames holds the
+ * KernelFrames kernel addresses followed by the UserFrames user addresses,
+ * innermost first. The first one of the interrupted mode is the interrupted
+ * instruction, the others are return addresses. The interrupt only records
+ * the interrupted user address. The whole user stack comes later, in a
+ * WMI_TRACE_TYPE_SAMPLED_USER_STACK event with the same SampleId, unless it
+ * could not be walked.
+ */
+#define WMI_TRACE_TYPE_SAMPLED_PROFILE 46
+#define WMI_TRACE_TYPE_SAMPLED_USER_STACK 47
+#define WMI_SAMPLED_PROFILE_MAX_FRAMES 64
+
+typedef struct _WMI_SAMPLED_PROFILE_EVENT
+{
+    USHORT KernelFrames;
+    USHORT UserFrames;
+    ULONG SampleId;
+    ULONG64 Frames[ANYSIZE_ARRAY];
+} WMI_SAMPLED_PROFILE_EVENT, *PWMI_SAMPLED_PROFILE_EVENT;
+
+/* Frames starts with the interrupted user address, like the sample's user frames */
+typedef struct _WMI_SAMPLED_USER_STACK_EVENT
+{
+    ULONG SampleId;
+    ULONG FrameCount;
+    ULONG64 Frames[ANYSIZE_ARRAY];
+} WMI_SAMPLED_USER_STACK_EVENT, *PWMI_SAMPLED_USER_STACK_EVENT;
@@ -1251,8 +1251,8 @@ typedef enum _FILE_INFORMATION_CLASS {
   FileIdFullDirectoryInformation,
   FileValidDataLengthInformation,
   FileShortNameInformation,
+  FileIoCompletionNotificationInformation, /* 5.2 SP2 and higher */
 #if (NTDDI_VERSION >= NTDDI_VISTA)
-  FileIoCompletionNotificationInformation,
   FileIoStatusBlockRangeInformation,
   FileIoPriorityHintInformation,
   FileSfioReserveInformation,
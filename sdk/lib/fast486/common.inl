@@ -60,6 +60,90 @@ Fast486GetCurrentPrivLevel(PFAST486_STATE State)
     return (!State->Flags.Vm) ? State->Cpl : 3;
 }
 
+FORCEINLINE
+VOID
+FASTCALL
+Fast486ReadPhysicalMemory(PFAST486_STATE State,
+                          ULONG Address,
+                          PVOID Buffer,
+                          ULONG Size)
+{
+    ULONG Page = Address >> 12;
+    PUCHAR Source;
+
+    /* Go through the callback for hooked pages and accesses crossing a page */
+    if ((Page >= State->MemoryMapPages)
+        || (State->MemoryMap[Page] == NULL)
+        || ((PAGE_OFFSET(Address) + Size) > FAST486_PAGE_SIZE))
+    {
+        State->MemReadCallback(State, Address, Buffer, Size);
+        return;
+    }
+
+    /* Plain RAM, read it directly */
+    Source = (PUCHAR)State->MemoryMap[Page] + PAGE_OFFSET(Address);
+    switch (Size)
+    {
+        case sizeof(UCHAR):
+            *(PUCHAR)Buffer = *Source;
+            break;
+
+        case sizeof(USHORT):
+            RtlCopyMemory(Buffer, Source, sizeof(USHORT));
+            break;
+
+        case sizeof(ULONG):
+            RtlCopyMemory(Buffer, Source, sizeof(ULONG));
+            break;
+
+        default:
+            RtlCopyMemory(Buffer, Source, Size);
+            break;
+    }
+}
+
+FORCEINLINE
+VOID
+FASTCALL
+Fast486WritePhysicalMemory(PFAST486_STATE State,
+                           ULONG Address,
+                           PVOID Buffer,
+                           ULONG Size)
+{
+    ULONG Page = Address >> 12;
+    PUCHAR Destination;
+
+    /* Go through the callback for hooked pages and accesses crossing a page */
+    if ((Page >= State->MemoryMapPages)
+        || (State->MemoryMap[Page] == NULL)
+        || ((PAGE_OFFSET(Address) + Size) > FAST486_PAGE_SIZE))
+    {
+        State->MemWriteCallback(State, Address, Buffer, Size);
+        return;
+    }
+
+    /* Plain RAM, write it directly */
+    Destination = (PUCHAR)State->MemoryMap[Page] + PAGE_OFFSET(Address);
+    switch (Size)
+    {
+        case sizeof(UCHAR):
+            *Destination = *(PUCHAR)Buffer;
+            break;
+
+        case sizeof(USHORT):
+            RtlCopyMemory(Destination, Buffer, sizeof(USHORT));
+            break;
+
+        case sizeof(ULONG):
+            RtlCopyMemory(Destination, Buffer, sizeof(ULONG));
+            break;
+
+        default:
+            RtlCopyMemory(Destination, Buffer, Size);
+            break;
+    }
+}
+
 FORCEINLINE
 ULONG
 FASTCALL
@@ -81,10 +165,10 @@ Fast486GetPageTableEntry(PFAST486_STATE State,
     }
 
     /* Read the directory entry */
-    State->MemReadCallback(State,
-                           PageDirectory + PdeIndex * sizeof(ULONG),
-                           &DirectoryEntry.Value,
-                           sizeof(DirectoryEntry));
+    Fast486ReadPhysicalMemory(State,
+                              PageDirectory + PdeIndex * sizeof(ULONG),
+                              &DirectoryEntry.Value,
+                              sizeof(DirectoryEntry));
 
     /* Make sure it is present */
     if (!DirectoryEntry.Present) return 0;
@@ -96,18 +180,18 @@ Fast486GetPageTableEntry(PFAST486_STATE State,
         DirectoryEntry.Accessed = TRUE;
 
         /* Write back the directory entry */
-        State->MemWriteCallback(State,
-                                PageDirectory + PdeIndex * sizeof(ULONG),
-                                &DirectoryEntry.Value,
-                                sizeof(DirectoryEntry));
+        Fast486WritePhysicalMemory(State,
+                                   PageDirectory + PdeIndex * sizeof(ULONG),
+                                   &DirectoryEntry.Value,
+                                   sizeof(DirectoryEntry));
     }
 
     /* Read the table entry */
-    State->MemReadCallback(State,
-                           (DirectoryEntry.TableAddress << 12)
-                           + PteIndex * sizeof(ULONG),
-                           &TableEntry.Value,
-                           sizeof(TableEntry));
+    Fast486ReadPhysicalMemory(State,
+                              (DirectoryEntry.TableAddress << 12)
+                              + PteIndex * sizeof(ULONG),
+                              &TableEntry.Value,
+                              sizeof(TableEntry));
 
     /* Make sure it is present */
     if (!TableEntry.Present) return 0;
@@ -120,11 +204,11 @@ Fast486GetPageTableEntry(PFAST486_STATE State,
         if (MarkAsDirty) TableEntry.Dirty = TRUE;
 
         /* Write back the table entry */
-        State->MemWriteCallback(State,
-                                (DirectoryEntry.TableAddress << 12)
-                                + PteIndex * sizeof(ULONG),
-                                &TableEntry.Value,
-                                sizeof(TableEntry));
+        Fast486WritePhysicalMemory(State,
+                                   (DirectoryEntry.TableAddress << 12)
+                                   + PteIndex * sizeof(ULONG),
+                                   &TableEntry.Value,
+                                   sizeof(TableEntry));
     }
 
     /*
@@ -155,6 +239,166 @@ Fast486FlushTlb(PFAST486_STATE State)
     State->TlbEmpty = TRUE;
 }
 
+FORCEINLINE
+VOID
+FASTCALL
+Fast486FlushInstCache(PFAST486_STATE State)
+{
+    PFAST486_ICACHE Cache = State->InstCache;
+    if (Cache == NULL) return;
+
+    /* Bumping the generation invalidates all entries at once */
+    if (++Cache->Generation == 0)
+    {
+        /* The generation wrapped around, clear the entries for real */
+        RtlZeroMemory(Cache->Entries, sizeof(Cache->Entries));
+        Cache->Generation = 1;
+    }
+}
+
+FORCEINLINE
+VOID
+FASTCALL
+Fast486InvalidateInstCache(PFAST486_STATE State,
+                           ULONG LinearAddress,
+                           ULONG Size)
+{
+    PFAST486_ICACHE Cache = State->InstCache;
+    PFAST486_ICACHE_ENTRY Entry;
+    ULONG LinearLine, LastLine, Line, Address, LineEnd;
+
+    /* The A20 gate only clears bit 20, so this also holds for the physical address */
+    if ((Cache == NULL) || (LinearAddress >= FAST486_ICACHE_LIMIT)) return;
+
+    LinearLine = LinearAddress >> FAST486_ICACHE_LINE_SHIFT;
+    LastLine = min((LinearAddress + Size - 1) >> FAST486_ICACHE_LINE_SHIFT,
+                   FAST486_ICACHE_LINES - 1);
+
+    for (; LinearLine <= LastLine; LinearLine++)
+    {
+        /* The entries are keyed by the address after the A20 gate */
+        Line = ((LinearLine << FAST486_ICACHE_LINE_SHIFT) & State->A20Mask)
+               >> FAST486_ICACHE_LINE_SHIFT;
+
+        /* Skip the line if no instruction was decoded from it */
+        if (!(Cache->CodeLines[Line >> 5] & (1 << (Line & 0x1F)))) continue;
+        Cache->CodeLines[Line >> 5] &= ~(1 << (Line & 0x1F));
+
+        /* Drop the entries of all instructions overlapping this line */
+        Address = Line << FAST486_ICACHE_LINE_SHIFT;
+        LineEnd = Address + (1 << FAST486_ICACHE_LINE_SHIFT);
+        Address = (Address >= FAST486_ICACHE_MAX_LENGTH - 1)
+                  ? Address - (FAST486_ICACHE_MAX_LENGTH - 1) : 0;
+
+        for (; Address < LineEnd; Address++)
+        {
+            Entry = &Cache->Entries[Address & (FAST486_ICACHE_ENTRIES - 1)];
+            if (Entry->Address == Address) Entry->Generation = 0;
+        }
+    }
+}
+
+FORCEINLINE
+PFAST486_ICACHE_ENTRY
+FASTCALL
+Fast486LookupInstCache(PFAST486_STATE State)
+{
+    PFAST486_ICACHE Cache = State->InstCache;
+    PFAST486_SEG_REG CachedDescriptor = &State->SegmentRegs[FAST486_REG_CS];
+    PFAST486_ICACHE_ENTRY Entry;
+    ULONG Offset, Address, LastByte;
+
+    /* The cache works on linear addresses, so it can't be used with paging */
+    if ((Cache == NULL)
+        || (State->ControlRegisters[FAST486_REG_CR0] & FAST486_CR0_PG))
+    {
+        return NULL;
+    }
+
+    Offset = (CachedDescriptor->Size) ? State->InstPtr.Long
+                                      : State->InstPtr.LowWord;
+
+    Address = (CachedDescriptor->Base + Offset) & State->A20Mask;
+
+    Entry = &Cache->Entries[Address & (FAST486_ICACHE_ENTRIES - 1)];
+    if ((Entry->Address != Address)
+        || (Entry->Generation != Cache->Generation))
+    {
+        return NULL;
+    }
+
+    /* The whole instruction must still be within the limit of CS */
+    LastByte = Offset + Entry->Length - 1;
+    if ((LastByte > CachedDescriptor->Limit)
+        || (!CachedDescriptor->Size && (LastByte > 0xFFFF)))
+    {
+        return NULL;
+    }
+
+    return Entry;
+}
+
+FORCEINLINE
+VOID
+FASTCALL
+Fast486FillInstCache(PFAST486_STATE State,
+                     FAST486_ICACHE_HANDLER Handler,
+                     UCHAR Opcode)
+{
+    PFAST486_ICACHE Cache = State->InstCache;
+    PFAST486_SEG_REG CachedDescriptor = &State->SegmentRegs[FAST486_REG_CS];
+    PFAST486_ICACHE_ENTRY Entry;
+    ULONG Offset, Length, Address, Line;
+
+    if ((Cache == NULL)
+        || (State->ControlRegisters[FAST486_REG_CR0] & FAST486_CR0_PG))
+    {
+        return;
+    }
+
+    /* The prefixes and the opcode span from the saved IP to the current one */
+    if (CachedDescriptor->Size)
+    {
+        Offset = State->SavedInstPtr.Long;
+        Length = State->InstPtr.Long - Offset;
+    }
+    else
+    {
+        Offset = State->SavedInstPtr.LowWord;
+        Length = State->InstPtr.LowWord - Offset;
+
+        /* Don't bother with instructions wrapping around the segment */
+        if (State->InstPtr.LowWord < Offset) return;
+    }
+
+    if ((Length == 0) || (Length > FAST486_ICACHE_MAX_LENGTH)) return;
+
+    Address = (CachedDescriptor->Base + Offset) & State->A20Mask;
+    if (Address >= FAST486_ICACHE_LIMIT - FAST486_ICACHE_MAX_LENGTH) return;
+
+    /* Don't bother with instructions wrapping around at the A20 gate either */
+    if (((CachedDescriptor->Base + Offset + Length - 1) & State->A20Mask)
+        != Address + Length - 1)
+    {
+        return;
+    }
+
+    Entry = &Cache->Entries[Address & (FAST486_ICACHE_ENTRIES - 1)];
+    Entry->Address = Address;
+    Entry->Generation = Cache->Generation;
+    Entry->Handler = Handler;
+    Entry->PrefixFlags = State->PrefixFlags;
+    Entry->SegmentOverride = State->SegmentOverride;
+    Entry->Opcode = Opcode;
+    Entry->Length = (UCHAR)Length;
+
+    /* Mark the lines holding the instruction, so writes to them invalidate it */
+    Line = Address >> FAST486_ICACHE_LINE_SHIFT;
+    Cache->CodeLines[Line >> 5] |= 1 << (Line & 0x1F);
+    Line = (Address + Length - 1) >> FAST486_ICACHE_LINE_SHIFT;
+    Cache->CodeLines[Line >> 5] |= 1 << (Line & 0x1F);
+}
+
 FORCEINLINE
 BOOLEAN
 FASTCALL
@@ -208,10 +452,10 @@ Fast486ReadLinearMemory(PFAST486_STATE State,
             }
 
             /* Read the memory */
-            State->MemReadCallback(State,
-                                   (TableEntry.Address << 12) | PageOffset,
-                                   (PVOID)((ULONG_PTR)Buffer + BufferOffset),
-                                   PageLength);
+            Fast486ReadPhysicalMemory(State,
+                                      (TableEntry.Address << 12) | PageOffset,
+                                      (PVOID)((ULONG_PTR)Buffer + BufferOffset),
+                                      PageLength);
 
             BufferOffset += PageLength;
         }
@@ -219,7 +463,7 @@ Fast486ReadLinearMemory(PFAST486_STATE State,
     else
     {
         /* Read the memory */
-        State->MemReadCallback(State, LinearAddress, Buffer, Size);
+        Fast486ReadPhysicalMemory(State, LinearAddress, Buffer, Size);
     }
 
     return TRUE;
@@ -281,18 +525,21 @@ Fast486WriteLinearMemory(PFAST486_STATE State,
             }
 
             /* Write the memory */
-            State->MemWriteCallback(State,
-                                    (TableEntry.Address << 12) | PageOffset,
-                                    (PVOID)((ULONG_PTR)Buffer + BufferOffset),
-                                    PageLength);
+            Fast486WritePhysicalMemory(State,
+                                       (TableEntry.Address << 12) | PageOffset,
+                                       (PVOID)((ULONG_PTR)Buffer + BufferOffset),
+                                       PageLength);
 
             BufferOffset += PageLength;
         }
     }
     else
     {
+        /* Drop any decoded instructions this write overwrites */
+        Fast486InvalidateInstCache(State, LinearAddress, Size);
+
         /* Write the memory */
-        State->MemWriteCallback(State, LinearAddress, Buffer, Size);
+        Fast486WritePhysicalMemory(State, LinearAddress, Buffer, Size);
     }
 
     return TRUE;
@@ -50,6 +50,7 @@ Fast486ExecutionControl(PFAST486_STATE State, FAST486_EXEC_CMD Command)
 {
     UCHAR Opcode;
     FAST486_OPCODE_HANDLER_PROC CurrentHandler;
+    PFAST486_ICACHE_ENTRY Entry;
     INT ProcedureCallCount = 0;
     BOOLEAN Trap;
 
@@ -58,7 +59,22 @@ Fast486ExecutionControl(PFAST486_STATE State, FAST486_EXEC_CMD Command)
     {
         Trap = State->Flags.Tf;
 
-        if (!State->Halted)
+        if (!State->Halted && (Entry = Fast486LookupInstCache(State)) != NULL)
+        {
+            /* The prefixes and the opcode were already decoded, skip them */
+            State->SavedInstPtr = State->InstPtr;
+            State->SavedStackPtr = State->GeneralRegs[FAST486_REG_ESP];
+            State->PrefixFlags = Entry->PrefixFlags;
+            State->SegmentOverride = Entry->SegmentOverride;
+
+            if (State->SegmentRegs[FAST486_REG_CS].Size) State->InstPtr.Long += Entry->Length;
+            else State->InstPtr.LowWord += Entry->Length;
+
+            /* Call the opcode handler */
+            Entry->Handler(State, Entry->Opcode);
+            State->PrefixFlags = 0;
+        }
+        else if (!State->Halted)
         {
 NextInst:
             /* Check if this is a new instruction */
@@ -80,6 +96,11 @@ NextInst:
 
             /* Call the opcode handler */
             CurrentHandler = Fast486OpcodeHandlers[Opcode];
+            if (CurrentHandler != Fast486OpcodePrefix)
+            {
+                /* Remember the decoded instruction before it runs */
+                Fast486FillInstCache(State, CurrentHandler, Opcode);
+            }
             CurrentHandler(State, Opcode);
 
             /* If this is a prefix, go to the next instruction immediately */
@@ -640,6 +640,9 @@ FAST486_OPCODE_HANDLER(Fast486ExtOpcodeLoadControlReg)
     State->PrefetchValid = FALSE;
 #endif
 
+    /* The decoded instructions are only valid while paging stays disabled */
+    if (ModRegRm.Register == (INT)FAST486_REG_CR0) Fast486FlushInstCache(State);
+
     if (ModRegRm.Register == (INT)FAST486_REG_CR3)
     {
         /* Flush the TLB */
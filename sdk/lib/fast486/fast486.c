@@ -108,7 +108,8 @@ Fast486Initialize(PFAST486_STATE         State,
                   FAST486_BOP_PROC       BopCallback,
                   FAST486_INT_ACK_PROC   IntAckCallback,
                   FAST486_FPU_PROC       FpuCallback,
-                  PULONG                 Tlb)
+                  PULONG                 Tlb,
+                  PFAST486_ICACHE        InstCache)
 {
     /* Set the callbacks (or use default ones if some are NULL) */
     State->MemReadCallback  = (MemReadCallback  ? MemReadCallback  : Fast486MemReadCallback );
@@ -122,6 +123,17 @@ Fast486Initialize(PFAST486_STATE         State,
     /* Set the TLB (if given) */
     State->Tlb = Tlb;
 
+    /* Set the decoded instruction cache (if given) */
+    if (InstCache != NULL) RtlZeroMemory(InstCache, sizeof(*InstCache));
+    State->InstCache = InstCache;
+
+    /* All memory goes through the callbacks until a memory map is set */
+    State->MemoryMap = NULL;
+    State->MemoryMapPages = 0;
+
+    /* The A20 line is enabled until the caller says otherwise */
+    State->A20Mask = 0xFFFFFFFF;
+
     /* Reset the CPU */
     Fast486Reset(State);
 }
@@ -132,7 +144,7 @@ Fast486Reset(PFAST486_STATE State)
 {
     FAST486_SEG_REGS i;
 
-    /* Save the callbacks and TLB */
+    /* Save the callbacks, TLB, instruction cache and memory map */
     FAST486_MEM_READ_PROC  MemReadCallback  = State->MemReadCallback;
     FAST486_MEM_WRITE_PROC MemWriteCallback = State->MemWriteCallback;
     FAST486_IO_READ_PROC   IoReadCallback   = State->IoReadCallback;
@@ -141,6 +153,10 @@ Fast486Reset(PFAST486_STATE State)
     FAST486_INT_ACK_PROC   IntAckCallback   = State->IntAckCallback;
     FAST486_FPU_PROC       FpuCallback      = State->FpuCallback;
     PULONG                 Tlb              = State->Tlb;
+    PFAST486_ICACHE        InstCache        = State->InstCache;
+    PVOID*                 MemoryMap        = State->MemoryMap;
+    ULONG                  MemoryMapPages   = State->MemoryMapPages;
+    ULONG                  A20Mask          = State->A20Mask;
 
     /* Clear the entire structure */
     RtlZeroMemory(State, sizeof(*State));
@@ -186,7 +202,7 @@ Fast486Reset(PFAST486_STATE State)
     State->FpuTag = 0xFFFF;
 #endif
 
-    /* Restore the callbacks and TLB */
+    /* Restore the callbacks, TLB, instruction cache and memory map */
     State->MemReadCallback  = MemReadCallback;
     State->MemWriteCallback = MemWriteCallback;
     State->IoReadCallback   = IoReadCallback;
@@ -195,9 +211,14 @@ Fast486Reset(PFAST486_STATE State)
     State->IntAckCallback   = IntAckCallback;
     State->FpuCallback      = FpuCallback;
     State->Tlb              = Tlb;
+    State->InstCache        = InstCache;
+    State->MemoryMap        = MemoryMap;
+    State->MemoryMapPages   = MemoryMapPages;
+    State->A20Mask          = A20Mask;
 
-    /* Flush the TLB */
+    /* Flush the TLB and the instruction cache */
     Fast486FlushTlb(State);
+    Fast486FlushInstCache(State);
 }
 
 VOID
@@ -260,4 +281,60 @@ Fast486Rewind(PFAST486_STATE State)
 #endif
 }
 
+VOID
+NTAPI
+Fast486FlushInstructionCache(PFAST486_STATE State)
+{
+    /* This function is used when the code was modified without the CPU knowing */
+    Fast486FlushInstCache(State);
+
+#ifndef FAST486_NO_PREFETCH
+    State->PrefetchValid = FALSE;
+#endif
+}
+
+VOID
+NTAPI
+Fast486InvalidateInstructionCache(PFAST486_STATE State, ULONG Address, ULONG Size)
+{
+    /* This function is used when the host writes guest memory, for example through DMA */
+    if (Size == 0) return;
+    Fast486InvalidateInstCache(State, Address, Size);
+
+#ifndef FAST486_NO_PREFETCH
+    /* The prefetch is keyed by linear address, only compare when that is physical */
+    if (State->PrefetchValid
+        && ((State->ControlRegisters[FAST486_REG_CR0] & FAST486_CR0_PG)
+            || ((Address < (State->PrefetchAddress & State->A20Mask) + FAST486_CACHE_SIZE)
+                && ((State->PrefetchAddress & State->A20Mask) < Address + Size))))
+    {
+        State->PrefetchValid = FALSE;
+    }
+#endif
+}
+
+VOID
+NTAPI
+Fast486SetMemoryMap(PFAST486_STATE State, PVOID *MemoryMap, ULONG NumPages)
+{
+    /*
+     * Each entry of the map gives the host address of a physical page, which
+     * is then accessed directly, or is NULL if the page needs the callbacks.
+     * The caller keeps the map up to date and may change it at any time.
+     */
+    State->MemoryMap = MemoryMap;
+    State->MemoryMapPages = (MemoryMap != NULL) ? NumPages : 0;
+}
+
+VOID
+NTAPI
+Fast486SetA20(PFAST486_STATE State, BOOLEAN Enabled)
+{
+    /*
+     * The memory callbacks and the memory map already apply the A20 gate,
+     * the CPU only needs it to key the decoded instruction cache.
+     */
+    State->A20Mask = Enabled ? 0xFFFFFFFF : ~(1 << 20);
+}
+
 /* EOF */
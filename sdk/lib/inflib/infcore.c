@@ -133,12 +133,288 @@ InfpFreeSection (PINFCACHESECTION Section)
     }
   Section->LastLine = NULL;
 
+  /* Release the indexes */
+  if (Section->LineById != NULL)
+    {
+      FREE (Section->LineById);
+    }
+  if (Section->KeyHash != NULL)
+    {
+      FREE (Section->KeyHash);
+    }
+
   FREE (Section);
 
   return Next;
 }
 
 
+VOID
+InfpFreeCache(PINFCACHE Cache)
+{
+  while (Cache->FirstSection != NULL)
+    {
+      Cache->FirstSection = InfpFreeSection(Cache->FirstSection);
+    }
+  Cache->LastSection = NULL;
+
+  if (Cache->SectionById != NULL)
+    {
+      FREE (Cache->SectionById);
+      Cache->SectionById = NULL;
+    }
+  Cache->SectionByIdSize = 0;
+
+  if (Cache->SectionHash != NULL)
+    {
+      FREE (Cache->SectionHash);
+      Cache->SectionHash = NULL;
+    }
+  Cache->SectionHashSize = 0;
+}
+
+
+static ULONG
+InfpHashName(PCWSTR Name)
+{
+  ULONG Hash = 0;
+
+  /* Must fold case the same way strcmpiW does */
+  while (*Name != 0)
+    {
+      Hash = (Hash * 31) + tolowerW(*Name);
+      Name++;
+    }
+
+  return Hash;
+}
+
+
+static ULONG
+InfpGetIndexSize(ULONG Size, ULONG Count)
+{
+  if (Size == 0)
+    {
+      Size = INF_HASH_INITIAL_SIZE;
+    }
+
+  while (Size < Count)
+    {
+      Size *= 2;
+    }
+
+  return Size;
+}
+
+
+static VOID
+InfpInsertSectionHash(PINFCACHE Cache,
+                      PINFCACHESECTION Section)
+{
+  PINFCACHESECTION *Bucket;
+  PINFCACHESECTION Current;
+
+  Bucket = &Cache->SectionHash[InfpHashName(Section->Name) & (Cache->SectionHashSize - 1)];
+
+  /* The first section with a given name wins, like in the list */
+  for (Current = *Bucket; Current != NULL; Current = Current->HashNext)
+    {
+      if (strcmpiW(Current->Name, Section->Name) == 0)
+        {
+          return;
+        }
+    }
+
+  Section->HashNext = *Bucket;
+  *Bucket = Section;
+}
+
+
+static VOID
+InfpIndexSection(PINFCACHE Cache,
+                 PINFCACHESECTION Section)
+{
+  PINFCACHESECTION Current;
+  ULONG Size;
+
+  /* Grow the Id and name indexes together, rebuilding them from the list */
+  if (Section->Id > Cache->SectionByIdSize)
+    {
+      Size = InfpGetIndexSize(Cache->SectionByIdSize * 2, Section->Id);
+
+      if (Cache->SectionById != NULL)
+        {
+          FREE (Cache->SectionById);
+        }
+      if (Cache->SectionHash != NULL)
+        {
+          FREE (Cache->SectionHash);
+        }
+      Cache->SectionByIdSize = 0;
+      Cache->SectionHashSize = 0;
+
+      Cache->SectionById = (PINFCACHESECTION *)MALLOC(Size * sizeof(PINFCACHESECTION));
+      Cache->SectionHash = (PINFCACHESECTION *)MALLOC(Size * sizeof(PINFCACHESECTION));
+      if (Cache->SectionById == NULL || Cache->SectionHash == NULL)
+        {
+          /* Lookups fall back to walking the list */
+          DPRINT("MALLOC() failed\n");
+          if (Cache->SectionById != NULL)
+            {
+              FREE (Cache->SectionById);
+              Cache->SectionById = NULL;
+            }
+          if (Cache->SectionHash != NULL)
+            {
+              FREE (Cache->SectionHash);
+              Cache->SectionHash = NULL;
+            }
+          return;
+        }
+
+      ZEROMEMORY (Cache->SectionById, Size * sizeof(PINFCACHESECTION));
+      ZEROMEMORY (Cache->SectionHash, Size * sizeof(PINFCACHESECTION));
+      Cache->SectionByIdSize = Size;
+      Cache->SectionHashSize = Size;
+
+      for (Current = Cache->FirstSection; Current != NULL; Current = Current->Next)
+        {
+          Cache->SectionById[Current->Id - 1] = Current;
+          Current->HashNext = NULL;
+          InfpInsertSectionHash(Cache, Current);
+        }
+
+      return;
+    }
+
+  Cache->SectionById[Section->Id - 1] = Section;
+  InfpInsertSectionHash(Cache, Section);
+}
+
+
+static VOID
+InfpInsertKeyHash(PINFCACHESECTION Section,
+                  PINFCACHELINE Line)
+{
+  PINFCACHELINE *Bucket;
+  PINFCACHELINE Current;
+
+  Bucket = &Section->KeyHash[InfpHashName(Line->Key) & (Section->KeyHashSize - 1)];
+
+  /* Lookups return the first line with a given key */
+  for (Current = *Bucket; Current != NULL; Current = Current->HashNext)
+    {
+      if (strcmpiW(Current->Key, Line->Key) == 0)
+        {
+          return;
+        }
+    }
+
+  Line->HashNext = *Bucket;
+  *Bucket = Line;
+  Section->KeyCount++;
+}
+
+
+static VOID
+InfpBuildKeyHash(PINFCACHESECTION Section,
+                 ULONG Size)
+{
+  PINFCACHELINE Line;
+
+  if (Section->KeyHash != NULL)
+    {
+      FREE (Section->KeyHash);
+    }
+  Section->KeyHashSize = 0;
+  Section->KeyCount = 0;
+
+  Section->KeyHash = (PINFCACHELINE *)MALLOC(Size * sizeof(PINFCACHELINE));
+  if (Section->KeyHash == NULL)
+    {
+      /* Lookups fall back to walking the list */
+      DPRINT("MALLOC() failed\n");
+      return;
+    }
+  ZEROMEMORY (Section->KeyHash, Size * sizeof(PINFCACHELINE));
+  Section->KeyHashSize = Size;
+
+  for (Line = Section->FirstLine; Line != NULL; Line = Line->Next)
+    {
+      Line->HashNext = NULL;
+      if (Line->Key != NULL)
+        {
+          InfpInsertKeyHash(Section, Line);
+        }
+    }
+}
+
+
+static VOID
+InfpIndexKey(PINFCACHESECTION Section,
+             PINFCACHELINE Line)
+{
+  /* Small sections are searched linearly */
+  if (Section->KeyHash == NULL)
+    {
+      if (Section->LineCount >= INF_KEY_HASH_MIN_LINES)
+        {
+          InfpBuildKeyHash(Section,
+                           InfpGetIndexSize(0, (ULONG)Section->LineCount));
+        }
+      return;
+    }
+
+  /* Keep the load factor below one */
+  if (Section->KeyCount >= Section->KeyHashSize)
+    {
+      InfpBuildKeyHash(Section, Section->KeyHashSize * 2);
+      return;
+    }
+
+  InfpInsertKeyHash(Section, Line);
+}
+
+
+static VOID
+InfpIndexLine(PINFCACHESECTION Section,
+              PINFCACHELINE Line)
+{
+  PINFCACHELINE Current;
+  ULONG Size;
+
+  if (Line->Id > Section->LineByIdSize)
+    {
+      Size = InfpGetIndexSize(Section->LineByIdSize * 2, Line->Id);
+
+      if (Section->LineById != NULL)
+        {
+          FREE (Section->LineById);
+        }
+      Section->LineByIdSize = 0;
+
+      Section->LineById = (PINFCACHELINE *)MALLOC(Size * sizeof(PINFCACHELINE));
+      if (Section->LineById == NULL)
+        {
+          /* Lookups fall back to walking the list */
+          DPRINT("MALLOC() failed\n");
+          return;
+        }
+      ZEROMEMORY (Section->LineById, Size * sizeof(PINFCACHELINE));
+      Section->LineByIdSize = Size;
+
+      for (Current = Section->FirstLine; Current != NULL; Current = Current->Next)
+        {
+          Section->LineById[Current->Id - 1] = Current;
+        }
+
+      return;
+    }
+
+  Section->LineById[Line->Id - 1] = Line;
+}
+
+
 PINFCACHESECTION
 InfpFindSection(PINFCACHE Cache,
                 PCWSTR Name)
@@ -150,6 +426,23 @@ InfpFindSection(PINFCACHE Cache,
       return NULL;
     }
 
+  /* use the name index if we have one */
+  if (Cache->SectionHash != NULL)
+    {
+      Section = Cache->SectionHash[InfpHashName(Name) & (Cache->SectionHashSize - 1)];
+      while (Section != NULL)
+        {
+          if (strcmpiW(Section->Name, Name) == 0)
+            {
+              return Section;
+            }
+
+          Section = Section->HashNext;
+        }
+
+      return NULL;
+    }
+
   /* iterate through list of sections */
   Section = Cache->FirstSection;
   while (Section != NULL)
@@ -209,6 +502,8 @@ InfpAddSection(PINFCACHE Cache,
       Cache->LastSection = Section;
     }
 
+  InfpIndexSection(Cache, Section);
+
   return Section;
 }
 
@@ -248,6 +543,8 @@ InfpAddLine(PINFCACHESECTION Section)
     }
   Section->LineCount++;
 
+  InfpIndexLine(Section, Line);
+
   return Line;
 }
 
@@ -256,6 +553,16 @@ InfpFindSectionById(PINFCACHE Cache, UINT Id)
 {
     PINFCACHESECTION Section;
 
+    if (Cache->SectionById != NULL)
+    {
+        if (Id == 0 || Id > Cache->SectionByIdSize)
+        {
+            return NULL;
+        }
+
+        return Cache->SectionById[Id - 1];
+    }
+
     for (Section = Cache->FirstSection;
          Section != NULL;
          Section = Section->Next)
@@ -293,6 +600,16 @@ InfpFindLineById(PINFCACHESECTION Section, UINT Id)
 {
     PINFCACHELINE Line;
 
+    if (Section->LineById != NULL)
+    {
+        if (Id == 0 || Id > Section->LineByIdSize)
+        {
+            return NULL;
+        }
+
+        return Section->LineById[Id - 1];
+    }
+
     for (Line = Section->FirstLine;
          Line != NULL;
          Line = Line->Next)
@@ -321,7 +638,8 @@ InfpGetLineForContext(PINFCONTEXT Context)
 }
 
 PVOID
-InfpAddKeyToLine(PINFCACHELINE Line,
+InfpAddKeyToLine(PINFCACHESECTION Section,
+                 PINFCACHELINE Line,
                  PCWSTR Key)
 {
   if (Line == NULL)
@@ -345,6 +663,8 @@ InfpAddKeyToLine(PINFCACHELINE Line,
 
   strcpyW(Line->Key, Key);
 
+  InfpIndexKey(Section, Line);
+
   return (PVOID)Line->Key;
 }
 
@@ -392,6 +712,23 @@ InfpFindKeyLine(PINFCACHESECTION Section,
 {
   PINFCACHELINE Line;
 
+  /* use the key index if the section has one */
+  if (Section->KeyHash != NULL)
+    {
+      Line = Section->KeyHash[InfpHashName(Key) & (Section->KeyHashSize - 1)];
+      while (Line != NULL)
+        {
+          if (strcmpiW(Line->Key, Key) == 0)
+            {
+              return Line;
+            }
+
+          Line = Line->HashNext;
+        }
+
+      return NULL;
+    }
+
   Line = Section->FirstLine;
   while (Line != NULL)
     {
@@ -537,7 +874,7 @@ static struct field *add_field_from_token( struct parser *parser, int is_key )
 
   if (is_key)
     {
-      field = InfpAddKeyToLine(parser->line, parser->token);
+      field = InfpAddKeyToLine(parser->cur_section, parser->line, parser->token);
     }
   else
     {
@@ -291,11 +291,7 @@ InfHostCloseFile(HINF InfHandle)
       return;
     }
 
-  while (Cache->FirstSection != NULL)
-    {
-      Cache->FirstSection = InfpFreeSection(Cache->FirstSection);
-    }
-  Cache->LastSection = NULL;
+  InfpFreeCache(Cache);
 
   FREE(Cache);
 }
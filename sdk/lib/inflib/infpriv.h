@@ -26,10 +26,15 @@ typedef struct _INFCACHEFIELD
   WCHAR Data[1];
 } INFCACHEFIELD, *PINFCACHEFIELD;
 
+/* Sections with at least this many lines get a key hash index */
+#define INF_KEY_HASH_MIN_LINES  16
+#define INF_HASH_INITIAL_SIZE   64
+
 typedef struct _INFCACHELINE
 {
   struct _INFCACHELINE *Next;
   struct _INFCACHELINE *Prev;
+  struct _INFCACHELINE *HashNext;
   UINT Id;
 
   LONG FieldCount;
@@ -45,6 +50,7 @@ typedef struct _INFCACHESECTION
 {
   struct _INFCACHESECTION *Next;
   struct _INFCACHESECTION *Prev;
+  struct _INFCACHESECTION *HashNext;
 
   PINFCACHELINE FirstLine;
   PINFCACHELINE LastLine;
@@ -53,6 +59,12 @@ typedef struct _INFCACHESECTION
   LONG LineCount;
   UINT NextLineId;
 
+  PINFCACHELINE *LineById;      /* Lines indexed by Id - 1 */
+  ULONG LineByIdSize;
+  PINFCACHELINE *KeyHash;       /* First line for each key, NULL if not indexed */
+  ULONG KeyHashSize;
+  ULONG KeyCount;
+
   WCHAR Name[1];
 } INFCACHESECTION, *PINFCACHESECTION;
 
@@ -64,6 +76,11 @@ typedef struct _INFCACHE
   UINT NextSectionId;
 
   PINFCACHESECTION StringsSection;
+
+  PINFCACHESECTION *SectionById;   /* Sections indexed by Id - 1 */
+  ULONG SectionByIdSize;
+  PINFCACHESECTION *SectionHash;   /* Sections by name */
+  ULONG SectionHashSize;
 } INFCACHE, *PINFCACHE;
 
 typedef struct _INFCONTEXT
@@ -83,10 +100,12 @@ extern INFSTATUS InfpParseBuffer(PINFCACHE file,
                                  const WCHAR *end,
                                  PULONG error_line);
 extern PINFCACHESECTION InfpFreeSection(PINFCACHESECTION Section);
+extern VOID InfpFreeCache(PINFCACHE Cache);
 extern PINFCACHESECTION InfpAddSection(PINFCACHE Cache,
                                        PCWSTR Name);
 extern PINFCACHELINE InfpAddLine(PINFCACHESECTION Section);
-extern PVOID InfpAddKeyToLine(PINFCACHELINE Line,
+extern PVOID InfpAddKeyToLine(PINFCACHESECTION Section,
+                              PINFCACHELINE Line,
                               PCWSTR Key);
 extern PVOID InfpAddFieldToLine(PINFCACHELINE Line,
                                 PCWSTR Data);
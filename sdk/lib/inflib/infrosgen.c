@@ -342,11 +342,7 @@ InfCloseFile(HINF InfHandle)
       return;
     }
 
-  while (Cache->FirstSection != NULL)
-    {
-      Cache->FirstSection = InfpFreeSection(Cache->FirstSection);
-    }
-  Cache->LastSection = NULL;
+  InfpFreeCache(Cache);
 
   FREE(Cache);
 
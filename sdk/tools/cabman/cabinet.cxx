@@ -26,6 +26,11 @@
 #include "cabinet.h"
 #include "raw.h"
 #include "mszip.h"
+#ifndef CAB_READ_ONLY
+# include <atomic>
+# include <thread>
+# include <vector>
+#endif
 
 #ifndef CAB_READ_ONLY
 
@@ -101,6 +106,11 @@ CCabinet::CCabinet()
     BlockIsSplit = false;
     ScratchFile  = NULL;
 
+    CompressionThreads = 1;
+    PendingBlocks      = NULL;
+    PendingBlockCount  = 0;
+    PendingBlockMax    = 0;
+
     FolderUncompSize = 0;
     BytesLeftInBlock = 0;
     ReuseBlock       = false;
@@ -122,6 +132,8 @@ CCabinet::~CCabinet()
 
     if (CodecSelected)
         delete Codec;
+
+    DestroyPendingBlocks();
 }
 
 bool CCabinet::IsSeparator(char Char)
@@ -761,10 +773,6 @@ ULONG CCabinet::ExtractFile(char* FileName)
     CFDATA CFData;
     ULONG Status;
     bool Skip;
-#if defined(_WIN32)
-    FILETIME FileTime;
-#endif
-    CHAR DestName[PATH_MAX];
     CHAR TempName[PATH_MAX];
 
     Status = LocateFile(FileName, &File);
@@ -776,19 +784,9 @@ ULONG CCabinet::ExtractFile(char* FileName)
 
     LastFileOffset = File->File.FileOffset;
 
-    switch (CurrentFolderNode->Folder.CompressionType & CAB_COMP_MASK)
-    {
-        case CAB_COMP_NONE:
-            SelectCodec(CAB_CODEC_RAW);
-            break;
-
-        case CAB_COMP_MSZIP:
-            SelectCodec(CAB_CODEC_MSZIP);
-            break;
-
-        default:
-            return CAB_STATUS_UNSUPPCOMP;
-    }
+    Status = SelectFolderCodec(CurrentFolderNode);
+    if (Status != CAB_STATUS_SUCCESS)
+        return Status;
 
     DPRINT(MAX_TRACE, ("Extracting file at uncompressed offset (0x%X)  Size (%u bytes)  AO (0x%X)  UO (0x%X).\n",
         (UINT)File->File.FileOffset,
@@ -796,45 +794,9 @@ ULONG CCabinet::ExtractFile(char* FileName)
         (UINT)File->DataBlock->AbsoluteOffset,
         (UINT)File->DataBlock->UncompOffset));
 
-    strcpy(DestName, DestPath);
-    strcat(DestName, FileName);
-
-    /* Create destination file, fail if it already exists */
-    DestFile = fopen(DestName, "rb");
-    if (DestFile != NULL)
-    {
-        fclose(DestFile);
-        /* If file exists, ask to overwrite file */
-        if (OnOverwrite(&File->File, FileName))
-        {
-            DestFile = fopen(DestName, "w+b");
-            if (DestFile == NULL)
-                return CAB_STATUS_CANNOT_CREATE;
-        }
-        else
-            return CAB_STATUS_FILE_EXISTS;
-    }
-    else
-    {
-        DestFile = fopen(DestName, "w+b");
-        if (DestFile == NULL)
-            return CAB_STATUS_CANNOT_CREATE;
-    }
-
-#if defined(_WIN32)
-    if (!DosDateTimeToFileTime(File->File.FileDate, File->File.FileTime, &FileTime))
-    {
-        fclose(DestFile);
-        DPRINT(MIN_TRACE, ("DosDateTimeToFileTime() failed (%u).\n", (UINT)GetLastError()));
-        return CAB_STATUS_CANNOT_WRITE;
-    }
-
-    SetFileTime(DestFile, NULL, &FileTime, NULL);
-#else
-    //DPRINT(MIN_TRACE, ("FIXME: DosDateTimeToFileTime\n"));
-#endif
-
-    SetAttributesOnFile(DestName, File->File.Attributes);
+    Status = CreateDestinationFile(File, FileName, &DestFile);
+    if (Status != CAB_STATUS_SUCCESS)
+        return Status;
 
     Buffer = (PUCHAR)malloc(CAB_BLOCKSIZE + 12); // This should be enough
     if (!Buffer)
@@ -1096,6 +1058,383 @@ ULONG CCabinet::ExtractFile(char* FileName)
     return CAB_STATUS_SUCCESS;
 }
 
+ULONG CCabinet::ExtractAll()
+/*
+ * FUNCTION: Extracts all files matching the search criteria from the cabinet
+ * RETURNS
+ *     Status of operation
+ * NOTES:
+ *     Every folder is read and decompressed only once, files are written
+ *     as their part of the folder goes by. Cabinets spanning several disks
+ *     are extracted file by file instead
+ */
+{
+    PCFFOLDER_NODE FolderNode;
+    PCAB_EXTRACT_FILE Files;
+    CAB_SEARCH Search;
+    PUCHAR Buffer;
+    ULONG Status;
+
+    if ((CABHeader.Flags & (CAB_FLAG_HASPREV | CAB_FLAG_HASNEXT)) != 0)
+    {
+        if (FindFirst(&Search) != CAB_STATUS_SUCCESS)
+            return CAB_STATUS_SUCCESS;
+
+        do
+        {
+            Status = ExtractFile(Search.FileName);
+            if (Status != CAB_STATUS_SUCCESS)
+                return Status;
+        } while (FindNext(&Search) == CAB_STATUS_SUCCESS);
+
+        return CAB_STATUS_SUCCESS;
+    }
+
+    Files = (PCAB_EXTRACT_FILE)malloc(CABHeader.FileCount * sizeof(CAB_EXTRACT_FILE));
+    Buffer = (PUCHAR)malloc(CAB_BLOCKSIZE + 12); // This should be enough
+    if (!Files || !Buffer)
+    {
+        free(Files);
+        free(Buffer);
+        DPRINT(MIN_TRACE, ("Insufficient memory.\n"));
+        return CAB_STATUS_NOMEMORY;
+    }
+
+    Status = CAB_STATUS_SUCCESS;
+    for (FolderNode = FolderListHead; FolderNode != NULL; FolderNode = FolderNode->Next)
+    {
+        Status = ExtractFolder(FolderNode, Files, Buffer);
+        if (Status != CAB_STATUS_SUCCESS)
+            break;
+    }
+
+    free(Buffer);
+    free(Files);
+
+    return Status;
+}
+
+
+static int CompareExtractFiles(const void* A, const void* B)
+{
+    ULONG OffsetA = ((PCAB_EXTRACT_FILE)A)->File->File.FileOffset;
+    ULONG OffsetB = ((PCAB_EXTRACT_FILE)B)->File->File.FileOffset;
+
+    if (OffsetA != OffsetB)
+        return (OffsetA < OffsetB) ? -1 : 1;
+
+    /* qsort isn't stable, so files at the same offset are kept in file table order */
+    ULONG IndexA = ((PCAB_EXTRACT_FILE)A)->TableIndex;
+    ULONG IndexB = ((PCAB_EXTRACT_FILE)B)->TableIndex;
+
+    return (IndexA < IndexB) ? -1 : (IndexA > IndexB);
+}
+
+
+ULONG CCabinet::ExtractFolder(PCFFOLDER_NODE FolderNode,
+                              PCAB_EXTRACT_FILE Files,
+                              PUCHAR Buffer)
+/*
+ * FUNCTION: Extracts the selected files of a folder in one pass
+ * ARGUMENTS:
+ *     FolderNode = Pointer to folder node
+ *     Files      = Pointer to array with room for all files in the cabinet
+ *     Buffer     = Pointer to buffer for one compressed data block
+ * RETURNS
+ *     Status of operation
+ */
+{
+    PCFFILE_NODE FileNode;
+    PCFDATA_NODE DataNode;
+    PCAB_EXTRACT_FILE Current;
+    ULONG FileCount = 0;
+    ULONG TableIndex = 0;
+    ULONG First, Index;
+    ULONG BlockStart, BlockEnd;
+    ULONG FileStart, FileEnd;
+    ULONG Start, End;
+    ULONG BytesRead;
+    ULONG BytesToWrite;
+    ULONG Status = CAB_STATUS_SUCCESS;
+
+    /* Collect the selected files of this folder */
+    for (FileNode = FileListHead; FileNode != NULL; FileNode = FileNode->Next, TableIndex++)
+    {
+        if ((FileNode->File.FileControlID != FolderNode->Index) ||
+            !IsFileSelected(FileNode->FileName))
+        {
+            continue;
+        }
+
+        Files[FileCount].File      = FileNode;
+        Files[FileCount].DestFile  = NULL;
+        Files[FileCount].BytesLeft = FileNode->File.FileSize;
+        Files[FileCount].TableIndex = TableIndex;
+        FileCount++;
+    }
+
+    if (FileCount == 0)
+        return CAB_STATUS_SUCCESS;
+
+    Status = SelectFolderCodec(FolderNode);
+    if (Status != CAB_STATUS_SUCCESS)
+        return Status;
+
+    /* Files are written as the folder is decompressed, so order them by offset */
+    qsort(Files, FileCount, sizeof(CAB_EXTRACT_FILE), CompareExtractFiles);
+
+    /* Empty files don't need any data */
+    for (Index = 0; Index < FileCount; Index++)
+    {
+        if (Files[Index].BytesLeft > 0)
+            continue;
+
+        Status = CreateDestinationFile(Files[Index].File, Files[Index].File->FileName, &Files[Index].DestFile);
+        if (Status != CAB_STATUS_SUCCESS)
+            goto Cleanup;
+
+        OnExtract(&Files[Index].File->File, Files[Index].File->FileName);
+        fclose(Files[Index].DestFile);
+        Files[Index].DestFile = NULL;
+    }
+
+    /* First file that is not completely written yet */
+    First = 0;
+    while ((First < FileCount) && (Files[First].BytesLeft == 0))
+        First++;
+
+    for (DataNode = FolderNode->DataListHead;
+         (DataNode != NULL) && (First < FileCount);
+         DataNode = DataNode->Next)
+    {
+        BlockStart = DataNode->UncompOffset;
+        BlockEnd   = BlockStart + DataNode->Data.UncompSize;
+
+        /* Skip blocks in front of the next file we need */
+        if (BlockEnd <= Files[First].File->File.FileOffset + Files[First].File->File.FileSize - Files[First].BytesLeft)
+            continue;
+
+        if (fseek(FileHandle, (off_t)DataNode->AbsoluteOffset + sizeof(CFDATA), SEEK_SET) != 0)
+        {
+            DPRINT(MIN_TRACE, ("fseek() failed.\n"));
+            Status = CAB_STATUS_INVALID_CAB;
+            goto Cleanup;
+        }
+
+        ASSERT(DataNode->Data.CompSize <= CAB_BLOCKSIZE + 12);
+
+        if (((Status = ReadBlock(Buffer, DataNode->Data.CompSize, &BytesRead)) !=
+            CAB_STATUS_SUCCESS) || (BytesRead != DataNode->Data.CompSize))
+        {
+            DPRINT(MIN_TRACE, ("Cannot read from file (%u).\n", (UINT)Status));
+            Status = CAB_STATUS_INVALID_CAB;
+            goto Cleanup;
+        }
+
+        Status = Codec->Uncompress(OutputBuffer, Buffer, BytesRead, &BytesToWrite);
+        if (Status != CS_SUCCESS)
+        {
+            DPRINT(MID_TRACE, ("Cannot uncompress block.\n"));
+            Status = (Status == CS_NOMEMORY) ? CAB_STATUS_NOMEMORY : CAB_STATUS_INVALID_CAB;
+            goto Cleanup;
+        }
+
+        if (BytesToWrite != DataNode->Data.UncompSize)
+        {
+            DPRINT(MID_TRACE, ("BytesToWrite (%u) != UncompSize (%d)\n",
+                (UINT)BytesToWrite, DataNode->Data.UncompSize));
+            Status = CAB_STATUS_INVALID_CAB;
+            goto Cleanup;
+        }
+
+        /* Hand the block to every file it overlaps */
+        for (Index = First; Index < FileCount; Index++)
+        {
+            Current   = &Files[Index];
+            FileStart = Current->File->File.FileOffset;
+            FileEnd   = FileStart + Current->File->File.FileSize;
+
+            if (FileStart >= BlockEnd)
+                break;
+
+            if (Current->BytesLeft == 0)
+                continue;
+
+            Start = FileEnd - Current->BytesLeft;
+            if (Start < BlockStart)
+                Start = BlockStart;
+            End = (FileEnd < BlockEnd) ? FileEnd : BlockEnd;
+            if (Start >= End)
+                continue;
+
+            if (!Current->DestFile)
+            {
+                Status = CreateDestinationFile(Current->File, Current->File->FileName, &Current->DestFile);
+                if (Status != CAB_STATUS_SUCCESS)
+                    goto Cleanup;
+
+                setvbuf(Current->DestFile, NULL, _IOFBF, CAB_EXTRACT_BUFFER_SIZE);
+
+                /* Call OnExtract event handler */
+                OnExtract(&Current->File->File, Current->File->FileName);
+            }
+
+            if (fwrite((PUCHAR)OutputBuffer + (Start - BlockStart), End - Start, 1, Current->DestFile) < 1)
+            {
+                DPRINT(MIN_TRACE, ("Cannot write to file.\n"));
+                Status = CAB_STATUS_CANNOT_WRITE;
+                goto Cleanup;
+            }
+
+            Current->BytesLeft -= (End - Start);
+            if (Current->BytesLeft == 0)
+            {
+                if (fclose(Current->DestFile) != 0)
+                {
+                    Current->DestFile = NULL;
+                    Status = CAB_STATUS_CANNOT_WRITE;
+                    goto Cleanup;
+                }
+                Current->DestFile = NULL;
+            }
+        }
+
+        while ((First < FileCount) && (Files[First].BytesLeft == 0))
+            First++;
+    }
+
+    /* The folder ended before all files were complete */
+    if (First < FileCount)
+    {
+        DPRINT(MIN_TRACE, ("Folder (%u) is truncated.\n", (UINT)FolderNode->Index));
+        Status = CAB_STATUS_INVALID_CAB;
+    }
+
+Cleanup:
+    for (Index = 0; Index < FileCount; Index++)
+    {
+        if (Files[Index].DestFile)
+            fclose(Files[Index].DestFile);
+    }
+
+    return Status;
+}
+
+
+ULONG CCabinet::CreateDestinationFile(PCFFILE_NODE File,
+                                      char* FileName,
+                                      FILE** DestFile)
+/*
+ * FUNCTION: Creates the destination file for a file being extracted
+ * ARGUMENTS:
+ *     File     = Pointer to file node
+ *     FileName = Pointer to buffer with name of file
+ *     DestFile = Address of pointer to receive the opened file
+ * RETURNS
+ *     Status of operation
+ */
+{
+#if defined(_WIN32)
+    FILETIME FileTime;
+#endif
+    CHAR DestName[PATH_MAX];
+
+    strcpy(DestName, DestPath);
+    strcat(DestName, FileName);
+
+    /* Create destination file, fail if it already exists */
+    *DestFile = fopen(DestName, "rb");
+    if (*DestFile != NULL)
+    {
+        fclose(*DestFile);
+        /* If file exists, ask to overwrite file */
+        if (OnOverwrite(&File->File, FileName))
+        {
+            *DestFile = fopen(DestName, "w+b");
+            if (*DestFile == NULL)
+                return CAB_STATUS_CANNOT_CREATE;
+        }
+        else
+            return CAB_STATUS_FILE_EXISTS;
+    }
+    else
+    {
+        *DestFile = fopen(DestName, "w+b");
+        if (*DestFile == NULL)
+            return CAB_STATUS_CANNOT_CREATE;
+    }
+
+#if defined(_WIN32)
+    if (!DosDateTimeToFileTime(File->File.FileDate, File->File.FileTime, &FileTime))
+    {
+        fclose(*DestFile);
+        *DestFile = NULL;
+        DPRINT(MIN_TRACE, ("DosDateTimeToFileTime() failed (%u).\n", (UINT)GetLastError()));
+        return CAB_STATUS_CANNOT_WRITE;
+    }
+
+    SetFileTime(*DestFile, NULL, &FileTime, NULL);
+#else
+    //DPRINT(MIN_TRACE, ("FIXME: DosDateTimeToFileTime\n"));
+#endif
+
+    SetAttributesOnFile(DestName, File->File.Attributes);
+
+    return CAB_STATUS_SUCCESS;
+}
+
+
+bool CCabinet::IsFileSelected(char* FileName)
+/*
+ * FUNCTION: Checks whether a file matches the search criteria
+ * ARGUMENTS:
+ *     FileName = Pointer to string with name of file
+ * RETURNS:
+ *     true if there are no search criteria or one of them matches
+ */
+{
+    PSEARCH_CRITERIA Criteria;
+
+    if (!CriteriaListHead)
+        return true;
+
+    for (Criteria = CriteriaListHead; Criteria != NULL; Criteria = Criteria->Next)
+    {
+        if (MatchFileNamePattern(FileName, Criteria->Search))
+            return true;
+    }
+
+    return false;
+}
+
+
+ULONG CCabinet::SelectFolderCodec(PCFFOLDER_NODE FolderNode)
+/*
+ * FUNCTION: Selects the codec needed to decompress a folder
+ * ARGUMENTS:
+ *     FolderNode = Pointer to folder node
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    switch (FolderNode->Folder.CompressionType & CAB_COMP_MASK)
+    {
+        case CAB_COMP_NONE:
+            SelectCodec(CAB_CODEC_RAW);
+            break;
+
+        case CAB_COMP_MSZIP:
+            SelectCodec(CAB_CODEC_MSZIP);
+            break;
+
+        default:
+            return CAB_STATUS_UNSUPPCOMP;
+    }
+
+    return CAB_STATUS_SUCCESS;
+}
+
+
 bool CCabinet::IsCodecSelected()
 /*
  * FUNCTION: Returns the value of CodecSelected
@@ -1122,22 +1461,35 @@ void CCabinet::SelectCodec(LONG Id)
         delete Codec;
     }
 
+    Codec = CreateCodec(Id);
+    if (!Codec)
+        return;
+
+    CodecId       = Id;
+    CodecSelected = true;
+}
+
+
+CCABCodec* CCabinet::CreateCodec(LONG Id)
+/*
+ * FUNCTION: Creates a new instance of a codec engine
+ * ARGUMENTS:
+ *     Id = Codec identifier
+ * RETURNS:
+ *     Pointer to codec, NULL if the codec is not supported
+ */
+{
     switch (Id)
     {
         case CAB_CODEC_RAW:
-            Codec = new CRawCodec();
-            break;
+            return new CRawCodec();
 
         case CAB_CODEC_MSZIP:
-            Codec = new CMSZipCodec();
-            break;
+            return new CMSZipCodec();
 
         default:
-            return;
+            return NULL;
     }
-
-    CodecId       = Id;
-    CodecSelected = true;
 }
 
 
@@ -1165,6 +1517,7 @@ ULONG CCabinet::NewCabinet()
     }
     CurrentIBuffer     = InputBuffer;
     CurrentIBufferSize = 0;
+    CurrentOBufferSize = 0;
 
     CABHeader.Signature     = CAB_SIGNATURE;
     CABHeader.Reserved1     = 0;            // Not used
@@ -1223,6 +1576,13 @@ ULONG CCabinet::NewDisk()
  *     Status of operation
  */
 {
+    ULONG Status;
+
+    /* Pending blocks belong to the previous disk */
+    Status = FlushDataBlocks();
+    if (Status != CAB_STATUS_SUCCESS)
+        return Status;
+
     // NextFolderNumber is 0-based
     NextFolderNumber = 1;
 
@@ -1247,6 +1607,13 @@ ULONG CCabinet::NewFolder()
  *     Status of operation
  */
 {
+    ULONG Status;
+
+    /* Pending blocks belong to the previous folder */
+    Status = FlushDataBlocks();
+    if (Status != CAB_STATUS_SUCCESS)
+        return Status;
+
     DPRINT(MAX_TRACE, ("Creating new folder.\n"));
 
     CurrentFolderNode = NewFolderNode();
@@ -1497,6 +1864,11 @@ ULONG CCabinet::CommitDisk(ULONG MoreDisks)
     PCFFOLDER_NODE FolderNode;
     ULONG Status;
 
+    /* Write out the blocks still being compressed */
+    Status = FlushDataBlocks();
+    if (Status != CAB_STATUS_SUCCESS)
+        return Status;
+
     OnCabinetName(CurrentDiskNumber, CabinetName);
 
     /* Create file, fail if it already exists */
@@ -1585,6 +1957,8 @@ ULONG CCabinet::CloseCabinet()
 
     DestroyFolderNodes();
 
+    DestroyPendingBlocks();
+
     if (InputBuffer)
     {
         free(InputBuffer);
@@ -1836,9 +2210,30 @@ void CCabinet::SetMaxDiskSize(ULONG Size)
  *     Size = Maximum size of current disk (0 means no maximum size)
  */
 {
+    /* Blocks are only queued while the disk size is unlimited */
+    if (Size > 0)
+        FlushDataBlocks();
+
     MaxDiskSize = Size;
 }
 
+
+void CCabinet::SetCompressionThreads(ULONG Count)
+/*
+ * FUNCTION: Sets the number of threads used to compress data blocks
+ * ARGUMENTS:
+ *     Count = Number of threads (0 means one per processor)
+ */
+{
+    FlushDataBlocks();
+    DestroyPendingBlocks();
+
+    if (Count == 0)
+        Count = std::thread::hardware_concurrency();
+
+    CompressionThreads = (Count > 0) ? Count : 1;
+}
+
 #endif /* CAB_READ_ONLY */
 
 
@@ -2983,8 +3378,13 @@ ULONG CCabinet::WriteDataBlock()
  */
 {
     ULONG Status;
-    ULONG BytesWritten;
-    PCFDATA_NODE DataNode;
+
+    /* Let the worker threads compress the block if nothing depends on its size yet */
+    if ((CompressionThreads > 1) && (MaxDiskSize == 0) &&
+        (!BlockIsSplit) && (CurrentOBufferSize == 0))
+    {
+        return QueueDataBlock();
+    }
 
     if (!BlockIsSplit)
     {
@@ -3000,6 +3400,21 @@ ULONG CCabinet::WriteDataBlock()
         CurrentOBufferSize = TotalCompSize;
     }
 
+    return StoreDataBlock();
+}
+
+
+ULONG CCabinet::StoreDataBlock()
+/*
+ * FUNCTION: Writes the compressed data block to the scratch file
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    ULONG Status;
+    ULONG BytesWritten;
+    PCFDATA_NODE DataNode;
+
     DataNode = NewDataNode(CurrentFolderNode);
     if (!DataNode)
     {
@@ -3062,6 +3477,178 @@ ULONG CCabinet::WriteDataBlock()
     return CAB_STATUS_SUCCESS;
 }
 
+ULONG CCabinet::QueueDataBlock()
+/*
+ * FUNCTION: Queues the current data block for compression on a worker thread
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    PCAB_PENDING_BLOCK Block;
+    ULONG i;
+
+    if (!PendingBlocks)
+    {
+        PendingBlockMax = CompressionThreads * CAB_BLOCKS_PER_THREAD;
+        PendingBlocks = (PCAB_PENDING_BLOCK)calloc(PendingBlockMax, sizeof(CAB_PENDING_BLOCK));
+        if (!PendingBlocks)
+        {
+            DPRINT(MIN_TRACE, ("Insufficient memory.\n"));
+            return CAB_STATUS_NOMEMORY;
+        }
+
+        for (i = 0; i < PendingBlockMax; i++)
+        {
+            PendingBlocks[i].InputBuffer  = malloc(CAB_BLOCKSIZE + 12);
+            PendingBlocks[i].OutputBuffer = malloc(CAB_BLOCKSIZE + 12);
+            if (!PendingBlocks[i].InputBuffer || !PendingBlocks[i].OutputBuffer)
+            {
+                DPRINT(MIN_TRACE, ("Insufficient memory.\n"));
+                DestroyPendingBlocks();
+                return CAB_STATUS_NOMEMORY;
+            }
+        }
+    }
+
+    /* Take over the input buffer, keeping the one of the pending block for reading */
+    Block = &PendingBlocks[PendingBlockCount++];
+    memcpy(Block->InputBuffer, InputBuffer, CurrentIBufferSize);
+    Block->InputSize = CurrentIBufferSize;
+
+    CurrentIBufferSize = 0;
+    CurrentIBuffer     = InputBuffer;
+
+    if (PendingBlockCount == PendingBlockMax)
+        return FlushDataBlocks();
+
+    return CAB_STATUS_SUCCESS;
+}
+
+
+void CCabinet::CompressPendingBlocks()
+/*
+ * FUNCTION: Compresses all pending data blocks using the worker threads
+ */
+{
+    std::vector<std::thread> Workers;
+    std::atomic<ULONG> NextBlock(0);
+    ULONG ThreadCount;
+    ULONG i;
+
+    ThreadCount = (PendingBlockCount < CompressionThreads) ? PendingBlockCount : CompressionThreads;
+
+    /* Each worker uses its own codec, they keep state while compressing */
+    auto Worker = [this, &NextBlock]()
+    {
+        CCABCodec* WorkerCodec = CreateCodec(CodecId);
+        ULONG Index;
+
+        while ((Index = NextBlock++) < PendingBlockCount)
+        {
+            PCAB_PENDING_BLOCK Block = &PendingBlocks[Index];
+
+            if (!WorkerCodec)
+            {
+                Block->Status = CS_NOMEMORY;
+                continue;
+            }
+
+            Block->Status = WorkerCodec->Compress(Block->OutputBuffer,
+                                                  Block->InputBuffer,
+                                                  Block->InputSize,
+                                                  &Block->OutputSize);
+        }
+
+        delete WorkerCodec;
+    };
+
+    /* The calling thread is one of the workers */
+    for (i = 1; i < ThreadCount; i++)
+        Workers.push_back(std::thread(Worker));
+
+    Worker();
+
+    for (i = 0; i < Workers.size(); i++)
+        Workers[i].join();
+}
+
+
+ULONG CCabinet::FlushDataBlocks()
+/*
+ * FUNCTION: Compresses all pending data blocks and writes them,
+ *           in order, to the scratch file
+ * RETURNS:
+ *     Status of operation
+ */
+{
+    void* SavedIBuffer;
+    ULONG SavedIBufferSize;
+    ULONG Status = CAB_STATUS_SUCCESS;
+    ULONG i;
+
+    if (PendingBlockCount == 0)
+        return CAB_STATUS_SUCCESS;
+
+    CompressPendingBlocks();
+
+    /* Keep the partially filled input block */
+    SavedIBuffer     = CurrentIBuffer;
+    SavedIBufferSize = CurrentIBufferSize;
+
+    for (i = 0; i < PendingBlockCount; i++)
+    {
+        if (PendingBlocks[i].Status != CS_SUCCESS)
+        {
+            DPRINT(MIN_TRACE, ("Cannot compress data block (%u).\n", (UINT)PendingBlocks[i].Status));
+            Status = CAB_STATUS_NOMEMORY;
+            break;
+        }
+
+        DPRINT(MAX_TRACE, ("Block compressed. CurrentIBufferSize (%u)  TotalCompSize(%u).\n",
+            (UINT)PendingBlocks[i].InputSize, (UINT)PendingBlocks[i].OutputSize));
+
+        /* Store the block as if it was just compressed */
+        CurrentIBufferSize = PendingBlocks[i].InputSize;
+        CurrentOBuffer     = PendingBlocks[i].OutputBuffer;
+        CurrentOBufferSize = PendingBlocks[i].OutputSize;
+        TotalCompSize      = PendingBlocks[i].OutputSize;
+
+        Status = StoreDataBlock();
+        if (Status != CAB_STATUS_SUCCESS)
+            break;
+    }
+
+    PendingBlockCount  = 0;
+    CurrentIBuffer     = SavedIBuffer;
+    CurrentIBufferSize = SavedIBufferSize;
+
+    return Status;
+}
+
+
+void CCabinet::DestroyPendingBlocks()
+/*
+ * FUNCTION: Frees the buffers of the pending data blocks
+ */
+{
+    ULONG i;
+
+    if (!PendingBlocks)
+        return;
+
+    for (i = 0; i < PendingBlockMax; i++)
+    {
+        free(PendingBlocks[i].InputBuffer);
+        free(PendingBlocks[i].OutputBuffer);
+    }
+
+    free(PendingBlocks);
+    PendingBlocks     = NULL;
+    PendingBlockCount = 0;
+    PendingBlockMax   = 0;
+}
+
+
 #if !defined(_WIN32)
 
 void CCabinet::ConvertDateAndTime(time_t* Time,
@@ -293,6 +293,36 @@ public:
 
 
 
+/* File being written while streaming through a folder */
+typedef struct _CAB_EXTRACT_FILE
+{
+    PCFFILE_NODE File;
+    FILE* DestFile;
+    ULONG BytesLeft;
+    ULONG TableIndex;   // Position of the file in the cabinet's file table
+} CAB_EXTRACT_FILE, *PCAB_EXTRACT_FILE;
+
+/* Size of the write buffer of each file extracted in one pass */
+#define CAB_EXTRACT_BUFFER_SIZE (1024 * 1024)
+
+#ifndef CAB_READ_ONLY
+
+/* Data block waiting to be compressed by a worker thread */
+typedef struct _CAB_PENDING_BLOCK
+{
+    void* InputBuffer;
+    void* OutputBuffer;
+    ULONG InputSize;
+    ULONG OutputSize;
+    ULONG Status;
+} CAB_PENDING_BLOCK, *PCAB_PENDING_BLOCK;
+
+/* Number of pending data blocks per compression thread */
+#define CAB_BLOCKS_PER_THREAD 4
+
+#endif /* CAB_READ_ONLY */
+
+
 /* Classes */
 
 #ifndef CAB_READ_ONLY
@@ -359,6 +389,8 @@ public:
     ULONG FindNext(PCAB_SEARCH Search);
     /* Extracts a file from the current cabinet file */
     ULONG ExtractFile(char* FileName);
+    /* Extracts all files matching the search criteria, reading each folder only once */
+    ULONG ExtractAll();
     /* Select codec engine to use */
     void SelectCodec(LONG Id);
     /* Returns whether a codec engine is selected */
@@ -395,6 +427,8 @@ public:
     ULONG AddFile(char* FileName);
     /* Sets the maximum size of the current disk */
     void SetMaxDiskSize(ULONG Size);
+    /* Sets the number of threads used to compress data blocks */
+    void SetCompressionThreads(ULONG Count);
 #endif /* CAB_READ_ONLY */
 
     /* Default event handlers */
@@ -417,6 +451,10 @@ private:
     PCFFOLDER_NODE LocateFolderNode(ULONG Index);
     ULONG GetAbsoluteOffset(PCFFILE_NODE File);
     ULONG LocateFile(char* FileName, PCFFILE_NODE *File);
+    ULONG CreateDestinationFile(PCFFILE_NODE File, char* FileName, FILE** DestFile);
+    bool IsFileSelected(char* FileName);
+    ULONG SelectFolderCodec(PCFFOLDER_NODE FolderNode);
+    ULONG ExtractFolder(PCFFOLDER_NODE FolderNode, PCAB_EXTRACT_FILE Files, PUCHAR Buffer);
     ULONG ReadString(char* String, LONG MaxLength);
     ULONG ReadFileTable();
     ULONG ReadDataBlocks(PCFFOLDER_NODE FolderNode);
@@ -431,6 +469,7 @@ private:
     ULONG ComputeChecksum(void* Buffer, ULONG Size, ULONG Seed);
     ULONG ReadBlock(void* Buffer, ULONG Size, PULONG BytesRead);
     bool MatchFileNamePattern(char* FileName, char* Pattern);
+    CCABCodec* CreateCodec(LONG Id);
 #ifndef CAB_READ_ONLY
     ULONG InitCabinetHeader();
     ULONG WriteCabinetHeader(bool MoreDisks);
@@ -438,6 +477,11 @@ private:
     ULONG WriteFileEntries();
     ULONG CommitDataBlocks(PCFFOLDER_NODE FolderNode);
     ULONG WriteDataBlock();
+    ULONG StoreDataBlock();
+    ULONG QueueDataBlock();
+    ULONG FlushDataBlocks();
+    void CompressPendingBlocks();
+    void DestroyPendingBlocks();
     ULONG GetAttributesOnFile(PCFFILE_NODE File);
     ULONG SetAttributesOnFile(char* FileName, USHORT FileAttributes);
     ULONG GetFileTimes(FILE* FileHandle, PCFFILE_NODE File);
@@ -503,6 +547,10 @@ private:
     ULONG TotalBytesLeft;
     bool BlockIsSplit;                  // true if current data block is split
     ULONG NextFolderNumber;     // Zero based folder number
+    ULONG CompressionThreads;   // Number of threads compressing data blocks
+    PCAB_PENDING_BLOCK PendingBlocks;   // Data blocks waiting for compression
+    ULONG PendingBlockCount;
+    ULONG PendingBlockMax;
 #endif /* CAB_READ_ONLY */
 };
 
@@ -192,8 +192,8 @@ void CCABManager::Usage()
 {
     printf("ReactOS Cabinet Manager\n\n");
     printf("CABMAN [-D | -E] [-A] [-L dir] cabinet [filename ...]\n");
-    printf("CABMAN [-M mode] -C dirfile [-I] [-RC file] [-P dir]\n");
-    printf("CABMAN [-M mode] -S cabinet filename [...]\n");
+    printf("CABMAN [-M mode] [-J n] -C dirfile [-I] [-RC file] [-P dir]\n");
+    printf("CABMAN [-M mode] [-J n] -S cabinet filename [...]\n");
     printf("  cabinet   Cabinet file.\n");
     printf("  filename  Name of the file to add to or extract from the cabinet.\n");
     printf("            Wild cards and multiple filenames\n");
@@ -207,6 +207,8 @@ void CCABManager::Usage()
     printf("  -D        Display cabinet directory.\n");
     printf("  -E        Extract files from cabinet.\n");
     printf("  -I        Don't create the cabinet, only the .inf file.\n");
+    printf("  -J n      Compress data blocks using n threads\n");
+    printf("            (0 means one per processor, default is 1).\n");
     printf("  -L dir    Location to place extracted or generated files\n");
     printf("            (default is current directory).\n");
     printf("  -M mode   Specify the compression method to use:\n");
@@ -267,6 +269,23 @@ bool CCABManager::ParseCmdline(int argc, char* argv[])
                     InfFileOnly = true;
                     break;
 
+                case 'j':
+                case 'J':
+                    if (argv[i][2] == 0)
+                    {
+                        i++;
+                        if (i >= argc)
+                        {
+                            printf("ERROR: Missing thread count.\n");
+                            return false;
+                        }
+                        SetCompressionThreads(strtoul(&argv[i][0], NULL, 10));
+                    }
+                    else
+                        SetCompressionThreads(strtoul(&argv[i][2], NULL, 10));
+
+                    break;
+
                 case 'l':
                 case 'L':
                     if (argv[i][2] == 0)
@@ -499,7 +518,6 @@ bool CCABManager::ExtractFromCabinet()
  */
 {
     bool bRet = true;
-    CAB_SEARCH Search;
     ULONG Status;
 
     if (Open() == CAB_STATUS_SUCCESS)
@@ -509,43 +527,34 @@ bool CCABManager::ExtractFromCabinet()
             printf("Cabinet %s\n\n", GetCabinetName());
         }
 
-        if (FindFirst(&Search) == CAB_STATUS_SUCCESS)
+        switch (Status = ExtractAll())
         {
-            do
-            {
-                switch (Status = ExtractFile(Search.FileName))
-                {
-                    case CAB_STATUS_SUCCESS:
-                        break;
-
-                    case CAB_STATUS_INVALID_CAB:
-                        printf("ERROR: Cabinet contains errors.\n");
-                        bRet = false;
-                        break;
-
-                    case CAB_STATUS_UNSUPPCOMP:
-                        printf("ERROR: Cabinet uses unsupported compression type.\n");
-                        bRet = false;
-                        break;
-
-                    case CAB_STATUS_CANNOT_WRITE:
-                        printf("ERROR: You've run out of free space on the destination volume or the volume is damaged.\n");
-                        bRet = false;
-                        break;
-
-                    default:
-                        printf("ERROR: Unspecified error code (%u).\n", (UINT)Status);
-                        bRet = false;
-                        break;
-                }
-
-                if(!bRet)
-                    break;
-            } while (FindNext(&Search) == CAB_STATUS_SUCCESS);
-
-            DestroySearchCriteria();
+            case CAB_STATUS_SUCCESS:
+                break;
+
+            case CAB_STATUS_INVALID_CAB:
+                printf("ERROR: Cabinet contains errors.\n");
+                bRet = false;
+                break;
+
+            case CAB_STATUS_UNSUPPCOMP:
+                printf("ERROR: Cabinet uses unsupported compression type.\n");
+                bRet = false;
+                break;
+
+            case CAB_STATUS_CANNOT_WRITE:
+                printf("ERROR: You've run out of free space on the destination volume or the volume is damaged.\n");
+                bRet = false;
+                break;
+
+            default:
+                printf("ERROR: Unspecified error code (%u).\n", (UINT)Status);
+                bRet = false;
+                break;
         }
 
+        DestroySearchCriteria();
+
         return bRet;
     }
     else
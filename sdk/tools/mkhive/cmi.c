@@ -194,7 +194,7 @@ CmiCreateSecurityKey(
     return STATUS_SUCCESS;
 }
 
-static NTSTATUS
+NTSTATUS
 CmiCreateSubKey(
     IN PCMHIVE RegistryHive,
     IN HCELL_INDEX ParentKeyCellOffset,
@@ -294,21 +294,13 @@ CmiCreateSubKey(
 }
 
 NTSTATUS
-CmiAddSubKey(
+CmiLinkSubKey(
     IN PCMHIVE RegistryHive,
     IN HCELL_INDEX ParentKeyCellOffset,
-    IN PCUNICODE_STRING SubKeyName,
-    IN BOOLEAN VolatileKey,
-    OUT HCELL_INDEX *pBlockOffset)
+    IN HCELL_INDEX NKBOffset,
+    IN PCUNICODE_STRING SubKeyName)
 {
     PCM_KEY_NODE ParentKeyCell;
-    HCELL_INDEX NKBOffset;
-    NTSTATUS Status;
-
-    /* Create the new key */
-    Status = CmiCreateSubKey(RegistryHive, ParentKeyCellOffset, SubKeyName, VolatileKey, &NKBOffset);
-    if (!NT_SUCCESS(Status))
-        return Status;
 
     /* Mark the parent cell as dirty */
     HvMarkCellDirty(&RegistryHive->Hive, ParentKeyCellOffset, FALSE);
@@ -340,6 +332,30 @@ CmiAddSubKey(
     /* Release the cell */
     HvReleaseCell(&RegistryHive->Hive, ParentKeyCellOffset);
 
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+CmiAddSubKey(
+    IN PCMHIVE RegistryHive,
+    IN HCELL_INDEX ParentKeyCellOffset,
+    IN PCUNICODE_STRING SubKeyName,
+    IN BOOLEAN VolatileKey,
+    OUT HCELL_INDEX *pBlockOffset)
+{
+    HCELL_INDEX NKBOffset;
+    NTSTATUS Status;
+
+    /* Create the new key */
+    Status = CmiCreateSubKey(RegistryHive, ParentKeyCellOffset, SubKeyName, VolatileKey, &NKBOffset);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
+    /* Add it to the index of its parent */
+    Status = CmiLinkSubKey(RegistryHive, ParentKeyCellOffset, NKBOffset, SubKeyName);
+    if (!NT_SUCCESS(Status))
+        return Status;
+
     *pBlockOffset = NKBOffset;
     return STATUS_SUCCESS;
 }
@@ -40,6 +40,21 @@ CmiCreateSecurityKey(
     IN PUCHAR Descriptor,
     IN ULONG DescriptorLength);
 
+NTSTATUS
+CmiCreateSubKey(
+    IN PCMHIVE RegistryHive,
+    IN HCELL_INDEX ParentKeyCellOffset,
+    IN PCUNICODE_STRING SubKeyName,
+    IN BOOLEAN VolatileKey,
+    OUT HCELL_INDEX* pNKBOffset);
+
+NTSTATUS
+CmiLinkSubKey(
+    IN PCMHIVE RegistryHive,
+    IN HCELL_INDEX ParentKeyCellOffset,
+    IN HCELL_INDEX NKBOffset,
+    IN PCUNICODE_STRING SubKeyName);
+
 NTSTATUS
 CmiAddSubKey(
     IN PCMHIVE RegistryHive,
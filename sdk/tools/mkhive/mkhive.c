@@ -162,12 +162,14 @@ int main(int argc, char *argv[])
     ret = -1;
 
     /* Now we should have the list of INF files: parse it */
+    RegSetBulkLoadMode(TRUE);
     for (; i < argc; ++i)
     {
         convert_path(FileName, argv[i]);
         if (!ImportRegistryFile(FileName))
             goto Quit;
     }
+    RegSetBulkLoadMode(FALSE);
 
     for (i = 0; i < MAX_NUMBER_OF_REGISTRY_HIVES; ++i)
     {
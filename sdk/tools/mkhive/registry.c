@@ -51,6 +51,57 @@ typedef struct _MEMKEY
 #define HKEY_TO_MEMKEY(hKey) ((PMEMKEY)(hKey))
 #define MEMKEY_TO_HKEY(memKey) ((HKEY)(memKey))
 
+/*
+ * Cache of the path resolved by the last RegpCreateOrOpenKey() call.
+ * INF files add many values to neighbouring keys, so most lookups
+ * share a long prefix with the previous one.
+ */
+#define KEY_PATH_CACHE_LENGTH   512
+#define KEY_PATH_CACHE_DEPTH    64
+
+typedef struct _KEY_PATH_COMPONENT
+{
+    ULONG NameEnd; /* Index in Path of the character following the name */
+    PCMHIVE RegistryHive;
+    HCELL_INDEX KeyCellOffset;
+} KEY_PATH_COMPONENT, *PKEY_PATH_COMPONENT;
+
+typedef struct _KEY_PATH_CACHE
+{
+    PCMHIVE StartHive;
+    HCELL_INDEX StartCellOffset;
+    ULONG Depth;
+    ULONG PathLength;
+    WCHAR Path[KEY_PATH_CACHE_LENGTH];
+    KEY_PATH_COMPONENT Components[KEY_PATH_CACHE_DEPTH];
+} KEY_PATH_CACHE, *PKEY_PATH_CACHE;
+
+static KEY_PATH_CACHE KeyPathCache;
+
+/*
+ * In bulk-load mode, new subkeys are not inserted into the index of their
+ * parent one at a time. They are kept in a hash table until the mode is
+ * left, then sorted and added to their parents' index in a single pass.
+ */
+#define PENDING_SUBKEY_HASH_BITS    16
+#define PENDING_SUBKEY_HASH_SIZE    (1 << PENDING_SUBKEY_HASH_BITS)
+
+typedef struct _PENDING_SUBKEY
+{
+    struct _PENDING_SUBKEY *HashNext;
+    PCMHIVE RegistryHive;
+    HCELL_INDEX ParentCellOffset;
+    HCELL_INDEX KeyCellOffset;
+    UNICODE_STRING Name;
+    WCHAR NameBuffer[ANYSIZE_ARRAY];
+} PENDING_SUBKEY, *PPENDING_SUBKEY;
+
+static BOOL BulkLoadMode = FALSE;
+static PPENDING_SUBKEY PendingSubKeyHash[PENDING_SUBKEY_HASH_SIZE];
+static PPENDING_SUBKEY *PendingSubKeys = NULL;
+static ULONG PendingSubKeyCount = 0;
+static ULONG PendingSubKeyMax = 0;
+
 static CMHIVE RootHive;
 static PMEMKEY RootKey;
 
@@ -385,6 +436,218 @@ CreateInMemoryStructure(
 LIST_ENTRY CmiHiveListHead;
 LIST_ENTRY CmiReparsePointsHead;
 
+static VOID
+RegpInvalidateKeyPathCache(VOID)
+{
+    KeyPathCache.Depth = 0;
+}
+
+static BOOL
+RegpMatchKeyPathCache(
+    IN PCWSTR KeyName,
+    IN ULONG Depth)
+{
+    ULONG i, End;
+
+    if (Depth == 0)
+    {
+        i = 0;
+    }
+    else
+    {
+        /* Stop at the end of the new path */
+        i = KeyPathCache.Components[Depth - 1].NameEnd;
+        if (KeyName[i] == UNICODE_NULL)
+            return FALSE;
+        i++;
+    }
+    End = KeyPathCache.Components[Depth].NameEnd;
+
+    for (; i < End; i++)
+    {
+        if (KeyName[i] == KeyPathCache.Path[i])
+            continue;
+
+        if (KeyName[i] == UNICODE_NULL ||
+            RtlUpcaseUnicodeChar(KeyName[i]) != RtlUpcaseUnicodeChar(KeyPathCache.Path[i]))
+        {
+            return FALSE;
+        }
+    }
+
+    return (KeyName[End] == UNICODE_NULL || KeyName[End] == OBJ_NAME_PATH_SEPARATOR);
+}
+
+static LONG
+RegpCompareKeyNames(
+    IN PCUNICODE_STRING Name1,
+    IN PCUNICODE_STRING Name2)
+{
+    USHORT i, Length;
+    WCHAR c1, c2;
+
+    /* Same ordering as CmpCompareCompressedName() */
+    Length = min(Name1->Length, Name2->Length) / sizeof(WCHAR);
+    for (i = 0; i < Length; i++)
+    {
+        c1 = RtlUpcaseUnicodeChar(Name1->Buffer[i]);
+        c2 = RtlUpcaseUnicodeChar(Name2->Buffer[i]);
+        if (c1 != c2)
+            return (LONG)c1 - (LONG)c2;
+    }
+
+    return (LONG)Name1->Length - (LONG)Name2->Length;
+}
+
+static ULONG
+RegpHashPendingSubKey(
+    IN PCMHIVE RegistryHive,
+    IN HCELL_INDEX ParentCellOffset,
+    IN PCUNICODE_STRING Name)
+{
+    ULONG Hash;
+
+    /* Cell offsets are aligned, so mix all the bits into the bucket index */
+    Hash = CmpComputeHashKey(0, Name, FALSE);
+    Hash ^= (ULONG)(ULONG_PTR)RegistryHive ^ (ParentCellOffset * 37);
+    return (Hash * 0x9E3779B1) >> (32 - PENDING_SUBKEY_HASH_BITS);
+}
+
+static HCELL_INDEX
+RegpFindPendingSubKey(
+    IN PCMHIVE RegistryHive,
+    IN HCELL_INDEX ParentCellOffset,
+    IN PCUNICODE_STRING Name)
+{
+    PPENDING_SUBKEY PendingSubKey;
+
+    PendingSubKey = PendingSubKeyHash[RegpHashPendingSubKey(RegistryHive, ParentCellOffset, Name)];
+    while (PendingSubKey)
+    {
+        if (PendingSubKey->RegistryHive == RegistryHive &&
+            PendingSubKey->ParentCellOffset == ParentCellOffset &&
+            RegpCompareKeyNames(&PendingSubKey->Name, Name) == 0)
+        {
+            return PendingSubKey->KeyCellOffset;
+        }
+
+        PendingSubKey = PendingSubKey->HashNext;
+    }
+
+    return HCELL_NIL;
+}
+
+static NTSTATUS
+RegpCreatePendingSubKey(
+    IN PCMHIVE RegistryHive,
+    IN HCELL_INDEX ParentCellOffset,
+    IN PCUNICODE_STRING Name,
+    IN BOOL Volatile,
+    OUT HCELL_INDEX *pBlockOffset)
+{
+    NTSTATUS Status;
+    PPENDING_SUBKEY PendingSubKey;
+    PPENDING_SUBKEY *NewPendingSubKeys;
+    ULONG Bucket;
+
+    /* Grow the list of pending subkeys if needed */
+    if (PendingSubKeyCount >= PendingSubKeyMax)
+    {
+        NewPendingSubKeys = (PPENDING_SUBKEY*)realloc(PendingSubKeys,
+                                                      (PendingSubKeyMax + 1024) * sizeof(PPENDING_SUBKEY));
+        if (!NewPendingSubKeys)
+            return STATUS_NO_MEMORY;
+
+        PendingSubKeys = NewPendingSubKeys;
+        PendingSubKeyMax += 1024;
+    }
+
+    PendingSubKey = (PPENDING_SUBKEY)malloc(FIELD_OFFSET(PENDING_SUBKEY, NameBuffer) + Name->Length);
+    if (!PendingSubKey)
+        return STATUS_NO_MEMORY;
+
+    /* Create the key, but leave the index of the parent alone */
+    Status = CmiCreateSubKey(RegistryHive,
+                             ParentCellOffset,
+                             Name,
+                             Volatile,
+                             &PendingSubKey->KeyCellOffset);
+    if (!NT_SUCCESS(Status))
+    {
+        free(PendingSubKey);
+        return Status;
+    }
+
+    PendingSubKey->RegistryHive = RegistryHive;
+    PendingSubKey->ParentCellOffset = ParentCellOffset;
+    memcpy(PendingSubKey->NameBuffer, Name->Buffer, Name->Length);
+    PendingSubKey->Name.Buffer = PendingSubKey->NameBuffer;
+    PendingSubKey->Name.Length = PendingSubKey->Name.MaximumLength = Name->Length;
+
+    Bucket = RegpHashPendingSubKey(RegistryHive, ParentCellOffset, Name);
+    PendingSubKey->HashNext = PendingSubKeyHash[Bucket];
+    PendingSubKeyHash[Bucket] = PendingSubKey;
+    PendingSubKeys[PendingSubKeyCount++] = PendingSubKey;
+
+    *pBlockOffset = PendingSubKey->KeyCellOffset;
+    return STATUS_SUCCESS;
+}
+
+static int
+RegpComparePendingSubKeys(
+    const void *p1,
+    const void *p2)
+{
+    PPENDING_SUBKEY PendingSubKey1 = *(PPENDING_SUBKEY*)p1;
+    PPENDING_SUBKEY PendingSubKey2 = *(PPENDING_SUBKEY*)p2;
+
+    /* Group the subkeys by parent, sorted by name */
+    if (PendingSubKey1->RegistryHive != PendingSubKey2->RegistryHive)
+        return ((ULONG_PTR)PendingSubKey1->RegistryHive < (ULONG_PTR)PendingSubKey2->RegistryHive) ? -1 : 1;
+
+    if (PendingSubKey1->ParentCellOffset != PendingSubKey2->ParentCellOffset)
+        return (PendingSubKey1->ParentCellOffset < PendingSubKey2->ParentCellOffset) ? -1 : 1;
+
+    return RegpCompareKeyNames(&PendingSubKey1->Name, &PendingSubKey2->Name);
+}
+
+static VOID
+RegpLinkPendingSubKeys(VOID)
+{
+    NTSTATUS Status;
+    PPENDING_SUBKEY PendingSubKey;
+    ULONG i;
+
+    if (PendingSubKeyCount == 0)
+        return;
+
+    /*
+     * Sorted subkeys are always appended at the end of the
+     * last leaf of their parent, so no entry has to be moved.
+     */
+    qsort(PendingSubKeys, PendingSubKeyCount, sizeof(PPENDING_SUBKEY), RegpComparePendingSubKeys);
+
+    for (i = 0; i < PendingSubKeyCount; ++i)
+    {
+        PendingSubKey = PendingSubKeys[i];
+
+        Status = CmiLinkSubKey(PendingSubKey->RegistryHive,
+                               PendingSubKey->ParentCellOffset,
+                               PendingSubKey->KeyCellOffset,
+                               &PendingSubKey->Name);
+        if (!NT_SUCCESS(Status))
+        {
+            DPRINT1("Could not link subkey '%.*S', Status 0x%08x\n",
+                    (int)(PendingSubKey->Name.Length / sizeof(WCHAR)), PendingSubKey->Name.Buffer, Status);
+        }
+
+        free(PendingSubKey);
+    }
+
+    PendingSubKeyCount = 0;
+    memset(PendingSubKeyHash, 0, sizeof(PendingSubKeyHash));
+}
+
 static LONG
 RegpCreateOrOpenKey(
     IN HKEY hParentKey,
@@ -404,6 +667,7 @@ RegpCreateOrOpenKey(
     PCM_KEY_NODE ParentKeyCell;
     PLIST_ENTRY Ptr;
     HCELL_INDEX BlockOffset;
+    ULONG Depth;
 
     DPRINT("RegpCreateOrOpenKey('%S')\n", KeyName);
 
@@ -425,6 +689,33 @@ RegpCreateOrOpenKey(
     }
 
     LocalKeyName = (PWSTR)KeyName;
+    Depth = 0;
+
+    /* Skip the part of the path that was already resolved by the previous call */
+    if (KeyPathCache.StartHive == ParentRegistryHive &&
+        KeyPathCache.StartCellOffset == ParentCellOffset)
+    {
+        while (Depth < KeyPathCache.Depth && RegpMatchKeyPathCache(KeyName, Depth))
+        {
+            ParentRegistryHive = KeyPathCache.Components[Depth].RegistryHive;
+            ParentCellOffset = KeyPathCache.Components[Depth].KeyCellOffset;
+            LocalKeyName = (PWSTR)KeyName + KeyPathCache.Components[Depth].NameEnd;
+            if (*LocalKeyName == OBJ_NAME_PATH_SEPARATOR)
+                LocalKeyName++;
+            Depth++;
+        }
+    }
+    else
+    {
+        KeyPathCache.StartHive = ParentRegistryHive;
+        KeyPathCache.StartCellOffset = ParentCellOffset;
+    }
+
+    /* Remember this path for the next call */
+    KeyPathCache.Depth = Depth;
+    KeyPathCache.PathLength = (ULONG)min(strlenW(KeyName), KEY_PATH_CACHE_LENGTH);
+    memcpy(KeyPathCache.Path, KeyName, KeyPathCache.PathLength * sizeof(WCHAR));
+
     for (;;)
     {
         End = (PWSTR)strchrW(LocalKeyName, OBJ_NAME_PATH_SEPARATOR);
@@ -451,6 +742,9 @@ RegpCreateOrOpenKey(
         VERIFY_KEY_CELL(ParentKeyCell);
 
         BlockOffset = CmpFindSubKeyByName(&ParentRegistryHive->Hive, ParentKeyCell, &KeyString);
+        if (BlockOffset == HCELL_NIL && PendingSubKeyCount != 0)
+            BlockOffset = RegpFindPendingSubKey(ParentRegistryHive, ParentCellOffset, &KeyString);
+
         if (BlockOffset != HCELL_NIL)
         {
             Status = STATUS_SUCCESS;
@@ -470,6 +764,14 @@ RegpCreateOrOpenKey(
                 Ptr = Ptr->Flink;
             }
         }
+        else if (AllowCreation && BulkLoadMode) // && (BlockOffset == HCELL_NIL)
+        {
+            Status = RegpCreatePendingSubKey(ParentRegistryHive,
+                                             ParentCellOffset,
+                                             &KeyString,
+                                             Volatile,
+                                             &BlockOffset);
+        }
         else if (AllowCreation) // && (BlockOffset == HCELL_NIL)
         {
             Status = CmiAddSubKey(ParentRegistryHive,
@@ -493,6 +795,19 @@ RegpCreateOrOpenKey(
         }
 
         ParentCellOffset = BlockOffset;
+
+        /* Add this component to the path cache, if it fits */
+        if (Depth == KeyPathCache.Depth && Depth < KEY_PATH_CACHE_DEPTH &&
+            (ULONG)(LocalKeyName - KeyName) + KeyString.Length / sizeof(WCHAR) <= KeyPathCache.PathLength)
+        {
+            KeyPathCache.Components[Depth].NameEnd = (ULONG)(LocalKeyName - KeyName) +
+                                                     KeyString.Length / sizeof(WCHAR);
+            KeyPathCache.Components[Depth].RegistryHive = ParentRegistryHive;
+            KeyPathCache.Components[Depth].KeyCellOffset = ParentCellOffset;
+            KeyPathCache.Depth++;
+        }
+        Depth++;
+
         if (End)
             LocalKeyName = End + 1;
         else
@@ -562,6 +877,10 @@ RegDeleteKeyW(
     PCM_KEY_NODE Parent;
     HCELL_INDEX ParentCell;
 
+    /* The key may have pending subkeys, and may be in the path cache */
+    RegpLinkPendingSubKeys();
+    RegpInvalidateKeyPathCache();
+
     if (lpSubKey)
     {
         rc = RegOpenKeyW(hKey, lpSubKey, &hTargetKey);
@@ -1073,6 +1392,7 @@ ConnectRegistry(
     ReparsePoint->DestinationHive = NewKey->RegistryHive;
     ReparsePoint->DestinationKeyCellOffset = NewKey->KeyCellOffset;
     InsertTailList(&CmiReparsePointsHead, &ReparsePoint->ListEntry);
+    RegpInvalidateKeyPathCache();
 
     return TRUE;
 }
@@ -1126,6 +1446,7 @@ CreateSymLink(
     ReparsePoint->DestinationHive = TargetKey->RegistryHive;
     ReparsePoint->DestinationKeyCellOffset = TargetKey->KeyCellOffset;
     InsertTailList(&CmiReparsePointsHead, &ReparsePoint->ListEntry);
+    RegpInvalidateKeyPathCache();
 
     return TRUE;
 }
@@ -1189,12 +1510,30 @@ RegInitializeRegistry(
 #endif
 }
 
+VOID
+RegSetBulkLoadMode(
+    IN BOOL Enable)
+{
+    /* Leaving bulk-load mode makes the new subkeys visible in the hives */
+    if (!Enable)
+        RegpLinkPendingSubKeys();
+
+    BulkLoadMode = Enable;
+}
+
 VOID
 RegShutdownRegistry(VOID)
 {
     PLIST_ENTRY Entry;
     PREPARSE_POINT ReparsePoint;
 
+    /* Release the pending subkeys */
+    RegSetBulkLoadMode(FALSE);
+    free(PendingSubKeys);
+    PendingSubKeys = NULL;
+    PendingSubKeyMax = 0;
+    RegpInvalidateKeyPathCache();
+
     /* Clean up the reparse points list */
     while (!IsListEmpty(&CmiReparsePointsHead))
     {
@@ -53,4 +53,8 @@ RegInitializeRegistry(
 VOID
 RegShutdownRegistry(VOID);
 
+VOID
+RegSetBulkLoadMode(
+    IN BOOL Enable);
+
 /* EOF */
@@ -477,6 +477,7 @@ VOID ScreenEventHandler(PWINDOW_BUFFER_SIZE_RECORD ScreenEvent)
     ResizeTextConsole(&CurrResolution, NULL);
 
     /* Force refresh of all the screen */
+    VgaFullRefresh = TRUE;
     NeedsUpdate = TRUE;
     UpdateRectangle.Left = 0;
     UpdateRectangle.Top  = 0;
@@ -531,6 +532,9 @@ BOOL VgaAttachToConsole(VOID)
     }
     OldConsoleFramebuffer = NULL;
 
+    /* Convert the whole VGA memory again on the next refresh */
+    VgaFullRefresh = TRUE;
+
     return TRUE;
 }
 
@@ -39,6 +39,9 @@
 FAST486_STATE EmulatorContext;
 BOOLEAN CpuRunning = FALSE;
 
+/* Decoded instruction cache for real mode and V86 code */
+static FAST486_ICACHE InstructionCache;
+
 /* No more than 'MaxCpuCallLevel' recursive CPU calls are allowed */
 static const INT MaxCpuCallLevel = 32;
 static INT CpuCallLevel = 0; // == 0: CPU stopped; >= 1: CPU running or halted
@@ -178,6 +181,12 @@ VOID CpuSimulate(VOID)
     CpuCallLevel++;
     DPRINT("CpuSimulate --> Level %d\n", CpuCallLevel);
 
+    /*
+     * The host may have written guest code behind the CPU's back meanwhile,
+     * like the trampolines of nested calls built in the middle of a BOP.
+     */
+    Fast486FlushInstructionCache(&EmulatorContext);
+
     CpuRunning = TRUE;
     while (VdmRunning && CpuRunning)
     {
@@ -231,7 +240,12 @@ BOOLEAN CpuInitialize(VOID)
                       EmulatorBiosOperation,
                       EmulatorIntAcknowledge,
                       EmulatorFpu,
-                      NULL /* TODO: Use a TLB */);
+                      NULL /* TODO: Use a TLB */,
+                      &InstructionCache);
+
+    /* Let the CPU access the unhooked pages directly */
+    Fast486SetMemoryMap(&EmulatorContext, DirectPageTable, TOTAL_PAGES);
+    Fast486SetA20(&EmulatorContext, EmulatorGetA20());
 
     /* Initialize the software callback system and register the emulator BOPs */
     // RegisterBop(BOP_DEBUGGER  , EmulatorDebugBreakBop);
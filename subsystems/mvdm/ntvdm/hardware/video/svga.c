@@ -297,6 +297,42 @@ static COORD CurrResolution   = {0};
 
 static SMALL_RECT UpdateRectangle = { 0, 0, 0, 0 };
 
+/*
+ * Dirty tracking of the VGA memory, in tiles of 256 bytes (that is, 64 addresses
+ * on all the planes). Only the scanlines showing a dirty tile are converted again.
+ */
+#define VGA_TILE_SHIFT 8
+#define VGA_NUM_TILES  (sizeof(VgaMemory) >> VGA_TILE_SHIFT)
+
+static ULONG VgaDirtyTiles[VGA_NUM_TILES / 32];
+
+/* The display state used for the last refresh, any change redraws the whole screen */
+typedef struct _VGA_DISPLAY_STATE
+{
+    PVOID Framebuffer;
+    COORD Resolution;
+    BOOLEAN DoubleWidth;
+    BOOLEAN DoubleHeight;
+    BOOLEAN PalDisable;
+    BYTE GcMode;
+    BYTE GcMisc;
+    BYTE SeqExtMode;
+    DWORD StartAddress;
+    DWORD ScanlineSize;
+    BYTE CrtcRegisters[SVGA_CRTC_MAX_REG];
+    BYTE AcRegisters[VGA_AC_MAX_REG];
+} VGA_DISPLAY_STATE, *PVGA_DISPLAY_STATE;
+
+static VGA_DISPLAY_STATE VgaDisplayState;
+static BOOLEAN VgaFullRefresh = TRUE;
+
+/* One scanline converted to one byte per pixel, including the panning margin */
+#define VGA_MAX_SCANLINE_PIXELS (256 * 9)
+static BYTE VgaScanline[VGA_MAX_SCANLINE_PIXELS + 16];
+
+/* Spreads the bits of a plane byte to the lowest bit of 8 pixels */
+static ULONGLONG VgaPlanarToChunky[256];
+
 
 
 
@@ -704,6 +740,7 @@ static VOID VgaChangeMode(VOID)
 Quit:
 
     /* Trigger a full update of the screen */
+    VgaFullRefresh = TRUE;
     NeedsUpdate = TRUE;
     UpdateRectangle.Left = 0;
     UpdateRectangle.Top  = 0;
@@ -733,9 +770,308 @@ static inline VOID VgaMarkForUpdate(SHORT Row, SHORT Column)
     NeedsUpdate = TRUE;
 }
 
+static inline VOID VgaMarkMemoryDirty(DWORD Index, DWORD Size)
+{
+    DWORD Tile, LastTile;
+
+    if (Size == 0) return;
+
+    LastTile = (Index + Size - 1) >> VGA_TILE_SHIFT;
+    for (Tile = Index >> VGA_TILE_SHIFT; Tile <= LastTile; Tile++)
+    {
+        VgaDirtyTiles[(Tile & (VGA_NUM_TILES - 1)) >> 5] |= 1 << (Tile & 0x1F);
+    }
+}
+
+static inline BOOLEAN VgaIsMemoryDirty(DWORD FirstIndex, DWORD LastIndex)
+{
+    DWORD Tile;
+
+    for (Tile = FirstIndex >> VGA_TILE_SHIFT; Tile <= (LastIndex >> VGA_TILE_SHIFT); Tile++)
+    {
+        if (VgaDirtyTiles[(Tile & (VGA_NUM_TILES - 1)) >> 5] & (1 << (Tile & 0x1F))) return TRUE;
+    }
+
+    return FALSE;
+}
+
+static BOOLEAN VgaIsScanlineDirty(DWORD Address, DWORD AddressSize, DWORD Count)
+{
+    DWORD FirstOffset, LastOffset;
+
+    if (VgaSeqRegisters[SVGA_SEQ_EXT_MODE_REG] & SVGA_SEQ_EXT_MODE_HIGH_RES)
+    {
+        /* The packed pixels are read straight from the memory */
+        return VgaIsMemoryDirty(Address, Address + Count - 1);
+    }
+
+    FirstOffset = WRAP_OFFSET(Address * AddressSize);
+    LastOffset = WRAP_OFFSET((Address + Count - 1) * AddressSize);
+
+    /* Play safe if the scanline wraps around */
+    if (LastOffset < FirstOffset) return TRUE;
+
+    return VgaIsMemoryDirty(FirstOffset * VGA_NUM_BANKS,
+                            LastOffset * VGA_NUM_BANKS + VGA_NUM_BANKS - 1);
+}
+
+static BOOLEAN VgaDisplayStateChanged(VOID)
+{
+    VGA_DISPLAY_STATE State;
+
+    RtlZeroMemory(&State, sizeof(State));
+    State.Framebuffer  = ActiveFramebuffer;
+    State.Resolution   = CurrResolution;
+    State.DoubleWidth  = DoubleWidth;
+    State.DoubleHeight = DoubleHeight;
+    State.PalDisable   = VgaAcPalDisable;
+    State.GcMode       = VgaGcRegisters[VGA_GC_MODE_REG]
+                         & (VGA_GC_MODE_OE | VGA_GC_MODE_SHIFTREG | VGA_GC_MODE_SHIFT256);
+    State.GcMisc       = VgaGcRegisters[VGA_GC_MISC_REG];
+    State.SeqExtMode   = VgaSeqRegisters[SVGA_SEQ_EXT_MODE_REG];
+    State.StartAddress = StartAddressLatch;
+    State.ScanlineSize = ScanlineSizeLatch;
+    RtlCopyMemory(State.CrtcRegisters, VgaCrtcRegisters, sizeof(State.CrtcRegisters));
+    RtlCopyMemory(State.AcRegisters, VgaAcRegisters, sizeof(State.AcRegisters));
+
+    /* The text cursor is drawn separately, ignore it */
+    State.CrtcRegisters[VGA_CRTC_CURSOR_START_REG]    = 0;
+    State.CrtcRegisters[VGA_CRTC_CURSOR_END_REG]      = 0;
+    State.CrtcRegisters[VGA_CRTC_CURSOR_LOC_HIGH_REG] = 0;
+    State.CrtcRegisters[VGA_CRTC_CURSOR_LOC_LOW_REG]  = 0;
+
+    if (RtlCompareMemory(&State, &VgaDisplayState, sizeof(State)) == sizeof(State)) return FALSE;
+
+    VgaDisplayState = State;
+    return TRUE;
+}
+
+static BYTE VgaGetPixel(DWORD Address, DWORD AddressSize, SHORT X)
+{
+    SHORT k;
+    BYTE PixelData = 0;
+
+    if (VgaSeqRegisters[SVGA_SEQ_EXT_MODE_REG] & SVGA_SEQ_EXT_MODE_HIGH_RES)
+    {
+        // TODO: Check for high color modes
+
+        /* 256 color mode */
+        PixelData = VgaMemory[Address + X];
+    }
+    else
+    {
+        /* Check the shifting mode */
+        if (VgaGcRegisters[VGA_GC_MODE_REG] & VGA_GC_MODE_SHIFT256)
+        {
+            /* 4 bits shifted from each plane */
+
+            /* Check if this is 16 or 256 color mode */
+            if (VgaAcRegisters[VGA_AC_CONTROL_REG] & VGA_AC_CONTROL_8BIT)
+            {
+                /* One byte per pixel */
+                PixelData = VgaMemory[WRAP_OFFSET((Address + (X / VGA_NUM_BANKS)) * AddressSize)
+                                      * VGA_NUM_BANKS + (X % VGA_NUM_BANKS)];
+            }
+            else
+            {
+                /* 4-bits per pixel */
+
+                PixelData = VgaMemory[WRAP_OFFSET((Address + (X / (VGA_NUM_BANKS * 2))) * AddressSize)
+                                      * VGA_NUM_BANKS + ((X / 2) % VGA_NUM_BANKS)];
+
+                /* Check if we should use the highest 4 bits or lowest 4 */
+                if ((X % 2) == 0)
+                {
+                    /* Highest 4 */
+                    PixelData >>= 4;
+                }
+                else
+                {
+                    /* Lowest 4 */
+                    PixelData &= 0x0F;
+                }
+            }
+        }
+        else if (VgaGcRegisters[VGA_GC_MODE_REG] & VGA_GC_MODE_SHIFTREG)
+        {
+            /* Check if this is 16 or 256 color mode */
+            if (VgaAcRegisters[VGA_AC_CONTROL_REG] & VGA_AC_CONTROL_8BIT)
+            {
+                // TODO: NOT IMPLEMENTED
+                DPRINT1("8-bit interleaved mode is not implemented!\n");
+            }
+            else
+            {
+                /*
+                 * 2 bits shifted from plane 0 and 2 for the first 4 pixels,
+                 * then 2 bits shifted from plane 1 and 3 for the next 4
+                 */
+                DWORD BankNumber = (X / 4) % 2;
+                DWORD Offset = Address + (X / 8);
+                BYTE LowPlaneData = VgaMemory[WRAP_OFFSET(Offset * AddressSize) * VGA_NUM_BANKS + BankNumber];
+                BYTE HighPlaneData = VgaMemory[WRAP_OFFSET(Offset * AddressSize) * VGA_NUM_BANKS + (BankNumber + 2)];
+
+                /* Extract the two bits from each plane */
+                LowPlaneData  = (LowPlaneData  >> (6 - ((X % 4) * 2))) & 0x03;
+                HighPlaneData = (HighPlaneData >> (6 - ((X % 4) * 2))) & 0x03;
+
+                /* Combine them into the pixel */
+                PixelData = LowPlaneData | (HighPlaneData << 2);
+            }
+        }
+        else
+        {
+            /* 1 bit shifted from each plane */
+
+            /* Check if this is 16 or 256 color mode */
+            if (VgaAcRegisters[VGA_AC_CONTROL_REG] & VGA_AC_CONTROL_8BIT)
+            {
+                /* 8 bits per pixel, 2 on each plane */
+
+                for (k = 0; k < VGA_NUM_BANKS; k++)
+                {
+                    /* The data is on plane k, 4 pixels per byte */
+                    BYTE PlaneData = VgaMemory[WRAP_OFFSET((Address + (X >> 2)) * AddressSize) * VGA_NUM_BANKS + k];
+
+                    /* The mask of the first bit in the pair */
+                    BYTE BitMask = 1 << (((3 - (X % VGA_NUM_BANKS)) * 2) + 1);
+
+                    /* Bits 0, 1, 2 and 3 come from the first bit of the pair */
+                    if (PlaneData & BitMask) PixelData |= 1 << k;
+
+                    /* Bits 4, 5, 6 and 7 come from the second bit of the pair */
+                    if (PlaneData & (BitMask >> 1)) PixelData |= 1 << (k + 4);
+                }
+            }
+            else
+            {
+                /* 4 bits per pixel, 1 on each plane */
+
+                for (k = 0; k < VGA_NUM_BANKS; k++)
+                {
+                    BYTE PlaneData = VgaMemory[WRAP_OFFSET((Address + (X >> 3)) * AddressSize) * VGA_NUM_BANKS + k];
+
+                    /* If the bit on that plane is set, set it */
+                    if (PlaneData & (1 << (7 - (X % 8)))) PixelData |= 1 << k;
+                }
+            }
+        }
+    }
+
+    return PixelData;
+}
+
+static VOID VgaConvertScanline(DWORD Address, DWORD AddressSize, SHORT Width)
+{
+    SHORT X;
+    ULONG Planes;
+
+    if (VgaSeqRegisters[SVGA_SEQ_EXT_MODE_REG] & SVGA_SEQ_EXT_MODE_HIGH_RES)
+    {
+        /* 256 color mode, the pixels are already packed */
+        DWORD Available = (Address < sizeof(VgaMemory)) ? (sizeof(VgaMemory) - Address) : 0;
+
+        /* Width includes the panning slack, don't read past the end of the video memory */
+        if ((DWORD)Width > Available)
+        {
+            RtlZeroMemory(&VgaScanline[Available], Width - Available);
+            Width = (SHORT)Available;
+        }
+
+        RtlCopyMemory(VgaScanline, &VgaMemory[Address], Width);
+    }
+    else if ((VgaGcRegisters[VGA_GC_MODE_REG] & VGA_GC_MODE_SHIFT256)
+             && (VgaAcRegisters[VGA_AC_CONTROL_REG] & VGA_AC_CONTROL_8BIT))
+    {
+        /* One byte per pixel, 4 consecutive pixels on the 4 planes (modes 13h and X) */
+        for (X = 0; X < Width; X += VGA_NUM_BANKS)
+        {
+            *(PULONG)&VgaScanline[X] = *(PULONG)&VgaMemory[WRAP_OFFSET((Address + (X / VGA_NUM_BANKS)) * AddressSize)
+                                                           * VGA_NUM_BANKS];
+        }
+    }
+    else if (!(VgaGcRegisters[VGA_GC_MODE_REG] & (VGA_GC_MODE_SHIFT256 | VGA_GC_MODE_SHIFTREG))
+             && !(VgaAcRegisters[VGA_AC_CONTROL_REG] & VGA_AC_CONTROL_8BIT))
+    {
+        /* 4 bits per pixel, 1 on each plane (modes 0Dh, 0Eh, 10h and 12h) */
+        for (X = 0; X < Width; X += 8)
+        {
+            Planes = *(PULONG)&VgaMemory[WRAP_OFFSET((Address + (X >> 3)) * AddressSize) * VGA_NUM_BANKS];
+
+            *(PULONGLONG)&VgaScanline[X] = VgaPlanarToChunky[Planes & 0xFF]
+                                           | (VgaPlanarToChunky[(Planes >> 8) & 0xFF] << 1)
+                                           | (VgaPlanarToChunky[(Planes >> 16) & 0xFF] << 2)
+                                           | (VgaPlanarToChunky[Planes >> 24] << 3);
+        }
+    }
+    else
+    {
+        /* The other modes are converted pixel by pixel */
+        for (X = 0; X < Width; X++) VgaScanline[X] = VgaGetPixel(Address, AddressSize, X);
+    }
+}
+
+static inline VOID VgaStorePixel(PBYTE GraphicsBuffer, SHORT Row, SHORT Column, BYTE PixelData)
+{
+    /* Take into account DoubleVision mode when checking for pixel updates */
+    if (DoubleWidth && DoubleHeight)
+    {
+        /* Now check if the resulting pixel data has changed */
+        if (GraphicsBuffer[(Row * 2 * CurrResolution.X * 2) + (Column * 2)] != PixelData)
+        {
+            /* Yes, write the new value */
+            GraphicsBuffer[(Row * 2 * CurrResolution.X * 2) + (Column * 2)] = PixelData;
+            GraphicsBuffer[(Row * 2 * CurrResolution.X * 2) + (Column * 2 + 1)] = PixelData;
+            GraphicsBuffer[((Row * 2 + 1) * CurrResolution.X * 2) + (Column * 2)] = PixelData;
+            GraphicsBuffer[((Row * 2 + 1) * CurrResolution.X * 2) + (Column * 2 + 1)] = PixelData;
+
+            /* Mark the specified pixel as changed */
+            VgaMarkForUpdate(Row, Column);
+        }
+    }
+    else if (DoubleWidth && !DoubleHeight)
+    {
+        /* Now check if the resulting pixel data has changed */
+        if (GraphicsBuffer[(Row * CurrResolution.X * 2) + (Column * 2)] != PixelData)
+        {
+            /* Yes, write the new value */
+            GraphicsBuffer[(Row * CurrResolution.X * 2) + (Column * 2)] = PixelData;
+            GraphicsBuffer[(Row * CurrResolution.X * 2) + (Column * 2 + 1)] = PixelData;
+
+            /* Mark the specified pixel as changed */
+            VgaMarkForUpdate(Row, Column);
+        }
+    }
+    else if (!DoubleWidth && DoubleHeight)
+    {
+        /* Now check if the resulting pixel data has changed */
+        if (GraphicsBuffer[(Row * 2 * CurrResolution.X) + Column] != PixelData)
+        {
+            /* Yes, write the new value */
+            GraphicsBuffer[(Row * 2 * CurrResolution.X) + Column] = PixelData;
+            GraphicsBuffer[((Row * 2 + 1) * CurrResolution.X) + Column] = PixelData;
+
+            /* Mark the specified pixel as changed */
+            VgaMarkForUpdate(Row, Column);
+        }
+    }
+    else // if (!DoubleWidth && !DoubleHeight)
+    {
+        /* Now check if the resulting pixel data has changed */
+        if (GraphicsBuffer[Row * CurrResolution.X + Column] != PixelData)
+        {
+            /* Yes, write the new value */
+            GraphicsBuffer[Row * CurrResolution.X + Column] = PixelData;
+
+            /* Mark the specified pixel as changed */
+            VgaMarkForUpdate(Row, Column);
+        }
+    }
+}
+
 static VOID VgaUpdateFramebuffer(VOID)
 {
-    SHORT i, j, k;
+    SHORT i, j;
     DWORD AddressSize = VgaGetAddressSize();
     DWORD Address = StartAddressLatch;
     BYTE BytePanning = (VgaCrtcRegisters[VGA_CRTC_PRESET_ROW_SCAN_REG] >> 5) & 3;
@@ -743,6 +1079,7 @@ static VOID VgaUpdateFramebuffer(VOID)
                        | ((VgaCrtcRegisters[VGA_CRTC_OVERFLOW_REG] & VGA_CRTC_OVERFLOW_LC8) << 4)
                        | ((VgaCrtcRegisters[VGA_CRTC_MAX_SCAN_LINE_REG] & VGA_CRTC_MAXSCANLINE_LC9) << 3);
     BYTE PixelShift = VgaAcRegisters[VGA_AC_HORZ_PANNING_REG] & 0x0F;
+    BOOLEAN FullRefresh;
 
     /*
      * If the console framebuffer is NULL, that means something
@@ -750,13 +1087,21 @@ static VOID VgaUpdateFramebuffer(VOID)
      */
     if (ActiveFramebuffer == NULL) return;
 
+    /* Convert everything again if the display state changed since the last refresh */
+    FullRefresh = VgaDisplayStateChanged() || VgaFullRefresh;
+    VgaFullRefresh = FALSE;
+
     /* Check if we are in text or graphics mode */
     if (ScreenMode == GRAPHICS_MODE)
     {
         /* Graphics mode */
         PBYTE GraphicsBuffer = (PBYTE)ActiveFramebuffer;
         DWORD InterlaceHighBit = VGA_INTERLACE_HIGH_BIT;
-        SHORT X;
+        SHORT X, Width = CurrResolution.X + 8;
+        DWORD Count;
+        BYTE PixelData, AttributeMap[16];
+
+        ASSERT(CurrResolution.X <= VGA_MAX_SCANLINE_PIXELS);
 
         /*
          * Synchronize access to the graphics framebuffer
@@ -781,6 +1126,41 @@ static VOID VgaUpdateFramebuffer(VOID)
             LineCompare /= 1 + (VgaCrtcRegisters[VGA_CRTC_MAX_SCAN_LINE_REG] & 0x1F);
         }
 
+        /*
+         * In 16 color mode, the value is an index to the AC registers
+         * if external palette access is disabled, otherwise (in case
+         * of palette loading) it is a blank pixel.
+         */
+        for (j = 0; j < 16; j++)
+        {
+            if (!VgaAcPalDisable)
+            {
+                AttributeMap[j] = 0;
+            }
+            else if (!(VgaAcRegisters[VGA_AC_CONTROL_REG] & VGA_AC_CONTROL_P54S))
+            {
+                /* Bits 4 and 5 are taken from the palette register */
+                AttributeMap[j] = ((VgaAcRegisters[VGA_AC_COLOR_SEL_REG] << 4) & 0xC0)
+                                  | (VgaAcRegisters[j] & 0x3F);
+            }
+            else
+            {
+                /* Bits 4 and 5 are taken from the color select register */
+                AttributeMap[j] = (VgaAcRegisters[VGA_AC_COLOR_SEL_REG] << 4)
+                                  | (VgaAcRegisters[j] & 0x0F);
+            }
+        }
+
+        /* Find how many addresses (or bytes, for packed pixels) a scanline shows */
+        if (VgaSeqRegisters[SVGA_SEQ_EXT_MODE_REG] & SVGA_SEQ_EXT_MODE_HIGH_RES)
+        {
+            Count = Width;
+        }
+        else
+        {
+            Count = (Width - 1) / ((VgaAcRegisters[VGA_AC_CONTROL_REG] & VGA_AC_CONTROL_8BIT) ? 4 : 8) + 1;
+        }
+
         /* Loop through the scanlines */
         for (i = 0; i < CurrResolution.Y; i++)
         {
@@ -806,210 +1186,33 @@ static VOID VgaUpdateFramebuffer(VOID)
                 Address |= InterlaceHighBit;
             }
 
-            /* Loop through the pixels */
-            for (j = 0; j < CurrResolution.X; j++)
+            /* Skip the scanline if the memory it shows wasn't written to */
+            if (FullRefresh || VgaIsScanlineDirty(Address, AddressSize, Count))
             {
-                BYTE PixelData = 0;
-
-                /* Apply horizontal pixel panning */
-                if (VgaAcRegisters[VGA_AC_CONTROL_REG] & VGA_AC_CONTROL_8BIT)
-                {
-                    X = j + ((PixelShift >> 1) & 0x03);
-                }
-                else
-                {
-                    X = j + ((PixelShift < 8) ? PixelShift : -1);
-                }
+                /* Convert the whole scanline at once */
+                VgaConvertScanline(Address, AddressSize, Width);
 
-                if (VgaSeqRegisters[SVGA_SEQ_EXT_MODE_REG] & SVGA_SEQ_EXT_MODE_HIGH_RES)
+                /* Loop through the pixels */
+                for (j = 0; j < CurrResolution.X; j++)
                 {
-                    // TODO: Check for high color modes
-
-                    /* 256 color mode */
-                    PixelData = VgaMemory[Address + X];
-                }
-                else
-                {
-                    /* Check the shifting mode */
-                    if (VgaGcRegisters[VGA_GC_MODE_REG] & VGA_GC_MODE_SHIFT256)
+                    /* Apply horizontal pixel panning */
+                    if (VgaAcRegisters[VGA_AC_CONTROL_REG] & VGA_AC_CONTROL_8BIT)
                     {
-                        /* 4 bits shifted from each plane */
-
-                        /* Check if this is 16 or 256 color mode */
-                        if (VgaAcRegisters[VGA_AC_CONTROL_REG] & VGA_AC_CONTROL_8BIT)
-                        {
-                            /* One byte per pixel */
-                            PixelData = VgaMemory[WRAP_OFFSET((Address + (X / VGA_NUM_BANKS)) * AddressSize)
-                                                  * VGA_NUM_BANKS + (X % VGA_NUM_BANKS)];
-                        }
-                        else
-                        {
-                            /* 4-bits per pixel */
-
-                            PixelData = VgaMemory[WRAP_OFFSET((Address + (X / (VGA_NUM_BANKS * 2))) * AddressSize)
-                                                  * VGA_NUM_BANKS + ((X / 2) % VGA_NUM_BANKS)];
-
-                            /* Check if we should use the highest 4 bits or lowest 4 */
-                            if ((X % 2) == 0)
-                            {
-                                /* Highest 4 */
-                                PixelData >>= 4;
-                            }
-                            else
-                            {
-                                /* Lowest 4 */
-                                PixelData &= 0x0F;
-                            }
-                        }
-                    }
-                    else if (VgaGcRegisters[VGA_GC_MODE_REG] & VGA_GC_MODE_SHIFTREG)
-                    {
-                        /* Check if this is 16 or 256 color mode */
-                        if (VgaAcRegisters[VGA_AC_CONTROL_REG] & VGA_AC_CONTROL_8BIT)
-                        {
-                            // TODO: NOT IMPLEMENTED
-                            DPRINT1("8-bit interleaved mode is not implemented!\n");
-                        }
-                        else
-                        {
-                            /*
-                             * 2 bits shifted from plane 0 and 2 for the first 4 pixels,
-                             * then 2 bits shifted from plane 1 and 3 for the next 4
-                             */
-                            DWORD BankNumber = (X / 4) % 2;
-                            DWORD Offset = Address + (X / 8);
-                            BYTE LowPlaneData = VgaMemory[WRAP_OFFSET(Offset * AddressSize) * VGA_NUM_BANKS + BankNumber];
-                            BYTE HighPlaneData = VgaMemory[WRAP_OFFSET(Offset * AddressSize) * VGA_NUM_BANKS + (BankNumber + 2)];
-
-                            /* Extract the two bits from each plane */
-                            LowPlaneData  = (LowPlaneData  >> (6 - ((X % 4) * 2))) & 0x03;
-                            HighPlaneData = (HighPlaneData >> (6 - ((X % 4) * 2))) & 0x03;
-
-                            /* Combine them into the pixel */
-                            PixelData = LowPlaneData | (HighPlaneData << 2);
-                        }
+                        X = j + ((PixelShift >> 1) & 0x03);
                     }
                     else
                     {
-                        /* 1 bit shifted from each plane */
-
-                        /* Check if this is 16 or 256 color mode */
-                        if (VgaAcRegisters[VGA_AC_CONTROL_REG] & VGA_AC_CONTROL_8BIT)
-                        {
-                            /* 8 bits per pixel, 2 on each plane */
-
-                            for (k = 0; k < VGA_NUM_BANKS; k++)
-                            {
-                                /* The data is on plane k, 4 pixels per byte */
-                                BYTE PlaneData = VgaMemory[WRAP_OFFSET((Address + (X >> 2)) * AddressSize) * VGA_NUM_BANKS + k];
-
-                                /* The mask of the first bit in the pair */
-                                BYTE BitMask = 1 << (((3 - (X % VGA_NUM_BANKS)) * 2) + 1);
-
-                                /* Bits 0, 1, 2 and 3 come from the first bit of the pair */
-                                if (PlaneData & BitMask) PixelData |= 1 << k;
-
-                                /* Bits 4, 5, 6 and 7 come from the second bit of the pair */
-                                if (PlaneData & (BitMask >> 1)) PixelData |= 1 << (k + 4);
-                            }
-                        }
-                        else
-                        {
-                            /* 4 bits per pixel, 1 on each plane */
-
-                            for (k = 0; k < VGA_NUM_BANKS; k++)
-                            {
-                                BYTE PlaneData = VgaMemory[WRAP_OFFSET((Address + (X >> 3)) * AddressSize) * VGA_NUM_BANKS + k];
-
-                                /* If the bit on that plane is set, set it */
-                                if (PlaneData & (1 << (7 - (X % 8)))) PixelData |= 1 << k;
-                            }
-                        }
+                        X = j + ((PixelShift < 8) ? PixelShift : -1);
                     }
-                }
 
-                if (!(VgaAcRegisters[VGA_AC_CONTROL_REG] & VGA_AC_CONTROL_8BIT))
-                {
-                    /*
-                     * In 16 color mode, the value is an index to the AC registers
-                     * if external palette access is disabled, otherwise (in case
-                     * of palette loading) it is a blank pixel.
-                     */
+                    PixelData = (X >= 0) ? VgaScanline[X] : VgaGetPixel(Address, AddressSize, X);
 
-                    if (VgaAcPalDisable)
+                    if (!(VgaAcRegisters[VGA_AC_CONTROL_REG] & VGA_AC_CONTROL_8BIT))
                     {
-                        if (!(VgaAcRegisters[VGA_AC_CONTROL_REG] & VGA_AC_CONTROL_P54S))
-                        {
-                            /* Bits 4 and 5 are taken from the palette register */
-                            PixelData = ((VgaAcRegisters[VGA_AC_COLOR_SEL_REG] << 4) & 0xC0)
-                                        | (VgaAcRegisters[PixelData & 0x0F] & 0x3F);
-                        }
-                        else
-                        {
-                            /* Bits 4 and 5 are taken from the color select register */
-                            PixelData = (VgaAcRegisters[VGA_AC_COLOR_SEL_REG] << 4)
-                                        | (VgaAcRegisters[PixelData & 0x0F] & 0x0F);
-                        }
+                        PixelData = AttributeMap[PixelData & 0x0F];
                     }
-                    else
-                    {
-                        PixelData = 0;
-                    }
-                }
 
-                /* Take into account DoubleVision mode when checking for pixel updates */
-                if (DoubleWidth && DoubleHeight)
-                {
-                    /* Now check if the resulting pixel data has changed */
-                    if (GraphicsBuffer[(i * 2 * CurrResolution.X * 2) + (j * 2)] != PixelData)
-                    {
-                        /* Yes, write the new value */
-                        GraphicsBuffer[(i * 2 * CurrResolution.X * 2) + (j * 2)] = PixelData;
-                        GraphicsBuffer[(i * 2 * CurrResolution.X * 2) + (j * 2 + 1)] = PixelData;
-                        GraphicsBuffer[((i * 2 + 1) * CurrResolution.X * 2) + (j * 2)] = PixelData;
-                        GraphicsBuffer[((i * 2 + 1) * CurrResolution.X * 2) + (j * 2 + 1)] = PixelData;
-
-                        /* Mark the specified pixel as changed */
-                        VgaMarkForUpdate(i, j);
-                    }
-                }
-                else if (DoubleWidth && !DoubleHeight)
-                {
-                    /* Now check if the resulting pixel data has changed */
-                    if (GraphicsBuffer[(i * CurrResolution.X * 2) + (j * 2)] != PixelData)
-                    {
-                        /* Yes, write the new value */
-                        GraphicsBuffer[(i * CurrResolution.X * 2) + (j * 2)] = PixelData;
-                        GraphicsBuffer[(i * CurrResolution.X * 2) + (j * 2 + 1)] = PixelData;
-
-                        /* Mark the specified pixel as changed */
-                        VgaMarkForUpdate(i, j);
-                    }
-                }
-                else if (!DoubleWidth && DoubleHeight)
-                {
-                    /* Now check if the resulting pixel data has changed */
-                    if (GraphicsBuffer[(i * 2 * CurrResolution.X) + j] != PixelData)
-                    {
-                        /* Yes, write the new value */
-                        GraphicsBuffer[(i * 2 * CurrResolution.X) + j] = PixelData;
-                        GraphicsBuffer[((i * 2 + 1) * CurrResolution.X) + j] = PixelData;
-
-                        /* Mark the specified pixel as changed */
-                        VgaMarkForUpdate(i, j);
-                    }
-                }
-                else // if (!DoubleWidth && !DoubleHeight)
-                {
-                    /* Now check if the resulting pixel data has changed */
-                    if (GraphicsBuffer[i * CurrResolution.X + j] != PixelData)
-                    {
-                        /* Yes, write the new value */
-                        GraphicsBuffer[i * CurrResolution.X + j] = PixelData;
-
-                        /* Mark the specified pixel as changed */
-                        VgaMarkForUpdate(i, j);
-                    }
+                    VgaStorePixel(GraphicsBuffer, i, j, PixelData);
                 }
             }
 
@@ -1048,6 +1251,13 @@ static VOID VgaUpdateFramebuffer(VOID)
         /* Loop through the scanlines */
         for (i = 0; i < CurrResolution.Y; i++)
         {
+            /* Skip the row if the memory it shows wasn't written to */
+            if (!FullRefresh && !VgaIsScanlineDirty(Address, AddressSize, CurrResolution.X))
+            {
+                Address += ScanlineSizeLatch;
+                continue;
+            }
+
             /* Loop through the characters */
             for (j = 0; j < CurrResolution.X; j++)
             {
@@ -1075,6 +1285,9 @@ static VOID VgaUpdateFramebuffer(VOID)
             Address += ScanlineSizeLatch;
         }
     }
+
+    /* Everything written so far is now on the screen */
+    RtlZeroMemory(VgaDirtyTiles, sizeof(VgaDirtyTiles));
 }
 
 static VOID VgaUpdateTextCursor(VOID)
@@ -2028,6 +2241,9 @@ BOOLEAN FASTCALL VgaWriteMemory(ULONG Address, PVOID Buffer, ULONG Size)
                 /* Copy the value to the VGA memory */
                 VgaMemory[VideoAddress * VGA_NUM_BANKS + j] = VgaTranslateByteForWriting(BufPtr[i], j);
             }
+
+            /* The scanlines showing this address must be refreshed */
+            VgaMarkMemoryDirty(VideoAddress * VGA_NUM_BANKS, VGA_NUM_BANKS);
         }
     }
     else
@@ -2040,6 +2256,7 @@ BOOLEAN FASTCALL VgaWriteMemory(ULONG Address, PVOID Buffer, ULONG Size)
         /* Just copy to the video memory */
         VideoAddress = VgaTranslateAddress(Address);
         VideoMemory = &VgaMemory[VideoAddress + (Address & 3)];
+        VgaMarkMemoryDirty(VideoAddress + (Address & 3), Size);
 
         switch (Size)
         {
@@ -2074,6 +2291,7 @@ BOOLEAN FASTCALL VgaWriteMemory(ULONG Address, PVOID Buffer, ULONG Size)
 VOID VgaClearMemory(VOID)
 {
     RtlZeroMemory(VgaMemory, sizeof(VgaMemory));
+    VgaFullRefresh = TRUE;
 }
 
 VOID VgaWriteTextModeFont(UINT FontNumber, CONST UCHAR* FontData, UINT Height)
@@ -2095,12 +2313,26 @@ VOID VgaWriteTextModeFont(UINT FontNumber, CONST UCHAR* FontData, UINT Height)
             VgaMemory[(i * VGA_MAX_FONT_HEIGHT + j) * VGA_NUM_BANKS + VGA_FONT_BANK] = 0;
         }
     }
+
+    VgaMarkMemoryDirty(0, VGA_FONT_SIZE * VGA_NUM_BANKS);
 }
 
 BOOLEAN VgaInitialize(HANDLE TextHandle)
 {
+    UINT i, j;
+
     if (!VgaConsoleInitialize(TextHandle)) return FALSE;
 
+    /* Build the planar to chunky conversion table, the leftmost pixel is the highest bit */
+    for (i = 0; i < ARRAYSIZE(VgaPlanarToChunky); i++)
+    {
+        VgaPlanarToChunky[i] = 0;
+        for (j = 0; j < 8; j++)
+        {
+            if (i & (0x80 >> j)) VgaPlanarToChunky[i] |= 1ULL << (j * 8);
+        }
+    }
+
     /* Clear the SEQ, GC, CRTC and AC registers */
     RtlZeroMemory(VgaSeqRegisters , sizeof(VgaSeqRegisters ));
     RtlZeroMemory(VgaGcRegisters  , sizeof(VgaGcRegisters  ));
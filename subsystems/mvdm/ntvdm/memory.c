@@ -40,6 +40,9 @@ static LIST_ENTRY HookList;
 static PMEM_HOOK PageTable[TOTAL_PAGES] = { NULL };
 static BOOLEAN A20Line = FALSE;
 
+/* Host address of each page the CPU can access directly, NULL if hooked */
+PVOID DirectPageTable[TOTAL_PAGES] = { NULL };
+
 /* PRIVATE FUNCTIONS **********************************************************/
 
 static inline VOID
@@ -134,6 +137,25 @@ WritePage(PMEM_HOOK Hook, ULONG Address, PVOID Buffer, ULONG Size)
     }
 }
 
+static VOID
+MemUpdateDirectPageTable(VOID)
+{
+    ULONG i, Page;
+
+    for (i = 0; i < TOTAL_PAGES; i++)
+    {
+        /* If the A20 line is disabled, mask bit 20 */
+        Page = A20Line ? i : (i & ~(1 << (20 - 12)));
+
+        /*
+         * Hooked pages must go through EmulatorReadMemory/EmulatorWriteMemory.
+         * Note that when the VDM memory starts at host address 0, the first
+         * page always does too, since NULL means the page is hooked.
+         */
+        DirectPageTable[i] = (PageTable[Page] == NULL) ? REAL_TO_PHYS(Page << 12) : NULL;
+    }
+}
+
 /* PUBLIC FUNCTIONS ***********************************************************/
 
 VOID FASTCALL EmulatorReadMemory(PFAST486_STATE State, ULONG Address, PVOID Buffer, ULONG Size)
@@ -185,14 +207,18 @@ VOID FASTCALL EmulatorWriteMemory(PFAST486_STATE State, ULONG Address, PVOID Buf
     ULONG i, Offset, Length;
     ULONG FirstPage, LastPage;
 
-    UNREFERENCED_PARAMETER(State);
-
     /* If the A20 line is disabled, mask bit 20 */
     if (!A20Line) Address &= ~(1 << 20);
 
     if (Address >= MAX_ADDRESS) return;
     Size = min(Size, MAX_ADDRESS - Address);
 
+    /*
+     * The host (DMA, BIOS, mouse driver...) writes through here as well,
+     * drop any code the CPU has decoded from this memory.
+     */
+    Fast486InvalidateInstructionCache(State, Address, Size);
+
     FirstPage = Address >> 12;
     LastPage = (Address + Size - 1) >> 12;
 
@@ -271,7 +297,13 @@ VOID FASTCALL EmulatorCopyMemory(PFAST486_STATE State, ULONG DestAddress, ULONG
 
 VOID EmulatorSetA20(BOOLEAN Enabled)
 {
+    if (A20Line == Enabled) return;
+
     A20Line = Enabled;
+    MemUpdateDirectPageTable();
+
+    /* The CPU keys its decoded instruction cache on the gated address */
+    Fast486SetA20(&EmulatorContext, Enabled);
 }
 
 BOOLEAN EmulatorGetA20(VOID)
@@ -343,6 +375,7 @@ MemInstallFastMemoryHook(PVOID Address,
     /* Add the hook entry to the page table */
     for (i = FirstPage; i <= LastPage; i++) PageTable[i] = Hook;
 
+    MemUpdateDirectPageTable();
     return TRUE;
 }
 
@@ -371,6 +404,7 @@ MemRemoveFastMemoryHook(PVOID Address, ULONG Size)
         PageTable[i] = NULL;
     }
 
+    MemUpdateDirectPageTable();
     return TRUE;
 }
 
@@ -439,8 +473,13 @@ VdmFlushCache(IN USHORT   Segment,
               IN ULONG    Size,
               IN VDM_MODE Mode)
 {
-    // FIXME
-    UNIMPLEMENTED;
+    /* The whole cache is flushed, there is no need to translate the address */
+    UNREFERENCED_PARAMETER(Segment);
+    UNREFERENCED_PARAMETER(Offset);
+    UNREFERENCED_PARAMETER(Size);
+    UNREFERENCED_PARAMETER(Mode);
+
+    Fast486FlushInstructionCache(&EmulatorContext);
     return TRUE;
 }
 
@@ -539,6 +578,7 @@ VDDInstallMemoryHook(IN HANDLE hVdd,
     /* Add the hook entry to the page table */
     for (i = FirstPage; i <= LastPage; i++) PageTable[i] = Hook;
 
+    MemUpdateDirectPageTable();
     return TRUE;
 }
 
@@ -595,6 +635,7 @@ VDDDeInstallMemoryHook(IN HANDLE hVdd,
         PageTable[i] = NULL;
     }
 
+    MemUpdateDirectPageTable();
     return TRUE;
 }
 
@@ -773,6 +814,9 @@ MemInitialize(VOID)
      * retrieve the exact CS:IP where the problem happens.
      */
     RtlFillMemory(BaseAddress, MAX_ADDRESS, 0xCC);
+
+    /* No pages are hooked yet, the CPU can access all of them directly */
+    MemUpdateDirectPageTable();
     return TRUE;
 }
 
@@ -789,6 +833,9 @@ MemCleanup(VOID)
         RtlFreeHeap(RtlGetProcessHeap(), 0, CONTAINING_RECORD(Pointer, MEM_HOOK, Entry));
     }
 
+    /* The memory is going away, don't let the CPU access it anymore */
+    RtlZeroMemory(DirectPageTable, sizeof(DirectPageTable));
+
     /* Decommit the VDM memory */
     Status = NtFreeVirtualMemory(NtCurrentProcess(),
                                  &BaseAddress,
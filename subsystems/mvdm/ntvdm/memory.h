@@ -29,6 +29,8 @@ typedef BOOLEAN
     ULONG Size
 );
 
+extern PVOID DirectPageTable[TOTAL_PAGES];
+
 /* FUNCTIONS ******************************************************************/
 
 BOOLEAN MemInitialize(VOID);